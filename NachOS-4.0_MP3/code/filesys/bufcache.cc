@@ -0,0 +1,1362 @@
+// bufcache.cc
+//	Routines to manage a cache of disk sectors in front of the
+//	synchronous disk.
+//
+//	The cache is a fixed array of entries.  A table indexed by sector
+//	number tells us which entry (if any) holds a sector, so a lookup
+//	is a single array reference.  Entries are kept on a doubly linked
+//	LRU list; on a miss we reuse the entry at the tail of the list,
+//	writing it back first if it is dirty.  With 2Q, there is a second
+//	list, for the entries on probation, and the miss reuses the tail
+//	of that one once it is long enough.  Dirty sectors are written
+//	back in runs of consecutive sectors, one disk request per run.
+//
+//	A lock provides mutual exclusion between threads using the cache.
+//	It is held across the disk I/O done for a miss, which is fine
+//	since the disk can only handle one request at a time anyway --
+//	unless the cache is in shards, each with a lock and an LRU list
+//	of its own, so that only the shard of the miss waits.  A run of
+//	sectors is then done a piece at a time, each piece the part of
+//	it in one shard, under that shard's lock.
+//
+//	Prefetches are different: the lock is only held while the entries
+//	are set aside and the request is queued.  The disk interrupt
+//	handler then copies the data in and marks the entries valid; it
+//	cannot acquire the lock, so it touches nothing but the in-flight
+//	entries, which nobody else may use until they are valid.
+//
+//	The flusher takes the locks like anyone else, a shard at a time:
+//	once to find the dirty entries, and again, in order of sector
+//	number, to write back the ones it picks; what it does is what an
+//	eviction would have done anyway, only sooner and in sector order.
+//
+//	Checksums are taken and checked right next to the disk requests,
+//	on the very bytes that go out or came in, so every way a sector
+//	has to and from the disk is covered, and nothing served from
+//	memory pays for them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "bufcache.h"
+#include "journal.h"
+#include "sectorsum.h"
+#include "debug.h"
+#include "main.h"
+
+// No more than this many sectors are in flight at once, so that a
+// miss can always find an entry to reuse.
+static const int MaxInFlightFraction = 2;
+
+// The flusher is woken once more than 1/DirtyHighFraction of the
+// entries are dirty, and writes back the oldest until no more than
+// 1/DirtyLowFraction are.
+static const int DirtyHighFraction = 2;
+static const int DirtyLowFraction = 4;
+
+// With 2Q, the oldest entry on probation is replaced once more than
+// 1/ProbationFraction of the entries are on it, as in the paper that
+// brought in 2Q, and the ghost list remembers as many sectors as
+// 1/GhostFraction of the entries.  Metadata is kept ahead of data only
+// while at least 1/DataReserveFraction of the entries are not
+// metadata: the read-ahead of a file needs them, or it replaces its
+// own sectors before they are read.
+static const int ProbationFraction = 4;
+static const int GhostFraction = 2;
+static const int DataReserveFraction = 2;
+
+//----------------------------------------------------------------------
+// ReadAhead
+// 	One prefetch request: a run of sectors being read into a staging
+//	buffer.  When the disk is done, CallBack copies them into their
+//	cache entries, and wakes up any thread that was waiting for one
+//	of them.  The last one out deletes the request.
+//----------------------------------------------------------------------
+
+class ReadAhead : public CallBackObj {
+  public:
+    ReadAhead(BufferCache *c, int first, int num);
+    ~ReadAhead();
+    void CallBack();
+
+    BufferCache *cache;			// where the sectors go
+    int firstSector;			// the run being read
+    int numSectors;
+    char *buffer;			// what the disk reads into
+    int waiters;			// threads blocked on "done"
+    Semaphore *done;			// signalled once per waiter
+};
+
+ReadAhead::ReadAhead(BufferCache *c, int first, int num)
+{
+    cache = c;
+    firstSector = first;
+    numSectors = num;
+    buffer = new char[num * SectorSize];
+    waiters = 0;
+    done = new Semaphore("read ahead", 0);
+}
+
+ReadAhead::~ReadAhead()
+{
+    delete [] buffer;
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// ReadAhead::CallBack
+// 	Called from the disk interrupt handler when the run has been
+//	read.  In-flight entries are never evicted, so every sector is
+//	still where Prefetch put it.  They are checked against their
+//	checksums first, if there are any.
+//----------------------------------------------------------------------
+
+void
+ReadAhead::CallBack()
+{
+    if (cache->sums != NULL)
+	cache->sums->Verify(firstSector, numSectors, buffer);
+    for (int i = 0; i < numSectors; i++) {
+	CacheEntry *e = &cache->entries[cache->slotOf[firstSector + i]];
+	ASSERT(e->sector == firstSector + i && e->inFlight == this);
+	bcopy(&buffer[i * SectorSize], e->data, SectorSize);
+	e->inFlight = NULL;
+    }
+    cache->ShardOf(firstSector)->numInFlight -= numSectors;
+    if (waiters == 0) {
+	delete this;
+    } else {
+	for (int i = 0; i < waiters; i++)
+	    done->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// CacheShard::CacheShard
+// 	Initialize a shard of "count" free entries, starting at "firstEntry"
+//	of "e", chained together in order.  "lockName" is kept.
+//----------------------------------------------------------------------
+
+CacheShard::CacheShard(CacheEntry *e, int firstEntry, int count,
+		       char *lockName)
+{
+    lock = new Lock(lockName);
+    entries = e;
+    first = firstEntry;
+    numEntries = count;
+    for (int i = first; i < first + count; i++) {
+	entries[i].sector = -1;
+	entries[i].dirty = FALSE;
+	entries[i].dirtiedAt = 0;
+	entries[i].inFlight = NULL;
+	entries[i].probation = FALSE;
+	entries[i].metadata = FALSE;
+	entries[i].loadedAt = 0;
+	entries[i].prev = (i > first) ? i - 1 : -1;
+	entries[i].next = (i + 1 < first + count) ? i + 1 : -1;
+    }
+    lruHead = first;
+    lruTail = first + count - 1;
+    probationHead = probationTail = -1;
+    numLoads = 0;
+    numProbation = 0;
+    numMetadata = 0;
+    ghostCapacity = max(1, count / GhostFraction);
+    ghosts = new int[ghostCapacity];
+    ghostsAdded = 0;
+    runBuffer = new char[count * SectorSize];
+    numInFlight = 0;
+    numDirty = 0;
+    oldestDirty = 0;
+}
+
+CacheShard::~CacheShard()
+{
+    delete [] ghosts;
+    delete [] runBuffer;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize an empty buffer cache.
+//
+//	"disk" -- the synchronous disk that misses are sent to
+//	"size" -- the number of sectors to keep in memory
+//	"writeThru" -- if TRUE, write every modified sector to disk
+//		immediately; otherwise wait until it is evicted or flushed
+//	"shardCount" -- how many shards to split the entries into; each
+//		gets an equal share of them
+//	"how" -- the replacement policy
+//	"favorMetadata" -- keep the sectors marked as metadata ahead of
+//		the rest
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(SynchDisk *synchDisk, int size, bool writeThru,
+			 int shardCount, CachePolicy how, bool favorMetadata)
+{
+    ASSERT(size > 0);
+    ASSERT(shardCount >= 1 && shardCount <= MaxCacheShards
+	   && size % shardCount == 0);
+
+    disk = synchDisk;
+    writeThrough = writeThru;
+    policy = how;
+    metadataFirst = favorMetadata;
+    journal = NULL;
+    sums = NULL;
+
+    numEntries = size;
+    entries = new CacheEntry[numEntries];
+    slotOf = new int[NumSectors];
+    for (int i = 0; i < NumSectors; i++)
+	slotOf[i] = -1;
+    ghostAt = NULL;
+    if (policy == Cache2Q) {
+	ghostAt = new int[NumSectors];
+	for (int i = 0; i < NumSectors; i++)
+	    ghostAt[i] = -1;
+    }
+
+    numShards = shardCount;
+    shards = new CacheShard *[numShards];
+    for (int i = 0; i < numShards; i++) {
+	char *name = new char[32];
+
+	if (numShards == 1)
+	    strcpy(name, "buffer cache lock");
+	else
+	    sprintf(name, "buffer cache shard %d", i);
+	shards[i] = new CacheShard(entries, i * (size / numShards),
+				   size / numShards, name);
+    }
+    flusherWakeup = NULL;
+    flusherWoken = FALSE;
+    flusherTimed = FALSE;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	Wait for any prefetch still in flight, write back anything still
+//	dirty, then de-allocate the cache.  Must be called while the disk
+//	and interrupts are still alive.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    for (int i = 0; i < numShards; i++) {
+	CacheShard *s = shards[i];
+
+	s->lock->Acquire();
+	for (int j = s->first; j < s->first + s->numEntries; j++) {
+	    while (entries[j].inFlight != NULL)
+		WaitFor(s, entries[j].inFlight);
+	}
+	s->lock->Release();
+    }
+    Flush();
+    for (int i = 0; i < numShards; i++)
+	delete shards[i];
+    delete [] shards;
+    delete [] entries;
+    delete [] slotOf;
+    delete [] ghostAt;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ShardOf
+// 	Return the shard "sectorNumber" belongs to: each track's sectors
+//	go to the next shard along, so that a run within a track is in
+//	one shard, and the tracks a file is in are spread over them.
+//----------------------------------------------------------------------
+
+CacheShard *
+BufferCache::ShardOf(int sectorNumber)
+{
+    return shards[(sectorNumber / SectorsPerTrack) % numShards];
+}
+
+//----------------------------------------------------------------------
+// BufferCache::PieceEnd
+// 	Return where the sectors from "sectorNumber" up to "end" that are
+//	in the same shard as it stop: at the end of its track, if there
+//	is more than one shard, or at "end".
+//----------------------------------------------------------------------
+
+int
+BufferCache::PieceEnd(int sectorNumber, int end)
+{
+    if (numShards == 1)
+	return end;
+    return min(end, (sectorNumber / SectorsPerTrack + 1) * SectorsPerTrack);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::StartFlusher
+// 	Fork the flusher thread, which sleeps until the cache has dirty
+//	sectors to write back (see CheckFlusher).  In write-through mode
+//	nothing is ever dirty, so there is no flusher.
+//----------------------------------------------------------------------
+
+void
+BufferCache::StartFlusher()
+{
+    Thread *t;
+
+    if (writeThrough || flusherWakeup != NULL)
+	return;
+    flusherWakeup = new Semaphore("buffer cache flusher", 0);
+    t = new Thread("flusher", 1, SmallStackSize);
+    t->ioClass = IoIdle;
+    t->Fork((VoidFunctionPtr) BufferCache::Flusher, (void *) this);
+}
+
+//----------------------------------------------------------------------
+// CacheShard::Unlink / PushFront / PushBack
+// 	Maintain the shard's lists: the LRU list, and the probation list
+//	of 2Q, whichever the entry's "probation" says it is on.  Unlink
+//	takes an entry off its list, PushFront puts it on as the most
+//	recently used entry, and PushBack as the least.
+//----------------------------------------------------------------------
+
+void
+CacheShard::Unlink(int which)
+{
+    CacheEntry *e = &entries[which];
+    int &head = e->probation ? probationHead : lruHead;
+    int &tail = e->probation ? probationTail : lruTail;
+
+    if (e->prev != -1)
+	entries[e->prev].next = e->next;
+    else
+	head = e->next;
+    if (e->next != -1)
+	entries[e->next].prev = e->prev;
+    else
+	tail = e->prev;
+    e->prev = e->next = -1;
+    if (e->probation)
+	numProbation--;
+}
+
+void
+CacheShard::PushFront(int which)
+{
+    CacheEntry *e = &entries[which];
+    int &head = e->probation ? probationHead : lruHead;
+    int &tail = e->probation ? probationTail : lruTail;
+
+    e->prev = -1;
+    e->next = head;
+    if (head != -1)
+	entries[head].prev = which;
+    head = which;
+    if (tail == -1)
+	tail = which;
+    if (e->probation)
+	numProbation++;
+}
+
+void
+CacheShard::PushBack(int which)
+{
+    CacheEntry *e = &entries[which];
+    int &head = e->probation ? probationHead : lruHead;
+    int &tail = e->probation ? probationTail : lruTail;
+
+    e->next = -1;
+    e->prev = tail;
+    if (tail != -1)
+	entries[tail].next = which;
+    tail = which;
+    if (head == -1)
+	head = which;
+    if (e->probation)
+	numProbation++;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBackRun
+// 	If "sectorNumber" is cached and dirty, write it back to disk
+//	together with the dirty cached sectors that directly follow it,
+//	as one disk request, and mark them all clean.  Return the number
+//	of sectors written (0 if "sectorNumber" was clean or not cached).
+//
+//	Sectors are usually dirtied in runs (a file written sequentially),
+//	so when one of them is evicted, its neighbours will soon be too;
+//	it is much cheaper to write them back now, in one go.  The run
+//	stops where the shard "s", whose lock is held, does.
+//----------------------------------------------------------------------
+
+int
+BufferCache::WriteBackRun(CacheShard *s, int sectorNumber)
+{
+    int run, limit = PieceEnd(sectorNumber, NumSectors) - sectorNumber;
+
+    ASSERT(s == ShardOf(sectorNumber));
+    for (run = 0; run < limit; run++) {
+	int which = slotOf[sectorNumber + run];
+	if (which == -1 || !entries[which].dirty)
+	    break;
+	bcopy(entries[which].data, &s->runBuffer[run * SectorSize], SectorSize);
+	SetDirty(s, which, FALSE);
+    }
+    if (run > 0) {
+	DEBUG(dbgFile, "Buffer cache writing back " << run << " sectors at " << sectorNumber);
+	if (sums != NULL)
+	    sums->Record(sectorNumber, run, s->runBuffer);
+	disk->WriteSectors(sectorNumber, run, s->runBuffer);
+    }
+    return run;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WaitFor
+// 	Wait for a prefetch to arrive.  The lock of the shard "s" is
+//	given up meanwhile, so the caller must look its sector up again
+//	afterwards.
+//----------------------------------------------------------------------
+
+void
+BufferCache::WaitFor(CacheShard *s, ReadAhead *request)
+{
+    ASSERT(s->lock->IsHeldByCurrentThread());
+    request->waiters++;
+    s->lock->Release();
+    request->done->P();
+    if (--request->waiters == 0)	// the disk is done with it
+	delete request;
+    s->lock->Acquire();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Reassign
+// 	Give the entry of the shard "s" that the policy picks (see
+//	Victim) to "sectorNumber", which must not be cached, and make it
+//	the most recently used entry: on the LRU list, or with 2Q on the
+//	probation list, unless the sector is a ghost.  The entry is
+//	written back first if it is dirty, and its sector becomes a ghost
+//	if it was on probation; its contents are then garbage, and the
+//	caller must fill them in.
+//----------------------------------------------------------------------
+
+int
+BufferCache::Reassign(CacheShard *s, int sectorNumber)
+{
+    int which = Victim(s);
+    CacheEntry *e = &entries[which];
+
+    ASSERT(slotOf[sectorNumber] == -1);
+    if (e->sector != -1) {
+	WriteBackRun(s, e->sector);
+	slotOf[e->sector] = -1;
+	if (e->probation)
+	    AddGhost(s, e->sector);
+    }
+    if (e->metadata) {
+	e->metadata = FALSE;
+	s->numMetadata--;
+    }
+    s->Unlink(which);
+    if (policy == Cache2Q) {
+	e->probation = !TakeGhost(s, sectorNumber);
+	if (!e->probation)
+	    kernel->stats->numCacheGhostHits++;
+    }
+    s->PushFront(which);
+    e->sector = sectorNumber;
+    e->loadedAt = s->numLoads++;
+    slotOf[sectorNumber] = which;
+    return which;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Victim
+// 	Return the entry of the shard "s" that a miss should reuse: the
+//	oldest that may be (see Oldest) of the LRU list -- unless, with
+//	2Q, that entry is in use and more than 1/ProbationFraction of the
+//	entries are on probation, or the LRU list has none to give but
+//	metadata being kept; then the oldest on probation.  A free entry
+//	is always taken first; they start out at the tail of the LRU
+//	list.  Since no more than half the entries are ever in flight,
+//	one of the lists has one that is not.
+//----------------------------------------------------------------------
+
+int
+BufferCache::Victim(CacheShard *s)
+{
+    int which = Oldest(s, s->lruTail);
+
+    if (policy == Cache2Q && (which == -1 || Kept(s, which)
+		|| (entries[which].sector != -1
+		    && s->numProbation > s->numEntries / ProbationFraction))) {
+	int other = Oldest(s, s->probationTail);
+
+	if (other != -1)
+	    which = other;
+    }
+    ASSERT(which != -1);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Oldest
+// 	Return the first entry, going from "from" towards the head of its
+//	list, that is not in flight and is not metadata being kept (see
+//	Kept); or, if all of them are, the first that is not in flight.
+//	-1 if there is none.
+//----------------------------------------------------------------------
+
+int
+BufferCache::Oldest(CacheShard *s, int from)
+{
+    int kept = -1;
+
+    for (int i = from; i != -1; i = entries[i].prev) {
+	if (entries[i].inFlight != NULL)
+	    continue;
+	if (!Kept(s, i))
+	    return i;
+	if (kept == -1)
+	    kept = i;
+    }
+    return kept;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Kept
+// 	Return TRUE if entry "which" holds metadata that should be kept
+//	ahead of file data: with -cmeta, as long as no more than all but
+//	1/DataReserveFraction of the entries of the shard "s" do.
+//----------------------------------------------------------------------
+
+bool
+BufferCache::Kept(CacheShard *s, int which)
+{
+    return metadataFirst && entries[which].metadata
+	&& s->numMetadata <= s->numEntries - s->numEntries / DataReserveFraction;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::AddGhost / TakeGhost
+// 	Maintain the ghost list of the shard "s": AddGhost puts a sector
+//	dropped from probation in the next slot of the ring, which forgets
+//	the sector in the oldest, and TakeGhost says whether a sector is
+//	still on the list, and forgets it if so.  A sector is on it if
+//	ghostAt says it went into one of the last ghostCapacity slots
+//	filled, and the slot still has it.  A sector taken off leaves its
+//	slot empty until the ring comes round to it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::AddGhost(CacheShard *s, int sectorNumber)
+{
+    s->ghosts[s->ghostsAdded % s->ghostCapacity] = sectorNumber;
+    ghostAt[sectorNumber] = s->ghostsAdded++;
+}
+
+bool
+BufferCache::TakeGhost(CacheShard *s, int sectorNumber)
+{
+    int slot = ghostAt[sectorNumber];
+
+    if (slot == -1)
+	return FALSE;
+    ghostAt[sectorNumber] = -1;
+    if (slot < s->ghostsAdded - s->ghostCapacity
+	    || s->ghosts[slot % s->ghostCapacity] != sectorNumber)
+	return FALSE;
+    s->ghosts[slot % s->ghostCapacity] = -1;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Lookup
+// 	Return the entry holding "sectorNumber", and make it the most
+//	recently used -- unless it is on probation, where only a hit
+//	long after the sector was loaded counts, and takes it off.  If
+//	the sector is being prefetched, wait for it to arrive.  If it is
+//	not cached, an entry is reassigned to it (see Reassign), and the
+//	caller must fill in its contents.
+//
+//	"s" -- the sector's shard, whose lock is held
+//	"sectorNumber" -- the sector we want
+//	"hit" -- set to TRUE if the sector was already cached
+//----------------------------------------------------------------------
+
+int
+BufferCache::Lookup(CacheShard *s, int sectorNumber, bool *hit)
+{
+    int which;
+
+    ASSERT(s->lock->IsHeldByCurrentThread());
+
+    while ((which = slotOf[sectorNumber]) != -1 &&
+				entries[which].inFlight != NULL) {
+	WaitFor(s, entries[which].inFlight);
+    }
+    if (which != -1) {
+	*hit = TRUE;
+	kernel->stats->numCacheHits++;
+	kernel->currentThread->stats->numCacheHits++;
+	if (!entries[which].probation) {
+	    s->Unlink(which);
+	    s->PushFront(which);
+	} else if (s->numLoads - entries[which].loadedAt
+				> s->numEntries / ProbationFraction) {
+	    s->Unlink(which);
+	    entries[which].probation = FALSE;
+	    s->PushFront(which);
+	}
+    } else {
+	*hit = FALSE;
+	kernel->stats->numCacheMisses++;
+	which = Reassign(s, sectorNumber);
+    }
+    return which;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Present
+// 	Return TRUE if "sectorNumber" can be read without going to the
+//	disk: it is cached, or the journal has a copy of it.
+//----------------------------------------------------------------------
+
+bool
+BufferCache::Present(int sectorNumber)
+{
+    return slotOf[sectorNumber] != -1
+	|| (journal != NULL && journal->Holds(sectorNumber));
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadIn
+// 	Fill in an entry Lookup has just given to a sector that was not
+//	cached: from the journal if it has the sector, since that is
+//	newer than what is on disk, and otherwise from the disk, which
+//	is checked against its checksum.
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadIn(int which)
+{
+    CacheEntry *e = &entries[which];
+
+    if (journal != NULL && journal->Lookup(e->sector, e->data))
+	return;
+    disk->ReadSector(e->sector, e->data);
+    if (sums != NULL)
+	sums->Verify(e->sector, 1, e->data);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+// 	Read the contents of a sector, from the cache if it is there,
+//	otherwise from the disk (in which case it is then cached).
+//
+//	"sectorNumber" -- the disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSector(int sectorNumber, char* data)
+{
+    ReadBytes(sectorNumber, 0, SectorSize, data);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadBytes
+// 	Copy part of a sector straight out of the cache, reading the
+//	sector in first if it is not there.  Reading only part of a
+//	sector this way saves the caller a staging buffer.
+//
+//	"sectorNumber" -- the disk sector to read
+//	"offset" -- where in the sector the bytes we want start
+//	"numBytes" -- how many of them
+//	"into" -- where to put them
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadBytes(int sectorNumber, int offset, int numBytes, char* into)
+{
+    CacheShard *s;
+    bool hit;
+    int which;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT((offset >= 0) && (numBytes >= 0) && (offset + numBytes <= SectorSize));
+    s = ShardOf(sectorNumber);
+    s->lock->Acquire();
+    which = Lookup(s, sectorNumber, &hit);
+    if (!hit) {
+	ReadIn(which);
+    }
+    bcopy(&entries[which].data[offset], into, numBytes);
+    s->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+// 	Write the contents of a buffer into a sector.  The cached copy is
+//	always updated; in write-through mode the disk is written
+//	immediately, otherwise the entry is just marked dirty.
+//
+//	Since the whole sector is overwritten, a miss does not need to
+//	read the old contents first.
+//
+//	In a transaction, the sector goes to the journal instead, and the
+//	entry stays clean -- unless there is no change to it at all, in
+//	which case there is nothing to log.  Outside one, the journal is
+//	first told to forget any copy it has of the sector.
+//
+//	"sectorNumber" -- the disk sector to be written
+//	"data" -- the new contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSector(int sectorNumber, char* data)
+{
+    bool inTransaction = (journal != NULL && journal->InTransaction());
+    bool hit, logged = FALSE;
+    CacheShard *s;
+    int which;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    if (journal != NULL && !inTransaction)
+	journal->Revoke(sectorNumber);
+    s = ShardOf(sectorNumber);
+    s->lock->Acquire();
+    which = Lookup(s, sectorNumber, &hit);
+    if (inTransaction) {
+	if (hit && !entries[which].dirty
+		&& bcmp(data, entries[which].data, SectorSize) == 0) {
+	    s->lock->Release();
+	    return;
+	}
+	logged = journal->Log(sectorNumber, data);
+    }
+    bcopy(data, entries[which].data, SectorSize);
+    if (logged) {
+	SetDirty(s, which, FALSE);
+    } else if (writeThrough) {
+	if (sums != NULL)
+	    sums->Record(sectorNumber, 1, entries[which].data);
+	disk->WriteSector(sectorNumber, entries[which].data);
+    } else {
+	SetDirty(s, which, TRUE);
+	CheckFlusher(s);
+    }
+    s->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSectors
+// 	Read a run of consecutive sectors.  Cached sectors are copied
+//	from memory (and those the journal has, from there); each
+//	stretch of sectors that are not is read with a single disk
+//	request, straight into the caller's buffer, and then entered in
+//	the cache.  With shards, each piece of the run in one shard is
+//	done on its own, under that shard's lock.
+//
+//	"firstSector" -- the first disk sector to read
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the buffer, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSectors(int firstSector, int numSectors, char* data)
+{
+    int sector, end;
+
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+    for (sector = firstSector; sector < firstSector + numSectors; sector = end) {
+	CacheShard *s = ShardOf(sector);
+
+	end = PieceEnd(sector, firstSector + numSectors);
+	s->lock->Acquire();
+	ReadPiece(s, sector, end - sector,
+		  &data[(sector - firstSector) * SectorSize]);
+	s->lock->Release();
+    }
+}
+
+void
+BufferCache::ReadPiece(CacheShard *s, int firstSector, int numSectors,
+		       char *data)
+{
+    bool hit;
+    int which, i, run;
+
+    for (i = 0; i < numSectors; i += run) {
+	if (Present(firstSector + i)) {
+	    which = Lookup(s, firstSector + i, &hit);
+	    if (!hit)
+		ReadIn(which);
+	    bcopy(entries[which].data, &data[i * SectorSize], SectorSize);
+	    run = 1;
+	    continue;
+	}
+	for (run = 1; i + run < numSectors; run++) {
+	    if (Present(firstSector + i + run))
+		break;
+	}
+	disk->ReadSectors(firstSector + i, run, &data[i * SectorSize]);
+	if (sums != NULL)
+	    sums->Verify(firstSector + i, run, &data[i * SectorSize]);
+	for (int j = i; j < i + run; j++) {
+	    which = Lookup(s, firstSector + j, &hit);
+	    bcopy(&data[j * SectorSize], entries[which].data, SectorSize);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSectors
+// 	Write a run of consecutive sectors.  Every sector is updated in
+//	the cache; in write-through mode the whole run then goes to disk
+//	as one request, or as one for each piece in a shard.  In a
+//	transaction, each sector is written on its own (see WriteSector),
+//	since each goes to the journal.
+//
+//	"firstSector" -- the first disk sector to write
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the new contents, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSectors(int firstSector, int numSectors, char* data)
+{
+    bool hit;
+    int which, end;
+
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+    if (journal != NULL) {
+	if (journal->InTransaction()) {
+	    for (int i = 0; i < numSectors; i++)
+		WriteSector(firstSector + i, &data[i * SectorSize]);
+	    return;
+	}
+	for (int i = 0; i < numSectors; i++)
+	    journal->Revoke(firstSector + i);
+    }
+    for (int sector = firstSector; sector < firstSector + numSectors;
+							sector = end) {
+	CacheShard *s = ShardOf(sector);
+	char *piece = &data[(sector - firstSector) * SectorSize];
+
+	end = PieceEnd(sector, firstSector + numSectors);
+	s->lock->Acquire();
+	for (int i = sector; i < end; i++) {
+	    which = Lookup(s, i, &hit);
+	    bcopy(&data[(i - firstSector) * SectorSize], entries[which].data,
+		  SectorSize);
+	    SetDirty(s, which, !writeThrough);
+	}
+	if (writeThrough && sums != NULL)
+	    sums->Record(sector, end - sector, piece);
+	if (writeThrough)
+	    disk->WriteSectors(sector, end - sector, piece);
+	else
+	    CheckFlusher(s);
+	s->lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Prefetch
+// 	Start reading the sectors of a run that are not cached yet, and
+//	return without waiting.  Each stretch of missing sectors goes to
+//	the disk as one request; its entries stay in flight until the
+//	request is done.  If too many sectors are in flight already in a
+//	shard, the rest of its piece of the run is left alone.
+//
+//	"firstSector" -- the first disk sector of the run
+//	"numSectors" -- the number of sectors in the run
+//----------------------------------------------------------------------
+
+void
+BufferCache::Prefetch(int firstSector, int numSectors)
+{
+    int sector, end;
+
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+    for (sector = firstSector; sector < firstSector + numSectors; sector = end) {
+	CacheShard *s = ShardOf(sector);
+
+	end = PieceEnd(sector, firstSector + numSectors);
+	s->lock->Acquire();
+	PrefetchPiece(s, sector, end - sector);
+	s->lock->Release();
+    }
+}
+
+void
+BufferCache::PrefetchPiece(CacheShard *s, int firstSector, int numSectors)
+{
+    int i, run, room;
+
+    for (i = 0; i < numSectors; i += run) {
+	if (Present(firstSector + i)) {
+	    run = 1;
+	    continue;
+	}
+	for (run = 1; i + run < numSectors; run++) {
+	    if (Present(firstSector + i + run))
+		break;
+	}
+	room = s->numEntries / MaxInFlightFraction - s->numInFlight;
+	if (room <= 0)
+	    break;
+	run = min(run, room);
+
+	ReadAhead *request = new ReadAhead(this, firstSector + i, run);
+	for (int j = i; j < i + run; j++) {
+	    int which = Reassign(s, firstSector + j);
+	    SetDirty(s, which, FALSE);
+	    entries[which].inFlight = request;
+	}
+	s->numInFlight += run;
+	kernel->stats->numReadAheads += run;
+	DEBUG(dbgFile, "Buffer cache prefetching " << run << " sectors at " << firstSector + i);
+	disk->Request(new DiskRequest(firstSector + i, run, request->buffer,
+				      FALSE, request));
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Demote
+// 	Make the sectors of a run that are cached the least recently used,
+//	so that they are the next ones replaced, before anything that was
+//	used less recently than they were.  A dirty one stays dirty, and
+//	is written back when it is replaced, as usual; one in flight stays
+//	where it is.  What is not cached is left alone.
+//
+//	"firstSector" -- the first disk sector of the run
+//	"numSectors" -- the number of sectors in the run
+//----------------------------------------------------------------------
+
+void
+BufferCache::Demote(int firstSector, int numSectors)
+{
+    int sector, end;
+
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+    for (sector = firstSector; sector < firstSector + numSectors; sector = end) {
+	CacheShard *s = ShardOf(sector);
+
+	end = PieceEnd(sector, firstSector + numSectors);
+	s->lock->Acquire();
+	DemotePiece(s, sector, end - sector);
+	s->lock->Release();
+    }
+}
+
+void
+BufferCache::DemotePiece(CacheShard *s, int firstSector, int numSectors)
+{
+    int which;
+
+    for (int i = numSectors - 1; i >= 0; i--) {	// the first goes first
+	which = slotOf[firstSector + i];
+	if (which != -1 && entries[which].inFlight == NULL) {
+	    s->Unlink(which);
+	    s->PushBack(which);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::MarkMetadata
+// 	The cached sectors of a run hold file system metadata: if the
+//	cache keeps metadata first, they are replaced after the sectors
+//	of file data (see Kept), and taken off probation.  One in flight,
+//	or not cached, is left alone; the mark goes with the entry, so
+//	the file system marks its sectors as it reads and writes them.
+//
+//	"firstSector" -- the first disk sector of the run
+//	"numSectors" -- the number of sectors in the run
+//----------------------------------------------------------------------
+
+void
+BufferCache::MarkMetadata(int firstSector, int numSectors)
+{
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+    if (!metadataFirst)
+	return;
+    for (int sector = firstSector; sector < firstSector + numSectors; sector++) {
+	CacheShard *s = ShardOf(sector);
+	int which;
+
+	s->lock->Acquire();
+	which = slotOf[sector];
+	if (which != -1 && entries[which].inFlight == NULL
+		&& !entries[which].metadata) {
+	    entries[which].metadata = TRUE;
+	    s->numMetadata++;
+	    if (entries[which].probation) {
+		s->Unlink(which);
+		entries[which].probation = FALSE;
+		s->PushFront(which);
+	    }
+	}
+	s->lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush
+// 	Write every dirty sector back to disk.  We go in order of sector
+//	number, rather than cache order, so that the disk head sweeps
+//	across the disk once, and each run of consecutive dirty sectors
+//	goes out as a single request.  Then the disk is asked to write its
+//	own cache to the media, so that on return it is all really there.
+//	With shards, each track's sectors are done under its shard's lock.
+//
+//	Finished transactions are committed first; what they wrote is on
+//	disk once it is in the journal.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+    int sector, end, run;
+
+    if (journal != NULL)
+	journal->Commit();
+    for (sector = 0; sector < NumSectors; sector = end) {
+	CacheShard *s = ShardOf(sector);
+
+	end = PieceEnd(sector, NumSectors);
+	s->lock->Acquire();
+	for (; sector < end; sector += (run > 0) ? run : 1)
+	    run = WriteBackRun(s, sector);
+	s->lock->Release();
+    }
+    disk->Flush();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Discard
+// 	Forget every sector in the cache, dirty or not, and tell the
+//	disk that none of its sectors is wanted any more: they all read
+//	as zeroes from now on.  For a disk being formatted, before the
+//	journal is started.  Every shard's lock is held, taken in order,
+//	until the disk has been told.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Discard()
+{
+    ASSERT(journal == NULL);
+    for (int i = 0; i < numShards; i++) {
+	CacheShard *s = shards[i];
+
+	s->lock->Acquire();
+	for (int j = s->first; j < s->first + s->numEntries; j++) {
+	    while (entries[j].inFlight != NULL)
+		WaitFor(s, entries[j].inFlight);
+	}
+	for (int j = s->first; j < s->first + s->numEntries; j++) {
+	    if (entries[j].sector >= 0)
+		slotOf[entries[j].sector] = -1;
+	    entries[j].sector = -1;
+	    entries[j].metadata = FALSE;
+	    SetDirty(s, j, FALSE);
+	}
+	s->numMetadata = 0;
+    }
+    disk->Discard();
+    for (int i = numShards - 1; i >= 0; i--)
+	shards[i]->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// DirtySector
+//	A dirty sector the flusher found, and when it was dirtied: a copy,
+//	since the entry may change once its shard's lock is let go.
+//----------------------------------------------------------------------
+
+class DirtySector {
+  public:
+    int sector;
+    Ticks dirtiedAt;
+};
+
+//----------------------------------------------------------------------
+// CompareInts / CompareAges
+//	For sorting sectors by number, and dirty sectors by age, with
+//	qsort.
+//----------------------------------------------------------------------
+
+static int
+CompareInts(const void *x, const void *y)
+{
+    return *(const int *) x - *(const int *) y;
+}
+
+static int
+CompareAges(const void *x, const void *y)
+{
+    const DirtySector *a = (const DirtySector *) x;
+    const DirtySector *b = (const DirtySector *) y;
+
+    if (a->dirtiedAt != b->dirtiedAt)
+	return (a->dirtiedAt < b->dirtiedAt) ? -1 : 1;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::SyncSectors
+// 	Make sure that the given sectors, and what finished transactions
+//	have written, are on the disk's media (UNIX fsync): the sectors
+//	that are dirty are written back, in order of sector number and
+//	in runs, the journal is committed, and the disk is flushed.
+//
+//	"sectors" -- the sectors, in any order; it is sorted in place
+//	"numSectors" -- how many there are
+//----------------------------------------------------------------------
+
+void
+BufferCache::SyncSectors(int *sectors, int numSectors)
+{
+    if (journal != NULL)
+	journal->Commit();
+    qsort(sectors, numSectors, sizeof(int), CompareInts);
+    for (int i = 0; i < numSectors; i++) {
+	CacheShard *s = ShardOf(sectors[i]);
+
+	s->lock->Acquire();
+	WriteBackRun(s, sectors[i]);	// nothing to do if it is
+	s->lock->Release();		// clean, or was in a run
+    }
+    disk->Flush();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::SetDirty
+// 	Mark an entry dirty or clean, keeping count of the dirty ones.
+//	An entry that is dirty already keeps the time it first became
+//	so: its age is how long the disk has been out of date.  The
+//	count is kept by its shard "s".
+//----------------------------------------------------------------------
+
+void
+BufferCache::SetDirty(CacheShard *s, int which, bool dirty)
+{
+    CacheEntry *e = &entries[which];
+
+    if (e->dirty == dirty)
+	return;
+    e->dirty = dirty;
+    if (dirty) {
+	e->dirtiedAt = kernel->stats->totalTicks;
+	if (s->numDirty++ == 0)
+	    s->oldestDirty = e->dirtiedAt;
+    } else {
+	s->numDirty--;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::NumDirty
+// 	Return how many entries are dirty, in all the shards.  The other
+//	shards' counts are read without their locks, so this is only a
+//	hint, which is all the flusher needs.
+//----------------------------------------------------------------------
+
+int
+BufferCache::NumDirty()
+{
+    int count = 0;
+
+    for (int i = 0; i < numShards; i++)
+	count += shards[i]->numDirty;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::OldestDirty
+// 	Set "*when" to no later than the time the oldest dirty entry was
+//	dirtied, and return TRUE; FALSE if none is dirty.  Like NumDirty,
+//	it reads the shards without their locks, as a hint.
+//----------------------------------------------------------------------
+
+bool
+BufferCache::OldestDirty(Ticks *when)
+{
+    bool any = FALSE;
+
+    for (int i = 0; i < numShards; i++) {
+	if (shards[i]->numDirty > 0
+		&& (!any || shards[i]->oldestDirty < *when)) {
+	    *when = shards[i]->oldestDirty;
+	    any = TRUE;
+	}
+    }
+    return any;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CheckFlusher
+// 	Called when a sector has been dirtied.  Wake the flusher if too
+//	much of the cache is dirty, or some of it has been for too long,
+//	or it is asleep with no wakeup set, to have it set one -- unless
+//	it has been woken already, and not got round to it.
+//	The lock of the shard "s", just dirtied, is held; the others are
+//	looked at as hints (see NumDirty).
+//----------------------------------------------------------------------
+
+void
+BufferCache::CheckFlusher(CacheShard *s)
+{
+    Ticks oldest = s->oldestDirty;
+
+    ASSERT(s->lock->IsHeldByCurrentThread());
+    if (flusherWakeup == NULL || flusherWoken)
+	return;
+    for (int i = 0; i < numShards; i++) {
+	if (shards[i]->numDirty > 0)
+	    oldest = min(oldest, shards[i]->oldestDirty);
+    }
+    if (!flusherTimed || NumDirty() > numEntries / DirtyHighFraction
+	    || kernel->stats->totalTicks - oldest > MaxDirtyAge) {
+	flusherWoken = TRUE;
+	flusherWakeup->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FlushOld
+// 	One pass of the flusher.  Pick the dirty entries that are older
+//	than MaxDirtyAge, or, if that is more, enough of the oldest ones
+//	to bring the cache down to 1/DirtyLowFraction dirty.  Write them
+//	back in order of sector number; each one takes the dirty sectors
+//	right after it along, in the same request (see WriteBackRun).
+//
+//	The shards are looked at one at a time, each under its lock; one
+//	whose lock is held is waited for.  A sector picked may have been
+//	written back by someone else by the time it is reached, in which
+//	case there is nothing to do for it.
+//----------------------------------------------------------------------
+
+void
+BufferCache::FlushOld()
+{
+    DirtySector *dirty = new DirtySector[numEntries];
+    int *chosen = new int[numEntries];
+    Ticks cutoff = kernel->stats->totalTicks - MaxDirtyAge;
+    int count = 0, numOld = 0, numChosen, run;
+    CacheShard *held = NULL;
+
+    for (int i = 0; i < numShards; i++) {
+	CacheShard *s = shards[i];
+
+	s->lock->Acquire();
+	for (int j = s->first; j < s->first + s->numEntries; j++) {
+	    if (entries[j].dirty) {
+		dirty[count].sector = entries[j].sector;
+		dirty[count++].dirtiedAt = entries[j].dirtiedAt;
+		if (entries[j].dirtiedAt <= cutoff)
+		    numOld++;
+	    }
+	}
+	s->lock->Release();
+    }
+    qsort(dirty, count, sizeof(DirtySector), CompareAges);
+    numChosen = max(numOld, count - numEntries / DirtyLowFraction);
+    for (int i = 0; i < numChosen; i++)
+	chosen[i] = dirty[i].sector;
+    qsort(chosen, numChosen, sizeof(int), CompareInts);
+
+    for (int i = 0; i < numChosen; i++) {
+	CacheShard *s = ShardOf(chosen[i]);
+
+	if (s != held) {		// keep it for the next one, if
+	    if (held != NULL)		// that is in the same shard
+		held->lock->Release();
+	    held = s;
+	    held->lock->Acquire();
+	}
+	run = WriteBackRun(s, chosen[i]);
+	if (run > 0) {
+	    kernel->stats->numFlusherWrites++;
+	    kernel->stats->numFlusherSectors += run;
+	}
+    }
+    if (held != NULL)
+	held->lock->Release();
+
+    for (int i = 0; i < numShards; i++) {
+	CacheShard *s = shards[i];
+
+	s->lock->Acquire();
+	s->oldestDirty = kernel->stats->totalTicks;
+	for (int j = s->first; j < s->first + s->numEntries; j++) {
+	    if (entries[j].dirty)
+		s->oldestDirty = min(s->oldestDirty, entries[j].dirtiedAt);
+	}
+	s->lock->Release();
+    }
+    delete [] dirty;
+    delete [] chosen;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flusher
+// 	The body of the flusher thread: sleep until woken, do a pass over
+//	the cache, and go back to sleep.  It lives until Nachos halts.
+//	If anything is dirty, it is woken by the alarm, too, once the
+//	oldest sector has been dirty for MaxDirtyAge; the wakeup is
+//	cancelled if a writer wakes it first.
+//
+//	"cache" is the buffer cache it works for
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flusher(void *cache)
+{
+    BufferCache *c = (BufferCache *) cache;
+    Wakeup *wakeup;
+    Ticks oldest;
+
+    for (;;) {
+	// cleared before looking, so that a writer that dirties the
+	// first sector after the look wakes us
+	c->flusherTimed = FALSE;
+	if (c->OldestDirty(&oldest)) {
+	    c->flusherTimed = TRUE;
+	    wakeup = kernel->alarm->SetWakeup(c->flusherWakeup,
+		(int) (oldest + MaxDirtyAge - kernel->stats->totalTicks));
+	    c->flusherWakeup->P();
+	    kernel->alarm->CancelWakeup(wakeup);
+	} else {
+	    c->flusherWakeup->P();
+	}
+	DEBUG(dbgFile, "Flusher woken, " << c->NumDirty() << " sectors dirty");
+	c->FlushOld();
+	c->flusherWoken = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BeginTransaction / EndTransaction
+// 	Start and finish a transaction for the running thread (see
+//	Journal::Begin and End).  Without a journal, these do nothing,
+//	and what is written goes to the cache as usual.
+//----------------------------------------------------------------------
+
+void
+BufferCache::BeginTransaction()
+{
+    if (journal != NULL)
+	journal->Begin();
+}
+
+void
+BufferCache::EndTransaction(bool durable)
+{
+    if (journal != NULL)
+	journal->End(durable);
+}
@@ -0,0 +1,307 @@
+// bufcache.h
+//	Data structures for a cache of disk sectors, kept in memory
+//	between the file system and the synchronous disk.
+//
+//	Every file header, directory and bitmap fetch in the file system
+//	ends up as a sector read; most of these sectors (the free map,
+//	the root directory, file headers) are read over and over again.
+//	The buffer cache keeps a fixed number of recently used sectors
+//	in memory, so that repeated reads do not go to the disk.
+//
+//	The cache can run in one of two modes:
+//	   write-through: every WriteSector goes to the disk immediately;
+//		the cache only saves reads.
+//	   write-back: WriteSector only updates the cached copy and marks
+//		it dirty; the sector is written to disk when it is evicted,
+//		or when Flush is called.  The kernel flushes the cache when
+//		Nachos halts.
+//
+//	Sectors can also be brought in ahead of time with Prefetch, which
+//	sends the disk request and returns without waiting for it.  Until
+//	the transfer is done the entries are "in flight": they cannot be
+//	evicted, and anyone who wants one of them waits for the disk.
+//	The other way round, sectors that will not be wanted again can be
+//	given up with Demote: they move to the tail of the LRU list, to be
+//	the next ones replaced, so that a long scan does not push out the
+//	headers and directories that are.
+//
+//	In write-back mode, a kernel thread, the "flusher", writes dirty
+//	sectors back in the background, so that they do not wait for an
+//	eviction: those that have been dirty for more than MaxDirtyAge
+//	ticks, and the oldest ones when too much of the cache is dirty.
+//	The writers check as they dirty the cache, and wake it when there
+//	is work.  While anything is dirty, it also sets itself a wakeup
+//	(Alarm::SetWakeup) for when the oldest sector comes of age, so
+//	that dirty sectors go out on an idle machine too; with nothing
+//	dirty it sets none, which would keep an idle machine ticking
+//	forever.  It goes in order of sector number, and writes each run
+//	of dirty sectors as one request.
+//
+//	If the file system has a journal (see journal.h), sectors written
+//	by a thread in a transaction go to the journal rather than to the
+//	disk, and stay clean in the cache; the journal has a copy of each,
+//	which a miss reads instead of the disk.
+//
+//	If the sectors have checksums (see sectorsum.h), the cache takes
+//	one of each sector it writes to the disk, and checks each one it
+//	reads from there.
+//
+//	The cache can be split into "shards" (-cs), each a slice of the
+//	entries with its own lock and LRU list, the sectors of each track
+//	going to one of them in turn.  A miss holds its shard's lock
+//	while it waits for the disk, and a hit on another shard goes
+//	ahead meanwhile, as does a miss on another disk of a striped
+//	volume; with the one lock, everything waits for the miss.  Only
+//	writing back walks the shards in order of sector number, one at
+//	a time; nothing holds two shard locks, except Discard, which
+//	takes them all in order.  The price is that each shard only holds
+//	its share of the entries, so a track that is busy has fewer.
+//	Each lock is named after its shard, so that -lp counts the
+//	contention on each apart.
+//
+//	Which entry a miss replaces is up to the replacement policy:
+//	   LRU -- the least recently used, as always.
+//	   2Q (-c2q) -- a sector seen for the first time goes on a "probation"
+//		list, in first-in, first-out order, which a hit does not
+//		change: the reads of a file streaming through hit each
+//		sector several times, and mean nothing by it.  A hit long
+//		after the sector was loaded -- after as many other loads
+//		as the probation list may hold -- does move it to the
+//		main list, as a full cache would have had it come back
+//		from the ghost list.  Only once
+//		more than a share of the entries are on probation is the
+//		oldest of them replaced, and its sector number is kept on
+//		a "ghost" list of sectors recently dropped.  A miss on a
+//		ghost -- a sector wanted again after a while -- goes on
+//		the main list instead, which is LRU as before.  So a long
+//		scan only ever replaces sectors on probation, and the
+//		working set on the main list stays.
+//	So the file system can say which cached sectors hold metadata --
+//	file headers, directories, the free map -- and with -cmeta they
+//	are kept ahead of file data: they skip probation, and the least
+//	recently used sector that is not metadata is replaced first, as
+//	long as no more than half the entries are.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BUFCACHE_H
+#define BUFCACHE_H
+
+#include "disk.h"
+#include "synch.h"
+#include "synchdisk.h"
+
+const int NumCacheEntries = 64;		// number of sectors kept in memory
+const int MaxDirtyAge = 50000;		// ticks a sector is left dirty
+					// before the flusher writes it
+const int MaxCacheShards = 16;		// NumCacheEntries / 4, so that each
+					// can have a prefetch in flight
+
+class ReadAhead;
+class Journal;
+class SectorSums;
+
+enum CachePolicy { CacheLRU, Cache2Q };
+
+// The following class defines one cached disk sector.  Entries are
+// linked together in LRU order (most recently used at the head).
+
+class CacheEntry {
+  public:
+    int sector;				// disk sector held here, -1 if free
+    bool dirty;				// modified since read from disk?
+    Ticks dirtiedAt;			// when it became dirty, if it is
+    ReadAhead *inFlight;		// prefetch still filling in "data",
+					//   NULL once the contents are valid
+    bool probation;			// on the probation list (2Q), not
+					//   the main one?
+    bool metadata;			// holds file system metadata?
+    int loadedAt;			// its shard's numLoads when the
+					//   sector was put in it
+    int prev;				// neighbours in its list,
+    int next;				//   -1 at either end
+    char data[SectorSize];		// contents of the sector
+};
+
+// The following class defines one shard of the cache: the entries
+// numbered from "first", and the sectors (sector / SectorsPerTrack)
+// % numShards == its index.  Everything here is protected by "lock".
+// The ghost list is a ring of sector numbers: a sector is on it if it
+// is in one of the last "ghostCapacity" slots filled, and the cache's
+// ghostAt says it is in that slot (see BufferCache::TakeGhost).
+
+class CacheShard {
+  public:
+    CacheShard(CacheEntry *e, int firstEntry, int count, char *lockName);
+    ~CacheShard();
+
+    Lock *lock;				// held while using its entries
+    CacheEntry *entries;		// the whole cache's entries
+    int first;				// this shard's are first..
+    int numEntries;			//   first + numEntries - 1
+    int lruHead;			// most recently used entry
+    int lruTail;			// least recently used entry
+    int probationHead;			// newest entry on probation (2Q)
+    int probationTail;			// oldest
+    int numProbation;			// how many are on probation
+    int numMetadata;			// entries holding metadata
+    int numLoads;			// sectors ever put in an entry
+    int *ghosts;			// sectors dropped from probation
+    int ghostCapacity;			// slots in the ring
+    int ghostsAdded;			// slots ever filled
+    char *runBuffer;			// staging area for writing back a
+					//   run of dirty sectors at once
+    int numInFlight;			// entries waiting for a prefetch;
+					//   changed by the interrupt handler
+    int numDirty;			// entries that are dirty
+    Ticks oldestDirty;			// none has been dirty since before
+					//   this time (a lower bound)
+
+    void Unlink(int which);		// take an entry off its list
+    void PushFront(int which);		// put an entry at the head
+    void PushBack(int which);		// or at the tail of the list
+					//   its "probation" says
+};
+
+// The following class defines the buffer cache.  It has the same
+// ReadSector/WriteSector interface as SynchDisk, so the file system
+// code does not need to know whether a sector came from memory or
+// from the disk.
+
+class BufferCache {
+  public:
+    BufferCache(SynchDisk *disk, int numEntries, bool writeThrough,
+		int numShards, CachePolicy policy, bool metadataFirst);
+					// Initialize an empty cache of
+					// "numEntries" sectors in front
+					// of "disk", in "numShards" shards,
+					// replacing them by "policy", and
+					// keeping metadata first if asked
+    ~BufferCache();			// Flush and de-allocate the cache
+
+    void ReadSector(int sectorNumber, char* data);
+					// Read/write a sector through
+					// the cache
+    void WriteSector(int sectorNumber, char* data);
+    void ReadBytes(int sectorNumber, int offset, int numBytes, char* into);
+					// Read just part of a sector
+    void ReadSectors(int firstSector, int numSectors, char* data);
+					// Same, for a run of consecutive
+					// sectors; whatever has to go to
+					// the disk goes in as few
+					// requests as possible
+    void WriteSectors(int firstSector, int numSectors, char* data);
+    void Prefetch(int firstSector, int numSectors);
+					// Start reading the sectors of a
+					// run that are not cached, without
+					// waiting for them
+    void Demote(int firstSector, int numSectors);
+					// Make the cached sectors of a run
+					// the next ones to be replaced
+    void MarkMetadata(int firstSector, int numSectors);
+					// Say the cached sectors of a run
+					// hold file system metadata
+    bool FavorsMetadata() { return metadataFirst; }
+					// Does it keep them ahead of data?
+
+    void Flush();			// Write every dirty sector back
+					// to disk
+    void SyncSectors(int *sectors, int numSectors);
+					// Make sure these sectors are on
+					// disk, along with the journal
+    void Discard();			// Forget every cached sector, and
+					// discard every sector on disk
+    void StartFlusher();		// Fork the flusher thread
+
+    bool IsWriteThrough() { return writeThrough; }
+
+    void SetJournal(Journal *j) { journal = j; }
+					// Send transactions' writes to "j"
+					// (NULL for none)
+    Journal *GetJournal() { return journal; }
+    void SetChecksums(SectorSums *s) { sums = s; }
+					// Take and check the checksums of
+					// sectors in "s" (NULL for none)
+    SectorSums *GetChecksums() { return sums; }
+    void BeginTransaction();		// Start/finish a transaction, if
+    void EndTransaction(bool durable);	// there is a journal
+
+  private:
+    friend class ReadAhead;		// fills in entries from the disk
+					// interrupt handler
+
+    SynchDisk *disk;			// where misses and write-backs go
+    bool writeThrough;			// write to disk on every write?
+    CachePolicy policy;			// which entry a miss replaces
+    bool metadataFirst;			// keep metadata ahead of data?
+    Journal *journal;			// where transactions' writes go
+    SectorSums *sums;			// checksums of what is on disk
+
+    int numEntries;			// size of the cache
+    CacheEntry *entries;		// the cached sectors
+    int *slotOf;			// sector number -> entry index,
+					//   -1 if the sector is not cached;
+					//   each under its shard's lock
+    int *ghostAt;			// sector number -> its slot in its
+					//   shard's ghost ring, if it was
+					//   put on it; NULL but for 2Q
+    int numShards;
+    CacheShard **shards;
+    Semaphore *flusherWakeup;		// what the flusher sleeps on; NULL
+					//   if there is no flusher
+    bool flusherWoken;			// signalled since its last pass?
+    bool flusherTimed;			// has it set itself a wakeup?
+
+    CacheShard *ShardOf(int sectorNumber);
+					// the shard a sector belongs to
+    int PieceEnd(int sectorNumber, int end);
+					// where the part of the run up to
+					// "end" in the same shard stops
+    int Lookup(CacheShard *s, int sectorNumber, bool *hit);
+					// find or allocate the entry for
+					// a sector; moves it to the head
+					// of the LRU list
+    int Reassign(CacheShard *s, int sectorNumber);
+					// give the entry the policy picks
+					// to a sector that is not cached,
+					// and put it on its list
+    int Victim(CacheShard *s);		// the entry the policy picks
+    int Oldest(CacheShard *s, int from);
+					// the oldest in a list, from its
+					// tail, that may be replaced
+    bool Kept(CacheShard *s, int which);
+					// is it metadata, kept ahead of
+					// data?
+    void AddGhost(CacheShard *s, int sectorNumber);
+					// remember a sector dropped from
+					// probation
+    bool TakeGhost(CacheShard *s, int sectorNumber);
+					// and forget it, if it was
+    void WaitFor(CacheShard *s, ReadAhead *request);
+					// wait, without the lock, for a
+					// prefetch to arrive
+    int WriteBackRun(CacheShard *s, int sectorNumber);
+					// write to disk the run of dirty
+					// cached sectors starting here
+    bool Present(int sectorNumber);	// cached, or held by the journal?
+    void ReadIn(int which);		// fill in an entry after a miss
+    void ReadPiece(CacheShard *s, int firstSector, int numSectors,
+		   char *data);		// ReadSectors, Prefetch, Demote for
+    void PrefetchPiece(CacheShard *s, int firstSector, int numSectors);
+    void DemotePiece(CacheShard *s, int firstSector, int numSectors);
+					// a run in one shard, lock held
+    void SetDirty(CacheShard *s, int which, bool dirty);
+					// mark an entry dirty or clean
+    int NumDirty();			// in all the shards
+    bool OldestDirty(Ticks *when);	// when the oldest dirty sector was
+					// dirtied, if any is
+    void CheckFlusher(CacheShard *s);	// wake the flusher if there is work
+    void FlushOld();			// the flusher's pass over the cache
+    static void Flusher(void *cache);	// what the flusher thread runs
+};
+
+#endif // BUFCACHE_H
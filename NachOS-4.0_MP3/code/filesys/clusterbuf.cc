@@ -0,0 +1,255 @@
+// clusterbuf.cc
+//	Routines to read and write a compressed file a cluster at a time.
+//	See clusterbuf.h for the policy.
+//
+//	A cluster is written out compressed if that saves at least one
+//	sector, and as it is otherwise; a cluster of nothing but zeroes
+//	is given no sectors at all.  The bytes of the last cluster past
+//	the end of the file are always zeroes, so that the file can grow
+//	over them without their being cleared.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+#ifndef FILESYS_STUB
+
+#include "copyright.h"
+#include "clusterbuf.h"
+#include "bufcache.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// ClusterBuffer::ClusterBuffer
+// 	Initialize an empty cluster buffer.
+//
+//	"fileHdr" -- the header of the compressed file
+//	"sector" -- where the header is on disk
+//----------------------------------------------------------------------
+
+ClusterBuffer::ClusterBuffer(FileHeader *fileHdr, int sector)
+{
+    ASSERT(fileHdr->IsCompressed());
+    hdr = fileHdr;
+    hdrSector = sector;
+    lock = new Lock("cluster buffer lock");
+    codec = new LzCodec;
+    packed = new char[ClusterSize];
+    for (int i = 0; i < ClusterSlots; i++) {
+	cluster[i] = -1;
+	data[i] = new char[ClusterSize];
+	dirty[i] = FALSE;
+	lastUse[i] = 0;
+    }
+    useCount = 0;
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::~ClusterBuffer
+// 	Write out the clusters written to, then de-allocate the buffer.
+//	The file header must still be around.
+//----------------------------------------------------------------------
+
+ClusterBuffer::~ClusterBuffer()
+{
+    Flush();
+    for (int i = 0; i < ClusterSlots; i++) {
+	delete [] data[i];
+    }
+    delete [] packed;
+    delete codec;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::Slot
+// 	Return the slot holding the "which"-th cluster of the file.  If
+//	no slot has it, it goes in the one used longest ago, whose
+//	cluster is written out first if it was written to, and is read
+//	in -- unless "overwrite", when all of it is about to be written.
+//----------------------------------------------------------------------
+
+int
+ClusterBuffer::Slot(int which, bool overwrite)
+{
+    int slot = 0;
+
+    for (int i = 0; i < ClusterSlots; i++) {
+	if (cluster[i] == which) {
+	    lastUse[i] = ++useCount;
+	    return i;
+	}
+	if (lastUse[i] < lastUse[slot]) {
+	    slot = i;
+	}
+    }
+    if (dirty[slot] && !WriteOut(slot)) {
+	DEBUG(dbgFile, "No room for cluster " << cluster[slot] << ", losing it");
+    }
+    if (!overwrite) {
+	DEBUG(dbgFile, "Reading in cluster " << which);
+	hdr->ReadCluster(which, data[slot]);
+    }
+    cluster[slot] = which;
+    dirty[slot] = FALSE;
+    lastUse[slot] = ++useCount;
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::Read
+// 	Read "numBytes" bytes of the file, starting at "position", from
+//	the clusters they are in.
+//
+//	"into" -- where the bytes go
+//	"numBytes" -- how many; the caller has checked that they are all
+//		within the file
+//	"position" -- the file offset of the first of them
+//----------------------------------------------------------------------
+
+void
+ClusterBuffer::Read(char *into, int numBytes, int position)
+{
+    int done, n;
+
+    ASSERT(numBytes > 0 && position + numBytes <= hdr->FileLength());
+    lock->Acquire();
+    for (done = 0; done < numBytes; done += n) {
+	int offset = (position + done) % ClusterSize;
+	int slot = Slot((position + done) / ClusterSize, FALSE);
+
+	n = min(numBytes - done, ClusterSize - offset);
+	bcopy(&data[slot][offset], &into[done], n);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::Write
+// 	Write "numBytes" bytes of the file, starting at "position", into
+//	the clusters they are in.  Stop before the first cluster that was
+//	not written to already, if there may be no room to write it out
+//	(see clusterbuf.h).  Return how many bytes were written.
+//
+//	"from" -- the new contents
+//	"numBytes" -- how many bytes; the caller has checked that they
+//		are all within the file
+//	"position" -- the file offset of the first of them
+//----------------------------------------------------------------------
+
+int
+ClusterBuffer::Write(char *from, int numBytes, int position)
+{
+    int done, n;
+
+    ASSERT(numBytes > 0 && position + numBytes <= hdr->FileLength());
+    lock->Acquire();
+    for (done = 0; done < numBytes; done += n) {
+	int offset = (position + done) % ClusterSize;
+	int slot;
+
+	n = min(numBytes - done, ClusterSize - offset);
+	slot = Slot((position + done) / ClusterSize, n == ClusterSize);
+	if (!dirty[slot]
+		&& kernel->mounts->Current()->FreeSectors() < ClusterSectors) {
+	    cluster[slot] = -1;			// disk full; it may not have
+	    lastUse[slot] = 0;			// been read in
+	    break;
+	}
+	bcopy(&from[done], &data[slot][offset], n);
+	dirty[slot] = TRUE;
+	if (kernel->bufferCache->IsWriteThrough()) {
+	    WriteOut(slot);
+	}
+    }
+    lock->Release();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::Flush
+// 	Write out every cluster that has been written to.  Return FALSE
+//	if one of them found no room; it stays in the buffer.
+//----------------------------------------------------------------------
+
+bool
+ClusterBuffer::Flush()
+{
+    bool success = TRUE;
+
+    lock->Acquire();
+    for (int i = 0; i < ClusterSlots; i++) {
+	if (dirty[i] && !WriteOut(i)) {
+	    success = FALSE;
+	}
+    }
+    lock->Release();
+    return success;
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::Truncate
+// 	Get ready for the file to be cut to "newLength" bytes: the
+//	clusters past the new end are forgotten, written to or not, and
+//	the bytes of the new last cluster past the end are zeroed.
+//----------------------------------------------------------------------
+
+void
+ClusterBuffer::Truncate(int newLength)
+{
+    int kept = divRoundUp(newLength, ClusterSize);
+
+    lock->Acquire();
+    for (int i = 0; i < ClusterSlots; i++) {
+	if (cluster[i] >= kept) {
+	    cluster[i] = -1;
+	    dirty[i] = FALSE;
+	    lastUse[i] = 0;
+	}
+    }
+    if (newLength % ClusterSize != 0) {
+	int slot = Slot(newLength / ClusterSize, FALSE);
+
+	bzero(&data[slot][newLength % ClusterSize],
+	      ClusterSize - newLength % ClusterSize);
+	dirty[slot] = TRUE;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ClusterBuffer::WriteOut
+// 	Compress the cluster in "slot" and write it out (see
+//	FileSystem::StoreCluster).  Return FALSE, leaving it written to,
+//	if there is no room for it.
+//----------------------------------------------------------------------
+
+bool
+ClusterBuffer::WriteOut(int slot)
+{
+    char *bytes = data[slot];
+    int length, count;
+    bool zeroes = TRUE;
+
+    for (int i = 0; i < ClusterSize && zeroes; i++) {
+	zeroes = (bytes[i] == 0);
+    }
+    if (zeroes) {
+	count = 0;
+    } else if ((length = codec->Compress(bytes, ClusterSize, packed,
+				(ClusterSectors - 1) * SectorSize)) == -1) {
+	count = ClusterSectors;			// stored as it is
+    } else {
+	count = divRoundUp(length, SectorSize);
+	bzero(&packed[length], count * SectorSize - length);
+	bytes = packed;
+    }
+    DEBUG(dbgFile, "Writing out cluster " << cluster[slot] << " in " << count << " sectors");
+    if (!kernel->mounts->Current()->StoreCluster(hdr, hdrSector,
+						 cluster[slot], bytes, count)) {
+	return FALSE;
+    }
+    dirty[slot] = FALSE;
+    return TRUE;
+}
+
+#endif // FILESYS_STUB
@@ -0,0 +1,91 @@
+// clusterbuf.h
+//	Data structures for reading and writing a compressed file (see
+//	filehdr.h) through its clusters, decompressed.
+//
+//	A compressed file cannot be read or written a sector at a time:
+//	a sector of its data is somewhere in the middle of a compressed
+//	cluster.  So each such file has a cluster buffer, holding the
+//	last ClusterSlots clusters it used, decompressed.  Reads and
+//	writes are copied out of and into these; a cluster that is not
+//	there is read in, replacing the one used longest ago, and only
+//	as many sectors are read as it was compressed into.
+//
+//	A cluster that has been written is compressed and written out
+//	when it is replaced, and when the buffer is flushed -- when the
+//	file is closed or synced.  So a file written sequentially has
+//	every cluster compressed once, however small its writes, and
+//	rewriting part of a cluster costs one decompression of it.  In
+//	write-through mode, a cluster is written out after each write.
+//
+//	A cluster gets its sectors when it is written out, so a write
+//	can only make sure there is room for it then: the first write to
+//	a cluster stops, as if the disk were full, unless ClusterSectors
+//	sectors are free.  Should a cluster still find no room once it
+//	is written out, it is kept, and its write tried again the next
+//	time; a cluster replaced with no room for it is lost.
+//
+//	Like the write buffer, the cluster buffer is shared by every
+//	OpenFile on the file (see inodetable.h), so they all see the
+//	same contents.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef CLUSTERBUF_H
+#define CLUSTERBUF_H
+
+#include "filehdr.h"
+#include "lzcodec.h"
+#include "synch.h"
+
+const int ClusterSlots = 2;		// clusters kept per file
+
+// The following class defines the cluster buffer of one file.
+
+class ClusterBuffer {
+  public:
+    ClusterBuffer(FileHeader *hdr, int hdrSector);
+					// Initialize an empty buffer in
+					// front of the compressed file
+					// whose header is "hdr", at
+					// "hdrSector"
+    ~ClusterBuffer();			// Flush and de-allocate the buffer
+
+    void Read(char *into, int numBytes, int position);
+					// Read bytes of the file, which
+					// must lie within its length
+    int Write(char *from, int numBytes, int position);
+					// Same, to write them; return how
+					// many were written
+    bool Flush();			// Write out every cluster written
+					// to; FALSE if one found no room
+    void Truncate(int newLength);	// The file is about to be cut to
+					// "newLength" bytes: zero the rest
+					// of its last cluster, and forget
+					// the ones past it
+
+  private:
+    FileHeader *hdr;			// where the file's clusters are
+    int hdrSector;			// and where the header is
+    Lock *lock;				// one reader or writer at a time
+    LzCodec *codec;
+    char *packed;			// a cluster being written out,
+					// compressed
+    int cluster[ClusterSlots];		// the cluster in each slot, -1
+					// if none
+    char *data[ClusterSlots];		// and its bytes, decompressed
+    bool dirty[ClusterSlots];		// written to since read in?
+    int lastUse[ClusterSlots];		// when it was last used
+    int useCount;			// uses so far, to time them by
+
+    int Slot(int which, bool overwrite);
+					// the slot holding cluster
+					// "which", read in if need be
+    bool WriteOut(int slot);		// compress a cluster and write it
+					// out; FALSE if there is no room
+};
+
+#endif // CLUSTERBUF_H
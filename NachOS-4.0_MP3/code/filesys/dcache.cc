@@ -0,0 +1,236 @@
+// dcache.cc
+//	Routines to remember the results of path name lookups.  See
+//	dcache.h for how the cache is used.
+//
+//	Everything but InvalidateTree touches a single slot.
+//	InvalidateTree looks at every slot, since the paths below a
+//	directory are scattered all over the cache; it is only called
+//	when a name is removed.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dcache.h"
+#include "debug.h"
+#include <string.h>
+
+//----------------------------------------------------------------------
+// DentryCache::DentryCache
+// 	Initialize an empty dentry cache.
+//----------------------------------------------------------------------
+
+DentryCache::DentryCache()
+{
+    for (int i = 0; i < NumDentries; i++)
+	entries[i].valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::MakePath
+// 	Join the names of a path into "buffer", each one preceded by a
+//	"/"; the root is the empty string.  Return FALSE (and leave the
+//	path unfinished) if it is longer than DentryPathMaxLen.
+//
+//	"buffer" -- at least DentryPathMaxLen + 1 characters
+//	"names", "len" -- the components of the path
+//----------------------------------------------------------------------
+
+bool
+DentryCache::MakePath(char *buffer, char **names, int len)
+{
+    int pos = 0;
+
+    buffer[0] = '\0';
+    for (int i = 0; i < len; i++) {
+	int n = strlen(names[i]);
+	if (pos + 1 + n > DentryPathMaxLen)
+	    return FALSE;
+	buffer[pos++] = '/';
+	strcpy(&buffer[pos], names[i]);
+	pos += n;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::SlotOf
+// 	Hash a path to the slot it is kept in.
+//----------------------------------------------------------------------
+
+int
+DentryCache::SlotOf(char *path)
+{
+    unsigned h = 0;
+
+    for (; *path != '\0'; path++)
+	h = h * 31 + (unsigned char) *path;
+    return h % NumDentries;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Lookup
+// 	Look a path up in the cache.  Return TRUE if it is there, with the
+//	sector of its directory header in "sector", or -1 if the path is
+//	known not to exist.
+//
+//	"names", "len" -- the components of the path
+//	"sector" -- where to put the result
+//----------------------------------------------------------------------
+
+bool
+DentryCache::Lookup(char **names, int len, int *sector)
+{
+    char path[DentryPathMaxLen + 1];
+
+    if (!MakePath(path, names, len))
+	return FALSE;
+    Dentry *d = &entries[SlotOf(path)];
+    if (!d->valid || strcmp(d->path, path) != 0)
+	return FALSE;
+    DEBUG(dbgFile, "Dentry cache hit on " << path << ": " << d->sector);
+    *sector = d->sector;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Enter
+// 	Remember the result of looking up a path, replacing whatever was
+//	in its slot.
+//
+//	"names", "len" -- the components of the path
+//	"sector" -- the sector of its directory header, or -1 if the path
+//		does not exist
+//----------------------------------------------------------------------
+
+void
+DentryCache::Enter(char **names, int len, int sector)
+{
+    char path[DentryPathMaxLen + 1];
+
+    if (!MakePath(path, names, len))
+	return;
+    Dentry *d = &entries[SlotOf(path)];
+    d->valid = TRUE;
+    d->sector = sector;
+    strcpy(d->path, path);
+}
+
+//----------------------------------------------------------------------
+// DentryCache::Invalidate
+// 	Forget what we know about a path; called when a name is added,
+//	since a negative entry for it would now be wrong.
+//
+//	"names", "len" -- the components of the path
+//----------------------------------------------------------------------
+
+void
+DentryCache::Invalidate(char **names, int len)
+{
+    char path[DentryPathMaxLen + 1];
+
+    if (!MakePath(path, names, len))
+	return;
+    Dentry *d = &entries[SlotOf(path)];
+    if (d->valid && strcmp(d->path, path) == 0)
+	d->valid = FALSE;
+}
+
+//----------------------------------------------------------------------
+// DentryCache::InvalidateTree
+// 	Forget a path and every path that goes through it; called when
+//	a name is removed.  If the path is too long to have been cached,
+//	neither can anything below it.
+//
+//	"names", "len" -- the components of the path
+//----------------------------------------------------------------------
+
+void
+DentryCache::InvalidateTree(char **names, int len)
+{
+    char path[DentryPathMaxLen + 1];
+    int n;
+
+    if (!MakePath(path, names, len))
+	return;
+    n = strlen(path);
+    for (int i = 0; i < NumDentries; i++) {
+	Dentry *d = &entries[i];
+	if (d->valid && strncmp(d->path, path, n) == 0
+		&& (d->path[n] == '\0' || d->path[n] == '/'))
+	    d->valid = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// WorkingDirectory::WorkingDirectory
+// 	Initialize a working directory at the root.
+//----------------------------------------------------------------------
+
+WorkingDirectory::WorkingDirectory()
+{
+    sector = -1;			// the file system knows the root's
+    depth = 0;
+}
+
+WorkingDirectory::~WorkingDirectory()
+{
+    for (int i = 0; i < depth; i++)
+	delete [] names[i];
+}
+
+//----------------------------------------------------------------------
+// WorkingDirectory::Set
+// 	Move to the directory named by the "len" components of a path,
+//	whose header is at "dirSector".  The names may be our own old
+//	ones (the path may have been relative), so the new ones are
+//	copied before those are freed.
+//----------------------------------------------------------------------
+
+void
+WorkingDirectory::Set(char **newNames, int len, int dirSector)
+{
+    char *copies[MaxPathDepth];
+
+    ASSERT(len <= MaxPathDepth);
+    for (int i = 0; i < len; i++) {
+	copies[i] = new char[strlen(newNames[i]) + 1];
+	strcpy(copies[i], newNames[i]);
+    }
+    for (int i = 0; i < depth; i++)
+	delete [] names[i];
+    for (int i = 0; i < len; i++)
+	names[i] = copies[i];
+    depth = len;
+    sector = dirSector;
+}
+
+//----------------------------------------------------------------------
+// WorkingDirectory::CopyFrom
+// 	Move to the same directory as "other" (for a forked program).
+//----------------------------------------------------------------------
+
+void
+WorkingDirectory::CopyFrom(WorkingDirectory *other)
+{
+    Set(other->names, other->depth, other->sector);
+}
+
+//----------------------------------------------------------------------
+// WorkingDirectory::Under
+// 	Return TRUE if the path of "len" components starts with ours, so
+//	that resolving it can start here.
+//----------------------------------------------------------------------
+
+bool
+WorkingDirectory::Under(char **path, int len)
+{
+    if (len < depth)
+	return FALSE;
+    for (int i = 0; i < depth; i++) {
+	if (strcmp(path[i], names[i]) != 0)
+	    return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,103 @@
+// dcache.h
+//	Data structures for a cache of path name lookups (a "dentry
+//	cache").
+//
+//	To find a file, the file system walks its path from the root,
+//	reading each directory on the way to find the next one.  The
+//	dentry cache remembers, for a path such as "/t0/t1", the sector
+//	of the header of the directory it names, so that the next lookup
+//	of the same path, or of a path under it, skips the walk.
+//
+//	The cache also keeps negative entries: a path that was looked up
+//	and found not to exist.  The file system invalidates the entry
+//	for a path whenever a name is added there, and every entry at or
+//	below a path whenever that name is removed.
+//
+//	The cache is direct-mapped: each path can only live in one slot,
+//	chosen by hashing it, and a new path simply replaces whatever
+//	was there.
+//
+//	A working directory, on the other hand, is pinned: it holds its
+//	path and the sector of its directory itself, so a lookup under it
+//	never walks down from the root, whatever has been evicted from
+//	the cache.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DCACHE_H
+#define DCACHE_H
+
+const int NumDentries = 128;		// number of paths remembered
+const int DentryPathMaxLen = 63;	// longer paths are never cached
+const int MaxPathDepth = 10;		// components in a path, or in a
+					// working directory
+
+// The following class defines one cached lookup.
+
+class Dentry {
+  public:
+    bool valid;				// does this slot hold a path?
+    int sector;				// header sector of the directory,
+					//   -1 if the path does not exist
+    char path[DentryPathMaxLen + 1];	// full path, e.g. "/t0/t1"
+};
+
+// The following class defines the dentry cache.  Paths are given as
+// the components produced by FileSystem::splitPath: "len" names,
+// starting from the root.
+
+class DentryCache {
+  public:
+    DentryCache();			// Initialize an empty cache
+
+    bool Lookup(char **names, int len, int *sector);
+					// If the path is cached, set
+					// "sector" (-1 for a negative
+					// entry) and return TRUE
+    void Enter(char **names, int len, int sector);
+					// Remember where a path leads,
+					// or (if "sector" is -1) that it
+					// does not exist
+    void Invalidate(char **names, int len);
+					// Forget a path
+    void InvalidateTree(char **names, int len);
+					// Forget a path and every path
+					// below it
+
+  private:
+    Dentry entries[NumDentries];
+
+    static bool MakePath(char *buffer, char **names, int len);
+					// join the names into "buffer";
+					// FALSE if the path is too long
+    static int SlotOf(char *path);	// which slot "path" lives in
+};
+
+// The following class defines a working directory: where a relative
+// path starts from.  Each address space has one (see AddrSpace); the
+// kernel's own threads share another.
+
+class WorkingDirectory {
+  public:
+    WorkingDirectory();			// Start at the root
+    ~WorkingDirectory();
+
+    void Set(char **names, int len, int dirSector);
+					// Move to the directory named by
+					// the path, at "dirSector"
+    void CopyFrom(WorkingDirectory *other);
+					// Move to where "other" is
+    bool Under(char **names, int len);	// Is the path at or below here?
+
+    int sector;				// header sector of the directory;
+					// not set at the root, and -1 in a
+					// file system mounted on it
+    int depth;				// components in its path
+    char *names[MaxPathDepth];		// the components, our own copies
+};
+
+#endif // DCACHE_H
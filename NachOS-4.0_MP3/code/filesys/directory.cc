@@ -1,19 +1,35 @@
 // directory.cc
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
-//	entry represents a single file, and contains the file name,
-//	and the location of the file header on disk.  The fixed size
-//	of each directory entry means that we have the restriction
-//	of a fixed maximum size for file names.
+//	The directory is a list of variable length records; each
+//	record represents a single file, and contains the file name,
+//	and the location of the file header on disk.  A record is as
+//	long as its name needs, plus whatever free space follows it, up
+//	to the next record; the last record runs to the end of the file.
+//	A new name goes in the free space after a record, or in a record
+//	no longer in use, and a removed one gives its space to the
+//	record before it.
 //
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
+//	Only the part of the file up to the end of the last record in use
+//	is read or written; the free space past it is never looked at.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	Names are looked up through a hash index kept only in memory:
+//	"bucket" gives the first record whose name hashes there, and
+//	"nextInChain" links the records of a chain.  Lookups therefore
+//	compare one name or a few, instead of every name in the directory.
+//	Each record's whole hash is kept beside its link, in "hashOf", so
+//	that walking a chain compares words held together, and only a
+//	record whose hash matches has its name looked at.
+//
+//	The directory can expand: Expand adds free records at the end,
+//	and the file system grows the directory file to match before
+//	writing it back.  FetchFrom sizes the directory from the length
+//	of the file.  Once it has grown to MinIndexedSize, the directory
+//	is indexed instead, and every operation is handed on to its
+//	DirectoryIndex.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -23,7 +39,11 @@
 #include "utility.h"
 #include "filehdr.h"
 #include "directory.h"
+#include "dirindex.h"
 #include "debug.h"
+#include "disk.h"
+#include "kernelprofile.h"
+#include "memcount.h"
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -32,17 +52,21 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of bytes in the directory
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
 {
-    table = new DirectoryEntry[size];
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-    {
-        table[i].inUse = NOT_USE;
-    }
+    index = NULL;
+    data = NULL;
+    length = 0;
+    endOnDisk = -1;
+    dirtyFrom = dirtyTo = 0;
+    bucket = NULL;
+    nextInChain = NULL;
+    hashOf = NULL;
+    Resize(size);
+    MemCount::Add(MemDirectory, sizeof(Directory));
 }
 
 //----------------------------------------------------------------------
@@ -52,49 +76,561 @@ Directory::Directory(int size)
 
 Directory::~Directory()
 {
-    delete[] table;
+    delete index;
+    delete[] data;
+    delete[] bucket;
+    delete[] nextInChain;
+    delete[] hashOf;
+    MemCount::Remove(MemDirectory, sizeof(Directory));
+}
+
+thread_local Slab Directory::slab("directories", sizeof(Directory));
+
+//----------------------------------------------------------------------
+// Directory::operator new, Directory::operator delete
+// 	Allocate the space for a Directory from its slab, and release it
+//	back there.
+//----------------------------------------------------------------------
+
+void *Directory::operator new(size_t size)
+{
+    return slab.Alloc(size);
+}
+
+void Directory::operator delete(void *p, size_t size)
+{
+    slab.Free(p, size);
+}
+
+//----------------------------------------------------------------------
+// HashName
+// 	Hash the "len" characters of a file name, so that equal names land
+//	in the same chain.
+//----------------------------------------------------------------------
+
+static unsigned
+HashName(char *name, int len)
+{
+    unsigned h = 0;
+
+    for (int i = 0; i < len; i++)
+        h = h * 31 + (unsigned char)name[i];
+    return h;
+}
+
+//----------------------------------------------------------------------
+// NameLength
+// 	How many characters of "name" a record keeps.
+//----------------------------------------------------------------------
+
+int
+NameLength(char *name)
+{
+    int len = 0;
+
+    while (len < FileNameMaxLen && name[len] != '\0')
+        len++;
+    return len;
+}
+
+//----------------------------------------------------------------------
+// Directory::Get, Directory::Put
+// 	Copy the record at "offset" out of the directory into "rec", or
+//	"rec" back into the directory.  Only the start of the record is
+//	copied, not the name.  Put marks it as to be written back.
+//----------------------------------------------------------------------
+
+void Directory::Get(int offset, DirectoryRecord *rec)
+{
+    bcopy(&data[offset], (char *)rec, RecordHeaderSize);
+}
+
+void Directory::Put(int offset, DirectoryRecord *rec)
+{
+    bcopy((char *)rec, &data[offset], RecordHeaderSize);
+    MarkDirty(offset, offset + RecordHeaderSize);
+}
+
+//----------------------------------------------------------------------
+// Directory::MarkDirty
+// 	Note that bytes "from" to "to" of the directory have changed, and
+//	have to be written back.  One range is kept, from the first byte
+//	changed to the last: records changed together are mostly near
+//	each other.
+//----------------------------------------------------------------------
+
+void Directory::MarkDirty(int from, int to)
+{
+    if (dirtyFrom >= dirtyTo)
+    {
+        dirtyFrom = from;
+        dirtyTo = to;
+        return;
+    }
+    if (from < dirtyFrom)
+        dirtyFrom = from;
+    if (to > dirtyTo)
+        dirtyTo = to;
+}
+
+//----------------------------------------------------------------------
+// Directory::Used
+// 	Return how many bytes of a record are taken: its start and its
+//	name if it is in use, only its start if not.  The rest, up to
+//	the next record, is free.
+//----------------------------------------------------------------------
+
+int Directory::Used(DirectoryRecord *rec)
+{
+    if (rec->type == NOT_USE)
+        return RecordHeaderSize;
+    return RecordHeaderSize + rec->nameLen;
+}
+
+//----------------------------------------------------------------------
+// Directory::MakeFree
+// 	Fill bytes "from" to "to" of the directory with records not in
+//	use, none longer than MaxRecordLength.  A long stretch is cut so
+//	that the last record still has room for its start.
+//----------------------------------------------------------------------
+
+void Directory::MakeFree(int from, int to)
+{
+    DirectoryRecord rec;
+
+    ASSERT(to - from >= RecordHeaderSize);
+    rec.sector = -1;
+    rec.type = NOT_USE;
+    rec.nameLen = 0;
+    while (from < to)
+    {
+        int len = to - from;
+
+        if (len > MaxRecordLength)
+            len = min(MaxRecordLength, len - RecordHeaderSize);
+        rec.recLen = len;
+        Put(from, &rec);
+        from += len;
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::Resize
+// 	Re-allocate the directory with "newSize" bytes.  The records are
+//	kept, the new bytes become free records, and the index is rebuilt.
+//	An empty directory is given its header first.
+//
+//	"newSize" -- the number of bytes in the new directory
+//----------------------------------------------------------------------
+
+void Directory::Resize(int newSize)
+{
+    char *oldData = data;
+
+    data = new char[newSize];
+    if (length == 0)
+    {
+        DirectoryHeader header;
+
+        header.magic = DirectoryMagic;
+        header.end = 0;         // set by WriteBack
+        bcopy((char *)&header, data, sizeof(DirectoryHeader));
+        length = sizeof(DirectoryHeader);
+    }
+    else
+        bcopy(oldData, data, length);
+    MakeFree(length, newSize);
+    length = newSize;
+    delete[] oldData;
+
+    delete[] bucket;
+    delete[] nextInChain;
+    delete[] hashOf;
+    for (numBuckets = 1; numBuckets * RecordHeaderSize < length; numBuckets *= 2)
+        ;
+    bucket = new int[numBuckets];
+    nextInChain = new int[length];
+    hashOf = new unsigned[length];
+    BuildIndex();
+}
+
+//----------------------------------------------------------------------
+// Directory::Hash
+// 	Put the record at "offset" on its hash chain.
+//----------------------------------------------------------------------
+
+void Directory::Hash(int offset)
+{
+    DirectoryRecord rec;
+
+    Get(offset, &rec);
+    hashOf[offset] = HashName(NameAt(offset), rec.nameLen);
+    int b = hashOf[offset] & (numBuckets - 1);
+    nextInChain[offset] = bucket[b];
+    bucket[b] = offset;
+}
+
+//----------------------------------------------------------------------
+// Directory::BuildIndex
+// 	Throw away the hash index and rebuild it from the records.  They
+//	are hashed in the order they come, and each one goes to the front
+//	of its chain, so if a name somehow appears twice, the last one is
+//	found; names are never added twice, so this does not come up.
+//----------------------------------------------------------------------
+
+void Directory::BuildIndex()
+{
+    DirectoryRecord rec;
+
+    for (int b = 0; b < numBuckets; b++)
+        bucket[b] = -1;
+    numInUse = 0;
+    for (int offset = sizeof(DirectoryHeader); offset < length; offset += rec.recLen)
+    {
+        Get(offset, &rec);
+        ASSERT(rec.recLen >= Used(&rec) && offset + rec.recLen <= length);
+        if (rec.type != NOT_USE)
+        {
+            Hash(offset);
+            numInUse++;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// Directory::Unhash
+// 	Take the record at "offset" off its hash chain.
+//----------------------------------------------------------------------
+
+void Directory::Unhash(int offset)
+{
+    int *link = &bucket[hashOf[offset] & (numBuckets - 1)];
+
+    while (*link != offset)
+    {
+        ASSERT(*link != -1);
+        link = &nextInChain[*link];
+    }
+    *link = nextInChain[offset];
+}
+
+//----------------------------------------------------------------------
+// Directory::Expand
+// 	Make room for more files.  The caller must grow the directory's
+//	file to Size() bytes before the next WriteBack.
+//
+//	"newSize" -- the number of bytes the directory should have
+//----------------------------------------------------------------------
+
+void Directory::Expand(int newSize)
+{
+    if (index != NULL)
+    {
+        index->Expand(newSize);
+        length = newSize;
+        return;
+    }
+    Resize(newSize);
+    if (length >= MinIndexedSize)
+        MakeIndex();
+}
+
+//----------------------------------------------------------------------
+// Directory::FreeRecords
+// 	Throw away the records, and their hash index, once the directory
+//	is indexed.
+//----------------------------------------------------------------------
+
+void Directory::FreeRecords()
+{
+    delete[] data;
+    delete[] bucket;
+    delete[] nextInChain;
+    delete[] hashOf;
+    data = NULL;
+    bucket = NULL;
+    nextInChain = NULL;
+    hashOf = NULL;
+}
+
+//----------------------------------------------------------------------
+// Directory::MakeIndex
+// 	Move the records into a new DirectoryIndex over the same file.
+//	The leaves of the index are not as full as the records, so they
+//	may not fit; the directory then stays as it is, and is indexed
+//	when it grows again.  WriteBack writes the whole index.
+//----------------------------------------------------------------------
+
+void Directory::MakeIndex()
+{
+    DirectoryIndex *newIndex = new DirectoryIndex(length);
+    DirectoryEntry entry;
+
+    for (int position = 0; NextEntry(&position, &entry);)
+        if (!newIndex->Add(entry.name, entry.sector, entry.inUse))
+        {
+            DEBUG(dbgFile, "No room yet to index the directory.");
+            delete newIndex;
+            return;
+        }
+    DEBUG(dbgFile, "Indexing a directory of " << numInUse << " names.");
+    FreeRecords();
+    index = newIndex;
+}
+
+//----------------------------------------------------------------------
+// Directory::Convert
+// 	Replace the records with the entries of a directory written
+//	before they were packed, in the same order.  The packed ones are
+//	shorter, so they always fit.
+//
+//	"table" -- the old entries
+//	"size" -- how many of them there are
+//----------------------------------------------------------------------
+
+void Directory::Convert(OldDirectoryEntry *table, int size)
+{
+    int offset = sizeof(DirectoryHeader);
+    DirectoryRecord rec;
+
+    for (int i = 0; i < size; i++)
+        if (table[i].inUse != NOT_USE)
+        {
+            rec.sector = table[i].sector;
+            rec.type = table[i].inUse;
+            rec.nameLen = 0;
+            while (rec.nameLen < OldFileNameMaxLen && table[i].name[rec.nameLen] != '\0')
+                rec.nameLen++;
+            rec.recLen = Used(&rec);
+            Put(offset, &rec);
+            bcopy(table[i].name, NameAt(offset), rec.nameLen);
+            MarkDirty(offset, offset + rec.recLen);
+            offset += rec.recLen;
+        }
+    MakeFree(offset, length);
 }
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Read the contents of the directory from disk, and index them.
+//	The directory is re-sized first if the file has grown.  Only what
+//	the header says is in use is read.  A directory of the old format
+//	is read whole, and packed.  Of an indexed one, only the header is
+//	read; the rest is read a block at a time, when it is needed.
+//
+//	What was read is what is on disk: nothing is dirty.  A directory
+//	that was packed has to be written back whole, header and all.
+//	The buffer cache is told the sectors are metadata (see
+//	OpenFile::MarkMetadata), as it is after WriteBack.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
 void Directory::FetchFrom(OpenFile *file)
 {
-    (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    ProfileRegion region("Directory::FetchFrom");
+    DirectoryHeader header;
+    int size = file->Length();
+
+    delete index;
+    index = NULL;
+    (void)file->ReadAt((char *)&header, sizeof(DirectoryHeader), 0);
+    if (header.magic == DirIndexMagic)
+    {
+        FreeRecords();
+        index = new DirectoryIndex(file);
+        length = size;
+        file->MarkMetadata();
+        return;
+    }
+    if (data == NULL || size != length)
+    {
+        FreeRecords();
+        length = 0;
+        Resize(size);
+    }
+    if (header.magic == DirectoryMagic)
+    {
+        ASSERT(header.end >= (int)sizeof(DirectoryHeader) && header.end <= length);
+        (void)file->ReadAt(data, header.end, 0);
+        endOnDisk = header.end;
+        dirtyFrom = dirtyTo = 0;
+    }
+    else
+    {
+        int oldSize = length / sizeof(OldDirectoryEntry);
+        OldDirectoryEntry *table = new OldDirectoryEntry[oldSize];
+
+        DEBUG(dbgFile, "Packing a directory of the old format.");
+        endOnDisk = -1;
+        (void)file->ReadAt((char *)table, oldSize * sizeof(OldDirectoryEntry), 0);
+        Convert(table, oldSize);
+        delete[] table;
+    }
+    BuildIndex();
+    file->MarkMetadata();
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk: the sectors
+//	of the records changed since it was last read or written, up to the
+//	end of the last one in use, and the header if that end has moved;
+//	the header goes on its own, so adding a name at the end of a long
+//	directory writes two sectors, not all of them.  Nothing is written
+//	if nothing has changed.  Whole sectors are
+//	written where the directory has them, so the buffer cache need
+//	not read them first.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
 void Directory::WriteBack(OpenFile *file)
 {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    DirectoryHeader header;
+    DirectoryRecord rec;
+    int offset = sizeof(DirectoryHeader);
+
+    if (index != NULL)
+    {
+        index->WriteBack(file);
+        file->MarkMetadata();
+        return;
+    }
+    for (Get(offset, &rec); offset + rec.recLen < length; Get(offset, &rec))
+        offset += rec.recLen;
+    header.magic = DirectoryMagic;
+    header.end = offset + Used(&rec);
+    bcopy((char *)&header, data, sizeof(DirectoryHeader));
+    if (header.end != endOnDisk)
+    {
+        if (dirtyFrom < SectorSize && dirtyFrom < dirtyTo)
+            dirtyFrom = 0; // it goes with the records there
+        else
+            (void)file->WriteAt(data, min(SectorSize, header.end), 0);
+        endOnDisk = header.end;
+    }
+    if (dirtyTo > header.end) // the rest is free, and never read
+        dirtyTo = header.end;
+    if (dirtyFrom < dirtyTo)
+    {
+        int from = dirtyFrom / SectorSize * SectorSize;
+        int to = min(divRoundUp(dirtyTo, SectorSize) * SectorSize, header.end);
+
+        (void)file->WriteAt(&data[from], to - from, from);
+    }
+    dirtyFrom = dirtyTo = 0;
+    file->MarkMetadata();
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
-// 	Look up file name in directory, and return its location in the table of
-//	directory entries.  Return -1 if the name isn't in the directory.
+// 	Look up file name in directory, and return the offset of its
+//	record.  Return -1 if the name isn't in the directory.  Records
+//	on the chain whose whole hash differs are passed over without
+//	reading them.
 //
 //	"name" -- the file name to look up
 //----------------------------------------------------------------------
 
 int Directory::FindIndex(char *name)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse != NOT_USE && !strncmp(table[i].name, name, FileNameMaxLen))
+    int len = NameLength(name);
+    unsigned h = HashName(name, len);
+    DirectoryRecord rec;
+
+    for (int i = bucket[h & (numBuckets - 1)]; i != -1; i = nextInChain[i])
+    {
+        if (hashOf[i] != h)
+            continue;
+        Get(i, &rec);
+        if (rec.nameLen == len && !memcmp(NameAt(i), name, len))
             return i;
+    }
     return -1; // name not in directory
 }
 
+//----------------------------------------------------------------------
+// Directory::FindRoom
+// 	Return the offset of the first record with enough free space
+//	after it (or in it, if it is not in use) to hold a record for
+//	"name".  Return -1 if there is none.
+//
+//	"name" -- the file name to make room for
+//----------------------------------------------------------------------
+
+int Directory::FindRoom(char *name)
+{
+    int needed = RecordHeaderSize + NameLength(name);
+    DirectoryRecord rec;
+
+    for (int offset = sizeof(DirectoryHeader); offset < length; offset += rec.recLen)
+    {
+        Get(offset, &rec);
+        if (rec.type == NOT_USE ? rec.recLen >= needed
+                                : rec.recLen - Used(&rec) >= needed)
+            return offset;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::CopyEntry
+// 	Copy the record at "offset" into "entry", with its name ended by
+//	a '\0'.
+//----------------------------------------------------------------------
+
+void Directory::CopyEntry(int offset, DirectoryEntry *entry)
+{
+    DirectoryRecord rec;
+
+    Get(offset, &rec);
+    entry->inUse = rec.type;
+    entry->sector = rec.sector;
+    bcopy(NameAt(offset), entry->name, rec.nameLen);
+    entry->name[rec.nameLen] = '\0';
+}
+
+//----------------------------------------------------------------------
+// Directory::NextEntry
+// 	Copy the first entry in use at or after byte "position" of the
+//	directory into "entry", and set "position" past it.  Return FALSE
+//	if there are no more.
+//----------------------------------------------------------------------
+
+bool Directory::NextEntry(int *position, DirectoryEntry *entry)
+{
+    DirectoryRecord rec;
+
+    if (index != NULL)
+        return index->Next(position, entry);
+    for (int offset = max(*position, (int)sizeof(DirectoryHeader)); offset < length;
+         offset += rec.recLen)
+    {
+        Get(offset, &rec);
+        if (rec.type != NOT_USE)
+        {
+            CopyEntry(offset, entry);
+            *position = offset + rec.recLen;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Directory::HasRoomFor
+// 	Return TRUE if "name" can be added without expanding the
+//	directory.
+//----------------------------------------------------------------------
+
+bool Directory::HasRoomFor(char *name)
+{
+    if (index != NULL)
+        return index->HasRoomFor(name);
+    return FindRoom(name) != -1;
+}
+
 //----------------------------------------------------------------------
 // Directory::Find
 // 	Look up file name in directory, and return the disk sector number
@@ -106,45 +642,94 @@ int Directory::FindIndex(char *name)
 
 int Directory::Find(char *name)
 {
+    DirectoryEntry entry;
+
+    if (index != NULL)
+        return index->Find(name, &entry) ? entry.sector : -1;
+
     int i = FindIndex(name);
+    DirectoryRecord rec;
 
-    if (i != -1)
-        return table[i].sector;
-    return -1;
+    if (i == -1)
+        return -1;
+    Get(i, &rec);
+    return rec.sector;
+}
+
+//----------------------------------------------------------------------
+// Directory::FindType
+// 	Look up file name in directory, and return whether it is a file
+//	(IS_FILE) or a directory (IS_DIR).  Return NOT_USE if the name
+//	isn't in the directory.
+//
+//	"name" -- the file name to look up
+//----------------------------------------------------------------------
+
+int Directory::FindType(char *name)
+{
+    DirectoryEntry entry;
+
+    if (index != NULL)
+        return index->Find(name, &entry) ? entry.inUse : NOT_USE;
+
+    int i = FindIndex(name);
+    DirectoryRecord rec;
+
+    if (i == -1)
+        return NOT_USE;
+    Get(i, &rec);
+    return rec.type;
 }
 
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
 //	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	the directory has no free space left big enough for the name.
+//
+//	The file takes the first record not in use, or the free space
+//	after the first record in use, that is big enough; that record
+//	is cut in two.  A full directory can be made bigger with Expand.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"type" -- IS_FILE or IS_DIR
 //----------------------------------------------------------------------
 
 bool Directory::Add(char *name, int newSector, int type)
 {
+    DirectoryRecord rec, newRec;
+
+    if (index != NULL)
+        return index->Add(name, newSector, type);
     if (FindIndex(name) != -1)
     {
         DEBUG(dbgFile, " Directory : index not found.");
         return FALSE;
     }
+    int offset = FindRoom(name);
+    if (offset == -1)
+        return FALSE; // no space; the caller can Expand
 
-    for (int i = 0; i < tableSize; i++)
+    Get(offset, &rec);
+    newRec.recLen = rec.recLen;
+    if (rec.type != NOT_USE)
     {
-        if (table[i].inUse == NOT_USE)
-        {
-            table[i].inUse = type;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
-            return TRUE;
-        }
-        DEBUG(dbgFile, " Directory : in loop. The table entry type is "<<table[i].inUse);
+        newRec.recLen = rec.recLen - Used(&rec);
+        rec.recLen = Used(&rec);
+        Put(offset, &rec);
+        offset += rec.recLen;
     }
+    newRec.sector = newSector;
+    newRec.type = type;
+    newRec.nameLen = NameLength(name);
+    Put(offset, &newRec);
+    bcopy(name, NameAt(offset), newRec.nameLen);
+    MarkDirty(offset, offset + Used(&newRec));
 
-    return FALSE; // no space.  Fix when we have extensible files.
+    Hash(offset);
+    numInUse++;
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -152,16 +737,43 @@ bool Directory::Add(char *name, int newSector, int type)
 // 	Remove a file name from the directory.  Return TRUE if successful;
 //	return FALSE if the file isn't in the directory.
 //
+//	The record's space goes to the record before it.  The first
+//	record has none before it, and is only marked as not in use; so
+//	is one that would make the record before it too long.
+//
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool Directory::Remove(char *name)
 {
+    if (index != NULL)
+        return index->Remove(name);
+
     int i = FindIndex(name);
+    DirectoryRecord rec, prevRec;
+    int prev = -1;
 
     if (i == -1)
         return FALSE; // name not in directory
-    table[i].inUse = NOT_USE;
+    Unhash(i);
+    numInUse--;
+    Get(i, &rec);
+    for (int offset = sizeof(DirectoryHeader); offset != i; offset += prevRec.recLen)
+    {
+        Get(offset, &prevRec);
+        prev = offset;
+    }
+    if (prev != -1 && prevRec.recLen + rec.recLen <= 0xffff) // fits in recLen
+    {
+        prevRec.recLen += rec.recLen;
+        Put(prev, &prevRec);
+    }
+    else
+    {
+        rec.type = NOT_USE;
+        rec.nameLen = 0;
+        Put(i, &rec);
+    }
     return TRUE;
 }
 
@@ -172,11 +784,10 @@ bool Directory::Remove(char *name)
 
 void Directory::List()
 {
-    for (int i = 0, __cnt = tableSize; i < tableSize; i++)
-        if (table[i].inUse > 0)
-        {
-            printf("%s\t%s\n", table[i].name, table[i].inUse==1?"File":"Dir");
-        }
+    DirectoryEntry entry;
+
+    for (int position = 0; NextEntry(&position, &entry);)
+        printf("%s\t%s\n", entry.name, entry.inUse==1?"File":"Dir");
 }
 
 //----------------------------------------------------------------------
@@ -188,15 +799,183 @@ void Directory::List()
 void Directory::Print()
 {
     FileHeader *hdr = new FileHeader;
+    DirectoryEntry entry;
 
     printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
-        {
-            printf("Name: %s, Sector: %d, Type : %d\n", table[i].name, table[i].sector, table[i].inUse);
-            hdr->FetchFrom(table[i].sector);
-            hdr->Print();
-        }
+    for (int position = 0; NextEntry(&position, &entry);)
+    {
+        printf("Name: %s, Sector: %d, Type : %d\n", entry.name, entry.sector, entry.inUse);
+        hdr->FetchFrom(entry.sector);
+        hdr->Print();
+    }
     printf("\n");
     delete hdr;
 }
+
+//----------------------------------------------------------------------
+// DirectoryIterator::DirectoryIterator
+// 	Start a pass over the directory in "file" at byte "position",
+//	which should be the start of an entry (0, or what Position
+//	returned).  Nothing is read until the first call to Next.
+//----------------------------------------------------------------------
+
+DirectoryIterator::DirectoryIterator(OpenFile *dirFile, int start)
+{
+    file = dirFile;
+    length = -1;
+    position = start;
+    buffer = new char[SectorSize];
+    bufferStart = -1;
+}
+
+DirectoryIterator::~DirectoryIterator()
+{
+    delete[] buffer;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIterator::CopyOut
+// 	Copy "numBytes" of the file, starting at "position", out of the
+//	buffer, and move past them.  When they run into the next sector,
+//	it is read into the buffer, in place of the one before.
+//----------------------------------------------------------------------
+
+void DirectoryIterator::CopyOut(char *into, int numBytes)
+{
+    while (numBytes > 0)
+    {
+        int start = (position / SectorSize) * SectorSize;
+        int chunk = min(numBytes, start + SectorSize - position);
+
+        if (start != bufferStart)
+        {
+            (void)file->ReadAt(buffer, min(SectorSize, file->Length() - start), start);
+            bufferStart = start;
+        }
+        bcopy(&buffer[position - start], into, chunk);
+        into += chunk;
+        position += chunk;
+        numBytes -= chunk;
+    }
+}
+
+//----------------------------------------------------------------------
+// DirectoryIterator::ReadHeader
+// 	Read the start of the file, to find out the format of the
+//	directory, and so where its entries end.  A pass from the start
+//	of a packed directory starts after the header.
+//----------------------------------------------------------------------
+
+void DirectoryIterator::ReadHeader()
+{
+    DirectoryHeader header;
+    int start = position;
+
+    position = 0;
+    CopyOut((char *)&header, sizeof(DirectoryHeader));
+    if (header.magic == DirIndexMagic)
+    {
+        DirIndexHeader indexHeader;
+
+        position = 0;
+        CopyOut((char *)&indexHeader, sizeof(DirIndexHeader));
+        format = IndexedDirectory;
+        length = indexHeader.numBlocks * DirBlockSize;
+        leafBlock = -1;
+        position = start;
+    }
+    else if (header.magic == DirectoryMagic)
+    {
+        format = PackedDirectory;
+        length = header.end;
+        position = max(start, (int)sizeof(DirectoryHeader));
+    }
+    else
+    {
+        format = OldDirectory;
+        length = file->Length();
+        position = start;
+    }
+}
+
+//----------------------------------------------------------------------
+// DirectoryIterator::NextInLeaf
+// 	Of an indexed directory, find the next leaf at or after
+//	"position", and move to its next record.  Return FALSE when there
+//	are no more.
+//----------------------------------------------------------------------
+
+bool DirectoryIterator::NextInLeaf()
+{
+    while (position < length)
+    {
+        int block = position / DirBlockSize;
+        int blockStart = block * DirBlockSize;
+
+        if (block != leafBlock)
+        {
+            DirBlockHeader hdr;
+            int start = position;
+
+            position = blockStart + (block == 0 ? sizeof(DirIndexHeader) : 0);
+            CopyOut((char *)&hdr, sizeof(DirBlockHeader));
+            leafBlock = block;
+            leafEnd = (hdr.kind == LeafDirBlock) ? blockStart + hdr.count : -1;
+            position = max(start, position);
+        }
+        if (position < leafEnd)
+            return TRUE;
+        position = blockStart + DirBlockSize;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIterator::Next
+// 	Find the next entry of the directory that is in use, and copy it
+//	into "entry".  Return FALSE when the end of the directory is
+//	reached.
+//----------------------------------------------------------------------
+
+bool DirectoryIterator::Next(DirectoryEntry *entry)
+{
+    if (length == -1)
+        ReadHeader();
+    if (format == OldDirectory)
+    {
+        OldDirectoryEntry old;
+
+        while (position + (int)sizeof(OldDirectoryEntry) <= length)
+        {
+            CopyOut((char *)&old, sizeof(OldDirectoryEntry));
+            if (old.inUse != NOT_USE)
+            {
+                entry->inUse = old.inUse;
+                entry->sector = old.sector;
+                strncpy(entry->name, old.name, OldFileNameMaxLen);
+                entry->name[OldFileNameMaxLen] = '\0';
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+    while (format == IndexedDirectory ? NextInLeaf()
+                                     : position + RecordHeaderSize <= length)
+    {
+        DirectoryRecord rec;
+        int start = position;
+
+        CopyOut((char *)&rec, RecordHeaderSize);
+        if (rec.type != NOT_USE)
+        {
+            CopyOut(entry->name, rec.nameLen);
+            entry->name[rec.nameLen] = '\0';
+            entry->inUse = rec.type;
+            entry->sector = rec.sector;
+            position = start + rec.recLen;
+            return TRUE;
+        }
+        position = start + rec.recLen;
+    }
+    return FALSE;
+}
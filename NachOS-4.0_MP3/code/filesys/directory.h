@@ -1,11 +1,40 @@
 // directory.h
 //	Data structures to manage a UNIX-like directory of file names.
 //
-//      A directory is a table of pairs: <file name, sector #>,
+//      A directory is a list of records: <file name, sector #>,
 //	giving the name of each file in the directory, and
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	The records are packed one after the other, each only as long
+//	as its name needs, names being up to FileNameMaxLen characters
+//	(as in the BSD fast file system).  Each record says how far it
+//	is to the next one; the space past the end of its name is free,
+//	and a new name can be put there.  A small header in front says
+//	where the last record in use ends, so that nothing past it has
+//	to be read or written.
+//
+//	To find a name without scanning every record, the directory
+//	keeps an index in memory: a hash table whose buckets hold chains
+//	of records.  The index is rebuilt whenever the directory is
+//	read in from disk; it is never stored.
+//
+//	A directory is not limited to the size it was created with.
+//	Its records take up all of its file, and Expand makes it bigger;
+//	the caller is responsible for growing the file to match.
+//
+//	A DirectoryIterator reads the entries of a directory one at a
+//	time (like UNIX readdir), straight from its file, holding only
+//	one sector of it at a time; nothing else needs to be read in.
+//
+//	A directory that grows big is indexed on disk instead, so that a
+//	name can be looked up without reading it all (see dirindex.h).
+//
+//	A directory written before the records were packed is a table of
+//	fixed-size entries, with names of up to 9 characters.  It can
+//	be told apart by the missing magic number; it is read the same,
+//	and written back packed.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -19,16 +48,22 @@
 
 #include "openfile.h"
 
-#define FileNameMaxLen 9 // for simplicity, we assume
-                         // file names are <= 9 characters long
+#define FileNameMaxLen 255 // longest file name a record can hold
 
 #define NOT_USE 0
 #define IS_FILE 1
 #define IS_DIR  2
 
+class DirectoryIndex;
+
+int NameLength(char *name); // Characters of "name" a directory keeps
+
+enum DirectoryFormat { OldDirectory, PackedDirectory, IndexedDirectory };
+
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
-// the file's header is to be found on disk.
+// the file's header is to be found on disk.  This is how an entry is
+// handed out of a directory; on disk, it is a DirectoryRecord.
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
@@ -43,6 +78,54 @@ public:
                                  // the trailing '\0'
 };
 
+// The following class defines the header at the start of a directory
+// file.
+
+const int DirectoryMagic = 0x4e444952;	// says the records are packed
+
+class DirectoryHeader
+{
+public:
+  int magic;                     // DirectoryMagic
+  int end;                       // Where the last record in use (or
+                                 //   the last record) stops being
+                                 //   used; the rest of the file is free
+};
+
+// The following class defines the start of a record of a directory
+// file, as it is on disk.  The name follows it, "nameLen" characters
+// with no trailing '\0', and the next record starts "recLen" bytes
+// after this one.  Records are packed with no alignment, so they are
+// copied in and out of the directory rather than used in place.
+
+class DirectoryRecord
+{
+public:
+  int sector;                    // Location on disk to find the
+                                 //   FileHeader for this file
+  unsigned short recLen;         // Bytes to the next record
+  unsigned char type;            // NOT_USE, IS_FILE or IS_DIR
+  unsigned char nameLen;         // Characters in the name
+};
+
+const int RecordHeaderSize = sizeof(DirectoryRecord);
+const int MaxRecordLength = 32768; // free space is cut into records
+                                 //   no longer than this, well within
+                                 //   what "recLen" can hold
+
+// The following class defines an entry of a directory written before
+// the records were packed.
+
+const int OldFileNameMaxLen = 9;
+
+class OldDirectoryEntry
+{
+public:
+  int inUse;
+  int sector;
+  char name[OldFileNameMaxLen + 1];
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
@@ -57,7 +140,7 @@ class Directory
 {
 public:
   Directory(int size); // Initialize an empty directory
-                       // with space for "size" files
+                       // of "size" bytes
   ~Directory();        // De-allocate the directory
 
   void FetchFrom(OpenFile *file); // Init directory contents from disk
@@ -66,8 +149,18 @@ public:
 
   int Find(char *name); // Find the sector number of the
                         // FileHeader for file: "name"
+  int FindType(char *name); // Is "name" a file (IS_FILE) or a
+                            // directory (IS_DIR)? NOT_USE if it
+                            // is not there
 
   bool Add(char *name, int newSector, int type); // Add a file name into the directory
+                                                 // Return FALSE if already there,
+                                                 // or if the directory is full
+
+  bool HasRoomFor(char *name); // Can "name" be added as it is?
+  int Size() { return length; } // Bytes in the directory file
+  void Expand(int newSize); // Grow to "newSize" bytes; a big
+                            // enough directory is indexed
 
   bool Remove(char *name); // Remove a file from the directory
 
@@ -77,13 +170,97 @@ public:
                 //  of the directory -- all the file
                 //  names and their contents.
 
+  void *operator new(size_t size); // From the slab of directories
+  void operator delete(void *p, size_t size);
+
+private:
+  static thread_local Slab slab; // where Directories come from
+  int length;            // Bytes in the directory, as in its file
+  DirectoryIndex *index; // The directory, if it is indexed; if not,
+                         //   NULL, and the following are used
+  char *data;            // The directory, as in its file: a
+                         //   DirectoryHeader, then the records
+  int numInUse;          // Number of records in use
+  int endOnDisk;         // The end of the records in the header on
+                         //   disk; -1 if it has none yet
+  int dirtyFrom;         // Bytes changed since the directory was read
+  int dirtyTo;           //   or written back: from "dirtyFrom" up to
+                         //   "dirtyTo"; none if they are equal
+
+  int numBuckets;        // Size of the hash index; a power of 2
+  int *bucket;           // First record of each hash chain, -1 if none
+  int *nextInChain;      // Next record in the same chain, -1 at the
+                         //   end; indexed by a record's offset
+  unsigned *hashOf;      // Whole hash of each record's name, checked
+                         //   before the name is; indexed the same way
+
+  void Get(int offset, DirectoryRecord *rec); // Copy a record out
+  void Put(int offset, DirectoryRecord *rec); //  and back in
+  void MarkDirty(int from, int to); // Bytes "from" to "to" have to
+                                    //  be written back
+  char *NameAt(int offset) { return &data[offset + RecordHeaderSize]; }
+  int Used(DirectoryRecord *rec); // Bytes of a record in use
+  void Resize(int newSize);  // Re-allocate the directory and the index,
+                             //  keeping the records
+  void MakeFree(int from, int to); // Fill bytes "from" to "to" with
+                                   //  free records
+  void Convert(OldDirectoryEntry *table, int size);
+                             // Pack the entries of an old directory
+  void MakeIndex();          // Index the directory, if it fits
+  void FreeRecords();        // Drop the records, and their index
+  void BuildIndex();         // Hash every record in use
+  void Hash(int offset);     // Put a record on its hash chain
+  void Unhash(int offset);   // Take a record off its hash chain
+
+  int FindIndex(char *name); // Find the offset of the record
+                             //  corresponding to "name"
+  int FindRoom(char *name);  // Find a record with room after it
+                             //  for "name"
+  void CopyEntry(int offset, DirectoryEntry *entry);
+                             // Copy a record out as an entry
+  bool NextEntry(int *position, DirectoryEntry *entry);
+                             // Copy out the entry at or after
+                             //  "position" (0 to start), and move
+                             //  past it
+};
+
+// The following class defines a pass over the entries of a directory
+// file, from first to last, of either format.  Each sector of the file
+// is read once, when the first entry in it is wanted.  The entries are
+// seen as they are on disk, so the directory should not change during
+// the pass.
+
+class DirectoryIterator
+{
+public:
+  DirectoryIterator(OpenFile *file, int position);
+                       // Read the directory in "file", starting
+                       // at byte "position"
+  ~DirectoryIterator(); // De-allocate the buffer; "file" stays
+                        // open
+
+  bool Next(DirectoryEntry *entry); // Copy out the next entry in use;
+                                    // FALSE if there are no more
+  int Position() { return position; } // Where the next entry starts, to
+                                      // carry on from later
+
 private:
-  int tableSize;         // Number of directory entries
-  DirectoryEntry *table; // Table of pairs:
-                         // <file name, file header location>
+  OpenFile *file;        // the directory file
+  int length;            // how far its entries go; -1 until the
+                         // header has been read
+  int format;            // a DirectoryFormat
+  int leafBlock;         // of an indexed directory, the block last
+                         // looked at, and where its records end (-1
+  int leafEnd;           // if it is not a leaf)
+  int position;          // of the next entry to look at
+  char *buffer;          // one sector of the file
+  int bufferStart;       // where it is in the file, -1 if none yet
 
-  int FindIndex(char *name); // Find the index into the directory
-  //  table corresponding to "name"
+  void CopyOut(char *into, int numBytes); // from the file at "position"
+  void ReadHeader();     // find out the format, and where the
+                         // entries end
+  bool NextInLeaf();     // of an indexed directory, move to the
+                         // next record in a leaf
 };
 
 #endif // DIRECTORY_H
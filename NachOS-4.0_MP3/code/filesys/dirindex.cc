@@ -0,0 +1,599 @@
+// dirindex.cc
+//	Routines to keep a large directory as a B+tree of name hashes.
+//
+//	Every operation starts at the root, in block 0, and goes down one
+//	index block per level, to the leaf whose range of hashes takes in
+//	the hash of the name.  Each block on the way is read into a
+//	buffer of the caller's, so a lookup changes nothing in the index.
+//	An operation that changes a block asks for it with Change, which
+//	keeps a copy until WriteBack; from then on, that copy is what is
+//	read.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dirindex.h"
+#include "openfile.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// IndexHash
+// 	Hash the "len" characters of a name (FNV-1a), for the keys of the
+//	tree.
+//----------------------------------------------------------------------
+
+static unsigned
+IndexHash(char *name, int len)
+{
+    unsigned h = 2166136261u;
+
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+//----------------------------------------------------------------------
+// HeaderOf, KeysOf, MaxKeys
+// 	Find the DirBlockHeader and the keys of a block in memory; those
+//	of block 0 come after the DirIndexHeader, so the root has room for
+//	fewer keys.
+//----------------------------------------------------------------------
+
+static DirBlockHeader *
+HeaderOf(int block, char *data)
+{
+    if (block == 0)
+        data += sizeof(DirIndexHeader);
+    return (DirBlockHeader *)data;
+}
+
+static DirIndexKey *
+KeysOf(int block, char *data)
+{
+    return (DirIndexKey *)((char *)HeaderOf(block, data) + sizeof(DirBlockHeader));
+}
+
+static int
+MaxKeys(int block)
+{
+    if (block == 0)
+        return MaxIndexKeys - divRoundUp(sizeof(DirIndexHeader), sizeof(DirIndexKey));
+    return MaxIndexKeys;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::DirectoryIndex
+// 	Use the index already in "dirFile": only its header is read.
+//----------------------------------------------------------------------
+
+DirectoryIndex::DirectoryIndex(OpenFile *dirFile)
+{
+    DirIndexHeader header;
+
+    file = dirFile;
+    (void)file->ReadAt((char *)&header, sizeof(DirIndexHeader), 0);
+    ASSERT(header.magic == DirIndexMagic);
+    numBlocks = header.numBlocks;
+    depth = header.depth;
+    maxBlocks = file->Length() / DirBlockSize;
+    ASSERT(numBlocks <= maxBlocks);
+    changed = new char *[maxBlocks];
+    for (int i = 0; i < maxBlocks; i++)
+        changed[i] = NULL;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::DirectoryIndex
+// 	Make a new index, for a file of "size" bytes: a root with a single
+//	empty leaf under it.  It is all kept in memory until WriteBack.
+//----------------------------------------------------------------------
+
+DirectoryIndex::DirectoryIndex(int size)
+{
+    file = NULL;
+    numBlocks = 0;
+    depth = 1;
+    maxBlocks = size / DirBlockSize;
+    ASSERT(maxBlocks >= 2);
+    changed = new char *[maxBlocks];
+    for (int i = 0; i < maxBlocks; i++)
+        changed[i] = NULL;
+
+    int root = NewBlock(IndexDirBlock);
+    int leaf = NewBlock(LeafDirBlock);
+    DirBlockHeader *hdr = HeaderOf(root, changed[root]);
+    DirIndexKey *keys = KeysOf(root, changed[root]);
+
+    keys[0].hash = 0;
+    keys[0].block = leaf;
+    hdr->count = 1;
+}
+
+DirectoryIndex::~DirectoryIndex()
+{
+    for (int i = 0; i < maxBlocks; i++)
+        delete[] changed[i];
+    delete[] changed;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::ReadBlock
+// 	Copy the latest contents of "block" into "into": the copy kept
+//	since it was changed, if there is one, or else the block on disk.
+//----------------------------------------------------------------------
+
+void
+DirectoryIndex::ReadBlock(int block, char *into)
+{
+    ASSERT(block >= 0 && block < numBlocks);
+    if (changed[block] != NULL)
+        bcopy(changed[block], into, DirBlockSize);
+    else
+        (void)file->ReadAt(into, DirBlockSize, block * DirBlockSize);
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Change
+// 	Return the copy of "block" to change, read in if there is none
+//	yet.  It is written back, and dropped, by WriteBack.
+//----------------------------------------------------------------------
+
+char *
+DirectoryIndex::Change(int block)
+{
+    if (changed[block] == NULL) {
+        char *data = new char[DirBlockSize];
+
+        ReadBlock(block, data);
+        changed[block] = data;
+    }
+    return changed[block];
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::SetHeader
+// 	Bring the header in block 0 up to date.
+//----------------------------------------------------------------------
+
+void
+DirectoryIndex::SetHeader()
+{
+    DirIndexHeader *header = (DirIndexHeader *)Change(0);
+
+    header->magic = DirIndexMagic;
+    header->numBlocks = numBlocks;
+    header->depth = depth;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::NewBlock
+// 	Take the next block of the file, and make it an empty one of
+//	"kind".  The caller has checked there is one.
+//----------------------------------------------------------------------
+
+int
+DirectoryIndex::NewBlock(int kind)
+{
+    ASSERT(numBlocks < maxBlocks);
+    int block = numBlocks++;
+    char *data = new char[DirBlockSize];
+    DirBlockHeader *hdr = HeaderOf(block, data);
+
+    bzero(data, DirBlockSize);
+    hdr->kind = kind;
+    hdr->count = (kind == LeafDirBlock) ? sizeof(DirBlockHeader) : 0;
+    changed[block] = data;
+    SetHeader();
+    return block;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::WriteBack
+// 	Write every block that changed to "dirFile", which is the file of
+//	the index from now on.
+//----------------------------------------------------------------------
+
+void
+DirectoryIndex::WriteBack(OpenFile *dirFile)
+{
+    file = dirFile;
+    for (int i = 0; i < numBlocks; i++)
+        if (changed[i] != NULL) {
+            (void)file->WriteAt(changed[i], DirBlockSize, i * DirBlockSize);
+            delete[] changed[i];
+            changed[i] = NULL;
+        }
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Expand
+// 	Take note that the file has grown to "newSize" bytes, so that new
+//	blocks can be taken from it.
+//----------------------------------------------------------------------
+
+void
+DirectoryIndex::Expand(int newSize)
+{
+    int newMax = newSize / DirBlockSize;
+    char **newChanged = new char *[newMax];
+
+    ASSERT(newMax >= maxBlocks);
+    for (int i = 0; i < newMax; i++)
+        newChanged[i] = (i < maxBlocks) ? changed[i] : NULL;
+    delete[] changed;
+    changed = newChanged;
+    maxBlocks = newMax;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Descend
+// 	Go down the tree to the leaf for "hash", reading each block on
+//	the way into "buffer", and return the leaf, which is left in
+//	"buffer".  The index block on each level is put in "path",
+//	path[depth] being the root and path[1] the block over the leaf.
+//----------------------------------------------------------------------
+
+int
+DirectoryIndex::Descend(unsigned hash, int *path, char *buffer)
+{
+    int block = 0;
+
+    for (int level = depth; level > 0; level--) {
+        ReadBlock(block, buffer);
+        DirBlockHeader *hdr = HeaderOf(block, buffer);
+        DirIndexKey *keys = KeysOf(block, buffer);
+        int low = 0, high = hdr->count - 1;
+
+        ASSERT(hdr->kind == IndexDirBlock && hdr->count > 0);
+        while (low < high) {		// last key with hash <= "hash"
+            int mid = (low + high + 1) / 2;
+
+            if (keys[mid].hash <= hash)
+                low = mid;
+            else
+                high = mid - 1;
+        }
+        path[level] = block;
+        block = keys[low].block;
+    }
+    ReadBlock(block, buffer);
+    ASSERT(HeaderOf(block, buffer)->kind == LeafDirBlock);
+    return block;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::FindInLeaf
+// 	Return the offset in "leaf" of the record for "name", or -1 if
+//	there is none.
+//----------------------------------------------------------------------
+
+int
+DirectoryIndex::FindInLeaf(char *leaf, char *name)
+{
+    int len = NameLength(name);
+    int end = ((DirBlockHeader *)leaf)->count;
+    DirectoryRecord rec;
+
+    for (int offset = sizeof(DirBlockHeader); offset < end; offset += rec.recLen) {
+        bcopy(&leaf[offset], (char *)&rec, RecordHeaderSize);
+        if (rec.nameLen == len
+            && !memcmp(&leaf[offset + RecordHeaderSize], name, len))
+            return offset;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Find
+// 	Look up "name", and copy its entry into "entry".  Return FALSE if
+//	the name isn't in the directory.
+//----------------------------------------------------------------------
+
+bool
+DirectoryIndex::Find(char *name, DirectoryEntry *entry)
+{
+    char buffer[DirBlockSize];
+    int path[MaxIndexDepth + 1];
+    DirectoryRecord rec;
+
+    (void)Descend(IndexHash(name, NameLength(name)), path, buffer);
+    int offset = FindInLeaf(buffer, name);
+    if (offset == -1)
+        return FALSE;
+    bcopy(&buffer[offset], (char *)&rec, RecordHeaderSize);
+    entry->inUse = rec.type;
+    entry->sector = rec.sector;
+    bcopy(&buffer[offset + RecordHeaderSize], entry->name, rec.nameLen);
+    entry->name[rec.nameLen] = '\0';
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::HasRoomFor
+// 	Return TRUE if "name" fits in its leaf, or if the file has enough
+//	blocks left for the splits adding it may take: one on each level,
+//	and one more if the root is split.
+//----------------------------------------------------------------------
+
+bool
+DirectoryIndex::HasRoomFor(char *name)
+{
+    char buffer[DirBlockSize];
+    int path[MaxIndexDepth + 1];
+    int len = NameLength(name);
+
+    (void)Descend(IndexHash(name, len), path, buffer);
+    if (((DirBlockHeader *)buffer)->count + RecordHeaderSize + len <= DirBlockSize)
+        return TRUE;
+    return maxBlocks - numBlocks >= depth + 2;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Add
+// 	Add a record for "name" to its leaf, splitting the leaf if it is
+//	full.  Return FALSE if the name is already there, or if there is
+//	no room (see HasRoomFor), or if the leaf cannot be split because
+//	too many of its names have the same hash.
+//
+//	"name" -- the name of the file being added
+//	"newSector" -- the disk sector containing the added file's header
+//	"type" -- IS_FILE or IS_DIR
+//----------------------------------------------------------------------
+
+bool
+DirectoryIndex::Add(char *name, int newSector, int type)
+{
+    char buffer[DirBlockSize];
+    int path[MaxIndexDepth + 1];
+    DirectoryRecord rec;
+    int len = NameLength(name);
+    unsigned hash = IndexHash(name, len);
+    int leaf = Descend(hash, path, buffer);
+
+    if (FindInLeaf(buffer, name) != -1)
+        return FALSE;
+    rec.sector = newSector;
+    rec.recLen = RecordHeaderSize + len;
+    rec.type = type;
+    rec.nameLen = len;
+
+    if (((DirBlockHeader *)buffer)->count + rec.recLen <= DirBlockSize) {
+        char *data = Change(leaf);
+        DirBlockHeader *hdr = (DirBlockHeader *)data;
+
+        bcopy((char *)&rec, &data[hdr->count], RecordHeaderSize);
+        bcopy(name, &data[hdr->count + RecordHeaderSize], len);
+        hdr->count += rec.recLen;
+        return TRUE;
+    }
+
+    unsigned splitHash;
+    int newLeaf;
+
+    if (maxBlocks - numBlocks < depth + 2
+        || !SplitLeaf(leaf, name, &rec, &splitHash, &newLeaf))
+        return FALSE;
+    AddKey(path, 1, splitHash, newLeaf);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::SplitLeaf
+// 	Share the records of a full leaf, and a new one, between the leaf
+//	and a new leaf.  The records are sorted by hash, and cut where
+//	both halves fit and are closest in size, but never between two
+//	records with the same hash.  The first hash of the new leaf is
+//	returned in "splitHash", for the index block above.
+//
+//	Return FALSE, changing nothing, if there is no place to cut.
+//----------------------------------------------------------------------
+
+bool
+DirectoryIndex::SplitLeaf(int leaf, char *name, DirectoryRecord *rec,
+			  unsigned *splitHash, int *newLeaf)
+{
+    char buffer[DirBlockSize];
+    char *records = new char[2 * DirBlockSize];	// all of them, in a row
+    unsigned hashes[MaxLeafRecords];
+    int starts[MaxLeafRecords];
+    int lens[MaxLeafRecords];
+    int order[MaxLeafRecords];
+    int n = 0, used = 0, total, best = -1, bestDiff = 0;
+    int room = DirBlockSize - sizeof(DirBlockHeader);
+    DirectoryRecord r;
+
+    ReadBlock(leaf, buffer);
+    int end = ((DirBlockHeader *)buffer)->count;
+    for (int offset = sizeof(DirBlockHeader); offset < end; offset += r.recLen) {
+        bcopy(&buffer[offset], (char *)&r, RecordHeaderSize);
+        bcopy(&buffer[offset], &records[used], r.recLen);
+        hashes[n] = IndexHash(&buffer[offset + RecordHeaderSize], r.nameLen);
+        starts[n] = used;
+        lens[n++] = r.recLen;
+        used += r.recLen;
+    }
+    bcopy((char *)rec, &records[used], RecordHeaderSize);
+    bcopy(name, &records[used + RecordHeaderSize], rec->nameLen);
+    hashes[n] = IndexHash(name, rec->nameLen);
+    starts[n] = used;
+    lens[n++] = rec->recLen;
+    total = used + rec->recLen;
+
+    for (int i = 0; i < n; i++) {	// insertion sort, by hash
+        int j = i;
+
+        while (j > 0 && hashes[order[j - 1]] > hashes[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    used = 0;
+    for (int k = 1; k < n; k++) {	// cut before the k'th record
+        used += lens[order[k - 1]];
+        int diff = used > total - used ? 2 * used - total : total - 2 * used;
+
+        if (hashes[order[k - 1]] != hashes[order[k]]
+            && used <= room && total - used <= room
+            && (best == -1 || diff < bestDiff)) {
+            best = k;
+            bestDiff = diff;
+        }
+    }
+    if (best == -1) {
+        DEBUG(dbgFile, "Too many names with the same hash in a leaf.");
+        delete[] records;
+        return FALSE;
+    }
+
+    *newLeaf = NewBlock(LeafDirBlock);
+    *splitHash = hashes[order[best]];
+    for (int half = 0; half < 2; half++) {
+        char *data = Change(half == 0 ? leaf : *newLeaf);
+        DirBlockHeader *hdr = (DirBlockHeader *)data;
+
+        hdr->count = sizeof(DirBlockHeader);
+        for (int k = (half == 0 ? 0 : best); k < (half == 0 ? best : n); k++) {
+            bcopy(&records[starts[order[k]]], &data[hdr->count], lens[order[k]]);
+            hdr->count += lens[order[k]];
+        }
+    }
+    DEBUG(dbgFile, "Split directory leaf " << leaf << " into " << *newLeaf);
+    delete[] records;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::AddKey
+// 	Put a key for the new child "block", whose hashes start at "hash",
+//	in the index block on "level" of "path".  A full index block is
+//	split in two, and its new half put in the block above it in turn.
+//	A full root is moved into two new blocks, under a new root; the
+//	tree is then one level deeper.
+//----------------------------------------------------------------------
+
+void
+DirectoryIndex::AddKey(int *path, int level, unsigned hash, int block)
+{
+    int node = path[level];
+    char *data = Change(node);
+    DirBlockHeader *hdr = HeaderOf(node, data);
+    DirIndexKey *keys = KeysOf(node, data);
+    DirIndexKey all[MaxIndexKeys + 1];
+    int i, n, half;
+
+    if (hdr->count < MaxKeys(node)) {
+        for (i = hdr->count; i > 0 && keys[i - 1].hash > hash; i--)
+            keys[i] = keys[i - 1];
+        keys[i].hash = hash;
+        keys[i].block = block;
+        hdr->count++;
+        return;
+    }
+
+    n = 0;
+    for (i = 0; i < hdr->count; i++) {
+        if (n == i && keys[i].hash > hash) {
+            all[n].hash = hash;
+            all[n++].block = block;
+        }
+        all[n++] = keys[i];
+    }
+    if (n == hdr->count) {
+        all[n].hash = hash;
+        all[n++].block = block;
+    }
+    half = n / 2;
+
+    int left = (node == 0) ? NewBlock(IndexDirBlock) : node;
+    int right = NewBlock(IndexDirBlock);
+
+    for (int side = 0; side < 2; side++) {
+        int b = (side == 0) ? left : right;
+        DirBlockHeader *h = HeaderOf(b, Change(b));
+        DirIndexKey *k = KeysOf(b, Change(b));
+
+        h->count = 0;
+        for (i = (side == 0 ? 0 : half); i < (side == 0 ? half : n); i++)
+            k[h->count++] = all[i];
+    }
+    DEBUG(dbgFile, "Split directory index block " << node);
+    if (node != 0) {
+        AddKey(path, level + 1, all[half].hash, right);
+        return;
+    }
+    keys[0].hash = 0;
+    keys[0].block = left;
+    keys[1].hash = all[half].hash;
+    keys[1].block = right;
+    hdr->count = 2;
+    depth++;
+    ASSERT(depth <= MaxIndexDepth);
+    SetHeader();
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Remove
+// 	Remove the record for "name" from its leaf, moving the records
+//	after it down.  Return FALSE if the name isn't in the directory.
+//----------------------------------------------------------------------
+
+bool
+DirectoryIndex::Remove(char *name)
+{
+    char buffer[DirBlockSize];
+    int path[MaxIndexDepth + 1];
+    DirectoryRecord rec;
+    int leaf = Descend(IndexHash(name, NameLength(name)), path, buffer);
+    int offset = FindInLeaf(buffer, name);
+
+    if (offset == -1)
+        return FALSE;
+
+    char *data = Change(leaf);
+    DirBlockHeader *hdr = (DirBlockHeader *)data;
+
+    bcopy(&data[offset], (char *)&rec, RecordHeaderSize);
+    bcopy(&data[offset + rec.recLen], &data[offset],
+          hdr->count - offset - rec.recLen);
+    hdr->count -= rec.recLen;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// DirectoryIndex::Next
+// 	Copy the first entry at or after byte "position" of the file into
+//	"entry", and set "position" past it.  Index blocks are skipped.
+//	Return FALSE if there are no more.
+//----------------------------------------------------------------------
+
+bool
+DirectoryIndex::Next(int *position, DirectoryEntry *entry)
+{
+    char buffer[DirBlockSize];
+    int block = *position / DirBlockSize;
+    int offset = *position % DirBlockSize;
+    DirectoryRecord rec;
+
+    for (; block < numBlocks; block++, offset = 0) {
+        ReadBlock(block, buffer);
+        DirBlockHeader *hdr = HeaderOf(block, buffer);
+
+        if (hdr->kind != LeafDirBlock)
+            continue;
+        offset = max(offset, (int)sizeof(DirBlockHeader));
+        if (offset < hdr->count) {
+            bcopy(&buffer[offset], (char *)&rec, RecordHeaderSize);
+            entry->inUse = rec.type;
+            entry->sector = rec.sector;
+            bcopy(&buffer[offset + RecordHeaderSize], entry->name, rec.nameLen);
+            entry->name[rec.nameLen] = '\0';
+            *position = block * DirBlockSize + offset + rec.recLen;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
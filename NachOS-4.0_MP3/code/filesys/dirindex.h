@@ -0,0 +1,158 @@
+// dirindex.h
+//	Data structures for a large directory, indexed on disk.
+//
+//	A packed directory (see directory.h) is read in whole before any
+//	name in it can be looked up, so a lookup in a directory that is
+//	not in memory costs as many sectors as the directory has.  Once a
+//	directory has grown to MinIndexedSize bytes, it is instead kept as
+//	a B+tree keyed by a hash of the names, as in the ext3 "htree":
+//	looking a name up reads one block on each level of the tree, and
+//	adding or removing one changes a single leaf, unless the leaf has
+//	to be split.
+//
+//	The directory file is cut into blocks of DirBlockSize bytes.
+//	Block 0 holds a header and the root of the tree.  Every other
+//	block in use is either an index block, a list of keys each giving
+//	the lowest hash found under a child block, or a leaf, holding the
+//	records (see DirectoryRecord) of the names whose hashes fall in
+//	its range.  Records in a leaf are packed one after the other, in
+//	no particular order, and take just the room their names need.
+//	All the names with the same hash are kept in the same leaf.
+//
+//	A full leaf is split in two at a hash near the middle of its
+//	names, and its new half added to the index block above it, which
+//	may have to be split in turn; the tree gets deeper when its root
+//	is split.  Leaves are never merged: a removed name leaves room in
+//	its leaf for another one.  New blocks are taken from the end of
+//	the file; the caller is responsible for growing the file when
+//	there are not enough of them (see HasRoomFor).
+//
+//	No block is cached between operations, so that lookups can be
+//	made by several threads at once: each one reads the blocks on its
+//	way down.  The blocks an operation changes are kept in memory until
+//	WriteBack; lookups see those instead of the ones on disk.
+//
+//	We assume mutual exclusion between changes is provided by the
+//	caller, as for Directory.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DIRINDEX_H
+#define DIRINDEX_H
+
+#include "disk.h"
+#include "directory.h"
+
+const int DirBlockSize = 4 * SectorSize; // a block holds any one name
+const int MinIndexedSize = 4 * DirBlockSize; // directories grown to
+					// this size are indexed
+const int DirIndexMagic = 0x4e444958;	// in the header in block 0
+
+enum DirBlockKind { FreeDirBlock, IndexDirBlock, LeafDirBlock };
+
+// The following class defines the header of the directory, at the start
+// of block 0, where the magic number of a packed directory would be.
+
+class DirIndexHeader {
+  public:
+    int magic;				// DirIndexMagic
+    int numBlocks;			// blocks in use, from the start
+					// of the file
+    int depth;				// index blocks from the root to a
+					// leaf, the root included
+};
+
+// The following class defines the start of every block in use; block
+// 0 has it after the DirIndexHeader.
+
+class DirBlockHeader {
+  public:
+    int kind;				// a DirBlockKind
+    int count;				// for an index block, keys in it;
+					// for a leaf, bytes in it used, up to
+					// the end of the last record
+};
+
+// The following class defines a key of an index block.  The keys are
+// in order of hash; the first one of the root has hash 0.
+
+class DirIndexKey {
+  public:
+    unsigned hash;			// the lowest hash under "block"
+    int block;				// the child block
+};
+
+const int MaxIndexKeys = (DirBlockSize - sizeof(DirBlockHeader))
+				/ sizeof(DirIndexKey);
+					// keys in an index block besides
+					// the root, which has fewer
+const int MaxLeafRecords = (DirBlockSize - sizeof(DirBlockHeader))
+				/ (RecordHeaderSize + 1) + 1;
+					// records in a leaf being split,
+					// with the new one
+const int MaxIndexDepth = 8;		// deeper than any disk will need
+
+// The following class defines a directory kept as a B+tree.
+
+class DirectoryIndex {
+  public:
+    DirectoryIndex(OpenFile *file);	// The index in "file", which must
+					// stay open while the index is used
+    DirectoryIndex(int size);		// A new, empty index, for a file of
+					// "size" bytes
+    ~DirectoryIndex();			// Changes not written back are lost
+
+    void WriteBack(OpenFile *file);	// Write the blocks that changed
+					// to "file", and read from it from
+					// now on
+
+    bool Find(char *name, DirectoryEntry *entry);
+					// Copy out the entry for "name";
+					// FALSE if it is not there
+    bool HasRoomFor(char *name);	// Can "name" be added without
+					// growing the file?
+    bool Add(char *name, int newSector, int type);
+					// Add a name; FALSE if it is there
+					// already, or there is no room
+    bool Remove(char *name);		// Remove one; FALSE if it is not
+					// there
+    void Expand(int newSize);		// The file has grown to "newSize"
+					// bytes
+
+    bool Next(int *position, DirectoryEntry *entry);
+					// Copy out the entry at or after
+					// "position" (0 to start), from the
+					// leaves in the order of their
+					// blocks, and move past it
+
+  private:
+    OpenFile *file;			// where the blocks are; NULL until
+					// the first WriteBack of a new index
+    int numBlocks;			// as in the header
+    int depth;
+    int maxBlocks;			// blocks the file has room for
+    char **changed;			// one per block: the block, if an
+					// operation changed it, or NULL
+
+    void ReadBlock(int block, char *into); // the latest contents
+    char *Change(int block);		// the copy kept until WriteBack
+    void SetHeader();			// copy numBlocks and depth to it
+    int NewBlock(int kind);		// take a block from the end
+
+    int Descend(unsigned hash, int *path, char *buffer);
+					// find the leaf for "hash", and the
+					// index blocks on the way
+    int FindInLeaf(char *leaf, char *name);
+					// offset of the record of "name"
+    bool SplitLeaf(int leaf, char *name, DirectoryRecord *rec,
+		   unsigned *splitHash, int *newLeaf);
+					// split a full leaf, adding a record
+    void AddKey(int *path, int level, unsigned hash, int block);
+					// put a new child in an index block
+};
+
+#endif // DIRINDEX_H
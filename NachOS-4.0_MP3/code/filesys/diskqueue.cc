@@ -0,0 +1,288 @@
+// diskqueue.cc
+//	Routines to keep the pending disk requests, and to pick which
+//	one the disk should serve next.  See diskqueue.h for the
+//	policies.
+//
+//	The queue is a plain list in arrival order, and every policy
+//	except FIFO scans the list, up to the first barrier, to make its
+//	choice.  There are never more pending requests than threads, so
+//	this is cheap.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "diskqueue.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Initialize a request for "num" sectors starting at "first".
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int first, int num, char *buffer, bool write,
+			 CallBackObj *done)
+{
+    firstSector = first;
+    numSectors = num;
+    data = buffer;
+    writing = write;
+    callWhenDone = done;
+    ioClass = IoBestEffort;
+    queuedAt = 0;
+    synchronous = FALSE;
+    barrier = FALSE;
+    fua = FALSE;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::DiskQueue
+// 	Initialize an empty queue of disk requests.
+//
+//	"order" -- the policy used to pick the next request
+//----------------------------------------------------------------------
+
+DiskQueue::DiskQueue(DiskPolicy order)
+{
+    policy = order;
+    pending = new List<DiskRequest *>;
+    sweepingUp = TRUE;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::~DiskQueue
+// 	De-allocate the queue.  Nobody should still be waiting on it.
+//----------------------------------------------------------------------
+
+DiskQueue::~DiskQueue()
+{
+    ASSERT(pending->IsEmpty());
+    delete pending;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::Append
+// 	Add a request to the set of pending requests.
+//----------------------------------------------------------------------
+
+void
+DiskQueue::Append(DiskRequest *request)
+{
+    pending->Append(request);
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::NextClass
+// 	Return the class of the request RemoveNext would pick: that of
+//	the oldest request if it has waited too long, or is a barrier,
+//	otherwise the best class of any ahead of the first barrier.  The
+//	queue must not be empty.
+//
+//	"now" -- the time
+//----------------------------------------------------------------------
+
+IoClass
+DiskQueue::NextClass(Ticks now)
+{
+    DiskRequest *oldest = pending->Front();
+    IoClass best = IoIdle;
+
+    if (now - oldest->queuedAt >= DiskStarveTicks || oldest->barrier)
+	return oldest->ioClass;
+    for (ListIterator<DiskRequest *> iter(pending);
+	 !iter.IsDone() && !iter.Item()->barrier; iter.Next())
+	best = min(best, iter.Item()->ioClass);
+    return best;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::RemoveNext
+// 	Choose, according to the policy, the next request to serve;
+//	remove it from the queue and return it.  Return NULL if there
+//	are no pending requests.
+//
+//	The oldest request goes next if it has waited DiskStarveTicks, or
+//	if it is a barrier.  Otherwise the policy picks, but only among
+//	requests of the best class pending, ahead of the first barrier.
+//
+//	"headSector" -- the sector the disk head is over (the last
+//		sector of the previous request)
+//	"now" -- the time, to tell how long requests have waited
+//----------------------------------------------------------------------
+
+DiskRequest *
+DiskQueue::RemoveNext(int headSector, Ticks now)
+{
+    DiskRequest *best = NULL;
+    ListIterator<DiskRequest *> iter(pending);
+    IoClass serving;
+
+    if (pending->IsEmpty())
+	return NULL;
+
+    if (now - pending->Front()->queuedAt >= DiskStarveTicks
+	    || pending->Front()->barrier) {
+	best = pending->Front();
+	DEBUG(dbgDisk, "Disk queue serving sector " << best->firstSector
+			<< ", waiting since " << best->queuedAt
+			<< (best->barrier ? ", a barrier" : ""));
+	pending->Remove(best);
+	return best;
+    }
+    serving = NextClass(now);
+
+    switch (policy) {
+      case DiskFIFO:
+	for (; best == NULL && !iter.Item()->barrier; iter.Next()) {
+	    if (iter.Item()->ioClass == serving)
+		best = iter.Item();
+	}
+	break;
+
+      case DiskSSTF:
+	for (; !iter.IsDone() && !iter.Item()->barrier; iter.Next()) {
+	    DiskRequest *r = iter.Item();
+	    if (r->ioClass != serving)
+		continue;
+	    if (best == NULL || abs(r->firstSector - headSector)
+				< abs(best->firstSector - headSector))
+		best = r;
+	}
+	break;
+
+      case DiskSCAN:
+	// nearest request in the direction we are going; if there is
+	// none, turn around
+	for (int pass = 0; pass < 2 && best == NULL; pass++) {
+	    for (iter = ListIterator<DiskRequest *>(pending);
+		 !iter.IsDone() && !iter.Item()->barrier; iter.Next()) {
+		DiskRequest *r = iter.Item();
+		if (r->ioClass != serving)
+		    continue;
+		if (sweepingUp ? (r->firstSector < headSector)
+			       : (r->firstSector > headSector))
+		    continue;
+		if (best == NULL || abs(r->firstSector - headSector)
+				    < abs(best->firstSector - headSector))
+		    best = r;
+	    }
+	    if (best == NULL)
+		sweepingUp = !sweepingUp;
+	}
+	break;
+
+      case DiskCLOOK:
+	// lowest request at or beyond the head, else the lowest of all
+	{
+	    DiskRequest *lowest = NULL;
+	    for (; !iter.IsDone() && !iter.Item()->barrier; iter.Next()) {
+		DiskRequest *r = iter.Item();
+		if (r->ioClass != serving)
+		    continue;
+		if (lowest == NULL || r->firstSector < lowest->firstSector)
+		    lowest = r;
+		if (r->firstSector >= headSector &&
+		    (best == NULL || r->firstSector < best->firstSector))
+		    best = r;
+	    }
+	    if (best == NULL)
+		best = lowest;
+	}
+	break;
+
+      default:
+	ASSERTNOTREACHED();
+    }
+    ASSERT(best != NULL);
+    pending->Remove(best);
+    DEBUG(dbgDisk, "Disk queue picked sector " << best->firstSector
+		    << " with head at " << headSector);
+    return best;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::RemoveNeighbor
+// 	Find a request that can be served by the same transfer as the
+//	sectors "first" to "first" + "num" - 1, once the transfer is made
+//	long enough to take it in, and no longer than "maxSectors": one
+//	in the same direction that starts right after them or ends right
+//	before them -- or, for a read, one of any of the same sectors.
+//	Writes that overlap are left alone, as the later must win.  So
+//	is a request that overlaps one of the other direction, which it
+//	must not be moved in front of.  None behind a barrier is taken,
+//	nor a request with a flag of its own, which the transfer would
+//	not honour.  Remove the request found from the queue and return
+//	it; return NULL if there is none.
+//
+//	"writing" -- the direction of the transfer
+//----------------------------------------------------------------------
+
+DiskRequest *
+DiskQueue::RemoveNeighbor(int first, int num, bool writing, int maxSectors)
+{
+    int last = first + num;
+
+    for (ListIterator<DiskRequest *> iter(pending);
+	 !iter.IsDone() && !iter.Item()->barrier; iter.Next()) {
+	DiskRequest *r = iter.Item();
+	int rLast = r->firstSector + r->numSectors;
+
+	if (r->writing != writing || r->numSectors == 0 || r->fua)
+	    continue;
+	if (writing ? (r->firstSector != last && rLast != first)
+		    : (r->firstSector > last || rLast < first))
+	    continue;
+	if (max(last, rLast) - min(first, r->firstSector) > maxSectors)
+	    continue;
+	if (Overlaps(r->firstSector, r->numSectors, !writing))
+	    continue;
+	pending->Remove(r);
+	return r;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::Overlaps
+// 	Return TRUE if a pending write (if "writing"; a read if not)
+//	includes any of the "num" sectors starting at "first".
+//----------------------------------------------------------------------
+
+bool
+DiskQueue::Overlaps(int first, int num, bool writing)
+{
+    for (ListIterator<DiskRequest *> iter(pending); !iter.IsDone(); iter.Next()) {
+	DiskRequest *r = iter.Item();
+
+	if (r->writing == writing && r->numSectors > 0
+		&& r->firstSector < first + num
+		&& first < r->firstSector + r->numSectors)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// DiskQueue::ParsePolicy
+// 	Translate the name of a policy, as given on the command line,
+//	into a DiskPolicy.  Return FALSE if the name is not known.
+//----------------------------------------------------------------------
+
+bool
+DiskQueue::ParsePolicy(char *name, DiskPolicy *order)
+{
+    if (strcmp(name, "fifo") == 0)
+	*order = DiskFIFO;
+    else if (strcmp(name, "sstf") == 0)
+	*order = DiskSSTF;
+    else if (strcmp(name, "scan") == 0)
+	*order = DiskSCAN;
+    else if (strcmp(name, "clook") == 0)
+	*order = DiskCLOOK;
+    else
+	return FALSE;
+    return TRUE;
+}
@@ -0,0 +1,124 @@
+// diskqueue.h
+//	Data structures for the queue of pending disk requests.
+//
+//	The raw disk can only work on one request at a time, but any
+//	number of threads may want to use it.  Requests that arrive while
+//	the disk is busy are kept in a DiskQueue; each time the disk
+//	finishes, the queue picks the next request to send.  The choice
+//	is made by one of several policies:
+//
+//	   FIFO -- in order of arrival
+//	   SSTF -- shortest seek time first: the request closest to
+//		the current head position
+//	   SCAN -- the elevator: keep moving the head in one direction,
+//		serving requests on the way, and turn around when there
+//		is nothing further in that direction
+//	   C-LOOK -- like SCAN, but only serve requests while moving
+//		towards higher sectors; when there are none, jump back
+//		to the lowest pending request
+//
+//	Since requests are only ordered, never moved, the head does not
+//	actually travel to the edge of the disk in SCAN; it turns around
+//	at the last request (what is sometimes called LOOK).
+//
+//	Every request also has an I/O class, that of the thread making it:
+//	realtime, best-effort (the default) or idle (the flusher, the
+//	reclaimer and the defragmenter).  The policy only chooses among
+//	requests of the best class pending, so background work waits
+//	while the foreground has the disk -- except that a request that
+//	has been waiting DiskStarveTicks goes next whatever its class,
+//	so none starves.
+//
+//	A write may be a "barrier": the requests queued before it are all
+//	served before it, and none queued after it is served before it,
+//	whatever the policy -- so the policy only chooses among the
+//	requests ahead of the first barrier, and the barrier goes once it
+//	is at the front.  The disk also writes what is in its write cache
+//	to the media before it writes the barrier's sectors.  A write may
+//	also be "force unit access" (FUA): it is not done until its
+//	sectors are on the media, not just in the write cache.  Together
+//	they order the few writes that must be ordered -- a journal's
+//	commit record after what it commits -- and leave the rest free to
+//	be reordered and merged.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef DISKQUEUE_H
+#define DISKQUEUE_H
+
+#include "callback.h"
+#include "list.h"
+
+enum DiskPolicy { DiskFIFO, DiskSSTF, DiskSCAN, DiskCLOOK };
+
+enum IoClass { IoRealtime, IoBestEffort, IoIdle };	// best first
+
+const int DiskStarveTicks = 100000;	// a request waiting this long is
+					// served next, whatever its class
+
+// The following class defines one request for the disk: a run of
+// consecutive sectors to read or write, and who to tell when it is done.
+
+class DiskRequest {
+  public:
+    DiskRequest(int first, int num, char *buffer, bool write,
+		CallBackObj *done);
+
+    int firstSector;			// first sector of the run
+    int numSectors;			// length of the run
+    char *data;				// numSectors * SectorSize bytes
+    bool writing;			// write (otherwise read) request?
+    CallBackObj *callWhenDone;		// called, at interrupt level, once
+					// the transfer has finished
+    IoClass ioClass;			// how urgent it is
+    Ticks queuedAt;			// when it was queued
+    bool synchronous;			// is its thread waiting for it?
+    bool barrier;			// everything queued before it is
+					// served, and on the media, first
+    bool fua;				// is it only done once its sectors
+					// are on the media?
+};
+
+// The following class defines the queue of pending requests.  It does
+// no synchronization itself; SynchDisk calls it with interrupts off.
+
+class DiskQueue {
+  public:
+    DiskQueue(DiskPolicy order);	// Initialize an empty queue
+    ~DiskQueue();			// De-allocate the queue
+
+    void Append(DiskRequest *request);	// Add a request to the queue
+    DiskRequest *RemoveNext(int headSector, Ticks now);
+					// Take off the request to serve
+					// next, given where the head is
+					// and the time; NULL if the queue
+					// is empty.  Never one behind a
+					// barrier.
+    IoClass NextClass(Ticks now);		// the class of that request; the
+					// queue must not be empty
+    DiskRequest *RemoveNeighbor(int first, int num, bool writing,
+				int maxSectors);
+					// Take off a request that can join
+					// a transfer of "num" sectors at
+					// "first"; NULL if there is none
+    bool Overlaps(int first, int num, bool writing);
+					// Is a write (if "writing"; else a
+					// read) of those sectors pending?
+    bool IsEmpty() { return pending->IsEmpty(); }
+
+    static bool ParsePolicy(char *name, DiskPolicy *order);
+					// Map "fifo", "sstf", "scan" or
+					// "clook" to a policy
+
+  private:
+    DiskPolicy policy;			// how to pick the next request
+    List<DiskRequest *> *pending;	// requests, in order of arrival
+    bool sweepingUp;			// SCAN: heading towards higher
+					// sector numbers?
+};
+
+#endif // DISKQUEUE_H
@@ -0,0 +1,207 @@
+// fdtable.cc
+//	Routines to hand out and look up open file descriptors.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fdtable.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::FileDescriptorTable
+// 	Initialize a table with every descriptor free.  The free list is
+//	in increasing order, so the first files opened get the lowest
+//	descriptors.
+//----------------------------------------------------------------------
+
+FileDescriptorTable::FileDescriptorTable()
+{
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	files[i] = NULL;
+	pipes[i] = NULL;
+	nextFree[i] = (i + 1 < MaxOpenFiles) ? i + 1 : -1;
+    }
+    firstFree = 0;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::~FileDescriptorTable
+// 	Close any file or pipe end the program did not close itself.
+//----------------------------------------------------------------------
+
+FileDescriptorTable::~FileDescriptorTable()
+{
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	if (files[i] != NULL)
+	    delete files[i];
+	if (pipes[i] != NULL && pipes[i]->Close(writeEnd[i]))
+	    delete pipes[i];
+    }
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Take
+// 	Take a free slot off the free list.  Return it, or -1 if there
+//	are none left.
+//----------------------------------------------------------------------
+
+int
+FileDescriptorTable::Take()
+{
+    int i = firstFree;
+
+    if (i != -1)
+	firstFree = nextFree[i];
+    return i;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Add
+// 	Take a free descriptor for "file".  Return it, or -1 if there
+//	are none left.
+//
+//	"file" -- the open file the descriptor will stand for
+//----------------------------------------------------------------------
+
+OpenFileId
+FileDescriptorTable::Add(OpenFile *file)
+{
+    int i;
+
+    ASSERT(file != NULL);
+    if ((i = Take()) == -1)
+	return -1;
+    files[i] = file;
+    return FirstFileId + i;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::Remove
+// 	Free descriptor "id".  Return the file it stood for, so that the
+//	caller can close it, or NULL if "id" was not open.
+//
+//	"id" -- the descriptor to free
+//----------------------------------------------------------------------
+
+OpenFile *
+FileDescriptorTable::Remove(OpenFileId id)
+{
+    OpenFile *file = Get(id);
+
+    if (file == NULL)
+	return NULL;
+    int i = id - FirstFileId;
+    files[i] = NULL;
+    nextFree[i] = firstFree;
+    firstFree = i;
+    return file;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::AddPipe
+// 	Take a free descriptor for one end of "pipe".  Return it, or -1
+//	if there are none left.  The pipe already counts the descriptor
+//	(see PipeBuffer::Open).
+//
+//	"pipe" -- the pipe
+//	"writing" -- TRUE for its write end, FALSE for its read end
+//----------------------------------------------------------------------
+
+OpenFileId
+FileDescriptorTable::AddPipe(PipeBuffer *pipe, bool writing)
+{
+    int i;
+
+    ASSERT(pipe != NULL);
+    if ((i = Take()) == -1)
+	return -1;
+    pipes[i] = pipe;
+    writeEnd[i] = writing;
+    return FirstFileId + i;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::GetPipe
+// 	Return the pipe descriptor "id" stands for an end of, and set
+//	"*writing" to which one; NULL if "id" is not a pipe end.
+//----------------------------------------------------------------------
+
+PipeBuffer *
+FileDescriptorTable::GetPipe(OpenFileId id, bool *writing)
+{
+    int i = id - FirstFileId;
+
+    if (i < 0 || i >= MaxOpenFiles || pipes[i] == NULL)
+	return NULL;
+    *writing = writeEnd[i];
+    return pipes[i];
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::ClosePipe
+// 	Free descriptor "id", which stands for a pipe end, deleting the
+//	pipe if no other descriptor is left for it.  Return FALSE if "id"
+//	is not a pipe end.
+//----------------------------------------------------------------------
+
+bool
+FileDescriptorTable::ClosePipe(OpenFileId id)
+{
+    bool writing;
+    PipeBuffer *pipe = GetPipe(id, &writing);
+
+    if (pipe == NULL)
+	return FALSE;
+    int i = id - FirstFileId;
+    pipes[i] = NULL;
+    nextFree[i] = firstFree;
+    firstFree = i;
+    if (pipe->Close(writing))
+	delete pipe;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::CopyPipesFrom
+// 	Give this table, which has nothing open, a descriptor for each
+//	pipe end "other" has, with the same OpenFileId, as a forked copy
+//	of a program expects.  The free list is made again from the
+//	slots left, in increasing order.
+//
+//	"other" -- the table to copy the pipe ends of
+//----------------------------------------------------------------------
+
+void
+FileDescriptorTable::CopyPipesFrom(FileDescriptorTable *other)
+{
+    firstFree = -1;
+    for (int i = MaxOpenFiles - 1; i >= 0; i--) {
+	ASSERT(files[i] == NULL && pipes[i] == NULL);
+	if (other->pipes[i] != NULL) {
+	    pipes[i] = other->pipes[i];
+	    writeEnd[i] = other->writeEnd[i];
+	    pipes[i]->Open(writeEnd[i]);
+	} else {
+	    nextFree[i] = firstFree;
+	    firstFree = i;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// FileDescriptorTable::IsEmpty
+// 	Return TRUE if no descriptor stands for a file or a pipe end: the
+//	program has only the console open.
+//----------------------------------------------------------------------
+
+bool
+FileDescriptorTable::IsEmpty()
+{
+    for (int i = 0; i < MaxOpenFiles; i++) {
+	if (files[i] != NULL || pipes[i] != NULL)
+	    return FALSE;
+    }
+    return TRUE;
+}
@@ -0,0 +1,77 @@
+// fdtable.h
+//	Data structures for a table of open file descriptors.
+//
+//	Each address space (in UNIX terms, each process) has its own
+//	small table, mapping the OpenFileId a user program was given by
+//	Open to the OpenFile it stands for.  OpenFileIds 0 and 1 are
+//	taken by the console (see syscall.h), so descriptors start at 2;
+//	an OpenFileId is then just an index into an array.
+//
+//	A descriptor may also stand for one end of a pipe (see pipebuf.h);
+//	Get returns NULL for it, so the operations on files simply fail
+//	on a pipe.  Many descriptors, in the tables of several programs,
+//	can stand for the same end: a pipe is passed on to the copy a
+//	program makes of itself with Fork.
+//
+//	Free slots are kept on a list threaded through the array, so
+//	both opening and closing a file take constant time.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FDTABLE_H
+#define FDTABLE_H
+
+#include "openfile.h"
+#include "pipebuf.h"
+
+typedef int OpenFileId;
+
+const int MaxOpenFiles = 16;		// descriptors per table
+const int FirstFileId = 2;		// after console input and output
+
+// The following class defines a table of open file descriptors.
+
+class FileDescriptorTable {
+  public:
+    FileDescriptorTable();		// Initialize an empty table
+    ~FileDescriptorTable();		// Close every file still open
+
+    OpenFileId Add(OpenFile *file);	// Give "file" a descriptor;
+					// -1 if the table is full
+    OpenFile *Get(OpenFileId id) {	// The file "id" stands for,
+	if (id < FirstFileId || id >= FirstFileId + MaxOpenFiles)
+	    return NULL;		// NULL if it isn't open
+	return files[id - FirstFileId];
+    }
+    OpenFile *Remove(OpenFileId id);	// Free the descriptor, and return
+					// the file for the caller to
+					// close; NULL if it wasn't open
+
+    OpenFileId AddPipe(PipeBuffer *pipe, bool writing);
+					// Give one end of "pipe" a
+					// descriptor; -1 if the table is full
+    PipeBuffer *GetPipe(OpenFileId id, bool *writing);
+					// The pipe "id" is an end of, and
+					// which end; NULL if it isn't one
+    bool ClosePipe(OpenFileId id);	// Free the descriptor of a pipe
+					// end; FALSE if "id" isn't one
+    void CopyPipesFrom(FileDescriptorTable *other);
+					// Into this empty table, the pipe
+					// ends of "other", as the same ids
+    bool IsEmpty();			// Is nothing but the console open?
+
+  private:
+    OpenFile *files[MaxOpenFiles];	// NULL for a free slot
+    PipeBuffer *pipes[MaxOpenFiles];		// or, if not NULL, a pipe end
+    bool writeEnd[MaxOpenFiles];	// which end of "pipes"
+    int nextFree[MaxOpenFiles];		// free list, -1 at the end
+    int firstFree;			// head of the free list
+
+    int Take();				// a free slot, -1 if none
+};
+
+#endif // FDTABLE_H
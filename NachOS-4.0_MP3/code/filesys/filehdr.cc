@@ -26,116 +26,1609 @@
 
 #include "filehdr.h"
 #include "debug.h"
-#include "synchdisk.h"
+#include "bufcache.h"
 #include "main.h"
+#include "arena.h"
+#include "lzcodec.h"
+#include "memcount.h"
+
+//----------------------------------------------------------------------
+// FileHeader::FileHeader
+// 	Initialize the in-memory part of a file header.  The on-disk
+//	part is filled in later, by Allocate or FetchFrom.
+//----------------------------------------------------------------------
+
+FileHeader::FileHeader()
+{
+    singleTable = NULL;
+    doubleTable = NULL;
+    doubleLeaves = NULL;
+    dirty = FALSE;
+    writes = 0;
+    MemCount::Add(MemFileHeader, sizeof(FileHeader));
+}
+
+//----------------------------------------------------------------------
+// FileHeader::~FileHeader
+// 	De-allocate the cached indirect tables.
+//----------------------------------------------------------------------
+
+FileHeader::~FileHeader()
+{
+    DropTables();
+    MemCount::Remove(MemFileHeader, sizeof(FileHeader));
+}
+
+thread_local Slab FileHeader::slab("file headers", sizeof(FileHeader));
+
+//----------------------------------------------------------------------
+// FileHeader::operator new, FileHeader::operator delete
+// 	Allocate the space for a FileHeader from its slab, and release it
+//	back there.
+//----------------------------------------------------------------------
+
+void *FileHeader::operator new(size_t size)
+{
+    return slab.Alloc(size);
+}
+
+void FileHeader::operator delete(void *p, size_t size)
+{
+    slab.Free(p, size);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::DropTables
+// 	Forget every cached indirect table.  Called whenever the tables
+//	on disk may no longer match what we have (a new Allocate or
+//	FetchFrom), and when the header is deleted.
+//----------------------------------------------------------------------
+
+void FileHeader::DropTables()
+{
+    if (doubleLeaves != NULL)
+    {
+        for (int i = 0; i < NumIndirect; i++)
+            delete doubleLeaves[i];
+        delete[] doubleLeaves;
+        doubleLeaves = NULL;
+    }
+    delete doubleTable;
+    doubleTable = NULL;
+    delete singleTable;
+    singleTable = NULL;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::SingleTable / DoubleTable / DoubleLeaf
+// 	Return the single indirect table, the double indirect table, or
+//	the "which"-th table pointed to by the double indirect table.
+//	Each is read from disk the first time it is asked for, and kept
+//	in memory afterwards.
+//----------------------------------------------------------------------
+
+SingleIndirectPointer *FileHeader::SingleTable()
+{
+    ASSERT(SingleIndirectSector != -1);
+    if (singleTable == NULL)
+    {
+        singleTable = new SingleIndirectPointer;
+        kernel->bufferCache->ReadSector(SingleIndirectSector, (char *)singleTable);
+    }
+    return singleTable;
+}
+
+DoubleIndirectPointer *FileHeader::DoubleTable()
+{
+    ASSERT(DoubleIndirectSector != -1);
+    if (doubleTable == NULL)
+    {
+        doubleTable = new DoubleIndirectPointer;
+        kernel->bufferCache->ReadSector(DoubleIndirectSector, (char *)doubleTable);
+        doubleLeaves = new SingleIndirectPointer *[NumIndirect];
+        for (int i = 0; i < NumIndirect; i++)
+            doubleLeaves[i] = NULL;
+    }
+    return doubleTable;
+}
+
+SingleIndirectPointer *FileHeader::DoubleLeaf(int which)
+{
+    DoubleIndirectPointer *table = DoubleTable();
+
+    ASSERT((which >= 0) && (which < table->numsSector));
+    ASSERT(table->pointers[which] != HoleSector);
+    if (doubleLeaves[which] == NULL)
+    {
+        doubleLeaves[which] = new SingleIndirectPointer;
+        kernel->bufferCache->ReadSector(table->pointers[which], (char *)doubleLeaves[which]);
+    }
+    return doubleLeaves[which];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::HasLeaf
+// 	Return TRUE if the "which"-th table hanging off the double
+//	indirect table exists: in a file with holes, it may not, and
+//	neither may the double indirect table itself.
+//----------------------------------------------------------------------
+
+bool FileHeader::HasLeaf(int which)
+{
+    if (DoubleIndirectSector == -1)
+        return FALSE;
+    DoubleIndirectPointer *table = DoubleTable();
+    return which < table->numsSector && table->pointers[which] != HoleSector;
+}
+
+//----------------------------------------------------------------------
+// IndexSectors
+// 	Return how many sectors of indirect tables a pointer-format file
+//	of "numSectors" data sectors needs.
+//----------------------------------------------------------------------
+
+static int
+IndexSectors(int numSectors)
+{
+    if (numSectors <= NumDirect)
+        return 0;
+    if (numSectors <= NumDirect + NumIndirect)
+        return 1;
+    return 2 + divRoundUp(numSectors - NumDirect - NumIndirect, NumIndirect);
+}
+
+//----------------------------------------------------------------------
+// TakeSectors
+// 	Take "count" free sectors from "freeMap" and store their numbers
+//	in "sectors".  They are taken in as few runs of consecutive
+//	sectors as the free map allows, so that the data of a file is
+//	laid out sequentially on disk when it can be.  The caller has
+//	checked that there is enough free space.
+//----------------------------------------------------------------------
+
+static void
+TakeSectors(PersistentBitmap *freeMap, int *sectors, int count)
+{
+    int start, length;
+
+    for (int i = 0; i < count; i += length)
+    {
+        start = freeMap->FindAndSetRange(count - i, &length);
+        ASSERT(start >= 0);
+        for (int j = 0; j < length; j++)
+            sectors[i + j] = start + j;
+    }
+}
 
 //----------------------------------------------------------------------
 // FileHeader::Allocate
 // 	Initialize a fresh file header for a newly created file.
 //	Allocate data blocks for the file out of the map of free disk blocks.
 //	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+//	the new file, or if it is too big for a file header to describe;
+//	in that case nothing has been taken from the free map.
+//
+//	The sectors come from where the free map was told to place them
+//	(for a new file, just after its header; see Bitmap::SetGoal).
+//	Each run is the first one after there long enough for the rest
+//	of the file, so a large file passes over the small holes nearby,
+//	leaving them to small files, and goes on in a new allocation
+//	group.
 //
 //	"freeMap" is the bit map of free disk sectors
-//	"fileSize" is the bit map of free disk sectors
+//	"fileSize" is the size of the new file, in bytes
+//----------------------------------------------------------------------
+
+bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
+{
+    DropTables();
+    numBytes = fileSize;
+    numSectors = divRoundUp(fileSize, SectorSize);
+    // Init single and Double
+    SingleIndirectSector = -1;
+    DoubleIndirectSector = -1;
+    if (numSectors < 0 || numSectors > MaxFileSectors)
+        return FALSE; // too big
+    if (freeMap->NumClear() < numSectors + IndexSectors(numSectors))
+        return FALSE; // not enough space
+
+    int sectorCounter = min(numSectors, (int) NumDirect);
+
+    TakeSectors(freeMap, dataSectors, sectorCounter);
+    if (sectorCounter == numSectors)
+    {
+        DEBUG(dbgFile, "Direct pointer is enough for " << fileSize << " size file.\n\n");
+        return TRUE;
+    }
+    // Let's go single indirect
+    // 4KB limit (5KB -> 7KB)
+    AllocateSingleIndirect(freeMap);
+    if (numSectors <= NumDirect + NumIndirect)
+        return TRUE;
+    // The single indirect is full...
+    return AllocateDoubleIndirect(freeMap);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateExtents
+// 	Initialize a fresh file header in the extent format.  Each extent
+//	is taken from the first run of free sectors long enough for the
+//	rest of the file; if there is none, the longest run is used and
+//	we go around again.  A file written sequentially is then read in
+//	long runs, and its header needs no indirect tables.
+//
+//	If the file cannot be described by NumExtents extents, the
+//	sectors taken so far are given back and the pointer format is
+//	used instead.  Return FALSE if there is not enough free space.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSize" is the size of the new file, in bytes
+//----------------------------------------------------------------------
+
+bool FileHeader::AllocateExtents(PersistentBitmap *freeMap, int fileSize)
+{
+    int remaining, start, length;
+
+    DropTables();
+    numBytes = fileSize;
+    numSectors = divRoundUp(fileSize, SectorSize);
+    SingleIndirectSector = -1;
+    DoubleIndirectSector = ExtentFormat;
+    dataSectors[0] = 0;
+    if (freeMap->NumClear() < numSectors)
+        return FALSE; // not enough space
+
+    for (remaining = numSectors; remaining > 0; remaining -= length)
+    {
+        if (dataSectors[0] == NumExtents)
+        {
+            DEBUG(dbgFile, "Free space too fragmented for extents, using pointers.");
+            Deallocate(freeMap);
+            return Allocate(freeMap, fileSize);
+        }
+        start = freeMap->FindAndSetRange(remaining, &length);
+        ASSERT(start >= 0); // we checked there was enough space
+        Extent(dataSectors[0])[0] = start;
+        Extent(dataSectors[0])[1] = length;
+        dataSectors[0]++;
+        DEBUG(dbgFile, "Extent " << dataSectors[0] << ": " << length << " sectors at " << start);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateInline
+// 	Initialize a fresh file header for a small file, whose data is
+//	kept in the header (see filehdr.h).  Nothing is taken from the
+//	free map, and the data starts out as zeroes.
+//
+//	"fileSize" is the size of the new file, in bytes
+//----------------------------------------------------------------------
+
+void FileHeader::AllocateInline(int fileSize)
+{
+    ASSERT(fileSize >= 0 && fileSize <= MaxInlineSize);
+    DropTables();
+    numBytes = fileSize;
+    numSectors = 0;
+    bzero((char *)dataSectors, MaxInlineSize);
+    SingleIndirectSector = -1;
+    DoubleIndirectSector = InlineFormat;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateSparse
+// 	Initialize a fresh file header in the pointer format, with no
+//	data sectors at all: the whole file is a hole, and reads as
+//	zeroes until it is written (see FillHoles).  Nothing is taken
+//	from the free map.  Return FALSE if the file is too big for a
+//	file header to describe.
+//
+//	"fileSize" is the size of the new file, in bytes
+//----------------------------------------------------------------------
+
+bool FileHeader::AllocateSparse(int fileSize)
+{
+    DropTables();
+    numBytes = fileSize;
+    numSectors = divRoundUp(fileSize, SectorSize);
+    for (int i = 0; i < NumDirect; i++)
+        dataSectors[i] = HoleSector;
+    SingleIndirectSector = -1;
+    DoubleIndirectSector = -1;
+    return numSectors <= MaxFileSectors;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AllocateCompressed
+// 	Initialize a fresh file header in the compressed format.  Every
+//	cluster starts out as zeroes, with no sectors: they are given
+//	their sectors as they are written out (see StoreCluster).  Only
+//	the single indirect table is taken from the free map, if the file
+//	has more clusters than fit in the header.  Return FALSE, taking
+//	nothing, if there is no room for it, or the file is too big for
+//	a file header to describe.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSize" is the size of the new file, in bytes
+//----------------------------------------------------------------------
+
+bool FileHeader::AllocateCompressed(PersistentBitmap *freeMap, int fileSize)
+{
+    DropTables();
+    numBytes = 0;
+    numSectors = 0;
+    SingleIndirectSector = -1;
+    DoubleIndirectSector = CompressedFormat;
+    return ExtendCompressed(freeMap, fileSize);
+}
+
+bool FileHeader::AllocateSingleIndirect(PersistentBitmap *freeMap)
+{
+    // the new table is exactly what is on disk, so keep it cached
+    SingleIndirectPointer *single_indirect = singleTable = new SingleIndirectPointer;
+    // create it.
+    SingleIndirectSector = freeMap->FindAndSet();
+    single_indirect->numsSector = min((int) NumIndirect, this->numSectors - (int) NumDirect);
+    TakeSectors(freeMap, single_indirect->dataSectors, single_indirect->numsSector);
+    kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)single_indirect);
+    if (single_indirect->numsSector == NumIndirect)
+    {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+bool FileHeader::AllocateDoubleIndirect(PersistentBitmap *freeMap)
+{
+    int sector_counter = NumIndirect + NumDirect;
+    DoubleIndirectPointer *double_indirect = doubleTable = new DoubleIndirectPointer;
+    doubleLeaves = new SingleIndirectPointer *[NumIndirect];
+    for (int i = 0; i < NumIndirect; i++)
+        doubleLeaves[i] = NULL;
+    DoubleIndirectSector = freeMap->FindAndSet();
+    double_indirect->numsSector = 0;
+
+    while (sector_counter < this->numSectors)
+    {
+        if (double_indirect->numsSector >= NumIndirect)
+            return FALSE;
+        SingleIndirectPointer *single = new SingleIndirectPointer;
+        int singleSector = freeMap->FindAndSet();
+        ASSERT(singleSector >= 0);
+        single->numsSector = min((int) NumIndirect, this->numSectors - sector_counter);
+        TakeSectors(freeMap, single->dataSectors, single->numsSector);
+        kernel->bufferCache->WriteSector(singleSector, (char *)single);
+        double_indirect->pointers[double_indirect->numsSector] = singleSector;
+        doubleLeaves[double_indirect->numsSector] = single;
+        double_indirect->numsSector++;
+        sector_counter += NumIndirect;
+        DEBUG(dbgFile, "Open Double indirect data table "<<double_indirect->numsSector<<" \n\n")
+    }
+
+    kernel->bufferCache->WriteSector(DoubleIndirectSector, (char *)double_indirect);
+    return TRUE;
+}
+//----------------------------------------------------------------------
+// TakeSectorsAfter
+// 	Same as TakeSectors, but first take the free sectors that directly
+//	follow "goal", so that a file that grows keeps going in a straight
+//	line on disk when nothing is in the way.  "goal" may be -1.
+//----------------------------------------------------------------------
+
+static void
+TakeSectorsAfter(PersistentBitmap *freeMap, int goal, int *sectors, int count)
+{
+    int i = 0;
+
+    if (goal >= 0)
+    {
+        for (int next = goal + 1; i < count && next < NumSectors && !freeMap->Test(next); next++)
+        {
+            freeMap->Mark(next);
+            sectors[i++] = next;
+        }
+    }
+    TakeSectors(freeMap, &sectors[i], count - i);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Make the file "newSize" bytes long, giving it more data sectors
+//	(and indirect tables) if it needs them.  The new sectors are
+//	taken right after the current last one if they are free.  The
+//	indirect tables that change are written out; the header itself
+//	is only marked dirty, and written back by whoever owns it.
+//
+//	Sectors that cannot follow the current last one come from the
+//	first long enough run after it, as in Allocate; so do any new
+//	indirect tables.  For an empty file, from where the free map was
+//	told to place them.
+//
+//	Return FALSE, leaving the file as it was, if there is not enough
+//	free space or the file would be too big for its header.  A file
+//	never shrinks here.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, in bytes
+//----------------------------------------------------------------------
+
+bool FileHeader::Extend(PersistentBitmap *freeMap, int newSize)
+{
+    int newNumSectors = divRoundUp(newSize, SectorSize);
+    int added = newNumSectors - numSectors;
+    int goal = (numSectors > 0 && !IsCompressed()) ? FileSectorToSector(numSectors - 1) : -1;
+    Arena scratch;
+    int *sectors;
+
+    if (newSize <= numBytes)
+        return TRUE;
+    if (IsInline())
+        return ExtendInline(freeMap, newSize);
+    if (IsCompressed())
+        return ExtendCompressed(freeMap, newSize);
+    if (added > 0 && IsExtentBased())
+        return ExtendExtents(freeMap, newSize);
+    if (added > 0)
+    {
+        if (newNumSectors > MaxFileSectors)
+            return FALSE; // too big
+        if (freeMap->NumClear() < added + IndexSectors(newNumSectors) - IndexSectors(numSectors))
+            return FALSE; // not enough space
+
+        // the new indirect tables are taken along with the data, so
+        // that each one comes just before the sectors it points to
+        int taken = added + IndexSectors(newNumSectors) - IndexSectors(numSectors);
+
+        sectors = (int *)scratch.Alloc(taken * sizeof(int));
+        if (goal >= 0 && goal + 1 < NumSectors)
+            freeMap->SetGoal(goal + 1);
+        TakeSectorsAfter(freeMap, goal, sectors, taken);
+        for (int next = 0; next < taken; )
+            AppendSector(sectors, &next);
+
+        // write out the tables that changed
+        if (newNumSectors > NumDirect && numSectors - added < NumDirect + NumIndirect)
+            kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+        if (newNumSectors > NumDirect + NumIndirect)
+        {
+            int first = max(numSectors - added, (int) (NumDirect + NumIndirect));
+            int firstLeaf = (first - NumDirect - NumIndirect) / NumIndirect;
+            int lastLeaf = (newNumSectors - 1 - NumDirect - NumIndirect) / NumIndirect;
+
+            for (int i = firstLeaf; i <= lastLeaf; i++)
+                kernel->bufferCache->WriteSector(DoubleTable()->pointers[i], (char *)DoubleLeaf(i));
+            kernel->bufferCache->WriteSector(DoubleIndirectSector, (char *)DoubleTable());
+        }
+    }
+    DEBUG(dbgFile, "Extended file from " << numBytes << " to " << newSize << " bytes.");
+    numBytes = newSize;
+    dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::AppendSector
+// 	Make "sectors[*next]" the next data sector of a pointer-format
+//	file, in the first free slot: a direct pointer, then the single
+//	indirect table, then the tables hanging off the double indirect
+//	table.  A table that does not exist yet is made first, in the
+//	sector before it in "sectors" (the caller has taken enough of
+//	them), and starts out empty.  "*next" is moved past the sectors
+//	used.
+//----------------------------------------------------------------------
+
+void FileHeader::AppendSector(int *sectors, int *next)
+{
+    int slot = numSectors++;
+
+    if (slot < NumDirect)
+    {
+        dataSectors[slot] = sectors[(*next)++];
+        return;
+    }
+    slot -= NumDirect;
+    if (slot < NumIndirect)
+    {
+        if (SingleIndirectSector == -1)
+        {
+            SingleIndirectSector = sectors[(*next)++];
+            singleTable = new SingleIndirectPointer;
+            singleTable->numsSector = 0;
+        }
+        SingleIndirectPointer *single = SingleTable();
+        ASSERT(single->numsSector == slot);
+        single->dataSectors[single->numsSector++] = sectors[(*next)++];
+        return;
+    }
+    slot -= NumIndirect;
+    if (DoubleIndirectSector == -1)
+    {
+        DoubleIndirectSector = sectors[(*next)++];
+        doubleTable = new DoubleIndirectPointer;
+        doubleTable->numsSector = 0;
+        doubleLeaves = new SingleIndirectPointer *[NumIndirect];
+        for (int i = 0; i < NumIndirect; i++)
+            doubleLeaves[i] = NULL;
+    }
+    DoubleIndirectPointer *table = DoubleTable();
+    int which = slot / NumIndirect;
+    if (which == table->numsSector)
+    {
+        table->pointers[which] = sectors[(*next)++];
+        doubleLeaves[which] = new SingleIndirectPointer;
+        doubleLeaves[which]->numsSector = 0;
+        table->numsSector++;
+    }
+    SingleIndirectPointer *leaf = DoubleLeaf(which);
+    ASSERT(leaf->numsSector == slot % NumIndirect);
+    leaf->dataSectors[leaf->numsSector++] = sectors[(*next)++];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillSector
+// 	Make "sectors[*next]" the data sector of the "fileSector"-th
+//	sector of a pointer-format file, which is a hole.  As in
+//	AppendSector, a table that does not exist yet is made first, in
+//	the sector before it in "sectors"; entries a table did not
+//	reach yet, between its old end and the new one, are holes.
+//----------------------------------------------------------------------
+
+void FileHeader::FillSector(int fileSector, int *sectors, int *next)
+{
+    SingleIndirectPointer *table;
+
+    ASSERT(FileSectorToSector(fileSector) == HoleSector);
+    if (fileSector < NumDirect)
+    {
+        dataSectors[fileSector] = sectors[(*next)++];
+        return;
+    }
+    fileSector -= NumDirect;
+    if (fileSector < NumIndirect)
+    {
+        if (SingleIndirectSector == -1)
+        {
+            SingleIndirectSector = sectors[(*next)++];
+            singleTable = new SingleIndirectPointer;
+            singleTable->numsSector = 0;
+        }
+        table = SingleTable();
+    }
+    else
+    {
+        fileSector -= NumIndirect;
+        if (DoubleIndirectSector == -1)
+        {
+            DoubleIndirectSector = sectors[(*next)++];
+            doubleTable = new DoubleIndirectPointer;
+            doubleTable->numsSector = 0;
+            doubleLeaves = new SingleIndirectPointer *[NumIndirect];
+            for (int i = 0; i < NumIndirect; i++)
+                doubleLeaves[i] = NULL;
+        }
+        DoubleIndirectPointer *dbl = DoubleTable();
+        int which = fileSector / NumIndirect;
+        if (!HasLeaf(which))
+        {
+            while (dbl->numsSector <= which)
+                dbl->pointers[dbl->numsSector++] = HoleSector;
+            dbl->pointers[which] = sectors[(*next)++];
+            delete doubleLeaves[which];
+            doubleLeaves[which] = new SingleIndirectPointer;
+            doubleLeaves[which]->numsSector = 0;
+        }
+        table = DoubleLeaf(which);
+        fileSector %= NumIndirect;
+    }
+    while (table->numsSector <= fileSector)
+        table->dataSectors[table->numsSector++] = HoleSector;
+    table->dataSectors[fileSector] = sectors[(*next)++];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Entry
+// 	Return where the "fileSector"-th sector of a pointer-format file
+//	is recorded: in a direct pointer or an indirect table, which must
+//	reach that far already.
+//----------------------------------------------------------------------
+
+int *FileHeader::Entry(int fileSector)
+{
+    if (fileSector < NumDirect)
+        return &dataSectors[fileSector];
+    fileSector -= NumDirect;
+    if (fileSector < NumIndirect)
+    {
+        ASSERT(fileSector < SingleTable()->numsSector);
+        return &SingleTable()->dataSectors[fileSector];
+    }
+    fileSector -= NumIndirect;
+    ASSERT(fileSector % NumIndirect < DoubleLeaf(fileSector / NumIndirect)->numsSector);
+    return &DoubleLeaf(fileSector / NumIndirect)->dataSectors[fileSector % NumIndirect];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FillHoles / Preallocate
+// 	Give a data sector to every hole among the sectors of the file
+//	overlapping a byte range, and make the indirect tables they need.
+//	As in Extend, the new sectors go right after the sector before
+//	the range if they can, the tables that change are written out,
+//	and the header is only marked dirty.
+//
+//	FillHoles gets the range ready to be written.  A sector that was
+//	a hole or unwritten, and that the range does not cover all of, is
+//	zeroed (in the buffer cache), since the part of it not about to
+//	be written has to go on reading as zeroes -- and so does any of
+//	it past the end of the file, should the file grow over it later.
+//	A sector shared with another file is replaced by a new one, with
+//	the bytes of the old one copied over unless the range covers all
+//	of it, and the file's use of the old one is given back.
+//
+//	Preallocate just sets the sectors aside: the new ones are marked
+//	unwritten, and nothing is written to them, so they go on reading
+//	as zeroes, without going to the disk, until FillHoles is called
+//	for them.  The free map gives them out in as few runs as it can.
+//
+//	Return FALSE, taking nothing, if there is not enough free space.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"offset" is the location within the file of the first byte
+//	"numBytes" is the length of the range, which lies in the file
+//----------------------------------------------------------------------
+
+bool FileHeader::FillHoles(PersistentBitmap *freeMap, int offset, int numBytes)
+{
+    return FillRange(freeMap, offset, numBytes, FALSE);
+}
+
+bool FileHeader::Preallocate(PersistentBitmap *freeMap, int offset, int numBytes)
+{
+    return FillRange(freeMap, offset, numBytes, TRUE);
+}
+
+bool FileHeader::FillRange(PersistentBitmap *freeMap, int offset, int numBytes,
+                           bool preallocate)
+{
+    int first = SectorOf(offset);
+    int last = SectorOf(offset + numBytes - 1);
+    int needed = 0, changes = 0, next = 0, newLeaf = -1, firstLeaf = -1, lastLeaf = -1;
+    bool newSingle = FALSE, newDouble = FALSE, singleChanged = FALSE;
+    int i, goal, which, entry;
+    bool shared;
+    char zeros[SectorSize], data[SectorSize];
+    Arena scratch;
+    int *sectors = NULL;
+
+    ASSERT(!IsInline() && !IsExtentBased());
+    ASSERT(numBytes > 0 && offset + numBytes <= this->numBytes);
+
+    // count the holes, and the tables that will have to be made
+    for (i = first; i <= last; i++)
+    {
+        entry = FileSectorToSector(i);
+        if (entry != HoleSector)
+        {
+            if (!preallocate && (entry & UnwrittenFlag))
+                changes++;
+            else if (!preallocate && freeMap->IsShared(entry))
+                needed++; // to be copied
+            continue;
+        }
+        needed++;
+        if (i >= NumDirect && i < NumDirect + NumIndirect && SingleIndirectSector == -1 && !newSingle)
+        {
+            newSingle = TRUE;
+            needed++;
+        }
+        else if (i >= NumDirect + NumIndirect)
+        {
+            which = (i - NumDirect - NumIndirect) / NumIndirect;
+            if (DoubleIndirectSector == -1 && !newDouble)
+            {
+                newDouble = TRUE;
+                needed++;
+            }
+            if (which != newLeaf && !HasLeaf(which))
+            {
+                newLeaf = which;
+                needed++;
+            }
+        }
+    }
+    if (needed == 0 && changes == 0)
+        return TRUE;
+    if (freeMap->NumClear() < needed)
+        return FALSE; // not enough space
+
+    if (needed > 0)
+    {
+        sectors = (int *)scratch.Alloc(needed * sizeof(int));
+        goal = (first > 0) ? FileSectorToSector(first - 1) : HoleSector;
+        if (goal != HoleSector)
+            goal &= ~UnwrittenFlag;
+        if (goal >= 0 && goal + 1 < NumSectors)
+            freeMap->SetGoal(goal + 1);
+        TakeSectorsAfter(freeMap, goal, sectors, needed);
+    }
+    bzero(zeros, SectorSize);
+    for (i = first; i <= last; i++)
+    {
+        entry = FileSectorToSector(i);
+        shared = !preallocate && entry != HoleSector && !(entry & UnwrittenFlag)
+                 && freeMap->IsShared(entry);
+        if (entry == HoleSector)
+            FillSector(i, sectors, &next);
+        else if (!shared && (preallocate || !(entry & UnwrittenFlag)))
+            continue; // nothing to do
+        if (i >= NumDirect + NumIndirect)
+        {
+            which = (i - NumDirect - NumIndirect) / NumIndirect;
+            if (firstLeaf == -1)
+                firstLeaf = which;
+            lastLeaf = which;
+        }
+        else if (i >= NumDirect)
+            singleChanged = TRUE;
+        if (preallocate)
+        {
+            *Entry(i) |= UnwrittenFlag;
+            continue;
+        }
+
+        int lo = max(offset, i * SectorSize);
+        int hi = min(offset + numBytes, (i + 1) * SectorSize);
+        if (shared)
+        {
+            *Entry(i) = sectors[next++];
+            if (hi - lo < SectorSize)
+            {
+                kernel->bufferCache->ReadSector(entry, data);
+                kernel->bufferCache->WriteSector(*Entry(i), data);
+            }
+            freeMap->Clear(entry); // one sharer fewer
+            continue;
+        }
+        *Entry(i) &= ~UnwrittenFlag;
+        if (hi - lo < SectorSize)
+            kernel->bufferCache->WriteSector(*Entry(i), zeros);
+    }
+    ASSERT(next == needed);
+
+    // write out the tables that changed
+    if (singleChanged)
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+    if (firstLeaf != -1)
+    {
+        for (which = firstLeaf; which <= lastLeaf; which++)
+            if (HasLeaf(which))
+                kernel->bufferCache->WriteSector(DoubleTable()->pointers[which], (char *)DoubleLeaf(which));
+        kernel->bufferCache->WriteSector(DoubleIndirectSector, (char *)DoubleTable());
+    }
+    DEBUG(dbgFile, (preallocate ? "Preallocated " : "Filled ") << needed << " sectors in file sectors " << first << " to " << last);
+    dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendSparse
+// 	Make the file "newSize" bytes long, as Extend does, except that in
+//	the pointer format only the sectors overlapping the bytes from
+//	"position" on are allocated (see FillHoles): a gap between the
+//	old end of the file and "position" is left as a hole.  Inline and
+//	extent files have no holes, and are just extended; so are
+//	compressed files, whose new clusters read as zeroes anyway.
+//
+//	Return FALSE, leaving the file as it was, if there is not enough
+//	free space or the file would be too big for its header.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, in bytes
+//	"position" is where in the file the bytes that need sectors start
+//----------------------------------------------------------------------
+
+bool FileHeader::ExtendSparse(PersistentBitmap *freeMap, int newSize, int position)
+{
+    int newNumSectors = divRoundUp(newSize, SectorSize);
+    int oldBytes = numBytes;
+    int oldSectors = numSectors;
+
+    if (newSize <= numBytes)
+        return TRUE;
+    if (IsInline() || IsExtentBased() || IsCompressed())
+        return Extend(freeMap, newSize);
+    if (newNumSectors > MaxFileSectors)
+        return FALSE; // too big
+    for (int i = numSectors; i < newNumSectors && i < NumDirect; i++)
+        dataSectors[i] = HoleSector;
+    numBytes = newSize;
+    numSectors = newNumSectors;
+    if (position < newSize && !FillHoles(freeMap, position, newSize - position))
+    {
+        numBytes = oldBytes;
+        numSectors = oldSectors;
+        return FALSE;
+    }
+    DEBUG(dbgFile, "Extended file from " << oldBytes << " to " << newSize << " bytes, sparsely.");
+    dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::HasUnwritten
+// 	Return TRUE if any sector of the file overlapping a byte range,
+//	which lies in the file, is a hole or unwritten.  Inline and
+//	extent files have none, and neither do compressed files: their
+//	clusters of zeroes are dealt with a cluster at a time.
+//----------------------------------------------------------------------
+
+bool FileHeader::HasUnwritten(int offset, int numBytes)
+{
+    if (IsInline() || IsExtentBased() || IsCompressed() || numBytes <= 0)
+        return FALSE;
+    for (int i = SectorOf(offset); i <= SectorOf(offset + numBytes - 1); i++)
+        if (IsUnwritten(FileSectorToSector(i)))
+            return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::HasShared
+// 	Return TRUE if any sector of the file overlapping a byte range,
+//	which lies in the file, is shared with another file, and so has
+//	to be copied before it is written (see FillHoles).  Only
+//	pointer-format files share sectors.
+//
+//	"freeMap" is the bit map of free disk sectors, which counts the
+//		files sharing each sector
+//----------------------------------------------------------------------
+
+bool FileHeader::HasShared(PersistentBitmap *freeMap, int offset, int numBytes)
+{
+    int entry;
+
+    if (IsInline() || IsExtentBased() || IsCompressed() || numBytes <= 0
+        || freeMap->NumShared() == 0)
+        return FALSE;
+    for (int i = SectorOf(offset); i <= SectorOf(offset + numBytes - 1); i++)
+    {
+        entry = FileSectorToSector(i);
+        if (!IsUnwritten(entry) && freeMap->IsShared(entry))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Clone
+// 	Initialize a fresh file header for a copy of the file "from"
+//	describes, without copying any data: the copy gets the same data
+//	sectors, shared with the original (see PersistentBitmap::Share),
+//	until one of them writes to one (see FillHoles).  Only the
+//	indirect tables, which say where the sectors are, are new.  A
+//	hole or unwritten sector of the original is a hole in the copy,
+//	since an unwritten sector is written in place the first time.
+//	An inline file is copied with its header.
+//
+//	Return FALSE, taking nothing, if there is no room for the tables,
+//	or a sector is shared by as many files as it can be.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"from" is the header of the original, which is inline or in the
+//		pointer format
+//----------------------------------------------------------------------
+
+bool FileHeader::Clone(PersistentBitmap *freeMap, FileHeader *from)
+{
+    int fileSectors = divRoundUp(from->numBytes, SectorSize);
+    int tables = 0, sectors[3];
+    int i, which, entry, count, next;
+
+    ASSERT(!from->IsExtentBased() && !from->IsCompressed());
+    if (from->IsInline())
+    {
+        DropTables();
+        numBytes = from->numBytes;
+        numSectors = 0;
+        bcopy((char *)from->dataSectors, (char *)dataSectors, MaxInlineSize);
+        SingleIndirectSector = -1;
+        DoubleIndirectSector = InlineFormat;
+        dirty = TRUE;
+        return TRUE;
+    }
+
+    // at most as many tables as the original has
+    if (from->SingleIndirectSector != -1)
+        tables++;
+    if (from->DoubleIndirectSector != -1)
+    {
+        tables++;
+        for (which = 0; which < NumIndirect; which++)
+            if (from->HasLeaf(which))
+                tables++;
+    }
+    if (freeMap->NumClear() < tables)
+        return FALSE;
+    // a sector may come up more than once, so share them as we go
+    for (i = 0; i < fileSectors; i++)
+    {
+        entry = from->FileSectorToSector(i);
+        if (!IsUnwritten(entry) && !freeMap->Share(entry))
+        {
+            while (--i >= 0)
+            {
+                entry = from->FileSectorToSector(i);
+                if (!IsUnwritten(entry))
+                    freeMap->Clear(entry); // one sharer fewer
+            }
+            return FALSE;
+        }
+    }
+
+    AllocateSparse(from->numBytes);
+    for (i = 0; i < fileSectors; i++)
+    {
+        entry = from->FileSectorToSector(i);
+        if (IsUnwritten(entry))
+            continue;
+        // the tables this sector is the first to need, then the sector
+        count = next = 0;
+        if (i >= NumDirect && i < NumDirect + NumIndirect && SingleIndirectSector == -1)
+            sectors[count++] = freeMap->FindAndSet();
+        else if (i >= NumDirect + NumIndirect)
+        {
+            if (DoubleIndirectSector == -1)
+                sectors[count++] = freeMap->FindAndSet();
+            if (!HasLeaf((i - NumDirect - NumIndirect) / NumIndirect))
+                sectors[count++] = freeMap->FindAndSet();
+        }
+        sectors[count++] = entry;
+        FillSector(i, sectors, &next);
+    }
+
+    // write out the new tables
+    if (SingleIndirectSector != -1)
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+    if (DoubleIndirectSector != -1)
+    {
+        for (which = 0; which < NumIndirect; which++)
+            if (HasLeaf(which))
+                kernel->bufferCache->WriteSector(DoubleTable()->pointers[which], (char *)DoubleLeaf(which));
+        kernel->bufferCache->WriteSector(DoubleIndirectSector, (char *)DoubleTable());
+    }
+    DEBUG(dbgFile, "Cloned a file of " << fileSectors << " sectors.");
+    dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ShareSector
+// 	Make the "fileSector"-th sector of a pointer-format file the disk
+//	sector "sector", which another file uses and which holds the same
+//	bytes as the file's own sector, giving the file's use of that
+//	one back.  The table the sector is recorded in, if it is not in
+//	the header, is written out; the header is only marked dirty.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSector" is a written sector of the file
+//	"sector" is the sector to share, which must have room for one
+//		more sharer (see PersistentBitmap::CanShare)
+//----------------------------------------------------------------------
+
+void FileHeader::ShareSector(PersistentBitmap *freeMap, int fileSector, int sector)
+{
+    int *entry = Entry(fileSector);
+    int which;
+    bool shared;
+
+    ASSERT(!IsInline() && !IsExtentBased() && !IsCompressed());
+    ASSERT(!IsUnwritten(*entry) && *entry != sector);
+    shared = freeMap->Share(sector);
+    ASSERT(shared);
+    freeMap->Clear(*entry);
+    *entry = sector;
+    if (fileSector >= NumDirect + NumIndirect)
+    {
+        which = (fileSector - NumDirect - NumIndirect) / NumIndirect;
+        kernel->bufferCache->WriteSector(DoubleTable()->pointers[which], (char *)DoubleLeaf(which));
+    }
+    else if (fileSector >= NumDirect)
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+    dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Truncate
+// 	Make the file "newSize" bytes long, which is no longer than it
+//	is.  The data sectors past the new end go back to the free map in
+//	one pass, and so does each indirect table with nothing left in
+//	it; the tables that are only cut short are written out.  The
+//	header is only marked dirty.
+//
+//	What is left of the last sector is not touched: the caller zeroes
+//	the bytes in it past the new end, if they could ever be read
+//	again.  An inline file has its bytes zeroed here.  A compressed
+//	file keeps its last cluster whole, and gives back the ones after.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"newSize" is the new length of the file, in bytes
+//----------------------------------------------------------------------
+
+void FileHeader::Truncate(PersistentBitmap *freeMap, int newSize)
+{
+    int newNumSectors = divRoundUp(newSize, SectorSize);
+
+    if (newSize >= numBytes)
+        return;
+    DEBUG(dbgFile, "Truncating file from " << numBytes << " to " << newSize << " bytes.");
+    if (IsCompressed())
+    {
+        TruncateCompressed(freeMap, divRoundUp(newSize, ClusterSize));
+        numBytes = newSize;
+        dirty = TRUE;
+        return;
+    }
+    if (IsInline())
+        bzero((char *)dataSectors + newSize, numBytes - newSize);
+    else if (IsExtentBased())
+        TruncateExtents(freeMap, newNumSectors);
+    else
+    {
+        for (int i = newNumSectors; i < numSectors; i++)
+        {
+            int sector = FileSectorToSector(i);
+            if (sector == HoleSector)
+                continue;
+            sector &= ~UnwrittenFlag;
+            ASSERT(freeMap->Test(sector)); // ought to be marked!
+            freeMap->Clear(sector);
+        }
+        for (int i = newNumSectors; i < NumDirect; i++)
+            dataSectors[i] = HoleSector;
+        TruncateTables(freeMap, newNumSectors);
+    }
+    numBytes = newSize;
+    numSectors = newNumSectors;
+    dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TruncateExtents
+// 	Truncate, in the extent format: the extents past the new end go,
+//	and the one it falls in is cut short.
+//----------------------------------------------------------------------
+
+void FileHeader::TruncateExtents(PersistentBitmap *freeMap, int newNumSectors)
+{
+    int kept = 0, numExtents = 0;
+
+    for (int i = 0; i < dataSectors[0]; i++)
+    {
+        int *extent = Extent(i);
+        int keep = max(0, min(extent[1], newNumSectors - kept));
+
+        kept += keep;
+        for (int j = extent[0] + keep; j < extent[0] + extent[1]; j++)
+        {
+            ASSERT(freeMap->Test(j)); // ought to be marked!
+            freeMap->Clear(j);
+        }
+        extent[1] = keep;
+        if (keep > 0)
+            numExtents = i + 1;
+    }
+    dataSectors[0] = numExtents;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::TruncateTables
+// 	Truncate the indirect tables of a pointer-format file to
+//	"newNumSectors" sectors, whose data sectors past that are free
+//	already.  A table with nothing left in it is freed, and forgotten,
+//	so that the file can grow again, in either format of allocation.
+//----------------------------------------------------------------------
+
+void FileHeader::TruncateTables(PersistentBitmap *freeMap, int newNumSectors)
+{
+    int inSingle = newNumSectors - NumDirect;
+    int inDouble = newNumSectors - NumDirect - NumIndirect;
+
+    if (SingleIndirectSector != -1)
+    {
+        if (inSingle <= 0)
+        {
+            freeMap->Clear(SingleIndirectSector);
+            delete singleTable;
+            singleTable = NULL;
+            SingleIndirectSector = -1;
+        }
+        else if (SingleTable()->numsSector > inSingle)
+        {
+            singleTable->numsSector = inSingle;
+            kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)singleTable);
+        }
+    }
+    if (DoubleIndirectSector == -1)
+        return;
+
+    DoubleIndirectPointer *table = DoubleTable();
+    int keepLeaves = (inDouble <= 0) ? 0 : divRoundUp(inDouble, NumIndirect);
+
+    for (int i = table->numsSector - 1; i >= keepLeaves; i--)
+    {
+        if (table->pointers[i] != HoleSector)
+            freeMap->Clear(table->pointers[i]);
+        delete doubleLeaves[i];
+        doubleLeaves[i] = NULL;
+    }
+    if (keepLeaves == 0)
+    {
+        freeMap->Clear(DoubleIndirectSector);
+        delete[] doubleLeaves;
+        doubleLeaves = NULL;
+        delete doubleTable;
+        doubleTable = NULL;
+        DoubleIndirectSector = -1;
+        return;
+    }
+    if (keepLeaves <= table->numsSector && HasLeaf(keepLeaves - 1))
+    {
+        SingleIndirectPointer *leaf = DoubleLeaf(keepLeaves - 1);
+        int inLeaf = inDouble - (keepLeaves - 1) * NumIndirect;
+
+        if (leaf->numsSector > inLeaf)
+        {
+            leaf->numsSector = inLeaf;
+            kernel->bufferCache->WriteSector(table->pointers[keepLeaves - 1], (char *)leaf);
+        }
+    }
+    if (table->numsSector > keepLeaves)
+    {
+        table->numsSector = keepLeaves;
+        kernel->bufferCache->WriteSector(DoubleIndirectSector, (char *)table);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendExtents
+// 	Extend for the extent format.  The last extent is lengthened as
+//	far as the free sectors after it allow; the rest goes in new
+//	extents.  If we run out of extents, everything taken is given
+//	back and FALSE is returned -- the file is not converted to the
+//	pointer format.
 //----------------------------------------------------------------------
 
-bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
+bool FileHeader::ExtendExtents(PersistentBitmap *freeMap, int newSize)
 {
-    numBytes = fileSize;
-    numSectors = divRoundUp(fileSize, SectorSize);
-    // Init single and Double
-    SingleIndirectSector = -1;
-    DoubleIndirectSector = -1;
-    if (freeMap->NumClear() < numSectors)
+    int newNumSectors = divRoundUp(newSize, SectorSize);
+    int remaining = newNumSectors - numSectors;
+    int oldExtents = dataSectors[0];
+    int oldLastLength = (oldExtents > 0) ? Extent(oldExtents - 1)[1] : 0;
+    int start, length;
+
+    if (freeMap->NumClear() < remaining)
         return FALSE; // not enough space
+    if (oldExtents > 0)
+    {
+        int *last = Extent(oldExtents - 1);
+        while (remaining > 0 && last[0] + last[1] < NumSectors && !freeMap->Test(last[0] + last[1]))
+        {
+            freeMap->Mark(last[0] + last[1]);
+            last[1]++;
+            remaining--;
+        }
+        if (last[0] + last[1] < NumSectors)
+            freeMap->SetGoal(last[0] + last[1]); // new extents go after it
+    }
+    for (; remaining > 0; remaining -= length)
+    {
+        if (dataSectors[0] == NumExtents)
+        {
+            DEBUG(dbgFile, "Out of extents, cannot extend the file.");
+            for (int i = oldExtents; i < dataSectors[0]; i++)
+                for (int j = Extent(i)[0]; j < Extent(i)[0] + Extent(i)[1]; j++)
+                    freeMap->Clear(j);
+            dataSectors[0] = oldExtents;
+            if (oldExtents > 0)
+            {
+                int *last = Extent(oldExtents - 1);
+                for (int j = last[0] + oldLastLength; j < last[0] + last[1]; j++)
+                    freeMap->Clear(j);
+                last[1] = oldLastLength;
+            }
+            return FALSE;
+        }
+        start = freeMap->FindAndSetRange(remaining, &length);
+        ASSERT(start >= 0); // we checked there was enough space
+        Extent(dataSectors[0])[0] = start;
+        Extent(dataSectors[0])[1] = length;
+        dataSectors[0]++;
+    }
+    DEBUG(dbgFile, "Extended file from " << numBytes << " to " << newSize << " bytes.");
+    numSectors = newNumSectors;
+    numBytes = newSize;
+    dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendInline
+// 	Extend for an inline file.  As long as the data still fits in
+//	the header, the new bytes are just zeroed.  Otherwise the file is
+//	turned into an empty pointer-format file and extended as one,
+//	and what it held is written to its first data sector, in the
+//	same transaction as the new sectors.  If there is not enough
+//	free space, the file is left inline, as it was.
+//----------------------------------------------------------------------
 
-    int sectorCounter;
+bool FileHeader::ExtendInline(PersistentBitmap *freeMap, int newSize)
+{
+    char saved[MaxInlineSize];
+    char data[SectorSize];
+    int oldBytes = numBytes;
 
-    for (sectorCounter = 0; (sectorCounter < NumDirect) && (sectorCounter < numSectors); sectorCounter++)
+    if (newSize <= MaxInlineSize)
     {
-        dataSectors[sectorCounter] = freeMap->FindAndSet();
-        // since we checked that there was enough free space,
-        // we expect this to succeed
-        ASSERT(dataSectors[sectorCounter] >= 0);
+        bzero((char *)dataSectors + numBytes, newSize - numBytes);
+        numBytes = newSize;
+        dirty = TRUE;
+        return TRUE;
     }
-    if (sectorCounter == numSectors)
+    bcopy((char *)dataSectors, saved, MaxInlineSize);
+    numBytes = 0;
+    DoubleIndirectSector = -1;
+    if (!Extend(freeMap, newSize))
     {
-        DEBUG(dbgFile, "Direct pointer is enough for " << fileSize << " size file.\n\n");
-        return TRUE;
+        bcopy(saved, (char *)dataSectors, MaxInlineSize);
+        numBytes = oldBytes;
+        DoubleIndirectSector = InlineFormat;
+        return FALSE;
     }
-    int rested_size = numBytes - (NumDirect * SectorSize);
-    // Let's go single indirect
-    // 4KB limit (5KB -> 7KB)
-    if (this->AllocateSingleIndirect(freeMap))
+    DEBUG(dbgFile, "Moved " << oldBytes << " inline bytes to sector " << dataSectors[0]);
+    if (oldBytes > 0)
+    {
+        bzero(data, SectorSize);
+        bcopy(saved, data, oldBytes);
+        kernel->bufferCache->WriteSector(dataSectors[0], data);
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ClusterEntry
+// 	Return where the entry of the "which"-th cluster of a compressed
+//	file is: in the header, or in the single indirect table.
+//----------------------------------------------------------------------
+
+int *FileHeader::ClusterEntry(int which)
+{
+    ASSERT(IsCompressed() && which >= 0 && which < (int) MaxClusters);
+    if (which < NumDirect)
+        return &dataSectors[which];
+    return &SingleTable()->dataSectors[which - NumDirect];
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FreeCluster
+// 	Give back the sectors of the cluster with entry "entry", from its
+//	"from"-th one to its last.
+//----------------------------------------------------------------------
+
+void FileHeader::FreeCluster(PersistentBitmap *freeMap, int entry, int from)
+{
+    for (int i = from; i < ClusterCount(entry); i++)
     {
+        ASSERT(freeMap->Test(ClusterStart(entry) + i)); // ought to be marked!
+        freeMap->Clear(ClusterStart(entry) + i);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ExtendCompressed
+// 	Extend for a compressed file.  The new clusters read as zeroes,
+//	and take no sectors yet; the single indirect table is taken from
+//	the free map when the file first needs it.  Return FALSE, leaving
+//	the file as it was, if there is no room for the table, or the
+//	file would be too big for its header.
+//----------------------------------------------------------------------
+
+bool FileHeader::ExtendCompressed(PersistentBitmap *freeMap, int newSize)
+{
+    int newNumClusters = divRoundUp(newSize, ClusterSize);
+
+    if (newSize <= numBytes)
         return TRUE;
+    if (newNumClusters > MaxClusters)
+        return FALSE; // too big
+    if (newNumClusters > NumDirect && SingleIndirectSector == -1)
+    {
+        int tableSector = freeMap->FindAndSet();
+        if (tableSector == -1)
+            return FALSE; // not enough space
+        SingleIndirectSector = tableSector;
+        singleTable = new SingleIndirectPointer;
+        singleTable->numsSector = 0;
     }
-    else
-    { // The single indirect is full...
-        rested_size -= (NumIndirect * SectorSize);
-        return AllocateDoubleIndirect(freeMap);
+    for (int i = numSectors; i < newNumClusters; i++)
+        *ClusterEntry(i) = 0;
+    if (newNumClusters > NumDirect && newNumClusters > numSectors)
+    {
+        SingleTable()->numsSector = newNumClusters - NumDirect;
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
     }
+    DEBUG(dbgFile, "Extended compressed file from " << numBytes << " to " << newSize << " bytes.");
+    numBytes = newSize;
+    numSectors = newNumClusters;
+    dirty = TRUE;
     return TRUE;
 }
 
-bool FileHeader::AllocateSingleIndirect(PersistentBitmap *freeMap)
+//----------------------------------------------------------------------
+// FileHeader::TruncateCompressed
+// 	Keep the first "newNumClusters" clusters of a compressed file,
+//	giving back the sectors of the rest, and the single indirect
+//	table if it is no longer needed; otherwise the table is cut
+//	short and written out.
+//----------------------------------------------------------------------
+
+void FileHeader::TruncateCompressed(PersistentBitmap *freeMap, int newNumClusters)
 {
-    SingleIndirectPointer *single_indirect = new SingleIndirectPointer;
-    // create it.
-    SingleIndirectSector = freeMap->FindAndSet();
-    single_indirect->numsSector = 0;
-    for (single_indirect->numsSector = 0;
-         (single_indirect->numsSector < NumIndirect) && ((single_indirect->numsSector + NumDirect) < this->numSectors);
-         single_indirect->numsSector++)
+    for (int i = newNumClusters; i < numSectors; i++)
     {
-        single_indirect->dataSectors[single_indirect->numsSector] = freeMap->FindAndSet();
-        // since we checked that there was enough free space,
-        // we expect this to succeed
-        ASSERT(single_indirect->dataSectors[single_indirect->numsSector] >= 0);
+        FreeCluster(freeMap, *ClusterEntry(i), 0);
+        *ClusterEntry(i) = 0;
     }
-    kernel->synchDisk->WriteSector(SingleIndirectSector, (char *)single_indirect);
-    if (single_indirect->numsSector == NumIndirect)
+    if (SingleIndirectSector != -1 && newNumClusters <= NumDirect)
     {
-        return FALSE;
+        ASSERT(freeMap->Test(SingleIndirectSector)); // ought to be marked!
+        freeMap->Clear(SingleIndirectSector);
+        delete singleTable;
+        singleTable = NULL;
+        SingleIndirectSector = -1;
     }
-    // delete single_indirect;
-    return TRUE;
+    else if (SingleIndirectSector != -1)
+    {
+        SingleTable()->numsSector = newNumClusters - NumDirect;
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+    }
+    numSectors = newNumClusters;
 }
 
-bool FileHeader::AllocateDoubleIndirect(PersistentBitmap *freeMap)
+//----------------------------------------------------------------------
+// FileHeader::ReadCluster
+// 	Read the "which"-th cluster of a compressed file, and decompress
+//	it into the ClusterSize bytes at "into".  Only as many sectors
+//	as it was compressed into are read; a cluster of zeroes is not
+//	read at all.  Bytes of the last cluster past the end of the file
+//	are zeroes.
+//----------------------------------------------------------------------
+
+void FileHeader::ReadCluster(int which, char *into)
 {
-    int sector_counter = NumIndirect + NumDirect;
-    DoubleIndirectPointer *double_indirect = new DoubleIndirectPointer;
-    DoubleIndirectSector = freeMap->FindAndSet();
-    double_indirect->numsSector = 0;
+    int entry = *ClusterEntry(which);
+    int start = ClusterStart(entry), count = ClusterCount(entry);
+    Arena scratch;
+    char *packed;
 
-    while (sector_counter <= this->numSectors)
+    ASSERT(which < numSectors);
+    if (count == 0)
+        bzero(into, ClusterSize);
+    else if (count == ClusterSectors)
+        kernel->bufferCache->ReadSectors(start, count, into);
+    else
     {
-        SingleIndirectPointer *single = new SingleIndirectPointer;
-        single->numsSector = 0;
-        double_indirect->pointers[double_indirect->numsSector] = freeMap->FindAndSet();
-        for (single->numsSector = 0;
-             (single->numsSector < NumIndirect) && (single->numsSector + sector_counter < this->numSectors);
-             single->numsSector++)
+        packed = (char *)scratch.Alloc(count * SectorSize);
+        kernel->bufferCache->ReadSectors(start, count, packed);
+        bool ok = LzCodec::Decompress(packed, count * SectorSize, into, ClusterSize);
+        ASSERT(ok); // a damaged cluster
+    }
+}
+
+//----------------------------------------------------------------------
+// FileHeader::StoreCluster
+// 	Write out the "which"-th cluster of a compressed file, which has
+//	been compressed into the "count" sectors at "packed": a "count"
+//	of 0 makes it a cluster of zeroes, and of ClusterSectors, a
+//	cluster stored as it is.  If it fits in the sectors it has, it
+//	is written over them, and the ones it no longer needs are given
+//	back; otherwise it goes to a new run of sectors -- right after
+//	the cluster before it, if that is free -- and the old ones are
+//	given back.  The single indirect table is written out if the
+//	entry is in it; the header is only marked dirty.
+//
+//	Return FALSE, leaving the cluster as it was, if there is no run
+//	of free sectors long enough.
+//
+//	"freeMap" is the bit map of free disk sectors
+//----------------------------------------------------------------------
+
+bool FileHeader::StoreCluster(PersistentBitmap *freeMap, int which, char *packed,
+                              int count)
+{
+    int *entry = ClusterEntry(which);
+    int start = ClusterStart(*entry);
+    int length;
+
+    ASSERT(which < numSectors && count >= 0 && count <= ClusterSectors);
+    if (count > ClusterCount(*entry))
+    {
+        for (int i = which - 1; i >= 0; i--)
         {
-            single->dataSectors[single->numsSector] = freeMap->FindAndSet();
-            // since we checked that there was enough free space,
-            // we expect this to succeed
-            ASSERT(single->dataSectors[single->numsSector] >= 0);
+            int before = *ClusterEntry(i);
+            if (before != 0)
+            {
+                freeMap->SetGoal(ClusterStart(before) + ClusterCount(before));
+                break;
+            }
         }
-        sector_counter += NumIndirect;
-        double_indirect->numsSector++;
-        if (double_indirect->numsSector >= NumIndirect)
+        start = freeMap->FindRun(count, &length);
+        if (length < count)
             return FALSE;
-        kernel->synchDisk->WriteSector(double_indirect->pointers[double_indirect->numsSector], (char *)single);
-        DEBUG(dbgFile, "Open Double indirect data table "<<double_indirect->numsSector<<" \n\n")
+        ASSERT(start < (1 << ClusterCountShift));
+        for (int i = 0; i < count; i++)
+            freeMap->Mark(start + i);
+        FreeCluster(freeMap, *entry, 0);
+    }
+    else
+        FreeCluster(freeMap, *entry, count);
+    DEBUG(dbgFile, "Storing cluster " << which << " in " << count << " sectors from " << start);
+    if (count > 0)
+        kernel->bufferCache->WriteSectors(start, count, packed);
+    *entry = (count == 0) ? 0 : start | (count << ClusterCountShift);
+    if (which >= NumDirect)
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+    dirty = TRUE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::CompressedSectors
+// 	Store in "sectors" the data sectors of a compressed file, in the
+//	order of its clusters, and return how many there are.
+//
+//	"sectors" has room for ClusterSectors entries per cluster
+//----------------------------------------------------------------------
+
+int FileHeader::CompressedSectors(int *sectors)
+{
+    int count = 0;
+
+    for (int i = 0; i < numSectors; i++)
+    {
+        int entry = *ClusterEntry(i);
+        for (int j = 0; j < ClusterCount(entry); j++)
+            sectors[count++] = ClusterStart(entry) + j;
     }
+    return count;
+}
 
-    kernel->synchDisk->WriteSector(DoubleIndirectSector, (char *)double_indirect);
-    // delete double_indirect;
+//----------------------------------------------------------------------
+// AddOwned
+// 	Append "sector" to the "*count" sectors a file is found to hold
+//	so far.  Return FALSE if it is not a sector of the disk, or there
+//	are already MaxOwnedSectors.
+//----------------------------------------------------------------------
+
+static bool
+AddOwned(int *sectors, int *count, int sector)
+{
+    if (sector < 0 || sector >= NumSectors || *count == MaxOwnedSectors)
+        return FALSE;
+    sectors[(*count)++] = sector;
     return TRUE;
 }
+
+//----------------------------------------------------------------------
+// FileHeader::OwnedSectors
+// 	Store in "sectors" every sector the file holds, besides its
+//	header: the data sectors it has (holes have none, and unwritten
+//	ones count), and its indirect tables, in any order.  Return how
+//	many there are, or -1 if the header, or one of its tables, is not
+//	valid: a sector number off the disk, or more sectors or extents
+//	than the format has room for.  A table is only read once its own
+//	sector has been found to be on the disk.  For checking the file
+//	system (see FileSystem::Check), so nothing is ASSERTed.
+//
+//	"sectors" has room for MaxOwnedSectors entries
+//----------------------------------------------------------------------
+
+int FileHeader::OwnedSectors(int *sectors)
+{
+    int count = 0;
+
+    if (numBytes < 0 || numSectors < 0)
+        return -1;
+    if (IsInline())
+        return (numBytes <= MaxInlineSize) ? 0 : -1;
+    if (IsExtentBased())
+    {
+        if (dataSectors[0] < 0 || dataSectors[0] > NumExtents)
+            return -1;
+        for (int i = 0; i < dataSectors[0]; i++)
+        {
+            if (Extent(i)[1] < 0)
+                return -1;
+            for (int j = 0; j < Extent(i)[1]; j++)
+            {
+                if (!AddOwned(sectors, &count, Extent(i)[0] + j))
+                    return -1;
+            }
+        }
+        return count;
+    }
+    if (IsCompressed())
+    {
+        if (numSectors > (int) MaxClusters
+            || (numSectors > NumDirect && SingleIndirectSector == -1))
+            return -1;
+        if (SingleIndirectSector != -1
+            && !AddOwned(sectors, &count, SingleIndirectSector))
+            return -1;
+        for (int i = 0; i < numSectors; i++)
+        {
+            int entry = *ClusterEntry(i);
+
+            if (ClusterCount(entry) < 0 || ClusterCount(entry) > ClusterSectors)
+                return -1;
+            for (int j = 0; j < ClusterCount(entry); j++)
+            {
+                if (!AddOwned(sectors, &count, ClusterStart(entry) + j))
+                    return -1;
+            }
+        }
+        return count;
+    }
+    if (DoubleIndirectSector < -1 || numSectors > (int) MaxFileSectors)
+        return -1; // not a format we know
+    for (int i = 0; i < numSectors && i < NumDirect; i++)
+    {
+        if (dataSectors[i] != HoleSector
+            && !AddOwned(sectors, &count, dataSectors[i] & ~UnwrittenFlag))
+            return -1;
+    }
+    if (SingleIndirectSector != -1)
+    {
+        if (!AddOwned(sectors, &count, SingleIndirectSector))
+            return -1;
+        SingleIndirectPointer *single = SingleTable();
+        if (single->numsSector < 0 || single->numsSector > NumIndirect)
+            return -1;
+        for (int i = 0; i < single->numsSector; i++)
+        {
+            if (single->dataSectors[i] != HoleSector
+                && !AddOwned(sectors, &count,
+                             single->dataSectors[i] & ~UnwrittenFlag))
+                return -1;
+        }
+    }
+    if (DoubleIndirectSector != -1)
+    {
+        if (!AddOwned(sectors, &count, DoubleIndirectSector))
+            return -1;
+        DoubleIndirectPointer *table = DoubleTable();
+        if (table->numsSector < 0 || table->numsSector > NumIndirect)
+            return -1;
+        for (int i = 0; i < table->numsSector; i++)
+        {
+            if (table->pointers[i] == HoleSector)
+                continue;
+            if (!AddOwned(sectors, &count, table->pointers[i]))
+                return -1;
+            SingleIndirectPointer *leaf = DoubleLeaf(i);
+            if (leaf->numsSector < 0 || leaf->numsSector > NumIndirect)
+                return -1;
+            for (int j = 0; j < leaf->numsSector; j++)
+            {
+                if (leaf->dataSectors[j] != HoleSector
+                    && !AddOwned(sectors, &count,
+                                 leaf->dataSectors[j] & ~UnwrittenFlag))
+                    return -1;
+            }
+        }
+    }
+    return count;
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Deallocate
 // 	De-allocate all the space allocated for data blocks for this file.
@@ -145,70 +1638,160 @@ bool FileHeader::AllocateDoubleIndirect(PersistentBitmap *freeMap)
 
 void FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
-    SingleIndirectPointer *single_temp = new SingleIndirectPointer;
-    DoubleIndirectPointer *double_temp = new DoubleIndirectPointer;
+    if (IsInline())
+    {
+        DoubleIndirectSector = -1; // no sectors to give back
+        return;
+    }
+    if (IsCompressed())
+    {
+        TruncateCompressed(freeMap, 0);
+        return;
+    }
+    if (IsExtentBased())
+    {
+        for (int i = 0; i < dataSectors[0]; i++)
+        {
+            for (int j = Extent(i)[0]; j < Extent(i)[0] + Extent(i)[1]; j++)
+            {
+                ASSERT(freeMap->Test(j)); // ought to be marked!
+                freeMap->Clear(j);
+            }
+        }
+        dataSectors[0] = 0;
+        return;
+    }
+    // holes, and tables that are not there, have nothing to give back
     for (int i = 0; i < numSectors && i < NumDirect; i++)
     {
-        ASSERT(freeMap->Test((int)dataSectors[i])); // ought to be marked!
-        freeMap->Clear((int)dataSectors[i]);
+        if (dataSectors[i] == HoleSector)
+            continue;
+        ASSERT(freeMap->Test(dataSectors[i] & ~UnwrittenFlag)); // ought to be marked!
+        freeMap->Clear(dataSectors[i] & ~UnwrittenFlag);
     }
     if (SingleIndirectSector != -1)
     {
-        kernel->synchDisk->ReadSector(SingleIndirectSector, (char *)single_temp);
+        SingleIndirectPointer *single_temp = SingleTable();
         for (int i = single_temp->numsSector - 1; i >= 0; i--)
         {
-            ASSERT(freeMap->Test((int)single_temp->dataSectors[i])); // ought to be marked!
-            freeMap->Clear((int)single_temp->dataSectors[i]);
+            if (single_temp->dataSectors[i] == HoleSector)
+                continue;
+            ASSERT(freeMap->Test(single_temp->dataSectors[i] & ~UnwrittenFlag)); // ought to be marked!
+            freeMap->Clear(single_temp->dataSectors[i] & ~UnwrittenFlag);
         }
         ASSERT(freeMap->Test((int)SingleIndirectSector)); // ought to be marked!
         freeMap->Clear((int)SingleIndirectSector);
-        SingleIndirectSector = -1;
     }
     if (DoubleIndirectSector != -1)
     {
-        kernel->synchDisk->ReadSector(DoubleIndirectSector, (char *)double_temp);
+        DoubleIndirectPointer *double_temp = DoubleTable();
         for (int i = double_temp->numsSector - 1; i >= 0; i--)
         {
-            single_temp = new SingleIndirectPointer;
-            kernel->synchDisk->ReadSector(double_temp->pointers[i], (char *)single_temp);
+            if (double_temp->pointers[i] == HoleSector)
+                continue;
+            SingleIndirectPointer *single_temp = DoubleLeaf(i);
             for (int j = single_temp->numsSector - 1; j >= 0; j--)
             {
-                ASSERT(freeMap->Test((int)single_temp->dataSectors[j])); // ought to be marked!
-                freeMap->Clear((int)single_temp->dataSectors[j]);
+                if (single_temp->dataSectors[j] == HoleSector)
+                    continue;
+                ASSERT(freeMap->Test(single_temp->dataSectors[j] & ~UnwrittenFlag)); // ought to be marked!
+                freeMap->Clear(single_temp->dataSectors[j] & ~UnwrittenFlag);
             }
             ASSERT(freeMap->Test((int)double_temp->pointers[i])); // ought to be marked!
             freeMap->Clear((int)double_temp->pointers[i]);
         }
         ASSERT(freeMap->Test((int)DoubleIndirectSector)); // ought to be marked!
         freeMap->Clear((int)DoubleIndirectSector);
-        DoubleIndirectSector = -1;
     }
-    // delete single_temp;
-    // delete double_temp;
+    DropTables();
+    SingleIndirectSector = -1;
+    DoubleIndirectSector = -1;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Relocate
+// 	Record that the data of the file has been moved to consecutive
+//	sectors from "start" on, in the order of the file: the first
+//	sector with data goes to "start", the next one to "start" + 1,
+//	and so on.  Holes stay holes, and unwritten sectors stay
+//	unwritten; the indirect tables stay where they are, and are
+//	written out with their new entries.  The header is only marked
+//	dirty.
+//
+//	The caller has copied the data, taken the new sectors from the
+//	free map, and gives the old ones back (see
+//	FileSystem::DefragmentFile).
+//
+//	"start" is the first of the file's new data sectors
+//----------------------------------------------------------------------
+
+void FileHeader::Relocate(int start)
+{
+    int next = start;
+
+    ASSERT(!IsInline() && !IsCompressed());
+    if (IsExtentBased())
+    {
+        dataSectors[0] = 1;
+        Extent(0)[0] = start;
+        Extent(0)[1] = numSectors;
+        dirty = TRUE;
+        return;
+    }
+    for (int i = 0; i < numSectors; i++)
+    {
+        int entry = FileSectorToSector(i);
+
+        if (entry != HoleSector)
+            *Entry(i) = next++ | (entry & UnwrittenFlag);
+    }
+    if (SingleIndirectSector != -1)
+        kernel->bufferCache->WriteSector(SingleIndirectSector, (char *)SingleTable());
+    for (int i = 0; i < NumIndirect; i++)
+    {
+        if (HasLeaf(i))
+            kernel->bufferCache->WriteSector(DoubleTable()->pointers[i], (char *)DoubleLeaf(i));
+    }
+    dirty = TRUE;
 }
 
 //----------------------------------------------------------------------
 // FileHeader::FetchFrom
-// 	Fetch contents of file header from disk.
+// 	Fetch contents of file header from disk.  Only the on-disk part
+//	of the object is overwritten; any cached indirect tables belong
+//	to the old contents and are dropped.
 //
 //	"sector" is the disk sector containing the file header
 //----------------------------------------------------------------------
 
 void FileHeader::FetchFrom(int sector)
 {
-    kernel->synchDisk->ReadSector(sector, (char *)this);
+    char buf[SectorSize];
+
+    DropTables();
+    dirty = FALSE;
+    kernel->bufferCache->ReadSector(sector, buf);
+    kernel->bufferCache->MarkMetadata(sector, 1);
+    bcopy(buf, (char *)this, SectorSize);
 }
 
 //----------------------------------------------------------------------
 // FileHeader::WriteBack
 // 	Write the modified contents of the file header back to disk.
+//	This is a transaction of its own, when it is not part of one
+//	(see journal.h): a header written back when its file is closed
+//	goes through the journal too.
 //
 //	"sector" is the disk sector to contain the file header
 //----------------------------------------------------------------------
 
 void FileHeader::WriteBack(int sector)
 {
-    kernel->synchDisk->WriteSector(sector, (char *)this);
+    kernel->bufferCache->BeginTransaction();
+    kernel->bufferCache->WriteSector(sector, (char *)this);
+    kernel->bufferCache->MarkMetadata(sector, 1);
+    kernel->bufferCache->EndTransaction(TRUE);
+    dirty = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -223,36 +1806,117 @@ void FileHeader::WriteBack(int sector)
 
 int FileHeader::ByteToSector(int offset)
 {
-    SingleIndirectPointer *single_temp = new SingleIndirectPointer;
-    DoubleIndirectPointer *double_temp = new DoubleIndirectPointer;
-    int offset_sector = offset / SectorSize;
-    if (offset_sector < NumDirect)
+    return FileSectorToSector(SectorOf(offset));
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ByteRangeToSectors
+// 	Translate a whole byte range of the file at once.  sectors[0]
+//	gets the disk sector holding byte "offset", sectors[1] the one
+//	holding the next SectorSize bytes of the file, and so on up to
+//	the sector holding the last byte of the range.
+//
+//	Since the indirect tables are cached, this touches the disk at
+//	most once per table, however long the range is.
+//
+//	"offset" is the location within the file of the first byte
+//	"numBytes" is the length of the range, at least 1
+//	"sectors" has room for one entry per file sector in the range
+//----------------------------------------------------------------------
+
+void FileHeader::ByteRangeToSectors(int offset, int numBytes, int *sectors)
+{
+    int first = SectorOf(offset);
+    int last = SectorOf(offset + numBytes - 1);
+
+    ASSERT(numBytes > 0);
+    for (int i = first; i <= last; i++)
+        sectors[i - first] = FileSectorToSector(i);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadInline / WriteInline
+// 	Copy "numBytes" bytes of an inline file, from "position" on, out
+//	of the header into "into", or from "from" into the header.  A
+//	write marks the header dirty; it is the header that has to be
+//	written back for the data to reach the disk.
+//----------------------------------------------------------------------
+
+void FileHeader::ReadInline(char *into, int numBytes, int position)
+{
+    ASSERT(IsInline() && position >= 0 && position + numBytes <= this->numBytes);
+    bcopy((char *)dataSectors + position, into, numBytes);
+}
+
+void FileHeader::WriteInline(char *from, int numBytes, int position)
+{
+    ASSERT(IsInline() && position >= 0 && position + numBytes <= this->numBytes);
+    bcopy(from, (char *)dataSectors + position, numBytes);
+    dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::RunLength
+// 	Return how many entries of "sectors", starting at "first", are
+//	consecutive disk sectors, so that they can be transferred with
+//	one disk request.  At most up to entry "count" - 1 is looked at.
+//	If entry "first" is a hole or unwritten, return how many such
+//	entries follow in a row instead: they need no disk request at all.
+//----------------------------------------------------------------------
+
+int FileHeader::RunLength(int *sectors, int first, int count)
+{
+    int run = 1;
+
+    if (IsUnwritten(sectors[first]))
     {
-        return (dataSectors[offset_sector]);
+        while ((first + run < count) && IsUnwritten(sectors[first + run]))
+            run++;
+        return run;
     }
-    else
+    while ((first + run < count) && (sectors[first + run] == sectors[first] + run))
+        run++;
+    return run;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::FileSectorToSector
+// 	Return the disk sector holding the "fileSector"-th sector of the
+//	file: one of the direct pointers, an entry of the single
+//	indirect table, or an entry of one of the tables hanging off
+//	the double indirect table.  In the extent format, we just walk
+//	down the list of extents.  Return HoleSector if it is a hole; an
+//	unwritten sector comes back with UnwrittenFlag set.
+//----------------------------------------------------------------------
+
+int FileHeader::FileSectorToSector(int fileSector)
+{
+    ASSERT((fileSector >= 0) && (fileSector < numSectors) && !IsCompressed());
+    if (IsExtentBased())
     {
-        if (offset_sector < NumIndirect + NumDirect)
-        {
-            kernel->synchDisk->ReadSector(SingleIndirectSector, (char *)single_temp);
-            return (single_temp->dataSectors[offset_sector - NumDirect]);
-        }
-        else
+        for (int i = 0; i < dataSectors[0]; i++)
         {
-            DEBUG(dbgFile, "Double indirect ByteToSector offset = "<<(offset)<<" \n\n")
-            
-            single_temp = new SingleIndirectPointer;
-            kernel->synchDisk->ReadSector(DoubleIndirectSector, (char *)double_temp);
-            DEBUG(dbgFile, "Double indirect ByteToSector table index = "<<(offset_sector - NumDirect - NumIndirect)<<" \n\n")
-
-            int index = double_temp->pointers[(offset_sector - NumDirect - NumIndirect) / NumIndirect];
-            DEBUG(dbgFile, "Double indirect ByteToSector index "<<(index)<<" \n\n")
-            
-            kernel->synchDisk->ReadSector(index, (char *)single_temp);
-            DEBUG(dbgFile, "Double indirect ByteToSector sector = "<<single_temp->dataSectors[((offset_sector - NumDirect - NumIndirect)%NumIndirect)]<<" \n\n")
-            return (single_temp->dataSectors[(offset_sector - NumDirect - NumIndirect) % NumIndirect]);
+            if (fileSector < Extent(i)[1])
+                return Extent(i)[0] + fileSector;
+            fileSector -= Extent(i)[1];
         }
+        ASSERTNOTREACHED();
+    }
+    if (fileSector < NumDirect)
+        return dataSectors[fileSector];
+    fileSector -= NumDirect;
+    if (fileSector < NumIndirect)
+    {
+        if (SingleIndirectSector == -1 || fileSector >= SingleTable()->numsSector)
+            return HoleSector;
+        return SingleTable()->dataSectors[fileSector];
     }
+    fileSector -= NumIndirect;
+    DEBUG(dbgFile, "Double indirect table " << fileSector / NumIndirect << " entry " << fileSector % NumIndirect);
+    if (!HasLeaf(fileSector / NumIndirect)
+            || fileSector % NumIndirect >= DoubleLeaf(fileSector / NumIndirect)->numsSector)
+        return HoleSector;
+    return DoubleLeaf(fileSector / NumIndirect)->dataSectors[fileSector % NumIndirect];
 }
 
 //----------------------------------------------------------------------
@@ -268,21 +1932,79 @@ int FileHeader::FileLength()
 //----------------------------------------------------------------------
 // FileHeader::Print
 // 	Print the contents of the file header, and the contents of all
-//	the data blocks pointed to by the file header.
+//	the data blocks pointed to by the file header.  A hole is shown
+//	as sector -1, an unwritten sector with a '*' after it; both are
+//	full of zeroes.  The clusters of a compressed file are shown as
+//	their first sector and how many they have, a cluster of zeroes as
+//	-1, and its contents are decompressed.
 //----------------------------------------------------------------------
 
 void FileHeader::Print()
 {
     int i, j, k;
-    char *data = new char[SectorSize];
+    char data[SectorSize];
+
+    if (IsInline())
+    {
+        printf("FileHeader contents.  File size: %d.  Inline, no blocks.\n", numBytes);
+        printf("File contents:\n");
+        for (j = 0; j < numBytes; j++)
+        {
+            char c = ((char *)dataSectors)[j];
+            if ('\040' <= c && c <= '\176') // isprint(c)
+                printf("%c", c);
+            else
+                printf("\\%x", (unsigned char)c);
+        }
+        printf("\n");
+        return;
+    }
+    if (IsCompressed())
+    {
+        Arena scratch;
+        char *cluster = (char *)scratch.Alloc(ClusterSize);
 
+        printf("FileHeader contents.  File size: %d.  Compressed clusters:\n", numBytes);
+        for (i = 0; i < numSectors; i++)
+        {
+            int entry = *ClusterEntry(i);
+            if (entry == 0)
+                printf("-1 ");
+            else
+                printf("%d+%d ", ClusterStart(entry), ClusterCount(entry));
+        }
+        printf("\nFile contents:\n");
+        for (i = k = 0; i < numSectors; i++)
+        {
+            ReadCluster(i, cluster);
+            for (j = 0; (j < ClusterSize) && (k < numBytes); j++, k++)
+            {
+                if ('\040' <= cluster[j] && cluster[j] <= '\176') // isprint
+                    printf("%c", cluster[j]);
+                else
+                    printf("\\%x", (unsigned char)cluster[j]);
+                if ((j + 1) % SectorSize == 0 || k + 1 == numBytes)
+                    printf("\n");
+            }
+        }
+        return;
+    }
     printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
     for (i = 0; i < numSectors; i++)
-        printf("%d ", dataSectors[i]);
+    {
+        int sector = FileSectorToSector(i);
+        if (sector != HoleSector && (sector & UnwrittenFlag))
+            printf("%d* ", sector & ~UnwrittenFlag);
+        else
+            printf("%d ", sector);
+    }
     printf("\nFile contents:\n");
     for (i = k = 0; i < numSectors; i++)
     {
-        kernel->synchDisk->ReadSector(dataSectors[i], data);
+        if (IsUnwritten(FileSectorToSector(i)))
+            bzero(data, SectorSize);
+        else
+            kernel->bufferCache->ReadSector(FileSectorToSector(i), data);
         for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++)
         {
             if ('\040' <= data[j] && data[j] <= '\176') // isprint(data[j])
@@ -292,5 +2014,4 @@ void FileHeader::Print()
         }
         printf("\n");
     }
-    delete[] data;
 }
@@ -16,10 +16,66 @@
 
 #include "disk.h"
 #include "pbitmap.h"
+#include "slab.h"
 
-#define NumDirect ((SectorSize - 4 * sizeof(int)) / sizeof(int))
-#define NumIndirect ((SectorSize - 1 * sizeof(int)) / sizeof(int))
+// The counts are ints, as the sector counts they are compared with are.
+#define NumDirect ((int) ((SectorSize - 4 * sizeof(int)) / sizeof(int)))
+#define NumIndirect ((int) ((SectorSize - 1 * sizeof(int)) / sizeof(int)))
 #define MaxFileSize (NumDirect * SectorSize)
+#define MaxFileSectors (NumDirect + NumIndirect + NumIndirect * NumIndirect)
+
+// In the extent format, dataSectors[0] holds the number of extents and
+// the rest of dataSectors[] holds (start sector, length) pairs.  The
+// format is marked by storing ExtentFormat, which is never a sector
+// number nor -1, in DoubleIndirectSector.
+#define ExtentFormat (-2)
+#define NumExtents ((NumDirect - 1) / 2)
+
+// A small file can keep its data in the header itself, in place of
+// dataSectors[]: it has no data sectors at all, so reading it takes
+// only the read of its header.  The format is marked by storing
+// InlineFormat in DoubleIndirectSector.
+#define InlineFormat (-3)
+#define MaxInlineSize ((int) (NumDirect * sizeof(int)))
+
+// In the pointer format, a sector of the file that was never written
+// may have no data sector at all (a "hole"): it reads as zeroes, and
+// gets a sector the first time it is written.  Its entry holds
+// HoleSector, or lies past the end of its indirect table; a table
+// with nothing but holes in it need not exist (its sector is -1).
+#define HoleSector (-1)
+
+// A sector can also be given to a file before anything is written to
+// it (see Preallocate).  Its entry then has UnwrittenFlag set, and it
+// reads as zeroes, as a hole does, until it is first written.
+
+// A data sector of a pointer-format file may be shared with other
+// files (see Clone and ShareSector; the free map counts how many use
+// it).  It is copied on write: FillHoles gives the file a sector of
+// its own in its place, before the file's write goes to it.
+#define UnwrittenFlag (1 << 30)
+
+// A file can also be kept compressed.  Its data is cut into clusters
+// of ClusterSize bytes, and each cluster is compressed on its own (see
+// lzcodec.h) into as few whole sectors as it takes, consecutive on
+// disk.  In place of sector numbers, dataSectors[], and past them the
+// single indirect table, hold one entry per cluster: its first sector,
+// with the number of sectors shifted up by ClusterCountShift.  An
+// entry of 0 is a cluster of nothing but zeroes, which has no sectors;
+// one with ClusterSectors sectors is a cluster that did not compress,
+// stored as it is.  The format is marked by storing CompressedFormat
+// in DoubleIndirectSector, and numSectors is the number of clusters.
+#define CompressedFormat (-4)
+#define ClusterSectors 32
+#define ClusterSize (ClusterSectors * SectorSize)
+#define MaxClusters (NumDirect + NumIndirect)
+#define ClusterCountShift 24
+
+// The most sectors, besides its header, that a valid header of any
+// format can say its file holds (see OwnedSectors): an extent file may
+// cover the disk, and a pointer-format one may share a sector with
+// itself.
+#define MaxOwnedSectors (NumSectors + MaxFileSectors + NumIndirect + 2)
 
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
@@ -32,36 +88,195 @@
 // as one disk sector.  Without indirect addressing, this
 // limits the maximum file length to just under 4K bytes.
 //
-// There is no constructor; rather the file header can be initialized
-// by allocating blocks for the file (if it is a new file), or by
-// reading it from disk.
+// The constructor does not initialize the header; rather the file header
+// can be initialized by allocating blocks for the file (if it is a new
+// file), or by reading it from disk.
+//
+// A header is in one of two formats, chosen when the file is created:
+// the pointer format above, or the extent format, where the file is
+// described by up to NumExtents runs of consecutive sectors.  Files
+// of both formats can live on the same disk.
+//
+// A file asked to be compressed is in a fourth format, described
+// above.  It is read and written a cluster at a time, through a buffer
+// of the clusters in use, decompressed (see clusterbuf.h); the header
+// only keeps track of where the compressed clusters are.
+//
+// A file created with no more than MaxInlineSize bytes (and not asking
+// for extents) starts out in a third format, with its data inline; when
+// it grows past that, the data moves to a sector of its own and the
+// header is turned into the pointer format.
+//
+// Only the first SectorSize bytes of the object are stored on disk.
+// Behind them we keep in-memory copies of the indirect tables, which are
+// read in the first time they are needed and kept until the header is
+// deleted (for an OpenFile, until the file is closed) or re-fetched.
+//
+// A file grows when it is written past its end (see Extend).  The new
+// sectors are recorded in the header in memory, which is marked dirty;
+// it is written back when the last OpenFile on the file is closed.
+//
+// On a disk made for holes, a pointer-format file gets its sectors as
+// it is written, not when it is created or extended (see
+// AllocateSparse, ExtendSparse and FillHoles): creating a large file,
+// or seeking far past the end of one, takes no space until the data
+// is there.  A file can also be given its sectors ahead of time
+// (Preallocate), and shrink (Truncate).
+
+class SingleIndirectPointer;
+class DoubleIndirectPointer;
 
 class FileHeader
 {
 public:
+  FileHeader();  // No indirect tables cached yet
+  ~FileHeader(); // De-allocate the cached tables
+
   bool Allocate(PersistentBitmap *bitMap, int fileSize); // Initialize a file header,
                                                          //  including allocating space
                                                          //  on disk for the file data
 
+  bool AllocateExtents(PersistentBitmap *bitMap, int fileSize);
+                                // Same, but try to describe the file
+                                //  by a few runs of sectors; falls
+                                //  back to Allocate if free space is
+                                //  too fragmented
+
+  void AllocateInline(int fileSize);
+                                // Same, but keep the data in the
+                                //  header; "fileSize" is at most
+                                //  MaxInlineSize
+
+  bool AllocateSparse(int fileSize);
+                                // Same, but the whole file is a
+                                //  hole; FALSE if it is too big
+
+  bool AllocateCompressed(PersistentBitmap *freeMap, int fileSize);
+                                // Same, but keep the file compressed;
+                                //  every cluster starts out as zeroes,
+                                //  with no sectors
+
   bool AllocateSingleIndirect(PersistentBitmap *freeMap);
   bool AllocateDoubleIndirect(PersistentBitmap *freeMap);
   void Deallocate(PersistentBitmap *bitMap); // De-allocate this file's
                                              //  data blocks
+  bool Extend(PersistentBitmap *freeMap, int newSize);
+                                // Make the file longer, allocating
+                                //  data sectors and tables as needed
+  bool ExtendSparse(PersistentBitmap *freeMap, int newSize, int position);
+                                // Same, but only the sectors from byte
+                                //  "position" on get allocated; the
+                                //  ones before are left as holes
+  bool FillHoles(PersistentBitmap *freeMap, int offset, int numBytes);
+                                // Get a byte range of the file ready
+                                //  to be written: allocate its holes,
+                                //  and clear UnwrittenFlag; FALSE,
+                                //  taking nothing, if there is not
+                                //  enough free space
+  bool Preallocate(PersistentBitmap *freeMap, int offset, int numBytes);
+                                // Allocate the holes of a byte range
+                                //  as unwritten sectors; FALSE in the
+                                //  same way
+  bool HasUnwritten(int offset, int numBytes);
+                                // Is any sector of the range a hole
+                                //  or unwritten?
+  bool HasShared(PersistentBitmap *freeMap, int offset, int numBytes);
+                                // or shared with another file?
+  bool Clone(PersistentBitmap *freeMap, FileHeader *from);
+                                // Initialize a file header for a copy
+                                //  of the file "from" describes, that
+                                //  shares its data sectors; FALSE,
+                                //  taking nothing, if there is no room
+                                //  for the indirect tables, or a
+                                //  sector has MaxShares sharers
+  void ShareSector(PersistentBitmap *freeMap, int fileSector, int sector);
+                                // Give back the "fileSector"-th sector
+                                //  of the file, and share "sector",
+                                //  which holds the same bytes, instead
+  void Truncate(PersistentBitmap *freeMap, int newSize);
+                                // Make the file shorter, giving back
+                                //  the sectors and tables past its
+                                //  new end
+  void Relocate(int start);     // The data has been moved to a run
+                                //  of sectors from "start" on
+
+  void ReadCluster(int which, char *into);
+                                // Decompress the "which"-th cluster
+                                //  of a compressed file into the
+                                //  ClusterSize bytes at "into"
+  bool StoreCluster(PersistentBitmap *freeMap, int which, char *packed,
+                    int count);
+                                // Write out a cluster, compressed
+                                //  into "count" sectors, moving it if
+                                //  it needs more than it has; FALSE if
+                                //  there is no run of free sectors
+                                //  that long
+  int CompressedSectors(int *sectors);
+                                // Store in "sectors" the data sectors
+                                //  of a compressed file, and return
+                                //  how many there are
+  int OwnedSectors(int *sectors);
+                                // Store in "sectors" every sector the
+                                //  file holds, tables too, and return
+                                //  how many; -1 if the header is not
+                                //  valid (for checking the disk)
 
   void FetchFrom(int sectorNumber); // Initialize file header from disk
   void WriteBack(int sectorNumber); // Write modifications to file header
                                     //  back to disk
+  bool IsDirty() { return dirty; }  // Changed since read or written?
+  unsigned int Writes() { return writes; } // How many times the data
+  void NoteWrite() { writes++; }    //  was written, since read in
 
   int ByteToSector(int offset); // Convert a byte offset into the file
                                 // to the disk sector containing
                                 // the byte
+
+  void ByteRangeToSectors(int offset, int numBytes, int *sectors);
+                                // Store in "sectors" the disk sector
+                                // of every file sector overlapping
+                                // the byte range (see IsUnwritten
+                                // for the ones with no data yet)
+
+  static int RunLength(int *sectors, int first, int count);
+                                // How many entries of "sectors" from
+                                // "first" on are consecutive sectors
+  static bool IsUnwritten(int sector)
+                { return sector == HoleSector || (sector & UnwrittenFlag) != 0; }
+                                // Does an entry of "sectors" read as
+                                // zeroes without a disk read?
   
+  static int ClusterStart(int entry)
+                { return entry & ((1 << ClusterCountShift) - 1); }
+  static int ClusterCount(int entry) { return entry >> ClusterCountShift; }
+                                // Where a cluster map entry starts,
+                                // and how many sectors it has
+
   int FileLength();             // Return the length of the file
                                 // in bytes
 
+  bool IsExtentBased() { return DoubleIndirectSector == ExtentFormat; }
+  bool IsInline() { return DoubleIndirectSector == InlineFormat; }
+  bool IsCompressed() { return DoubleIndirectSector == CompressedFormat; }
+  bool HasIndirectTables()
+                { return SingleIndirectSector >= 0 || DoubleIndirectSector >= 0; }
+                                // Must tables be read to find the
+                                // file's sectors?
+
+  void ReadInline(char *into, int numBytes, int position);
+  void WriteInline(char *from, int numBytes, int position);
+                                // Copy data of an inline file out of
+                                //  or into the header, which is then
+                                //  dirty; the bytes must lie within
+                                //  the file's length
+
   void Print(); // Print the contents of the file.
 
+  void *operator new(size_t size); // From the slab of file headers
+  void operator delete(void *p, size_t size);
+
 private:
+  static thread_local Slab slab; // where FileHeaders come from
   int numBytes;               // Number of bytes in the file
   int numSectors;             // Number of data sectors in the file
   int dataSectors[NumDirect]; // Disk sector numbers for each data
@@ -74,6 +289,52 @@ private:
   int DoubleIndirectSector;   // to support 32KB , we need more indirect pointer
                               // this attemp will support
                               // 128 *(28+31+31*31) Bytes (about 130KB)
+
+  // The rest is not stored on disk.
+  SingleIndirectPointer *singleTable;  // cached single indirect table,
+                                       //  NULL if not read in yet
+  DoubleIndirectPointer *doubleTable;  // cached double indirect table
+  SingleIndirectPointer **doubleLeaves; // cached tables it points to,
+                                       //  NumIndirect entries, each NULL
+                                       //  until read in
+  bool dirty;                          // extended, but not written back
+  unsigned int writes;                 // writes and truncates of the
+                                       //  data, for the page cache
+
+  SingleIndirectPointer *SingleTable(); // Read in the tables on demand
+  DoubleIndirectPointer *DoubleTable();
+  SingleIndirectPointer *DoubleLeaf(int which);
+  void DropTables();                    // Forget the cached tables
+  int FileSectorToSector(int fileSector); // Map the n-th sector of the
+                                        //  file to a disk sector
+  int *Extent(int which) { return &dataSectors[1 + 2 * which]; }
+                                        // (start, length) of an extent
+  void AppendSector(int *sectors, int *next);
+                                        // Add a data sector at the end,
+                                        //  and any table it needs
+  void FillSector(int fileSector, int *sectors, int *next);
+                                        // Same, for a hole anywhere
+  int *Entry(int fileSector);           // Where in the header or a
+                                        //  table a sector is recorded
+  bool FillRange(PersistentBitmap *freeMap, int offset, int numBytes,
+                 bool preallocate);     // FillHoles or Preallocate
+  void TruncateExtents(PersistentBitmap *freeMap, int newNumSectors);
+  void TruncateTables(PersistentBitmap *freeMap, int newNumSectors);
+                                        // Truncate, for extents and
+                                        //  for the indirect tables
+  bool HasLeaf(int which);              // Is that double indirect
+                                        //  table there?
+  bool ExtendExtents(PersistentBitmap *freeMap, int newSize);
+                                        // Extend, in the extent format
+  bool ExtendInline(PersistentBitmap *freeMap, int newSize);
+                                        // and for an inline file
+  bool ExtendCompressed(PersistentBitmap *freeMap, int newSize);
+  void TruncateCompressed(PersistentBitmap *freeMap, int newNumClusters);
+                                        // and for a compressed file
+  int *ClusterEntry(int which);         // Where a cluster is recorded
+  void FreeCluster(PersistentBitmap *freeMap, int entry, int from);
+                                        // Give back the sectors of a
+                                        //  cluster from the "from"-th on
 };
 
 class SingleIndirectPointer
@@ -14,9 +14,9 @@
 //	   A directory of file names and file headers
 //
 //      Both the bitmap and the directory are represented as normal
-//	files.  Their file headers are located in specific sectors
-//	(sector 0 and sector 1), so that the file system can find them
-//	on bootup.
+//	files.  The superblock, in sector 0, says where their file
+//	headers are, so that the file system can find them on bootup
+//	(see superblock.h).
 //
 //	The file system assumes that the bitmap and directory files are
 //	kept "open" continuously while Nachos is running.
@@ -30,14 +30,16 @@
 //
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
+//	   lookups may go on concurrently, but anything that changes a
+//	     directory waits for them and holds up the others
 //	   files have a fixed size, set when the file is created
 //	   files cannot be bigger than about 3KB in size
 //	   there is no hierarchical directory structure, and only a limited
 //	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//	   only the metadata is journaled: an operation that changes
+//	    headers, directories and the free map is done completely or
+//	    not at all, even if Nachos exits in the middle of it (see
+//	    journal.h), but the data in files is not
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -50,6 +52,21 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "fscheck.h"
+#include "main.h"
+#include "inodetable.h"
+#include "synch.h"
+#include "arena.h"
+#include "superblock.h"
+#include "bufcache.h"
+#include "journal.h"
+#include "mounttable.h"
+#include "sectorsum.h"
+#include "seglog.h"
+#include "list.h"
+#include "heap.h"
+#include "hash.h"
+#include "kernelprofile.h"
 
 #ifdef FILESYS_STUB
 
@@ -72,7 +89,7 @@ FileSystem::FileSystem(bool format)
     if (format)
     {
         PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
-        Directory *directory = new Directory(NumDirEntries);
+        Directory *directory = new Directory(DirectoryFileSize);
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
@@ -137,27 +154,66 @@ FileSystem::FileSystem(bool format)
 #else
 
 // Sectors containing the file headers for the bitmap of free sectors,
-// and the directory of files.  These file headers are placed in well-known
-// sectors, so that they can be located on boot-up.
-#define FreeMapSector 0
-#define DirectorySector 1
+// and the root directory, on a disk formatted by us: they come after
+// the superblock, which says where they are.  On a disk formatted
+// before there were superblocks, they are in the first two sectors.
+#define FreeMapSector 1
+#define DirectorySector 2
+#define OldFreeMapSector 0
+#define OldDirectorySector 1
 
 // Initial file sizes for the bitmap and directory; until the file system
 // supports extensible files, the directory size sets the maximum number
 // of files that can be loaded onto the disk.
 #define FreeMapFileSize (NumSectors / BitsInByte)
-#define NumDirEntries 64
-#define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
+#define DirectoryFileSize (10 * SectorSize) // about 100 names of 4
+                                            // characters; it grows
+#define ShareMapFileSize NumSectors         // a count for every sector
+
+// How many bytes an in-kernel copy moves at a time (see CopyBytes):
+// enough sectors for the buffer cache and the write buffer to move
+// them in runs
+#define CopyChunkSize (32 * SectorSize)
+
+// How many free sectors a new directory wants in its parent's
+// allocation group, to go in it: its header and entries, and as much
+// again for its files
+#define NewDirectoryRoom (2 * (1 + divRoundUp(DirectoryFileSize, SectorSize)))
+
+// With -eh, how many sectors right after the entries of a directory
+// that has not grown the headers of the files created in it may take
+// (see PlaceHeader)
+#define HeaderWindow 8
+
+// With -tp, how many of the directories in a directory a walk down
+// the tree starts reading at once, as it goes into the directory, and
+// how many sectors from each one's header (see PrefetchSubdirectories)
+#define TreePrefetch 8
+#define TreePrefetchRun 4
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
 // 	Initialize the file system.  If format = TRUE, the disk has
 //	nothing on it, and we need to initialize the disk to contain
-//	an empty directory, and a bitmap of free sectors (with almost but
-//	not all of the sectors marked as free).
+//	a superblock, an empty directory, and a bitmap of free sectors
+//	(with almost but not all of the sectors marked as free).  The
+//	disk is discarded first, so that only the sectors with something
+//	on them need be written: a few headers, the first sector of the
+//	bitmap and of the journal, and the superblock.  With -lfs, the
+//	disk is laid out as a log before anything is written, and the
+//	sectors past the log's LogicalSectors are marked in use.
+//
+//	If format = FALSE, we read the superblock to find the files
+//	representing the bitmap and the directory, and open them (see
+//	Mount).
 //
-//	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	With -ro (and not formatting), the disk is mounted read-only:
+//	nothing on it is ever written, there is no reclaimer, and every
+//	call that would change the disk fails (see IsReadOnly).
+//
+//	The disk is that of the file system the running thread is in:
+//	the kernel's own, or one being mounted on a directory (see
+//	MountTable::Mount).
 //
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
@@ -165,19 +221,53 @@ FileSystem::FileSystem(bool format)
 FileSystem::FileSystem(bool format)
 {
     DEBUG(dbgFile, "Initializing the file system.");
+    mount = kernel->currentThread->mount;
+    readOnly = kernel->readOnlyMount && !format;
+    pinned = NULL;
+    pinnedDirs = NULL;
+    if (readOnly)
+    {
+        pinned = new OpenFile *[NumSectors];
+        pinnedDirs = new Directory *[NumSectors];
+        for (int i = 0; i < NumSectors; i++)
+        {
+            pinned[i] = NULL;
+            pinnedDirs[i] = NULL;
+        }
+    }
     if (format)
     {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
-        Directory *directory = new Directory(NumDirEntries);
+        Directory *directory = new Directory(DirectoryFileSize);
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
+        freeMap = new PersistentBitmap(NumSectors);
+        superBlock = new SuperBlock;
+        orphans = NULL; // made when it is first needed
+        shareMapFile = NULL; // and so is the share map
+        sums = NULL;
+        freeMapSector = FreeMapSector;
+        rootSector = DirectorySector;
+
         DEBUG(dbgFile, "Formatting the file system.");
 
-        // First, allocate space for FileHeaders for the directory and bitmap
-        // (make sure no one else grabs these!)
-        freeMap->Mark(FreeMapSector);
-        freeMap->Mark(DirectorySector);
+        // Nothing on the disk is wanted any more: discard it all, so
+        // that every sector reads as zeroes, and only what is not
+        // zero need be written
+        kernel->bufferCache->Discard();
+        if (kernel->logStructured)
+        {
+            // from now on, every sector is written to the log
+            SegmentLog *log = new SegmentLog(kernel->synchDisk);
+            log->Format();
+            kernel->synchDisk->SetLog(log);
+        }
+
+        // First, allocate space for the superblock, and FileHeaders for
+        // the directory and bitmap (make sure no one else grabs these!)
+        freeMap->Mark(SuperBlockSector);
+        freeMap->Mark(freeMapSector);
+        freeMap->Mark(rootSector);
 
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
@@ -191,20 +281,15 @@ FileSystem::FileSystem(bool format)
         // on it!).
 
         DEBUG(dbgFile, "Writing headers back to disk.");
-        mapHdr->WriteBack(FreeMapSector);
-        dirHdr->WriteBack(DirectorySector);
+        mapHdr->WriteBack(freeMapSector);
+        dirHdr->WriteBack(rootSector);
 
         // OK to open the bitmap and directory files now
         // The file system operations assume these two files are left open
         // while Nachos is running.
 
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
-
-        // pwd implement
-        currentDirectoryFile = new OpenFile(DirectorySector); // root dir
-        currentDirectory = new Directory(NumDirEntries);
-        currentDirectory->FetchFrom(currentDirectoryFile);
+        freeMapFile = new OpenFile(freeMapSector);
+        directoryFile = new OpenFile(rootSector);
 
         // Once we have the files "open", we can write the initial version
         // of each file back to disk.  The directory at this point is completely
@@ -212,61 +297,532 @@ FileSystem::FileSystem(bool format)
         // sectors on the disk have been allocated for the file headers and
         // to hold the file data for the directory and bitmap.
 
+        // The journal gets a track of its own, the first whole one
+        // free (everything so far was taken from the start of the
+        // disk), so that a commit never has to seek
+        int journalSectors;
+        freeMap->SetGoal(divRoundUp(NumSectors - freeMap->NumClear(),
+                                    SectorsPerTrack) * SectorsPerTrack);
+        int journalStart = freeMap->FindAndSetRange(JournalSectors, &journalSectors);
+        ASSERT(journalStart >= 0 && journalSectors == JournalSectors);
+        if (kernel->synchDisk->Log() != NULL) // there are only so many
+        {
+            for (int i = LogicalSectors; i < NumSectors; i++)
+                freeMap->Mark(i);
+        }
+
         DEBUG(dbgFile, "Writing bitmap and directory back to disk.");
+        freeMap->SetClearOnDisk();
         freeMap->WriteBack(freeMapFile); // flush changes to disk
         directory->WriteBack(directoryFile);
 
+        journal = new Journal(journalStart, journalSectors);
+        journal->Format(TRUE);
+        kernel->bufferCache->SetJournal(journal);
+
+        // Last, the superblock: the file system is mounted from now
+        // on, so it is not clean
+        superBlock->freeMapSector = freeMapSector;
+        superBlock->rootSector = rootSector;
+        superBlock->journalStart = journalStart;
+        superBlock->journalSectors = journalSectors;
+        superBlock->Summarize(freeMap);
+        superBlock->WriteBack(SuperBlockSector);
+
         if (debug->IsEnabled('f'))
         {
             freeMap->Print();
             directory->Print();
         }
-        delete freeMap;
+        delete directory;
         delete mapHdr;
         delete dirHdr;
     }
     else
     {
-        // if we are not formatting the disk, just open the files representing
-        // the bitmap and directory; these are left open while Nachos is running
-        freeMapFile = new OpenFile(FreeMapSector);
-        directoryFile = new OpenFile(DirectorySector);
+        Mount();
+    }
 
-        // pwd implement
-        currentDirectoryFile = new OpenFile(DirectorySector); // root dir
-        currentDirectory = new Directory(NumDirEntries);
-        currentDirectory->FetchFrom(currentDirectoryFile);
+    kernelFiles = new FileDescriptorTable;
+    kernelCwd = new WorkingDirectory;
+
+    // pwd implement
+    dentries = new DentryCache;
+    namespaceLock = new RWLock("namespace lock");
+    freeMapLock = new RWLock("free map lock");
+    orphansQueued = new Semaphore("orphans queued", 0);
+    unmounting = FALSE;
+    reclaimerDone = new Semaphore("reclaimer done", 0);
+    defragmenting = FALSE;
+    defragmenterDone = new Semaphore("defragmenter done", 0);
+    if (superBlock != NULL && sums == NULL && kernel->sectorChecksums
+            && !readOnly && !MakeChecksums())
+        cerr << "No room on the disk for the sector checksums\n";
+    if (superBlock != NULL && !readOnly)
+    {
+        Thread *t = new Thread("reclaimer", 1);
+        t->ioClass = IoIdle;
+        t->Fork((VoidFunctionPtr)FileSystem::Reclaimer, (void *)this);
+        if (orphans != NULL && orphans->numOrphans > 0)
+            orphansQueued->V(); // left over from before we mounted
     }
+    currentDirectoryFile = NULL;
+    currentDirectorySector = -1;
+    currentDirectory = NULL;
+    resetRootDir();
     DEBUG(dbgFile, "Finish initializing the file system.");
 }
 
-// destructor of filesystem class
+//----------------------------------------------------------------------
+// FileSystem::Mount
+// 	Open the files representing the bitmap and the directory, where
+//	the superblock says they are; these are left open while Nachos
+//	is running.
+//
+//	If the disk was cleanly unmounted, the superblock's summary of
+//	the bitmap is used, rather than counting its free sectors.  The
+//	journal is replayed first (after a clean unmount it is empty, but
+//	it still says which record comes next).  Then the superblock is
+//	marked not clean, until we unmount.
+//
+//	The share map is read in along with the free map, if there is
+//	one (see PersistentBitmap::Share), and so are the checksums of
+//	the sectors after it, if it has them (see sectorsum.h).
+//
+//	The orphan table is read in, if the disk has one: files removed
+//	whose sectors had not been given back when Nachos last stopped
+//	are reclaimed once the reclaimer starts (see FileSystem).
+//
+//	A disk with no superblock is mounted the old way: the files are
+//	in the first two sectors, and the bitmap is counted.
+//
+//	A disk formatted as a log (-f -lfs) has its log attached first,
+//	so that everything after is read from where the log put it (see
+//	seglog.h).
+//
+//	Mounted read-only, the disk must have been cleanly unmounted,
+//	since recovering it means writing to it; the journal is left
+//	alone (it is empty), and the superblock stays as it is.
+//----------------------------------------------------------------------
+
+void FileSystem::Mount()
+{
+    journal = NULL;
+    orphans = NULL;
+    shareMapFile = NULL;
+    sums = NULL;
+    if (SegmentLog::IsOnDisk(kernel->synchDisk))
+    {
+        // before anything but the superblock is read
+        SegmentLog *log = new SegmentLog(kernel->synchDisk);
+        log->Mount();
+        kernel->synchDisk->SetLog(log);
+    }
+    superBlock = new SuperBlock;
+    if (!superBlock->FetchFrom(SuperBlockSector))
+    {
+        DEBUG(dbgFile, "No superblock, mounting an old file system.");
+        delete superBlock;
+        superBlock = NULL;
+        freeMapSector = OldFreeMapSector;
+        rootSector = OldDirectorySector;
+        freeMapFile = new OpenFile(freeMapSector);
+        directoryFile = new OpenFile(rootSector);
+        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+        return;
+    }
+    if (!superBlock->IsCompatible())
+    {
+        cerr << "The file system on this disk was made by a different "
+                "kernel; format it with -f\n";
+        superBlock->Print();
+        Abort();
+    }
+    if (readOnly && !superBlock->clean)
+    {
+        cerr << "The file system on this disk was not cleanly unmounted; "
+                "mount it without -ro first, to recover it\n";
+        Abort();
+    }
+    freeMapSector = superBlock->freeMapSector;
+    rootSector = superBlock->rootSector;
+    if (superBlock->journalSectors > 0 && !readOnly)
+    {
+        // replay the journal before anything reads what it changes
+        journal = new Journal(superBlock->journalStart,
+                              superBlock->journalSectors);
+        journal->Recover();
+        kernel->bufferCache->SetJournal(journal);
+        superBlock->FetchFrom(SuperBlockSector); // which may be one of them
+    }
+    freeMapFile = new OpenFile(freeMapSector);
+    directoryFile = new OpenFile(rootSector);
+    freeMap = new PersistentBitmap(NumSectors);
+    if (superBlock->clean)
+    {
+        freeMap->FetchFrom(freeMapFile, superBlock->freeSectors,
+                           superBlock->FirstFreeGroup());
+    }
+    else
+    {
+        DEBUG(dbgFile, "File system was not cleanly unmounted, counting free sectors.");
+        freeMap->FetchFrom(freeMapFile);
+        superBlock->Summarize(freeMap);
+    }
+    if (superBlock->shareMapSector >= 0)
+    {
+        shareMapFile = new OpenFile(superBlock->shareMapSector);
+        freeMap->FetchShares(shareMapFile);
+        if (shareMapFile->Length() >= SumMapOffset + SumMapSize)
+            StartChecksums(superBlock->clean);
+    }
+    DEBUG(dbgFile, "Mounted: " << freeMap->NumClear() << " sectors free, "
+          << freeMap->NumShared() << " shared.");
+    if (superBlock->orphanSector >= 0)
+    {
+        orphans = new OrphanTable;
+        kernel->bufferCache->ReadSector(superBlock->orphanSector,
+                                        (char *)orphans);
+        DEBUG(dbgFile, orphans->numOrphans << " removed files to reclaim.");
+    }
+    if (readOnly)
+        return; // it stays clean
+
+    // make sure the disk says we are mounted, before anything changes;
+    // from now on it may have headers in the newest format
+    superBlock->clean = FALSE;
+    superBlock->version = SuperBlockVersion;
+    superBlock->headerFormat = HeaderFormat;
+    superBlock->WriteBack(SuperBlockSector);
+    kernel->bufferCache->Flush();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::~FileSystem
+// 	Unmount the file system: close its files, write back the bitmap,
+//	and then the superblock with a summary of the bitmap.  It is
+//	marked clean only once every file is closed, and so every file
+//	header and sector written is in the buffer cache, to be flushed
+//	before it.  The journal is checkpointed, so that it is empty.
+//	The checksums of the sectors, if there are any, are written back
+//	last but for the superblock, once everything else is on disk.
+//
+//	First the defragmenter, if it is running, is let finish, and the
+//	reclaimer is stopped, once it has reclaimed the removed files it
+//	has not got round to, except those still open.
+//
+//	Mounted read-only, nothing is written: the pinned directories and
+//	headers are just let go.
+//----------------------------------------------------------------------
+
 FileSystem::~FileSystem()
 {
+    WaitForDefragmenter();
+    if (superBlock != NULL && !readOnly)
+    {
+        unmounting = TRUE;
+        orphansQueued->V();
+        reclaimerDone->P();
+    }
+    delete orphansQueued;
+    delete reclaimerDone;
+    delete defragmenterDone;
+    delete kernelFiles;
+    delete kernelCwd;
+    delete dentries;
+    delete namespaceLock;
+    delete freeMapLock;
+    if (readOnly)
+    {
+        for (int i = 0; i < NumSectors; i++)
+        {
+            if (pinnedDirs[i] != NULL)
+                delete pinnedDirs[i];
+            if (pinned[i] != NULL)
+                delete pinned[i];
+        }
+        delete[] pinnedDirs;
+        delete[] pinned;
+    }
     if (currentDirectoryFile != NULL)
         delete currentDirectoryFile;
     if (currentDirectory != NULL)
         delete currentDirectory;
-    delete freeMapFile;
     delete directoryFile;
+    if (!readOnly)
+    {
+        kernel->bufferCache->BeginTransaction();
+        freeMap->WriteBack(freeMapFile); // normally a no-op, see Create
+        kernel->bufferCache->EndTransaction(TRUE);
+    }
+    delete freeMapFile;
+    if (journal != NULL)
+    {
+        // headers still in use are written back later, without it
+        journal->Checkpoint();
+        kernel->bufferCache->SetJournal(NULL);
+        delete journal;
+    }
+    if (sums != NULL)
+    {
+        kernel->bufferCache->Flush(); // so every checksum is taken
+        if (!readOnly)
+            sums->WriteBack(shareMapFile);
+        kernel->bufferCache->SetChecksums(NULL);
+        delete sums;
+    }
+    if (shareMapFile != NULL)
+        delete shareMapFile;
+    if (superBlock != NULL && !readOnly)
+    {
+        superBlock->Summarize(freeMap);
+        superBlock->clean = kernel->inodeTable->IsEmpty();
+        kernel->bufferCache->Flush();
+        superBlock->WriteBack(SuperBlockSector);
+    }
+    if (superBlock != NULL)
+        delete superBlock;
+    delete freeMap;
+    if (orphans != NULL)
+        delete orphans;
 }
 
-// split the path name
-int FileSystem::splitPath(char **arr, char *path)
+// split the path name, into at most MaxPathDepth components; they
+// point into a copy of it in the caller's scratch arena, so they last
+// as long as the operation does
+int FileSystem::splitPath(char **arr, char *path, Arena *scratch)
 {
-    char *tmp_path = (char *)calloc(30, sizeof(char));
-    strncpy(tmp_path, path, 30);
+    char *tmp_path = scratch->CopyString(path);
     int ret = 0;
-    char *tmp;
-    tmp = strtok(tmp_path, "/");
-    while (tmp != NULL)
+    char *tmp, *place; // strtok's own would be shared by every machine
+    tmp = strtok_r(tmp_path, "/", &place);
+    while (tmp != NULL && ret < MaxPathDepth)
     {
         arr[ret++] = tmp;
-        tmp = strtok(NULL, "/");
+        tmp = strtok_r(NULL, "/", &place);
     }
     return ret;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::ResolvePath
+// 	Split "path" into the components of a path from the root, and
+//	return how many there are.  A path not starting with "/" is
+//	relative to the running program's working directory, whose
+//	components come first.
+//
+//	"arr" -- room for 2 * MaxPathDepth components
+//	"scratch" -- the caller's arena, for the components to live in
+//----------------------------------------------------------------------
+
+int FileSystem::ResolvePath(char **arr, char *path, Arena *scratch)
+{
+    WorkingDirectory *cwd = WorkingDir();
+    int depth = 0;
+
+    if (path[0] != '/')
+    {
+        for (depth = 0; depth < cwd->depth; depth++)
+            arr[depth] = cwd->names[depth];
+    }
+    return depth + splitPath(arr + depth, path, scratch);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WorkingDir
+// 	Return the working directory of the running program: the one in
+//	its address space, or for threads that run only in the kernel,
+//	the file system's own.  A file system mounted on a directory
+//	only gets paths from its own root (see Route), so it has only
+//	its own, at the root.
+//----------------------------------------------------------------------
+
+WorkingDirectory *
+FileSystem::WorkingDir()
+{
+    AddrSpace *space = kernel->currentThread->space;
+
+    return (space != NULL && mount == NULL) ? space->WorkingDir() : kernelCwd;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StartOfWalk
+// 	Return how many of the "len" components of a path can be skipped
+//	when resolving it, setting "sector" to the directory to start
+//	from: all of the working directory's, if the path is under it,
+//	otherwise none, starting from the root.  A working directory in
+//	a file system mounted on one of ours has no sector here, and
+//	paths under it are walked from the root.
+//----------------------------------------------------------------------
+
+int FileSystem::StartOfWalk(char **arr, int len, int *sector)
+{
+    WorkingDirectory *cwd = WorkingDir();
+
+    if (cwd->depth > 0 && cwd->sector >= 0 && cwd->Under(arr, len))
+    {
+        *sector = cwd->sector;
+        return cwd->depth;
+    }
+    *sector = rootSector;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Route
+// 	If the path "name" goes through a directory another file system
+//	is mounted on, return that file system's entry in the mount
+//	table, setting "rest" to what is left of the path, from its root
+//	("/" for the directory itself).  Otherwise return NULL: the path
+//	is all ours.  Every operation that takes a path asks this first,
+//	and hands the path on if it is not ours (see mounttable.h).
+//
+//	"scratch" -- the caller's arena, for "rest" to live in
+//----------------------------------------------------------------------
+
+MountEntry *
+FileSystem::Route(char *name, char **rest, Arena *scratch)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    MountEntry *m;
+    int count, crossed, length = 2;
+
+    if (!kernel->mounts->HasMounts(this))
+        return NULL;
+    count = ResolvePath(dir_arr, name, scratch);
+    LockForLookup();
+    crossed = FindMount(dir_arr, count, &m);
+    UnlockForLookup();
+    if (crossed == -1)
+        return NULL;
+
+    for (int i = crossed; i < count; i++)
+        length += strlen(dir_arr[i]) + 1;
+    *rest = (char *)scratch->Alloc(length);
+    strcpy(*rest, "/");
+    for (int i = crossed; i < count; i++)
+    {
+        if (i > crossed)
+            strcat(*rest, "/");
+        strcat(*rest, dir_arr[i]);
+    }
+    DEBUG(dbgFile, "Path " << name << " goes on as " << *rest << " in the "
+                   "file system on " << m->path);
+    return m;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindMount
+// 	Walk the first "len" components of a path, as FindPath does, and
+//	return how many of them there are up to and including the first
+//	one that is a directory another file system is mounted on,
+//	setting "crossed" to its entry.  Return -1 if there is none, or
+//	the path does not exist.  The caller holds namespaceLock to read.
+//----------------------------------------------------------------------
+
+int FileSystem::FindMount(char **arr, int len, MountEntry **crossed)
+{
+    int sector_num;
+    for (int i = StartOfWalk(arr, len, &sector_num); i < len; i++)
+    {
+        int next;
+        if (!dentries->Lookup(arr, i + 1, &next))
+        {
+            next = FindInDirectory(sector_num, arr[i]);
+            dentries->Enter(arr, i + 1, next);
+        }
+        if (next == -1)
+            return -1;
+        *crossed = kernel->mounts->On(this, next);
+        if (*crossed != NULL)
+            return i + 1;
+        sector_num = next;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::MountPoint
+// 	Return the header sector of the directory "name", for another
+//	file system to be mounted on, setting "fs" to the file system it
+//	is in: ours, or one mounted on ours that the path goes into.  The
+//	directory is made if it is not there.  Return -1 if it cannot be,
+//	or "name" is a file, or the root of the file system it is in.
+//----------------------------------------------------------------------
+
+int FileSystem::MountPoint(char *name, FileSystem **fs)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    MountEntry *m;
+    char *rest;
+    int count, sector = -1;
+    StatInfo info;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        return m->fileSystem->MountPoint(rest, fs);
+    }
+    count = ResolvePath(dir_arr, name, &scratch);
+    if (count == 0 || count > MaxPathDepth)
+        return -1;
+    if (!Stat(name, &info) && !MakeNewDir(name))
+        return -1;
+    if (!Stat(name, &info) || info.type != IS_DIR)
+        return -1;
+    LockForLookup();
+    sector = FindPath(dir_arr, count);
+    UnlockForLookup();
+    *fs = this;
+    return sector;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ChangeDirectory
+// 	Make the directory "name" (relative to the current working
+//	directory, unless it starts with "/") the running program's
+//	working directory.  Return FALSE if it does not exist, or its
+//	path is too deep.  "/" is the root.  A directory in a file system
+//	mounted on ours is looked for there; the working directory keeps
+//	only its path, which Route finds the way into again.
+//----------------------------------------------------------------------
+
+bool FileSystem::ChangeDirectory(char *name)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    int sector;
+    MountEntry *m;
+    char *rest;
+
+    if (count > MaxPathDepth)
+        return FALSE;
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        StatInfo info;
+        bool found;
+        {
+            MountScope scope(m);
+
+            found = m->fileSystem->Stat(rest, &info) && info.type == IS_DIR;
+        }
+        if (found)
+            WorkingDir()->Set(dir_arr, count, -1);
+        return found;
+    }
+    LockForLookup();
+    sector = FindPath(dir_arr, count);
+    if (sector != -1)
+        WorkingDir()->Set(dir_arr, count, sector);
+    UnlockForLookup();
+    return sector != -1;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
@@ -294,65 +850,256 @@ int FileSystem::splitPath(char **arr, char *path)
 //
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
+//	"useExtents" -- if TRUE, describe the file by runs of sectors
+//		(see FileHeader::AllocateExtents) rather than one pointer
+//		per sector
+//	"compressed" -- if TRUE, keep the file compressed (see
+//		FileHeader::AllocateCompressed); only on a disk with a
+//		superblock, and it takes no data sectors until it is
+//		written.  It wins over "useExtents".
+//
+//	Otherwise, a file of at most MaxInlineSize bytes gets no data
+//	sectors: its data is kept in its header until it grows (see
+//	FileHeader::AllocateInline).  A bigger one gets none either: it
+//	starts out as one hole, and its sectors are allocated as it is
+//	written (see FileHeader::AllocateSparse).  On a disk with no
+//	superblock, the sectors are all allocated up front.
 //----------------------------------------------------------------------
 
 bool FileSystem::Create(char *name, int initialSize)
 {
-    PersistentBitmap *freeMap;
-    FileHeader *hdr;
-    int sector;
+    return Create(name, initialSize, FALSE);
+}
+
+bool FileSystem::Create(char *name, int initialSize, bool useExtents)
+{
+    return Create(name, initialSize, useExtents, FALSE);
+}
+
+bool FileSystem::Create(char *name, int initialSize, bool useExtents,
+                        bool compressed)
+{
+    ProfileRegion region("FileSystem::Create");
     bool success;
     char *file_name;
-    char *dir_arr[10];
-    int count = splitPath(dir_arr, name);
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    MountEntry *m;
+    char *rest;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        return strcmp(rest, "/") != 0
+               && m->fileSystem->Create(rest, initialSize, useExtents,
+                                        compressed);
+    }
     file_name = dir_arr[count - 1];
+    if (readOnly)
+        return FALSE;
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite();
     ASSERT(changeToRightDir(dir_arr, count - 1) == TRUE) // sus
 
     DEBUG(dbgFile, "Creating file " << file_name << " size " << initialSize);
 
-    currentDirectory->FetchFrom(currentDirectoryFile);
+    // removed files must not take the room it needs; the header and
+    // data go in the directory's group
+    MakeRoom(RoomToCreate(initialSize, useExtents, compressed));
+    freeMap->PlaceNear(currentDirectorySector,
+                       PlaceToCreate(initialSize, useExtents, compressed));
+    success = CreateInCurrentDirectory(file_name, initialSize, useExtents,
+                                       compressed);
+    if (success)
+    {
+        // everthing worked, flush all changes back to disk
+        currentDirectory->WriteBack(currentDirectoryFile);
+        freeMap->WriteBack(freeMapFile);
+        dentries->Invalidate(dir_arr, count);
+    }
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CreateMany
+// 	Create "count" files in the directory "dirName", in one go.  The
+//	same as calling Create on each of them, except that the path of
+//	the directory is walked once, the free map is told once where the
+//	headers and data of them all are to go, and the directory and the
+//	free map are written back once, at the end: each of their
+//	sectors that changed is written once, not once per file.  It is
+//	all one transaction.
+//
+//	Return how many files were created, setting "created[i]" to say
+//	whether "names[i]" was: it is not if a file of that name is there
+//	already (or was earlier in the list), the name has a "/" in it,
+//	or there is no room for it.  Return -1, creating none, if the
+//	directory does not exist.
+//
+//	"dirName" -- the directory to create them in
+//	"names", "sizes" -- the name and initial size of each file
+//----------------------------------------------------------------------
 
-    if (currentDirectory->Find(file_name) != -1)
+int FileSystem::CreateMany(char *dirName, char **names, int *sizes,
+                           bool *created, int count)
+{
+    ProfileRegion region("FileSystem::CreateMany");
+    char *dir_arr[2 * MaxPathDepth + 1];
+    Arena scratch;
+    int depth = ResolvePath(dir_arr, dirName, &scratch);
+    int room = 0, place = 0, numCreated = 0;
+    MountEntry *m;
+    char *rest;
+
+    m = Route(dirName, &rest, &scratch);
+    if (m != NULL)
     {
-        DEBUG(dbgFile, "File " << file_name << "is already in directory.");
-        success = FALSE; // file is already in directory
+        MountScope scope(m);
+
+        return m->fileSystem->CreateMany(rest, names, sizes, created, count);
     }
-    else
+    if (readOnly)
     {
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-        sector = freeMap->FindAndSet(); // find a sector to hold the file header
-        if (sector == -1)
-        {
-            DEBUG(dbgFile, " creating File " << file_name << " : no free block for file header.");
-            success = FALSE; // no free block for file header
-        }
-        else if (!currentDirectory->Add(file_name, sector, IS_FILE))
-        {
-            DEBUG(dbgFile, " creating File " << file_name << " : no space in directory.");
-            success = FALSE; // no space in directory
-        }
-        else
+        for (int i = 0; i < count; i++)
+            created[i] = FALSE;
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        room += RoomToCreate(sizes[i], FALSE, FALSE);
+        place += PlaceToCreate(sizes[i], FALSE, FALSE);
+    }
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite();
+    if (!changeToRightDir(dir_arr, depth))
+    {
+        freeMapLock->ReleaseWrite();
+        namespaceLock->ReleaseWrite();
+        kernel->bufferCache->EndTransaction(TRUE);
+        return -1;
+    }
+    DEBUG(dbgFile, "Creating " << count << " files in " << dirName);
+
+    MakeRoom(room);
+    freeMap->PlaceNear(currentDirectorySector, place);
+    for (int i = 0; i < count; i++)
+    {
+        created[i] = strchr(names[i], '/') == NULL
+                     && CreateInCurrentDirectory(names[i], sizes[i], FALSE, FALSE);
+        if (created[i])
         {
-            hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize))
-            {
-                DEBUG(dbgFile, " creating File " << file_name << " : no space on disk for data.");
-                success = FALSE; // no space on disk for data
-            }
-            else
-            {
-                success = TRUE;
-                // everthing worked, flush all changes back to disk
-                hdr->WriteBack(sector);
-                currentDirectory->WriteBack(currentDirectoryFile);
-                freeMap->WriteBack(freeMapFile);
-            }
-            delete hdr;
+            dir_arr[depth] = names[i];
+            dentries->Invalidate(dir_arr, depth + 1);
+            numCreated++;
         }
-        delete freeMap;
     }
-    resetRootDir();
-    return success;
+    if (numCreated > 0)
+    {
+        currentDirectory->WriteBack(currentDirectoryFile);
+        freeMap->WriteBack(freeMapFile);
+    }
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    return numCreated;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CreateInCurrentDirectory
+// 	Do the work of Create, for a file "name" in the current directory:
+//	allocate the header and data of the file, enter it in the
+//	directory and write the header out.  The directory and the free
+//	map are only changed in memory, for the caller to write back.
+//	Return FALSE, changing nothing, if the file is there already or
+//	there is no room for it.  See Create for "useExtents" and
+//	"compressed".
+//
+//	The caller holds namespaceLock and freeMapLock to write, and has
+//	told the free map where to allocate from.
+//----------------------------------------------------------------------
+
+bool FileSystem::CreateInCurrentDirectory(char *name, int initialSize,
+                                          bool useExtents, bool compressed)
+{
+    FileHeader hdr; // only needed until it is written out
+    int sector;
+    bool success;
+    // a disk with no superblock may be used by kernels that predate
+    // inline files and holes, so it gets neither
+    bool compress = compressed && superBlock != NULL;
+    bool sparse = !useExtents && !compress && superBlock != NULL;
+    bool small = sparse && initialSize <= MaxInlineSize;
+
+    ASSERT(freeMapLock->IsHeldForWriteByCurrentThread());
+    if (currentDirectory->Find(name) != -1)
+    {
+        DEBUG(dbgFile, "File " << name << "is already in directory.");
+        return FALSE; // file is already in directory
+    }
+    sector = PlaceHeader(); // find a sector to hold the file header
+    if (sector == -1)
+    {
+        DEBUG(dbgFile, " creating File " << name << " : no free block for file header.");
+        return FALSE; // no free block for file header
+    }
+    if (!AddToCurrentDirectory(name, sector, IS_FILE))
+    {
+        DEBUG(dbgFile, " creating File " << name << " : no space in directory.");
+        freeMap->Clear(sector);
+        return FALSE; // no space in directory
+    }
+    if (compress)
+        success = hdr.AllocateCompressed(freeMap, initialSize);
+    else if (small)
+    {
+        hdr.AllocateInline(initialSize);
+        success = TRUE;
+    }
+    else if (sparse)
+        success = hdr.AllocateSparse(initialSize);
+    else
+        success = useExtents ? hdr.AllocateExtents(freeMap, initialSize)
+                             : hdr.Allocate(freeMap, initialSize);
+    if (!success)
+    {
+        DEBUG(dbgFile, " creating File " << name << " : no space on disk for data.");
+        currentDirectory->Remove(name);
+        freeMap->Clear(sector);
+        return FALSE; // no space on disk for data
+    }
+    hdr.WriteBack(sector);
+    kernel->inodeTable->ForgetStats(sector);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RoomToCreate, FileSystem::PlaceToCreate
+// 	Return how many free sectors creating a file takes now, and how
+//	many it is placed for (a sparse file's sectors are allocated as
+//	it is written, near its header).
+//----------------------------------------------------------------------
+
+int FileSystem::RoomToCreate(int initialSize, bool useExtents, bool compressed)
+{
+    if (superBlock != NULL && (compressed || !useExtents))
+        return 1; // inline, sparse or compressed: only the header
+    return 1 + divRoundUp(initialSize, SectorSize);
+}
+
+int FileSystem::PlaceToCreate(int initialSize, bool useExtents, bool compressed)
+{
+    if (superBlock != NULL && !useExtents && !compressed
+        && initialSize <= MaxInlineSize)
+        return 1;
+    return 1 + divRoundUp(initialSize, SectorSize);
 }
 
 //----------------------------------------------------------------------
@@ -362,69 +1109,405 @@ bool FileSystem::Create(char *name, int initialSize)
 //	  Find the location of the file's header, using the directory
 //	  Bring the header into memory
 //
+//	Opening only looks things up, so any number of threads may be
+//	doing it at once.  The current directory stays as it is, and
+//	where the file was found (or that it was not) is entered in the
+//	dentry cache, so opening it again reads no directory.  Mounted
+//	read-only, the file's header stays in memory from then on.
+//
 //	"name" -- the text name of the file to be opened
 //----------------------------------------------------------------------
 
 OpenFile *
 FileSystem::Open(char *name)
 {
+    ProfileRegion region("FileSystem::Open");
     OpenFile *openFile = NULL;
     int sector;
     char *file_name;
-    char *dir_arr[10];
-    int count = splitPath(dir_arr, name);
-    file_name = dir_arr[count - 1];
-    DEBUG(dbgFile, "Opening file " << file_name << "Path : "<<name);
-    ASSERT(changeToRightDir(dir_arr, count - 1) == TRUE) // sus
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    MountEntry *m;
+    char *rest;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
 
-    currentDirectory->FetchFrom(currentDirectoryFile);
-    sector = currentDirectory->Find(file_name);
+        return m->fileSystem->Open(rest);
+    }
+    file_name = (count > 0) ? dir_arr[count - 1] : (char *)"/";
+    DEBUG(dbgFile, "Opening file " << file_name << "Path : "<<name);
+    LockForLookup();
+    if (count == 0)
+        sector = rootSector; // a mounted file system's root, say
+    else if (!dentries->Lookup(dir_arr, count, &sector))
+    {
+        int dirSector = FindPath(dir_arr, count - 1);
+        ASSERT(dirSector != -1) // sus
+
+        sector = FindInDirectory(dirSector, file_name);
+        dentries->Enter(dir_arr, count, sector);
+    }
     if (sector >= 0)
+    {
+        if (readOnly)
+            PinHeader(sector);
         openFile = new OpenFile(sector); // name was found in directory
-    resetRootDir();
+    }
+    UnlockForLookup();
     return openFile; // return NULL if not found
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Descriptors
+// 	Return the table of file descriptors of the running program: the
+//	one in its address space, or for threads that run only in the
+//	kernel, the file system's own.
+//----------------------------------------------------------------------
+
+FileDescriptorTable *
+FileSystem::Descriptors()
+{
+    AddrSpace *space = kernel->currentThread->space;
+
+    return (space != NULL) ? space->Descriptors() : kernelFiles;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenAFile
+// 	Open a file on behalf of the running program, and return the
+//	descriptor it will use to refer to it: -1 if the file does not
+//	exist or the program has too many files open.
+//
+//	"name" -- the text name of the file to be opened
+//----------------------------------------------------------------------
+
 OpenFileId
 FileSystem::OpenAFile(char *name)
 {
     OpenFile *one_file = Open(name);
     OpenFileId id;
-    // choose a file discriptor which is not occupied by another opened file.
-    do
-    {
-        id = rand();
-    } while (openedTable.find(id) != openedTable.end());
-    // assign id to file on map
-    openedTable[id] = one_file;
+
+    if (one_file == NULL)
+        return -1;
+    id = Descriptors()->Add(one_file);
+    if (id == -1)
+        delete one_file; // no free descriptor
     return id;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::OpenAPipe
+// 	Make a pipe for the running program, and give each of its ends a
+//	descriptor (see pipebuf.h).  Return FALSE if the program does not
+//	have two descriptors free.
+//
+//	"readId", "writeId" -- set to the descriptors of the two ends
+//----------------------------------------------------------------------
+
+bool
+FileSystem::OpenAPipe(OpenFileId *readId, OpenFileId *writeId)
+{
+    FileDescriptorTable *files = Descriptors();
+    PipeBuffer *pipe = new PipeBuffer;
+
+    *readId = files->AddPipe(pipe, FALSE);
+    if (*readId == -1) {
+        pipe->Close(FALSE);
+        pipe->Close(TRUE);
+        delete pipe;
+        return FALSE;
+    }
+    *writeId = files->AddPipe(pipe, TRUE);
+    if (*writeId == -1) {
+        pipe->Close(TRUE);
+        files->ClosePipe(*readId); // the last end: deletes it
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteAFile / ReadAFile
+// 	Write or read an open file of the running program, at its
+//	current position, or the end of a pipe it has.  Return the number
+//	of bytes transferred, 0 if "id" is neither an open file nor the
+//	right end of a pipe.
+//----------------------------------------------------------------------
+
 int FileSystem::WriteAFile(char *buffer, int size, OpenFileId id)
 {
-    if (openedTable.find(id) != openedTable.end())
-        return openedTable[id]->Write(buffer, size);
+    OpenFile *file = Descriptors()->Get(id);
+    bool writing;
+    PipeBuffer *pipe;
+
+    if (file != NULL)
+        return file->Write(buffer, size);
+    if ((pipe = Descriptors()->GetPipe(id, &writing)) != NULL && writing)
+        return pipe->Write(buffer, size);
     return 0; // failed to write.
 }
 
 int FileSystem::ReadAFile(char *buffer, int size, OpenFileId id)
 {
-    if (openedTable.find(id) != openedTable.end())
-        return openedTable[id]->Read(buffer, size);
+    OpenFile *file = Descriptors()->Get(id);
+    bool writing;
+    PipeBuffer *pipe;
+
+    if (file != NULL)
+        return file->Read(buffer, size);
+    if ((pipe = Descriptors()->GetPipe(id, &writing)) != NULL && !writing)
+        return pipe->Read(buffer, size);
     return 0; // failed to read.
 }
 
+//----------------------------------------------------------------------
+// FileSystem::WriteAFileAt / ReadAFileAt
+// 	The same, at file offset "position" instead (UNIX pwrite and
+//	pread).  The file's position is neither used nor moved, so
+//	threads sharing the descriptor need not agree on it.  Return 0
+//	also if "position" is negative.
+//----------------------------------------------------------------------
+
+int FileSystem::WriteAFileAt(char *buffer, int size, int position, OpenFileId id)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    if (file != NULL && position >= 0)
+        return file->WriteAt(buffer, size, position);
+    return 0;
+}
+
+int FileSystem::ReadAFileAt(char *buffer, int size, int position, OpenFileId id)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    if (file != NULL && position >= 0)
+        return file->ReadAt(buffer, size, position);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SeekAFile
+// 	Set the position of an open file of the running program, where
+//	its next read or write starts.  Return 1 on success, 0 if "id" is
+//	not an open file or "position" is negative.
+//----------------------------------------------------------------------
+
+int FileSystem::SeekAFile(int position, OpenFileId id)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    if (file == NULL || position < 0)
+        return 0;
+    file->Seek(position);
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CloseAFile
+// 	Close an open file or pipe end of the running program.  Return 1
+//	on success, 0 if "id" was not open.
+//----------------------------------------------------------------------
+
 int FileSystem::CloseAFile(OpenFileId id)
 {
-    if (openedTable.find(id) != openedTable.end())
+    OpenFile *file = Descriptors()->Remove(id);
+
+    if (file != NULL)
     {
-        delete openedTable[id];
-        openedTable.erase(id);
+        delete file;
         return 1;
     }
+    if (Descriptors()->ClosePipe(id))
+        return 1;
     return 0; // failed to close.
 }
 
+//----------------------------------------------------------------------
+// FileSystem::SyncAFile
+// 	Make sure an open file of the running program is on disk (see
+//	OpenFile::Fsync).  Return 1 on success, 0 if "id" is not open.
+//----------------------------------------------------------------------
+
+int FileSystem::SyncAFile(OpenFileId id)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    if (file == NULL)
+        return 0;
+    file->Fsync();
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StatsOfAFile
+// 	Return the I/O counters of an open file of the running program
+//	(see FileIoStats in writebuf.h), NULL if "id" is not open.
+//----------------------------------------------------------------------
+
+FileIoStats *FileSystem::StatsOfAFile(OpenFileId id)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    if (file == NULL)
+        return NULL;
+    return kernel->inodeTable->IoStatsOf(file->HeaderSector());
+}
+
+//----------------------------------------------------------------------
+// FileSystem::TruncateAFile / AllocateAFile
+// 	Set the length of an open file of the running program (see
+//	OpenFile::Truncate), or set aside the space for part of it (see
+//	OpenFile::Allocate).  Return 1 on success, 0 if "id" is not open
+//	or the request could not be carried out.
+//----------------------------------------------------------------------
+
+int FileSystem::TruncateAFile(OpenFileId id, int length)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    return (file != NULL && file->Truncate(length)) ? 1 : 0;
+}
+
+int FileSystem::AllocateAFile(OpenFileId id, int offset, int length)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    return (file != NULL && file->Allocate(offset, length)) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::AdviseAFile
+// 	Pass on what the running program says about how it will use part
+//	of an open file (see OpenFile::Advise).  Return 1 on success, 0
+//	if "id" is not open or the advice is not valid.
+//----------------------------------------------------------------------
+
+int FileSystem::AdviseAFile(OpenFileId id, int offset, int length, int advice)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    return (file != NULL && file->Advise((FileAdvice)advice, offset, length)) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LockAFileRange
+// 	Lock, or let go of, part of an open file of the running program
+//	(see OpenFile::LockRange).  Return 1 on success, 0 if "id" is not
+//	open, the range or the mode is not valid, or the range could not
+//	be had at once and the mode said not to wait.
+//----------------------------------------------------------------------
+
+int FileSystem::LockAFileRange(OpenFileId id, int offset, int length, int mode)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    return (file != NULL && file->LockRange((RangeLockMode)mode, offset, length)) ? 1 : 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::MapAFile
+// 	Map "length" bytes of an open file of the running program,
+//	starting at file offset "offset", into its address space (see
+//	AddrSpace::Map).  The mapping gets an OpenFile of its own, so it
+//	stays good after "id" is closed.  Return the virtual address of
+//	the mapped region, or -1 on failure.
+//----------------------------------------------------------------------
+
+int FileSystem::MapAFile(OpenFileId id, int offset, int length)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    OpenFile *mapped;
+    int vaddr;
+
+    if (space == NULL || offset < 0 || length <= 0
+        || (mapped = ReopenAFile(id)) == NULL)
+        return -1;
+    vaddr = space->Map(mapped, offset, length);
+    if (vaddr == -1)
+        delete mapped; // no room in the address space
+    return vaddr;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReopenAFile
+// 	Return a new OpenFile on the same file as the open file "id" of
+//	the running program, for something that must outlive the
+//	descriptor (a mapping, an asynchronous request); NULL if "id" is
+//	not open.  The caller deletes it.
+//----------------------------------------------------------------------
+
+OpenFile *
+FileSystem::ReopenAFile(OpenFileId id)
+{
+    OpenFile *file = Descriptors()->Get(id);
+
+    if (file == NULL)
+        return NULL;
+    MountScope scope(file->Mount()); // in the file system it is in
+    return new OpenFile(file->HeaderSector());
+}
+
+//----------------------------------------------------------------------
+// CopyBytes
+// 	Copy "length" bytes of "from", starting at "fromPosition", to
+//	"to" at "toPosition", which grows if they go past its end.  The
+//	bytes go through a kernel buffer CopyChunkSize bytes at a time,
+//	so the reads and writes take runs of sectors.  Return how many
+//	bytes were copied: fewer if "from" ends first, or the disk fills.
+//----------------------------------------------------------------------
+
+static int
+CopyBytes(OpenFile *from, int fromPosition, OpenFile *to, int toPosition,
+          int length)
+{
+    char *buffer = new char[CopyChunkSize];
+    int done, read, written;
+
+    for (done = 0; done < length; done += written)
+    {
+        read = from->ReadAt(buffer, min(length - done, CopyChunkSize),
+                            fromPosition + done);
+        if (read <= 0)
+            break;
+        written = to->WriteAt(buffer, read, toPosition + done);
+        if (written < read)
+        {
+            done += max(written, 0); // disk full
+            break;
+        }
+    }
+    delete[] buffer;
+    return done;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CopyAFileRange
+// 	Copy "length" bytes from one open file of the running program to
+//	another, from and to where each is positioned, and move both past
+//	them, without the bytes going through the program (like UNIX
+//	copy_file_range).  Return how many bytes were copied, 0 if either
+//	"fromId" or "toId" is not open or "length" is not positive.
+//----------------------------------------------------------------------
+
+int FileSystem::CopyAFileRange(OpenFileId fromId, OpenFileId toId, int length)
+{
+    OpenFile *from = Descriptors()->Get(fromId);
+    OpenFile *to = Descriptors()->Get(toId);
+    int copied;
+
+    if (from == NULL || to == NULL || length <= 0)
+        return 0;
+    copied = CopyBytes(from, from->Position(), to, to->Position(), length);
+    from->Seek(from->Position() + copied);
+    to->Seek(to->Position() + copied);
+    return copied;
+}
+
 //----------------------------------------------------------------------
 // FileSystem::Remove
 // 	Delete a file from the file system.  This requires:
@@ -436,205 +1519,2552 @@ int FileSystem::CloseAFile(OpenFileId id)
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
 //	in the file system.
 //
+//	Finding the data blocks of a file with index tables means reading
+//	every table, so such a file is only taken out of its directory:
+//	its sectors are left to the reclaimer thread (see QueueOrphan).
+//	So is a file that is still open, whatever its size: its sectors
+//	are not given back until it is closed, and the file can be used
+//	until then.  Other files, and every file on a disk with no
+//	superblock, are deleted right away.
+//
 //	"name" -- the text name of the file to be removed
 //----------------------------------------------------------------------
 
 bool FileSystem::Remove(char *name)
 {
-    PersistentBitmap *freeMap;
     FileHeader *fileHdr;
     int sector;
     char *file_name;
-    char *dir_arr[10];
-    int count = splitPath(dir_arr, name);
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    MountEntry *m;
+    char *rest;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        return strcmp(rest, "/") != 0 && m->fileSystem->Remove(rest);
+    }
     file_name = dir_arr[count - 1];
+    if (readOnly)
+        return FALSE;
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
     ASSERT(changeToRightDir(dir_arr, count - 1) == TRUE) // sus
 
-    currentDirectory->FetchFrom(currentDirectoryFile);
-    sector = currentDirectory->Find(name);
+    sector = currentDirectory->Find(file_name);
     if (sector == -1)
     {
+        namespaceLock->ReleaseWrite();
+        kernel->bufferCache->EndTransaction(TRUE);
         return FALSE; // file not found
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
+    freeMapLock->AcquireWrite();
+    // the header in memory, if the file is open, may be newer than
+    // the one on disk
+    fileHdr = kernel->inodeTable->Acquire(sector);
 
-    freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-
-    fileHdr->Deallocate(freeMap); // remove data blocks
-    freeMap->Clear(sector);       // remove header block
-    currentDirectory->Remove(name);
+    if ((kernel->inodeTable->RefCount(sector) == 1
+         && !fileHdr->HasIndirectTables()) || !QueueOrphan(sector))
+    {
+        fileHdr->Deallocate(freeMap); // remove data blocks
+        freeMap->Clear(sector);       // remove header block
+    }
+    currentDirectory->Remove(file_name);
 
     freeMap->WriteBack(freeMapFile);                   // flush to disk
     currentDirectory->WriteBack(currentDirectoryFile); // flush to disk
-    delete fileHdr;
-    delete freeMap;
-    resetRootDir();
+    dentries->InvalidateTree(dir_arr, count);
+    kernel->inodeTable->Release(sector);
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
     return TRUE;
 }
 
 //----------------------------------------------------------------------
-// FileSystem::List
-// 	List all the files in the file system directory.
+// FileSystem::RemoveTree
+// 	Delete a file, or a directory and everything under it, in one
+//	pass: the tree is walked once (see FreeTree), taking what it finds
+//	out of the free map in memory, and then the free map and the
+//	directory the tree was in are written back once each, in one
+//	transaction.  Removing the files one at a time instead would look
+//	up each path, and write the free map and a directory, every time.
+//
+//	A file or directory still open when it is removed keeps its
+//	sectors until it is closed, as in Remove; so does the working
+//	directory of a program, if it is in the tree.
+//
+//	Return TRUE if it was deleted, FALSE if there is no such file or
+//	directory, or if it is the root.
+//
+//	"name" -- the text name of the file or directory to be removed
 //----------------------------------------------------------------------
 
-void FileSystem::List(char *path)
+bool FileSystem::RemoveTree(char *name)
 {
-    char *dir_arr[10];
-    int count = splitPath(dir_arr, path);
-    changeToRightDir(dir_arr, count);
-    currentDirectory->FetchFrom(currentDirectoryFile);
-    currentDirectory->List();
-    resetRootDir();
-}
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    char *file_name;
+    int type = NOT_USE;
+    MountEntry *m;
+    char *rest;
 
-bool FileSystem::createDir(char *name)
-{
-    PersistentBitmap *freeMap;
-    FileHeader *hdr;
-    int sector;
-    bool success;
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
 
-    DEBUG(dbgFile, "Creating Dir " << name);
+        return strcmp(rest, "/") != 0 && m->fileSystem->RemoveTree(rest);
+    }
+    if (count == 0 || readOnly)
+        return FALSE; // the root stays
+    file_name = dir_arr[count - 1];
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
+    if (changeToRightDir(dir_arr, count - 1))
+        type = currentDirectory->FindType(file_name);
+    if (type != NOT_USE)
+    {
+        DEBUG(dbgFile, "Removing the tree at " << name);
+        freeMapLock->AcquireWrite();
+        FreeTree(currentDirectory->Find(file_name), type);
+        currentDirectory->Remove(file_name);
+
+        freeMap->WriteBack(freeMapFile);
+        currentDirectory->WriteBack(currentDirectoryFile);
+        dentries->InvalidateTree(dir_arr, count);
+        freeMapLock->ReleaseWrite();
+    }
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    return type != NOT_USE;
+}
 
-    currentDirectory->FetchFrom(currentDirectoryFile);
+//----------------------------------------------------------------------
+// IsUnder
+// 	Return TRUE if the path of "len" components is at or below the one
+//	of "topLen" components "top".
+//----------------------------------------------------------------------
 
-    if (currentDirectory->Find(name) != -1)
-        success = FALSE; // file is already in directory
-    else
+static bool IsUnder(char **path, int len, char **top, int topLen)
+{
+    if (len < topLen)
+        return FALSE;
+    for (int i = 0; i < topLen; i++)
     {
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-        sector = freeMap->FindAndSet(); // find a sector to hold the file header
-        if (sector == -1)
-            success = FALSE; // no free block for file header
-        else if (!currentDirectory->Add(name, sector, IS_DIR))
-            success = FALSE; // no space in directory
-        else
-        {
-            hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, DirectoryFileSize))
-                success = FALSE; // no space on disk for data
-            else
-            {
-                success = TRUE;
-                // everthing worked, flush all changes back to disk
-                hdr->WriteBack(sector);
-                OpenFile *newDirFile = new OpenFile(sector);
-                Directory *newDir = new Directory(NumDirEntries);
-                newDir->WriteBack(newDirFile);
-                currentDirectory->WriteBack(currentDirectoryFile);
-                freeMap->WriteBack(freeMapFile);
-            }
-            delete hdr;
-        }
-        delete freeMap;
+        if (strcmp(path[i], top[i]) != 0)
+            return FALSE;
     }
-    return success;
+    return TRUE;
 }
 
-bool FileSystem::changeToRightDir(char **arr, int len)
+//----------------------------------------------------------------------
+// FileSystem::Rename
+// 	Give the file or directory "from" the name "to", which may be in
+//	another directory.  Only its directory entry moves: it is added
+//	to the directory of "to" and taken out of the one of "from", both
+//	in one transaction, so after a crash it is in exactly one of them.
+//	The file's header and data are not touched, so this costs the
+//	same whatever the size of the file, and files open on it stay
+//	open.  The directory of "to" is grown if it is full.
+//
+//	A working directory under a directory that moves keeps its old
+//	path, as after Remove.
+//
+//	Return FALSE, changing nothing, if "from" does not exist, "to"
+//	already does or its directory does not, either is the root, or
+//	a directory would be moved under itself.
+//
+//	"from" -- the text name of the file or directory
+//	"to" -- its new name
+//----------------------------------------------------------------------
+
+bool FileSystem::Rename(char *from, char *to)
 {
-    if (len < 0)
-        return true; // Already in right folder
-    DEBUG(dbgFile, " changeToRightDir : len = " << len);
-    int sector_num = -1;
-    for (int i = 0; i < len; i++)
+    char *from_arr[2 * MaxPathDepth];
+    char *to_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int fromCount = ResolvePath(from_arr, from, &scratch);
+    int toCount = ResolvePath(to_arr, to, &scratch);
+    char *from_name, *to_name;
+    int sector = -1, type = NOT_USE;
+    bool success = FALSE, found;
+    MountEntry *fromMount, *toMount;
+    char *fromRest, *toRest;
+
+    fromMount = Route(from, &fromRest, &scratch);
+    toMount = Route(to, &toRest, &scratch);
+    if (fromMount != toMount)
+        return FALSE; // not from one file system into another
+    if (fromMount != NULL)
     {
-        DEBUG(dbgFile, "Try switch to " << arr[i]);
-        // currentDirectory->List();
-        sector_num = currentDirectory->Find(arr[i]);
-        DEBUG(dbgFile, " changeToRightDir : sector_num = " << sector_num);
+        MountScope scope(fromMount);
 
-        if (sector_num == -1)
-        {
-            std::cout << "dir not found..\n";
-            return false;
-        }
-        else
-        {
-            currentDirectory->WriteBack(currentDirectoryFile);
-            delete currentDirectoryFile;
-            delete currentDirectory;
-            currentDirectoryFile = new OpenFile(sector_num);
-            currentDirectory = new Directory(NumDirEntries);
-            currentDirectory->FetchFrom(currentDirectoryFile);
-            DEBUG(dbgFile, "Success on switching to " << arr[i]);
-            // currentDirectory->List();
-        }
+        return fromMount->fileSystem->Rename(fromRest, toRest);
     }
-    return true;
-}
-void FileSystem::resetRootDir()
-{
-    // cout<<" resetRootDir : resetting pwd to root"<<endl;
-    if (currentDirectoryFile != NULL)
-        delete currentDirectoryFile;
-    if (currentDirectory != NULL)
-        delete currentDirectory;
-    currentDirectoryFile = new OpenFile(DirectorySector); // root dir
-    currentDirectory = new Directory(NumDirEntries);
-    currentDirectory->FetchFrom(currentDirectoryFile);
-}
-bool FileSystem::MakeNewDir(char *name)
-{
-    char *dir_arr[10];
-    int dir_count = 0;
-    char *new_dir_name;
-    if (name[0] != '/')
+    if (fromCount == 0 || toCount == 0 || readOnly)
+        return FALSE; // the root has no name to change
+    from_name = from_arr[fromCount - 1];
+    to_name = to_arr[toCount - 1];
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite(); // the new directory may have to grow
+    if (changeToRightDir(from_arr, fromCount - 1))
     {
-        cout << "The mkdir should start with '/' \n ";
-        return false;
+        sector = currentDirectory->Find(from_name);
+        type = currentDirectory->FindType(from_name);
     }
-    else
+    if (sector != -1
+        && !(type == IS_DIR && IsUnder(to_arr, toCount, from_arr, fromCount))
+        && changeToRightDir(to_arr, toCount - 1)
+        && currentDirectory->Find(to_name) == -1
+        && AddToCurrentDirectory(to_name, sector, type))
     {
-        dir_count = splitPath(dir_arr, name);
-        // cout << " MakeNewDir : dir_count = " << dir_count << endl;
-        new_dir_name = dir_arr[dir_count - 1];
-        // cout << " MakeNewDir : new_dir_name = " << new_dir_name << endl;
-
-        // move the currDir to right place
-        if (changeToRightDir(dir_arr, dir_count - 1) == false)
-            return FALSE;
-        if (createDir(new_dir_name) == false)
-            return FALSE;
+        DEBUG(dbgFile, "Renaming " << from << " to " << to);
+        currentDirectory->WriteBack(currentDirectoryFile);
+        found = changeToRightDir(from_arr, fromCount - 1);
+        ASSERT(found);
+        currentDirectory->Remove(from_name);
+        currentDirectory->WriteBack(currentDirectoryFile);
+        freeMap->WriteBack(freeMapFile); // if a directory grew
+        dentries->InvalidateTree(from_arr, fromCount);
+        dentries->Invalidate(to_arr, toCount);
+        success = TRUE;
     }
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    return success;
+}
 
-    // back to root dir
-    resetRootDir();
+//----------------------------------------------------------------------
+// FileSystem::MakeShareMap
+// 	Make the share map, the file of how many files share each sector
+//	(see PersistentBitmap::Share), if there is none yet: its header
+//	and sectors are taken from the free map, and the superblock says
+//	where it is.  The caller holds freeMapLock to write, and writes
+//	the free map back, which writes the share map too, in its
+//	transaction.  Return FALSE if the disk has no superblock to
+//	record it in, or no room for it.
+//----------------------------------------------------------------------
+
+bool FileSystem::MakeShareMap()
+{
+    FileHeader hdr;
+    int sector;
 
+    ASSERT(freeMapLock->IsHeldForWriteByCurrentThread());
+    if (shareMapFile != NULL)
+        return TRUE;
+    if (superBlock == NULL)
+        return FALSE;
+    sector = freeMap->FindAndSet();
+    if (sector == -1)
+        return FALSE;
+    if (!hdr.Allocate(freeMap, ShareMapFileSize))
+    {
+        freeMap->Clear(sector);
+        return FALSE;
+    }
+    DEBUG(dbgFile, "Making the share map, header " << sector);
+    hdr.WriteBack(sector);
+    shareMapFile = new OpenFile(sector);
+    freeMap->FormatShares(shareMapFile);
+    superBlock->shareMapSector = sector;
+    superBlock->WriteBack(SuperBlockSector);
     return TRUE;
 }
+
 //----------------------------------------------------------------------
-// FileSystem::Print
-// 	Print everything about the file system:
-//	  the contents of the bitmap
-//	  the contents of the directory
-//	  for each file in the directory,
-//	      the contents of the file header
-//	      the data in the file
+// FileSystem::StartChecksums
+// 	Take the checksum of every sector written to disk from now on,
+//	and check every one read (see sectorsum.h).  The sectors holding
+//	the checksums, at the end of the share map file, and the
+//	superblock are left out: they are written after the checksums
+//	are, at unmount.
+//
+//	"fetch" -- start from the checksums on disk?  Only if they were
+//		written back at the last unmount, after everything else
 //----------------------------------------------------------------------
 
-void FileSystem::Print()
+void FileSystem::StartChecksums(bool fetch)
 {
-    FileHeader *bitHdr = new FileHeader;
-    FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    int sumSectors[SumMapSize / SectorSize];
+    FileHeader *hdr;
 
-    printf("Bit map file header:\n");
-    bitHdr->FetchFrom(FreeMapSector);
-    bitHdr->Print();
+    sums = new SectorSums;
+    sums->Exclude(SuperBlockSector);
+    hdr = kernel->inodeTable->Acquire(superBlock->shareMapSector);
+    hdr->ByteRangeToSectors(SumMapOffset, SumMapSize, sumSectors);
+    kernel->inodeTable->Release(superBlock->shareMapSector);
+    for (int i = 0; i < SumMapSize / SectorSize; i++)
+        sums->Exclude(sumSectors[i]);
+    if (fetch)
+        sums->FetchFrom(shareMapFile);
+    else
+        DEBUG(dbgFile, "Starting the checksums with none known.");
+    kernel->bufferCache->SetChecksums(sums);
+}
 
-    printf("Directory file header:\n");
-    dirHdr->FetchFrom(DirectorySector);
-    dirHdr->Print();
+//----------------------------------------------------------------------
+// FileSystem::MakeChecksums
+// 	Start checksums of the sectors (-crc) on a disk that has none:
+//	the share map is made if there is none yet, and made long enough
+//	to hold them, none known to start with.  Return FALSE if the disk
+//	has no room for them.
+//
+//	This is done while the file system is being made, before the
+//	kernel has it, so the share map is extended here, rather than
+//	by writing past its end (see ExtendFile).
+//----------------------------------------------------------------------
 
-    freeMap->Print();
+bool FileSystem::MakeChecksums()
+{
+    SectorSums none;
+    FileHeader *hdr;
+    bool made;
 
-    currentDirectory->FetchFrom(currentDirectoryFile);
-    currentDirectory->Print();
+    kernel->bufferCache->BeginTransaction();
+    freeMapLock->AcquireWrite();
+    made = MakeShareMap();
+    if (made && shareMapFile->Length() < SumMapOffset + SumMapSize)
+    {
+        hdr = kernel->inodeTable->Acquire(superBlock->shareMapSector);
+        freeMap->SetGoal(superBlock->shareMapSector);
+        made = hdr->Extend(freeMap, SumMapOffset + SumMapSize);
+        if (made)
+            hdr->WriteBack(superBlock->shareMapSector);
+        kernel->inodeTable->Release(superBlock->shareMapSector);
+    }
+    if (made)
+        freeMap->WriteBack(freeMapFile);
+    freeMapLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    if (!made)
+        return FALSE;
+    none.WriteBack(shareMapFile);
+    DEBUG(dbgFile, "Keeping checksums of the sectors, in the share map.");
+    StartChecksums(FALSE);
+    return TRUE;
+}
 
-    delete bitHdr;
-    delete dirHdr;
-    delete freeMap;
+//----------------------------------------------------------------------
+// FileSystem::Clone
+// 	Make the file "to" a copy of the file "from", without copying its
+//	data: the copy shares the data sectors of the original (see
+//	FileHeader::Clone), and only has a header, and indirect tables,
+//	of its own.  A sector is copied when either file first writes to
+//	it.  So copying a file costs the same whatever its size, and
+//	takes almost no space.  The new entry, header, tables and free
+//	map, with the share counts, are written in one transaction.
+//
+//	Return FALSE, changing nothing, if "from" is not a file, "to"
+//	already exists or its directory does not, or there is no room.
+//	So is a file that is open, since writes to it may be held back
+//	(see writebuf.h), and one in the extent or compressed format,
+//	whose sectors cannot be copied one at a time on write.
+//
+//	"from" -- the text name of the file to copy
+//	"to" -- the name of the copy
+//----------------------------------------------------------------------
+
+bool FileSystem::Clone(char *from, char *to)
+{
+    char *from_arr[2 * MaxPathDepth];
+    char *to_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int fromCount = ResolvePath(from_arr, from, &scratch);
+    int toCount = ResolvePath(to_arr, to, &scratch);
+    FileHeader hdr; // only needed until it is written out
+    FileHeader *fromHdr;
+    char *to_name;
+    int fromSector = -1, sector = -1;
+    bool success = FALSE;
+    MountEntry *fromMount, *toMount;
+    char *fromRest, *toRest;
+
+    fromMount = Route(from, &fromRest, &scratch);
+    toMount = Route(to, &toRest, &scratch);
+    if (fromMount != toMount)
+        return FALSE; // the sectors would be on another disk
+    if (fromMount != NULL)
+    {
+        MountScope scope(fromMount);
+
+        return fromMount->fileSystem->Clone(fromRest, toRest);
+    }
+    if (fromCount == 0 || toCount == 0 || readOnly)
+        return FALSE;
+    to_name = to_arr[toCount - 1];
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite();
+    if (changeToRightDir(from_arr, fromCount - 1)
+        && currentDirectory->FindType(from_arr[fromCount - 1]) == IS_FILE)
+        fromSector = currentDirectory->Find(from_arr[fromCount - 1]);
+    if (fromSector != -1)
+    {
+        fromHdr = kernel->inodeTable->Acquire(fromSector);
+        if (kernel->inodeTable->RefCount(fromSector) == 1
+            && !fromHdr->IsExtentBased() && !fromHdr->IsCompressed()
+            && (fromHdr->IsInline() || MakeShareMap())
+            && changeToRightDir(to_arr, toCount - 1)
+            && currentDirectory->Find(to_name) == -1)
+        {
+            freeMap->PlaceNear(currentDirectorySector, 1);
+            sector = freeMap->FindAndSet();
+        }
+        if (sector != -1 && !AddToCurrentDirectory(to_name, sector, IS_FILE))
+        {
+            freeMap->Clear(sector);
+            sector = -1;
+        }
+        if (sector != -1)
+        {
+            freeMap->SetGoal(sector); // the tables go after the header
+            success = hdr.Clone(freeMap, fromHdr);
+            if (!success)
+            {
+                currentDirectory->Remove(to_name);
+                freeMap->Clear(sector);
+            }
+        }
+        kernel->inodeTable->Release(fromSector);
+    }
+    if (success)
+    {
+        DEBUG(dbgFile, "Cloned " << from << " to " << to);
+        hdr.WriteBack(sector);
+        currentDirectory->WriteBack(currentDirectoryFile);
+        dentries->Invalidate(to_arr, toCount);
+    }
+    freeMap->WriteBack(freeMapFile); // and the share map, if it is new
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CopyFile
+// 	Make the new file "to" a copy of the file "from", in the same
+//	header format, without the bytes leaving the kernel.  Where it
+//	can, the copy shares the sectors of "from" (see Clone), and costs
+//	only its header and tables; otherwise -- a file that is open, or
+//	in the extent or compressed format -- the bytes are copied, a
+//	run of sectors at a time (see CopyBytes).
+//
+//	A copy from one file system into another has its bytes copied,
+//	into a file in the usual format (see Create).
+//
+//	Return FALSE if "from" is not a file, "to" exists already, or the
+//	disk is too full; a copy the disk filled up during is removed.
+//----------------------------------------------------------------------
+
+bool FileSystem::CopyFile(char *from, char *to)
+{
+    char *from_arr[2 * MaxPathDepth];
+    char *to_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int fromCount = ResolvePath(from_arr, from, &scratch);
+    int toCount = ResolvePath(to_arr, to, &scratch);
+    OpenFile *fromFile = NULL, *toFile;
+    FileHeader *fromHdr;
+    bool useExtents, compressed, success;
+    int length;
+    MountEntry *fromMount, *toMount;
+    char *fromRest, *toRest;
+
+    fromMount = Route(from, &fromRest, &scratch);
+    toMount = Route(to, &toRest, &scratch);
+    if (fromMount == toMount && fromMount != NULL)
+    {
+        MountScope scope(fromMount);
+
+        return fromMount->fileSystem->CopyFile(fromRest, toRest);
+    }
+    if (fromMount != toMount)
+    {
+        StatInfo info; // each of these finds its own way
+
+        if (!Stat(from, &info) || info.type != IS_FILE
+            || !Create(to, info.length))
+            return FALSE;
+        fromFile = Open(from);
+        toFile = Open(to);
+        success = (CopyBytes(fromFile, 0, toFile, 0, info.length)
+                   == info.length);
+        delete toFile;
+        delete fromFile;
+        if (!success)
+            Remove(to);
+        DEBUG(dbgFile, "Copying " << from << " to " << to << " across file "
+                       "systems" << (success ? "" : " failed"));
+        return success;
+    }
+    if (Clone(from, to))
+        return TRUE;
+    if (fromCount == 0 || toCount == 0)
+        return FALSE;
+    namespaceLock->AcquireWrite();
+    if (changeToRightDir(to_arr, toCount - 1) // Create needs it there
+        && currentDirectory->Find(to_arr[toCount - 1]) == -1
+        && changeToRightDir(from_arr, fromCount - 1)
+        && currentDirectory->FindType(from_arr[fromCount - 1]) == IS_FILE)
+        fromFile = new OpenFile(currentDirectory->Find(from_arr[fromCount - 1]));
+    namespaceLock->ReleaseWrite();
+    if (fromFile == NULL)
+        return FALSE;
+    fromHdr = kernel->inodeTable->Acquire(fromFile->HeaderSector());
+    useExtents = fromHdr->IsExtentBased();
+    compressed = fromHdr->IsCompressed();
+    kernel->inodeTable->Release(fromFile->HeaderSector());
+    length = fromFile->Length();
+    success = Create(to, length, useExtents, compressed);
+    if (success)
+    {
+        toFile = Open(to);
+        success = (CopyBytes(fromFile, 0, toFile, 0, length) == length);
+        delete toFile;
+        if (!success)
+            Remove(to);
+    }
+    delete fromFile;
+    DEBUG(dbgFile, "Copying " << from << " to " << to << (success ? "" : " failed"));
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeTree
+// 	Give back the sectors of the file or directory whose header is
+//	at "sector" and, for a directory, first those of everything in
+//	it, depth first.  Each directory is read once, an entry at a time
+//	(see DirectoryIterator).  Nothing is written back: the directories
+//	in the tree are all going, and only the free map in memory
+//	changes.  One that is open is left to the reclaimer instead (see
+//	QueueOrphan).  The caller holds freeMapLock to write.
+//
+//	"sector" -- the header of the file or directory
+//	"type" -- IS_FILE or IS_DIR
+//----------------------------------------------------------------------
+
+void FileSystem::FreeTree(int sector, int type)
+{
+    FileHeader *hdr;
+    DirectoryEntry entry;
+
+    if (type == IS_DIR)
+    {
+        OpenFile dirFile(sector);
+        DirectoryIterator it(&dirFile, 0);
+
+        PrefetchSubdirectories(sector);
+        while (it.Next(&entry))
+            FreeTree(entry.sector, entry.inUse);
+    }
+    hdr = kernel->inodeTable->Acquire(sector);
+    if (kernel->inodeTable->RefCount(sector) == 1 || !QueueOrphan(sector))
+    {
+        hdr->Deallocate(freeMap);
+        freeMap->Clear(sector);
+    }
+    kernel->inodeTable->Release(sector);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PrefetchSubdirectories
+// 	With -tp, a walk down the tree (ListRecursive, FreeTree) is going
+//	into the directory whose header is at "dirSector": start reading
+//	the headers of the first TreePrefetch directories in it, all at
+//	once, each with the sectors after it, where its entries usually
+//	start; and then, as the headers arrive, the first sector of the
+//	entries of each one whose entries are elsewhere.  Going into each
+//	of them in turn then finds what it reads first in the buffer
+//	cache, and the disk gets the requests together, to take in the
+//	order it likes, rather than one at a time as the walk gets to
+//	them.
+//
+//	It pays when the disk is striped (-dn): the requests then go to
+//	several disks at once.  On one disk, which reads ahead along the
+//	track anyway, the walk is as fast or faster without it.
+//
+//	The directory itself is read through here first; the walk then
+//	reads it again from the cache.
+//----------------------------------------------------------------------
+
+void FileSystem::PrefetchSubdirectories(int dirSector)
+{
+    int children[TreePrefetch];
+    int numChildren = 0;
+    DirectoryEntry entry;
+
+    if (!kernel->treePrefetch)
+        return;
+
+    OpenFile dirFile(dirSector);
+    DirectoryIterator it(&dirFile, 0);
+
+    while (numChildren < TreePrefetch && it.Next(&entry))
+    {
+        if (entry.inUse == IS_DIR)
+        {
+            children[numChildren++] = entry.sector;
+            kernel->bufferCache->Prefetch(entry.sector, TreePrefetchRun);
+        }
+    }
+    for (int i = 0; i < numChildren; i++)
+    {
+        FileHeader hdr;
+        int first;
+
+        hdr.FetchFrom(children[i]); // waits for it, if it is on its way
+        if (hdr.FileLength() == 0 || hdr.IsInline() || hdr.IsCompressed())
+            continue;
+        hdr.ByteRangeToSectors(0, 1, &first);
+        if (!FileHeader::IsUnwritten(first) && (first < children[i]
+                || first >= children[i] + TreePrefetchRun))
+            kernel->bufferCache->Prefetch(first, 1);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::List
+// 	List all the files in the file system directory.  The directory
+//	is read an entry at a time (see DirectoryIterator), and it does
+//	not become the current one.
+//----------------------------------------------------------------------
+
+void FileSystem::List(char *path)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, path, &scratch);
+    DirectoryEntry entry;
+    int sector;
+    MountEntry *m;
+    char *rest;
+
+    m = Route(path, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        m->fileSystem->List(rest);
+        return;
+    }
+    LockForLookup();
+    sector = FindPath(dir_arr, count);
+    if (sector != -1)
+    {
+        OpenFile dirFile(sector);
+        DirectoryIterator it(&dirFile, 0);
+
+        while (it.Next(&entry))
+            printf("%s\t%s\n", entry.name, entry.inUse == IS_FILE ? "File" : "Dir");
+    }
+    UnlockForLookup();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ListRecursive
+// 	List all the files in a directory and, depth first, in every
+//	directory under it, in the form the HW04 answer files have: the
+//	entries of the directory, one "[i] name D" or "[i] name F" line
+//	each, or "Empty"; then, for each directory in it, a line of "="s
+//	and "Dir name", and that directory listed the same way (see
+//	ListLevel).  None of them becomes the current directory.
+//
+//	"path" -- the directory to start from
+//----------------------------------------------------------------------
+
+void FileSystem::ListRecursive(char *path)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, path, &scratch);
+    int sector;
+    MountEntry *m;
+    char *rest;
+
+    m = Route(path, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        m->fileSystem->ListRecursive(rest);
+        return;
+    }
+    LockForLookup();
+    sector = FindPath(dir_arr, count);
+    if (sector != -1)
+        ListLevel(sector, 1);
+    UnlockForLookup();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ListLevel
+// 	Print the part of ListRecursive for the directory whose header is
+//	at "sector", "depth" levels down (1 for the one it started from).
+//	Its entries are read once, with a DirectoryIterator, and the
+//	directories among them are kept to be gone into afterwards.
+//	Directories more than 2 * MaxPathDepth levels down are listed, but
+//	not gone into: no path could name what is in them.  A directory
+//	another file system is mounted on is listed from that one's root.
+//	The caller holds namespaceLock to read.
+//----------------------------------------------------------------------
+
+void FileSystem::ListLevel(int sector, int depth)
+{
+    OpenFile dirFile(sector);
+    DirectoryIterator it(&dirFile, 0);
+    ::List<DirectoryEntry *> subdirs; // not FileSystem::List
+    DirectoryEntry entry;
+    int i;
+
+    PrefetchSubdirectories(sector);
+    for (i = 0; it.Next(&entry); i++)
+    {
+        printf("[%d] %s %s \n", i, entry.name,
+               entry.inUse == IS_FILE ? "F" : "D");
+        if (entry.inUse == IS_DIR && depth < 2 * MaxPathDepth)
+        {
+            DirectoryEntry *dir = new DirectoryEntry;
+
+            *dir = entry;
+            subdirs.Append(dir);
+        }
+    }
+    if (i == 0)
+        printf("Empty\n");
+    while (!subdirs.IsEmpty())
+    {
+        DirectoryEntry *dir = subdirs.RemoveFront();
+
+        printf("=======================================\n");
+        printf("Dir %s\n", dir->name);
+        MountEntry *m = kernel->mounts->On(this, dir->sector);
+        if (m != NULL)
+        {
+            MountScope scope(m);
+            FileSystem *fs = m->fileSystem;
+
+            fs->LockForLookup();
+            fs->ListLevel(fs->rootSector, depth + 1);
+            fs->UnlockForLookup();
+        }
+        else
+            ListLevel(dir->sector, depth + 1);
+        delete dir;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReadDirectory
+// 	Copy up to "count" of the entries in use of an open directory of
+//	the running program, starting at its current position, into
+//	"entries" (like UNIX getdents).  The position is left alone;
+//	"next" is set to where the entries end, for the caller to Seek
+//	to once it has them.  Return how many entries were copied, 0 at
+//	the end of the directory, or -1 if "id" is not open.
+//----------------------------------------------------------------------
+
+int FileSystem::ReadDirectory(OpenFileId id, DirectoryEntry *entries, int count,
+                              int *next)
+{
+    OpenFile *file = Descriptors()->Get(id);
+    FileSystem *fs;
+    int n = 0;
+
+    if (file == NULL)
+        return -1;
+    fs = kernel->mounts->FileSystemOf(file->Mount()); // whose it is
+    fs->LockForLookup(); // so that the batch is all of a piece
+    DirectoryIterator it(file, file->Position());
+    while (n < count && it.Next(&entries[n]))
+        n++;
+    *next = it.Position();
+    fs->UnlockForLookup();
+    return n;
+}
+
+bool FileSystem::createDir(char *name)
+{
+    FileHeader hdr; // only needed until it is written out
+    int sector;
+    bool success;
+
+    DEBUG(dbgFile, "Creating Dir " << name);
+
+    if (currentDirectory->Find(name) != -1)
+        success = FALSE; // file is already in directory
+    else
+    {
+        // a new directory goes near its parent, if there is room
+        // there for its files too, so that it can keep them together
+        freeMap->PlaceNear(currentDirectorySector, NewDirectoryRoom);
+        sector = freeMap->FindAndSet(); // find a sector to hold the file header
+        if (sector == -1)
+            success = FALSE; // no free block for file header
+        else if (!AddToCurrentDirectory(name, sector, IS_DIR))
+        {
+            freeMap->Clear(sector);
+            success = FALSE; // no space in directory
+        }
+        else
+        {
+            if (!hdr.Allocate(freeMap, DirectoryFileSize))
+            {
+                currentDirectory->Remove(name);
+                freeMap->Clear(sector);
+                success = FALSE; // no space on disk for data
+            }
+            else
+            {
+                success = TRUE;
+                // everthing worked, flush all changes back to disk
+                hdr.WriteBack(sector);
+                kernel->inodeTable->ForgetStats(sector);
+                OpenFile newDirFile(sector);
+                Directory newDir(DirectoryFileSize);
+                newDir.WriteBack(&newDirFile);
+                currentDirectory->WriteBack(currentDirectoryFile);
+                freeMap->WriteBack(freeMapFile);
+            }
+        }
+    }
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::AddToCurrentDirectory
+// 	Add a name to the current directory, growing the directory first
+//	if it is full.  Return FALSE if the name is already there, or if
+//	the directory is full and there is no room on disk to grow it.
+//
+//	"name" -- the name of the file or directory being added
+//	"sector" -- the disk sector containing its header
+//	"type" -- IS_FILE or IS_DIR
+//----------------------------------------------------------------------
+
+bool FileSystem::AddToCurrentDirectory(char *name, int sector, int type)
+{
+    if (!currentDirectory->HasRoomFor(name) && currentDirectory->Find(name) == -1
+        && !GrowCurrentDirectory())
+        return FALSE;
+    return currentDirectory->Add(name, sector, type);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::GrowCurrentDirectory
+// 	Double the size of the current directory.  The directory file is
+//	extended in place; the header that changes is the one shared by
+//	every OpenFile on the directory (see inodetable.h), so they all
+//	see the new sectors.  The header and the directory are then
+//	written back right away, so the directory on disk says the new
+//	space is free.
+//
+//	If there is not enough free space, even once removed files are
+//	reclaimed, the directory keeps its old size and FALSE is returned.
+//----------------------------------------------------------------------
+
+bool FileSystem::GrowCurrentDirectory()
+{
+    int newSize = 2 * currentDirectory->Size();
+    FileHeader *hdr;
+
+    ASSERT(freeMapLock->IsHeldForWriteByCurrentThread());
+    hdr = kernel->inodeTable->Acquire(currentDirectorySector);
+
+    if (!hdr->Extend(freeMap, newSize)
+        && (!Reclaim() || !hdr->Extend(freeMap, newSize)))
+    {
+        DEBUG(dbgFile, "No space on disk to grow the directory.");
+        kernel->inodeTable->Release(currentDirectorySector);
+        return FALSE;
+    }
+    hdr->WriteBack(currentDirectorySector);
+    kernel->inodeTable->Release(currentDirectorySector);
+
+    DEBUG(dbgFile, "Growing directory to " << newSize << " bytes.");
+    currentDirectory->Expand(newSize);
+    currentDirectory->WriteBack(currentDirectoryFile);
+    freeMap->WriteBack(freeMapFile);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ExtendFile
+// 	Make an open file "newSize" bytes long (see FileHeader::Extend),
+//	for a write starting at "position".  On a disk with a superblock,
+//	only the sectors of the write are allocated; those between the
+//	old end and "position" are left as a hole (see
+//	FileHeader::ExtendSparse).  The free map is written back with the
+//	next operation that writes it, and the header when the file is
+//	closed.  Return FALSE if there is not enough free space, even
+//	once removed files are reclaimed.
+//
+//	With a journal, the free map is written back right away, in the
+//	same transaction as the index tables that Extend writes, so that
+//	after a crash no header can point at a sector the free map says
+//	is free (sectors taken by a file whose header was not written
+//	back are lost, rather).  The transaction need not be committed
+//	before we return, even in write-through mode: the header that
+//	points at the new sectors is written back in a later one, and
+//	commits go in order.
+//
+//	Only the free map is locked: the file's name is not involved.
+//	If the file is empty, its first sectors go right after its
+//	header.
+//
+//	"hdr" -- the header of the open file
+//	"hdrSector" -- where the header is on disk
+//	"position" -- where the write that extends the file starts
+//	"newSize" -- the new length of the file, in bytes
+//----------------------------------------------------------------------
+
+bool FileSystem::ExtendFile(FileHeader *hdr, int hdrSector, int position,
+                            int newSize)
+{
+    bool success;
+
+    kernel->bufferCache->BeginTransaction();
+    freeMapLock->AcquireWrite();
+    do
+    {
+        freeMap->SetGoal(hdrSector);
+        if (superBlock != NULL)
+            success = hdr->ExtendSparse(freeMap, newSize, position);
+        else
+            success = hdr->Extend(freeMap, newSize);
+    } while (!success && Reclaim()); // try again, if that made room
+    if (success && journal != NULL)
+        freeMap->WriteBack(freeMapFile); // along with its index tables
+    freeMapLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(FALSE); // see below
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FillHoles
+// 	Allocate the holes in "numBytes" bytes of an open file, from
+//	"position" on, before they are written, and copy the sectors
+//	among them shared with other files (see FileHeader::FillHoles).
+//	Return FALSE if there is not enough free space.  The free map and
+//	header are dealt with as in ExtendFile, except that once a shared
+//	sector has been copied, the header is written back right away, as
+//	in TruncateFile: on disk, it must not go on pointing at a sector
+//	the share map no longer counts it among the users of.
+//----------------------------------------------------------------------
+
+bool FileSystem::FillHoles(FileHeader *hdr, int hdrSector, int position,
+                           int numBytes)
+{
+    bool success, shared;
+
+    kernel->bufferCache->BeginTransaction();
+    freeMapLock->AcquireWrite();
+    shared = hdr->HasShared(freeMap, position, numBytes);
+    do
+    {
+        freeMap->SetGoal(hdrSector);
+        success = hdr->FillHoles(freeMap, position, numBytes);
+    } while (!success && Reclaim());
+    if (success && shared)
+        hdr->WriteBack(hdrSector); // see below
+    if (success && journal != NULL)
+        freeMap->WriteBack(freeMapFile);
+    freeMapLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(FALSE);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PreallocateFile
+// 	Set aside the sectors for "numBytes" bytes of an open file, from
+//	"position" on, making the file longer if they go past its end
+//	(see FileHeader::Preallocate).  Return FALSE, leaving the file as
+//	it was, if there is not enough free space.  The free map and
+//	header are dealt with as in ExtendFile.
+//
+//	Only a pointer-format file on a disk with a superblock can have
+//	unwritten sectors.  Any other file just gets longer, with its
+//	sectors allocated as Extend always does; the caller zeroes the
+//	new bytes (see OpenFile::Allocate).  A compressed file gets
+//	nothing set aside: its clusters take their sectors when they are
+//	written out.
+//----------------------------------------------------------------------
+
+bool FileSystem::PreallocateFile(FileHeader *hdr, int hdrSector, int position,
+                                 int numBytes)
+{
+    int oldSize = hdr->FileLength();
+    int newSize = max(oldSize, position + numBytes);
+    bool success;
+
+    kernel->bufferCache->BeginTransaction();
+    freeMapLock->AcquireWrite();
+    do
+    {
+        freeMap->SetGoal(hdrSector);
+        if (superBlock == NULL || hdr->IsInline() || hdr->IsExtentBased()
+            || hdr->IsCompressed())
+            success = hdr->Extend(freeMap, newSize);
+        else
+        {
+            // the new bytes start out as a hole, which is then filled in
+            success = hdr->ExtendSparse(freeMap, newSize, newSize)
+                      && hdr->Preallocate(freeMap, position, numBytes);
+            if (!success)
+                hdr->Truncate(freeMap, oldSize);
+        }
+    } while (!success && Reclaim());
+    if (success && journal != NULL)
+        freeMap->WriteBack(freeMapFile);
+    freeMapLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(FALSE);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::TruncateFile
+// 	Make an open file "newSize" bytes long, which is no longer than it
+//	is, giving the sectors past the new end back to the free map (see
+//	FileHeader::Truncate).  Unlike ExtendFile, this writes the header
+//	back right away, in the same transaction as the free map (when
+//	there is a journal): a sector given back may go to another file
+//	at once, and after a crash the old header must not still point
+//	at it.
+//----------------------------------------------------------------------
+
+void FileSystem::TruncateFile(FileHeader *hdr, int hdrSector, int newSize)
+{
+    kernel->bufferCache->BeginTransaction();
+    freeMapLock->AcquireWrite();
+    hdr->Truncate(freeMap, newSize);
+    hdr->WriteBack(hdrSector);
+    if (journal != NULL)
+        freeMap->WriteBack(freeMapFile);
+    freeMapLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StoreCluster
+// 	Write out the "which"-th cluster of an open compressed file,
+//	compressed into the "count" sectors at "packed", taking the
+//	sectors it needs from the free map and giving back those it no
+//	longer does (see FileHeader::StoreCluster).  Return FALSE if
+//	there is no run of free sectors long enough, even after
+//	reclaiming.
+//
+//	The header is written back in the same transaction as the free
+//	map, as in TruncateFile: the sectors given back may go to another
+//	file at once.
+//----------------------------------------------------------------------
+
+bool FileSystem::StoreCluster(FileHeader *hdr, int hdrSector, int which,
+                              char *packed, int count)
+{
+    bool success;
+
+    kernel->bufferCache->BeginTransaction();
+    freeMapLock->AcquireWrite();
+    do
+    {
+        freeMap->SetGoal(hdrSector);
+        success = hdr->StoreCluster(freeMap, which, packed, count);
+    } while (!success && Reclaim());
+    if (success)
+    {
+        hdr->WriteBack(hdrSector);
+        if (journal != NULL)
+            freeMap->WriteBack(freeMapFile);
+    }
+    freeMapLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(FALSE);
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FreeSectors
+// 	Return how many sectors of the disk are free.
+//----------------------------------------------------------------------
+
+int FileSystem::FreeSectors()
+{
+    int numFree;
+
+    freeMapLock->AcquireRead();
+    numFree = freeMap->NumClear();
+    freeMapLock->ReleaseRead();
+    return numFree;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::HasShared
+// 	Return TRUE if "numBytes" bytes of an open file, from "position"
+//	on, are in a sector it shares with another file, which has to be
+//	copied before they are written (see FillHoles).  If no sector is
+//	shared at all, as on most disks, the free map is not even locked;
+//	nor is it when the caller holds it already, to write out the free
+//	map, the share map or a directory, none of which share sectors.
+//----------------------------------------------------------------------
+
+bool FileSystem::HasShared(FileHeader *hdr, int position, int numBytes)
+{
+    bool shared;
+
+    if (freeMap->NumShared() == 0)
+        return FALSE;
+    if (freeMapLock->IsHeldForWriteByCurrentThread())
+        return hdr->HasShared(freeMap, position, numBytes);
+    freeMapLock->AcquireRead();
+    shared = hdr->HasShared(freeMap, position, numBytes);
+    freeMapLock->ReleaseRead();
+    return shared;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::QueueOrphan
+// 	Leave the sectors of a file being removed to the reclaimer
+//	thread.  Its header sector stays allocated, and goes in the
+//	orphan table, which is written out in the caller's transaction,
+//	along with the directory the file is taken out of.  So after a
+//	crash, the file is either still in its directory or in the
+//	orphan table, and mounting finds it there.
+//
+//	The orphan table gets a sector the first time it is needed.
+//	Return FALSE, for the caller to give the sectors back itself, if
+//	the disk has no superblock to record it in, or no room for it.
+//	The caller holds freeMapLock to write.
+//
+//	"sector" -- the header of the file being removed
+//----------------------------------------------------------------------
+
+bool FileSystem::QueueOrphan(int sector)
+{
+    ASSERT(freeMapLock->IsHeldForWriteByCurrentThread());
+    if (superBlock == NULL)
+        return FALSE;
+    if (orphans == NULL)
+    {
+        int tableSector = freeMap->FindAndSet();
+        if (tableSector == -1)
+            return FALSE;
+        orphans = new OrphanTable;
+        orphans->numOrphans = 0;
+        superBlock->orphanSector = tableSector;
+        superBlock->WriteBack(SuperBlockSector);
+    }
+    if (orphans->numOrphans == MaxOrphans)
+        return FALSE;
+    DEBUG(dbgFile, "Leaving the sectors of header " << sector << " to the reclaimer.");
+    orphans->headers[orphans->numOrphans++] = sector;
+    kernel->bufferCache->WriteSector(superBlock->orphanSector, (char *)orphans);
+    orphansQueued->V(); // it runs once we let go of the free map
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Reclaim
+// 	Give back the sectors of every file in the orphan table that is
+//	not open any more, and take it out of the table.  One still open
+//	is left for next time.  The free map and the table are written
+//	out once for all of them, in one transaction.  The caller holds
+//	freeMapLock to write.  Return TRUE if any file was reclaimed.
+//----------------------------------------------------------------------
+
+bool FileSystem::Reclaim()
+{
+    FileHeader *hdr;
+    int sector, kept = 0;
+    bool reclaimed;
+
+    ASSERT(freeMapLock->IsHeldForWriteByCurrentThread());
+    if (orphans == NULL || orphans->numOrphans == 0)
+        return FALSE;
+    kernel->bufferCache->BeginTransaction();
+    for (int i = 0; i < orphans->numOrphans; i++)
+    {
+        sector = orphans->headers[i];
+        // waits for a last close that is writing the header back
+        hdr = kernel->inodeTable->Acquire(sector);
+        if (kernel->inodeTable->RefCount(sector) > 1)
+            orphans->headers[kept++] = sector; // still open
+        else
+        {
+            DEBUG(dbgFile, "Reclaiming the sectors of header " << sector);
+            hdr->Deallocate(freeMap);
+            freeMap->Clear(sector);
+        }
+        kernel->inodeTable->Release(sector);
+    }
+    reclaimed = kept < orphans->numOrphans;
+    orphans->numOrphans = kept;
+    if (reclaimed)
+    {
+        freeMap->WriteBack(freeMapFile);
+        kernel->bufferCache->WriteSector(superBlock->orphanSector,
+                                         (char *)orphans);
+    }
+    kernel->bufferCache->EndTransaction(TRUE);
+    return reclaimed;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::MakeRoom
+// 	Reclaim removed files now, rather than waiting for the reclaimer,
+//	if fewer than "numSectors" sectors are free: otherwise removing a
+//	file would not make room for a new one right away.  The caller
+//	holds freeMapLock to write.
+//----------------------------------------------------------------------
+
+void FileSystem::MakeRoom(int numSectors)
+{
+    if (freeMap->NumClear() < numSectors)
+        Reclaim();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Reclaimer
+// 	The reclaimer thread: each time files are removed, give back
+//	their sectors, all in one go.  It only holds up other threads
+//	that allocate or free sectors.  When the file system is being
+//	unmounted, it reclaims one last time, and finishes.
+//
+//	"data" -- the file system
+//----------------------------------------------------------------------
+
+void FileSystem::Reclaimer(void *data)
+{
+    FileSystem *fs = (FileSystem *)data;
+    bool last;
+
+    do
+    {
+        fs->orphansQueued->P();
+        last = fs->unmounting;
+        fs->freeMapLock->AcquireWrite();
+        fs->Reclaim();
+        fs->freeMapLock->ReleaseWrite();
+    } while (!last);
+    fs->reclaimerDone->V();
+}
+
+//----------------------------------------------------------------------
+// DataSectors
+// 	Store in "sectors" the disk sectors holding the data of a file,
+//	in the order of the file, and return how many there are.  Holes
+//	have none, and are left out; an unwritten sector is put in
+//	without its UnwrittenFlag, since it is on the disk all the same.
+//	An inline file has none.  A compressed file has the sectors of
+//	each of its clusters.
+//
+//	"sectors" -- room for ClusterSectors entries per cluster of the
+//		file (see DataSectorsRoom)
+//----------------------------------------------------------------------
+
+static int
+DataSectors(FileHeader *hdr, int *sectors)
+{
+    int numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    int count = 0;
+
+    if (hdr->IsCompressed())
+        return hdr->CompressedSectors(sectors);
+    if (hdr->IsInline() || numSectors == 0)
+        return 0;
+    hdr->ByteRangeToSectors(0, hdr->FileLength(), sectors);
+    for (int i = 0; i < numSectors; i++)
+    {
+        if (sectors[i] != HoleSector)
+            sectors[count++] = sectors[i] & ~UnwrittenFlag;
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// DataSectorsRoom
+// 	Return how many entries DataSectors may need: one per sector of
+//	the file, but a compressed cluster that did not compress may
+//	take more sectors than the file has bytes for.
+//----------------------------------------------------------------------
+
+static int
+DataSectorsRoom(FileHeader *hdr)
+{
+    return max(1, divRoundUp(hdr->FileLength(), ClusterSize) * ClusterSectors);
+}
+
+//----------------------------------------------------------------------
+// CountRuns
+// 	Return how many runs of consecutive disk sectors the "count"
+//	entries of "sectors" fall into, and set "*ticks" to an estimate of
+//	the time reading them in order spends getting from the end of
+//	one run to the start of the next.  As in Disk::TimeToSeek, the
+//	head moves one track per SeekTime; then it waits RotationTime
+//	for each sector that goes by before the one it wants.
+//----------------------------------------------------------------------
+
+static int
+CountRuns(int *sectors, int count, int *ticks)
+{
+    int runs = (count > 0) ? 1 : 0;
+
+    *ticks = 0;
+    for (int i = 1; i < count; i++)
+    {
+        int last = sectors[i - 1], next = sectors[i];
+
+        if (next == last + 1)
+            continue;
+        runs++;
+        *ticks += abs(next / SectorsPerTrack - last / SectorsPerTrack) * SeekTime
+               + (((next - last - 1) % SectorsPerTrack + SectorsPerTrack)
+                  % SectorsPerTrack) * RotationTime;
+    }
+    return runs;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PrintFragmentation
+// 	Print how many data sectors a file has, how many runs of
+//	consecutive sectors they are in, and about how long reading the
+//	file through spends seeking from one run to the next (see
+//	CountRuns).  The file may be a directory.
+//
+//	"name" -- the text name of the file
+//----------------------------------------------------------------------
+
+void FileSystem::PrintFragmentation(char *name)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    FileHeader *hdr;
+    int *sectors;
+    int sector, numSectors, runs, ticks;
+    MountEntry *m;
+    char *rest;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        m->fileSystem->PrintFragmentation(rest);
+        return;
+    }
+    LockForLookup();
+    sector = FindPath(dir_arr, count);
+    if (sector == -1)
+    {
+        UnlockForLookup();
+        printf("No file %s\n", name);
+        return;
+    }
+    hdr = kernel->inodeTable->Acquire(sector);
+    sectors = (int *)scratch.Alloc(DataSectorsRoom(hdr) * sizeof(int));
+    numSectors = DataSectors(hdr, sectors);
+    runs = CountRuns(sectors, numSectors, &ticks);
+    kernel->inodeTable->Release(sector);
+    UnlockForLookup();
+    printf("%s: %d sectors in %d runs, about %d ticks seeking between them\n",
+           name, numSectors, runs, ticks);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Stat
+// 	Say how long the file "name" is, whether it is a directory, and
+//	how its data lies on disk, without opening it: no descriptor is
+//	taken, and its header is only read if the inode table does not
+//	have it already (see inodetable.h).  The directory it is in is
+//	found through the dentry cache, as for Open; the name is looked
+//	up in it to find its type.  "/" is the root directory.  Return
+//	FALSE if there is no such file.
+//
+//	"name" -- the text name of the file
+//	"info" -- where to put what is found
+//----------------------------------------------------------------------
+
+bool FileSystem::Stat(char *name, StatInfo *info)
+{
+    ProfileRegion region("FileSystem::Stat");
+    char *dir_arr[2 * MaxPathDepth];
+    Arena scratch;
+    int count = ResolvePath(dir_arr, name, &scratch);
+    FileHeader *hdr;
+    int *sectors;
+    int sector, type, ticks;
+    MountEntry *m;
+    char *rest;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        return m->fileSystem->Stat(rest, info);
+    }
+    LockForLookup();
+    if (count == 0)
+    {
+        sector = rootSector;
+        type = IS_DIR;
+    }
+    else
+    {
+        int dirSector = FindPath(dir_arr, count - 1);
+
+        sector = (dirSector == -1) ? -1
+                 : FindInDirectory(dirSector, dir_arr[count - 1], &type);
+    }
+    if (sector == -1)
+    {
+        UnlockForLookup();
+        return FALSE;
+    }
+    hdr = kernel->inodeTable->Acquire(sector);
+    sectors = (int *)scratch.Alloc(DataSectorsRoom(hdr) * sizeof(int));
+    info->length = hdr->FileLength();
+    info->numSectors = DataSectors(hdr, sectors);
+    info->numFragments = CountRuns(sectors, info->numSectors, &ticks);
+    info->type = type;
+    kernel->inodeTable->Release(sector);
+    UnlockForLookup();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DefragmentFile
+// 	Move the data of the file whose header is at "sector" into one
+//	run of free sectors, near the header, if it is in more than one
+//	run now and there is a free run long enough.  A file that is open
+//	is left alone, since its readers and writers may be using the
+//	sectors it has now; so is an inline file, which has none, and a
+//	compressed one, whose clusters move whenever they are written
+//	out, or one that shares sectors with other files, which would
+//	each need a copy of their own.  Return TRUE if the file was moved.
+//
+//	The data is copied to the new sectors, and they are made sure to
+//	be on disk, before anything says they belong to the file.  Then
+//	the header, its indirect tables and the free map, with the old
+//	sectors given back, are written in one transaction.  So after a
+//	crash the file is either where it was, with the new sectors still
+//	free, or where it went.  Only the metadata goes through the
+//	journal.
+//
+//	The caller holds namespaceLock to write, so the file cannot be
+//	opened while it moves.
+//----------------------------------------------------------------------
+
+bool FileSystem::DefragmentFile(int sector)
+{
+    FileHeader *hdr;
+    Arena scratch;
+    int *sectors, *newSectors;
+    char *buffer;
+    int count, runs, ticks, start, length;
+    bool moved = FALSE;
+
+    ASSERT(namespaceLock->IsHeldForWriteByCurrentThread());
+    freeMapLock->AcquireWrite();
+    hdr = kernel->inodeTable->Acquire(sector);
+    sectors = (int *)scratch.Alloc(DataSectorsRoom(hdr) * sizeof(int));
+    count = DataSectors(hdr, sectors);
+    runs = CountRuns(sectors, count, &ticks);
+    for (int i = 0; i < count && runs > 1; i++)
+        if (freeMap->IsShared(sectors[i]))
+            runs = 1; // moving it would stop it sharing
+    if (runs > 1 && kernel->inodeTable->RefCount(sector) == 1 && !hdr->IsCompressed())
+    {
+        freeMap->SetGoal(sector);
+        start = freeMap->FindRun(count, &length);
+        if (length == count)
+        {
+            DEBUG(dbgFile, "Moving the " << count << " sectors of header "
+                  << sector << ", in " << runs << " runs, to " << start);
+            newSectors = (int *)scratch.Alloc(count * sizeof(int));
+            buffer = (char *)scratch.Alloc(SectorsPerTrack * SectorSize);
+            for (int i = 0; i < count; i++)
+            {
+                freeMap->Mark(start + i);
+                newSectors[i] = start + i;
+            }
+            for (int i = 0, n; i < count; i += n)
+            {
+                n = min(FileHeader::RunLength(sectors, i, count), SectorsPerTrack);
+                kernel->bufferCache->ReadSectors(sectors[i], n, buffer);
+                kernel->bufferCache->WriteSectors(start + i, n, buffer);
+            }
+            kernel->bufferCache->SyncSectors(newSectors, count);
+
+            kernel->bufferCache->BeginTransaction();
+            hdr->Relocate(start);
+            hdr->WriteBack(sector);
+            for (int i = 0; i < count; i++)
+                freeMap->Clear(sectors[i]);
+            freeMap->WriteBack(freeMapFile);
+            kernel->bufferCache->EndTransaction(TRUE);
+            moved = TRUE;
+        }
+    }
+    kernel->inodeTable->Release(sector);
+    freeMapLock->ReleaseWrite();
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// CollectPaths
+// 	Append to "paths" the full path name of every file and directory
+//	under the directory whose header is at "sector", depth first.
+//	Directories more than 2 * MaxPathDepth levels down are not gone
+//	into, as in FileSystem::ListRecursive.  The caller holds
+//	namespaceLock to read.
+//
+//	"path" -- the path of the directory, "" for the root
+//	"depth" -- how many levels down it is, 1 for the root
+//----------------------------------------------------------------------
+
+static void
+CollectPaths(int sector, char *path, int depth, List<char *> *paths)
+{
+    OpenFile dirFile(sector);
+    DirectoryIterator it(&dirFile, 0);
+    DirectoryEntry entry;
+    int len = strlen(path);
+
+    while (it.Next(&entry))
+    {
+        char *name = new char[len + strlen(entry.name) + 2];
+
+        sprintf(name, "%s/%s", path, entry.name);
+        paths->Append(name);
+        if (entry.inUse == IS_DIR && depth < 2 * MaxPathDepth)
+            CollectPaths(entry.sector, name, depth + 1, paths);
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StartDefragmenter
+// 	Fork the defragmenter, a background thread (see
+//	Thread::background) that goes once over every file and directory
+//	on the disk, moving each one that is fragmented into a run of
+//	its own (see DefragmentFile).  Nothing happens if it is running
+//	already, or if the disk has no superblock, and so no journal to
+//	make a move safe.
+//----------------------------------------------------------------------
+
+void FileSystem::StartDefragmenter()
+{
+    Thread *t;
+
+    if (defragmenting || superBlock == NULL || readOnly)
+        return;
+    defragmenting = TRUE;
+    t = new Thread("defragmenter", 1);
+    t->background = TRUE;
+    t->ioClass = IoIdle;
+    t->Fork((VoidFunctionPtr)FileSystem::Defragmenter, (void *)this);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WaitForDefragmenter
+// 	Wait for the defragmenter, if it is running, to finish.
+//----------------------------------------------------------------------
+
+void FileSystem::WaitForDefragmenter()
+{
+    if (defragmenting)
+    {
+        defragmenterDone->P();
+        defragmenting = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Defragmenter
+// 	The defragmenter thread.  The names of the files are gathered
+//	first, holding namespaceLock to read; then each one is looked up
+//	again, and moved, holding it to write, one file at a time, and
+//	giving up the CPU in between.  So the rest of the file system is
+//	only held up for as long as one file takes to copy, and a file
+//	removed or renamed in the meantime is just not found.
+//
+//	"data" -- the file system
+//----------------------------------------------------------------------
+
+void FileSystem::Defragmenter(void *data)
+{
+    FileSystem *fs = (FileSystem *)data;
+    ::List<char *> *paths = new ::List<char *>; // not FileSystem::List
+    int numFiles = 0, numMoved = 0;
+
+    fs->namespaceLock->AcquireRead();
+    CollectPaths(fs->rootSector, "", 1, paths);
+    fs->namespaceLock->ReleaseRead();
+    while (!paths->IsEmpty())
+    {
+        char *path = paths->RemoveFront();
+        char *dir_arr[2 * MaxPathDepth];
+        Arena scratch;
+        int count = fs->splitPath(dir_arr, path, &scratch);
+        int sector = fs->rootSector;
+
+        fs->namespaceLock->AcquireWrite();
+        for (int i = 0; i < count && sector != -1; i++)
+            sector = fs->FindInDirectory(sector, dir_arr[i]);
+        if (sector != -1)
+        {
+            numFiles++;
+            if (fs->DefragmentFile(sector))
+                numMoved++;
+        }
+        fs->namespaceLock->ReleaseWrite();
+        delete[] path;
+        kernel->currentThread->Yield();
+    }
+    delete paths;
+    DEBUG(dbgFile, "Defragmenter moved " << numMoved << " of " << numFiles
+          << " files.");
+    fs->defragmenterDone->V();
+}
+
+//----------------------------------------------------------------------
+// SectorIndex
+// 	The sectors Deduplicate has seen so far, by a hash of their
+//	bytes: the first sector seen with each hash.  Two sectors with
+//	the same hash are only shared once their bytes are compared.
+//----------------------------------------------------------------------
+
+class SectorPrint
+{
+public:
+    unsigned hash; // of the sector's bytes
+    int sector;
+};
+
+static unsigned PrintHash(SectorPrint *print) { return print->hash; }
+static unsigned HashOfHash(unsigned hash) { return hash; }
+
+class SectorIndex
+{
+public:
+    SectorIndex() : table(PrintHash, HashOfHash) {}
+    ~SectorIndex()
+    {
+        while (!prints.IsEmpty())
+            delete table.Remove(prints.RemoveFront()->hash);
+    }
+    bool Find(unsigned hash, int *sector)
+    {
+        SectorPrint *print;
+
+        if (!table.Find(hash, &print))
+            return FALSE;
+        *sector = print->sector;
+        return TRUE;
+    }
+    void Insert(unsigned hash, int sector)
+    {
+        SectorPrint *print = new SectorPrint;
+
+        print->hash = hash;
+        print->sector = sector;
+        table.Insert(print);
+        prints.Append(print);
+    }
+
+private:
+    HashTable<unsigned, SectorPrint *> table;
+    List<SectorPrint *> prints; // to delete them by
+};
+
+//----------------------------------------------------------------------
+// HashSector
+// 	Return a hash of the SectorSize bytes at "data" (FNV-1a).
+//----------------------------------------------------------------------
+
+static unsigned
+HashSector(char *data)
+{
+    unsigned hash = 2166136261U;
+
+    for (int i = 0; i < SectorSize; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 16777619U;
+    return hash;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Deduplicate
+// 	Go once over every file on the disk, and make each data sector
+//	that holds the same bytes as one seen before shared with it (see
+//	FileHeader::ShareSector), giving back the sector of its own.  So
+//	the same inputs copied into many directories take the space of
+//	one of them.  Return how many sectors were freed.
+//
+//	Each sector read is entered in an index by a hash of its bytes
+//	(see SectorIndex); a later sector with the same hash is compared
+//	with the one in the index, and shared if they are the same.  Only
+//	pointer-format files share sectors, and only those not open, as
+//	for Clone.  Every file is dealt with in a transaction of its own
+//	(see DeduplicateFile).
+//
+//	The whole disk is held up while this runs: a sector in the index
+//	must not be given back and used again, for something else,
+//	before it is shared.  Nothing happens on a disk with no
+//	superblock, where there can be no share map.
+//----------------------------------------------------------------------
+
+int FileSystem::Deduplicate()
+{
+    SectorIndex *index;
+    int numFreed = 0;
+    bool made;
+
+    if (readOnly)
+        return 0;
+    index = new SectorIndex;
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite();
+    kernel->bufferCache->BeginTransaction();
+    made = MakeShareMap();
+    if (made)
+        freeMap->WriteBack(freeMapFile);
+    kernel->bufferCache->EndTransaction(TRUE);
+    if (made)
+        numFreed = DeduplicateTree(rootSector, 1, index);
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    delete index;
+    DEBUG(dbgFile, "Deduplicating freed " << numFreed << " sectors.");
+    return numFreed;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Check the file system on the disk (-fsck): find out which sectors
+//	are in use, and by how many files, from the sectors kept for the
+//	file system, the headers of its own files and of the removed ones
+//	not yet reclaimed, and the tree under the root (see fscheck.h).
+//	Then repair the free map, and the share counts, where they say
+//	otherwise.  The free map is counted again first, and a share map
+//	is made if sectors turn out to be shared and there is none.  The
+//	repairs are written in one transaction.
+//	Return how many problems were found.  Mounted read-only, they
+//	are only reported: the free map is put right in memory alone.
+//
+//	Nothing should be open but the file system's own files, and
+//	nothing else should run; both locks are held to write throughout.
+//----------------------------------------------------------------------
+
+int FileSystem::Check()
+{
+    FsChecker *checker = new FsChecker;
+    int numProblems;
+
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite();
+    if (superBlock != NULL)
+    {
+        checker->ClaimSector(SuperBlockSector, "the superblock");
+        for (int i = 0; i < superBlock->journalSectors; i++)
+            checker->ClaimSector(superBlock->journalStart + i, "the journal");
+        if (superBlock->orphanSector >= 0)
+            checker->ClaimSector(superBlock->orphanSector, "the orphan table");
+        if (superBlock->shareMapSector >= 0)
+            checker->ClaimFile(superBlock->shareMapSector, "the share map");
+    }
+    if (kernel->synchDisk->Log() != NULL)
+    {
+        for (int i = LogicalSectors; i < NumSectors; i++)
+            checker->ClaimSector(i, "the log's spare room");
+    }
+    checker->ClaimFile(freeMapSector, "the free map");
+    if (orphans != NULL)
+    {
+        for (int i = 0; i < orphans->numOrphans && i < MaxOrphans; i++)
+            checker->ClaimFile(orphans->headers[i], "a removed file");
+    }
+    checker->ClaimTree(rootSector);
+
+    // count the free sectors from the map itself: after a clean
+    // unmount, the summary was taken on trust, and it may be wrong too
+    freeMap->FetchFrom(freeMapFile);
+    kernel->bufferCache->BeginTransaction();
+    checker->CheckFreeMap(freeMap);
+    if (checker->NeedsShares() && shareMapFile == NULL && !readOnly
+        && MakeShareMap())
+        checker->ClaimFile(superBlock->shareMapSector, "the share map");
+    checker->CheckShares(freeMap, shareMapFile != NULL);
+    if (freeMap->IsDirty() && !readOnly)
+        freeMap->WriteBack(freeMapFile);
+    kernel->bufferCache->EndTransaction(TRUE);
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+
+    checker->Print();
+    numProblems = checker->NumProblems();
+    delete checker;
+    return numProblems;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DeduplicateTree
+// 	Deduplicate every file under the directory whose header is at
+//	"sector", depth first, as far down as CollectPaths goes.  Return
+//	how many sectors were freed.
+//
+//	"depth" -- how many levels down the directory is, 1 for the root
+//	"index" -- the sectors seen so far
+//----------------------------------------------------------------------
+
+int FileSystem::DeduplicateTree(int sector, int depth, SectorIndex *index)
+{
+    OpenFile dirFile(sector);
+    DirectoryIterator it(&dirFile, 0);
+    DirectoryEntry entry;
+    int numFreed = 0;
+
+    while (it.Next(&entry))
+    {
+        if (entry.inUse == IS_FILE)
+            numFreed += DeduplicateFile(entry.sector, index);
+        else if (entry.inUse == IS_DIR && depth < 2 * MaxPathDepth)
+            numFreed += DeduplicateTree(entry.sector, depth + 1, index);
+    }
+    return numFreed;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DeduplicateFile
+// 	Share each written sector of the file whose header is at
+//	"sector" that holds what a sector in "index" does, and enter the
+//	others in it.  The header, the tables that changed and the free
+//	map, with the share counts, are written in one transaction.
+//	Return how many sectors were freed.  The caller holds
+//	namespaceLock and freeMapLock to write.
+//----------------------------------------------------------------------
+
+int FileSystem::DeduplicateFile(int sector, SectorIndex *index)
+{
+    FileHeader *hdr;
+    Arena scratch;
+    int *sectors;
+    char data[SectorSize], other[SectorSize];
+    int numSectors, numFree = freeMap->NumClear(), shared = 0, found;
+    unsigned hash;
+
+    hdr = kernel->inodeTable->Acquire(sector);
+    numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    if (kernel->inodeTable->RefCount(sector) > 1 || hdr->IsInline()
+        || hdr->IsExtentBased() || hdr->IsCompressed() || numSectors == 0)
+    {
+        kernel->inodeTable->Release(sector);
+        return 0;
+    }
+    sectors = (int *)scratch.Alloc(numSectors * sizeof(int));
+    hdr->ByteRangeToSectors(0, hdr->FileLength(), sectors);
+    kernel->bufferCache->BeginTransaction();
+    for (int i = 0; i < numSectors; i++)
+    {
+        if (FileHeader::IsUnwritten(sectors[i]))
+            continue;
+        kernel->bufferCache->ReadSector(sectors[i], data);
+        hash = HashSector(data);
+        if (!index->Find(hash, &found))
+        {
+            index->Insert(hash, sectors[i]);
+            continue;
+        }
+        if (found == sectors[i] || !freeMap->CanShare(found))
+            continue;
+        kernel->bufferCache->ReadSector(found, other);
+        if (bcmp(data, other, SectorSize) != 0)
+            continue; // the same hash, but not the same bytes
+        hdr->ShareSector(freeMap, i, found);
+        shared++;
+    }
+    if (shared > 0)
+    {
+        DEBUG(dbgFile, "Header " << sector << " shares " << shared << " more sectors.");
+        hdr->WriteBack(sector);
+        freeMap->WriteBack(freeMapFile);
+    }
+    kernel->bufferCache->EndTransaction(TRUE);
+    kernel->inodeTable->Release(sector);
+    return freeMap->NumClear() - numFree;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::changeToRightDir
+// 	Make the directory named by the first "len" components of a path
+//	the current directory.  Paths start from the root, or if they are
+//	under it, from the working directory (see StartOfWalk).
+//
+//	Each prefix of the path is looked up in the dentry cache first,
+//	and a directory is only read when its prefix is not cached; the
+//	result of every such read (found or not) is entered in the cache.
+//	So once a path has been resolved, resolving it again reads no
+//	directory at all, unless the directory it names is not already
+//	the current one.
+//
+//	Return FALSE if some component of the path does not exist, or is
+//	a directory another file system is mounted on.  The caller must
+//	hold namespaceLock to write, since the current directory changes.
+//----------------------------------------------------------------------
+
+bool FileSystem::changeToRightDir(char **arr, int len)
+{
+    ProfileRegion region("changeToRightDir");
+    ASSERT(namespaceLock->IsHeldForWriteByCurrentThread());
+    DEBUG(dbgFile, " changeToRightDir : len = " << len);
+    int sector_num;
+    for (int i = StartOfWalk(arr, len, &sector_num); i < len; i++)
+    {
+        DEBUG(dbgFile, "Try switch to " << arr[i]);
+        int next;
+        if (!dentries->Lookup(arr, i + 1, &next))
+        {
+            // not cached; look in the directory we've got to so far
+            SwitchToDirectory(sector_num);
+            next = currentDirectory->Find(arr[i]);
+            dentries->Enter(arr, i + 1, next);
+        }
+        DEBUG(dbgFile, " changeToRightDir : sector_num = " << next);
+
+        // a directory another file system is mounted on is covered by
+        // it: what is in it is not ours to look at (see Route)
+        if (next == -1 || kernel->mounts->On(this, next) != NULL)
+        {
+            std::cout << "dir not found..\n";
+            return false;
+        }
+        sector_num = next;
+    }
+    SwitchToDirectory(sector_num);
+    return true;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindPath
+// 	Return the header sector of the directory named by the first
+//	"len" components of a path, or -1 if some component of the path
+//	does not exist, or is mounted on.  The same as changeToRightDir, but the current
+//	directory is left alone, so holding namespaceLock to read is
+//	enough.
+//----------------------------------------------------------------------
+
+int FileSystem::FindPath(char **arr, int len)
+{
+    ProfileRegion region("FileSystem::FindPath");
+    int sector_num;
+    for (int i = StartOfWalk(arr, len, &sector_num); i < len; i++)
+    {
+        int next;
+        if (!dentries->Lookup(arr, i + 1, &next))
+        {
+            next = FindInDirectory(sector_num, arr[i]);
+            dentries->Enter(arr, i + 1, next);
+        }
+        if (next == -1 || kernel->mounts->On(this, next) != NULL)
+        {
+            std::cout << "dir not found..\n";
+            return -1;
+        }
+        sector_num = next;
+    }
+    return sector_num;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindInDirectory
+// 	Return the header sector of "name" in the directory whose header
+//	is at "dirSector", or -1 if it is not there.  The current
+//	directory is already in memory; any other is read into a copy of
+//	our own, which readers cannot share.  Mounted read-only, every
+//	directory is read in once, and shared (see PinnedDirectory).
+//----------------------------------------------------------------------
+
+int FileSystem::FindInDirectory(int dirSector, char *name)
+{
+    ProfileRegion region("FileSystem::FindInDirectory");
+    if (readOnly)
+        return PinnedDirectory(dirSector)->Find(name);
+    if (dirSector == currentDirectorySector)
+        return currentDirectory->Find(name);
+
+    OpenFile dirFile(dirSector);
+    Directory dir(DirectoryFileSize);
+
+    PrefetchDirectory(dirSector);
+    dir.FetchFrom(&dirFile);
+    return dir.Find(name);
+}
+
+int FileSystem::FindInDirectory(int dirSector, char *name, int *type)
+{
+    ProfileRegion region("FileSystem::FindInDirectory");
+    if (readOnly)
+    {
+        Directory *dir = PinnedDirectory(dirSector);
+
+        *type = dir->FindType(name);
+        return dir->Find(name);
+    }
+    if (dirSector == currentDirectorySector)
+    {
+        *type = currentDirectory->FindType(name);
+        return currentDirectory->Find(name);
+    }
+
+    OpenFile dirFile(dirSector);
+    Directory dir(DirectoryFileSize);
+
+    PrefetchDirectory(dirSector);
+    dir.FetchFrom(&dirFile);
+    *type = dir.FindType(name);
+    return dir.Find(name);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::DirectoryRun
+// 	If the directory whose header is at "dirSector" has not grown,
+//	and its entries are in one run of sectors, set "first" to the
+//	first of them and return TRUE.
+//----------------------------------------------------------------------
+
+bool FileSystem::DirectoryRun(int dirSector, int *first)
+{
+    const int numSectors = divRoundUp(DirectoryFileSize, SectorSize);
+    int sectors[numSectors];
+    FileHeader hdr;
+
+    hdr.FetchFrom(dirSector);
+    if (hdr.FileLength() != DirectoryFileSize || hdr.IsInline()
+        || hdr.IsCompressed())
+        return FALSE;
+    hdr.ByteRangeToSectors(0, DirectoryFileSize, sectors);
+    for (int i = 0; i < numSectors; i++)
+    {
+        if (FileHeader::IsUnwritten(sectors[i]))
+            return FALSE;
+    }
+    if (FileHeader::RunLength(sectors, 0, numSectors) < numSectors)
+        return FALSE;
+    *first = sectors[0];
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PlaceHeader
+// 	Allocate a sector for the header of a file being created in the
+//	current directory, and return it, or -1 if the disk is full.
+//	With -eh, and if the directory has not grown, it is the first
+//	free one of the HeaderWindow sectors right after the entries, so
+//	that looking the file up reads its header too (see
+//	PrefetchDirectory).  freeMapLock is held to write.
+//----------------------------------------------------------------------
+
+int FileSystem::PlaceHeader()
+{
+    int first;
+
+    if (kernel->headersNearDirectory
+        && DirectoryRun(currentDirectorySector, &first))
+    {
+        int end = first + divRoundUp(DirectoryFileSize, SectorSize);
+
+        for (int s = end; s < end + HeaderWindow && s < NumSectors; s++)
+        {
+            if (!freeMap->Test(s))
+            {
+                freeMap->Mark(s);
+                return s;
+            }
+        }
+    }
+    return freeMap->FindAndSet();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PrefetchDirectory
+// 	With -eh, start reading the entries of the directory whose header
+//	is at "dirSector", if it has not grown, together with the
+//	sectors after them in its HeaderWindow up to the last one in use,
+//	as one request: the headers of the files created in it are
+//	there, so opening the one looked up finds its header in the
+//	buffer cache.  The entries are then read from the cache as
+//	usual, once the request is done.
+//
+//	The free map is looked at without freeMapLock: at worst a sector
+//	too many or too few is read.
+//----------------------------------------------------------------------
+
+void FileSystem::PrefetchDirectory(int dirSector)
+{
+    int first, numSectors = divRoundUp(DirectoryFileSize, SectorSize);
+    int extra = 0;
+
+    if (!kernel->headersNearDirectory || !DirectoryRun(dirSector, &first))
+        return;
+    for (int i = 0; i < HeaderWindow; i++)
+    {
+        int s = first + numSectors + i;
+
+        if (s < NumSectors && freeMap->Test(s))
+            extra = i + 1;
+    }
+    kernel->bufferCache->Prefetch(first, numSectors + extra);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::LockForLookup, FileSystem::UnlockForLookup
+// 	Take (and let go of) namespaceLock to read, to look something
+//	up.  Mounted read-only, nothing ever changes a directory, so
+//	nothing is taken.
+//----------------------------------------------------------------------
+
+void FileSystem::LockForLookup()
+{
+    if (!readOnly)
+        namespaceLock->AcquireRead();
+}
+
+void FileSystem::UnlockForLookup()
+{
+    if (!readOnly)
+        namespaceLock->ReleaseRead();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PinHeader, FileSystem::PinnedDirectory
+// 	Mounted read-only, keep the header at "sector" in the inode
+//	table until we unmount, by keeping a file open on it; and return
+//	the entries of the directory whose header is there, read in the
+//	first time it is looked in, and kept.  They never go stale, so
+//	they are shared by every thread, with no lock.  A thread that
+//	finds another has read one in while it was reading it too throws
+//	its own copy away.
+//----------------------------------------------------------------------
+
+void FileSystem::PinHeader(int sector)
+{
+    OpenFile *file;
+
+    ASSERT(readOnly);
+    if (pinned[sector] != NULL)
+        return;
+    file = new OpenFile(sector);
+    if (pinned[sector] == NULL)
+        pinned[sector] = file;
+    else
+        delete file;
+}
+
+Directory *
+FileSystem::PinnedDirectory(int sector)
+{
+    Directory *dir;
+
+    if (pinnedDirs[sector] != NULL)
+        return pinnedDirs[sector];
+    PinHeader(sector);
+    dir = new Directory(DirectoryFileSize);
+    dir->FetchFrom(pinned[sector]);
+    if (pinnedDirs[sector] == NULL)
+        pinnedDirs[sector] = dir;
+    else
+        delete dir;
+    return pinnedDirs[sector];
+}
+
+//----------------------------------------------------------------------
+// FileSystem::SwitchToDirectory
+// 	Make the directory whose header is at "sector" the current one,
+//	reading it in unless it is the current one already.  The copy in
+//	memory is kept identical to the one on disk, so there is never
+//	anything to write back when we leave a directory.
+//----------------------------------------------------------------------
+
+void FileSystem::SwitchToDirectory(int sector)
+{
+    if (sector == currentDirectorySector)
+        return;
+    if (currentDirectoryFile != NULL)
+        delete currentDirectoryFile;
+    if (currentDirectory != NULL)
+        delete currentDirectory;
+    currentDirectoryFile = new OpenFile(sector);
+    currentDirectorySector = sector;
+    currentDirectory = new Directory(DirectoryFileSize);
+    currentDirectory->FetchFrom(currentDirectoryFile);
+}
+
+void FileSystem::resetRootDir()
+{
+    SwitchToDirectory(rootSector);
+}
+
+bool FileSystem::MakeNewDir(char *name)
+{
+    char *dir_arr[2 * MaxPathDepth];
+    int dir_count = 0;
+    char *new_dir_name;
+    bool success;
+    Arena scratch;
+
+    MountEntry *m;
+    char *rest;
+
+    m = Route(name, &rest, &scratch);
+    if (m != NULL)
+    {
+        MountScope scope(m);
+
+        return strcmp(rest, "/") != 0 && m->fileSystem->MakeNewDir(rest);
+    }
+    // a relative name is under the working directory
+    dir_count = ResolvePath(dir_arr, name, &scratch);
+    // cout << " MakeNewDir : dir_count = " << dir_count << endl;
+    new_dir_name = dir_arr[dir_count - 1];
+    // cout << " MakeNewDir : new_dir_name = " << new_dir_name << endl;
+    if (readOnly)
+        return FALSE;
+
+    // move the currDir to right place
+    kernel->bufferCache->BeginTransaction();
+    namespaceLock->AcquireWrite();
+    freeMapLock->AcquireWrite();
+    MakeRoom(NewDirectoryRoom);
+    success = changeToRightDir(dir_arr, dir_count - 1)
+              && createDir(new_dir_name);
+    if (success)
+        dentries->Invalidate(dir_arr, dir_count);
+    freeMapLock->ReleaseWrite();
+    namespaceLock->ReleaseWrite();
+    kernel->bufferCache->EndTransaction(TRUE);
+    return success;
+}
+//----------------------------------------------------------------------
+// FileSystem::IndexFreeExtents
+// 	From now on, keep an index of the free extents of the disk along
+//	with the free map (see PersistentBitmap::IndexExtents), so that
+//	files that want their sectors contiguous find room for them in
+//	time O(log n) in the number of free extents.
+//----------------------------------------------------------------------
+
+void
+FileSystem::IndexFreeExtents()
+{
+    freeMapLock->AcquireWrite();
+    freeMap->IndexExtents();
+    freeMapLock->ReleaseWrite();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Print
+// 	Print one page of everything about the file system, for -Dfull:
+//	  the superblock, and, on the first page only, the headers of
+//	  the bitmap and the root directory, and the bitmap itself
+//	  for each of DumpPageFiles files, in the order ListRecursive
+//	      lists them, its full name and the contents of its header,
+//	      and the data in it
+//	  the I/O counters of the files that have been used
+//	The tree is walked a directory sector at a time, and each file
+//	is printed a sector at a time as it is read (see FileHeader::
+//	Print), so nothing is held on to for the files before the page;
+//	the walk stops at the first file after it.
+//
+//	"page" -- which page to print, from 0
+//----------------------------------------------------------------------
+
+void FileSystem::Print(int page)
+{
+    const int maxDepth = 2 * MaxPathDepth;
+    OpenFile *files[maxDepth];
+    DirectoryIterator *dirs[maxDepth];
+    int nameEnd[maxDepth];           // where the path of each level ends
+    char *name = new char[maxDepth * (FileNameMaxLen + 1) + 1];
+    DirectoryEntry entry;
+    int depth, len, numSeen = 0;
+    int first = page * DumpPageFiles;
+
+    ASSERT(page >= 0);
+    if (superBlock != NULL)
+        superBlock->Print();
+
+    namespaceLock->AcquireRead();
+    if (page == 0)
+    {
+        FileHeader bitHdr;
+        FileHeader dirHdr;
+
+        printf("Bit map file header:\n");
+        bitHdr.FetchFrom(freeMapSector);
+        bitHdr.Print();
+
+        printf("Directory file header:\n");
+        dirHdr.FetchFrom(rootSector);
+        dirHdr.Print();
+
+        freeMapLock->AcquireRead();
+        freeMap->Print();
+        freeMapLock->ReleaseRead();
+    }
+
+    printf("Directory contents, page %d:\n", page);
+    files[0] = new OpenFile(rootSector);
+    dirs[0] = new DirectoryIterator(files[0], 0);
+    nameEnd[0] = 0;
+    depth = 1;
+    while (depth > 0)
+    {
+        if (!dirs[depth - 1]->Next(&entry))
+        {
+            depth--;
+            delete dirs[depth];
+            delete files[depth];
+            continue;
+        }
+        len = nameEnd[depth - 1];
+        name[len] = '/';
+        strcpy(&name[len + 1], entry.name);
+        if (numSeen == first + DumpPageFiles)
+        {
+            printf("More files follow: -Dfull %d for the next page\n",
+                   page + 1);
+            while (depth > 0)
+            {
+                depth--;
+                delete dirs[depth];
+                delete files[depth];
+            }
+            break;
+        }
+        if (numSeen++ >= first)
+        {
+            FileHeader *hdr = kernel->inodeTable->Acquire(entry.sector);
+
+            printf("Name: %s, Sector: %d, Type : %d\n", name, entry.sector,
+                   entry.inUse);
+            hdr->Print();
+            kernel->inodeTable->Release(entry.sector);
+        }
+        if (entry.inUse == IS_DIR && depth < maxDepth)
+        {
+            files[depth] = new OpenFile(entry.sector);
+            dirs[depth] = new DirectoryIterator(files[depth], 0);
+            nameEnd[depth] = strlen(name);
+            depth++;
+        }
+    }
+    delete[] name;
+    namespaceLock->ReleaseRead();
+    printf("\n");
+
+    kernel->inodeTable->PrintStats();
+}
+
+// The following class defines the totals of the summary for one
+// directory: of the entries in it, and of everything under it.
+
+class SummaryDir
+{
+public:
+    SummaryDir(SummaryDir *p, char *name);
+    ~SummaryDir() { delete[] path; }
+
+    char *path;                      // its full name
+    SummaryDir *parent;              // the directory it is in; NULL
+                                     // for the root
+    int numEntries;                  // files and directories in it
+    int numFiles;                    // under it, at any depth
+    int numDirs;
+    int numBytes;                    // in those files and directories
+    int numSectors;                  // their data sectors
+};
+
+SummaryDir::SummaryDir(SummaryDir *p, char *name)
+{
+    parent = p;
+    if (p == NULL)
+    {
+        path = new char[2];
+        strcpy(path, "/");
+    }
+    else
+    {
+        int len = strlen(p->path);
+
+        if (len == 1)
+            len = 0;                 // "/a", not "//a"
+        path = new char[len + strlen(name) + 2];
+        strncpy(path, p->path, len);
+        path[len] = '/';
+        strcpy(&path[len + 1], name);
+    }
+    numEntries = numFiles = numDirs = numBytes = numSectors = 0;
+}
+
+// The following class defines a header the summary has still to
+// read: its sector, and the entry it was found under.
+
+class SummaryItem
+{
+public:
+    SummaryItem(int s, int t, SummaryDir *d, char *n)
+    { sector = s; type = t; dir = d; name = new char[strlen(n) + 1];
+      strcpy(name, n); }
+    ~SummaryItem() { delete[] name; }
+
+    int sector;                      // where the header is
+    int type;                        // IS_FILE or IS_DIR
+    SummaryDir *dir;                 // the directory it is in
+    char *name;                      // its name there
+};
+
+//----------------------------------------------------------------------
+// LowerSummarySector
+// 	Compare two headers to be read by where they are, the lower one
+//	first.  Serves as the comparison function of the summary's heap.
+//----------------------------------------------------------------------
+
+static int
+LowerSummarySector(SummaryItem *x, SummaryItem *y)
+{
+    if (x->sector != y->sector)
+        return (x->sector < y->sector) ? -1 : 1;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::PrintSummary
+// 	Print what the file system holds, for -D, without printing the
+//	files themselves: how many files and directories there are, the
+//	bytes in them and the sectors they take, how fragmented they are
+//	(see CountRuns) and how the free space is; then, for each
+//	directory, what is in it and under it; then the I/O counters of
+//	the files that have been used.
+//
+//	Only the metadata is read -- each header once, and each
+//	directory's entries -- in one sweep across the disk: as in
+//	FsChecker::ClaimTree, the headers still to be read are kept in a
+//	heap, and the lowest one is read next.  No data sector of a file
+//	is read.
+//----------------------------------------------------------------------
+
+void FileSystem::PrintSummary()
+{
+    PairingHeap<SummaryItem *> pending(LowerSummarySector);
+    ::List<SummaryDir *> dirList;  // not FileSystem::List
+    int *sectors = new int[MaxOwnedSectors];
+    DirectoryEntry entry;
+    int numFiles = 0, numDirs = 0, numBytes = 0;
+    int numData = 0, numHeld = 0;    // data sectors; and with the
+                                     // headers and index sectors too
+    int numFragmented = 0, numRuns = 0, seekTicks = 0;
+    int numFree = 0, numFreeRuns = 0, longestFree = 0, run = 0;
+
+    if (superBlock != NULL)
+        superBlock->Print();
+
+    namespaceLock->AcquireRead();
+    pending.Insert(new SummaryItem(rootSector, IS_DIR, NULL, ""));
+    while (!pending.IsEmpty())
+    {
+        SummaryItem *item = pending.RemoveFront();
+        FileHeader *hdr = kernel->inodeTable->Acquire(item->sector);
+        int length = hdr->FileLength();
+        int count, held, runs, ticks;
+
+        held = hdr->OwnedSectors(sectors) + 1;
+        ASSERT(DataSectorsRoom(hdr) <= (int) MaxOwnedSectors);
+        count = DataSectors(hdr, sectors);
+        runs = CountRuns(sectors, count, &ticks);
+        kernel->inodeTable->Release(item->sector);
+
+        numBytes += length;
+        numData += count;
+        numHeld += held;
+        numRuns += runs;
+        seekTicks += ticks;
+        if (runs > 1)
+            numFragmented++;
+        if (item->dir != NULL)
+            item->dir->numEntries++;
+        for (SummaryDir *d = item->dir; d != NULL; d = d->parent)
+        {
+            if (item->type == IS_DIR)
+                d->numDirs++;
+            else
+                d->numFiles++;
+            d->numBytes += length;
+            d->numSectors += count;
+        }
+
+        if (item->type == IS_DIR)
+        {
+            SummaryDir *dir = new SummaryDir(item->dir, item->name);
+            OpenFile dirFile(item->sector);
+            DirectoryIterator it(&dirFile, 0);
+
+            numDirs++;
+            dirList.Append(dir);
+            while (it.Next(&entry))
+                pending.Insert(new SummaryItem(entry.sector, entry.inUse,
+                                               dir, entry.name));
+        }
+        else
+            numFiles++;
+        delete item;
+    }
+    namespaceLock->ReleaseRead();
+    delete[] sectors;
+
+    freeMapLock->AcquireRead();
+    for (int i = 0; i <= NumSectors; i++)
+    {
+        if (i < NumSectors && !freeMap->Test(i))
+        {
+            numFree++;
+            run++;
+            continue;
+        }
+        if (run > 0)
+        {
+            numFreeRuns++;
+            longestFree = max(longestFree, run);
+        }
+        run = 0;
+    }
+    freeMapLock->ReleaseRead();
+
+    printf("File system summary:\n");
+    printf("%d files, %d directories (with the root), %d bytes in %d data sectors\n",
+           numFiles, numDirs, numBytes, numData);
+    printf("%d sectors held in all, with the headers and index sectors\n",
+           numHeld);
+    printf("%d files and directories in more than one run; %d runs, about %d ticks seeking between them\n",
+           numFragmented, numRuns, seekTicks);
+    printf("%d of %d sectors free, in %d runs, the longest %d sectors\n",
+           numFree, NumSectors, numFreeRuns, longestFree);
+    printf("Directories: entries; files, directories, bytes, data sectors under it\n");
+    while (!dirList.IsEmpty())
+    {
+        SummaryDir *dir = dirList.RemoveFront();
+
+        printf("%s\t%d; %d, %d, %d, %d\n", dir->path, dir->numEntries,
+               dir->numFiles, dir->numDirs, dir->numBytes, dir->numSectors);
+        delete dir;
+    }
+    printf("\n");
+
+    kernel->inodeTable->PrintStats();
 }
 #endif // FILESYS_STUB
@@ -36,8 +36,21 @@
 #include "copyright.h"
 #include "sysdep.h"
 #include "openfile.h"
-#include <map>
 #include "directory.h"
+#include "pbitmap.h"
+#include "dcache.h"
+#include "fdtable.h"
+
+class Arena;
+class SuperBlock;
+class OrphanTable;
+class Journal;
+class SectorSums;
+
+class RWLock;
+class Semaphore;
+class SectorIndex;
+class MountEntry;
 
 #ifdef FILESYS_STUB // Temporarily implement file system calls as
 // calls to UNIX, until the real file system
@@ -118,6 +131,19 @@ public:
 		return size;
 	}
 
+	int SeekAFile(int position, OpenFileId id)
+	{
+		for (int i = 0; i < table_len; i++)
+		{
+			if (fileDescriptorTable[i]->get_FD() == id && position >= 0)
+			{
+				fileDescriptorTable[i]->Seek(position);
+				return 1;
+			}
+		}
+		return 0;
+	}
+
 	int CloseAFile(OpenFileId id)
 	{
 		for (int i = 0; i < table_len; i++)
@@ -159,6 +185,21 @@ private:
 
 #else // FILESYS
 typedef int OpenFileId;
+
+const int DumpPageFiles = 16;    // files printed per page of -Dfull
+
+// The following class defines what Stat says about a file, without
+// opening it.
+
+class StatInfo
+{
+public:
+    int length;      // bytes in the file
+    int numSectors;  // data sectors it has on disk (not its holes)
+    int type;        // IS_FILE or IS_DIR
+    int numFragments; // runs of consecutive sectors they are in
+};
+
 class FileSystem
 {
 public:
@@ -169,41 +210,264 @@ public:
 							 // the disk, so initialize the directory
 							 // and the bitmap of free blocks.
 	~FileSystem();
-    // split the @path into @arr and return the len of arr
-    int splitPath(char **arr, char *path);
+    // split the @path into @arr and return the len of arr; the
+    // components are copied into @scratch
+    int splitPath(char **arr, char *path, Arena *scratch);
     bool Create(char *name, int initialSize);
     // Create a file (UNIX creat)
+    bool Create(char *name, int initialSize, bool useExtents);
+    // Same, choosing the header format
+    bool Create(char *name, int initialSize, bool useExtents, bool compressed);
+    // or keeping the file compressed
+    int CreateMany(char *dirName, char **names, int *sizes, bool *created,
+                   int count);
+    // Create several files in one directory at once
 
 	OpenFile *Open(char *name);
 
 	OpenFileId OpenAFile(char *name);
 
+	bool OpenAPipe(OpenFileId *readId, OpenFileId *writeId);
+
 	int WriteAFile(char *buffer, int size, OpenFileId id);
 
 	int ReadAFile(char *buffer, int size, OpenFileId id);
 
+	int WriteAFileAt(char *buffer, int size, int position, OpenFileId id);
+
+	int ReadAFileAt(char *buffer, int size, int position, OpenFileId id);
+
+	int SeekAFile(int position, OpenFileId id);
+
 	int CloseAFile(OpenFileId id);
 
+	int SyncAFile(OpenFileId id);
+
+	FileIoStats *StatsOfAFile(OpenFileId id);
+
+	int TruncateAFile(OpenFileId id, int length);
+
+	int AllocateAFile(OpenFileId id, int offset, int length);
+
+	int AdviseAFile(OpenFileId id, int offset, int length, int advice);
+
+	int LockAFileRange(OpenFileId id, int offset, int length, int mode);
+
+	int MapAFile(OpenFileId id, int offset, int length);
+
+	OpenFile *ReopenAFile(OpenFileId id);
+
+	int CopyAFileRange(OpenFileId fromId, OpenFileId toId, int length);
+
 	bool Remove(char *name); // Delete a file (UNIX unlink)
+	bool RemoveTree(char *name); // Delete a file or a directory, and
+							 // everything under it (rm -r)
+	bool Rename(char *from, char *to); // Give a file or directory a
+							 // new name, maybe in another
+							 // directory (UNIX rename)
+	bool Clone(char *from, char *to); // Copy a file, sharing its
+							 // data sectors (UNIX cp
+							 // --reflink)
+	bool CopyFile(char *from, char *to); // Copy a file, sharing its
+							 // sectors if it can
+	int Deduplicate();		 // share the sectors of every file
+							 // that hold the same bytes;
+							 // return how many were freed
+	int Check();			 // check which sectors are in use,
+							 // and repair the free map; return
+							 // how many problems were found
 
     void List(char *path); //show all file in path
+    void ListRecursive(char *path); // and in every directory under it
+    int ReadDirectory(OpenFileId id, DirectoryEntry *entries, int count,
+                      int *next); // the next entries in use of an open
+                                  // directory, and where they end
     // mkdir helper
     bool createDir(char *name);
 	// change the current dir to the right place
     bool changeToRightDir(char **arr, int len);
+    void SwitchToDirectory(int sector); // make it current, reading it
+                                        // in only if it is not already
     void resetRootDir();
+    bool AddToCurrentDirectory(char *name, int sector, int type);
+                                // add a name, growing the directory
+                                // if it is full
+    bool GrowCurrentDirectory(); // double the size of the current
+                                 // directory and its file
+    bool ExtendFile(FileHeader *hdr, int hdrSector, int position,
+                    int newSize);
+                                 // make an open file longer, taking
+                                 // the space from the free map
+    bool FillHoles(FileHeader *hdr, int hdrSector, int position,
+                   int numBytes);
+                                 // and give sectors to the holes a
+                                 // write will go into
+    bool PreallocateFile(FileHeader *hdr, int hdrSector, int position,
+                         int numBytes);
+                                 // or set them aside ahead of time
+    void TruncateFile(FileHeader *hdr, int hdrSector, int newSize);
+                                 // make an open file shorter
+    bool StoreCluster(FileHeader *hdr, int hdrSector, int which,
+                      char *packed, int count);
+                                 // write out a cluster of an open
+                                 // compressed file, taking the
+                                 // sectors it needs
+    int FreeSectors();           // how many sectors are free
+    bool HasShared(FileHeader *hdr, int position, int numBytes);
+                                 // must a write to an open file copy
+                                 // some of its sectors first?
     // List all the files in the file system
     bool MakeNewDir(char *name); // create new dir with @name
-	void Print();				 // List all the files and their contents
+    bool ChangeDirectory(char *name); // make @name the running
+                                 // program's working directory
+    void Print(int page);        // List the files and their contents,
+                                 // DumpPageFiles of them at a time
+    void PrintSummary();         // Count the files, the space they
+                                 // take, and what is free
+    void IndexFreeExtents();     // find runs of free sectors from an
+                                 // index of them, not the free map
+    bool Stat(char *name, StatInfo *info); // a file's length, type
+                                 // and layout, without opening it
+    void PrintFragmentation(char *name); // how many runs of sectors a
+                                 // file is in, and what seeking
+                                 // between them costs
+    void StartDefragmenter();    // move fragmented files, in the
+                                 // background, each into one run
+    void WaitForDefragmenter();  // until it has been over them all
+    bool IsReadOnly() { return readOnly; } // mounted with -ro?  Then
+                                 // every call that would change the
+                                 // disk fails, and so do writes to
+                                 // open files
+    int MountPoint(char *name, FileSystem **fs); // the directory
+                                 // another file system is to be
+                                 // mounted on, and the one it is in
 
 private:
-	map<OpenFileId, OpenFile *> openedTable;
+	MountEntry *mount;		 // where it is in the mount table;
+							 // NULL for the root
+	MountEntry *Route(char *name, char **rest, Arena *scratch);
+							 // the file system a path goes
+							 // on in, if another is mounted
+							 // on the way, and the rest of it
+	int FindMount(char **arr, int len, MountEntry **crossed);
+							 // how many components of a path
+							 // lead to a directory something
+							 // is mounted on; -1 if none do
+	bool readOnly;			 // mounted read-only: nothing is
+							 // written, and lookups take no lock
+	OpenFile **pinned;		 // then, sector -> a file kept open
+							 // on every header looked up, so
+							 // it stays in the inode table;
+							 // NULL if not yet
+	Directory **pinnedDirs;	 // sector -> the entries of every
+							 // directory looked in, kept
+	void PinHeader(int sector);
+	Directory *PinnedDirectory(int sector);
+	bool DirectoryRun(int dirSector, int *first); // where the
+							 // entries of a directory that
+							 // has not grown start, if they
+							 // are in one run
+	int PlaceHeader();		 // allocate a new file's header
+	void PrefetchDirectory(int dirSector); // start reading the
+							 // entries, and the headers
+							 // after them, with -eh
+	void PrefetchSubdirectories(int dirSector); // start reading
+							 // the directories in one, for
+							 // a walk down the tree, with -tp
+	void ListLevel(int sector, int depth); // one directory of
+							 // ListRecursive, and those under it
+	void LockForLookup();	 // namespaceLock to read, unless
+	void UnlockForLookup();	 // mounted read-only
+	SuperBlock *superBlock;	 // what the disk holds; NULL for a
+							 // disk formatted without one
+	Journal *journal;		 // of metadata updates; NULL if
+							 // the disk has none
+	int freeMapSector;		 // where the free map's header is
+	OpenFile *shareMapFile;	 // counts of files sharing each
+							 // sector; NULL until one is
+							 // first shared
+	bool MakeShareMap();	 // make it, if there is none yet
+	SectorSums *sums;		 // checksums of the sectors, kept
+							 // after the share counts; NULL
+							 // if there are none
+	void StartChecksums(bool fetch); // take and check them from now
+							 // on, from those on disk or none
+	bool MakeChecksums();	 // make room for them, if there is
+							 // none yet
+	int DeduplicateTree(int sector, int depth, SectorIndex *index);
+							 // deduplicate a directory, and
+							 // everything under it
+	int DeduplicateFile(int sector, SectorIndex *index);
+							 // share the sectors of a file that
+							 // hold what one seen so far does
+	int rootSector;			 // and the root directory's
+	void Mount();			 // find and open the free map and
+							 // the root directory
+	FileDescriptorTable *kernelFiles; // descriptors of threads with
+							 // no address space
+	FileDescriptorTable *Descriptors(); // those of the running program
 	OpenFile *freeMapFile;	 // Bit map of free disk blocks,
 							 // represented as a file
+	PersistentBitmap *freeMap; // The free map, kept in memory;
+							 // written back (only the parts
+							 // that changed) after each
+							 // operation that changes it
 	OpenFile *directoryFile; // "Root" directory -- list of
 							 // file names, represented as a file
+	DentryCache *dentries;	 // path -> directory header sector
+	WorkingDirectory *kernelCwd; // working directory of threads with
+							 // no address space
+	WorkingDirectory *WorkingDir(); // that of the running program
+	int ResolvePath(char **arr, char *path, Arena *scratch);
+							 // split a path, relative ones
+							 // under the working directory
+	int StartOfWalk(char **arr, int len, int *sector);
+							 // where resolving a path can start
+	RWLock *namespaceLock;	 // held to read for lookups, to write
+							 // for anything that changes a
+							 // directory or the current one
+	RWLock *freeMapLock;	 // held to write to allocate or free
+							 // sectors; taken after namespaceLock
+	OrphanTable *orphans;	 // files removed, but whose sectors
+							 // are not given back yet; NULL if
+							 // the disk has no orphan table
+	Semaphore *orphansQueued; // V'ed for the reclaimer
+	bool unmounting;		 // should the reclaimer finish?
+	Semaphore *reclaimerDone; // V'ed once it has
+	bool QueueOrphan(int sector); // leave a removed file's sectors
+							 // to the reclaimer
+	bool Reclaim();			 // give back what it can now
+	void MakeRoom(int numSectors); // reclaim, if fewer sectors than
+							 // that are free
+	bool CreateInCurrentDirectory(char *name, int initialSize,
+								  bool useExtents, bool compressed);
+							 // allocate and enter a new file,
+							 // leaving the directory and free
+							 // map to be written back
+	int RoomToCreate(int initialSize, bool useExtents, bool compressed);
+	int PlaceToCreate(int initialSize, bool useExtents, bool compressed);
+							 // sectors it takes now, and the
+							 // ones it is placed for
+	static void Reclaimer(void *data);
+	bool defragmenting;		 // is the defragmenter running?
+	Semaphore *defragmenterDone; // V'ed when it has finished
+	bool DefragmentFile(int sector); // move one file, if it is
+							 // fragmented and not open
+	static void Defragmenter(void *data);
+	void FreeTree(int sector, int type); // give back the sectors of a
+							 // file, or of a directory and all
+							 // that is under it
+	int FindPath(char **arr, int len);
+							 // header sector of the directory a
+							 // path names, -1 if there is none,
+							 // leaving the current one alone
+	int FindInDirectory(int dirSector, char *name);
+	int FindInDirectory(int dirSector, char *name, int *type);
+							 // look "name" up in a directory,
+							 // maybe finding its type too
 	// for recording the present working dir
 	OpenFile *currentDirectoryFile;
+	int currentDirectorySector; // where its header is
 	Directory *currentDirectory;
 };
 
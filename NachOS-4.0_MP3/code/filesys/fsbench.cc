@@ -0,0 +1,311 @@
+// fsbench.cc
+//	Routines to benchmark the file system.  See fsbench.h.
+//
+//	The data written is the same every run, as are the "random"
+//	offsets (RandomNumber, after RandomInit), so the simulated
+//	costs only change when the file system does.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FILESYS_STUB
+
+#include "copyright.h"
+#include "fsbench.h"
+#include "main.h"
+#include "filesys.h"
+#include "openfile.h"
+#include "disk.h"
+#include "sysdep.h"
+#include <stdio.h>
+#include <sys/time.h>
+
+const int BenchChunk = SectorSize;	// bytes per Read/Write call
+const int NumRandomOps = 64;		// calls per random case
+
+//----------------------------------------------------------------------
+// HostMs
+//	The host's wall clock time, in milliseconds.
+//----------------------------------------------------------------------
+
+static double
+HostMs()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::FileSystemBench
+//	Open the results file, and start the JSON array of cases.
+//
+//	"resultFile" -- the UNIX file to write the results to
+//----------------------------------------------------------------------
+
+FileSystemBench::FileSystemBench(char *resultFile)
+{
+    resultFd = OpenForWrite(resultFile);
+    first = TRUE;
+    Put("[");
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::~FileSystemBench
+//	End the array, and close the results file.
+//----------------------------------------------------------------------
+
+FileSystemBench::~FileSystemBench()
+{
+    Put("\n]\n");
+    Close(resultFd);
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Put
+//	Add "text" to the results file.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::Put(char *text)
+{
+    WriteFile(resultFd, text, strlen(text));
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Run
+//	Run every case, in turn.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::Run()
+{
+    RandomInit(1);
+    CreateRemove(32);
+    CreateMany(32);
+    WriteRead(1024, FALSE);
+    WriteRead(8 * 1024, FALSE);
+    WriteRead(32 * 1024, FALSE);
+    WriteRead(8 * 1024, TRUE);
+    WriteRead(32 * 1024, TRUE);
+    DeepLookup(6, 100);
+    ListDirectory(32, 20);
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Start
+//	Note the statistics, and the time, as a case starts.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::Start()
+{
+    startTicks = kernel->stats->totalTicks;
+    startReads = kernel->stats->numDiskReads;
+    startWrites = kernel->stats->numDiskWrites;
+    startMs = HostMs();
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Report
+//	Write out what the case that just ended cost, since Start.
+//
+//	"name" -- what the case does
+//	"size" -- the size of file it works on (0 if none)
+//	"ops" -- how many operations it did
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::Report(char *name, int size, int ops)
+{
+    char line[200];
+
+    snprintf(line, sizeof(line), "%s  {\"case\": \"%s\", \"size\": %d, "
+	     "\"ops\": %d, \"ticks\": %lld, \"diskReads\": %d, "
+	     "\"diskWrites\": %d, \"hostMs\": %.3f}",
+	     first ? "\n" : ",\n", name, size, ops,
+	     kernel->stats->totalTicks - startTicks,
+	     kernel->stats->numDiskReads - startReads,
+	     kernel->stats->numDiskWrites - startWrites,
+	     HostMs() - startMs);
+    Put(line);
+    first = FALSE;
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::CreateRemove
+//	Create "numFiles" empty files in one directory, then remove them:
+//	two cases.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::CreateRemove(int numFiles)
+{
+    char name[20];
+    int i;
+
+    ASSERT(kernel->fileSystem->MakeNewDir("/cr"));
+    Start();
+    for (i = 0; i < numFiles; i++) {
+	snprintf(name, sizeof(name), "/cr/f%d", i);
+	ASSERT(kernel->fileSystem->Create(name, 0));
+    }
+    Report("create", 0, numFiles);
+
+    Start();
+    for (i = 0; i < numFiles; i++) {
+	snprintf(name, sizeof(name), "/cr/f%d", i);
+	ASSERT(kernel->fileSystem->Remove(name));
+    }
+    Report("remove", 0, numFiles);
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::CreateMany
+//	Create "numFiles" empty files in one directory with a single
+//	FileSystem::CreateMany, to compare with the "create" case.  The
+//	files are left there.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::CreateMany(int numFiles)
+{
+    char **names = new char *[numFiles];
+    int *sizes = new int[numFiles];
+    bool *created = new bool[numFiles];
+
+    ASSERT(kernel->fileSystem->MakeNewDir("/cm"));
+    for (int i = 0; i < numFiles; i++) {
+	names[i] = new char[20];
+	snprintf(names[i], 20, "f%d", i);
+	sizes[i] = 0;
+    }
+    Start();
+    ASSERT(kernel->fileSystem->CreateMany("/cm", names, sizes, created,
+					  numFiles) == numFiles);
+    Report("createMany", 0, numFiles);
+    for (int i = 0; i < numFiles; i++)
+	delete [] names[i];
+    delete [] names;
+    delete [] sizes;
+    delete [] created;
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::WriteRead
+//	Write a file of "size" bytes, a chunk at a time, then read it
+//	back: two cases.  If "random", the file is first written out in
+//	full, and each case is then NumRandomOps chunks at random offsets.
+//	The file is removed at the end.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::WriteRead(int size, bool random)
+{
+    char *name = random ? (char *) "/rand" : (char *) "/seq";
+    char buffer[BenchChunk];
+    int numChunks = size / BenchChunk;
+    OpenFile *file;
+    int i;
+
+    for (i = 0; i < BenchChunk; i++)
+	buffer[i] = 'a' + i % 26;
+    ASSERT(kernel->fileSystem->Create(name, 0));
+    file = kernel->fileSystem->Open(name);
+    ASSERT(file != NULL);
+
+    if (random) {
+	for (i = 0; i < numChunks; i++)
+	    ASSERT(file->Write(buffer, BenchChunk) == BenchChunk);
+	file->Sync();
+
+	Start();
+	for (i = 0; i < NumRandomOps; i++) {
+	    int at = (RandomNumber() % numChunks) * BenchChunk;
+
+	    ASSERT(file->WriteAt(buffer, BenchChunk, at) == BenchChunk);
+	}
+	file->Sync();
+	Report("random write", size, NumRandomOps);
+
+	Start();
+	for (i = 0; i < NumRandomOps; i++) {
+	    int at = (RandomNumber() % numChunks) * BenchChunk;
+
+	    ASSERT(file->ReadAt(buffer, BenchChunk, at) == BenchChunk);
+	}
+	Report("random read", size, NumRandomOps);
+    } else {
+	Start();
+	for (i = 0; i < numChunks; i++)
+	    ASSERT(file->Write(buffer, BenchChunk) == BenchChunk);
+	file->Sync();
+	Report("sequential write", size, numChunks);
+
+	Start();
+	file->Seek(0);
+	for (i = 0; i < numChunks; i++)
+	    ASSERT(file->Read(buffer, BenchChunk) == BenchChunk);
+	Report("sequential read", size, numChunks);
+    }
+
+    delete file;
+    ASSERT(kernel->fileSystem->Remove(name));
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::DeepLookup
+//	Make a path of "depth" nested directories with a file at the end,
+//	then open the file by its full name "numLookups" times: one case.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::DeepLookup(int depth, int numLookups)
+{
+    char path[MaxPathDepth * (FileNameMaxLen + 1) + 1];
+    int length = 0;
+
+    ASSERT(depth < MaxPathDepth);
+    for (int i = 0; i < depth; i++) {
+	length += snprintf(&path[length], sizeof(path) - length, "/d%d", i);
+	ASSERT(kernel->fileSystem->MakeNewDir(path));
+    }
+    snprintf(&path[length], sizeof(path) - length, "/file");
+    ASSERT(kernel->fileSystem->Create(path, 0));
+
+    Start();
+    for (int i = 0; i < numLookups; i++) {
+	OpenFile *file = kernel->fileSystem->Open(path);
+
+	ASSERT(file != NULL);
+	delete file;
+    }
+    Report("deep lookup", 0, numLookups);
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::ListDirectory
+//	Fill a directory with "numFiles" files, then list it "numLists"
+//	times: one case.  The listings themselves go to stdout.
+//----------------------------------------------------------------------
+
+void
+FileSystemBench::ListDirectory(int numFiles, int numLists)
+{
+    char name[20];
+
+    ASSERT(kernel->fileSystem->MakeNewDir("/ls"));
+    for (int i = 0; i < numFiles; i++) {
+	snprintf(name, sizeof(name), "/ls/f%d", i);
+	ASSERT(kernel->fileSystem->Create(name, 0));
+    }
+
+    Start();
+    for (int i = 0; i < numLists; i++)
+	kernel->fileSystem->List("/ls");
+    Report("list", 0, numLists);
+}
+
+#endif // FILESYS_STUB
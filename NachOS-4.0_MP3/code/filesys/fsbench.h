@@ -0,0 +1,58 @@
+// fsbench.h
+//	Data structures for a micro-benchmark of the file system, run by
+//	"nachos -f -bench <file>" (or "make bench").
+//
+//	Each case does many of one kind of operation -- creating and
+//	removing files (one at a time, and in one batch), reading and writing files of a few sizes in order
+//	and at random, looking up a name at the end of a deep path,
+//	listing a directory -- and reports what it cost: simulated ticks,
+//	sectors read from and written to the disk, and host time.  The
+//	results go to the file named, as JSON, so that runs of different
+//	versions can be compared by a script.
+//
+//	The benchmark needs a freshly formatted disk, and leaves its files
+//	on it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FSBENCH_H
+#define FSBENCH_H
+
+#ifndef FILESYS_STUB
+
+#include "utility.h"
+
+class FileSystemBench {
+  public:
+    FileSystemBench(char *resultFile);
+				// Open the results file
+    ~FileSystemBench();		// Finish it, and close it
+
+    void Run();			// Run every case
+
+  private:
+    int resultFd;		// the UNIX file of JSON results
+    bool first;			// no case reported yet?
+    Ticks startTicks;
+    int startReads, startWrites;
+				// the statistics when the case started
+    double startMs;		// and the host time
+
+    void Put(char *text);	// add "text" to the results
+    void Start();		// a case starts: take a snapshot
+    void Report(char *name, int size, int ops);
+				// it is over: write what it cost
+
+    void CreateRemove(int numFiles);
+    void CreateMany(int numFiles);
+    void WriteRead(int size, bool random);
+    void DeepLookup(int depth, int numLookups);
+    void ListDirectory(int numFiles, int numLists);
+};
+
+#endif // FILESYS_STUB
+#endif // FSBENCH_H
@@ -0,0 +1,329 @@
+// fscheck.cc
+//	Routines to check the file system on a disk, and repair its free
+//	map.  See fscheck.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fscheck.h"
+#include "filehdr.h"
+#include "directory.h"
+#include "openfile.h"
+#include "inodetable.h"
+#include "heap.h"
+#include "debug.h"
+#include "main.h"
+
+// The following class defines a header the walk has still to read:
+// its sector, and the entry it was found under.
+
+class CheckItem {
+  public:
+    CheckItem(int s, int t, char *n)
+	{ sector = s; type = t; name = new char[strlen(n) + 1];
+	  strcpy(name, n); }
+    ~CheckItem() { delete [] name; }
+
+    int sector;				// where the header is
+    int type;				// IS_FILE or IS_DIR
+    char *name;				// for reporting it
+};
+
+//----------------------------------------------------------------------
+// LowerSector
+// 	Compare two headers to be read by where they are, the lower one
+//	first.  Serves as the comparison function of the walk's heap.
+//----------------------------------------------------------------------
+
+static int
+LowerSector(CheckItem *x, CheckItem *y)
+{
+    if (x->sector != y->sector)
+	return (x->sector < y->sector) ? -1 : 1;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::FsChecker
+// 	Start a check, with no sector found in use yet.
+//----------------------------------------------------------------------
+
+FsChecker::FsChecker()
+{
+    uses = new int[NumSectors];
+    isKept = new bool[NumSectors];
+    reached = new bool[NumSectors];
+    for (int i = 0; i < NumSectors; i++) {
+	uses[i] = 0;
+	isKept[i] = reached[i] = FALSE;
+    }
+    owned = new int[MaxOwnedSectors];
+    allKnown = TRUE;
+    numFiles = numDirectories = 0;
+    numProblems = numRepaired = 0;
+}
+
+FsChecker::~FsChecker()
+{
+    delete [] uses;
+    delete [] isKept;
+    delete [] reached;
+    delete [] owned;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::Use
+// 	Count one more use of "sector", by "what".  A sector that is
+//	"kept" -- a header, or one the file system keeps for itself --
+//	cannot be used by anything else too.
+//----------------------------------------------------------------------
+
+void
+FsChecker::Use(int sector, bool kept, char *what)
+{
+    ASSERT(sector >= 0 && sector < NumSectors);
+    if (uses[sector] > 0 && (kept || isKept[sector])) {
+	printf("Check: sector %d of %s is used by something else too\n",
+	       sector, what);
+	numProblems++;
+    }
+    uses[sector]++;
+    if (kept)
+	isKept[sector] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::ClaimSector
+// 	Record that the file system keeps "sector" for "what".
+//----------------------------------------------------------------------
+
+void
+FsChecker::ClaimSector(int sector, char *what)
+{
+    if (sector < 0 || sector >= NumSectors) {
+	printf("Check: %s is at sector %d, off the disk\n", what, sector);
+	numProblems++;
+	return;
+    }
+    Use(sector, TRUE, what);
+}
+
+//----------------------------------------------------------------------
+// FsChecker::ClaimFile
+// 	Record that the header at "sector" is in use, and every sector
+//	it says its file holds.  Return FALSE if the header is off the
+//	disk, was reached already, or is not valid; then its file is not
+//	walked.
+//
+//	"what" -- the file's name, or what it is for, to report it
+//----------------------------------------------------------------------
+
+bool
+FsChecker::ClaimFile(int sector, char *what)
+{
+    FileHeader *hdr;
+    int count;
+
+    if (sector < 0 || sector >= NumSectors) {
+	printf("Check: %s has its header at sector %d, off the disk\n",
+	       what, sector);
+	numProblems++;
+	return FALSE;
+    }
+    if (reached[sector]) {
+	printf("Check: %s has the header at sector %d, as something "
+	       "before it does\n", what, sector);
+	numProblems++;
+	return FALSE;
+    }
+    reached[sector] = TRUE;
+    Use(sector, TRUE, what);
+    hdr = kernel->inodeTable->Acquire(sector);
+    count = hdr->OwnedSectors(owned);
+    kernel->inodeTable->Release(sector);
+    if (count < 0) {
+	printf("Check: %s has a header at sector %d that is not valid\n",
+	       what, sector);
+	numProblems++;
+	allKnown = FALSE;
+	return FALSE;
+    }
+    DEBUG(dbgFile, "Check: " << what << ", header " << sector << ", holds "
+		   << count << " sectors");
+    for (int i = 0; i < count; i++)
+	Use(owned[i], FALSE, what);
+    numFiles++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::ClaimTree
+// 	Record that the directory whose header is at "rootSector" is in
+//	use, and everything under it.  Headers are read lowest sector
+//	first (see fscheck.h); a directory's entries are read as soon as
+//	its header has been, and their headers join the ones waiting.
+//----------------------------------------------------------------------
+
+void
+FsChecker::ClaimTree(int rootSector)
+{
+    PairingHeap<CheckItem *> pending(LowerSector);
+    DirectoryEntry entry;
+
+    pending.Insert(new CheckItem(rootSector, IS_DIR, "/"));
+    while (!pending.IsEmpty()) {
+	CheckItem *item = pending.RemoveFront();
+
+	if (ClaimFile(item->sector, item->name) && item->type == IS_DIR) {
+	    OpenFile dirFile(item->sector);
+	    DirectoryIterator it(&dirFile, 0);
+
+	    numDirectories++;
+	    while (it.Next(&entry)) {
+		if (entry.inUse != IS_FILE && entry.inUse != IS_DIR) {
+		    printf("Check: %s in directory %s is of no known type\n",
+			   entry.name, item->name);
+		    numProblems++;
+		    continue;
+		}
+		pending.Insert(new CheckItem(entry.sector, entry.inUse,
+					     entry.name));
+	    }
+	}
+	delete item;
+    }
+}
+
+//----------------------------------------------------------------------
+// FsChecker::ReportRun
+// 	Report that the free map is wrong in the same way ("what") about
+//	the sectors "from" up to, but not including, "to".
+//----------------------------------------------------------------------
+
+void
+FsChecker::ReportRun(int from, int to, char *what)
+{
+    if (to == from + 1)
+	printf("Check: sector %d %s\n", from, what);
+    else
+	printf("Check: sectors %d to %d %s\n", from, to - 1, what);
+}
+
+//----------------------------------------------------------------------
+// FsChecker::CheckFreeMap
+// 	Compare the free map with the sectors found in use, report each
+//	run of sectors it is wrong about, and repair them: a sector in
+//	use is marked, and a leaked one cleared (unless some header was
+//	not valid).  Return how many sectors were wrong.  Runs of
+//	sectors wrong in the same way are reported together.
+//----------------------------------------------------------------------
+
+int
+FsChecker::CheckFreeMap(PersistentBitmap *freeMap)
+{
+    int numWrong = 0;
+    int runStart = 0, runKind = 0;	// 0 right, 1 in use but free,
+					// 2 leaked
+
+    for (int i = 0; i <= NumSectors; i++) {
+	int kind = 0;
+
+	if (i < NumSectors && uses[i] > 0 && !freeMap->Test(i))
+	    kind = 1;
+	else if (i < NumSectors && uses[i] == 0 && freeMap->Test(i))
+	    kind = 2;
+	if (kind != runKind) {
+	    if (runKind == 1)
+		ReportRun(runStart, i, "in use, but marked free");
+	    else if (runKind == 2 && allKnown)
+		ReportRun(runStart, i, "marked in use, but not used");
+	    else if (runKind == 2)
+		ReportRun(runStart, i, "marked in use, but not used (kept)");
+	    runStart = i;
+	    runKind = kind;
+	}
+	if (kind == 0)
+	    continue;
+	numWrong++;
+	if (kind == 1) {
+	    freeMap->Mark(i);
+	    numRepaired++;
+	} else if (allKnown) {
+	    freeMap->SetSharers(i, 0);
+	    freeMap->Clear(i);
+	    numRepaired++;
+	}
+    }
+    numProblems += numWrong;
+    return numWrong;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::NeedsShares
+// 	Return TRUE if some sector was found in use more than once, and
+//	so needs a share count.
+//----------------------------------------------------------------------
+
+bool
+FsChecker::NeedsShares()
+{
+    for (int i = 0; i < NumSectors; i++) {
+	if (uses[i] > 1)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::CheckShares
+// 	Compare the share count of each sector with one less than the
+//	files found using it, report the sectors where they differ, and
+//	repair the counts.  Return how many were wrong.  A sector used
+//	more than MaxShares + 1 times can only be counted that far.
+//
+//	"canShare" -- does the free map have share counts?  If not, the
+//		sectors used more than once are only reported
+//----------------------------------------------------------------------
+
+int
+FsChecker::CheckShares(PersistentBitmap *freeMap, bool canShare)
+{
+    int numWrong = 0;
+
+    for (int i = 0; i < NumSectors; i++) {
+	int expected = min(max(uses[i] - 1, 0), MaxShares);
+
+	if (freeMap->Sharers(i) == expected)
+	    continue;
+	printf("Check: sector %d is used by %d files, but its share count "
+	       "is %d\n", i, uses[i], freeMap->Sharers(i));
+	numWrong++;
+	if (canShare) {
+	    freeMap->SetSharers(i, expected);
+	    numRepaired++;
+	}
+    }
+    numProblems += numWrong;
+    return numWrong;
+}
+
+//----------------------------------------------------------------------
+// FsChecker::Print
+// 	Summarize the check: what was walked, and what was found wrong.
+//----------------------------------------------------------------------
+
+void
+FsChecker::Print()
+{
+    int numUsed = 0;
+
+    for (int i = 0; i < NumSectors; i++) {
+	if (uses[i] > 0)
+	    numUsed++;
+    }
+    printf("Check: %d headers (%d directories), %d sectors in use; "
+	   "%d problems, %d sectors of the free map repaired\n",
+	   numFiles, numDirectories, numUsed, numProblems, numRepaired);
+}
@@ -0,0 +1,89 @@
+// fscheck.h
+//	Data structures for checking the file system on a disk (-fsck).
+//
+//	The checker works out, from what the disk holds, which sectors
+//	are in use, and by how many files.  It is given the sectors the
+//	file system keeps for itself (the superblock, the journal area,
+//	the orphan table), the headers of the files it keeps open (the
+//	free map, the share map) and of the removed files not reclaimed
+//	yet, and the root directory, from which it walks the whole tree.
+//	Every header is read, and each sector it says its file holds is
+//	counted (see FileHeader::OwnedSectors); every directory is read,
+//	and the files and directories in it are walked in turn.
+//
+//	The headers still to be read are kept in a heap by sector number,
+//	and the lowest is always read next, so the walk sweeps across the
+//	disk in one direction as far as it can, instead of seeking back
+//	and forth the way the tree happens to be laid out.
+//
+//	The counts are then compared with the free map: a sector in use
+//	but marked free, one marked in use that nothing uses (a "leak",
+//	left by a run that stopped before it had given back what it
+//	freed), and one whose share count is not one less than the files
+//	using it.  All of these are repaired.  What is wrong with the tree
+//	itself -- a header that is not valid, an entry for a sector off
+//	the disk, a header reached twice, a header or a file system sector
+//	that something else uses too -- is only reported; and if a header
+//	was not valid, leaks are not given back, since the sectors its
+//	file holds are not known.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FSCHECK_H
+#define FSCHECK_H
+
+#include "disk.h"
+#include "pbitmap.h"
+
+// The following class defines a check of the file system.
+
+class FsChecker {
+  public:
+    FsChecker();			// Nothing is in use yet
+    ~FsChecker();
+
+    void ClaimSector(int sector, char *what);
+					// The file system keeps "sector"
+					// for "what"
+    bool ClaimFile(int sector, char *what);
+					// The header at "sector", and every
+					// sector its file holds, are in use;
+					// FALSE if the header is not valid
+    void ClaimTree(int rootSector);	// Same, for a directory and
+					// everything under it
+
+    int CheckFreeMap(PersistentBitmap *freeMap);
+					// Report and repair the sectors the
+					// map is wrong about; return how many
+    bool NeedsShares();			// Is any sector used more than once?
+    int CheckShares(PersistentBitmap *freeMap, bool canShare);
+					// Same, for the share counts, if the
+					// map has them
+
+    int NumProblems() { return numProblems; }
+    void Print();			// Summarize what was found
+
+  private:
+    int *uses;				// how many things use each sector
+    bool *isKept;			// is it a header, or kept by the
+					// file system? (then it cannot be
+					// shared)
+    bool *reached;			// headers read so far
+    int *owned;				// what a file holds, MaxOwnedSectors
+    bool allKnown;			// was every header valid?
+    int numFiles;			// files and directories walked
+    int numDirectories;
+    int numProblems;			// found in the tree and the map
+    int numRepaired;			// sectors of the map repaired
+
+    void Use(int sector, bool kept, char *what);
+					// count one more use of "sector"
+    void ReportRun(int from, int to, char *what);
+					// report sectors "from" up to "to"
+};
+
+#endif // FSCHECK_H
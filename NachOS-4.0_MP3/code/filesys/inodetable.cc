@@ -0,0 +1,214 @@
+// inodetable.cc
+//	Routines to share file headers between the open files of the
+//	same file.  The table is indexed directly by sector number, like
+//	the buffer cache's sector map, so finding a header is a single
+//	array reference.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "inodetable.h"
+#include "debug.h"
+#include "list.h"
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize an empty table: no headers are in memory.
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable()
+{
+    lock = new Lock("inode table lock");
+    headers = new FileHeader *[NumSectors];
+    buffers = new WriteBuffer *[NumSectors];
+    clusters = new ClusterBuffer *[NumSectors];
+    ranges = new RangeLocks *[NumSectors];
+    refCount = new int[NumSectors];
+    ioStats = new FileIoStats[NumSectors];
+    for (int i = 0; i < NumSectors; i++) {
+	headers[i] = NULL;
+	buffers[i] = NULL;
+	clusters[i] = NULL;
+	ranges[i] = NULL;
+	refCount[i] = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table, and any header still in it.  A file left
+//	open gets its write buffer flushed, so the buffer cache must
+//	still be around.
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    for (int i = 0; i < NumSectors; i++) {
+	if (headers[i] != NULL) {
+	    delete ranges[i];
+	    delete clusters[i];
+	    delete buffers[i];
+	    if (headers[i]->IsDirty())
+		headers[i]->WriteBack(i);
+	    delete headers[i];
+	}
+    }
+    delete [] headers;
+    delete [] buffers;
+    delete [] clusters;
+    delete [] ranges;
+    delete [] refCount;
+    delete [] ioStats;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Acquire
+// 	Return the file header stored at "sector", and count one more
+//	reference to it.  The header is read from disk only if it was
+//	not already in memory.
+//
+//	"sector" -- the location on disk of the file header
+//----------------------------------------------------------------------
+
+FileHeader *
+InodeTable::Acquire(int sector)
+{
+    FileHeader *hdr;
+
+    ASSERT((sector >= 0) && (sector < NumSectors));
+    lock->Acquire();
+    if (headers[sector] == NULL) {
+	DEBUG(dbgFile, "Reading in the file header at " << sector);
+	headers[sector] = new FileHeader;
+	headers[sector]->FetchFrom(sector);
+	buffers[sector] = new WriteBuffer(headers[sector], &ioStats[sector]);
+	ranges[sector] = new RangeLocks;
+	if (headers[sector]->IsCompressed())
+	    clusters[sector] = new ClusterBuffer(headers[sector], sector);
+    }
+    refCount[sector]++;
+    hdr = headers[sector];
+    lock->Release();
+    return hdr;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Release
+// 	Drop a reference to the header at "sector"; when there are none
+//	left, the write buffer is flushed, the header is written back if
+//	the file has grown (see FileHeader::Extend), and it is freed.
+//
+//	A cluster buffer is freed along with it, but should have been
+//	flushed already (see OpenFile::~OpenFile): writing out a cluster
+//	takes the free map lock, which may not be taken under ours.
+//
+//	"sector" -- the location on disk of the file header
+//----------------------------------------------------------------------
+
+void
+InodeTable::Release(int sector)
+{
+    lock->Acquire();
+    ASSERT(refCount[sector] > 0);
+    if (--refCount[sector] == 0) {
+	delete clusters[sector];
+	clusters[sector] = NULL;
+	delete ranges[sector];
+	ranges[sector] = NULL;
+	delete buffers[sector];
+	buffers[sector] = NULL;
+	if (headers[sector]->IsDirty())
+	    headers[sector]->WriteBack(sector);
+	delete headers[sector];
+	headers[sector] = NULL;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Sync
+// 	For every open file, flush its write buffer, and write its header
+//	back if the file has grown, as OpenFile::Sync does for one file.
+//	Everything written to the files so far is then in the buffer
+//	cache (UNIX sync).
+//
+//	The cluster buffers of compressed files are flushed first, with
+//	the table unlocked (see Release); a reference is held to each
+//	file meanwhile, so that it stays open.
+//----------------------------------------------------------------------
+
+void
+InodeTable::Sync()
+{
+    List<int> compressed;
+
+    lock->Acquire();
+    for (int i = 0; i < NumSectors; i++) {
+	if (clusters[i] != NULL) {
+	    refCount[i]++;
+	    compressed.Append(i);
+	}
+    }
+    lock->Release();
+    while (!compressed.IsEmpty()) {
+	int sector = compressed.RemoveFront();
+
+	clusters[sector]->Flush();
+	Release(sector);
+    }
+
+    lock->Acquire();
+    for (int i = 0; i < NumSectors; i++) {
+	if (headers[i] != NULL) {
+	    buffers[i]->Flush();
+	    if (headers[i]->IsDirty())
+		headers[i]->WriteBack(i);
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// InodeTable::IsEmpty
+// 	Return TRUE if no file header is in memory: every file has been
+//	closed, and anything they changed has been written back.
+//----------------------------------------------------------------------
+
+bool
+InodeTable::IsEmpty()
+{
+    for (int i = 0; i < NumSectors; i++) {
+	if (headers[i] != NULL)
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::PrintStats
+// 	Print the I/O counters of every file that has been read or
+//	written, by the sector of its header, with its length if it is
+//	open.
+//----------------------------------------------------------------------
+
+void
+InodeTable::PrintStats()
+{
+    printf("File I/O, by header sector:\n");
+    for (int i = 0; i < NumSectors; i++) {
+	FileIoStats *s = &ioStats[i];
+
+	if (s->IsEmpty())
+	    continue;
+	printf("  %d: read %d bytes, wrote %d bytes, sectors read %d, "
+	       "written %d, cache hits %d, runs %d", i, s->bytesRead,
+	       s->bytesWritten, s->sectorReads, s->sectorWrites,
+	       s->cacheHits, s->runs);
+	if (headers[i] != NULL)
+	    printf(", open, length %d", headers[i]->FileLength());
+	printf("\n");
+    }
+}
@@ -0,0 +1,94 @@
+// inodetable.h
+//	Data structures for the table of file headers in memory (in UNIX
+//	terms, the in-core i-node table).
+//
+//	Every open file needs its file header in memory.  Rather than have
+//	each OpenFile read its own copy, the headers are kept in one
+//	system-wide table, indexed by the sector the header lives in.
+//	Opening a file that is already open just takes another reference
+//	to the header that is there; the header is read from disk only by
+//	the first open, and freed when the last OpenFile is closed.
+//
+//	Because every OpenFile on a given file shares the same header,
+//	a change made to the header through one of them (for instance,
+//	giving the file new data sectors) is seen by all of them.  The
+//	same goes for the file's write buffer (see writebuf.h), which
+//	comes and goes with the header; the last close flushes it.  A
+//	compressed file also has a cluster buffer (see clusterbuf.h),
+//	shared in the same way.
+//
+//	The byte-range locks of a file (see rangelock.h) come and go with
+//	its header in the same way.
+//
+//	The table also keeps each file's I/O counters (see writebuf.h).
+//	Unlike the header, they stay when the file is closed, so that a
+//	file opened many times is counted as a whole, and start over when
+//	a new file is created at the same header sector.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef INODETABLE_H
+#define INODETABLE_H
+
+#include "filehdr.h"
+#include "writebuf.h"
+#include "clusterbuf.h"
+#include "rangelock.h"
+#include "synch.h"
+
+// The following class defines the table of file headers in memory.
+
+class InodeTable {
+  public:
+    InodeTable();			// Initialize an empty table
+    ~InodeTable();			// De-allocate the table; every
+					// file should be closed by now
+
+    FileHeader *Acquire(int sector);	// Return the header stored at
+					// "sector", reading it in if no
+					// one has it open, and take a
+					// reference to it
+    void Release(int sector);		// Drop a reference; the last one
+					// flushes the write buffer and
+					// frees the header, writing it
+					// back if the file grew
+    int RefCount(int sector) { return refCount[sector]; }
+    bool IsEmpty();			// Is every file closed?
+    void Sync();			// Send every open file's held back
+					// writes on to the buffer cache
+    WriteBuffer *WriteBufferOf(int sector) { return buffers[sector]; }
+					// The write buffer of a file that
+					// has been acquired
+    ClusterBuffer *ClusterBufferOf(int sector) { return clusters[sector]; }
+					// And its cluster buffer, NULL if
+					// it is not compressed
+    RangeLocks *RangeLocksOf(int sector) { return ranges[sector]; }
+					// And its byte-range locks
+    FileIoStats *IoStatsOf(int sector) { return &ioStats[sector]; }
+					// The I/O counters of the file
+					// whose header is at "sector"
+    void ForgetStats(int sector) { ioStats[sector].Clear(); }
+					// A new file has that header
+    void PrintStats();			// Print the counters of every file
+					// that was read or written
+
+  private:
+    Lock *lock;				// so that two opens of the same
+					// file don't both read it in
+    FileHeader **headers;		// sector -> header, NULL if not
+					//   in memory
+    WriteBuffer **buffers;		// sector -> write buffer, NULL
+					//   along with the header
+    ClusterBuffer **clusters;		// sector -> cluster buffer, NULL
+					//   unless the file is compressed
+    RangeLocks **ranges;		// sector -> range locks, NULL
+					//   along with the header
+    int *refCount;			// sector -> number of references
+    FileIoStats *ioStats;		// sector -> I/O counters
+};
+
+#endif // INODETABLE_H
@@ -0,0 +1,631 @@
+// journal.cc
+//	Routines to keep the metadata journal: to collect what
+//	transactions write, commit it to the journal area, write it home
+//	at checkpoints, and replay the journal after a crash.  See
+//	journal.h.
+//
+//	Everything is protected by one lock, which commits and
+//	checkpoints keep while they wait for the disk; the buffer cache
+//	calls Log with its own lock held, so the journal never goes
+//	through the cache while it has its lock, except to replay
+//	records before the cache knows about it.
+//
+//	A commit writes out the images of every pending sector, so it
+//	has to wait until no transaction is half done.  Only Commit and
+//	Checkpoint, whose callers hold no locks, wait for that; End
+//	commits only when its transaction is the last one running.  A
+//	checkpoint does not have to wait: a sector that has
+//	been changed again since it was committed has what was committed
+//	kept aside, and that is what is written home.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "synch.h"
+#include "synchdisk.h"
+#include "bufcache.h"
+#include "sectorsum.h"
+#include "workerpool.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// CheckpointJob
+// 	Run by a kernel worker thread, when the journal is getting full,
+//	in the file system whose journal it is (see mounttable.h).  The
+//	journal is looked up again, in case the file system has been
+//	unmounted in the meantime.
+//
+//	"mount" -- the file system's entry in the mount table
+//----------------------------------------------------------------------
+
+static void
+CheckpointJob(void *mount)
+{
+    MountScope scope((MountEntry *) mount);
+    Journal *journal = kernel->bufferCache->GetJournal();
+
+    if (journal != NULL)
+	journal->Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize the journal kept in an area of the disk, holding
+//	nothing.  The area is read or written only by Recover and Format,
+//	and by commits and checkpoints.
+//
+//	"firstSector" -- the first sector of the area
+//	"numSectors" -- how many sectors it has
+//----------------------------------------------------------------------
+
+Journal::Journal(int firstSector, int numSectors)
+{
+    ASSERT(sizeof(JournalDescriptor) == SectorSize);
+    ASSERT(numSectors >= 3);
+
+    start = firstSector;
+    size = numSectors;
+
+    // a record, with its descriptors, must fit after the header
+    for (maxSlots = size - 1; maxSlots + DescriptorsFor(maxSlots) > size - 1;
+								maxSlots--)
+	;
+    slots = new JournalSlot[maxSlots];
+    for (int i = 0; i < maxSlots; i++) {
+	slots[i].sector = -1;
+	slots[i].pending = slots[i].inLog = FALSE;
+    }
+    slotOf = new int[NumSectors];
+    for (int i = 0; i < NumSectors; i++)
+	slotOf[i] = -1;
+    numUsed = numPending = 0;
+    head = 1;
+    sequence = 1;
+    committed = 0;
+    buffer = new char[size * SectorSize];
+
+    lock = new Lock("journal lock");
+    changed = new Condition("journal changed");
+    numOpen = 0;
+    committing = FALSE;
+    wanted = FALSE;
+    checkpointQueued = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::~Journal
+// 	De-allocate the journal.
+//----------------------------------------------------------------------
+
+Journal::~Journal()
+{
+    ASSERT(numOpen == 0);
+    delete [] slots;
+    delete [] slotOf;
+    delete [] buffer;
+    delete lock;
+    delete changed;
+}
+
+//----------------------------------------------------------------------
+// Journal::DescriptorsFor
+// 	Return how many descriptor sectors a record of "numSectors"
+//	sectors needs.
+//----------------------------------------------------------------------
+
+int
+Journal::DescriptorsFor(int numSectors)
+{
+    return divRoundUp(numSectors, DescriptorEntries);
+}
+
+//----------------------------------------------------------------------
+// Journal::Checksum
+// 	Return a checksum of "numSectors" sector images, to tell a whole
+//	record from one that was cut short.
+//----------------------------------------------------------------------
+
+int
+Journal::Checksum(char *images, int numSectors)
+{
+    unsigned int *word = (unsigned int *) images;
+    unsigned int sum = 0;
+
+    for (unsigned int i = 0; i < numSectors * SectorSize / sizeof(int); i++)
+	sum = ((sum << 1) | (sum >> 31)) + word[i];
+    return (int) sum;
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHeader
+// 	Write the header sector: the log is empty, and the next record
+//	written, right after the header, will be number "sequence".  It
+//	is a barrier and FUA write, so that the sectors written before it
+//	-- those a checkpoint wrote home -- are on the media before the
+//	records that hold them are forgotten, and the header itself is
+//	there when we return.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteHeader()
+{
+    int header[SectorSize / sizeof(int)];
+
+    bzero((char *) header, SectorSize);
+    header[0] = JournalMagic;
+    header[1] = sequence;
+    kernel->synchDisk->WriteSectors(start, 1, (char *) header, TRUE, TRUE);
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Make the journal empty, for a newly formatted disk.  The whole
+//	area is cleared, in one request, so that nothing left in it by
+//	an earlier file system looks like a record -- unless the disk
+//	has just been discarded, and the area reads as zeroes already:
+//	then only the header is written.
+//
+//	"discarded" -- does everything after the header read as zeroes?
+//----------------------------------------------------------------------
+
+void
+Journal::Format(bool discarded)
+{
+    int *header = (int *) buffer;
+
+    lock->Acquire();
+    sequence = 1;
+    committed = 0;
+    head = 1;
+    bzero(buffer, size * SectorSize);
+    header[0] = JournalMagic;
+    header[1] = sequence;
+    kernel->synchDisk->WriteSectors(start, discarded ? 1 : size, buffer,
+				    TRUE, TRUE);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Read the journal of a disk being mounted, and replay what it
+//	holds: write each whole record in it, in order, to where its
+//	sectors belong.  The first record that is not there, or is not
+//	complete, is the end.  Then the journal is made empty, and the
+//	next record written follows on from the last one there was.
+//
+//	Called when mounting, before anything reads the sectors that
+//	might be replayed, and before the buffer cache sends writes here.
+//	After a clean unmount there is nothing to replay.
+//----------------------------------------------------------------------
+
+void
+Journal::Recover()
+{
+    JournalDescriptor *desc = (JournalDescriptor *) buffer;
+    int *header = (int *) buffer;
+    int replayed = 0;
+    int pos, n, d, i;
+    bool fresh, whole;
+
+    lock->Acquire();
+    kernel->synchDisk->ReadSector(start, buffer);
+    fresh = (header[0] != JournalMagic);
+    if (fresh) {
+	DEBUG(dbgFile, "Journal has no header, starting it again.");
+	sequence = 1;
+    } else {
+	sequence = header[1];
+    }
+    for (pos = 1; !fresh && pos + 1 < size; pos += d + n) {
+	kernel->synchDisk->ReadSector(start + pos, buffer);
+	if (desc->magic != RecordMagic || desc->sequence != sequence)
+	    break;
+	n = desc->numSectors;
+	d = DescriptorsFor(n);
+	if (n <= 0 || pos + d + n > size)
+	    break;
+	kernel->synchDisk->ReadSectors(start + pos, d + n, buffer);
+	whole = (Checksum(&buffer[d * SectorSize], n) == desc->checksum);
+	for (i = 1; i < d && whole; i++) {
+	    whole = (desc[i].magic == RecordMagic
+		     && desc[i].sequence == sequence
+		     && desc[i].checksum == desc->checksum);
+	}
+	if (!whole)
+	    break;
+
+	DEBUG(dbgFile, "Journal replaying record " << sequence << ", " << n << " sectors");
+	for (i = 0; i < n; i++) {
+	    kernel->bufferCache->WriteSector(
+		desc[i / DescriptorEntries].sectors[i % DescriptorEntries],
+		&buffer[(d + i) * SectorSize]);
+	}
+	sequence++;
+	replayed++;
+    }
+    committed = sequence - 1;
+    head = 1;
+    if (replayed > 0) {
+	DEBUG(dbgFile, "Journal replayed " << replayed << " records.");
+	kernel->bufferCache->Flush();
+    }
+    if (fresh || replayed > 0)
+	WriteHeader();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::InTransaction
+// 	Return TRUE if the running thread is in a transaction.
+//----------------------------------------------------------------------
+
+bool
+Journal::InTransaction()
+{
+    return kernel->currentThread->transactionDepth > 0;
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin
+// 	Start a transaction for the running thread: until the matching
+//	End, whatever it writes belongs to it.  A thread already in one
+//	stays in it, so an operation can be made of others.
+//
+//	Begin never waits for other threads, since its caller may be
+//	holding a lock that a running transaction needs.  If more than
+//	three quarters of the journal's slots are in use, though, and
+//	nothing is running, and no worker has checkpointed it yet, the
+//	checkpoint is done now, so that there is room for this
+//	transaction.
+//----------------------------------------------------------------------
+
+void
+Journal::Begin()
+{
+    lock->Acquire();
+    if (kernel->currentThread->transactionDepth++ == 0) {
+	if (numUsed > maxSlots - maxSlots / 4 && numOpen == 0 && !committing) {
+	    if (numPending > 0)
+		CommitUpTo(sequence);
+	    WriteHome();
+	}
+	numOpen++;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::End
+// 	Finish the running thread's transaction.  When the last running
+//	transaction finishes, it commits everything pending, if there is
+//	enough to be worth it, or if the buffer cache is write-through
+//	and one of the transactions has to be on disk when it returns.
+//	Otherwise what the transactions wrote waits to be committed with
+//	the ones after them.  If another thread is waiting to commit, it
+//	will take this transaction along; End does not wait for it, for
+//	the same reason Begin does not.
+//
+//	"durable" -- FALSE if the transaction may wait, even in write-
+//		through mode, since nothing depends on it until another
+//		transaction has been committed after it (see
+//		FileSystem::ExtendFile)
+//----------------------------------------------------------------------
+
+void
+Journal::End(bool durable)
+{
+    lock->Acquire();
+    ASSERT(kernel->currentThread->transactionDepth > 0);
+    wanted = wanted || durable;
+    if (--kernel->currentThread->transactionDepth == 0) {
+	numOpen--;
+	changed->Broadcast(lock);
+	if (numOpen == 0 && !committing && numPending > 0
+		&& wanted && kernel->bufferCache->IsWriteThrough())
+	    CommitUpTo(sequence);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Log
+// 	Keep the image of a sector written by a transaction, until it is
+//	committed and checkpointed.  Return FALSE if the journal has no
+//	room for another sector; the caller then writes it like any
+//	other (and the transaction is not all or nothing).  Called by
+//	the buffer cache, with its lock held.
+//
+//	"sector" -- the sector written
+//	"data" -- its new contents
+//----------------------------------------------------------------------
+
+bool
+Journal::Log(int sector, char *data)
+{
+    JournalSlot *slot;
+    int which;
+
+    lock->Acquire();
+    which = slotOf[sector];
+    if (which == -1) {
+	if (numUsed == maxSlots) {
+	    DEBUG(dbgFile, "Journal full, sector " << sector << " not logged.");
+	    lock->Release();
+	    return FALSE;
+	}
+	for (which = 0; slots[which].sector != -1; which++)
+	    ;
+	slots[which].sector = sector;
+	slots[which].pending = slots[which].inLog = FALSE;
+	slotOf[sector] = which;
+	numUsed++;
+    }
+    slot = &slots[which];
+    if (!slot->pending) {
+	if (slot->inLog)		// the log has what was committed
+	    bcopy(slot->image, slot->committed, SectorSize);
+	slot->pending = TRUE;
+	numPending++;
+    }
+    bcopy(data, slot->image, SectorSize);
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Lookup
+// 	If the journal has an image of "sector", copy it into "data" and
+//	return TRUE.  It is newer than what is on disk, so a read that
+//	misses in the buffer cache must get it from here.
+//----------------------------------------------------------------------
+
+bool
+Journal::Lookup(int sector, char *data)
+{
+    int which = slotOf[sector];
+
+    if (which == -1)
+	return FALSE;
+    bcopy(slots[which].image, data, SectorSize);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Revoke
+// 	"sector" is about to be written without a transaction -- after a
+//	file header or directory sector is freed and given to a file's
+//	data, say.  The journal must not replay its old image over that:
+//	if it is in the log, the log is checkpointed now, and if it is
+//	only pending, it is dropped.
+//----------------------------------------------------------------------
+
+void
+Journal::Revoke(int sector)
+{
+    int which;
+
+    if (slotOf[sector] == -1)		// the usual case
+	return;
+    lock->Acquire();
+    if (slotOf[sector] != -1 && slots[slotOf[sector]].inLog)
+	WriteHome();
+    which = slotOf[sector];
+    if (which != -1) {
+	ASSERT(slots[which].pending && !slots[which].inLog);
+	DEBUG(dbgFile, "Journal dropping sector " << sector);
+	slots[which].sector = -1;
+	slotOf[sector] = -1;
+	numUsed--;
+	numPending--;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Commit every transaction that has finished, and wait until it is
+//	on disk.  The running thread must not be in a transaction.
+//----------------------------------------------------------------------
+
+void
+Journal::Commit()
+{
+    lock->Acquire();
+    ASSERT(!InTransaction());
+    if (numPending > 0)
+	CommitUpTo(sequence);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Commit every transaction that has finished, then write all of
+//	the log home, leaving the journal empty.  The running thread
+//	must not be in a transaction.
+//----------------------------------------------------------------------
+
+void
+Journal::Checkpoint()
+{
+    lock->Acquire();
+    ASSERT(!InTransaction());
+    if (numPending > 0)
+	CommitUpTo(sequence);
+    if (head > 1)
+	WriteHome();
+    checkpointQueued = FALSE;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::CommitUpTo
+// 	Make sure record "wanted" has been committed, committing it
+//	ourselves if no other thread is.  This is where commits are
+//	grouped: everything pending when the record is written goes in
+//	it, whoever wrote it, so the threads whose transactions it holds
+//	need not commit again.  The lock is held.
+//----------------------------------------------------------------------
+
+void
+Journal::CommitUpTo(int wanted)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    while (committed < wanted) {
+	if (committing) {
+	    changed->Wait(lock);	// someone else is writing it
+	    continue;
+	}
+	if (numPending == 0)		// there is nothing left of it
+	    break;
+	committing = TRUE;
+	while (numOpen > 0)
+	    changed->Wait(lock);
+	WriteRecord();
+	committing = FALSE;
+	changed->Broadcast(lock);
+    }
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteRecord
+// 	Write every pending sector to the log, as a record, in one disk
+//	request.  If it does not fit after the records already there,
+//	those are checkpointed first.  No transaction may be running.
+//
+//	The record is a barrier and FUA write: what was written before it
+//	-- the data of the files it commits -- is on the media first, and
+//	the record is there when the commit is done.  The disk queue is
+//	free to reorder everything else.
+//
+//	Once the log is half full, a worker thread is asked to
+//	checkpoint it, so that later commits do not have to.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteRecord()
+{
+    JournalDescriptor *desc = (JournalDescriptor *) buffer;
+    int n = numPending;
+    int d = DescriptorsFor(n);
+    int i, k, sum;
+
+    ASSERT(numOpen == 0);
+    if (n == 0)
+	return;
+    if (head + d + n > size)
+	WriteHome();
+    ASSERT(head + d + n <= size);
+
+    bzero(buffer, d * SectorSize);
+    for (i = 0, k = 0; i < maxSlots; i++) {
+	if (slots[i].sector == -1 || !slots[i].pending)
+	    continue;
+	desc[k / DescriptorEntries].sectors[k % DescriptorEntries] = slots[i].sector;
+	bcopy(slots[i].image, &buffer[(d + k) * SectorSize], SectorSize);
+	k++;
+    }
+    ASSERT(k == n);
+    sum = Checksum(&buffer[d * SectorSize], n);
+    for (i = 0; i < d; i++) {
+	desc[i].magic = RecordMagic;
+	desc[i].sequence = sequence;
+	desc[i].numSectors = n;
+	desc[i].checksum = sum;
+    }
+
+    DEBUG(dbgFile, "Journal committing record " << sequence << ", " << n << " sectors at " << start + head);
+    kernel->synchDisk->WriteSectors(start + head, d + n, buffer, TRUE, TRUE);
+    kernel->stats->numJournalCommits++;
+    kernel->stats->numJournalSectors += d + n;
+
+    for (i = 0; i < maxSlots; i++) {
+	if (slots[i].sector != -1 && slots[i].pending) {
+	    slots[i].pending = FALSE;
+	    slots[i].inLog = TRUE;
+	}
+    }
+    numPending = 0;
+    wanted = FALSE;
+    head += d + n;
+    committed = sequence++;
+
+    if (!checkpointQueued && head > size / 2) {
+	checkpointQueued = TRUE;
+	kernel->workerPool->Submit(CheckpointJob,
+				   (void *) kernel->currentThread->mount);
+    }
+}
+
+//----------------------------------------------------------------------
+// Journal::WriteHome
+// 	Checkpoint the log: write every sector in it to where it belongs,
+//	in sector order, each run of consecutive sectors as one request.
+//	A sector changed again since it was committed gets what was
+//	committed.  Then the header is rewritten, emptying the log, as a
+//	barrier behind them, and the sectors that are not pending are
+//	forgotten.  The lock is
+//	held.  The sectors go around the buffer cache, so their
+//	checksums are taken here.
+//----------------------------------------------------------------------
+
+void
+Journal::WriteHome()
+{
+    int *order = new int[maxSlots];
+    int count = 0;
+    int i, j, run;
+    JournalSlot *slot;
+    SectorSums *sums = kernel->bufferCache->GetChecksums();
+
+    for (i = 0; i < maxSlots; i++) {	// the slots in the log, sorted
+	if (slots[i].sector == -1 || !slots[i].inLog)
+	    continue;
+	for (j = count++; j > 0 && slots[order[j - 1]].sector > slots[i].sector; j--)
+	    order[j] = order[j - 1];
+	order[j] = i;
+    }
+
+    DEBUG(dbgFile, "Journal checkpointing " << count << " sectors.");
+    for (i = 0; i < count; i += run) {
+	for (run = 0; i + run < count; run++) {
+	    slot = &slots[order[i + run]];
+	    if (slot->sector != slots[order[i]].sector + run)
+		break;
+	    bcopy(slot->pending ? slot->committed : slot->image,
+		  &buffer[run * SectorSize], SectorSize);
+	}
+	if (sums != NULL)
+	    sums->Record(slots[order[i]].sector, run, buffer);
+	kernel->synchDisk->WriteSectors(slots[order[i]].sector, run, buffer);
+    }
+    head = 1;
+    WriteHeader();
+    kernel->stats->numCheckpoints++;
+
+    for (i = 0; i < count; i++) {
+	slot = &slots[order[i]];
+	slot->inLog = FALSE;
+	if (!slot->pending) {
+	    slotOf[slot->sector] = -1;
+	    slot->sector = -1;
+	    numUsed--;
+	}
+    }
+    delete [] order;
+}
+
+//----------------------------------------------------------------------
+// Journal::Print
+// 	Print where the journal is, and what it holds.
+//----------------------------------------------------------------------
+
+void
+Journal::Print()
+{
+    printf("Journal: sectors %d to %d, %d in use; next record %d, "
+	   "%d sectors held, %d of them pending\n", start, start + size - 1,
+	   head, sequence, numUsed, numPending);
+}
@@ -0,0 +1,160 @@
+// journal.h
+//	Data structures for the file system's metadata journal.
+//
+//	An operation such as Create changes several sectors -- the new
+//	file header, the directory, the free map -- which are written
+//	back separately, in whatever order the buffer cache chooses.  If
+//	Nachos stops part way, the disk is left with only some of them.
+//
+//	With a journal, the sectors an operation writes are first kept
+//	aside as a "transaction".  Every so often the transactions done
+//	since the last time are "committed": the images of all of the
+//	sectors they changed are written, in one go, to a record in the
+//	journal area, a track set aside for it when the disk is
+//	formatted.  Only after that are the sectors written to where
+//	they belong ("checkpointing"), in sector order, as a batch.  If
+//	Nachos stops before that is done, mounting the disk replays the
+//	records in the journal, so each operation is either all there
+//	or not there at all.
+//
+//	Committing many operations at once ("group commit") means that
+//	a sector changed by each of them -- the directory, say -- goes to
+//	the journal once, and the whole commit is one sequential write
+//	rather than a few random ones per operation.  Transactions are
+//	committed when the journal is running out of slots for them,
+//	when the buffer cache is flushed, and, if the cache is
+//	write-through, as soon as none is running (threads whose
+//	operations overlap share a commit).  Checkpoints are done by a
+//	kernel worker thread once the journal is half full, or when a
+//	commit does not fit, and on unmount.
+//
+//	The buffer cache does the work of finding what a transaction
+//	writes: while the running thread is in one, every sector it
+//	writes through the cache is handed to Log.  The journal keeps
+//	its own copy of each such sector until it is checkpointed, so
+//	the cache can drop it without writing it back, and reads of it
+//	are answered from that copy (see Lookup).
+//
+//	On disk the journal area is a header sector, saying what the
+//	sequence number of the first record is, followed by the records
+//	one after another.  A record is some descriptor sectors, listing
+//	the sectors it holds, then their images; the descriptors carry
+//	the record's sequence number and a checksum of the images, so a
+//	record that was not completely written, or one left over from
+//	before the last checkpoint, is not replayed.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+
+class Lock;
+class Condition;
+
+const int JournalSectors = SectorsPerTrack;	// a record is never split
+						// across tracks
+const int JournalMagic = 0x4e464a48;	// in the header sector
+const int RecordMagic = 0x4e464a52;	// in each descriptor sector
+const int DescriptorFields = 4;		// ints before the sector list
+const int DescriptorEntries = SectorSize / sizeof(int) - DescriptorFields;
+
+// The following class defines one descriptor sector of a record.
+
+class JournalDescriptor {
+  public:
+    int magic;				// RecordMagic
+    int sequence;			// of the record
+    int numSectors;			// in the whole record
+    int checksum;			// of all of their images
+    int sectors[DescriptorEntries];	// where they go; the first
+					// descriptor has the first ones
+};
+
+// The following class defines a sector the journal has a copy of.
+
+class JournalSlot {
+  public:
+    int sector;				// -1 if the slot is free
+    bool pending;			// changed since the last commit?
+    bool inLog;				// in a record not checkpointed yet?
+    char image[SectorSize];		// the latest contents
+    char committed[SectorSize];		// those in the log, if pending
+					// and inLog
+};
+
+// The following class defines the journal.
+
+class Journal {
+  public:
+    Journal(int firstSector, int numSectors);
+					// The journal in "numSectors"
+					// sectors from "firstSector"
+    ~Journal();				// Everything should have been
+					// checkpointed by now
+
+    void Format(bool discarded);	// Make the journal empty; only
+					// its header, if the disk has been
+					// discarded
+    void Recover();			// Replay the records in it
+
+    void Begin();			// Start a transaction for the
+					// running thread; may nest
+    void End(bool durable);		// Finish it; must it be on disk
+					// on return, if the cache is
+					// write-through?
+    bool InTransaction();		// Is the running thread in one?
+
+    bool Log(int sector, char *data);	// A transaction wrote "sector";
+					// FALSE if there is no room
+					// to keep it
+    bool Lookup(int sector, char *data); // Copy out the journal's image
+					// of "sector", if it has one
+    bool Holds(int sector) { return slotOf[sector] != -1; }
+    void Revoke(int sector);		// "sector" is being written
+					// outside any transaction
+
+    void Commit();			// Commit every finished
+					// transaction
+    void Checkpoint();			// Commit, then write everything
+					// home and empty the journal
+
+    void Print();			// Print the state of the journal
+
+  private:
+    int start;				// first sector of the area
+    int size;				// how many sectors it has
+    int maxSlots;			// the most sectors a record can hold
+    JournalSlot *slots;
+    int *slotOf;			// sector -> slot, -1 if none
+    int numUsed;			// slots holding a sector
+    int numPending;			// slots changed since the last commit
+    int head;				// where the next record goes
+    int sequence;			// sequence number of the next record
+    int committed;			// and of the last one committed
+    char *buffer;			// staging area for a whole record
+
+    Lock *lock;				// protects all of the above
+    Condition *changed;			// a transaction ended, or a commit
+					// is done
+    int numOpen;			// threads in a transaction (each
+					// keeps how deeply it is nested)
+    bool committing;			// is a commit under way?
+    bool wanted;			// has a finished transaction asked
+					// to be on disk?
+    bool checkpointQueued;		// is a worker on its way?
+
+    void CommitUpTo(int wanted);	// commit records up to "wanted"
+    void WriteRecord();			// write the pending sectors as one
+    void WriteHome();			// checkpoint what is in the log
+    void WriteHeader();			// say where the log starts
+    int DescriptorsFor(int numSectors);	// that a record of them needs
+    static int Checksum(char *images, int numSectors);
+};
+
+#endif // JOURNAL_H
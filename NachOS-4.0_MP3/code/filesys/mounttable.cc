@@ -0,0 +1,267 @@
+// mounttable.cc
+//	Routines to mount file systems on directories of the root one,
+//	and to move threads between them.  See mounttable.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "mounttable.h"
+#include "filesys.h"
+#include "synchdisk.h"
+#include "bufcache.h"
+#include "inodetable.h"
+#include "debug.h"
+#include "main.h"
+
+#ifndef FILESYS_STUB
+
+//----------------------------------------------------------------------
+// MountEntry::MountEntry
+// 	Record a file system mounted on the directory of "onFs" whose
+//	header is at "onSector", and the devices it works on.  It has no
+//	FileSystem yet.
+//----------------------------------------------------------------------
+
+MountEntry::MountEntry(FileSystem *onFs, int onSector, char *onPath,
+		       SynchDisk *d, BufferCache *c, InodeTable *i)
+{
+    parent = onFs;
+    sector = onSector;
+    path = onPath;
+    disk = d;
+    cache = c;
+    inodes = i;
+    fileSystem = NULL;
+}
+
+//----------------------------------------------------------------------
+// MountTable::MountTable
+// 	Initialize the table, with only the root in it, on the kernel's
+//	devices; its FileSystem is kernel->fileSystem.
+//----------------------------------------------------------------------
+
+MountTable::MountTable(SynchDisk *disk, BufferCache *cache,
+		       InodeTable *inodes)
+{
+    root = new MountEntry(NULL, -1, "/", disk, cache, inodes);
+    numMounts = 0;
+}
+
+//----------------------------------------------------------------------
+// MountTable::~MountTable
+// 	Delete the disks of the file systems Unmount took down, and the
+//	table, once the scheduler and the interrupts are gone, as the
+//	kernel does its own disk (see Kernel::~Kernel): until then the
+//	threads a file system forked may run, in it.  Their buffer
+//	caches are not deleted, since their flushers sleep on them until
+//	Nachos exits; they have nothing left to write.
+//----------------------------------------------------------------------
+
+MountTable::~MountTable()
+{
+    for (int i = numMounts - 1; i >= 0; i--) {
+	delete entries[i]->disk;
+	delete entries[i];
+    }
+    delete root;
+}
+
+//----------------------------------------------------------------------
+// MountTable::Unmount
+// 	Unmount every file system but the root, at halt, the last
+//	mounted first, so that one mounted on another goes before it.
+//	Each is unmounted from inside it, then its inode table goes,
+//	its buffer cache is written back and the log on its disk, if it
+//	has one, is closed; the same order as the kernel's own.
+//----------------------------------------------------------------------
+
+void
+MountTable::Unmount()
+{
+    for (int i = numMounts - 1; i >= 0; i--) {
+	MountEntry *m = entries[i];
+	MountScope scope(m);
+
+	DEBUG(dbgFile, "Unmounting " << m->path);
+	delete m->fileSystem;
+	m->fileSystem = NULL;
+	delete m->inodes;
+	m->inodes = NULL;
+	m->cache->Flush();
+	m->disk->CloseLog();
+    }
+}
+
+//----------------------------------------------------------------------
+// MountTable::Mount
+// 	Mount the file system on "disk" on the directory "path", making
+//	the directory if it is not there (see FileSystem::MountPoint).
+//	The file system is made from inside it, so that it works on its
+//	own devices, and so do the threads it forks, starting with the
+//	buffer cache's flusher.  Return FALSE, deleting the devices, if
+//	there is no such directory and there cannot be one, or too many
+//	file systems are mounted already.
+//
+//	"format" -- should the disk be formatted first?
+//----------------------------------------------------------------------
+
+bool
+MountTable::Mount(char *path, SynchDisk *disk, BufferCache *cache,
+		  InodeTable *inodes, bool format)
+{
+    FileSystem *onFs;
+    int sector = -1;
+    MountEntry *m;
+
+    if (numMounts < MaxMounts - 1)
+	sector = kernel->fileSystem->MountPoint(path, &onFs);
+    if (sector == -1) {
+	delete inodes;
+	delete cache;
+	delete disk;
+	return FALSE;
+    }
+    m = new MountEntry(onFs, sector, path, disk, cache, inodes);
+    {
+	MountScope scope(m);
+
+	cache->StartFlusher();
+	m->fileSystem = new FileSystem(format);
+    }
+    entries[numMounts++] = m;
+    DEBUG(dbgFile, "Mounted a file system on " << path << ", sector "
+		   << sector);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// MountTable::On
+// 	Return the entry of the file system mounted on the directory of
+//	"fs" whose header is at "sector", or NULL if there is none.
+//----------------------------------------------------------------------
+
+MountEntry *
+MountTable::On(FileSystem *fs, int sector)
+{
+    for (int i = 0; i < numMounts; i++) {
+	if (entries[i]->parent == fs && entries[i]->sector == sector)
+	    return entries[i];
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// MountTable::HasMounts
+// 	Return TRUE if some file system is mounted on a directory of
+//	"fs", so that its paths need looking at (see FileSystem::Route).
+//----------------------------------------------------------------------
+
+bool
+MountTable::HasMounts(FileSystem *fs)
+{
+    for (int i = 0; i < numMounts; i++) {
+	if (entries[i]->parent == fs)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// MountTable::FileSystemOf
+// 	Return the file system of the entry "m": kernel->fileSystem for
+//	the root (NULL), whatever the entry says otherwise.  NULL while
+//	it is being made.
+//----------------------------------------------------------------------
+
+FileSystem *
+MountTable::FileSystemOf(MountEntry *m)
+{
+    return (m == NULL) ? kernel->fileSystem : m->fileSystem;
+}
+
+//----------------------------------------------------------------------
+// MountTable::Current
+// 	Return the file system the running thread is in, as FileSystemOf
+//	does.
+//----------------------------------------------------------------------
+
+FileSystem *
+MountTable::Current()
+{
+    return FileSystemOf(kernel->currentThread->mount);
+}
+
+//----------------------------------------------------------------------
+// MountTable::Use
+// 	Point the kernel at the disk, the buffer cache and the inode
+//	table of the entry "m", or of the root if it is NULL.  Called
+//	when a thread goes into a file system or out of it, and when the
+//	scheduler switches to a thread in another one (see
+//	Scheduler::Switch).
+//----------------------------------------------------------------------
+
+void
+MountTable::Use(MountEntry *m)
+{
+    if (m == NULL)
+	m = root;
+    kernel->synchDisk = m->disk;
+    kernel->bufferCache = m->cache;
+    kernel->inodeTable = m->inodes;
+}
+
+//----------------------------------------------------------------------
+// MountTable::Sync
+// 	Send what every file system holds back to its disk: every open
+//	file's held back writes to the buffer cache, the cache to the
+//	disk, and the disk into its UNIX file, if it is mapped.
+//----------------------------------------------------------------------
+
+void
+MountTable::Sync()
+{
+    for (int i = -1; i < numMounts; i++) {
+	MountScope scope((i < 0) ? NULL : entries[i]);
+
+	kernel->inodeTable->Sync();
+	kernel->bufferCache->Flush();	// flushes the disk's cache too
+	kernel->synchDisk->Sync();
+    }
+}
+
+//----------------------------------------------------------------------
+// MountScope::MountScope
+// 	Take the running thread into the file system of the entry "m"
+//	(NULL for the root), unless it is there already.  The thread says
+//	so first, so that a switch away and back in the meantime finds
+//	the devices it will use.
+//----------------------------------------------------------------------
+
+MountScope::MountScope(MountEntry *m)
+{
+    Thread *t = kernel->currentThread;
+
+    saved = t->mount;
+    moved = (m != saved);
+    if (moved) {
+	t->mount = m;
+	kernel->mounts->Use(m);
+    }
+}
+
+//----------------------------------------------------------------------
+// MountScope::~MountScope
+// 	Take the running thread back to the file system it was in.
+//----------------------------------------------------------------------
+
+MountScope::~MountScope()
+{
+    if (moved) {
+	kernel->currentThread->mount = saved;
+	kernel->mounts->Use(saved);
+    }
+}
+
+#endif // FILESYS_STUB
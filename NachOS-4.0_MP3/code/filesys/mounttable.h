@@ -0,0 +1,123 @@
+// mounttable.h
+//	Data structures for the file systems mounted on directories of
+//	the root one (-mount).
+//
+//	Every file system has a disk of its own, and a buffer cache, an
+//	inode table, a free map and a namespace lock of its own in front
+//	of it.  The mount table says which directory of which file system
+//	each one is mounted on; a path that goes through that directory
+//	goes on from the root of the mounted one instead (see
+//	FileSystem::Route), and what was in the directory is hidden until
+//	Nachos halts.
+//
+//	The file system code finds the disk, the buffer cache and the
+//	inode table it is to use in the kernel: kernel->synchDisk,
+//	kernel->bufferCache and kernel->inodeTable are always those of
+//	the file system the running thread is in.  A thread goes into a
+//	mounted file system with a MountScope, for as long as it works
+//	there, and each thread remembers which one it is in
+//	(Thread::mount), so that the scheduler can put the kernel's
+//	pointers back when it next runs.  A thread forked by one that is
+//	in a mounted file system starts out in it too, so the background
+//	threads of a mounted file system -- its flusher, reclaimer and
+//	the like -- work on their own disk.
+//
+//	Each open file remembers the file system it was opened in, and
+//	goes back into it for every read and write (see openfile.h); so
+//	a program's descriptors can be of files on any of them.
+//
+//	A file or directory cannot be renamed, or cloned, from one file
+//	system into another, nor can a file system be unmounted before
+//	Nachos halts.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef MOUNTTABLE_H
+#define MOUNTTABLE_H
+
+class FileSystem;
+class SynchDisk;
+class BufferCache;
+class InodeTable;
+
+const int MaxMounts = 8;		// file systems mounted at once, with
+					// the root
+
+// The following class defines one file system of the mount table,
+// and the devices it works on.
+
+class MountEntry {
+  public:
+    MountEntry(FileSystem *onFs, int onSector, char *onPath,
+	       SynchDisk *disk, BufferCache *cache, InodeTable *inodes);
+
+    FileSystem *parent;			// the one it is mounted on; NULL
+					// for the root
+    int sector;				// header sector of the directory of
+					// "parent" it is mounted on
+    char *path;				// and that directory's path
+    SynchDisk *disk;			// what it works on
+    BufferCache *cache;
+    InodeTable *inodes;
+    FileSystem *fileSystem;		// NULL while it is being made
+};
+
+// The following class defines the table of mounted file systems.  The
+// root's entry is made with the table, from the kernel's devices; the
+// kernel deletes those itself.
+
+class MountTable {
+  public:
+    MountTable(SynchDisk *disk, BufferCache *cache, InodeTable *inodes);
+					// A table with only the root in it
+    ~MountTable();			// Delete the disks, once nothing
+					// runs any more
+
+    void Unmount();			// Unmount all but the root, the
+					// last mounted first
+
+    bool Mount(char *path, SynchDisk *disk, BufferCache *cache,
+	       InodeTable *inodes, bool format);
+					// Mount a file system on the
+					// directory "path", making the
+					// directory if need be; formatting
+					// the disk first, if "format"
+    MountEntry *On(FileSystem *fs, int sector);
+					// The file system mounted on a
+					// directory, NULL if none is
+    bool HasMounts(FileSystem *fs);	// Is anything mounted on "fs"?
+    FileSystem *FileSystemOf(MountEntry *m);
+					// The file system of an entry, NULL
+					// for the root; NULL while it is
+					// being made
+    FileSystem *Current();		// That of the running thread
+    void Use(MountEntry *m);		// Point the kernel at the devices
+					// of an entry; NULL for the root
+    void Sync();			// Send what every file system has
+					// held back to its disk (SysSync)
+
+  private:
+    MountEntry *root;			// the root's devices
+    MountEntry *entries[MaxMounts];	// the others, in order of mounting
+    int numMounts;
+};
+
+// The following class defines a thread's stay in a file system: it is
+// in the file system of the entry from the constructor until the
+// destructor, which takes it back to where it was.
+
+class MountScope {
+  public:
+    MountScope(MountEntry *m);		// Go into "m"; NULL for the root
+    ~MountScope();			// and back out of it
+
+  private:
+    MountEntry *saved;			// where the thread was before
+    bool moved;				// was that somewhere else?
+};
+
+#endif // MOUNTTABLE_H
@@ -7,6 +7,23 @@
 //	Also as in UNIX, for convenience, we keep the file header in
 //	memory while the file is open.
 //
+//	Each OpenFile watches whether it is being read sequentially, that
+//	is, whether every read starts where the previous one ended.  If so,
+//	it keeps a window of sectors past the last read prefetched into
+//	the buffer cache; the window doubles with each sequential read, up
+//	to MaxReadAhead sectors, and closes as soon as a read goes
+//	anywhere else.
+//
+//	A program that knows how it will use the file can say so instead
+//	(see Advise): a file to be read sequentially gets the largest
+//	window from the start, and the sectors it has read are the first
+//	to go from the buffer cache, so a long scan does not push out
+//	what is used again; one to be read at random gets no read-ahead.
+//
+//	A compressed file is read and written through its cluster buffer
+//	instead (see clusterbuf.h); it has no use for the write buffer or
+//	read-ahead, since a whole cluster is read in at once.
+//
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -16,31 +33,122 @@
 #include "main.h"
 #include "filehdr.h"
 #include "openfile.h"
-#include "synchdisk.h"
+#include "bufcache.h"
+#include "inodetable.h"
+#include "mounttable.h"
+#include "kernelprofile.h"
+#include "memcount.h"
+
+static const int MinReadAhead = 2;	// first window, in sectors
+static const int MaxReadAhead = 16;	// largest window, in sectors
+static const int ReadBatchSectors = 32;	// sector numbers ReadAt looks
+					// up at once
+
+// The following class charges a file what the running thread's
+// counters gain while one read or write of it is under way, however
+// the call returns.
+
+class IoCounter {
+  public:
+    IoCounter(FileIoStats *fileStats);
+    ~IoCounter();
+
+  private:
+    FileIoStats *ioStats;
+    ThreadStats *mine;
+    int bytesRead, bytesWritten;	// the thread's counters when the
+    int sectorReads, sectorWrites;	// call started
+    int cacheHits;
+};
+
+IoCounter::IoCounter(FileIoStats *fileStats)
+{
+    ioStats = fileStats;
+    mine = kernel->currentThread->stats;
+    bytesRead = mine->bytesRead;
+    bytesWritten = mine->bytesWritten;
+    sectorReads = mine->numDiskReads;
+    sectorWrites = mine->numDiskWrites;
+    cacheHits = mine->numCacheHits;
+}
+
+IoCounter::~IoCounter()
+{
+    ioStats->bytesRead += mine->bytesRead - bytesRead;
+    ioStats->bytesWritten += mine->bytesWritten - bytesWritten;
+    ioStats->sectorReads += mine->numDiskReads - sectorReads;
+    ioStats->sectorWrites += mine->numDiskWrites - sectorWrites;
+    ioStats->cacheHits += mine->numCacheHits - cacheHits;
+}
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open; if the file is open already,
+//	the header in memory is shared (see inodetable.h).
+//
+//	The file is in the file system the running thread is in; every
+//	call that reads or writes it goes back into that one, wherever
+//	it is made from (see mounttable.h).
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 { 
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    hdrSector = sector;
+    mount = kernel->currentThread->mount;
+    hdr = kernel->inodeTable->Acquire(sector);
+    writeBuffer = kernel->inodeTable->WriteBufferOf(sector);
+    rangeLocks = kernel->inodeTable->RangeLocksOf(sector);
+    clusterBuffer = kernel->inodeTable->ClusterBufferOf(sector);
+    ioStats = kernel->inodeTable->IoStatsOf(sector);
     seekPosition = 0;
+    nextReadPosition = 0;
+    readAheadWindow = 0;
+    readAheadEnd = 0;
+    advice = AdviseNormal;
+    MemCount::Add(MemOpenFile, sizeof(OpenFile));
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	The file header and write buffer go away with the last OpenFile
+//	on the file; the buffer is flushed then.  A cluster buffer is
+//	flushed here, before the inode table is locked (see
+//	InodeTable::Release).
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    MountScope scope(mount);
+
+    if (clusterBuffer != NULL)
+	clusterBuffer->Flush();
+    rangeLocks->ReleaseAll(this);
+    kernel->inodeTable->Release(hdrSector);
+    MemCount::Remove(MemOpenFile, sizeof(OpenFile));
+}
+
+thread_local Slab OpenFile::slab("open files", sizeof(OpenFile));
+
+//----------------------------------------------------------------------
+// OpenFile::operator new, OpenFile::operator delete
+// 	Allocate the space for an OpenFile from its slab, and release it
+//	back there.
+//----------------------------------------------------------------------
+
+void *
+OpenFile::operator new(size_t size)
+{
+    return slab.Alloc(size);
+}
+
+void
+OpenFile::operator delete(void *p, size_t size)
+{
+    slab.Free(p, size);
 }
 
 //----------------------------------------------------------------------
@@ -97,13 +205,37 @@ OpenFile::Write(char *into, int numBytes)
 //	sector at a time.  Thus:
 //
 //	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   Whole sectors go straight into the caller's buffer, those that
+//	   are consecutive on disk with a single request; of a partial
+//	   first or last sector, the cache copies out just the part we
+//	   want.  No staging buffer is needed.  The sector numbers are
+//	   looked up ReadBatchSectors at a time.  A hole, or a sector
+//	   that was preallocated and not written yet (see filehdr.h), is
+//	   just zeroed, without going to the disk.
+//	   Then the read-ahead window is moved along (see UpdateReadAhead),
+//	   and if the file is being scanned (AdviseSequential), the whole
+//	   sectors read are demoted in the buffer cache.
+//	   Bytes still held back in the file's write buffer are flushed
+//	   first.  A small file kept inline in its header (see filehdr.h)
+//	   is just copied out of it, and a compressed one out of its
+//	   cluster buffer.
 //	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   Nothing is written if the file system is mounted read-only.
+//	   A write past the end of the file first makes the file longer
+//	   (any gap between the old end and the write reads as zeroes);
+//	   if the disk is full, the write stops at the old end.  Holes
+//	   the write goes into get their sectors first (and unwritten
+//	   sectors are readied); if there is no room for them, nothing
+//	   is written.  The
+//	   bytes then go to the file's write buffer, which merges them
+//	   with the writes around them and only reads in a partially
+//	   written sector when it has to (see writebuf.h).  The bytes of
+//	   an inline file go into its header instead, which in
+//	   write-through mode is written back right away; those of a
+//	   compressed file go into its cluster buffer, and stop short if
+//	   there may be no room for the clusters they are in.
+//	Either way, what the call cost is added to the file's I/O
+//	counters (see FileIoStats in writebuf.h).
 //
 //	"into" -- the buffer to contain the data to be read from disk 
 //	"from" -- the buffer containing the data to be written to disk 
@@ -115,9 +247,12 @@ OpenFile::Write(char *into, int numBytes)
 int
 OpenFile::ReadAt(char *into, int numBytes, int position)
 {
+    ProfileRegion region("OpenFile::ReadAt");
+    MountScope scope(mount);
+    IoCounter counter(ioStats);
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
+    int i, run, batch, whole, firstSector, lastSector, fileSector;
+    int sectors[ReadBatchSectors];
 
     if ((numBytes <= 0) || (position >= fileLength))
     	return 0; 				// check request
@@ -125,61 +260,501 @@ OpenFile::ReadAt(char *into, int numBytes, int position)
 	numBytes = fileLength - position;
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
-    firstSector = divRoundDown(position, SectorSize);
-    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
+    if (hdr->IsInline()) {			// the data is in the header
+	hdr->ReadInline(into, numBytes, position);
+	kernel->currentThread->stats->bytesRead += numBytes;
+	return numBytes;
+    }
+    if (clusterBuffer != NULL) {		// a cluster at a time
+	clusterBuffer->Read(into, numBytes, position);
+	kernel->currentThread->stats->bytesRead += numBytes;
+	return numBytes;
+    }
+
+    firstSector = SectorOf(position);
+    lastSector = SectorOf(position + numBytes - 1);
+
+    // anything written there but held back has to be in the cache first
+    writeBuffer->FlushRange(position, numBytes);
+
+    for (fileSector = firstSector; fileSector <= lastSector; fileSector += batch) {
+	batch = min(ReadBatchSectors, lastSector - fileSector + 1);
+	hdr->ByteRangeToSectors(fileSector * SectorSize, batch * SectorSize,
+				sectors);
 
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
+	// the last sector of the request may be partial
+	whole = batch;
+	if (fileSector + batch - 1 == lastSector
+			&& InSector(position + numBytes) != 0)
+	    whole--;
 
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete [] buf;
+	for (i = 0; i < batch; i += run) {
+	    int lo = max(position, (fileSector + i) * SectorSize);
+	    int hi = min(position + numBytes, (fileSector + i + 1) * SectorSize);
+
+	    if (FileHeader::IsUnwritten(sectors[i])) { // reads as zeroes
+		run = FileHeader::RunLength(sectors, i, batch);
+		hi = min(position + numBytes, (fileSector + i + run) * SectorSize);
+		bzero(&into[lo - position], hi - lo);
+	    } else if (hi - lo < SectorSize) {
+		kernel->bufferCache->ReadBytes(sectors[i], InSector(lo),
+					       hi - lo, &into[lo - position]);
+		run = 1;
+		ioStats->runs++;
+	    } else {
+		run = FileHeader::RunLength(sectors, i, whole);
+		kernel->bufferCache->ReadSectors(sectors[i], run,
+						 &into[lo - position]);
+		ioStats->runs++;
+	    }
+	}
+	if (advice == AdviseSequential)
+	    DemoteSectors(sectors, whole);	// not wanted again
+    }
+    UpdateReadAhead(position, numBytes);
+    kernel->currentThread->stats->bytesRead += numBytes;
     return numBytes;
 }
 
 int
 OpenFile::WriteAt(char *from, int numBytes, int position)
 {
+    MountScope scope(mount);
+    FileSystem *fs = kernel->mounts->Current();
+    IoCounter counter(ioStats);
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
 
-    if ((numBytes <= 0) || (position >= fileLength))
+    if ((numBytes <= 0) || (position < 0))
 	return 0;				// check request
-    if ((position + numBytes) > fileLength)
+    if (fs != NULL && fs->IsReadOnly())
+	return 0;				// mounted -ro
+    hdr->NoteWrite();				// pages cached are stale
+    if ((position + numBytes) > fileLength &&
+		!fs->ExtendFile(hdr, hdrSector, position,
+						    position + numBytes)) {
+	if (position >= fileLength)		// disk full
+	    return 0;
 	numBytes = fileLength - position;
+    }
+    if (!MakeWritable(position, numBytes))
+	return 0;				// disk full
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
 
-    firstSector = divRoundDown(position, SectorSize);
-    lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
+    if (hdr->IsInline()) {			// the gap is zeroed already
+	hdr->WriteInline(from, numBytes, position);
+	if (kernel->bufferCache->IsWriteThrough())
+	    hdr->WriteBack(hdrSector);
+	kernel->currentThread->stats->bytesWritten += numBytes;
+	return numBytes;
+    }
+    if (clusterBuffer != NULL) {		// the gap reads as zeroes
+	numBytes = clusterBuffer->Write(from, numBytes, position);
+	kernel->currentThread->stats->bytesWritten += numBytes;
+	return numBytes;
+    }
+    if (position > fileLength)
+	ZeroGap(fileLength, position);
+    writeBuffer->Write(from, numBytes, position);
+    kernel->currentThread->stats->bytesWritten += numBytes;
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::MakeWritable
+// 	Make sure "numBytes" bytes of the file, from "position" on, can
+//	be written in place: give sectors to the holes and unwritten
+//	sectors among them, and a copy of its own of each sector the file
+//	shares with another (see FileSystem::FillHoles).  Return FALSE if
+//	the disk is too full.  The file system's own files, written while
+//	it is still being set up, share nothing.
+//----------------------------------------------------------------------
 
-    buf = new char[numSectors * SectorSize];
+bool
+OpenFile::MakeWritable(int position, int numBytes)
+{
+    FileSystem *fs = kernel->mounts->Current();
 
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
+    if (!hdr->HasUnwritten(position, numBytes)
+		&& (fs == NULL || !fs->HasShared(hdr, position, numBytes)))
+	return TRUE;
+    return fs->FillHoles(hdr, hdrSector, position, numBytes);
+}
 
-// read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);	
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize], 
-				SectorSize, lastSector * SectorSize);	
+//----------------------------------------------------------------------
+// OpenFile::ZeroGap
+// 	Make the file bytes [from, to), which the file was just extended
+//	over, read as zeroes.  An inline file has them zeroed already, and
+//	so does a compressed one (see clusterbuf.cc).
+//	If there is a hole or unwritten sector among them, the file was
+//	extended sparsely: they read as zeroes already, and so does the
+//	rest of the sector the file ended in (see FileHeader::FillHoles).
+//	Otherwise they are written, through the write buffer, once the
+//	sector the file ended in is its own (see MakeWritable); if the
+//	disk is too full to copy it, the gap keeps what it held before.
+//----------------------------------------------------------------------
 
-// copy in the bytes we want to change 
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+void
+OpenFile::ZeroGap(int from, int to)
+{
+    char *zeros;
 
-// write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)	
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize), 
-					&buf[(i - firstSector) * SectorSize]);
-    delete [] buf;
-    return numBytes;
+    if (hdr->IsInline() || hdr->IsCompressed()
+		|| hdr->HasUnwritten(from, to - from)
+		|| !MakeWritable(from, to - from))
+	return;
+    zeros = new char[to - from];
+    bzero(zeros, to - from);
+    writeBuffer->Write(zeros, to - from, from);
+    delete [] zeros;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Truncate
+// 	Make the file "newLength" bytes long (UNIX ftruncate).  Bytes
+//	past the new end are thrown away, along with the sectors that
+//	held them; if the file grows, the new bytes read as zeroes, and
+//	on a disk with holes take no space yet.  The rest of the last
+//	sector (of a compressed file, cluster) is zeroed first, in case
+//	the file grows over it again.
+//	Return FALSE if "newLength" is negative, the disk is full, or
+//	the file system is mounted read-only.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Truncate(int newLength)
+{
+    MountScope scope(mount);
+    FileSystem *fs = kernel->mounts->Current();
+    int fileLength = hdr->FileLength();
+    int tail = min(fileLength, divRoundUp(newLength, SectorSize) * SectorSize) - newLength;
+
+    if (newLength < 0 || fs->IsReadOnly())
+	return FALSE;
+    hdr->NoteWrite();
+    if (newLength > fileLength) {
+	if (!fs->ExtendFile(hdr, hdrSector, newLength, newLength))
+	    return FALSE;
+	ZeroGap(fileLength, newLength);
+	return TRUE;
+    }
+    if (newLength == fileLength)
+	return TRUE;
+    if (clusterBuffer != NULL)
+	clusterBuffer->Truncate(newLength);
+    else if (tail > 0 && !hdr->IsInline() && !hdr->HasUnwritten(newLength, tail)
+		&& MakeWritable(newLength, tail)) {
+	char zeros[SectorSize];
+
+	bzero(zeros, tail);
+	writeBuffer->Write(zeros, tail, newLength);
+    }
+    writeBuffer->Flush();			// nothing held back for sectors
+						// about to be freed
+    fs->TruncateFile(hdr, hdrSector, newLength);
+    readAheadEnd = min(readAheadEnd, divRoundUp(newLength, SectorSize));
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Allocate
+// 	Set aside disk space for the "numBytes" bytes of the file from
+//	"position" on, making the file longer if they go past its end,
+//	so that writing them later cannot fail for lack of space (UNIX
+//	fallocate).  Nothing is written: the bytes read as they did, and
+//	new ones as zeroes (see FileHeader::Preallocate).  A file that
+//	cannot have holes (see FileSystem::PreallocateFile) has the new
+//	bytes zeroed instead.  Return FALSE if the range is bad, the
+//	disk is full, or the file system is mounted read-only.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Allocate(int position, int numBytes)
+{
+    MountScope scope(mount);
+    FileSystem *fs = kernel->mounts->Current();
+    int fileLength = hdr->FileLength();
+
+    if (position < 0 || numBytes <= 0 || fs->IsReadOnly())
+	return FALSE;
+    if (!fs->PreallocateFile(hdr, hdrSector, position, numBytes))
+	return FALSE;
+    if (position + numBytes > fileLength)
+	ZeroGap(fileLength, position + numBytes);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Sync
+// 	Send every write to the file that is still held back in its
+//	write buffer on to the buffer cache, along with the file header
+//	if the file has grown (UNIX fsync).  A compressed file has the
+//	clusters written to in its cluster buffer written out.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Sync()
+{
+    MountScope scope(mount);
+
+    if (clusterBuffer != NULL)
+	clusterBuffer->Flush();
+    writeBuffer->Flush();
+    if (hdr->IsDirty())
+	hdr->WriteBack(hdrSector);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Fsync
+// 	Make sure everything written to the file so far is on disk: send
+//	on what the write buffer holds (see Sync), then have the buffer
+//	cache write the file's sectors and its header back, and commit
+//	the journal, which has the rest of the file's metadata (UNIX
+//	fsync).  A mapped disk image is synced as well.
+//----------------------------------------------------------------------
+
+void
+OpenFile::Fsync()
+{
+    MountScope scope(mount);
+    int numSectors, *sectors, i, j;
+
+    Sync();
+    if (hdr->IsCompressed()) {
+	sectors = new int[divRoundUp(hdr->FileLength(), ClusterSize)
+				* ClusterSectors + 1];
+	j = hdr->CompressedSectors(sectors);
+    } else {
+	numSectors = hdr->IsInline() ? 0 : divRoundUp(hdr->FileLength(), SectorSize);
+	sectors = new int[numSectors + 1];
+	if (numSectors > 0)
+	    hdr->ByteRangeToSectors(0, hdr->FileLength(), sectors);
+	for (i = j = 0; i < numSectors; i++)	// holes have nothing to write
+	    if (!FileHeader::IsUnwritten(sectors[i]))
+		sectors[j++] = sectors[i];
+    }
+    sectors[j] = hdrSector;
+    kernel->bufferCache->SyncSectors(sectors, j + 1);
+    kernel->synchDisk->Sync();
+    delete [] sectors;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::UpdateReadAhead
+// 	Called after "numBytes" have been read at "position".  If the read
+//	started where the last one ended, grow the read-ahead window and
+//	make sure the sectors in it are on their way into the buffer
+//	cache; otherwise close the window.
+//
+//	To keep the number of disk requests down, nothing is sent until
+//	less than half of the window is left prefetched ahead of the
+//	reader; then the whole window is topped up at once.
+//
+//	Advice overrides the guess: a file advised AdviseSequential always
+//	has the largest window, and one advised AdviseRandom none.
+//----------------------------------------------------------------------
+
+void
+OpenFile::UpdateReadAhead(int position, int numBytes)
+{
+    int fileSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    int nextSector = divRoundUp(position + numBytes, SectorSize);
+    int first, last;
+
+    if (advice == AdviseRandom) {
+	readAheadWindow = 0;
+    } else if (advice == AdviseSequential) {
+	if (position != nextReadPosition)
+	    readAheadEnd = 0;			// a new place to scan from
+	readAheadWindow = MaxReadAhead;
+    } else if (position != nextReadPosition) {
+	readAheadWindow = 0;			// random access
+	readAheadEnd = 0;
+    } else if (readAheadWindow == 0) {
+	readAheadWindow = MinReadAhead;
+    } else {
+	readAheadWindow = min(2 * readAheadWindow, MaxReadAhead);
+    }
+    nextReadPosition = position + numBytes;
+    if (readAheadWindow == 0 ||
+		readAheadEnd - nextSector > readAheadWindow / 2)
+	return;
+
+    first = max(nextSector, readAheadEnd);
+    last = min(nextSector + readAheadWindow, fileSectors);
+    if (first >= last)
+	return;
+    DEBUG(dbgFile, "Reading ahead file sectors " << first << " to " << last - 1);
+    PrefetchSectors(first, last - first);
+    readAheadEnd = last;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::PrefetchSectors / DemoteSectors
+// 	Start reading "count" file sectors from "first" on into the
+//	buffer cache, without waiting for them; or make the disk sectors
+//	"sectors" of the file the next ones the cache replaces (see
+//	BufferCache::Demote).  Either way, each run of consecutive
+//	sectors is one call to the cache, and holes and unwritten sectors,
+//	which are never cached, are skipped.
+//----------------------------------------------------------------------
+
+void
+OpenFile::PrefetchSectors(int first, int count)
+{
+    int *sectors = new int[count];
+
+    hdr->ByteRangeToSectors(first * SectorSize, count * SectorSize, sectors);
+    for (int i = 0, run; i < count; i += run) {
+	run = FileHeader::RunLength(sectors, i, count);
+	if (!FileHeader::IsUnwritten(sectors[i]))
+	    kernel->bufferCache->Prefetch(sectors[i], run);
+    }
+    delete [] sectors;
+}
+
+void
+OpenFile::DemoteSectors(int *sectors, int count)
+{
+    for (int i = 0, run; i < count; i += run) {
+	run = FileHeader::RunLength(sectors, i, count);
+	if (!FileHeader::IsUnwritten(sectors[i]))
+	    kernel->bufferCache->Demote(sectors[i], run);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Advise
+// 	Take the program's word for how it will use "numBytes" bytes of
+//	the file from "position" on (UNIX posix_fadvise):
+//
+//	   AdviseNormal, AdviseSequential, AdviseRandom -- how this
+//		OpenFile will be read from now on, whatever the range:
+//		guessed from the reads, as a scan, or at random (see
+//		UpdateReadAhead).  A scan also gives up what it has read
+//		(see ReadAt).
+//	   AdviseWillNeed -- the range will be read soon: start reading
+//		it into the buffer cache now.
+//	   AdviseDontNeed -- it will not be read again soon: make its
+//		sectors the next ones the cache replaces, after sending on
+//		what is held back for them in the write buffer.
+//
+//	A range past the end of the file is cut at the end.  An inline or
+//	compressed file takes the advice but has no use for the range.
+//	Return FALSE if the range or the advice is not valid.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::Advise(FileAdvice how, int position, int numBytes)
+{
+    MountScope scope(mount);
+    int fileLength = hdr->FileLength();
+    int first, last, *sectors;
+
+    if (position < 0 || numBytes < 0 || how < AdviseNormal || how > AdviseDontNeed)
+	return FALSE;
+    if (how == AdviseNormal || how == AdviseSequential || how == AdviseRandom) {
+	advice = how;
+	readAheadWindow = 0;			// start over
+	readAheadEnd = 0;
+	return TRUE;
+    }
+    numBytes = min(numBytes, fileLength - position);
+    if (numBytes <= 0 || hdr->IsInline() || clusterBuffer != NULL)
+	return TRUE;
+    first = divRoundDown(position, SectorSize);
+    last = divRoundUp(position + numBytes, SectorSize);
+    DEBUG(dbgFile, "Advised about file sectors " << first << " to " << last - 1);
+    if (how == AdviseWillNeed) {
+	PrefetchSectors(first, last - first);
+	return TRUE;
+    }
+    writeBuffer->FlushRange(position, numBytes);
+    sectors = new int[last - first];
+    hdr->ByteRangeToSectors(first * SectorSize, (last - first) * SectorSize,
+			    sectors);
+    DemoteSectors(sectors, last - first);
+    delete [] sectors;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::MarkMetadata
+// 	Tell the buffer cache that the file holds file system metadata --
+//	it is a directory, or the free map -- so that the sectors of it
+//	that are cached are kept ahead of file data (see
+//	BufferCache::MarkMetadata).  Nothing is done if the cache does
+//	not favor metadata.  What the write buffer still holds is not
+//	cached yet; it is marked when the file is next read or written.
+//----------------------------------------------------------------------
+
+void
+OpenFile::MarkMetadata()
+{
+    MountScope scope(mount);
+    int numSectors, *sectors;
+
+    if (!kernel->bufferCache->FavorsMetadata() || hdr->IsInline()
+	    || clusterBuffer != NULL)
+	return;
+    numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    if (numSectors == 0)
+	return;
+    sectors = new int[numSectors];
+    hdr->ByteRangeToSectors(0, hdr->FileLength(), sectors);
+    for (int i = 0, run; i < numSectors; i += run) {
+	run = FileHeader::RunLength(sectors, i, numSectors);
+	if (!FileHeader::IsUnwritten(sectors[i]))
+	    kernel->bufferCache->MarkMetadata(sectors[i], run);
+    }
+    delete [] sectors;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::LockRange
+// 	Lock the "numBytes" bytes of the file from "position" on, or let
+//	go of them (see rangelock.h).  The range may go past the end of
+//	the file; "numBytes" 0 means up to the end, however long the file
+//	grows.  The lock is this opening's: others wait for it, or fail
+//	to get theirs, until this one lets go or is closed.
+//
+//	"mode" is one of:
+//	   RangeUnlock -- let go of every lock of this opening on any
+//		part of the range, the whole of each.
+//	   RangeShared, RangeExclusive -- lock the range for reading,
+//		along with others, or for writing, alone; wait until no
+//		other opening has a lock in the way.
+//	   RangeTryShared, RangeTryExclusive -- the same, but return
+//		FALSE rather than wait.
+//
+//	Return FALSE too if the range or the mode is not valid.
+//----------------------------------------------------------------------
+
+bool
+OpenFile::LockRange(RangeLockMode mode, int position, int numBytes)
+{
+    int end;
+
+    if (position < 0 || numBytes < 0 || mode < RangeUnlock
+	|| mode > RangeTryExclusive)
+	return FALSE;
+    if (numBytes == 0 || numBytes > RangeLockEnd - position)
+	end = RangeLockEnd;
+    else
+	end = position + numBytes;
+    if (position >= end)
+	return FALSE;
+    switch (mode) {
+      case RangeUnlock:
+	rangeLocks->Release(this, position, end);
+	return TRUE;
+      case RangeShared:
+      case RangeExclusive:
+	rangeLocks->Acquire(this, position, end, mode == RangeExclusive);
+	return TRUE;
+      default:
+	return rangeLocks->TryAcquire(this, position, end,
+				      mode == RangeTryExclusive);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -193,4 +768,18 @@ OpenFile::Length()
     return hdr->FileLength(); 
 }
 
+//----------------------------------------------------------------------
+// OpenFile::WriteCount
+// 	Return how many times the file has been written or truncated
+//	since its header was read in, through this or any other opening
+//	of it.  The page cache goes by it (see frametable.h): a page read
+//	in before the count last moved may be stale.
+//----------------------------------------------------------------------
+
+unsigned int
+OpenFile::WriteCount()
+{
+    return hdr->Writes();
+}
+
 #endif //FILESYS_STUB
@@ -23,6 +23,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "sysdep.h"
+#include "slab.h"
 
 #ifdef FILESYS_STUB // Temporarily implement calls to
 					// Nachos file system as calls to UNIX!
@@ -60,6 +61,7 @@ public:
 		currentOffset += numWritten;
 		return numWritten;
 	}
+	void Seek(int position) { currentOffset = position; }
 
 	int Length()
 	{
@@ -79,6 +81,35 @@ private:
 
 #else // FILESYS
 class FileHeader;
+class WriteBuffer;
+class ClusterBuffer;
+class FileIoStats;
+class RangeLocks;
+class MountEntry;
+
+// The ways a program can say it will use an open file (UNIX
+// posix_fadvise; see OpenFile::Advise).  They have the values of the
+// Fadvise... constants of the system call (see syscall.h).
+
+enum FileAdvice {
+	AdviseNormal,	  // no advice: guess from the reads
+	AdviseSequential, // the file will be scanned
+	AdviseRandom,	  // read at random
+	AdviseWillNeed,	  // the range will be read soon
+	AdviseDontNeed	  // the range will not be read again soon
+};
+
+// The ways a range of an open file can be locked (see OpenFile::
+// LockRange and rangelock.h), with the values of the Lock...
+// constants of the system call (see syscall.h).
+
+enum RangeLockMode {
+	RangeUnlock,	   // let go of the locks on the range
+	RangeShared,	   // lock it for reading, waiting if need be
+	RangeExclusive,	   // or for writing
+	RangeTryShared,	   // the same, but fail rather than wait
+	RangeTryExclusive
+};
 
 class OpenFile
 {
@@ -106,9 +137,73 @@ public:
 				  // than the UNIX idiom -- lseek to
 				  // end of file, tell, lseek back
 
+	void Sync(); // Send on the writes held back in the
+				 // file's write buffer
+	void Fsync(); // Same, then make sure the file is on
+				  // disk -- UNIX fsync
+	bool Truncate(int newLength); // Set the length -- UNIX ftruncate
+	bool Allocate(int position, int numBytes); // Set aside the space
+									// for a range -- UNIX fallocate
+	bool Advise(FileAdvice how, int position, int numBytes);
+									// How the file will be used --
+									// UNIX posix_fadvise
+	bool LockRange(RangeLockMode mode, int position, int numBytes);
+									// Lock part of the file, or let
+									// go of it -- UNIX fcntl F_SETLKW
+	void MarkMetadata(); // Say the file is a directory or the
+						 // free map, for the buffer cache to
+						 // keep ahead of file data
+
+	int HeaderSector() { return hdrSector; } // To open the file again
+	MountEntry *Mount() { return mount; } // in the file system it is
+										  // in; NULL for the root
+	int Position() { return seekPosition; } // Where the next Read or
+											// Write starts
+	unsigned int WriteCount(); // How many times the file has been
+							   // written, by any opening of it
+
+	void *operator new(size_t size); // From the slab of open files
+	void operator delete(void *p, size_t size);
+
 private:
-	FileHeader *hdr;  // Header for this file
+	static thread_local Slab slab; // where OpenFiles come from
+	FileHeader *hdr;  // Header for this file, shared with every
+					  // other OpenFile on the same file
+	WriteBuffer *writeBuffer; // Writes not sent to the cache yet,
+							  // also shared
+	RangeLocks *rangeLocks; // The file's byte-range locks, also
+							// shared; this opening's go with it
+	ClusterBuffer *clusterBuffer; // For a compressed file, its
+							  // clusters in use, decompressed,
+							  // also shared; NULL otherwise
+	FileIoStats *ioStats; // The file's I/O counters, also shared
+	int hdrSector;	  // Where the header is on disk
+	MountEntry *mount; // The file system it was opened in, gone
+					   // back into to read and write it (see
+					   // mounttable.h); NULL for the root
 	int seekPosition; // Current position within the file
+
+	int nextReadPosition; // Where the next read starts if the file
+						  // is being read sequentially
+	int readAheadWindow;  // Sectors to keep prefetched past the
+						  // last read, 0 if access is random
+	int readAheadEnd;	  // File sectors below this one have been
+						  // prefetched already
+	FileAdvice advice;	  // How the program said it would read,
+						  // AdviseNormal if it did not
+
+	void UpdateReadAhead(int position, int numBytes);
+	// Note where a read was, and prefetch past it
+	// if the file is being read sequentially
+	void PrefetchSectors(int first, int count);
+	void DemoteSectors(int *sectors, int count);
+									// Send a hint about a range of
+									// sectors to the buffer cache
+	bool MakeWritable(int position, int numBytes);
+									// Give the bytes sectors of the
+									// file's own before a write
+	void ZeroGap(int from, int to); // Make bytes the file was
+									// extended over read as zeroes
 };
 
 #endif // FILESYS
@@ -8,6 +8,9 @@
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "disk.h"
+#include "debug.h"
+#include "superblock.h"
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -21,6 +24,11 @@
 
 PersistentBitmap::PersistentBitmap(int numItems):Bitmap(numItems) 
 { 
+    onDisk = NULL;			// first WriteBack writes it all
+    extents = NULL;
+    shareFile = NULL;
+    shares = sharesOnDisk = NULL;
+    numShared = 0;
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +48,12 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    onDisk = NULL;
+    extents = NULL;
+    shareFile = NULL;
+    shares = sharesOnDisk = NULL;
+    numShared = 0;
+    FetchFrom(file);
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +63,10 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems):Bitmap(numItems
 
 PersistentBitmap::~PersistentBitmap()
 { 
+    delete [] onDisk;
+    delete extents;
+    delete [] shares;
+    delete [] sharesOnDisk;
 }
 
 //----------------------------------------------------------------------
@@ -63,11 +80,54 @@ void
 PersistentBitmap::FetchFrom(OpenFile *file) 
 {
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    Recount();
+    MakeExtents();
+    if (onDisk == NULL)
+	onDisk = new unsigned int[numWords];
+    bcopy(map, onDisk, numWords * sizeof(unsigned));
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FetchFrom
+// 	Same, but take the number of clear bits, and a bit below which
+//	none are clear, from a summary of the bitmap made when it was
+//	last written back (see SuperBlock), instead of counting them.  The
+//	summary above the map is still made from the words.
+//
+//	"file" is the place to read the bitmap from
+//	"numFree" is the number of clear bits
+//	"firstFree" is a bit that no clear bit comes before
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::FetchFrom(OpenFile *file, int numFree, int firstFree)
+{
+    ASSERT(numFree >= 0 && numFree <= numBits);
+    ASSERT(firstFree >= 0 && firstFree <= numBits);
+    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    numClear = numFree;
+    firstClear = firstFree;
+    MakeSummary();
+    MakeExtents();
+    if (onDisk == NULL)
+	onDisk = new unsigned int[numWords];
+    bcopy(map, onDisk, numWords * sizeof(unsigned));
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
 // 	Store the contents of a persistent bitmap to a Nachos file.
+//	Only the sectors of the file that differ from what we last read
+//	or wrote are written.  They go straight on to the buffer cache,
+//	not held back in the file's write buffer, so that they are in the
+//	caller's transaction: after a crash, the free map must not say a
+//	sector is free that a header or an orphan table written in the
+//	same transaction uses.  The share map, if there is one, is
+//	written back the same way, to its own file.
+//
+//	The count of clear bits goes into the superblock summary with the
+//	map, so it is checked against the bits first: a popcount of the
+//	map is a few dozen words.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
@@ -75,5 +135,381 @@ PersistentBitmap::FetchFrom(OpenFile *file)
 void
 PersistentBitmap::WriteBack(OpenFile *file)
 {
-   file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int numBytes = numWords * sizeof(unsigned);
+    const char *now = (char *) map;
+
+    ASSERT(CountIsRight());
+    if (onDisk == NULL) {
+	onDisk = new unsigned int[numWords];
+	file->WriteAt((char *)map, numBytes, 0);
+    } else {
+	const char *then = (char *) onDisk;
+	for (int pos = 0; pos < numBytes; pos += SectorSize) {
+	    int len = min(SectorSize, numBytes - pos);
+	    if (memcmp(&now[pos], &then[pos], len) != 0)
+		file->WriteAt((char *)&now[pos], len, pos);
+	}
+    }
+#ifndef FILESYS_STUB
+    file->Sync();
+    file->MarkMetadata();
+#endif
+    bcopy(map, onDisk, numBytes);
+    if (shareFile == NULL) {
+	return;
+    }
+    if (sharesOnDisk == NULL) {
+	sharesOnDisk = new unsigned char[numBits];
+	shareFile->WriteAt((char *)shares, numBits, 0);
+    } else {
+	for (int pos = 0; pos < numBits; pos += SectorSize) {
+	    int len = min(SectorSize, numBits - pos);
+	    if (memcmp(&shares[pos], &sharesOnDisk[pos], len) != 0)
+		shareFile->WriteAt((char *)&shares[pos], len, pos);
+	}
+    }
+#ifndef FILESYS_STUB
+    shareFile->Sync();
+#endif
+    bcopy(shares, sharesOnDisk, numBits);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetClearOnDisk
+// 	Note that the file reads as all zeroes just now -- its sectors
+//	are on a disk that has been discarded -- so that the next
+//	WriteBack only writes its sectors with a bit set.  The rest of
+//	the map need never be written until a sector in it is used.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::SetClearOnDisk()
+{
+    if (onDisk == NULL)
+	onDisk = new unsigned int[numWords];
+    bzero(onDisk, numWords * sizeof(unsigned));
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::IsDirty
+// 	Return TRUE if the bitmap has changed since it was last read or
+//	written back.
+//----------------------------------------------------------------------
+
+bool
+PersistentBitmap::IsDirty() const
+{
+    return onDisk == NULL
+	|| memcmp(map, onDisk, numWords * sizeof(unsigned)) != 0
+	|| (shareFile != NULL && (sharesOnDisk == NULL
+				  || memcmp(shares, sharesOnDisk, numBits) != 0));
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FetchShares, PersistentBitmap::FormatShares
+// 	Read in the share map from "file", or start a new one, with no
+//	sector shared, to go in "file"; either way, it is written back
+//	to "file" along with the bitmap from now on.
+//
+//	"file" is the share map file, with a byte per bit of the bitmap
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::FetchShares(OpenFile *file)
+{
+    FormatShares(file);
+    file->ReadAt((char *)shares, numBits, 0);
+    for (int i = 0; i < numBits; i++) {
+	if (shares[i] > 0) {
+	    numShared++;
+	}
+    }
+    sharesOnDisk = new unsigned char[numBits];
+    bcopy(shares, sharesOnDisk, numBits);
+}
+
+void
+PersistentBitmap::FormatShares(OpenFile *file)
+{
+    ASSERT(shares == NULL);
+    shareFile = file;
+    shares = new unsigned char[numBits];
+    bzero(shares, numBits);
+    numShared = 0;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Share
+// 	Record that one more file uses sector "which", which is in use
+//	already.  Return FALSE, changing nothing, if MaxShares files
+//	besides the first use it already.  There must be a share map.
+//----------------------------------------------------------------------
+
+bool
+PersistentBitmap::Share(int which)
+{
+    ASSERT(shares != NULL && Test(which));
+    if (shares[which] == MaxShares) {
+	return FALSE;
+    }
+    if (shares[which]++ == 0) {
+	numShared++;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetSharers
+// 	Record that "count" files besides the first use sector "which",
+//	whatever the map said before; for repairing it (see
+//	FileSystem::Check).  There must be a share map unless "count" is
+//	0.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::SetSharers(int which, int count)
+{
+    ASSERT(count >= 0 && count <= MaxShares);
+    if (shares == NULL) {
+	ASSERT(count == 0);
+	return;
+    }
+    if (shares[which] == 0 && count > 0) {
+	numShared++;
+    } else if (shares[which] > 0 && count == 0) {
+	numShared--;
+    }
+    shares[which] = count;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::PlaceNear
+// 	Make the next sectors allocated come from the allocation group
+//	of "sector", from its first free sector on, if it has "wanted"
+//	free sectors; otherwise from the nearest group that does (the
+//	one after, of two as near), so what goes together stays a short
+//	seek apart.  If none does, from the group with the most.  Either
+//	way, when the group runs out, they come from the groups after it.
+//
+//	"sector" is the sector the allocation should go near
+//	"wanted" is how many sectors are about to be allocated
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::PlaceNear(int sector, int wanted)
+{
+    int group = sector / SectorsPerGroup;
+    int best = group, bestFree = -1;
+
+    for (int distance = 0; distance < NumAllocGroups; distance++) {
+	int after = group + distance, before = group - distance;
+
+	if (after < NumAllocGroups && GroupFree(after) >= wanted) {
+	    SetGoal(after * SectorsPerGroup);
+	    return;
+	}
+	if (before >= 0 && GroupFree(before) >= wanted) {
+	    SetGoal(before * SectorsPerGroup);
+	    return;
+	}
+    }
+    for (int i = 0; i < NumAllocGroups; i++) {
+	if (GroupFree(i) > bestFree) {
+	    best = i;
+	    bestFree = GroupFree(i);
+	}
+    }
+    SetGoal(best * SectorsPerGroup);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::GroupFree
+// 	Return the number of free sectors in allocation group "group".
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::GroupFree(int group)
+{
+    return NumClearIn(group * SectorsPerGroup,
+			min((group + 1) * SectorsPerGroup, numBits));
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::IndexExtents
+// 	Index the free extents of the bitmap, from what it holds now, and
+//	keep the index up to date as sectors are allocated and freed.
+//	Searches for runs of free sectors then use it instead of the map.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::IndexExtents()
+{
+    if (extents == NULL) {
+	extents = new ExtentTree;
+	MakeExtents();
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::MakeExtents
+// 	If the free extents are indexed, index them again from the
+//	contents of "map", after it has been filled in directly.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::MakeExtents()
+{
+    int start, end;
+
+    if (extents == NULL) {
+	return;
+    }
+    delete extents;
+    extents = new ExtentTree;
+    for (start = NextClear(0); start < numBits; start = NextClear(end)) {
+	end = NextSet(start);
+	extents->Insert(start, end - start);
+    }
+    DEBUG(dbgFile, "Indexed " << extents->NumExtents() << " free extents.");
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::TakeExtent
+// 	Take the free sectors from "from" on, "length" of them, out of the
+//	free extent they are in, leaving what is left of it on either side.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::TakeExtent(int from, int length)
+{
+    int start, len;
+    bool found = extents->Floor(from, &start, &len);
+
+    ASSERT(found && from + length <= start + len);
+    extents->Remove(start);
+    if (from > start) {
+	extents->Insert(start, from - start);
+    }
+    if (from + length < start + len) {
+	extents->Insert(from + length, start + len - from - length);
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark, PersistentBitmap::Clear
+// 	Set or clear a bit, as Bitmap does; if the free extents are
+//	indexed, split the one the bit was in, or join the bit to the
+//	extents on either side of it.  Clearing the bit of a shared
+//	sector only means one file fewer uses it: the bit stays set.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Mark(int which)
+{
+    if (extents != NULL && !Test(which)) {
+	TakeExtent(which, 1);
+    }
+    Bitmap::Mark(which);
+}
+
+void
+PersistentBitmap::Clear(int which)
+{
+    if (IsShared(which)) {
+	if (--shares[which] == 0) {
+	    numShared--;
+	}
+	return;
+    }
+    if (extents != NULL && Test(which)) {
+	int from = which, to = which + 1;
+	int start, len;
+
+	if (which > 0 && extents->Floor(which - 1, &start, &len)
+	    && start + len == which) {
+	    extents->Remove(start);
+	    from = start;
+	}
+	if (which + 1 < numBits && extents->Floor(which + 1, &start, &len)
+	    && start == which + 1) {
+	    extents->Remove(start);
+	    to = start + len;
+	}
+	extents->Insert(from, to - from);
+    }
+    Bitmap::Clear(which);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::MarkRange
+// 	Set the bits of a run of free sectors, found by FindRun, taking
+//	the run out of its extent at once rather than a bit at a time.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::MarkRange(int from, int length)
+{
+    if (extents != NULL) {
+	TakeExtent(from, length);
+    }
+    Bitmap::MarkRange(from, length);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindRunIn
+// 	Same as Bitmap::FindRunIn, looking for a run starting from bit
+//	"from" up to, but not including, bit "to", but from the index of
+//	free extents, if there is one.  The first run is the rest of the
+//	extent "from" is in, as it is for the bitmap; after it come the
+//	extents that start in the range.
+//----------------------------------------------------------------------
+
+int
+PersistentBitmap::FindRunIn(int from, int to, int wanted, int *length) const
+{
+    int bestStart = -1, bestLength = 0;
+    int start, len;
+
+    if (extents == NULL) {
+	return Bitmap::FindRunIn(from, to, wanted, length);
+    }
+    if (from < to && extents->Floor(from, &start, &len)
+	&& start + len > from) {
+	if (start + len - from >= wanted) {
+	    *length = wanted;
+	    return from;
+	}
+	bestStart = from;
+	bestLength = start + len - from;
+    }
+    if (extents->FirstFit(from + 1, wanted, &start, &len) && start < to) {
+	*length = wanted;
+	return start;
+    }
+    if (extents->Longest(from + 1, to, &start, &len) && len > bestLength) {
+	bestStart = start;
+	bestLength = len;
+    }
+    *length = bestLength;
+    return bestStart;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Print
+// 	Print the bitmap and, if they are indexed, how many free extents
+//	there are and the longest of them; and how many sectors are
+//	shared, if any are.
+//----------------------------------------------------------------------
+
+void
+PersistentBitmap::Print() const
+{
+    Bitmap::Print();
+    if (extents != NULL) {
+	printf("%d free extents, the longest %d sectors\n",
+	       extents->NumExtents(), extents->LongestLength());
+    }
+    if (numShared > 0) {
+	printf("%d sectors shared\n", numShared);
+    }
 }
@@ -6,6 +6,34 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    As the bitmap of free sectors, it also places what is allocated
+//    next: in the allocation group (see superblock.h) of a sector it
+//    should go near, or if that group is short of room, in the nearest
+//    group that is not.  Since groups are whole tracks, what
+//    is in one group can be read without long seeks.
+//
+//    The bitmap remembers what the file held when it was last read or
+//    written, so WriteBack only writes the sectors of the file whose
+//    bits have changed since.  This lets the file system keep one
+//    bitmap in memory and write it back after every operation cheaply.
+//
+//    The free sectors can also be indexed by extent (see extenttree.h),
+//    so that a run of free sectors is found without scanning the map
+//    for it: in time O(log n) in the number of free extents, however
+//    fragmented the disk.  The bitmap stays what is on disk; the index
+//    is only kept in memory, and made again from the bitmap whenever it
+//    is fetched.
+//
+//    A sector can also be shared by several files (see
+//    FileSystem::Clone and FileSystem::Deduplicate).  The bitmap then
+//    keeps a count, for every sector, of how many files use it besides
+//    the first, and Clear only takes one off the count of a shared
+//    sector: the sector is only free once the last file using it gives
+//    it back.  So every way a file gives back its sectors works for a
+//    shared one too.  The counts go in a file of their own, the share
+//    map, which is only made once a sector is first shared, and is
+//    written back along with the bitmap, in the same way.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -16,6 +44,10 @@
 #include "copyright.h"
 #include "bitmap.h"
 #include "openfile.h"
+#include "extenttree.h"
+
+const int MaxShares = 255;		// most files besides the first that
+					// one sector can be shared by
 
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
@@ -29,7 +61,65 @@ class PersistentBitmap : public Bitmap {
     ~PersistentBitmap(); 			// deallocate bitmap
 
     void FetchFrom(OpenFile *file);     // read bitmap from the disk
-    void WriteBack(OpenFile *file); 	// write bitmap contents to disk 
+    void FetchFrom(OpenFile *file, int numFree, int firstFree);
+					// same, trusting a summary of it
+    void WriteBack(OpenFile *file); 	// write changed parts of the
+					// bitmap to disk
+    bool IsDirty() const;		// anything not yet written back?
+    void SetClearOnDisk();		// the file reads as all zeroes
+
+    void IndexExtents();		// keep an index of the free extents
+					// from now on
+    void Mark(int which);		// Bitmap operations, keeping the
+    void Clear(int which);		// index up to date
+    void Print() const;			// the bitmap, and the free extents
+
+    void FetchShares(OpenFile *file);	// read the share map, and write it
+					// back with the bitmap from now on
+    void FormatShares(OpenFile *file);	// same, for a new share map, with
+					// no sector shared
+    bool Share(int which);		// one more file uses this sector
+					// (whose bit is set); FALSE if
+					// MaxShares already do
+    bool IsShared(int which) const	// more than one file uses it?
+		{ return shares != NULL && shares[which] > 0; }
+    bool CanShare(int which) const	// may one more?
+		{ return shares != NULL && shares[which] < MaxShares; }
+    int Sharers(int which) const	// how many files besides the
+		{ return (shares == NULL) ? 0 : shares[which]; }
+					// first use it
+    void SetSharers(int which, int count);
+					// set that, when checking the disk
+    int NumShared() const { return numShared; }
+					// how many sectors are shared
+
+    void PlaceNear(int sector, int wanted);
+					// allocate from the group of
+					// "sector" next, if it has room,
+					// else from the nearest that has
+
+  private:
+    int GroupFree(int group);		// free sectors in a group
+    int FindRunIn(int from, int to, int wanted, int *length) const;
+    void MarkRange(int from, int length);
+    void MakeExtents();			// index the free extents in "map"
+    void TakeExtent(int from, int length);
+					// take a run out of the free extent
+					// it is in
+
+    unsigned int *onDisk;		// contents of the file, as last
+					// read or written; NULL if unknown
+    ExtentTree *extents;		// the free extents; NULL if they
+					// are not indexed
+    OpenFile *shareFile;		// the share map; NULL if there is
+					// none
+    unsigned char *shares;		// how many files besides the first
+					// use each sector; NULL if none
+    unsigned char *sharesOnDisk;	// what the share map held, as
+					// last read or written; NULL if
+					// unknown
+    int numShared;			// how many entries of "shares" are
+					// not 0
 };
 
 #endif // PBITMAP_H
@@ -0,0 +1,205 @@
+// pipebuf.cc
+//	Routines to pass bytes through a pipe.  See pipebuf.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "pipebuf.h"
+#include "synch.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// PipeBuffer::PipeBuffer
+// 	Initialize an empty pipe.  The caller is about to give each end
+//	a descriptor.
+//----------------------------------------------------------------------
+
+PipeBuffer::PipeBuffer()
+{
+    lock = new Lock("pipe lock");
+    dataReady = new Condition("pipe data ready");
+    spaceReady = new Condition("pipe space ready");
+    buffer = new char[PipeSize];
+    head = count = 0;
+    numReaders = numWriters = 1;
+    handoff = NULL;
+    handoffSize = handoffDone = 0;
+}
+
+PipeBuffer::~PipeBuffer()
+{
+    ASSERT(numReaders == 0 && numWriters == 0);
+    delete [] buffer;
+    delete spaceReady;
+    delete dataReady;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Read
+// 	Take up to "numBytes" bytes out of the pipe, waiting until there
+//	are some.  Return how many were taken, 0 if the pipe is empty and
+//	its write end is closed.
+//
+//	If the ring buffer is empty, "into" is left for the next writer
+//	to fill, unless another reader got there first, in which case we
+//	wait our turn.
+//
+//	"into" -- where the bytes go; it must stay put while we wait
+//	"numBytes" -- how many are wanted
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Read(char *into, int numBytes)
+{
+    int done;
+
+    if (numBytes <= 0)
+	return 0;
+    lock->Acquire();
+    while (count == 0 && numWriters > 0 && handoff != NULL)
+	dataReady->Wait(lock);		// another reader is waiting
+    if (count == 0 && numWriters > 0) {
+	handoff = into;
+	handoffSize = numBytes;
+	handoffDone = 0;
+	while (handoffDone == 0 && numWriters > 0)
+	    dataReady->Wait(lock);
+	done = handoffDone;
+	handoff = NULL;
+	dataReady->Broadcast(lock);	// for the readers behind us
+	DEBUG(dbgFile, "Pipe handed over " << done << " bytes");
+    } else {
+	done = Take(into, numBytes);
+	spaceReady->Broadcast(lock);
+    }
+    lock->Release();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Write
+// 	Put "numBytes" bytes into the pipe, waiting for room as needed.
+//	Return how many went in: all of them, unless the read end is
+//	closed first.
+//
+//	A reader waiting with its buffer empty is given the bytes
+//	straight away; the rest go in the ring buffer behind them.
+//
+//	"from" -- the bytes to write
+//	"numBytes" -- how many
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Write(char *from, int numBytes)
+{
+    int done = 0;
+
+    lock->Acquire();
+    while (done < numBytes && numReaders > 0) {
+	if (handoff != NULL && handoffDone == 0) {
+	    int n = min(numBytes - done, handoffSize);
+
+	    bcopy(&from[done], handoff, n);
+	    handoffDone = n;
+	    done += n;
+	    dataReady->Broadcast(lock);
+	} else if (count < PipeSize) {
+	    done += Put(&from[done], numBytes - done);
+	    dataReady->Broadcast(lock);
+	} else {
+	    spaceReady->Wait(lock);
+	}
+    }
+    lock->Release();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Open
+// 	Note that one more descriptor stands for one of the ends.
+//
+//	"writing" -- TRUE for the write end, FALSE for the read end
+//----------------------------------------------------------------------
+
+void
+PipeBuffer::Open(bool writing)
+{
+    lock->Acquire();
+    if (writing)
+	numWriters++;
+    else
+	numReaders++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Close
+// 	Note that a descriptor for one of the ends is gone, and wake up
+//	whoever is waiting on the other end, in case it was the last one.
+//	Return TRUE if no descriptor is left for either end: the caller
+//	deletes the pipe.
+//
+//	"writing" -- TRUE for the write end, FALSE for the read end
+//----------------------------------------------------------------------
+
+bool
+PipeBuffer::Close(bool writing)
+{
+    bool last;
+
+    lock->Acquire();
+    if (writing) {
+	ASSERT(numWriters > 0);
+	numWriters--;
+	dataReady->Broadcast(lock);
+    } else {
+	ASSERT(numReaders > 0);
+	numReaders--;
+	spaceReady->Broadcast(lock);
+    }
+    last = (numReaders == 0 && numWriters == 0);
+    lock->Release();
+    return last;
+}
+
+//----------------------------------------------------------------------
+// PipeBuffer::Take / Put
+// 	Move up to "numBytes" bytes out of or into the ring buffer, in at
+//	most two pieces, as the ring wraps around.  Return how many were
+//	moved.
+//----------------------------------------------------------------------
+
+int
+PipeBuffer::Take(char *into, int numBytes)
+{
+    int done = 0;
+
+    while (done < numBytes && count > 0) {
+	int n = min(min(numBytes - done, count), PipeSize - head);
+
+	bcopy(&buffer[head], &into[done], n);
+	head = (head + n) % PipeSize;
+	count -= n;
+	done += n;
+    }
+    return done;
+}
+
+int
+PipeBuffer::Put(char *from, int numBytes)
+{
+    int done = 0;
+
+    while (done < numBytes && count < PipeSize) {
+	int tail = (head + count) % PipeSize;
+	int n = min(min(numBytes - done, PipeSize - count), PipeSize - tail);
+
+	bcopy(&from[done], &buffer[tail], n);
+	count += n;
+	done += n;
+    }
+    return done;
+}
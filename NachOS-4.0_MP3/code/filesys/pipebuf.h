@@ -0,0 +1,72 @@
+// pipebuf.h
+//	Data structures for a pipe: a stream of bytes from programs that
+//	write to one end to programs that read from the other (the Pipe
+//	system call).
+//
+//	The bytes wait in a ring buffer in the kernel.  A read blocks
+//	until there is something to read, and returns what there is, up
+//	to what was asked for; a write blocks until every byte has gone
+//	in.  Once no descriptor is left for the write end, a read of an
+//	empty pipe returns 0, as at the end of a file; once none is left
+//	for the read end, a write returns what it got in so far.
+//
+//	When a reader finds the pipe empty, it leaves where its bytes go
+//	-- the pinned frame the user's buffer is in (see SysTransfer) --
+//	for the next writer, which copies into it directly.  So a reader
+//	that keeps up gets its bytes copied once, from the writer's frame
+//	to its own, never going through the ring buffer at all.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef PIPEBUF_H
+#define PIPEBUF_H
+
+class Lock;
+class Condition;
+
+const int PipeSize = 4096;		// bytes a pipe holds
+
+// The following class defines a pipe.
+
+class PipeBuffer {
+  public:
+    PipeBuffer();			// Initialize an empty pipe, with
+					// one descriptor for each end
+    ~PipeBuffer();
+
+    int Read(char *into, int numBytes);	// Wait for bytes, and take up to
+					// "numBytes" of them; 0 at the end
+    int Write(char *from, int numBytes); // Put in "numBytes" bytes, waiting
+					// for room; fewer if no one is
+					// left to read them
+
+    void Open(bool writing);		// Another descriptor for one end
+    bool Close(bool writing);		// One less; TRUE if that was the
+					// last of both, for the caller to
+					// delete the pipe
+
+  private:
+    Lock *lock;				// protects everything below
+    Condition *dataReady;		// signalled when bytes go in,
+					// or the write end closes
+    Condition *spaceReady;		// signalled when bytes come out,
+					// or the read end closes
+    char *buffer;			// the ring buffer
+    int head;				// where the oldest byte is
+    int count;				// bytes in the ring buffer
+    int numReaders;			// descriptors for the read end
+    int numWriters;			// and for the write end
+
+    char *handoff;			// a waiting reader's buffer, or NULL
+    int handoffSize;			// its size
+    int handoffDone;			// bytes a writer put in it
+
+    int Take(char *into, int numBytes);	// Out of, and into, the ring
+    int Put(char *from, int numBytes);	// buffer; return bytes moved
+};
+
+#endif // PIPEBUF_H
@@ -0,0 +1,154 @@
+// rangelock.cc
+//	Routines for locking byte ranges of a file.  See rangelock.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "rangelock.h"
+#include "synch.h"
+#include "debug.h"
+
+// What a search for a lock in the way of a new one is told.
+
+class RangeRequest {
+  public:
+    void *owner;			// who wants the range
+    bool exclusive;			// and how
+};
+
+//----------------------------------------------------------------------
+// Conflicts
+// 	Is the lock "node" in the way of the request "arg"?  A lock of the
+//	same owner never is; otherwise it is if either is exclusive.
+//----------------------------------------------------------------------
+
+static bool
+Conflicts(IntervalNode *node, void *arg)
+{
+    RangeRequest *request = (RangeRequest *) arg;
+
+    return node->owner != request->owner && (node->tag || request->exclusive);
+}
+
+//----------------------------------------------------------------------
+// IsOwnedBy
+// 	Is the lock "node" one of "owner"'s?
+//----------------------------------------------------------------------
+
+static bool
+IsOwnedBy(IntervalNode *node, void *owner)
+{
+    return node->owner == owner;
+}
+
+//----------------------------------------------------------------------
+// RangeLocks::RangeLocks, RangeLocks::~RangeLocks
+// 	Set up a file with no range locked, and de-allocate one, whose
+//	locks have all been let go: the file is no longer open.
+//----------------------------------------------------------------------
+
+RangeLocks::RangeLocks()
+{
+    held = new IntervalTree;
+    lock = new Lock("range locks");
+    released = new Condition("range released");
+    numWaiting = 0;
+}
+
+RangeLocks::~RangeLocks()
+{
+    ASSERT(IsEmpty() && numWaiting == 0);
+    delete released;
+    delete lock;
+    delete held;
+}
+
+//----------------------------------------------------------------------
+// RangeLocks::InTheWay
+// 	Return TRUE if an owner other than "owner" holds a lock on part of
+//	[start, end) that conflicts with locking it, shared or
+//	"exclusive".  "lock" is held.
+//----------------------------------------------------------------------
+
+bool
+RangeLocks::InTheWay(void *owner, int start, int end, bool exclusive)
+{
+    RangeRequest request;
+
+    request.owner = owner;
+    request.exclusive = exclusive;
+    return held->FindOverlap(start, end, Conflicts, &request) != NULL;
+}
+
+//----------------------------------------------------------------------
+// RangeLocks::Acquire, RangeLocks::TryAcquire
+// 	Lock the bytes [start, end) for "owner", shared, or exclusive if
+//	"exclusive".  Acquire waits until nothing is in the way, checking
+//	again each time another owner lets go of a lock; TryAcquire
+//	returns FALSE, changing nothing, if something is.
+//----------------------------------------------------------------------
+
+void
+RangeLocks::Acquire(void *owner, int start, int end, bool exclusive)
+{
+    ASSERT(start < end);
+    lock->Acquire();
+    while (InTheWay(owner, start, end, exclusive)) {
+	DEBUG(dbgFile, "Waiting for bytes " << start << " to " << end);
+	numWaiting++;
+	released->Wait(lock);
+	numWaiting--;
+    }
+    held->Insert(start, end, owner, exclusive);
+    lock->Release();
+}
+
+bool
+RangeLocks::TryAcquire(void *owner, int start, int end, bool exclusive)
+{
+    bool free;
+
+    ASSERT(start < end);
+    lock->Acquire();
+    free = !InTheWay(owner, start, end, exclusive);
+    if (free)
+	held->Insert(start, end, owner, exclusive);
+    lock->Release();
+    return free;
+}
+
+//----------------------------------------------------------------------
+// RangeLocks::Release
+// 	Let go of every lock of "owner" that overlaps [start, end), the
+//	whole of each, and wake whoever is waiting to look again.
+//----------------------------------------------------------------------
+
+void
+RangeLocks::Release(void *owner, int start, int end)
+{
+    IntervalNode *node;
+    bool any = FALSE;
+
+    lock->Acquire();
+    while ((node = held->FindOverlap(start, end, IsOwnedBy, owner)) != NULL) {
+	held->Remove(node);
+	any = TRUE;
+    }
+    if (any && numWaiting > 0)
+	released->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RangeLocks::ReleaseAll
+// 	Let go of every lock of "owner": the opening of the file it
+//	stands for is being closed.
+//----------------------------------------------------------------------
+
+void
+RangeLocks::ReleaseAll(void *owner)
+{
+    Release(owner, 0, RangeLockEnd);
+}
@@ -0,0 +1,76 @@
+// rangelock.h
+//	Data structures for locking byte ranges of a file (LockRange).
+//
+//	Programs writing different parts of one shared file, such as the
+//	records of an output file, need to keep each other out of the
+//	parts they are working on, but not out of the whole file.  A
+//	range lock covers the bytes [start, end) of a file, and is either
+//	shared, for readers, or exclusive, for a writer: a range can be
+//	locked shared by any number of openings of the file at once, but
+//	exclusive by only one, and then by no other, shared or exclusive.
+//	Locks on ranges that do not overlap never get in each other's
+//	way, so writers of disjoint ranges go ahead together.
+//
+//	The locks of a file are kept with its header in the inode table
+//	(see InodeTable::RangeLocksOf), in an interval tree (see
+//	intervaltree.h), which finds a lock in the way of a new one in
+//	time proportional to the log of how many there are.  They belong
+//	to an opening of the file (an OpenFile): an opening never gets in
+//	its own way, and closing it lets go of every lock it holds, as
+//	with BSD's flock.
+//
+//	The locks are advisory: Read and Write do not look at them; they
+//	are for programs that agree to take them.  A thread waiting for a
+//	range waits as long as it takes: nothing finds deadlocks.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef RANGELOCK_H
+#define RANGELOCK_H
+
+#include "intervaltree.h"
+
+class Lock;
+class Condition;
+
+const int RangeLockEnd = 0x7fffffff;	// past the end of any file: a
+					// lock to here covers whatever
+					// the file grows to
+
+// The following class defines the range locks of one file.
+
+class RangeLocks {
+  public:
+    RangeLocks();			// No range locked
+    ~RangeLocks();			// Every lock must have been let go
+
+    void Acquire(void *owner, int start, int end, bool exclusive);
+					// Lock [start, end) for "owner",
+					// waiting until no other owner
+					// has a lock in the way
+    bool TryAcquire(void *owner, int start, int end, bool exclusive);
+					// The same, but return FALSE at
+					// once rather than wait
+    void Release(void *owner, int start, int end);
+					// Let go of the locks of "owner"
+					// that overlap [start, end)
+    void ReleaseAll(void *owner);	// and all of them (on close)
+    bool IsEmpty() { return held->NumIntervals() == 0; }
+
+  private:
+    IntervalTree *held;			// the locks; an owner, and TRUE
+					// for an exclusive lock
+    Lock *lock;				// protects "held"
+    Condition *released;		// broadcast when locks go
+    int numWaiting;			// threads waiting on it
+
+    bool InTheWay(void *owner, int start, int end, bool exclusive);
+					// Does another owner hold a lock
+					// that conflicts?
+};
+
+#endif // RANGELOCK_H
@@ -0,0 +1,142 @@
+// sectorsum.cc
+//	Routines to keep, and check, the checksum of every sector on
+//	disk.  See sectorsum.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "sectorsum.h"
+#include "crc32c.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// SectorSums::SectorSums
+// 	Start with no checksum known, for any sector.
+//----------------------------------------------------------------------
+
+SectorSums::SectorSums()
+{
+    sums = new unsigned int[NumSectors];
+    excluded = new bool[NumSectors];
+    for (int i = 0; i < NumSectors; i++) {
+	sums[i] = 0;
+	excluded[i] = FALSE;
+    }
+}
+
+SectorSums::~SectorSums()
+{
+    delete [] sums;
+    delete [] excluded;
+}
+
+//----------------------------------------------------------------------
+// SectorSums::FetchFrom, SectorSums::WriteBack
+// 	Read the checksums from the share map file, or write them to it
+//	(which makes it long enough to hold them, the first time).
+//
+//	"file" is the share map file
+//----------------------------------------------------------------------
+
+void
+SectorSums::FetchFrom(OpenFile *file)
+{
+    file->ReadAt((char *) sums, SumMapSize, SumMapOffset);
+    for (int i = 0; i < NumSectors; i++) {
+	if (excluded[i])
+	    sums[i] = 0;
+    }
+}
+
+void
+SectorSums::WriteBack(OpenFile *file)
+{
+    file->WriteAt((char *) sums, SumMapSize, SumMapOffset);
+#ifndef FILESYS_STUB
+    file->Sync();
+#endif
+}
+
+//----------------------------------------------------------------------
+// SectorSums::Exclude
+// 	Never check "sector"; whatever is known of it is forgotten.  For
+//	a sector written to disk behind the back of the checksums.
+//----------------------------------------------------------------------
+
+void
+SectorSums::Exclude(int sector)
+{
+    ASSERT(sector >= 0 && sector < NumSectors);
+    excluded[sector] = TRUE;
+    sums[sector] = 0;
+}
+
+//----------------------------------------------------------------------
+// SectorSums::Sum
+// 	Return the checksum of a sector's contents, never 0 (see
+//	sectorsum.h).
+//----------------------------------------------------------------------
+
+unsigned int
+SectorSums::Sum(char *data)
+{
+    unsigned int sum = Crc32c::Compute(data, SectorSize);
+
+    return (sum == 0) ? 1 : sum;
+}
+
+//----------------------------------------------------------------------
+// SectorSums::Record
+// 	Note the checksums of a run of sectors being written to disk.
+//
+//	"firstSector" -- the first disk sector of the run
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- their contents, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+SectorSums::Record(int firstSector, int numSectors, char *data)
+{
+    ASSERT(firstSector >= 0 && firstSector + numSectors <= NumSectors);
+    for (int i = 0; i < numSectors; i++) {
+	if (!excluded[firstSector + i])
+	    sums[firstSector + i] = Sum(&data[i * SectorSize]);
+    }
+}
+
+//----------------------------------------------------------------------
+// SectorSums::Verify
+// 	Check a run of sectors just read from disk against their
+//	checksums, and report each one that does not match.  Return
+//	FALSE if any does not.  May be called from the disk interrupt
+//	handler, for a prefetch.
+//
+//	"firstSector" -- the first disk sector of the run
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- what was read, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+bool
+SectorSums::Verify(int firstSector, int numSectors, char *data)
+{
+    bool allMatch = TRUE;
+
+    ASSERT(firstSector >= 0 && firstSector + numSectors <= NumSectors);
+    for (int i = 0; i < numSectors; i++) {
+	int sector = firstSector + i;
+
+	if (sums[sector] == 0)
+	    continue;			// not known, or not checked
+	kernel->stats->numSectorsChecked++;
+	if (Sum(&data[i * SectorSize]) != sums[sector]) {
+	    printf("Checksum: sector %d does not read back what was "
+		   "written to it\n", sector);
+	    kernel->stats->numChecksumErrors++;
+	    allMatch = FALSE;
+	}
+    }
+    return allMatch;
+}
@@ -0,0 +1,76 @@
+// sectorsum.h
+//	Data structures for keeping a checksum of every sector on disk,
+//	to catch a sector that does not read back what was written to it
+//	(-crc).
+//
+//	The checksum of a sector (a CRC-32C, see lib/crc32c.h) is taken
+//	each time the buffer cache, or the journal when it checkpoints,
+//	writes it to disk, and checked each time the cache reads it in
+//	from disk: on a miss, on a read of a run, and when a prefetch
+//	arrives.  So every read of the file system that goes to the disk
+//	is checked, data and headers alike, and one that is served from
+//	memory costs nothing.  A sector that does not match is reported,
+//	and counted, but its contents are still used: what to do about
+//	it is up to whoever reads the report.
+//
+//	A checksum of 0 means none is known for the sector: it has not
+//	been written since the checksums were started.  It is not
+//	checked.  A sector whose checksum does come out as 0 gets 1
+//	instead, so it loses one value in 2^32 of its check.
+//
+//	The checksums are kept on disk after the share counts, in the
+//	share map file (see PersistentBitmap::Share), which is made when
+//	checksums are first wanted if there is none yet; the file's
+//	length says whether it has them.  They are written back only
+//	when the file system is unmounted, and only used on the next
+//	mount if it was unmounted cleanly: otherwise some sectors may
+//	have been written since, and the checksums are started afresh.
+//	The sectors of the checksums themselves, and the superblock --
+//	written after them, when the file system is unmounted -- are not
+//	checked.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SECTORSUM_H
+#define SECTORSUM_H
+
+#include "disk.h"
+#include "openfile.h"
+
+// Where the checksums start in the share map file, and how much of it
+// they take: one per sector, after a byte of share count per sector.
+const int SumMapOffset = NumSectors;
+const int SumMapSize = NumSectors * sizeof(unsigned int);
+
+// The following class defines the checksums of the sectors on disk.
+
+class SectorSums {
+  public:
+    SectorSums();			// None known yet
+    ~SectorSums();
+
+    void FetchFrom(OpenFile *file);	// Read them from the share map
+    void WriteBack(OpenFile *file);	// Write them to it
+    void Exclude(int sector);		// Never check "sector"
+
+    void Record(int firstSector, int numSectors, char *data);
+					// A run of sectors is being written
+					// to disk with these contents
+    bool Verify(int firstSector, int numSectors, char *data);
+					// A run was read with these; FALSE
+					// if a sector does not match
+
+  private:
+    unsigned int *sums;			// the checksum of each sector; 0
+					// if it is not known
+    bool *excluded;			// never checked?
+
+    static unsigned int Sum(char *data);
+					// the checksum of one sector
+};
+
+#endif // SECTORSUM_H
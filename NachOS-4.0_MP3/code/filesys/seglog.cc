@@ -0,0 +1,768 @@
+// seglog.cc
+//	Routines for laying out the disk as a log.  See seglog.h.
+//
+//	Everything is done with the log's lock held, across the log's
+//	own transfers, so that nothing moves while it is being read or
+//	written.  The only exception is a read started by Request: the
+//	lock is let go once it is queued, and instead a checkpoint, which
+//	is what lets a segment be reused, waits for every such read to
+//	be done first.
+//
+//	A new segment is always the free one with the lowest number, and
+//	segments are only freed at a checkpoint, so after one, the
+//	segments the log goes on to are the ones it left free, in order;
+//	that is how rolling forward finds them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "seglog.h"
+#include "synchdisk.h"
+#include "main.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// LogReadParts
+// 	Completion callback for the transfers a read started by
+//	SegmentLog::Request is split into, one for each run of sectors
+//	that are next to each other on the disk.  The last to be done
+//	finishes the request, and deletes it, and itself; it holds one
+//	count more, given up once all of them are queued.
+//----------------------------------------------------------------------
+
+class LogReadParts : public CallBackObj {
+  public:
+    LogReadParts(SegmentLog *l, DiskRequest *r)
+	{ log = l; request = r; remaining = 1; }
+    void Add() { remaining++; }
+    void CallBack();
+
+  private:
+    SegmentLog *log;
+    DiskRequest *request;		// the read asked for
+    int remaining;			// transfers not done, and the hold
+};
+
+void
+LogReadParts::CallBack()
+{
+    if (--remaining > 0)
+	return;
+    request->callWhenDone->CallBack();
+    delete request;
+    log->ReadDone();
+    delete this;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::SegmentLog
+// 	Set up a log with nothing in it, and start the cleaner thread;
+//	Format or Mount says what is really on the disk.
+//
+//	"d" -- the disk; the log does its own transfers through it
+//----------------------------------------------------------------------
+
+SegmentLog::SegmentLog(SynchDisk *d)
+{
+    disk = d;
+    map = new int[NumSectors];
+    owner = new int[NumSectors];
+    for (int i = 0; i < NumSectors; i++)
+	map[i] = owner[i] = -1;
+    live = new int[NumSegments];
+    sequence = new int[NumSegments];
+    full = new bool[NumSegments];
+    for (int i = 0; i < NumSegments; i++) {
+	live[i] = sequence[i] = 0;
+	full[i] = FALSE;
+    }
+    numFree = NumSegments - 1;
+    tail = tailBlock = 0;
+    tailData = new char[SegmentSectors * SectorSize];
+    bzero(tailData, SegmentSectors * SectorSize);
+    summary = (SegmentSummary *) &tailData[SegmentBlocks * SectorSize];
+    tailWritten = 0;
+    summaryDirty = FALSE;
+    nextSequence = 1;
+    serial = 0;
+    sinceCheckpoint = 0;
+    dirty = cleaning = closed = FALSE;
+
+    lock = new Lock("segment log");
+    work = new Semaphore("log cleaner work", 0);
+    woken = FALSE;
+    numReading = 0;
+    readsDone = new Semaphore("log reads done", 0);
+    waitingForReads = FALSE;
+    numWritten = numMoved = numFilled = numCleaned = numCheckpoints = 0;
+
+    Thread *t = new Thread("log cleaner", 1);
+    t->ioClass = IoIdle;
+    t->Fork(SegmentLog::CleanerThread, this);
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::~SegmentLog
+// 	De-allocate the log; it should have been closed.  The cleaner
+//	thread is left waiting; it is never run again.
+//----------------------------------------------------------------------
+
+SegmentLog::~SegmentLog()
+{
+    ASSERT(closed);
+    delete readsDone;
+    delete work;
+    delete lock;
+    delete [] tailData;
+    delete [] full;
+    delete [] sequence;
+    delete [] live;
+    delete [] owner;
+    delete [] map;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::IsOnDisk
+// 	Return TRUE if either checkpoint area has a checkpoint in it.
+//	Without a log, the first one is where the free map's file
+//	header is.  The disk must not have a log attached yet.
+//----------------------------------------------------------------------
+
+bool
+SegmentLog::IsOnDisk(SynchDisk *d)
+{
+    char buffer[SectorSize];
+    CheckpointHeader *header = (CheckpointHeader *) buffer;
+
+    for (int i = 0; i < 2; i++) {
+	d->ReadSector(1 + i * CheckpointSectors, buffer);
+	if (header->magic == LogMagic && header->numSegments == NumSegments)
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Format
+// 	Start the log at the first segment, with nothing written, and
+//	checkpoint that.  The disk has just been discarded.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Format()
+{
+    lock->Acquire();
+    tail = tailBlock = 0;
+    sequence[tail] = nextSequence++;
+    summary->sequence = sequence[tail];
+    for (int i = 0; i < SegmentBlocks; i++)
+	summary->logical[i] = -1;
+    Checkpoint();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Mount
+// 	Read in the later of the two checkpoints, and go on from there.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Mount()
+{
+    char *buffer = new char[CheckpointSectors * SectorSize];
+    CheckpointHeader *header = (CheckpointHeader *) buffer;
+    int *body = (int *) &buffer[SectorSize];
+    int latest = -1;
+
+    lock->Acquire();
+    for (int i = 0; i < 2; i++) {
+	disk->Transfer(1 + i * CheckpointSectors, 1, buffer, FALSE);
+	if (header->magic == LogMagic && header->numSegments == NumSegments
+		&& header->serial > serial) {
+	    latest = i;
+	    serial = header->serial;
+	}
+    }
+    ASSERT(latest >= 0);
+    disk->Transfer(1 + latest * CheckpointSectors, CheckpointSectors,
+		   buffer, FALSE);
+    nextSequence = header->nextSequence;
+    tail = header->tail;
+    tailBlock = tailWritten = header->tailBlock;
+    bcopy(body, map, NumSectors * sizeof(int));
+    bcopy(&body[NumSectors], sequence, NumSegments * sizeof(int));
+    delete [] buffer;
+    DEBUG(dbgDisk, "Log checkpoint " << serial << ": segment " << tail
+			<< ", " << tailBlock << " sectors in");
+
+    RollForward();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::RollForward
+// 	Put in the map what was written after the checkpoint: the rest
+//	of the tail, as far as its summary says, then, if it is full,
+//	each segment that was free at the checkpoint, in order, as long
+//	as it was started next.
+//
+//	Until the next checkpoint, mounting the disk again would roll
+//	forward from the same one, through the same segments; so one is
+//	taken before the log starts a segment of its own.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::RollForward()
+{
+    int end, expected = nextSequence;
+    bool rolled = FALSE;
+
+    Rebuild();
+    end = ApplySummary(tail, sequence[tail], tailBlock);
+    if (end > tailBlock) {
+	rolled = TRUE;
+	tailBlock = tailWritten = end;
+    } else if (end < 0) {		// nothing was added to it
+	summary->sequence = sequence[tail];
+	for (int i = 0; i < SegmentBlocks; i++)
+	    summary->logical[i] =
+		(i < tailBlock) ? owner[SegmentStart(tail) + i] : -1;
+    }
+    for (int s = 0; s < NumSegments && tailBlock == SegmentBlocks; s++) {
+	if (s == tail || full[s])
+	    continue;
+	end = ApplySummary(s, expected, 0);
+	if (end < 0)
+	    break;
+	DEBUG(dbgDisk, "Log rolled forward to segment " << s);
+	tail = s;
+	tailBlock = tailWritten = end;
+	sequence[tail] = expected++;
+	rolled = TRUE;
+    }
+    nextSequence = expected;
+    Rebuild();
+    if (rolled) {
+	dirty = TRUE;
+	sinceCheckpoint = CheckpointSegments;
+    }
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::ApplySummary
+// 	Read the summary of segment "segment"; if it was started as
+//	segment "expected", put what its sectors hold from "from" on in
+//	the map, and make it the summary of the tail.
+//----------------------------------------------------------------------
+
+int
+SegmentLog::ApplySummary(int segment, int expected, int from)
+{
+    SegmentSummary found;
+    int i;
+
+    disk->Transfer(SegmentStart(segment) + SegmentBlocks, 1,
+		   (char *) &found, FALSE);
+    if (found.sequence != expected)
+	return -1;
+    for (i = from; i < SegmentBlocks; i++) {
+	int logical = found.logical[i];
+
+	if (logical < 0 || logical >= LogicalSectors)
+	    break;
+	map[logical] = SegmentStart(segment) + i;
+    }
+    *summary = found;
+    return i;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Rebuild
+// 	Work out from the map who owns each sector in the log, how much
+//	of each segment is alive, and which are free: those with nothing
+//	alive, other than the tail.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Rebuild()
+{
+    for (int i = 0; i < NumSectors; i++)
+	owner[i] = -1;
+    for (int s = 0; s < NumSegments; s++)
+	live[s] = 0;
+    for (int i = 0; i < NumSectors; i++) {
+	if (map[i] >= 0) {
+	    owner[map[i]] = i;
+	    live[SegmentOf(map[i])]++;
+	}
+    }
+    numFree = 0;
+    for (int s = 0; s < NumSegments; s++) {
+	full[s] = (s != tail && live[s] > 0);
+	if (s != tail && !full[s])
+	    numFree++;
+    }
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Close
+// 	Nachos is halting, and the buffer cache has been flushed: take
+//	a checkpoint, if anything was written since the last one, so
+//	that mounting the disk need not roll forward.  Say how the log
+//	did, with -stats.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Close()
+{
+    lock->Acquire();
+    if (dirty)
+	Checkpoint();
+    closed = TRUE;
+    lock->Release();
+    if (kernel->printStats && numWritten > 0)
+	cout << "Log: " << numWritten << " sectors written, " << numFilled
+	     << " segments filled, " << numCleaned << " cleaned ("
+	     << numMoved << " sectors moved), " << numCheckpoints
+	     << " checkpoints\n";
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Physical
+// 	Return where logical sector "logical" is on the disk, or -1 if
+//	it has never been written.  The superblock is where it is.
+//----------------------------------------------------------------------
+
+int
+SegmentLog::Physical(int logical)
+{
+    if (logical == 0)
+	return 0;
+    return map[logical];
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Buffered
+// 	Return TRUE if "physical" is in the tail, and has not been
+//	written to the disk yet.
+//----------------------------------------------------------------------
+
+bool
+SegmentLog::Buffered(int physical)
+{
+    return physical >= SegmentStart(tail) + tailWritten
+	&& physical < SegmentStart(tail) + SegmentBlocks;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Read
+// 	Read logical sectors, a run of them next to each other on the
+//	disk at a time; one never written reads as zeroes, and one in the
+//	tail that is not on the disk yet is copied.
+//
+//	"firstSector" -- the first logical sector to read
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the buffer, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Read(int firstSector, int numSectors, char *data)
+{
+    lock->Acquire();
+    for (int i = 0, run; i < numSectors; i += run) {
+	int where = Physical(firstSector + i);
+
+	for (run = 1; i + run < numSectors; run++) {
+	    int next = Physical(firstSector + i + run);
+
+	    if (where < 0 ? next >= 0 : next != where + run
+				|| Buffered(next) != Buffered(where))
+		break;
+	}
+	if (where < 0)
+	    bzero(&data[i * SectorSize], run * SectorSize);
+	else if (Buffered(where))
+	    bcopy(&tailData[(where - SegmentStart(tail)) * SectorSize],
+		  &data[i * SectorSize], run * SectorSize);
+	else
+	    disk->Transfer(where, run, &data[i * SectorSize], FALSE);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Request
+// 	Start a read of logical sectors, as Read, but return at once;
+//	"request" is finished, and deleted, once all of it is done.  It
+//	is split into a transfer for each run of sectors next to each
+//	other on the disk.  Only reads are started this way.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Request(DiskRequest *request)
+{
+    LogReadParts *parts = new LogReadParts(this, request);
+
+    ASSERT(!request->writing);
+    lock->Acquire();
+    numReading++;
+    for (int i = 0, run; i < request->numSectors; i += run) {
+	int where = Physical(request->firstSector + i);
+	char *data = &request->data[i * SectorSize];
+
+	for (run = 1; i + run < request->numSectors; run++) {
+	    int next = Physical(request->firstSector + i + run);
+
+	    if (where < 0 ? next >= 0 : next != where + run
+				|| Buffered(next) != Buffered(where))
+		break;
+	}
+	if (where < 0) {
+	    bzero(data, run * SectorSize);
+	} else if (Buffered(where)) {
+	    bcopy(&tailData[(where - SegmentStart(tail)) * SectorSize], data,
+		  run * SectorSize);
+	} else {
+	    parts->Add();
+	    disk->Queue(new DiskRequest(where, run, data, FALSE, parts));
+	}
+    }
+    lock->Release();
+    kernel->interrupt->Schedule(parts, 1, DiskInt);	// give up the hold
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::ReadDone
+// 	A read started by Request is done; if it was the last one, and a
+//	checkpoint is waiting for them, let it go on.  Called from the
+//	disk interrupt handler.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::ReadDone()
+{
+    numReading--;
+    if (numReading == 0 && waitingForReads) {
+	waitingForReads = FALSE;
+	readsDone->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Write
+// 	Append logical sectors to the log; the superblock is written in
+//	place, and at once.
+//
+//	"firstSector" -- the first logical sector to write
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the buffer, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Write(int firstSector, int numSectors, char *data)
+{
+    lock->Acquire();
+    if (firstSector == 0) {
+	disk->Transfer(0, 1, data, TRUE);
+	firstSector++;
+	numSectors--;
+	data += SectorSize;
+    }
+    if (numSectors > 0) {
+	int *logical = new int[numSectors];
+
+	ASSERT(firstSector + numSectors <= LogicalSectors);
+	for (int i = 0; i < numSectors; i++)
+	    logical[i] = firstSector + i;
+	Append(logical, numSectors, data);
+	numWritten += numSectors;
+	delete [] logical;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Sync
+// 	Write what is not on the disk of the tail, then flush the disk's
+//	write cache: everything written so far survives a crash.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Sync()
+{
+    lock->Acquire();
+    if (summaryDirty)
+	WriteTail();
+    disk->FlushCache();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Append
+// 	Put "count" sectors at the end of the log, in the tail, and
+//	point the map at them.  Where they were before is dead.
+//
+//	"logical" -- the logical sector each of them is
+//	"data" -- their contents, count * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Append(int *logical, int count, char *data)
+{
+    for (int done = 0, run; done < count; done += run) {
+	while (tailBlock == SegmentBlocks)	// cleaning may fill it
+	    NextSegment();
+	int first = SegmentStart(tail) + tailBlock;
+
+	run = min(count - done, SegmentBlocks - tailBlock);
+	bcopy(&data[done * SectorSize], &tailData[tailBlock * SectorSize],
+	      run * SectorSize);
+	for (int i = 0; i < run; i++) {
+	    int l = logical[done + i], old = map[l];
+
+	    if (old >= 0) {
+		owner[old] = -1;
+		live[SegmentOf(old)]--;
+	    }
+	    map[l] = first + i;
+	    owner[first + i] = l;
+	    summary->logical[tailBlock + i] = l;
+	}
+	live[tail] += run;
+	tailBlock += run;
+	summaryDirty = TRUE;
+    }
+    dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::NextSegment
+// 	The tail is full: write it, and start the lowest free segment.  Every CheckpointSegments segments, or when none is
+//	free but some may be emptied, take a checkpoint first.
+//
+//	Once only ReserveSegments are left, clean here and now, until
+//	there are CleanSegments again; a few less than that, wake the
+//	cleaner to do it in the background.  The cleaner can use the
+//	reserve for what it moves.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::NextSegment()
+{
+    WriteTail();
+    full[tail] = TRUE;
+    numFilled++;
+    if (++sinceCheckpoint >= CheckpointSegments || numFree == 0)
+	Checkpoint();
+    if (numFree == 0) {
+	cerr << "The log is full\n";
+	Abort();
+    }
+
+    for (tail = 0; full[tail]; tail++)
+	;
+    numFree--;
+    tailBlock = tailWritten = 0;
+    sequence[tail] = nextSequence++;
+    bzero(tailData, SegmentBlocks * SectorSize);
+    summary->sequence = sequence[tail];
+    for (int i = 0; i < SegmentBlocks; i++)
+	summary->logical[i] = -1;
+    DEBUG(dbgDisk, "Log starts segment " << tail << ", " << numFree
+			<< " free");
+
+    if (cleaning)
+	return;
+    if (numFree < ReserveSegments) {
+	Clean(CleanSegments);
+    } else if (numFree < CleanSegments && !woken) {
+	woken = TRUE;
+	work->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::WriteTail
+// 	Write the sectors of the tail from the first that is not on the
+//	disk through to its summary, in one transfer.  Those not used
+//	yet go too, since they are in between, and are written again
+//	once they are.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::WriteTail()
+{
+    disk->Transfer(SegmentStart(tail) + tailWritten,
+		   SegmentSectors - tailWritten,
+		   &tailData[tailWritten * SectorSize], TRUE);
+    tailWritten = tailBlock;
+    summaryDirty = FALSE;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Checkpoint
+// 	Write the map to the checkpoint area not holding the latest
+//	checkpoint, and then its header, each once what comes before it
+//	is on the media -- starting with the tail, which the map points
+//	into; then free the segments with nothing alive.
+//	Since a read started by Request may be in one of them, wait for
+//	those to be done, first.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Checkpoint()
+{
+    char *buffer = new char[CheckpointSectors * SectorSize];
+    CheckpointHeader *header = (CheckpointHeader *) buffer;
+    int *body = (int *) &buffer[SectorSize];
+    IntStatus oldLevel;
+    int start;
+
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    while (numReading > 0) {
+	waitingForReads = TRUE;
+	readsDone->P();
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+
+    bzero(buffer, CheckpointSectors * SectorSize);
+    header->magic = LogMagic;
+    header->serial = ++serial;
+    header->nextSequence = nextSequence;
+    header->tail = tail;
+    header->tailBlock = tailBlock;
+    header->numSegments = NumSegments;
+    bcopy(map, body, NumSectors * sizeof(int));
+    bcopy(sequence, &body[NumSectors], NumSegments * sizeof(int));
+
+    start = 1 + (serial % 2) * CheckpointSectors;
+    if (summaryDirty)
+	WriteTail();
+    disk->FlushCache();
+    disk->Transfer(start + 1, CheckpointSectors - 1, &buffer[SectorSize], TRUE);
+    disk->FlushCache();
+    disk->Transfer(start, 1, buffer, TRUE);
+    disk->FlushCache();
+    delete [] buffer;
+
+    for (int s = 0; s < NumSegments; s++) {
+	if (full[s] && live[s] == 0 && s != tail) {
+	    full[s] = FALSE;
+	    numFree++;
+	}
+    }
+    DEBUG(dbgDisk, "Log checkpoint " << serial << ", " << numFree
+			<< " segments free");
+    sinceCheckpoint = 0;
+    dirty = FALSE;
+    numCheckpoints++;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::NumEmptied
+// 	Return how many segments the next checkpoint will free.
+//----------------------------------------------------------------------
+
+int
+SegmentLog::NumEmptied()
+{
+    int count = 0;
+
+    for (int s = 0; s < NumSegments; s++) {
+	if (full[s] && live[s] == 0 && s != tail)
+	    count++;
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::CleanOne
+// 	Pick the full segment whose cleaning is worth the most, by cost-
+//	benefit, and copy what is alive in it to the end of the log, in
+//	one transfer (or two, if the tail fills).  Return FALSE if every
+//	full segment is all alive, or has nothing alive.
+//----------------------------------------------------------------------
+
+bool
+SegmentLog::CleanOne()
+{
+    int victim = -1, count = 0;
+    double best = 0;
+    char *data;
+    int logical[SegmentBlocks];
+
+    for (int s = 0; s < NumSegments; s++) {
+	if (!full[s] || s == tail || live[s] == 0 || live[s] == SegmentBlocks)
+	    continue;
+	double u = (double) live[s] / SegmentBlocks;
+	double benefit = (1 - u) * (nextSequence - sequence[s]) / (1 + u);
+
+	if (victim < 0 || benefit > best) {
+	    victim = s;
+	    best = benefit;
+	}
+    }
+    if (victim < 0)
+	return FALSE;
+
+    data = new char[SegmentBlocks * SectorSize];
+    disk->Transfer(SegmentStart(victim), SegmentBlocks, data, FALSE);
+    for (int i = 0; i < SegmentBlocks; i++) {
+	int l = owner[SegmentStart(victim) + i];
+
+	if (l < 0)
+	    continue;
+	if (count < i)
+	    bcopy(&data[i * SectorSize], &data[count * SectorSize], SectorSize);
+	logical[count++] = l;
+    }
+    DEBUG(dbgDisk, "Log cleaning segment " << victim << ": " << count
+			<< " sectors alive, age "
+			<< nextSequence - sequence[victim]);
+    Append(logical, count, data);
+    delete [] data;
+    numMoved += count;
+    numCleaned++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::Clean
+// 	Clean segments until "target" of them are free, or will be at
+//	the next checkpoint, or there is nothing worth cleaning; then
+//	take the checkpoint, if it frees any.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::Clean(int target)
+{
+    cleaning = TRUE;
+    while (numFree + NumEmptied() < target && CleanOne())
+	;
+    cleaning = FALSE;
+    if (NumEmptied() > 0)
+	Checkpoint();
+}
+
+//----------------------------------------------------------------------
+// SegmentLog::CleanerThread
+// 	The cleaner thread; "data" is the log.  Each time it is woken,
+//	it cleans until there are CleanSegments free segments again.
+//----------------------------------------------------------------------
+
+void
+SegmentLog::CleanerThread(void *data)
+{
+    SegmentLog *log = (SegmentLog *) data;
+
+    for (;;) {
+	log->work->P();
+	log->lock->Acquire();
+	log->woken = FALSE;
+	if (!log->closed)
+	    log->Clean(CleanSegments);
+	log->lock->Release();
+    }
+}
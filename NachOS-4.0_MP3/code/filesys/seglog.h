@@ -0,0 +1,201 @@
+// seglog.h
+//	Data structures for laying out the disk as a log (-f -lfs).
+//
+//	The file system writes a sector in place: a file written a few
+//	sectors at a time, or many small files created together, means
+//	a seek between most of the writes.  On a disk formatted with
+//	-lfs, every sector written is instead appended to the end of a
+//	log, wherever it belongs in the file system, so that writes go
+//	to the disk one after another, in runs, however scattered they
+//	are.  A "map" says where on the disk the latest copy of each
+//	sector is; the file system above is the same one, and only sees
+//	the sectors where they always were (the "logical" sectors).
+//
+//	The log is written a "segment" at a time: a track's worth of
+//	sectors, whose last sector, the summary, says which logical
+//	sector each of the others holds, and when the segment was
+//	started.  Every CheckpointSegments segments, and when Nachos
+//	halts, the whole map is written to one of two checkpoint areas at
+//	the start of the disk, in turn, with the segment the log had got
+//	to; mounting the disk reads the later of the two, and then rolls
+//	forward through the segments written after it, by their
+//	summaries.
+//
+//	The segment being written, the "tail", is put together in memory,
+//	and written, up to and including its summary, in one transfer,
+//	when it is full, and whenever the disk is flushed, so that what
+//	was written before then is not lost.  So the sectors written go
+//	to the disk in long runs, without missing a turn of the disk
+//	between each of them, and the summary is not a write on its own.
+//
+//	A sector written again leaves its old copy dead, so segments
+//	gradually empty.  The "cleaner" copies what is still alive in
+//	the segments it picks to the end of the log, so that they can be
+//	reused: it picks those which give the most room for the least
+//	copying, and which have been left alone longest, by the "cost-
+//	benefit" of Rosenblum and Ousterhout, (1 - u) * age / (1 + u),
+//	where u is how much of the segment is alive.  It runs in a thread
+//	of its own, in the background, once CleanSegments segments or
+//	fewer are free; a thread that finds only ReserveSegments left
+//	cleans for itself.  A segment emptied is only reused after the
+//	next checkpoint, since until then, mounting the disk would go by
+//	a map that still points into it.
+//
+//	So that there is always something worth cleaning, there are only
+//	LogicalSectors logical sectors, about three quarters of what
+//	segments hold; the file system marks the rest in use when it is
+//	formatted.  The superblock, sector 0, stays where it is.
+//
+//	SynchDisk does the remapping: once the log is attached to it,
+//	its reads and writes are of logical sectors (see SynchDisk::
+//	SetLog), and the log does its own through SynchDisk::Transfer.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SEGLOG_H
+#define SEGLOG_H
+
+#include "disk.h"
+#include "utility.h"
+
+class SynchDisk;
+class DiskRequest;
+class Lock;
+class Semaphore;
+
+const int LogMagic = 0x4e464c47;	// in a checkpoint's header
+const int SegmentSectors = SectorSize / sizeof(int);
+					// a summary holds an int for
+					// each of the others, and one more
+const int SegmentBlocks = SegmentSectors - 1;
+const int MaxSegments = NumSectors / SegmentSectors;
+const int CheckpointSectors = 1 + divRoundUp((NumSectors + MaxSegments)
+					      * sizeof(int), SectorSize);
+					// a header, then the map and the
+					// segments' sequence numbers
+const int LogStart = divRoundUp(1 + 2 * CheckpointSectors, SegmentSectors)
+			* SegmentSectors;	// the first segment
+const int NumSegments = (NumSectors - LogStart) / SegmentSectors;
+const int CheckpointSegments = 8;	// segments between checkpoints
+const int CleanSegments = 4;		// free ones the cleaner keeps
+const int ReserveSegments = 2;		// kept for cleaning
+const int LogicalSectors = 1 + (NumSegments - ReserveSegments)
+				* SegmentBlocks * 3 / 4;
+
+// The following class defines a segment's summary.
+
+class SegmentSummary {
+  public:
+    int sequence;			// when the segment was started
+    int logical[SegmentBlocks];		// what each sector holds, up to
+					// the first -1
+};
+
+// The following class defines the header sector of a checkpoint.
+
+class CheckpointHeader {
+  public:
+    int magic;				// LogMagic
+    int serial;				// the later of the two is used
+    int nextSequence;			// for the next segment started
+    int tail;				// the segment being written
+    int tailBlock;			// and how much of it had been
+    int numSegments;			// NumSegments, as a check
+};
+
+// The following class defines the log.
+
+class SegmentLog {
+  public:
+    SegmentLog(SynchDisk *d);		// Start the cleaner thread
+    ~SegmentLog();
+
+    static bool IsOnDisk(SynchDisk *d);	// Was the disk formatted with
+					// a log?
+    void Format();			// Start an empty log
+    void Mount();			// Read the latest checkpoint, and
+					// recover what came after it
+    void Close();			// Checkpoint, if need be, and
+					// say how it went
+
+    void Read(int firstSector, int numSectors, char *data);
+    void Write(int firstSector, int numSectors, char *data);
+					// of logical sectors; what is
+					// written is on the disk by the
+					// next Sync
+    void Request(DiskRequest *request);	// Start a read, as SynchDisk::
+					// Request
+    void Sync();			// Put the summary on the disk,
+					// and flush it
+
+  private:
+    SynchDisk *disk;
+    int *map;				// logical -> physical, -1 if the
+					// sector was never written
+    int *owner;				// physical -> logical, -1 if dead
+    int *live;				// sectors of each segment alive
+    int *sequence;			// and when each was started
+    bool *full;				// written, and not yet free again
+    int numFree;			// segments neither full nor the tail
+    int tail;				// the segment being written
+    int tailBlock;			// and how much of it has been
+    char *tailData;			// its sectors, as they will be
+					// written
+    SegmentSummary *summary;		// the last of them
+    int tailWritten;			// how many are on the disk
+    bool summaryDirty;			// not yet written?
+    int nextSequence;			// for the next segment
+    int serial;				// of the last checkpoint
+    int sinceCheckpoint;		// segments filled since then
+    bool dirty;				// anything written since then?
+    bool cleaning;			// moving the live sectors of one?
+    bool closed;
+
+    Lock *lock;				// protects all of the above; held
+					// across the log's own transfers
+    Semaphore *work;			// V'ed to wake the cleaner, if it
+    bool woken;				// is not already awake
+    int numReading;			// reads started by Request not done
+    Semaphore *readsDone;		// V'ed once they are, if someone
+    bool waitingForReads;		// is waiting for them (interrupts
+					// off)
+
+    int numWritten;			// sectors the file system wrote
+    int numMoved;			// and the cleaner copied
+    int numFilled;			// segments filled
+    int numCleaned;			// of them, cleaned
+    int numCheckpoints;
+
+    int Physical(int logical);		// where it is, -1 if nowhere
+    int SegmentOf(int physical) { return (physical - LogStart) / SegmentSectors; }
+    int SegmentStart(int segment) { return LogStart + segment * SegmentSectors; }
+    void Append(int *logical, int count, char *data);
+					// to the end of the log
+    void NextSegment();			// the tail is full: move on
+    bool Buffered(int physical);	// in the tail, not yet written?
+    void WriteTail();			// what is not on the disk of it,
+					// up to its summary
+    void Checkpoint();			// write the map, and free the
+					// segments emptied
+    void RollForward();			// apply the segments after it
+    int ApplySummary(int segment, int expected, int from);
+					// use its summary from "from", if
+					// it is the one expected; return
+					// how far it goes, or -1
+    void Rebuild();			// "owner", "live", "full" from "map"
+    bool CleanOne();			// the cost-benefit choice
+    void Clean(int target);		// until "target" segments are free
+					// or can be
+    int NumEmptied();			// full segments with nothing alive
+    void ReadDone();			// a read started by Request is
+					// done; called from its interrupt
+
+    friend class LogReadParts;		// calls ReadDone
+    static void CleanerThread(void *data);
+};
+
+#endif // SEGLOG_H
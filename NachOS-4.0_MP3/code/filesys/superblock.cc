@@ -0,0 +1,176 @@
+// superblock.cc
+//	Routines to read, write and check the superblock, and to keep
+//	its summary of the free map.  See superblock.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "superblock.h"
+#include "bufcache.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// SuperBlock::SuperBlock
+// 	Initialize the superblock of a file system about to be made on
+//	this disk.  Where the free map and root directory headers go,
+//	and the summary, are for the caller to fill in.
+//----------------------------------------------------------------------
+
+SuperBlock::SuperBlock()
+{
+    ASSERT(sizeof(SuperBlock) == SectorSize);
+
+    magic = SuperBlockMagic;
+    version = SuperBlockVersion;
+    sectorSize = SectorSize;
+    sectorsPerTrack = SectorsPerTrack;
+    numSectors = NumSectors;
+    headerFormat = HeaderFormat;
+    freeMapSector = -1;
+    rootSector = -1;
+    clean = FALSE;
+    freeSectors = NumSectors;
+
+    groupSize = SectorsPerGroup;
+    numGroups = NumAllocGroups;
+    for (int i = 0; i < MaxAllocGroups; i++) {
+	groupFree[i] = 0;
+    }
+    journalStart = -1;
+    journalSectors = 0;
+    orphanSector = -1;
+    shareMapSector = -1;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::FetchFrom
+// 	Read the superblock from disk.  Return FALSE if "sector" does
+//	not hold one, leaving the superblock as it was.  Each version
+//	has one int less of group summary than the last, for the fields
+//	it added at the end of the sector: a version 1 superblock has no
+//	journal, neither it nor a version 2 one has an orphan table, and
+//	none before version 4 has a share map.
+//
+//	"sector" is the disk sector holding the superblock
+//----------------------------------------------------------------------
+
+bool
+SuperBlock::FetchFrom(int sector)
+{
+    char buf[SectorSize];
+    int numAdded, *added;
+
+    kernel->bufferCache->ReadSector(sector, buf);
+    if (((SuperBlock *) buf)->magic != SuperBlockMagic) {
+	return FALSE;
+    }
+    bcopy(buf, (char *) this, SectorSize);
+    numAdded = (version == 1) ? 0 : version;	// ints after groupFree[]
+    added = (int *) buf + SectorSize / sizeof(int) - numAdded;
+    journalStart = (version >= 2) ? added[0] : -1;
+    journalSectors = (version >= 2) ? added[1] : 0;
+    orphanSector = (version >= 3) ? added[2] : -1;
+    shareMapSector = (version >= 4) ? added[3] : -1;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::WriteBack
+// 	Write the superblock back to disk.
+//
+//	"sector" is the disk sector to hold the superblock
+//----------------------------------------------------------------------
+
+void
+SuperBlock::WriteBack(int sector)
+{
+    kernel->bufferCache->WriteSector(sector, (char *) this);
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::IsCompatible
+// 	Return TRUE if the file system was made by a kernel like this
+//	one: for the same geometry and allocation groups, and with file
+//	headers we can read.  A superblock of any older version will do (see
+//	FetchFrom), and so will headers of any format from 2 on: each one
+//	only added to the last (inline data in 3, holes in 4, unwritten
+//	sectors in 5, packed directories in 6, indexed ones in 7).
+//----------------------------------------------------------------------
+
+bool
+SuperBlock::IsCompatible()
+{
+    return version >= 1 && version <= SuperBlockVersion
+	&& sectorSize == SectorSize
+	&& sectorsPerTrack == SectorsPerTrack && numSectors == NumSectors
+	&& headerFormat >= 2 && headerFormat <= HeaderFormat
+	&& groupSize == SectorsPerGroup && numGroups == NumAllocGroups;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::Summarize
+// 	Record how many sectors are free, and how many in each group.
+//
+//	"freeMap" is the bitmap of free sectors
+//----------------------------------------------------------------------
+
+void
+SuperBlock::Summarize(Bitmap *freeMap)
+{
+    freeSectors = 0;
+    for (int i = 0; i < numGroups; i++) {
+	groupFree[i] = freeMap->NumClearIn(i * groupSize,
+				min((i + 1) * groupSize, NumSectors));
+	freeSectors += groupFree[i];
+    }
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::FirstFreeGroup
+// 	Return the number of the first sector of the first group with a
+//	free sector, according to the summary; every sector before it is
+//	in use.  NumSectors if the disk is full.
+//----------------------------------------------------------------------
+
+int
+SuperBlock::FirstFreeGroup()
+{
+    for (int i = 0; i < numGroups; i++) {
+	if (groupFree[i] > 0) {
+	    return i * groupSize;
+	}
+    }
+    return NumSectors;
+}
+
+//----------------------------------------------------------------------
+// SuperBlock::Print
+// 	Print the contents of the superblock.
+//----------------------------------------------------------------------
+
+void
+SuperBlock::Print()
+{
+    printf("Superblock version %d: %d sectors of %d bytes, %d per track, "
+	   "header format %d\n", version, numSectors, sectorSize,
+	   sectorsPerTrack, headerFormat);
+    printf("Free map header: %d, root directory header: %d, %s\n",
+	   freeMapSector, rootSector, clean ? "clean" : "not clean");
+    printf("%d sectors free, in groups of %d:", freeSectors, groupSize);
+    for (int i = 0; i < numGroups; i++) {
+	printf(" %d", groupFree[i]);
+    }
+    printf("\n");
+    if (journalSectors > 0) {
+	printf("Journal: sectors %d to %d\n", journalStart,
+	       journalStart + journalSectors - 1);
+    }
+    if (orphanSector >= 0) {
+	printf("Orphan table: sector %d\n", orphanSector);
+    }
+    if (shareMapSector >= 0) {
+	printf("Share map header: %d\n", shareMapSector);
+    }
+}
@@ -0,0 +1,121 @@
+// superblock.h
+//	Data structures for the file system's superblock: the first
+//	sector of a formatted disk, saying what is on it.
+//
+//	The superblock records the geometry the file system was made
+//	for, the version of its file header format, and where the
+//	headers of the free map and of the root directory are, so that
+//	mounting does not have to assume any of them.
+//
+//	It also keeps a summary of the free map: how many sectors are
+//	free, overall and in each allocation group (a range of whole
+//	tracks, see PersistentBitmap::PlaceNear).  The summary is only
+//	written back when the file system is unmounted, along with a
+//	"clean" flag; mounting clears the flag on disk.  So when the flag
+//	is set, everything on the disk was written back, and the summary
+//	can be used instead of working it out from the free map.  When it
+//	is not (Nachos stopped without unmounting), it is recomputed.
+//
+//	Since version 2, the superblock also says where the journal area
+//	is (see journal.h).  A version 1 disk has no journal, and is
+//	mounted without one.  Version 3 added the orphan table: the
+//	headers of files that were removed, but whose sectors have not
+//	been given back yet (see FileSystem::Remove).  A version 1 or 2
+//	disk has none, and gets one when it is first needed.  Version 4
+//	added the share map: how many files share each sector (see
+//	PersistentBitmap::Share), also made when it is first needed.
+//
+//	Header format 3 added files with their data inline (see
+//	filehdr.h), 4 holes, 5 unwritten sectors, 6 directories of
+//	packed records with long names (see directory.h), and 7 large
+//	directories indexed on disk (see dirindex.h).  A disk with
+//	headers of an older format can be mounted, since those are still
+//	valid (an old directory is packed when it is next written back);
+//	it is marked with the newest format when it is.
+//
+//	A disk formatted before there were superblocks has the free map
+//	header in its first sector; it can be told apart by the magic
+//	number, and is mounted the old way.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SUPERBLOCK_H
+#define SUPERBLOCK_H
+
+#include "disk.h"
+#include "bitmap.h"
+
+const int SuperBlockSector = 0;		// where it is on a formatted disk
+const int SuperBlockMagic = 0x4e465342;	// which says it is there
+const int SuperBlockVersion = 4;	// the layout of this sector
+const int HeaderFormat = 7;		// the layout of file headers: with
+					// indirect tables, extents, inline
+					// data, holes and unwritten sectors,
+					// and of directories
+const int SuperBlockFields = 16;	// ints besides groupFree[]
+const int MaxAllocGroups = SectorSize / sizeof(int) - SuperBlockFields;
+
+// Allocation groups are as few tracks as it takes for the summary of
+// every group to fit in the superblock.
+const int TracksPerGroup = divRoundUp(NumTracks, MaxAllocGroups);
+const int SectorsPerGroup = TracksPerGroup * SectorsPerTrack;
+const int NumAllocGroups = divRoundUp(NumTracks, TracksPerGroup);
+
+// The following class defines the superblock.  Like a file header, it
+// is exactly one sector on disk.
+
+class SuperBlock {
+  public:
+    SuperBlock();			// Describe a new, empty file system
+
+    bool FetchFrom(int sector);		// Read it from disk; FALSE if the
+					// sector has no superblock
+    void WriteBack(int sector);		// Write it to disk
+
+    bool IsCompatible();		// Was it made for this kernel's
+					// geometry and header format?
+    void Summarize(Bitmap *freeMap);	// Record which sectors are free
+    int FirstFreeGroup();		// First sector of the first group
+					// with a free sector; NumSectors
+					// if there is none
+
+    void Print();			// Print the contents
+
+    int magic;				// SuperBlockMagic
+    int version;			// SuperBlockVersion
+    int sectorSize;			// geometry of the disk
+    int sectorsPerTrack;
+    int numSectors;
+    int headerFormat;			// HeaderFormat
+    int freeMapSector;			// header of the free map file
+    int rootSector;			// header of the root directory
+    int clean;				// TRUE if the disk was unmounted
+					// after it was last changed
+    int freeSectors;			// free map summary: overall,
+    int groupSize;			// SectorsPerGroup
+    int numGroups;			// NumAllocGroups
+    int groupFree[MaxAllocGroups];	// and free sectors in each group
+    int journalStart;			// first sector of the journal area
+    int journalSectors;			// its size; 0 if there is none
+    int orphanSector;			// the orphan table; -1 if there
+					// is none yet
+    int shareMapSector;			// header of the share map file;
+					// -1 if there is none yet
+};
+
+// The following class defines the orphan table.  Like the superblock,
+// it is exactly one sector on disk.
+
+const int MaxOrphans = SectorSize / sizeof(int) - 1;
+
+class OrphanTable {
+  public:
+    int numOrphans;			// how many of the following are used
+    int headers[MaxOrphans];		// header sectors of removed files
+};
+
+#endif // SUPERBLOCK_H
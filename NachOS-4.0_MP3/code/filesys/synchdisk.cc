@@ -5,10 +5,15 @@
 //	the disk providing a synchronous interface (requests wait until
 //	the request completes).
 //
-//	Use a semaphore to synchronize the interrupt handlers with the
-//	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	The physical disk can only handle one operation at a time, so
+//	requests that arrive while it is busy are queued.  When the disk
+//	interrupt says the current request is done, we start the next one
+//	(chosen by the queue's policy), then tell whoever made the finished
+//	request.  A thread doing synchronous I/O waits on a semaphore of
+//	its own, which the completion callback signals.
+//
+//	The queue and the "active" request are shared with the interrupt
+//	handler, so they are only touched with interrupts disabled.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -16,20 +21,76 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+#include "replica.h"
+#include "seglog.h"
 
 
+//----------------------------------------------------------------------
+// DiskWaiter
+// 	Completion callback for a synchronous request: wake up the
+//	thread waiting for it.
+//----------------------------------------------------------------------
+
+class DiskWaiter : public CallBackObj {
+  public:
+    DiskWaiter() { done = new Semaphore("disk request", 0); }
+    ~DiskWaiter() { delete done; }
+    void CallBack() { done->V(); }
+    void Wait() { done->P(); }
+
+  private:
+    Semaphore *done;
+};
+
+//----------------------------------------------------------------------
+// AnticipationTimer
+// 	Ends an anticipation window when it has run its course, unless
+//	it ended already.  Delete itself once it goes off.
+//----------------------------------------------------------------------
+
+class AnticipationTimer : public CallBackObj {
+  public:
+    AnticipationTimer(SynchDisk *d, int w) { disk = d; which = w; }
+    void CallBack() { disk->EndAnticipation(which); delete this; }
+
+  private:
+    SynchDisk *disk;
+    int which;				// the window it ends
+};
+
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
 //	initializing the physical disk.
 //
+//	"order" -- the policy for serving queued requests
+//	"mapImage" -- map the disk's UNIX file into memory (see disk.h)
+//	"trackBuffers" -- how many track buffers the disk has
+//	"writeCacheSectors" -- how many sectors its write cache holds
+//	"device" -- the model of its media
+//	"numDisks" -- how many disks the sectors are striped across
+//	"imageName" -- the UNIX file holding the disk, for one mounted
+//		on a directory; NULL for the kernel's own disk (see
+//		Disk::Disk)
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(DiskPolicy order, bool mapImage, int trackBuffers,
+		     int writeCacheSectors, DiskDevice device, int numDisks,
+		     char *imageName)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    queue = new DiskQueue(order);
+    active = NULL;
+    riders = new List<DiskRequest *>;
+    transferFirst = transferNum = 0;
+    transferData = NULL;
+    headSector = 0;
+    anticipating = FALSE;
+    window = 0;
+    log = NULL;
+    mirrored = (imageName == NULL);
+    disk = new Volume(this, numDisks, mapImage, trackBuffers,
+		      writeCacheSectors, device, imageName);
 }
 
 //----------------------------------------------------------------------
@@ -40,9 +101,10 @@ SynchDisk::SynchDisk()
 
 SynchDisk::~SynchDisk()
 {
+    ASSERT(active == NULL);
     delete disk;
-    delete lock;
-    delete semaphore;
+    delete riders;
+    delete queue;
 }
 
 //----------------------------------------------------------------------
@@ -57,10 +119,10 @@ SynchDisk::~SynchDisk()
 void
 SynchDisk::ReadSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    if (log != NULL)
+	log->Read(sectorNumber, 1, data);
+    else
+	Transfer(sectorNumber, 1, data, FALSE);
 }
 
 //----------------------------------------------------------------------
@@ -75,20 +137,392 @@ SynchDisk::ReadSector(int sectorNumber, char* data)
 void
 SynchDisk::WriteSector(int sectorNumber, char* data)
 {
-    lock->Acquire();			// only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P();			// wait for interrupt
-    lock->Release();
+    if (log != NULL)
+	log->Write(sectorNumber, 1, data);
+    else
+	Transfer(sectorNumber, 1, data, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors/WriteSectors
+// 	Read/write a run of consecutive disk sectors with one disk
+//	request.  Return only after all of them have been transferred.
+//
+//	"firstSector" -- the first disk sector to read/write
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- the buffer, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+SynchDisk::ReadSectors(int firstSector, int numSectors, char* data)
+{
+    if (log != NULL)
+	log->Read(firstSector, numSectors, data);
+    else
+	Transfer(firstSector, numSectors, data, FALSE);
+}
+
+void
+SynchDisk::WriteSectors(int firstSector, int numSectors, char* data)
+{
+    if (log != NULL)
+	log->Write(firstSector, numSectors, data);
+    else
+	Transfer(firstSector, numSectors, data, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::WriteSectors
+// 	Write a run of consecutive disk sectors, as above, but as a
+//	barrier -- once everything queued before it is on the media, and
+//	before anything queued after it -- and/or FUA -- returning only
+//	once the sectors are on the media themselves.  With a log, which
+//	decides where the sectors go, the order is its own business: the
+//	sectors are written, then synced, which is at least as strong.
+//
+//	"barrier" -- order the write after those before it
+//	"forceUnit" -- return once the sectors are on the media
+//----------------------------------------------------------------------
+
+void
+SynchDisk::WriteSectors(int firstSector, int numSectors, char* data,
+			bool barrier, bool forceUnit)
+{
+    if (log != NULL) {
+	log->Write(firstSector, numSectors, data);
+	if (barrier || forceUnit)
+	    log->Sync();
+    } else {
+	Transfer(firstSector, numSectors, data, TRUE, barrier, forceUnit);
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Flush/FlushCache
+// 	Ask the disk to write what is in its write cache to the media,
+//	and wait until it has.  The writes this covers are the ones that
+//	had finished when it was asked; there is nothing to wait for if
+//	the disk does not cache writes.  With a log, it first writes
+//	what it has to for them to be found again (see SegmentLog::Sync).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Flush()
+{
+    if (log != NULL)
+	log->Sync();
+    else
+	FlushCache();
+}
+
+void
+SynchDisk::FlushCache()
+{
+    if (disk->CachesWrites())
+	Transfer(0, 0, NULL, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Sync
+// 	Make sure what is on the media is in the UNIX files too: with
+//	-dm the disk is a mapping, and the host writes it back when it
+//	likes (see Disk::Sync).  Call it after Flush.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Sync()
+{
+    disk->Sync();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::SaveImage
+// 	Write an image of the disk, with every sector as it reads now,
+//	to the start of the UNIX file "file", for a checkpoint (see
+//	Disk::SaveImage).  Call it after Sync; it takes no simulated time.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::SaveImage(int file)
+{
+    disk->SaveImage(file);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Discard
+// 	Tell the disk that nothing on it is wanted any more, so that
+//	every sector reads as zeroes until it is written (see
+//	Disk::Discard).  Nothing may be queued, or in flight.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Discard()
+{
+    ASSERT(active == NULL && queue->IsEmpty() && log == NULL);
+    disk->Discard();
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::CloseLog
+// 	Nachos is halting, and the file system is gone: close the log,
+//	if there is one, so that it need not be recovered next time.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::CloseLog()
+{
+    if (log != NULL) {
+	log->Close();
+	delete log;
+	log = NULL;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Transfer
+// 	Queue a request, and wait until the disk has finished it.  It
+//	may be a barrier, or FUA, or both.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Transfer(int firstSector, int numSectors, char* data, bool writing)
+{
+    Transfer(firstSector, numSectors, data, writing, FALSE, FALSE);
+}
+
+void
+SynchDisk::Transfer(int firstSector, int numSectors, char* data, bool writing,
+		    bool barrier, bool forceUnit)
+{
+    DiskWaiter waiter;
+    DiskRequest *request = new DiskRequest(firstSector, numSectors, data,
+					   writing, &waiter);
+
+    request->synchronous = TRUE;
+    request->barrier = barrier;
+    request->fua = forceUnit;
+    Queue(request);
+    waiter.Wait();			// wait for interrupt
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Request
+// 	Queue a disk request, and return immediately; request->
+//	callWhenDone is called when the transfer has finished.  With a
+//	log, it says where the sectors are (see SegmentLog::Request).
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Request(DiskRequest *request)
+{
+    if (log != NULL)
+	log->Request(request);
+    else
+	Queue(request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Queue
+// 	Queue a disk request, starting it right away if the disk is idle.
+//	Returns immediately; request->callWhenDone is called when the
+//	transfer has finished.  The sectors are charged to the thread
+//	asking for them, even if it does not wait, and the request is of
+//	its I/O class.  One that is not idle ends an anticipation window.
+//
+//	A read the read in flight can serve is only added to its riders.
+//	A write is mirrored onto the backup, if there is one (see
+//	network/replica.h), unless this is a disk mounted on a directory.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Queue(DiskRequest *request)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (Rides(request)) {
+	DEBUG(dbgDisk, "Read of sector " << request->firstSector
+			<< " shares the one in flight");
+	kernel->stats->numDiskSharedReads++;
+	riders->Append(request);
+	kernel->interrupt->SetLevel(oldLevel);
+	return;
+    }
+    if (request->writing) {
+	kernel->currentThread->stats->numDiskWrites += request->numSectors;
+	if (kernel->replicator != NULL && mirrored && request->numSectors > 0)
+	    kernel->replicator->Mirror(request->firstSector,
+				       request->numSectors, request->data);
+    } else {
+	kernel->currentThread->stats->numDiskReads += request->numSectors;
+    }
+
+    request->ioClass = kernel->currentThread->ioClass;
+    request->queuedAt = kernel->stats->totalTicks;
+    queue->Append(request);
+    if (anticipating && queue->NextClass(request->queuedAt) != IoIdle) {
+	DEBUG(dbgDisk, "Anticipation over: sector " << request->firstSector
+			<< " asked for");
+	anticipating = FALSE;
+    }
+    StartNext();
+    kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Rides
+// 	Return TRUE if "request" is a read of sectors that the read in
+//	flight covers, and no write of them is waiting to go before it.
+//----------------------------------------------------------------------
+
+bool
+SynchDisk::Rides(DiskRequest *request)
+{
+    return !request->writing && request->numSectors > 0
+	&& active != NULL && !active->writing && active->numSectors > 0
+	&& request->firstSector >= transferFirst
+	&& request->firstSector + request->numSectors
+				<= transferFirst + transferNum
+	&& !queue->Overlaps(request->firstSector, request->numSectors, TRUE);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::StartNext
+// 	If the disk is idle and there is a request waiting, send the one
+//	the queue picks to the disk, with the queued requests that can
+//	be merged into the same transfer, and its flags: the whole
+//	transfer goes after a barrier's flush, and past the cache if it
+//	is FUA.  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::StartNext()
+{
+    DiskRequest *r;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (active != NULL || anticipating || queue->IsEmpty())
+	return;
+
+    active = queue->RemoveNext(headSector, kernel->stats->totalTicks);
+    if (active->numSectors == 0) {
+	disk->FlushRequest();
+	return;
+    }
+    transferFirst = active->firstSector;
+    transferNum = active->numSectors;
+    while ((r = queue->RemoveNeighbor(transferFirst, transferNum,
+				active->writing, MaxMergeSectors)) != NULL) {
+	int last = max(transferFirst + transferNum,
+		       r->firstSector + r->numSectors);
+
+	riders->Append(r);
+	transferFirst = min(transferFirst, r->firstSector);
+	transferNum = last - transferFirst;
+	kernel->stats->numDiskMerges++;
+    }
+    transferData = active->data;
+    if (!riders->IsEmpty()) {
+	DEBUG(dbgDisk, "Merged " << riders->NumInList() + 1
+			<< " requests into " << transferNum << " sectors");
+	transferData = new char[transferNum * SectorSize];
+	if (active->writing) {		// they do not overlap
+	    bcopy(active->data,
+		  &transferData[(active->firstSector - transferFirst) * SectorSize],
+		  active->numSectors * SectorSize);
+	    for (ListIterator<DiskRequest *> it(riders); !it.IsDone(); it.Next())
+		bcopy(it.Item()->data,
+		      &transferData[(it.Item()->firstSector - transferFirst) * SectorSize],
+		      it.Item()->numSectors * SectorSize);
+	}
+    }
+    if (active->writing)
+	disk->WriteRequest(transferFirst, transferNum, transferData,
+			   active->barrier, active->fua);
+    else
+	disk->ReadRequest(transferFirst, transferNum, transferData);
+    headSector = transferFirst + transferNum - 1;
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Anticipate
+// 	Keep the disk idle for AnticipateTicks, or until a request that
+//	is not idle comes.  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::Anticipate()
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    anticipating = TRUE;
+    window++;
+    DEBUG(dbgDisk, "Anticipating a read, head at " << headSector);
+    kernel->interrupt->Schedule(new AnticipationTimer(this, window),
+				AnticipateTicks, DiskInt);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::EndAnticipation
+// 	The time for window "which" is up: if it is still open, let the
+//	idle requests have the disk.  Called from the timer interrupt.
+//----------------------------------------------------------------------
+
+void
+SynchDisk::EndAnticipation(int which)
+{
+    if (anticipating && which == window) {
+	DEBUG(dbgDisk, "Anticipation over: no read came");
+	anticipating = FALSE;
+	StartNext();
+    }
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler.  Keep the disk busy by starting the next
+//	request, then tell the owners of the finished ones.  But if that
+//	was a synchronous read of the foreground, and there are only idle
+//	requests to start, anticipate the reader's next one instead.
+//
+//	The sectors read go to each request served from its part of the
+//	transfer, before the next transfer can reuse the fields.
 //----------------------------------------------------------------------
 
 void
 SynchDisk::CallBack()
 { 
-    semaphore->V();
+    DiskRequest *done = active;
+    List<DiskRequest *> served;
+
+    ASSERT(done != NULL);
+    if (done->numSectors > 0) {
+	served.Append(done);
+	while (!riders->IsEmpty())
+	    served.Append(riders->RemoveFront());
+	for (ListIterator<DiskRequest *> it(&served); !it.IsDone(); it.Next()) {
+	    DiskRequest *r = it.Item();
+
+	    if (!r->writing && r->data != transferData)
+		bcopy(&transferData[(r->firstSector - transferFirst) * SectorSize],
+		      r->data, r->numSectors * SectorSize);
+	}
+	if (transferData != done->data)
+	    delete [] transferData;
+	served.RemoveFront();
+    }
+    active = NULL;
+    if (done->synchronous && !done->writing && done->ioClass != IoIdle
+		&& !queue->IsEmpty()
+		&& queue->NextClass(kernel->stats->totalTicks) == IoIdle) {
+	Anticipate();
+    } else {
+	StartNext();
+    }
+    done->callWhenDone->CallBack();
+    delete done;
+    while (!served.IsEmpty()) {
+	DiskRequest *r = served.RemoveFront();
+
+	r->callWhenDone->CallBack();
+	delete r;
+    }
 }
@@ -11,9 +11,17 @@
 #ifndef SYNCHDISK_H
 #define SYNCHDISK_H
 
-#include "disk.h"
+#include "volume.h"
 #include "synch.h"
 #include "callback.h"
+#include "diskqueue.h"
+
+class SegmentLog;
+
+const int AnticipateTicks = 1000;	// how long to keep the disk for
+					// a synchronous reader's next read
+const int MaxMergeSectors = 32;		// longest transfer that requests
+					// are merged into
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -24,32 +32,130 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  Requests made while the disk is busy wait in a DiskQueue,
+// which decides the order in which they are served; each thread waits
+// for its own request only.
+//
+// Request() is the asynchronous form underneath: it queues the request
+// and returns at once, and the request's callback is invoked when the
+// transfer is done.  A request for no sectors is a flush of the disk's
+// write cache.
+//
+// A write may be a barrier, or FUA, or both (see diskqueue.h): the
+// queue serves it after everything queued before it and before
+// everything queued after it, the disk flushes its write cache before
+// writing it, and a FUA write is on the media when it is done.  The
+// rest of the requests are reordered and merged as the queue sees
+// fit; only the writes whose order matters need the flags.
+//
+// When a request is sent to the disk, the queued requests next to it
+// in the same direction are merged into the same transfer, up to
+// MaxMergeSectors in all, through a buffer of our own; so are queued
+// reads of the same sectors.  A read of sectors that a read in flight
+// is transferring already does not go to the disk at all: it is given
+// a copy of them when that read is done.
+//
+// Once a log is attached (see seglog.h), the sectors read and written
+// are those the file system sees, and the log says where each of them
+// is on the disk, and decides where it goes; what is written is on the
+// disk by the next Flush, as with a write cache.
+//
+// A request gets the I/O class of the thread making it (see
+// diskqueue.h).  When a synchronous read of the foreground is done and
+// only idle requests are left, the disk is kept idle for up to
+// AnticipateTicks ("anticipation"): a thread reading a file is likely
+// to ask for the next sector as soon as it has this one, and if the
+// background got in first, it would wait a whole request for it, and
+// a seek back.
 
 class SynchDisk : public CallBackObj {
   public:
-    SynchDisk();    		        // Initialize a synchronous disk,
+    SynchDisk(DiskPolicy order, bool mapImage, int trackBuffers,
+	      int writeCacheSectors, DiskDevice device, int numDisks,
+	      char *imageName);
+					// Initialize a synchronous disk,
 					// by initializing the raw Disk.
+					// Pending requests are served in
+					// "order"; the rest is passed on.
+					// "imageName" is NULL for the
+					// kernel's own disk
     ~SynchDisk();			// De-allocate the synch disk data
     
     void ReadSector(int sectorNumber, char* data);
     					// Read/write a disk sector, returning
     					// only once the data is actually read 
-					// or written.  These call
-    					// Disk::ReadRequest/WriteRequest and
-					// then wait until the request is done.
+					// or written.  These queue a request
+    					// and then wait until it is done.
     void WriteSector(int sectorNumber, char* data);
+    void ReadSectors(int firstSector, int numSectors, char* data);
+    					// Same, for "numSectors" consecutive
+					// sectors, sent to the disk as a
+					// single request
+    void WriteSectors(int firstSector, int numSectors, char* data);
+    void WriteSectors(int firstSector, int numSectors, char* data,
+		      bool barrier, bool forceUnit);
+					// Same, as a barrier and/or FUA
+					// write
+    void Flush();			// Return once every sector written
+					// so far is on the media, not just
+					// in the disk's write cache
+    void Sync();			// And once the media is in the
+					// UNIX file, if it is mapped
+    void SaveImage(int file);		// Write an image of the disk, as it
+					// reads now, to the UNIX "file"
+    void Discard();			// Make every sector read as zeroes;
+					// the disk must be idle
+
+    void Request(DiskRequest *request);	// Queue a request and return
+					// immediately; SynchDisk deletes
+					// it once its callback has run
+
+    void SetLog(SegmentLog *l) { log = l; }
+					// Go through "l" from now on
+    SegmentLog *Log() { return log; }	// NULL if there is none
+    void CloseLog();			// Close it and delete it, once
+					// nothing more is written
     
     void CallBack();			// Called by the disk device interrupt
 					// handler, to signal that the
 					// current disk operation is complete.
 
   private:
-    Disk *disk;		  		// Raw disk device
-    Semaphore *semaphore; 		// To synchronize requesting thread 
-					// with the interrupt handler
-    Lock *lock;		  		// Only one read/write request
-					// can be sent to the disk at a time
+    Volume *disk;	  		// Raw disk device: one disk, or a
+					// volume striped over several
+    DiskQueue *queue;			// Requests waiting for the disk
+    DiskRequest *active;		// Request the disk is working on,
+					// NULL if the disk is idle
+    List<DiskRequest *> *riders;	// the others its transfer serves
+    int transferFirst;			// the sectors the transfer covers
+    int transferNum;
+    char *transferData;			// and its buffer: active's own, or
+					// ours if requests were merged
+    int headSector;			// Where the last request left the
+					// disk head
+    bool anticipating;			// keeping the disk idle for the
+					// foreground?
+    int window;				// counts the times we have
+    SegmentLog *log;			// what all of the above go
+					// through, or NULL
+    bool mirrored;			// are its writes mirrored onto the
+					// backup, if there is one?  Only
+					// the kernel's own disk's are
+
+    void StartNext();			// Send the next queued request to
+					// the disk, if it is idle
+    bool Rides(DiskRequest *request);	// Can the read in flight serve it?
+    void Anticipate();			// Keep it idle for a while
+    void EndAnticipation(int which);	// Window "which" is over
+
+    friend class AnticipationTimer;	// calls EndAnticipation
+    friend class SegmentLog;		// calls the three below
+    void Transfer(int firstSector, int numSectors, char* data,
+		  bool writing);	// Queue a request and wait for it
+    void Transfer(int firstSector, int numSectors, char* data,
+		  bool writing, bool barrier, bool forceUnit);
+    void Queue(DiskRequest *request);	// Request, of sectors on the disk
+    void FlushCache();			// Flush, of the disk itself
 };
 
 #endif // SYNCHDISK_H
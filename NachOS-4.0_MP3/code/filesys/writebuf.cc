@@ -0,0 +1,217 @@
+// writebuf.cc
+//	Routines to hold back and merge the small writes to a file.
+//	See writebuf.h for the policy.
+//
+//	The buffer holds one contiguous range of the file.  Its memory
+//	starts at a sector boundary, so the whole sectors of the range
+//	can be handed to the buffer cache straight from it.
+//
+//	In write-through mode nothing is held back: the point of that
+//	mode is that a write is on disk once it returns.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "writebuf.h"
+#include "bufcache.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// WriteBuffer::WriteBuffer
+// 	Initialize an empty write buffer.
+//
+//	"fileHdr" -- the header of the file being written
+//	"fileStats" -- the file's I/O counters
+//----------------------------------------------------------------------
+
+WriteBuffer::WriteBuffer(FileHeader *fileHdr, FileIoStats *fileStats)
+{
+    hdr = fileHdr;
+    ioStats = fileStats;
+    lock = new Lock("write buffer lock");
+    data = new char[WriteBufferSize];
+    base = start = end = 0;
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::~WriteBuffer
+// 	Send on whatever is still held back, then de-allocate the buffer.
+//	The file header must still be around.
+//----------------------------------------------------------------------
+
+WriteBuffer::~WriteBuffer()
+{
+    Flush();
+    delete [] data;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::Fits
+// 	Return TRUE if the file bytes [first, last) can be added to the
+//	buffer: it is empty, or they overlap or touch the bytes in it,
+//	and the buffer memory reaches far enough.
+//----------------------------------------------------------------------
+
+bool
+WriteBuffer::Fits(int first, int last)
+{
+    if (IsEmpty())
+	return last - divRoundDown(first, SectorSize) * SectorSize
+						<= WriteBufferSize;
+    return first <= end && last >= start && first >= base
+				&& last - base <= WriteBufferSize;
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::Write
+// 	Write "numBytes" bytes of the file, starting at "position".  If
+//	they cannot join the bytes already buffered, those are sent on
+//	first: only the whole sectors of them, if the new bytes carry on
+//	from where they end, otherwise all of them.  A write bigger than
+//	the buffer goes straight to the cache.
+//
+//	"from" -- the new contents
+//	"numBytes" -- how many bytes; the caller has checked that they
+//		are all within the file
+//	"position" -- the file offset of the first of them
+//----------------------------------------------------------------------
+
+void
+WriteBuffer::Write(char *from, int numBytes, int position)
+{
+    int last = position + numBytes;
+
+    ASSERT(numBytes > 0 && last <= hdr->FileLength());
+    lock->Acquire();
+    if (kernel->bufferCache->IsWriteThrough()) {
+	WriteOut(from, position, position, last);
+	lock->Release();
+	return;
+    }
+
+    if (!IsEmpty() && !Fits(position, last) && position == end)
+	Drain();
+    if (!IsEmpty() && !Fits(position, last)) {
+	WriteOut(data, base, start, end);
+	start = end;
+    }
+    if (!Fits(position, last)) {		// too big to buffer at all
+	WriteOut(from, position, position, last);
+	lock->Release();
+	return;
+    }
+
+    if (IsEmpty()) {
+	base = position - InSector(position);
+	start = end = position;
+    }
+    bcopy(from, &data[position - base], numBytes);
+    start = min(start, position);
+    end = max(end, last);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::Drain
+// 	Make room in the buffer by writing out everything up to the
+//	start of the sector holding its last byte.  If the buffer ends
+//	in the middle of that sector, the bytes of it we have stay
+//	behind, moved down to the front of the buffer.
+//----------------------------------------------------------------------
+
+void
+WriteBuffer::Drain()
+{
+    int tail = divRoundDown(end, SectorSize) * SectorSize;
+
+    if (tail <= start) {			// nothing but a partial sector
+	WriteOut(data, base, start, end);
+	start = end;
+	return;
+    }
+    WriteOut(data, base, start, tail);
+    bcopy(&data[tail - base], data, end - tail);
+    base = start = tail;
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::FlushRange
+// 	Send the buffer on if it holds any of the file bytes
+//	[position, position + numBytes), so that reading them from the
+//	cache gets what was written.
+//----------------------------------------------------------------------
+
+void
+WriteBuffer::FlushRange(int position, int numBytes)
+{
+    lock->Acquire();
+    if (!IsEmpty() && position < end && position + numBytes > start) {
+	WriteOut(data, base, start, end);
+	start = end;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::Flush
+// 	Send everything in the buffer on to the cache.
+//----------------------------------------------------------------------
+
+void
+WriteBuffer::Flush()
+{
+    lock->Acquire();
+    if (!IsEmpty()) {
+	WriteOut(data, base, start, end);
+	start = end;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// WriteBuffer::WriteOut
+// 	Write the file bytes [first, last) to the buffer cache.  Sectors
+//	they cover completely are written in runs of consecutive disk
+//	sectors; a sector they only cover part of is read in, patched
+//	and written back.  None of them is a hole, or unwritten: the
+//	write that put the bytes here saw to that (see OpenFile::WriteAt).
+//
+//	"buf" -- holds the bytes
+//	"bufBase" -- the file offset of buf[0]
+//----------------------------------------------------------------------
+
+void
+WriteBuffer::WriteOut(char *buf, int bufBase, int first, int last)
+{
+    int firstSector = SectorOf(first);
+    int numSectors = SectorOf(last + SectorSize - 1) - firstSector;
+    int numWhole = (InSector(last) == 0) ? numSectors : numSectors - 1;
+    int *sectors = new int[numSectors];
+    int i, run;
+
+    DEBUG(dbgFile, "Writing out file bytes " << first << " to " << last - 1);
+    hdr->ByteRangeToSectors(first, last - first, sectors);
+    for (i = 0; i < numSectors; i += run) {
+	ASSERT(!FileHeader::IsUnwritten(sectors[i]));
+	int lo = max(first, (firstSector + i) * SectorSize);
+	int hi = min(last, (firstSector + i + 1) * SectorSize);
+
+	if (hi - lo < SectorSize) {		// partial sector
+	    char sector[SectorSize];
+
+	    kernel->bufferCache->ReadSector(sectors[i], sector);
+	    bcopy(&buf[lo - bufBase], &sector[InSector(lo)], hi - lo);
+	    kernel->bufferCache->WriteSector(sectors[i], sector);
+	    run = 1;
+	} else {
+	    run = FileHeader::RunLength(sectors, i, numWhole);
+	    kernel->bufferCache->WriteSectors(sectors[i], run,
+					      &buf[lo - bufBase]);
+	}
+	ioStats->runs++;
+    }
+    delete [] sectors;
+}
@@ -0,0 +1,107 @@
+// writebuf.h
+//	Data structures for holding back small writes to a file, so that
+//	they reach the buffer cache as a few whole-sector runs.
+//
+//	A program that writes a file a few bytes at a time would
+//	otherwise have every write go to the cache (and, in write-through
+//	mode, to the disk) on its own, and a write that only covers part
+//	of a sector would first have to read the rest of it in.  Instead,
+//	each file has a write buffer: a range of at most WriteBufferSize
+//	bytes that have been written but not yet sent on.  A write that
+//	overlaps or extends the range is simply copied into it.
+//
+//	When a write does not fit, the buffer is drained: the sectors
+//	that are completely covered are written out as one run, and a
+//	partly written last sector is kept to be finished by the writes
+//	that follow, so a file written sequentially in pieces never reads
+//	a sector back.  Only what is still partial when the buffer is
+//	flushed -- when the file is closed, synced, or read at the
+//	buffered bytes -- is read in and merged.
+//
+//	Like the file header, the write buffer is shared by every
+//	OpenFile on the file (see inodetable.h), so they all see the
+//	same contents.
+//
+//	The I/O counters of a file (FileIoStats) are kept beside it too,
+//	in the inode table, and the write buffer counts the runs of
+//	sectors it writes out.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef WRITEBUF_H
+#define WRITEBUF_H
+
+#include "filehdr.h"
+#include "synch.h"
+
+const int WriteBufferSize = 8 * SectorSize;	// bytes held back per file
+
+// The following class defines the I/O counters of one file.  Reads
+// and writes count the bytes, disk sectors and buffer cache hits of
+// the calls that made them (see OpenFile::ReadAt/WriteAt): sectors a
+// write held back are counted by the call that sends them on, if it
+// is a write to the same file.  A run is a stretch of consecutive disk
+// sectors read or written at once, so that a fragmented file touches
+// more runs for the same bytes.
+
+class FileIoStats {
+  public:
+    FileIoStats() { Clear(); }
+    void Clear() { bytesRead = bytesWritten = sectorReads = sectorWrites
+			= cacheHits = runs = 0; }
+    bool IsEmpty() { return bytesRead == 0 && bytesWritten == 0; }
+
+    int bytesRead;			// bytes read from the file,
+    int bytesWritten;			// and written to it
+    int sectorReads;			// disk sectors read for them,
+    int sectorWrites;			// and written
+    int cacheHits;			// sector reads/writes found in the
+					// buffer cache
+    int runs;				// runs of sectors read/written
+};
+
+// The following class defines the write buffer of one file.
+
+class WriteBuffer {
+  public:
+    WriteBuffer(FileHeader *hdr, FileIoStats *ioStats);
+					// Initialize an empty buffer in
+					// front of the file "hdr"
+					// describes, counting its runs
+					// in "ioStats"
+    ~WriteBuffer();			// Flush and de-allocate the buffer
+
+    void Write(char *from, int numBytes, int position);
+					// Write bytes of the file, which
+					// must lie within its length
+    void FlushRange(int position, int numBytes);
+					// Flush the buffer if it holds any
+					// of these bytes
+    void Flush();			// Send everything on to the cache
+
+  private:
+    FileHeader *hdr;			// where the file's sectors are
+    FileIoStats *ioStats;		// the file's counters
+    Lock *lock;				// one writer or flusher at a time
+    char *data;				// the buffered bytes
+    int base;				// file offset of data[0]; always
+					//   at a sector boundary
+    int start, end;			// the file bytes [start, end) are
+					//   in the buffer; none if equal
+
+    bool IsEmpty() { return start == end; }
+    bool Fits(int first, int last);	// can bytes [first, last) join
+					// the buffer?
+    void Drain();			// write out the whole sectors,
+					// keep a partial last one
+    void WriteOut(char *buf, int bufBase, int first, int last);
+					// write the file bytes [first,
+					// last), found in "buf" from file
+					// offset "bufBase" on
+};
+
+#endif // WRITEBUF_H
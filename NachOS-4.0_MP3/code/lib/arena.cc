@@ -0,0 +1,86 @@
+// arena.cc
+//	Routines to hand out scratch memory from an arena, and to give
+//	it all back.  See arena.h.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "arena.h"
+#include "debug.h"
+#include <string.h>
+
+//----------------------------------------------------------------------
+// Arena::Arena
+// 	Initialize an empty arena: its first requests are met from
+//	the arena object itself.
+//----------------------------------------------------------------------
+
+Arena::Arena()
+{
+    avail = (char *) initial;
+    numFree = sizeof(initial);
+    blocks = NULL;
+}
+
+//----------------------------------------------------------------------
+// Arena::~Arena
+// 	Free every block the arena took from the heap.  Whatever was
+//	allocated in the arena is gone.
+//----------------------------------------------------------------------
+
+Arena::~Arena()
+{
+    while (blocks != NULL) {
+	ArenaBlock *next = blocks->next;
+
+	delete [] (char *) blocks;
+	blocks = next;
+    }
+}
+
+//----------------------------------------------------------------------
+// Arena::Alloc
+// 	Return "size" bytes of memory, aligned like a double, which last
+//	as long as the arena does.  If the current block has no room, a
+//	new one is taken from the heap, big enough for this request and
+//	at least ArenaBlockSize; what was left of the old one is wasted.
+//----------------------------------------------------------------------
+
+void *
+Arena::Alloc(int size)
+{
+    char *result;
+
+    ASSERT(size >= 0);
+    size = divRoundUp(size, sizeof(double)) * sizeof(double);
+    if (size > numFree) {
+	int blockSize = max(size, ArenaBlockSize);
+	ArenaBlock *block = (ArenaBlock *)
+	    new char[sizeof(ArenaBlock) - sizeof(double) + blockSize];
+
+	block->next = blocks;
+	blocks = block;
+	avail = (char *) block->space;
+	numFree = blockSize;
+    }
+    result = avail;
+    avail += size;
+    numFree -= size;
+    return result;
+}
+
+//----------------------------------------------------------------------
+// Arena::CopyString
+// 	Return a copy of the string "s", allocated in the arena.
+//----------------------------------------------------------------------
+
+char *
+Arena::CopyString(char *s)
+{
+    char *copy = (char *) Alloc(strlen(s) + 1);
+
+    strcpy(copy, s);
+    return copy;
+}
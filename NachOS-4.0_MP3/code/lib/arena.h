@@ -0,0 +1,61 @@
+// arena.h
+//	Data structures for an "arena": a scratch allocator for the
+//	short-lived memory of one operation, all of which is given back
+//	at once when the arena is destroyed.
+//
+//	An arena is meant to be a local variable of the routine doing
+//	the operation.  The first ArenaSize bytes it hands out are part
+//	of the arena object itself -- on the stack, then -- so the
+//	usual small requests (the components of a path name, a list of
+//	sectors to allocate) touch neither new nor delete.  Bigger needs
+//	are met by further blocks from the heap, chained together and
+//	freed with the arena.
+//
+//	Memory from an arena is never freed piece by piece, and no
+//	destructors are run for what is in it: it is for plain data.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation 
+// of liability and disclaimer of warranty provisions.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "copyright.h"
+#include "utility.h"
+
+const int ArenaSize = 256;		// bytes in the arena itself
+const int ArenaBlockSize = 4096;	// bytes in each further block, at
+					// least
+
+// The following class defines one further block of an arena.
+
+class ArenaBlock {
+  public:
+    ArenaBlock *next;			// the block allocated before it
+    double space[1];			// the memory handed out; really as
+					// long as was asked for (a double,
+					// so it is aligned for anything)
+};
+
+// The following class defines an arena.
+
+class Arena {
+  public:
+    Arena();				// Initialize an empty arena
+    ~Arena();				// Free everything allocated in it
+
+    void *Alloc(int size);		// Return "size" bytes of scratch
+					// memory, aligned for any use
+    char *CopyString(char *s);		// Return a copy of "s" in the arena
+
+  private:
+    double initial[ArenaSize / sizeof(double)];
+					// the first ArenaSize bytes
+    char *avail;			// the next byte to hand out
+    int numFree;			// bytes left from there, in the
+					// current block
+    ArenaBlock *blocks;			// the further blocks, newest first
+};
+
+#endif // ARENA_H
@@ -27,9 +27,16 @@ Bitmap::Bitmap(int numItems)
     numBits = numItems;
     numWords = divRoundUp(numBits, BitsInWord);
     map = new unsigned int[numWords];
+    numSummaryWords = divRoundUp(numWords, BitsInWord);
+    anyClear = new unsigned int[numSummaryWords];
+    anySet = new unsigned int[numSummaryWords];
+    firstClear = 0;
+    goal = -1;
+    numClear = numBits;
     for (i = 0; i < numWords; i++) {
 	map[i] = 0;		// initialize map to keep Purify happy
     }
+    MakeSummary();
     for (i = 0; i < numBits; i++) {
         Clear(i);
     }
@@ -43,6 +50,8 @@ Bitmap::Bitmap(int numItems)
 Bitmap::~Bitmap()
 { 
     delete map;
+    delete [] anyClear;
+    delete [] anySet;
 }
 
 //----------------------------------------------------------------------
@@ -57,7 +66,11 @@ Bitmap::Mark(int which)
 { 
     ASSERT(which >= 0 && which < numBits);
 
+    if (!Test(which)) {
+	numClear--;
+    }
     map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    Summarize(which / BitsInWord);
 
     ASSERT(Test(which));
 }
@@ -74,7 +87,14 @@ Bitmap::Clear(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
+    if (Test(which)) {
+	numClear++;
+    }
     map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    Summarize(which / BitsInWord);
+    if (which < firstClear) {
+	firstClear = which;
+    }
 
     ASSERT(!Test(which));
 }
@@ -98,9 +118,156 @@ Bitmap::Test(int which) const
     }
 }
 
+//----------------------------------------------------------------------
+// Bitmap::Summarize
+// 	Set the summary bits of word "w" of the map to what is in it now.
+//
+//	"w" is the number of the word that changed.
+//----------------------------------------------------------------------
+
+void
+Bitmap::Summarize(int w)
+{
+    unsigned int bit = 1u << (w % BitsInWord);
+
+    if (map[w] != ~0u) {
+	anyClear[w / BitsInWord] |= bit;
+    } else {
+	anyClear[w / BitsInWord] &= ~bit;
+    }
+    if (map[w] != 0) {
+	anySet[w / BitsInWord] |= bit;
+    } else {
+	anySet[w / BitsInWord] &= ~bit;
+    }
+}
+
+//----------------------------------------------------------------------
+// Bitmap::MakeSummary
+// 	Work out the whole summary from the contents of "map", after it
+//	has been filled in directly.
+//----------------------------------------------------------------------
+
+void
+Bitmap::MakeSummary()
+{
+    for (int s = 0; s < numSummaryWords; s++) {
+	anyClear[s] = anySet[s] = 0;
+    }
+    for (int w = 0; w < numWords; w++) {
+	Summarize(w);
+    }
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextWord
+// 	Return the number of the first word of the map, at or after word
+//	"from", whose bit in "summary" is set; numWords if there is none.
+//	The summary is searched as NextClear searches the map.
+//
+//	"summary" is anyClear or anySet.
+//	"from" is the number of the first word to look at.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextWord(const unsigned int *summary, int from) const
+{
+    if (from >= numWords) {
+	return numWords;
+    }
+    int s = from / BitsInWord;
+    unsigned int bits = summary[s] & (~0u << (from % BitsInWord));
+
+    while (bits == 0) {
+	if (++s == numSummaryWords) {
+	    return numWords;
+	}
+	bits = summary[s];
+    }
+    return s * BitsInWord + __builtin_ctz(bits);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextClear
+// 	Return the number of the first clear bit at or after "from", or
+//	numBits if there is none.  If the word "from" is in has no clear
+//	bit after it, the summary gives the next word that has one; in
+//	that word, the compiler's count-trailing-zeros builtin picks it
+//	out.
+//
+//	The bits past numBits in the last word are always clear, so
+//	they can be found here and have to be filtered out.
+//
+//	"from" is the number of the first bit to look at.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextClear(int from) const
+{
+    if (from >= numBits) {
+	return numBits;
+    }
+    int w = from / BitsInWord;
+    unsigned int bits = ~map[w] & (~0u << (from % BitsInWord));
+
+    if (bits == 0) {
+	w = NextWord(anyClear, w + 1);
+	if (w == numWords) {
+	    return numBits;
+	}
+	bits = ~map[w];
+    }
+    return min(w * BitsInWord + __builtin_ctz(bits), numBits);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::NextSet
+// 	Return the number of the first set bit at or after "from", or
+//	numBits if there is none.  Same as NextClear, with the bits
+//	flipped and the other summary.
+//
+//	"from" is the number of the first bit to look at.
+//----------------------------------------------------------------------
+
+int
+Bitmap::NextSet(int from) const
+{
+    if (from >= numBits) {
+	return numBits;
+    }
+    int w = from / BitsInWord;
+    unsigned int bits = map[w] & (~0u << (from % BitsInWord));
+
+    if (bits == 0) {
+	w = NextWord(anySet, w + 1);
+	if (w == numWords) {
+	    return numBits;
+	}
+	bits = map[w];
+    }
+    return min(w * BitsInWord + __builtin_ctz(bits), numBits);
+}
+
+//----------------------------------------------------------------------
+// Bitmap::SetGoal
+// 	Make the searches for clear bits start from bit "which", rather
+//	than from the lowest clear bit.  Until this is called, the lowest
+//	clear bit is always the one found.
+//
+//	"which" is the number of the bit to start from.
+//----------------------------------------------------------------------
+
+void
+Bitmap::SetGoal(int which)
+{
+    ASSERT(which >= 0 && which < numBits);
+    goal = which;
+}
+
 //----------------------------------------------------------------------
 // Bitmap::FindAndSet
-// 	Return the number of the first bit which is clear.
+// 	Return the number of the first bit which is clear, at or after
+//	the goal if there is one there.
 //	As a side effect, set the bit (mark it as in use).
 //	(In other words, find and allocate a bit.)
 //
@@ -110,34 +277,197 @@ Bitmap::Test(int which) const
 int 
 Bitmap::FindAndSet() 
 {
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    Mark(i);
-	    return i;
-	}
+    int which = numBits;
+
+    if (goal > firstClear) {
+	which = NextClear(goal);
+    }
+    if (which == numBits) {
+	which = NextClear(firstClear);
+	firstClear = which;
     }
-    return -1;
+    if (which == numBits) {
+	return -1;
+    }
+    Mark(which);
+    if (which == firstClear) {
+	firstClear = which + 1;
+    }
+    if (goal >= 0) {
+	goal = (which + 1) % numBits;
+    }
+    return which;
 }
 
 //----------------------------------------------------------------------
-// Bitmap::NumClear
-// 	Return the number of clear bits in the bitmap.
-//	(In other words, how many bits are unallocated?)
+// Bitmap::NumClearIn
+// 	Return the number of clear bits from bit "from" up to, but not
+//	including, bit "to".  The set bits are counted a word (or the
+//	part of one that is in the range) at a time.
 //----------------------------------------------------------------------
 
-int 
-Bitmap::NumClear() const
+int
+Bitmap::NumClearIn(int from, int to) const
 {
-    int count = 0;
+    int count = to - from;
 
-    for (int i = 0; i < numBits; i++) {
-	if (!Test(i)) {
-	    count++;
+    ASSERT(from >= 0 && from <= to && to <= numBits);
+    for (int i = from; i < to; ) {
+	int shift = i % BitsInWord;
+	int n = min(BitsInWord - shift, to - i);
+	unsigned int bits = map[i / BitsInWord] >> shift;
+
+	if (n < BitsInWord) {
+	    bits &= (1u << n) - 1;
 	}
+	count -= __builtin_popcount(bits);
+	i += n;
     }
     return count;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::CountIsRight
+// 	Return TRUE if the number of clear bits kept as bits are set and
+//	cleared is the number a popcount of the map finds, no bit below
+//	firstClear is clear, and the summary agrees with the map.  For
+//	checking the bookkeeping, and a count taken on trust (see
+//	PersistentBitmap::FetchFrom).
+//----------------------------------------------------------------------
+
+bool
+Bitmap::CountIsRight() const
+{
+    for (int w = 0; w < numWords; w++) {
+	unsigned int bit = 1u << (w % BitsInWord);
+
+	if (((anyClear[w / BitsInWord] & bit) != 0) != (map[w] != ~0u)
+	    || ((anySet[w / BitsInWord] & bit) != 0) != (map[w] != 0)) {
+	    return FALSE;
+	}
+    }
+    return numClear == NumClearIn(0, numBits)
+	&& NextClear(0) >= firstClear;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Work out the number of clear bits and the summary, and start
+//	looking for clear bits from the beginning, after "map" has been
+//	filled in directly.
+//
+//	The bits past numBits are never set, so counting the set bits
+//	of each whole word is enough.
+//----------------------------------------------------------------------
+
+void
+Bitmap::Recount()
+{
+    numClear = numBits;
+    for (int w = 0; w < numWords; w++) {
+	numClear -= __builtin_popcount(map[w]);
+    }
+    firstClear = 0;
+    MakeSummary();
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindRun
+// 	Look for "wanted" consecutive clear bits.  Return the number of
+//	the first bit of the first such run -- after the goal if there
+//	is one there -- and set "*length" to "wanted".  If there is no
+//	run that long, return the start of the longest run of clear bits
+//	instead, with its length in "*length".
+//
+//	If no bits are clear, return -1 (and "*length" is 0).
+//	None of the bits are set; the caller marks the ones it uses.
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindRun(int wanted, int *length) const
+{
+    int start, startBefore, lengthBefore;
+
+    ASSERT(wanted > 0);
+    if (goal <= firstClear) {
+	return FindRunIn(firstClear, numBits, wanted, length);
+    }
+    start = FindRunIn(goal, numBits, wanted, length);
+    if (*length == wanted) {
+	return start;
+    }
+    startBefore = FindRunIn(firstClear, goal, wanted, &lengthBefore);
+    if (lengthBefore > *length) {
+	*length = lengthBefore;
+	return startBefore;
+    }
+    return start;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindRunIn
+// 	Same as FindRun, looking only at runs that start from bit "from"
+//	up to, but not including, bit "to" (they may go on past it).
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindRunIn(int from, int to, int wanted, int *length) const
+{
+    int bestStart = -1, bestLength = 0;
+    int start, end;
+
+    for (start = NextClear(from); start < to; start = NextClear(end)) {
+	end = NextSet(start);
+	if (end - start >= wanted) {
+	    *length = wanted;
+	    return start;
+	}
+	if (end - start > bestLength) {
+	    bestStart = start;
+	    bestLength = end - start;
+	}
+    }
+    *length = bestLength;
+    return bestStart;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetRange
+// 	Find a run of clear bits, as FindRun does, and set every bit of
+//	it.  Return the number of the first bit of the run, with its
+//	length in "*length"; -1 (and 0) if no bits are clear.  The next
+//	search starts after the run.
+//
+//	"wanted" is the length of the run we would like.
+//----------------------------------------------------------------------
+
+int
+Bitmap::FindAndSetRange(int wanted, int *length)
+{
+    int start = FindRun(wanted, length);
+
+    if (*length > 0) {
+	MarkRange(start, *length);
+    }
+    if (goal >= 0 && *length > 0) {
+	goal = (start + *length) % numBits;
+    }
+    return start;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::MarkRange
+// 	Set "length" bits from bit "from" on, all of which are clear.
+//----------------------------------------------------------------------
+
+void
+Bitmap::MarkRange(int from, int length)
+{
+    for (int i = from; i < from + length; i++) {
+	Bitmap::Mark(i);
+    }
+}
+
 //----------------------------------------------------------------------
 // Bitmap::Print
 // 	Print the contents of the bitmap, for debugging.
@@ -169,7 +499,7 @@ Bitmap::SelfTest()
 {
     int i;
     
-    ASSERT(numBits >= BitsInWord);	// bitmap must be big enough
+    ASSERT(numBits >= 2 * BitsInWord);	// bitmap must be big enough
 
     ASSERT(NumClear() == numBits);	// bitmap must be empty
     ASSERT(FindAndSet() == 0);
@@ -177,15 +507,69 @@ Bitmap::SelfTest()
     ASSERT(Test(0) && Test(31));
 
     ASSERT(FindAndSet() == 1);
+
+    int length;
+    ASSERT(FindRun(4, &length) == 2 && length == 4);
+    ASSERT(FindRun(29, &length) == 2 && length == 29);
+    ASSERT(FindRun(30, &length) == 32 && length == 30);
     Clear(0);
     Clear(1);
     Clear(31);
 
+    // a run that crosses a word boundary, then single bits
+    // after it and in a hole below the hint
+    ASSERT(FindAndSetRange(BitsInWord + 2, &length) == 0
+	   && length == BitsInWord + 2);
+    ASSERT(NumClear() == numBits - BitsInWord - 2);
+    ASSERT(CountIsRight());
+    ASSERT(NumClearIn(0, BitsInWord + 2) == 0);
+    ASSERT(NumClearIn(3, 2 * BitsInWord) == BitsInWord - 2);
+    ASSERT(FindAndSet() == BitsInWord + 2);
+    Clear(5);
+    ASSERT(FindAndSet() == 5);
+
+    // with a goal, searches start there and go on from there, then
+    // go round to the beginning
+    Clear(6);
+    SetGoal(numBits - 1);
+    ASSERT(FindAndSet() == numBits - 1);
+    ASSERT(FindAndSet() == 6);
+    ASSERT(FindRun(2, &length) == BitsInWord + 3 && length == 2);
+    Clear(numBits - 1);
+    goal = -1;
+    for (i = 0; i < BitsInWord + 3; i++) {
+        Clear(i);
+    }
+    ASSERT(NumClear() == numBits);
+
     for (i = 0; i < numBits; i++) {
         Mark(i);
     }
     ASSERT(FindAndSet() == -1);		// bitmap should be full!
+    ASSERT(CountIsRight());
     for (i = 0; i < numBits; i++) {
         Clear(i);
     }
+
+    // a map with several summary words: single bits and runs found
+    // across them, on a nearly full map and a nearly empty one
+    int bigBits = 3 * BitsInWord * BitsInWord + 5;
+    Bitmap *big = new Bitmap(bigBits);
+
+    ASSERT(big->FindAndSetRange(bigBits, &length) == 0 && length == bigBits);
+    ASSERT(big->FindAndSet() == -1 && big->CountIsRight());
+    big->Clear(bigBits - 1);
+    big->Clear(2 * BitsInWord * BitsInWord + 7);
+    ASSERT(big->FindAndSet() == 2 * BitsInWord * BitsInWord + 7);
+    ASSERT(big->FindRun(2, &length) == bigBits - 1 && length == 1);
+    ASSERT(big->FindAndSet() == bigBits - 1);
+    for (i = BitsInWord * BitsInWord - 3; i < 2 * BitsInWord * BitsInWord; i++) {
+	big->Clear(i);
+    }
+    ASSERT(big->CountIsRight());
+    ASSERT(big->FindRun(BitsInWord * BitsInWord + 3, &length)
+	   == BitsInWord * BitsInWord - 3 && length == BitsInWord * BitsInWord + 3);
+    ASSERT(big->FindRun(bigBits, &length) == BitsInWord * BitsInWord - 3
+	   && length == BitsInWord * BitsInWord + 3);
+    delete big;
 }
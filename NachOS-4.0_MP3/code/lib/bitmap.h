@@ -8,6 +8,29 @@
 //	The bitmap can be parameterized with with the number of bits being 
 //	managed.
 //
+//	Searches go a word at a time, skipping words with no bit of the
+//	kind they want, and start from a hint: no bit below "firstClear"
+//	is clear, so allocating the bits one after another does not scan
+//	the beginning of the map over and over.  The number of clear bits
+//	is kept up to date as bits are set and cleared.
+//
+//	Above the map is a summary level, with a bit for each of its
+//	words: "anyClear" says which words have a clear bit, "anySet"
+//	which have a set one (so a word with neither is entirely free).
+//	A search reads one summary word for every BitsInWord words of
+//	the map, and only the map word it stops at; on a nearly full or
+//	nearly empty map of a million bits, that is some thousand words,
+//	not thirty thousand.  The summary is kept as bits are set and
+//	cleared, one word at a time.
+//
+//	A caller that cares where its bits are can set a "goal": searches
+//	then start there, going round to the beginning if there is nothing
+//	after it, and carry on from where the last one ended.
+//
+//	Setting and clearing bits and looking for runs of them are
+//	virtual, so that a subclass can keep an index of the runs as
+//	well (see PersistentBitmap::IndexExtents).
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -34,15 +57,30 @@ class Bitmap {
   public:
     Bitmap(int numItems);	// Initialize a bitmap, with "numItems" bits
 				// initially, all bits are cleared.
-    ~Bitmap();			// De-allocate bitmap
+    virtual ~Bitmap();		// De-allocate bitmap
     
-    void Mark(int which);   	// Set the "nth" bit
-    void Clear(int which);  	// Clear the "nth" bit
+    virtual void Mark(int which); // Set the "nth" bit
+    virtual void Clear(int which); // Clear the "nth" bit
     bool Test(int which) const;	// Is the "nth" bit set?
+    void SetGoal(int which);	// Start searching from bit "which"
     int FindAndSet();         // Return the # of a clear bit, and as a side
 				// effect, set the bit. 
 				// If no bits are clear, return -1.
-    int NumClear() const;	// Return the number of clear bits
+    int FindAndSetRange(int wanted, int *length);
+				// Same as FindRun, but set the bits
+				// of the run that is returned
+    int NumClear() const { return numClear; }
+				// Return the number of clear bits
+    int NumClearIn(int from, int to) const;
+				// Same, counting only bits "from"
+				// up to (but not including) "to"
+    bool CountIsRight() const;	// Do numClear and firstClear agree
+				// with the bits themselves?
+    int FindRun(int wanted, int *length) const;
+				// Return the start of the first run of
+				// "wanted" clear bits, or failing that
+				// of the longest run; its length goes
+				// in "length".  Bits are not set.
 
     void Print() const;		// Print contents of bitmap
     void SelfTest();		// Test whether bitmap is working
@@ -54,6 +92,39 @@ class Bitmap {
 				//  multiple of the number of bits in
 				//  a word)
     unsigned int *map;		// bit storage
+    int firstClear;		// every bit below this one is set;
+    int goal;			// where searches start, if after
+				// firstClear; -1 until SetGoal
+    int numClear;		// how many bits are clear; subclasses
+				// that fill in "map" directly must
+				// reset both, and the summary (see
+				// Recount, MakeSummary)
+    int numSummaryWords;	// words in each summary, a bit per
+				// word of "map"; the bits past
+				// numWords are always clear
+    unsigned int *anyClear;	// which words of "map" have a clear bit
+    unsigned int *anySet;	// which have a set bit
+
+    void Recount();		// work out firstClear and numClear
+				// from the contents of "map", and
+				// the summary
+    void MakeSummary();		// work out only the summary
+    void Summarize(int w);	// bring the summary bits of word "w"
+				// of "map" up to date
+    int NextWord(const unsigned int *summary, int from) const;
+				// # of the first word of "map" at or
+				// after word "from" whose bit is set
+				// in "summary"; numWords if none
+
+    int NextClear(int from) const;	// # of the first clear bit at or
+				// after "from"; numBits if none
+    int NextSet(int from) const;	// same, for a set bit
+    virtual int FindRunIn(int from, int to, int wanted,
+			  int *length) const;
+				// FindRun, for runs starting in
+				// bits "from" up to "to"
+    virtual void MarkRange(int from, int length);
+				// set the bits of a run, all clear
 };
 
 #endif // BITMAP_H
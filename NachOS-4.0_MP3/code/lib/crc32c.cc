@@ -0,0 +1,180 @@
+// crc32c.cc
+//	Routines to compute CRC-32C checksums.  See crc32c.h.
+//
+//	The checksum is of the reflected polynomial 0x82F63B78, starting
+//	from all ones and inverted at the end, so that it is the same as
+//	the one the instructions compute, and the one other systems
+//	store.  The instructions take a word at a time; the bytes before
+//	the first whole word, and after the last, go one at a time.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "crc32c.h"
+#include "debug.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define CRC_INSTRUCTION_X86
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC_INSTRUCTION_ARM
+#include <arm_acle.h>
+#endif
+
+static const unsigned int Polynomial = 0x82F63B78;	// reflected
+
+// each host thread makes its own, so that machines on several of them
+// (-machines) need no lock
+static thread_local unsigned int table[256]; // the CRC of each byte value
+static thread_local bool tableMade = FALSE;
+static thread_local int hasInstruction = -1; // -1 until the host is asked
+
+//----------------------------------------------------------------------
+// MakeTable
+// 	Fill in the CRC of each byte value, a bit at a time.
+//----------------------------------------------------------------------
+
+static void
+MakeTable()
+{
+    for (unsigned int i = 0; i < 256; i++) {
+	unsigned int crc = i;
+
+	for (int bit = 0; bit < 8; bit++)
+	    crc = (crc & 1) ? (crc >> 1) ^ Polynomial : crc >> 1;
+	table[i] = crc;
+    }
+    tableMade = TRUE;
+}
+
+//----------------------------------------------------------------------
+// TableExtend
+// 	Run "length" bytes through the CRC "crc", a byte at a time.
+//----------------------------------------------------------------------
+
+static unsigned int
+TableExtend(unsigned int crc, unsigned char *p, int length)
+{
+    if (!tableMade)
+	MakeTable();
+    while (length-- > 0)
+	crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC_INSTRUCTION_X86
+//----------------------------------------------------------------------
+// HardwareExtend
+// 	Same, with the SSE4.2 instruction.  Only this function is built
+//	for SSE4.2, so the rest of the kernel still runs on a host
+//	without it; it is not called there.
+//----------------------------------------------------------------------
+
+__attribute__((target("sse4.2"))) static unsigned int
+HardwareExtend(unsigned int crc, unsigned char *p, int length)
+{
+    unsigned int word;
+
+    for (; length > 0 && ((unsigned long) p & 3) != 0; length--)
+	crc = __builtin_ia32_crc32qi(crc, *p++);
+    for (; length >= 4; length -= 4, p += 4) {
+	bcopy(p, &word, sizeof(word));
+	crc = __builtin_ia32_crc32si(crc, word);
+    }
+    while (length-- > 0)
+	crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif
+
+#ifdef CRC_INSTRUCTION_ARM
+static unsigned int
+HardwareExtend(unsigned int crc, unsigned char *p, int length)
+{
+    unsigned int word;
+
+    for (; length > 0 && ((unsigned long) p & 3) != 0; length--)
+	crc = __crc32cb(crc, *p++);
+    for (; length >= 4; length -= 4, p += 4) {
+	bcopy(p, &word, sizeof(word));
+	crc = __crc32cw(crc, word);
+    }
+    while (length-- > 0)
+	crc = __crc32cb(crc, *p++);
+    return crc;
+}
+#endif
+
+//----------------------------------------------------------------------
+// Crc32c::InHardware
+// 	Return TRUE if the host has the CRC-32C instruction, and Compute
+//	uses it.  Every ARMv8 host that was built for has it; an x86 one
+//	is asked.
+//----------------------------------------------------------------------
+
+bool
+Crc32c::InHardware()
+{
+    if (hasInstruction == -1) {
+#if defined(CRC_INSTRUCTION_X86)
+	__builtin_cpu_init();
+	hasInstruction = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+#elif defined(CRC_INSTRUCTION_ARM)
+	hasInstruction = 1;
+#else
+	hasInstruction = 0;
+#endif
+	DEBUG(dbgFile, "CRC-32C " << (hasInstruction ? "in hardware"
+					: "from a table"));
+    }
+    return hasInstruction == 1;
+}
+
+//----------------------------------------------------------------------
+// Crc32c::Compute, Crc32c::ComputeInTable
+// 	Return the CRC-32C of "length" bytes at "data": with the
+//	instruction if the host has it, or always with the table.
+//----------------------------------------------------------------------
+
+unsigned int
+Crc32c::Compute(char *data, int length)
+{
+#if defined(CRC_INSTRUCTION_X86) || defined(CRC_INSTRUCTION_ARM)
+    if (InHardware())
+	return ~HardwareExtend(~0U, (unsigned char *) data, length);
+#endif
+    return ComputeInTable(data, length);
+}
+
+unsigned int
+Crc32c::ComputeInTable(char *data, int length)
+{
+    return ~TableExtend(~0U, (unsigned char *) data, length);
+}
+
+//----------------------------------------------------------------------
+// Crc32c::SelfTest
+// 	Test whether this module is working: the checksum of the usual
+//	check string is the published one, and both ways agree on
+//	blocks of every length up to a few words, at every alignment.
+//----------------------------------------------------------------------
+
+void
+Crc32c::SelfTest()
+{
+    char check[] = "123456789";
+    char block[64];
+
+    ASSERT(ComputeInTable(check, 9) == 0xE3069283);
+    ASSERT(Compute(check, 9) == 0xE3069283);
+    ASSERT(Compute(check, 0) == 0);
+    for (int i = 0; i < (int) sizeof(block); i++)
+	block[i] = (char) (i * 37 + 11);
+    for (int start = 0; start < 4; start++) {
+	for (int length = 0; start + length <= (int) sizeof(block); length++) {
+	    ASSERT(Compute(&block[start], length)
+		   == ComputeInTable(&block[start], length));
+	}
+    }
+}
@@ -0,0 +1,39 @@
+// crc32c.h
+//	Routines to compute the CRC-32C (Castagnoli) checksum of a block
+//	of bytes, the one used by iSCSI, ext4 and btrfs to catch sectors
+//	that have changed behind the file system's back.
+//
+//	Most hosts Nachos runs on can compute it in hardware: x86 has had
+//	a "crc32" instruction since SSE4.2, and ARMv8 has "crc32cw".  The
+//	instruction is used if the host has it -- checked once, the first
+//	time a checksum is wanted, since the kernel is not built for any
+//	one CPU -- and otherwise a table of 256 entries, a byte at a time.
+//	Both give the same result; the instruction is about ten times
+//	faster, which is what makes checking every sector the file system
+//	reads cheap enough to leave on.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class groups the checksum routines; it has no state
+// of its own besides the table, which is shared.
+
+class Crc32c {
+  public:
+    static unsigned int Compute(char *data, int length);
+					// The CRC-32C of "length" bytes
+    static unsigned int ComputeInTable(char *data, int length);
+					// Same, never with the instruction
+    static bool InHardware();		// Does Compute use the instruction?
+
+    static void SelfTest();		// Test whether this module is working
+};
+
+#endif // CRC32C_H
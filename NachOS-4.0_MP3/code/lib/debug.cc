@@ -16,7 +16,8 @@
 //      Initialize so that only DEBUG messages with a flag in flagList 
 //	will be printed.
 //
-//	If the flag is "+", we enable all DEBUG messages.
+//	If the flag is "+", we enable all DEBUG messages.  The flags are
+//	looked at only here, to set their bits in "enabled".
 //
 // 	"flagList" is a string of characters for whose DEBUG messages are 
 //		to be enabled.
@@ -24,22 +25,21 @@
 
 Debug::Debug(char *flagList)
 {
-    enableFlags = flagList;
-}
-
-
-//----------------------------------------------------------------------
-// Debug::IsEnabled
-//      Return TRUE if DEBUG messages with "flag" are to be printed.
-//----------------------------------------------------------------------
+    for (int i = 0; i < NumDebugFlagWords; i++) {
+	enabled[i] = 0;
+    }
+    if (flagList == NULL) {
+	return;
+    }
+    if (strchr(flagList, dbgAll) != NULL) {
+	for (int i = 0; i < NumDebugFlagWords; i++) {
+	    enabled[i] = ~0U;
+	}
+	return;
+    }
+    for (char *p = flagList; *p != '\0'; p++) {
+	unsigned int f = (unsigned char) *p;
 
-bool
-Debug::IsEnabled(char flag)
-{
-    if (enableFlags != NULL) {
-	return ((strchr(enableFlags, flag) != 0) 
-		|| (strchr(enableFlags, '+') != 0));
-    } else {
-    	return FALSE;
+	enabled[f / 32] |= 1U << (f % 32);
     }
 }
@@ -6,6 +6,11 @@
 //	passed to Nachos (-d).  You are encouraged to add your own
 //	debugging flags.  Please.... 
 //
+//	The flags are turned into a bitmask once, at start-up, so that
+//	checking one -- which DEBUG does wherever it is used, including
+//	the simulator's inner loops -- is an inline test of one bit.
+//	Compiling with -DNO_DEBUG removes the DEBUG messages altogether.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -31,27 +36,47 @@ const char dbgNet = 'n'; 		// network emulation
 const char dbgSys = 'u';        // systemcall
 const char dbgTraCode = 'c';    // for tracing code
 
+const int NumDebugFlagWords = 256 / 32;	// one bit for each character
+
 class Debug {
   public:
     Debug(char *flagList);
 
-    bool IsEnabled(char flag);
+#ifdef NO_DEBUG
+    bool IsEnabled(char flag) { return FALSE; }
+#else
+    bool IsEnabled(char flag) {
+	unsigned int f = (unsigned char) flag;
+	return (enabled[f / 32] & (1U << (f % 32))) != 0; }
+#endif
+				// Are "flag" messages to be printed?
 
   private:
-    char *enableFlags;		// controls which DEBUG messages are printed
+    unsigned int enabled[NumDebugFlagWords];
+				// controls which DEBUG messages are printed
 };
 
-extern Debug *debug;
+extern thread_local Debug *debug;
 
 
 //----------------------------------------------------------------------
 // DEBUG
 //      If flag is enabled, print a message.
+//
+//	With NO_DEBUG, the message is still compiled -- so that it stays
+//	correct -- but can never be printed, and so generates no code.
 //----------------------------------------------------------------------
+#ifdef NO_DEBUG
+#define DEBUG(flag,expr)                                                     \
+    if (TRUE) {} else { 						\
+        cerr << expr << "\n";   				        \
+    }
+#else
 #define DEBUG(flag,expr)                                                     \
     if (!debug->IsEnabled(flag)) {} else { 				\
         cerr << expr << "\n";   				        \
     }
+#endif
 
 
 //----------------------------------------------------------------------
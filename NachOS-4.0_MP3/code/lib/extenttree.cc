@@ -0,0 +1,298 @@
+// extenttree.cc
+//	Routines to manage a set of extents, kept in a treap ordered by
+//	start and augmented with the longest extent of every subtree.
+//
+//	Insert and Remove are built out of Split, which cuts a tree in
+//	two at a key, and Join, which puts two such trees back together
+//	in order of priority; both go down a single path.  The searches
+//	prune any subtree whose maxLength shows it cannot hold what they
+//	are looking for.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "extenttree.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// ExtentTree::ExtentTree, ExtentTree::~ExtentTree
+// 	Make an empty set of extents, and de-allocate one.
+//----------------------------------------------------------------------
+
+ExtentTree::ExtentTree()
+{
+    root = NULL;
+    numExtents = 0;
+}
+
+ExtentTree::~ExtentTree()
+{
+    DeleteAll(root);
+}
+
+void
+ExtentTree::DeleteAll(ExtentNode *node)
+{
+    if (node != NULL) {
+	DeleteAll(node->left);
+	DeleteAll(node->right);
+	delete node;
+    }
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Update
+// 	Work out the longest extent under "node" from its children.
+//----------------------------------------------------------------------
+
+void
+ExtentTree::Update(ExtentNode *node)
+{
+    node->maxLength = node->length;
+    if (node->left != NULL && node->left->maxLength > node->maxLength) {
+	node->maxLength = node->left->maxLength;
+    }
+    if (node->right != NULL && node->right->maxLength > node->maxLength) {
+	node->maxLength = node->right->maxLength;
+    }
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Split
+// 	Cut the tree under "node" into the extents starting before "key",
+//	returned in "*less", and the rest, in "*rest".
+//----------------------------------------------------------------------
+
+void
+ExtentTree::Split(ExtentNode *node, int key, ExtentNode **less,
+		  ExtentNode **rest)
+{
+    if (node == NULL) {
+	*less = *rest = NULL;
+    } else if (node->start < key) {
+	Split(node->right, key, &node->right, rest);
+	Update(node);
+	*less = node;
+    } else {
+	Split(node->left, key, less, &node->left);
+	Update(node);
+	*rest = node;
+    }
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Join
+// 	Put two trees back together, every extent of "less" starting
+//	before those of "rest".  The root is whichever root has the
+//	higher priority.
+//----------------------------------------------------------------------
+
+ExtentNode *
+ExtentTree::Join(ExtentNode *less, ExtentNode *rest)
+{
+    if (less == NULL) {
+	return rest;
+    }
+    if (rest == NULL) {
+	return less;
+    }
+    if (less->priority > rest->priority) {
+	less->right = Join(less->right, rest);
+	Update(less);
+	return less;
+    }
+    rest->left = Join(less, rest->left);
+    Update(rest);
+    return rest;
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Insert
+// 	Add the extent of "length" numbers from "start", which must not
+//	overlap any extent already in the tree.
+//----------------------------------------------------------------------
+
+void
+ExtentTree::Insert(int start, int length)
+{
+    ExtentNode *node = new ExtentNode;
+    ExtentNode *less, *rest;
+
+    ASSERT(length > 0);
+    node->start = start;
+    node->length = node->maxLength = length;
+    node->priority = (unsigned) start * 2654435761U;
+    node->left = node->right = NULL;
+    Split(root, start, &less, &rest);
+    root = Join(Join(less, node), rest);
+    numExtents++;
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Remove
+// 	Take the extent starting at "start" out of the tree; there must
+//	be one.
+//----------------------------------------------------------------------
+
+void
+ExtentTree::Remove(int start)
+{
+    ExtentNode *less, *middle, *rest;
+
+    Split(root, start, &less, &rest);
+    Split(rest, start + 1, &middle, &rest);
+    ASSERT(middle != NULL && middle->start == start
+	   && middle->left == NULL && middle->right == NULL);
+    delete middle;
+    root = Join(less, rest);
+    numExtents--;
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Floor
+// 	Find the last extent that starts at or before "which", and return
+//	it in "*start" and "*length".  Return FALSE if there is none.
+//----------------------------------------------------------------------
+
+bool
+ExtentTree::Floor(int which, int *start, int *length) const
+{
+    ExtentNode *found = NULL;
+
+    for (ExtentNode *node = root; node != NULL; ) {
+	if (node->start <= which) {
+	    found = node;
+	    node = node->right;
+	} else {
+	    node = node->left;
+	}
+    }
+    if (found == NULL) {
+	return FALSE;
+    }
+    *start = found->start;
+    *length = found->length;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FirstFitIn, LongestIn
+// 	The searches of FirstFit and Longest, under "node".
+//----------------------------------------------------------------------
+
+static ExtentNode *
+FirstFitIn(ExtentNode *node, int from, int wanted)
+{
+    if (node == NULL || node->maxLength < wanted) {
+	return NULL;
+    }
+    if (node->start >= from) {
+	ExtentNode *found = FirstFitIn(node->left, from, wanted);
+
+	if (found != NULL) {
+	    return found;
+	}
+	if (node->length >= wanted) {
+	    return node;
+	}
+    }
+    return FirstFitIn(node->right, from, wanted);
+}
+
+static void
+LongestIn(ExtentNode *node, int from, int to, ExtentNode **best)
+{
+    if (node == NULL
+	|| (*best != NULL && node->maxLength <= (*best)->length)) {
+	return;
+    }
+    if (node->start >= from) {
+	LongestIn(node->left, from, to, best);
+	if (node->start < to
+	    && (*best == NULL || node->length > (*best)->length)) {
+	    *best = node;
+	}
+    }
+    if (node->start < to) {
+	LongestIn(node->right, from, to, best);
+    }
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::FirstFit
+// 	Find the first extent that starts at or after "from" and has at
+//	least "wanted" numbers in it, and return it in "*start" and
+//	"*length".  Return FALSE if there is none.
+//----------------------------------------------------------------------
+
+bool
+ExtentTree::FirstFit(int from, int wanted, int *start, int *length) const
+{
+    ExtentNode *found = FirstFitIn(root, from, wanted);
+
+    if (found == NULL) {
+	return FALSE;
+    }
+    *start = found->start;
+    *length = found->length;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::Longest
+// 	Find the longest extent starting from "from" up to, but not
+//	including, "to" -- the first of them, if several are as long --
+//	and return it in "*start" and "*length".  Return FALSE if no
+//	extent starts there.
+//----------------------------------------------------------------------
+
+bool
+ExtentTree::Longest(int from, int to, int *start, int *length) const
+{
+    ExtentNode *best = NULL;
+
+    LongestIn(root, from, to, &best);
+    if (best == NULL) {
+	return FALSE;
+    }
+    *start = best->start;
+    *length = best->length;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ExtentTree::SelfTest
+// 	Test whether this module is working.
+//----------------------------------------------------------------------
+
+void
+ExtentTree::SelfTest()
+{
+    int start, length;
+
+    ASSERT(NumExtents() == 0 && !Floor(100, &start, &length));
+    for (int i = 0; i < 100; i++) {	// extents of 1, 2, 3 ... at 10 * i
+	Insert(10 * i, i % 9 + 1);
+    }
+    ASSERT(NumExtents() == 100 && LongestLength() == 9);
+
+    ASSERT(Floor(255, &start, &length) && start == 250 && length == 8);
+    ASSERT(Floor(250, &start, &length) && start == 250);
+    ASSERT(FirstFit(0, 5, &start, &length) && start == 40 && length == 5);
+    ASSERT(FirstFit(41, 9, &start, &length) && start == 80);
+    ASSERT(FirstFit(981, 9, &start, &length) == FALSE);
+    ASSERT(Longest(100, 170, &start, &length) && start == 160 && length == 8);
+    ASSERT(Longest(0, 1000, &start, &length) && start == 80 && length == 9);
+
+    Remove(80);
+    ASSERT(FirstFit(41, 9, &start, &length) && start == 170);
+    ASSERT(Longest(0, 170, &start, &length) && start == 70 && length == 8);
+    for (int i = 0; i < 100; i++) {
+	if (i != 8) {
+	    Remove(10 * i);
+	}
+    }
+    ASSERT(NumExtents() == 0 && LongestLength() == 0);
+}
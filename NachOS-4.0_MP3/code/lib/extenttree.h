@@ -0,0 +1,84 @@
+// extenttree.h
+//	Data structures for a set of extents -- runs of consecutive
+//	numbers, such as free disk sectors -- that can be searched by
+//	where they start and by how long they are.
+//
+//	The extents are kept in a balanced binary search tree ordered by
+//	where they start.  Each node also records the length of the
+//	longest extent under it, so the first extent after a given point
+//	that is at least some length long can be found by going down one
+//	path of the tree, skipping every subtree whose extents are all
+//	too short.  So finding room, adding an extent and taking one out
+//	each take time proportional to the depth of the tree, that is
+//	O(log n) in the number of extents.
+//
+//	The tree is a "treap": besides being in order of start, each
+//	node has a priority no higher than its parent's.  The priorities
+//	are a hash of the start, which keeps the tree about as balanced
+//	as a random one, but does the same thing on every run.
+//
+//	The extents should not overlap; the caller merges and splits
+//	them as needed.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef EXTENTTREE_H
+#define EXTENTTREE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines a node of the tree: one extent.
+
+class ExtentNode {
+  public:
+    int start;			// first number in the extent
+    int length;			// how many there are
+    int maxLength;		// longest extent in this subtree
+    unsigned priority;		// no higher than the parent's
+    ExtentNode *left;		// extents that start before this one
+    ExtentNode *right;		// and after it
+};
+
+// The following class defines the set of extents.
+
+class ExtentTree {
+  public:
+    ExtentTree();		// Initially empty
+    ~ExtentTree();		// De-allocate the nodes
+
+    void Insert(int start, int length); // Add an extent
+    void Remove(int start);	// Take out the extent starting at "start"
+    bool Floor(int which, int *start, int *length) const;
+				// The last extent starting at or before
+				// "which"; FALSE if there is none
+    bool FirstFit(int from, int wanted, int *start, int *length) const;
+				// The first extent starting at or after
+				// "from" with at least "wanted" numbers
+    bool Longest(int from, int to, int *start, int *length) const;
+				// The longest extent (the first of
+				// them) starting from "from" up to, but
+				// not including, "to"
+    int NumExtents() const { return numExtents; }
+    int LongestLength() const { return root ? root->maxLength : 0; }
+
+    void SelfTest();		// Test whether this module is working
+
+  private:
+    ExtentNode *root;
+    int numExtents;
+
+    static void Update(ExtentNode *node); // recompute maxLength
+    static void Split(ExtentNode *node, int key, ExtentNode **less,
+		      ExtentNode **rest);
+				// cut into nodes starting before "key",
+				// and the others
+    static ExtentNode *Join(ExtentNode *less, ExtentNode *rest);
+				// the reverse, every start in "less"
+				// being below those in "rest"
+    static void DeleteAll(ExtentNode *node);
+};
+
+#endif // EXTENTTREE_H
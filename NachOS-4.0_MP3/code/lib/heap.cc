@@ -0,0 +1,298 @@
+// heap.cc
+//     	Routines to manage a pairing heap of arbitrary things.  See
+//	heap.h.
+//
+//	Melding the children of a removed root is done with a loop, not
+//	by recursion: the root can have a child for every item that was
+//	put in since the last removal.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::PairingHeap
+//	Initialize a heap, empty to start with.
+//
+//	"comp" is the function comparing two items: -1 if the first
+//	comes out first, 1 if the second does, 0 if they are equal
+//----------------------------------------------------------------------
+
+template <class T>
+PairingHeap<T>::PairingHeap(int (*comp)(T x, T y))
+{
+    root = NULL;
+    numInHeap = 0;
+    numOrdered = 0;
+    spare = NULL;
+    compare = comp;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::~PairingHeap
+//	Prepare a heap for deallocation.  If the heap still contains any
+//	items, they are not de-allocated -- only the elements holding them.
+//----------------------------------------------------------------------
+
+template <class T>
+PairingHeap<T>::~PairingHeap()
+{
+    DeleteTree(root);
+    while (spare != NULL) {
+	HeapElement<T> *element = spare;
+
+	spare = element->sibling;
+	delete element;
+    }
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::DeleteTree
+//	De-allocate "top", its siblings, and all of their descendants.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+PairingHeap<T>::DeleteTree(HeapElement<T> *top)
+{
+    while (top != NULL) {
+	HeapElement<T> *next = top->sibling;
+
+	DeleteTree(top->child);
+	delete top;
+	top = next;
+    }
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::Before
+//	Return TRUE if the item of "x" comes out of the heap before the
+//	item of "y": it is smaller or, if they are equal, it went in
+//	first.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+PairingHeap<T>::Before(HeapElement<T> *x, HeapElement<T> *y) const
+{
+    int result = compare(x->item, y->item);
+
+    return result < 0 || (result == 0 && x->order < y->order);
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::Meld
+//	Make one tree of the trees "x" and "y" (either may be NULL), and
+//	return its root: the root of the other becomes the first child of
+//	the one that comes out first.  Neither may have siblings.
+//----------------------------------------------------------------------
+
+template <class T>
+HeapElement<T> *
+PairingHeap<T>::Meld(HeapElement<T> *x, HeapElement<T> *y) const
+{
+    if (x == NULL) {
+	return y;
+    }
+    if (y == NULL) {
+	return x;
+    }
+    ASSERT(x->sibling == NULL && y->sibling == NULL);
+    if (Before(y, x)) {
+	HeapElement<T> *t = x;
+
+	x = y;
+	y = t;
+    }
+    y->sibling = x->child;
+    x->child = y;
+    return x;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::MeldPairs
+//	Make one tree of "first" and the siblings after it, and return
+//	its root.  The first pass melds them in pairs, left to right,
+//	and chains the pairs up in the opposite order; the second melds
+//	that chain into one tree, so the pairs are taken right to left.
+//----------------------------------------------------------------------
+
+template <class T>
+HeapElement<T> *
+PairingHeap<T>::MeldPairs(HeapElement<T> *first) const
+{
+    HeapElement<T> *pairs = NULL;	// melded pairs, the last first
+    HeapElement<T> *x, *y, *result;
+
+    while (first != NULL) {
+	x = first;
+	y = x->sibling;
+	first = (y == NULL) ? NULL : y->sibling;
+	x->sibling = NULL;
+	if (y != NULL) {
+	    y->sibling = NULL;
+	}
+	x = Meld(x, y);
+	x->sibling = pairs;
+	pairs = x;
+    }
+    result = NULL;
+    while (pairs != NULL) {
+	x = pairs;
+	pairs = x->sibling;
+	x->sibling = NULL;
+	result = Meld(result, x);
+    }
+    return result;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::Insert
+//	Put an item in the heap, as a tree of its own melded with the
+//	rest.  The element to hold it is a spare one if there is one.
+//
+//	"item" is the thing to put in the heap
+//----------------------------------------------------------------------
+
+template <class T>
+void
+PairingHeap<T>::Insert(T item)
+{
+    HeapElement<T> *element;
+
+    if (spare != NULL) {
+	element = spare;
+	spare = element->sibling;
+    } else {
+	element = new HeapElement<T>;
+    }
+    element->item = item;
+    element->order = numOrdered++;
+    element->child = NULL;
+    element->sibling = NULL;
+    root = Meld(root, element);
+    numInHeap++;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::Front
+//	Return the smallest item in the heap, without removing it.
+//	The heap must not be empty.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+PairingHeap<T>::Front() const
+{
+    ASSERT(!IsEmpty());
+    return root->item;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::RemoveFront
+//	Take the smallest item out of the heap, and return it; its
+//	children are melded into the new heap.  The heap must not be
+//	empty.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+PairingHeap<T>::RemoveFront()
+{
+    HeapElement<T> *element = root;
+    T item;
+
+    ASSERT(!IsEmpty());
+    item = element->item;
+    root = MeldPairs(element->child);
+    numInHeap--;
+    element->sibling = spare;
+    spare = element;
+    return item;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::CheckTree
+//	Check that no item in the trees of "top" and its siblings comes
+//	out before its parent, and return how many items they have.
+//----------------------------------------------------------------------
+
+template <class T>
+int
+PairingHeap<T>::CheckTree(HeapElement<T> *top) const
+{
+    int count = 0;
+
+    for (; top != NULL; top = top->sibling) {
+	for (HeapElement<T> *c = top->child; c != NULL; c = c->sibling) {
+	    ASSERT(!Before(c, top));
+	}
+	count += 1 + CheckTree(top->child);
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::SanityCheck
+//	Test whether this is still a legal heap.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+PairingHeap<T>::SanityCheck() const
+{
+    ASSERT((root == NULL) == (numInHeap == 0));
+    if (root != NULL) {
+	ASSERT(root->sibling == NULL);
+    }
+    ASSERT(CheckTree(root) == numInHeap);
+}
+
+//----------------------------------------------------------------------
+// PairingHeap<T>::SelfTest
+//	Test whether this module is working: everything put in comes
+//	out, smallest first, also when items are put in between
+//	removals.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+PairingHeap<T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+    T *q = new T[numEntries];
+
+    ASSERT(IsEmpty());
+    for (i = 0; i < numEntries; i++) {
+	Insert(p[i]);
+	ASSERT(NumInHeap() == i + 1);
+    }
+    SanityCheck();
+
+    // take half out, and put them back in; that melds pairs of a
+    // root with many children
+    for (i = 0; i < numEntries / 2; i++) {
+	q[i] = RemoveFront();
+	SanityCheck();
+    }
+    for (i = 0; i < numEntries / 2; i++) {
+	Insert(q[i]);
+    }
+    SanityCheck();
+
+    // should be able to get out everything we put in, in order
+    for (i = 0; i < numEntries; i++) {
+	q[i] = RemoveFront();
+    }
+    ASSERT(IsEmpty());
+    for (i = 0; i < (numEntries - 1); i++) {
+	ASSERT(compare(q[i], q[i + 1]) <= 0);
+    }
+    SanityCheck();
+
+    delete [] q;
+}
@@ -0,0 +1,93 @@
+// heap.h
+//	Data structures to manage a "pairing heap" -- a priority queue
+//	with the same use as a SortedList (see list.h), minus the walk:
+//	"RemoveFront" always returns the smallest item, but putting an
+//	item in takes constant time, and taking the smallest out takes
+//	logarithmic time (amortized), however many items there are.
+//
+//	The heap is a tree, the smallest item at the root, and each item
+//	no smaller than its parent.  An item goes in as a tree of its
+//	own, "melded" with the root: the bigger of two roots becomes the
+//	first child of the other.  When the root is taken out, its
+//	children are melded in pairs, left to right, and then the pairs
+//	are melded right to left into one tree.
+//
+//	Of two items that compare equal, the one put in first comes out
+//	first, as on a SortedList, so a SortedList can be replaced by a
+//	heap without changing the order things come out in.
+//
+//	As for a SortedList, the items must have a "Compare" function,
+//	and allocation and deallocation of the items are to be done by
+//	the caller.  The elements of the heap itself are kept for re-use
+//	once their item is removed, so a heap that grows and shrinks by a
+//	few items does not call new.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "copyright.h"
+#include "debug.h"
+
+// The following class defines one element of a pairing heap.  It is
+// private to this module; made public for notational convenience.
+
+template <class T>
+class HeapElement {
+  public:
+    T item;			// item in the heap
+    int order;			// when it was put in, to break ties
+    HeapElement *child;		// first child, NULL if none
+    HeapElement *sibling;	// next child of the same parent; the
+				// next spare element, for a spare one
+};
+
+// The following class defines a pairing heap.
+
+template <class T>
+class PairingHeap {
+  public:
+    PairingHeap(int (*comp)(T x, T y));
+				// initialize an empty heap, ordered by
+				// "comp" (-1, 0 or 1, as for SortedList)
+    ~PairingHeap();		// de-allocate the heap; its items are not
+
+    void Insert(T item);	// put an item in the heap
+    T RemoveFront();		// take the smallest item out
+    T Front() const;		// return the smallest item, leaving it in
+
+    bool IsEmpty() const { return numInHeap == 0; }
+    int NumInHeap() const { return numInHeap; }
+
+    void SanityCheck() const;	// has this heap been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    HeapElement<T> *root;	// the smallest item; NULL if empty
+    int numInHeap;		// how many items are in the heap
+    int numOrdered;		// items put in so far
+    HeapElement<T> *spare;	// elements to re-use, chained through
+				// "sibling"
+    int (*compare)(T x, T y);	// function for ordering the items
+
+    bool Before(HeapElement<T> *x, HeapElement<T> *y) const;
+				// does "x" come out before "y"?
+    HeapElement<T> *Meld(HeapElement<T> *x, HeapElement<T> *y) const;
+				// make one tree of two
+    HeapElement<T> *MeldPairs(HeapElement<T> *first) const;
+				// make one tree of a list of siblings
+    int CheckTree(HeapElement<T> *top) const;
+				// check "top" and its descendants;
+				// return how many there are
+    void DeleteTree(HeapElement<T> *top);
+				// de-allocate them
+};
+
+#include "heap.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // HEAP_H
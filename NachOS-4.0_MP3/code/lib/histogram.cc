@@ -0,0 +1,113 @@
+// histogram.cc
+//	Routines to keep a histogram in power of two buckets.  See
+//	histogram.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "histogram.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// LogHistogram::LogHistogram
+// 	Initialize a histogram with no values in it.
+//----------------------------------------------------------------------
+
+LogHistogram::LogHistogram()
+{
+    for (int b = 0; b < HistogramBuckets; b++)
+	buckets[b] = 0;
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+//----------------------------------------------------------------------
+// LogHistogram::Add
+// 	Count "value", which must not be negative, in the bucket of its
+//	highest bit.
+//----------------------------------------------------------------------
+
+void
+LogHistogram::Add(int value)
+{
+    int b = 0;
+
+    ASSERT(value >= 0);
+    for (unsigned int v = value; v != 0; v >>= 1)
+	b++;
+    buckets[b]++;
+    count++;
+    sum += value;
+    if (value > max)
+	max = value;
+}
+
+//----------------------------------------------------------------------
+// LogHistogram::Percentile
+// 	Return an upper bound on the value that "percent" of the values
+//	counted are at or below: the top of the first bucket by which
+//	that many have been counted, or the largest value, if that is
+//	less.  0 if there are none.
+//----------------------------------------------------------------------
+
+int
+LogHistogram::Percentile(int percent)
+{
+    int wanted = divRoundUp(count * (long long) percent, 100);
+    int seen = 0;
+
+    if (count == 0)
+	return 0;
+    for (int b = 0; b < HistogramBuckets; b++) {
+	seen += buckets[b];
+	if (seen >= wanted && seen > 0) {
+	    int top = (b == 0) ? 0 : (int) ((1u << b) - 1);
+
+	    return min(top, max);
+	}
+    }
+    return max;
+}
+
+//----------------------------------------------------------------------
+// LogHistogram::Print
+// 	Print how many values there were, their mean, median, 99th
+//	percentile and largest, on the rest of a line.
+//----------------------------------------------------------------------
+
+void
+LogHistogram::Print()
+{
+    cout << "n " << count << ", mean " << (int) Mean();
+    cout << ", p50 " << Percentile(50) << ", p99 " << Percentile(99);
+    cout << ", max " << max << "\n";
+}
+
+//----------------------------------------------------------------------
+// LogHistogram::Format
+// 	Put the histogram in "buffer", which has room for "size"
+//	characters, as a JSON object: the summary Print gives, and the
+//	count in each bucket, up to the last one used.
+//----------------------------------------------------------------------
+
+void
+LogHistogram::Format(char *buffer, int size)
+{
+    int used = snprintf(buffer, size, "{\"count\": %d, \"mean\": %.1f, "
+			"\"p50\": %d, \"p99\": %d, \"max\": %d, \"buckets\": [",
+			count, Mean(), Percentile(50), Percentile(99), max);
+    int last = 0;
+
+    for (int b = 0; b < HistogramBuckets; b++) {
+	if (buckets[b] > 0)
+	    last = b;
+    }
+    for (int b = 0; b <= last && used < size; b++)
+	used += snprintf(buffer + used, size - used, "%s%d",
+			 (b == 0) ? "" : ", ", buckets[b]);
+    if (used < size)
+	snprintf(buffer + used, size - used, "]}");
+}
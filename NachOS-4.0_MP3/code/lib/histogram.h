@@ -0,0 +1,48 @@
+// histogram.h
+//	Data structures for a histogram of times (or any values that are
+//	not negative), kept in buckets that grow by powers of two, so that
+//	the occasional slow case is seen next to the many quick ones
+//	without keeping every value.
+//
+//	Bucket 0 holds the zeroes, and bucket "b" the values from 2^(b-1)
+//	to 2^b - 1.  A percentile is reported as the top of the bucket it
+//	falls in (but never above the largest value seen), so it is an
+//	upper bound, good to a factor of two.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include "copyright.h"
+#include "utility.h"
+
+const int HistogramBuckets = 32;	// enough for any int
+
+// The following class defines one histogram.
+
+class LogHistogram {
+  public:
+    LogHistogram();			// Start with no values
+
+    void Add(int value);		// Count one value
+    int Count() { return count; }	// how many were counted
+    int Max() { return max; }		// the largest, 0 if none
+    double Mean() { return (count > 0) ? (double) sum / count : 0; }
+    int Percentile(int percent);	// the value "percent" of them are
+					// at or below, rounded up
+
+    void Print();			// Print a summary on one line
+    void Format(char *buffer, int size);
+					// Put it in "buffer" as a JSON object
+
+  private:
+    int buckets[HistogramBuckets];	// how many values fell in each
+    int count;
+    long long sum;
+    int max;
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,265 @@
+// intervaltree.cc
+//	Routines to manage a set of intervals, kept in a treap ordered by
+//	start and augmented with the furthest end of every subtree.
+//
+//	As in extenttree.cc, Insert is built out of Split and Join.  Since
+//	several intervals may start at the same place, a new one goes
+//	after those already there, and Remove finds its node by pointer,
+//	going down from the root by start, and trying both sides where
+//	the starts are equal.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "intervaltree.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// IntervalTree::IntervalTree, IntervalTree::~IntervalTree
+// 	Make an empty set of intervals, and de-allocate one.
+//----------------------------------------------------------------------
+
+IntervalTree::IntervalTree()
+{
+    root = NULL;
+    numIntervals = 0;
+    numInserted = 0;
+}
+
+IntervalTree::~IntervalTree()
+{
+    DeleteAll(root);
+}
+
+void
+IntervalTree::DeleteAll(IntervalNode *node)
+{
+    if (node != NULL) {
+	DeleteAll(node->left);
+	DeleteAll(node->right);
+	delete node;
+    }
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::Update
+// 	Work out the furthest end under "node" from its children.
+//----------------------------------------------------------------------
+
+void
+IntervalTree::Update(IntervalNode *node)
+{
+    node->maxEnd = node->end;
+    if (node->left != NULL && node->left->maxEnd > node->maxEnd) {
+	node->maxEnd = node->left->maxEnd;
+    }
+    if (node->right != NULL && node->right->maxEnd > node->maxEnd) {
+	node->maxEnd = node->right->maxEnd;
+    }
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::Split
+// 	Cut the tree under "node" into the intervals starting before
+//	"key" -- or at it too, if "equalGoesLeft" -- returned in "*less",
+//	and the rest, in "*rest".
+//----------------------------------------------------------------------
+
+void
+IntervalTree::Split(IntervalNode *node, int key, bool equalGoesLeft,
+		    IntervalNode **less, IntervalNode **rest)
+{
+    if (node == NULL) {
+	*less = *rest = NULL;
+    } else if (node->start < key || (equalGoesLeft && node->start == key)) {
+	Split(node->right, key, equalGoesLeft, &node->right, rest);
+	Update(node);
+	*less = node;
+    } else {
+	Split(node->left, key, equalGoesLeft, less, &node->left);
+	Update(node);
+	*rest = node;
+    }
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::Join
+// 	Put two trees back together, every interval of "less" coming
+//	before those of "rest".  The root is whichever root has the
+//	higher priority.
+//----------------------------------------------------------------------
+
+IntervalNode *
+IntervalTree::Join(IntervalNode *less, IntervalNode *rest)
+{
+    if (less == NULL) {
+	return rest;
+    }
+    if (rest == NULL) {
+	return less;
+    }
+    if (less->priority > rest->priority) {
+	less->right = Join(less->right, rest);
+	Update(less);
+	return less;
+    }
+    rest->left = Join(less, rest->left);
+    Update(rest);
+    return rest;
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::Insert
+// 	Add the interval [start, end), with its "owner" and "tag", after
+//	any that start at the same place, and return its node, for
+//	Remove.  The priorities are a hash of how many intervals were
+//	added before, so they do not depend on where the intervals are.
+//----------------------------------------------------------------------
+
+IntervalNode *
+IntervalTree::Insert(int start, int end, void *owner, int tag)
+{
+    IntervalNode *node = new IntervalNode;
+    IntervalNode *less, *rest;
+
+    ASSERT(start < end);
+    node->start = start;
+    node->end = node->maxEnd = end;
+    node->owner = owner;
+    node->tag = tag;
+    node->priority = ++numInserted * 2654435761U;
+    node->left = node->right = NULL;
+    Split(root, start, TRUE, &less, &rest);
+    root = Join(Join(less, node), rest);
+    numIntervals++;
+    return node;
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::Unlink
+// 	Return the tree under "tree" with "node" taken out, its children
+//	joined in its place, and set "*found" if it was there.  Where the
+//	starts are equal, the node may be on either side.
+//----------------------------------------------------------------------
+
+IntervalNode *
+IntervalTree::Unlink(IntervalNode *tree, IntervalNode *node, bool *found)
+{
+    if (tree == NULL) {
+	return NULL;
+    }
+    if (tree == node) {
+	*found = TRUE;
+	return Join(node->left, node->right);
+    }
+    if (node->start <= tree->start) {
+	tree->left = Unlink(tree->left, node, found);
+    }
+    if (!*found && node->start >= tree->start) {
+	tree->right = Unlink(tree->right, node, found);
+    }
+    Update(tree);
+    return tree;
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::Remove
+// 	Take the interval of "node" out of the tree, and free the node.
+//----------------------------------------------------------------------
+
+void
+IntervalTree::Remove(IntervalNode *node)
+{
+    bool found = FALSE;
+
+    root = Unlink(root, node, &found);
+    ASSERT(found);
+    numIntervals--;
+    delete node;
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::FindOverlap
+// 	Return the first interval, in order of start, that overlaps
+//	[start, end) and passes "test" -- called with it and "arg" -- or
+//	NULL if there is none.  With no "test", any overlapping interval
+//	will do.
+//----------------------------------------------------------------------
+
+IntervalNode *
+IntervalTree::FindOverlap(int start, int end, IntervalTest test,
+			  void *arg) const
+{
+    return Find(root, start, end, test, arg);
+}
+
+IntervalNode *
+IntervalTree::Find(IntervalNode *node, int start, int end,
+		   IntervalTest test, void *arg)
+{
+    IntervalNode *found;
+
+    if (node == NULL || node->maxEnd <= start) {
+	return NULL;			// everything here ends too soon
+    }
+    found = Find(node->left, start, end, test, arg);
+    if (found != NULL) {
+	return found;
+    }
+    if (node->start >= end) {
+	return NULL;			// and everything after starts too late
+    }
+    if (node->end > start && (test == NULL || (*test)(node, arg))) {
+	return node;
+    }
+    return Find(node->right, start, end, test, arg);
+}
+
+//----------------------------------------------------------------------
+// IntervalTree::SelfTest
+// 	Test whether this module is working.
+//----------------------------------------------------------------------
+
+static bool
+TagIsOdd(IntervalNode *node, void *arg)
+{
+    return node->tag % 2 == 1;
+}
+
+void
+IntervalTree::SelfTest()
+{
+    IntervalNode *nodes[100];
+    IntervalNode *found;
+
+    ASSERT(NumIntervals() == 0 && FindOverlap(0, 1000, NULL, NULL) == NULL);
+    for (int i = 0; i < 100; i++) {	// [10 * (i / 2), + 5 or 25)
+	nodes[i] = Insert(10 * (i / 2), 10 * (i / 2) + (i % 2 ? 25 : 5),
+			  NULL, i);
+    }
+    ASSERT(NumIntervals() == 100);
+
+    found = FindOverlap(5, 10, NULL, NULL);	// only the long one at 0
+    ASSERT(found != NULL && found->tag == 1);
+    found = FindOverlap(103, 104, NULL, NULL);
+    ASSERT(found != NULL && found->tag == 17);	// [80, 105)
+    found = FindOverlap(100, 101, TagIsOdd, NULL);
+    ASSERT(found != NULL && found->tag == 17);
+    found = FindOverlap(495, 2000, NULL, NULL);	// [480, 505)
+    ASSERT(found != NULL && found->tag == 97);
+    ASSERT(FindOverlap(515, 2000, NULL, NULL) == NULL);
+
+    Remove(nodes[17]);
+    Remove(nodes[19]);
+    found = FindOverlap(103, 104, NULL, NULL);
+    ASSERT(found != NULL && found->tag == 20);	// [100, 105), added
+						// before [100, 125)
+    for (int i = 0; i < 100; i++) {
+	if (i != 17 && i != 19) {
+	    Remove(nodes[i]);
+	}
+    }
+    ASSERT(NumIntervals() == 0 && root == NULL);
+}
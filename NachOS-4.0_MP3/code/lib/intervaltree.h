@@ -0,0 +1,88 @@
+// intervaltree.h
+//	Data structures for a set of intervals -- ranges [start, end) of
+//	numbers, such as the bytes of a file -- that may overlap, and
+//	that can be searched for the ones overlapping a given range.
+//
+//	The intervals are kept in a balanced binary search tree ordered by
+//	where they start, a treap, as in extenttree.h.  Each node also
+//	records the furthest end of any interval under it, so a search
+//	for an interval overlapping [start, end) skips every subtree that
+//	ends at or before "start", and every right subtree once the
+//	intervals start at or after "end".  So adding and taking out an
+//	interval take time proportional to the depth of the tree, that is
+//	O(log n), and so does finding an overlapping one, if most of those
+//	overlapping are what the caller wants.
+//
+//	Each interval carries an "owner" and a "tag" for the caller; the
+//	tree does not look at them, except through the test that a search
+//	is given (see FindOverlap).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines a node of the tree: one interval.
+
+class IntervalNode {
+  public:
+    int start;			// first number in the interval
+    int end;			// one past the last
+    void *owner;		// for the caller
+    int tag;
+    int maxEnd;			// furthest end in this subtree
+    unsigned priority;		// no higher than the parent's
+    IntervalNode *left;		// intervals that start before this one,
+    IntervalNode *right;	// or at the same place and added before
+};
+
+// A test a search applies to each interval it finds overlapping.
+
+typedef bool (*IntervalTest)(IntervalNode *node, void *arg);
+
+// The following class defines the set of intervals.
+
+class IntervalTree {
+  public:
+    IntervalTree();		// Initially empty
+    ~IntervalTree();		// De-allocate the nodes
+
+    IntervalNode *Insert(int start, int end, void *owner, int tag);
+				// Add an interval; return its node
+    void Remove(IntervalNode *node); // Take one out, and free the node
+    IntervalNode *FindOverlap(int start, int end, IntervalTest test,
+			      void *arg) const;
+				// The first interval overlapping
+				// [start, end) that passes "test"
+				// (any, if it is NULL); NULL if none
+    int NumIntervals() const { return numIntervals; }
+
+    void SelfTest();		// Test whether this module is working
+
+  private:
+    IntervalNode *root;
+    int numIntervals;
+    unsigned numInserted;	// for the priorities
+
+    static void Update(IntervalNode *node); // recompute maxEnd
+    static void Split(IntervalNode *node, int key, bool equalGoesLeft,
+		      IntervalNode **less, IntervalNode **rest);
+				// cut into nodes starting before "key"
+				// (or at it, if "equalGoesLeft"), and
+				// the others
+    static IntervalNode *Join(IntervalNode *less, IntervalNode *rest);
+				// the reverse
+    static IntervalNode *Unlink(IntervalNode *tree, IntervalNode *node,
+				bool *found);
+				// "tree" without "node", if it is there
+    static IntervalNode *Find(IntervalNode *node, int start, int end,
+			      IntervalTest test, void *arg);
+    static void DeleteAll(IntervalNode *node);
+};
+
+#endif // INTERVALTREE_H
@@ -1,6 +1,9 @@
 // libtest.cc 
 //	Driver code to call self-test routines for standard library
-//	classes -- bitmaps, lists, sorted lists, and hash tables.
+//	classes -- bitmaps, lists, sorted lists, heaps, rings and hash
+//	tables -- and to time the two kinds of hash table, sorted lists
+//	and heaps, and the two ways of taking a checksum, against each
+//	other.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -9,9 +12,17 @@
 #include "copyright.h"
 #include "libtest.h"
 #include "bitmap.h"
+#include "extenttree.h"
+#include "intervaltree.h"
+#include "lzcodec.h"
+#include "crc32c.h"
 #include "list.h"
+#include "heap.h"
+#include "ringqueue.h"
 #include "hash.h"
+#include "openhash.h"
 #include "sysdep.h"
+#include <time.h>
 
 //----------------------------------------------------------------------
 // IntCompare
@@ -53,33 +64,246 @@ HashKey(char *str) {
 // Array of values to be inserted into a List or SortedList. 
 static int listTestVector[] = { 9, 5, 7 };
 
+// Array of values to be inserted into a PairingHeap: enough to give
+// the root many children, and some equal ones.
+static int heapTestVector[] = { 9, 5, 7, 12, 3, 5, 18, 1, 14, 7, 2, 11,
+	 6, 16, 0, 9, 13, 4, 8, 15, 10, 3, 17 };
+
+// Items to be put on an IntrusiveList, linked through "next".
+class IntrusiveTestItem {
+  public:
+    IntrusiveTestItem *next;
+};
+static IntrusiveTestItem intrusiveTestVector[5];
+
+//----------------------------------------------------------------------
+// BenchKey, BenchHash
+//	The key of an item of the hash table benchmark, and its hash:
+//	multiplying scatters consecutive keys, as a real hash would.
+//----------------------------------------------------------------------
+
+static int
+BenchKey(int *item) {
+    return *item;
+}
+
+static unsigned int
+BenchHash(int key) {
+    return (unsigned int) key * 2654435761U;
+}
+
+const int NumBenchItems = 1000;		// in the tables at once
+const int NumBenchRounds = 50;		// times they all go in and out
+
 // Array of values to be inserted into the HashTable
 // There are enough here to force a ReHash().
 static char *hashTestVector[] = { "0", "1", "2", "3", "4", "5", "6",
 	 "7", "8", "9", "10", "11", "12", "13", "14"};
 
+//----------------------------------------------------------------------
+// HashBenchmark
+//	Time the chained and the open addressing hash tables doing the
+//	same work -- NumBenchItems items inserted, each looked up twice,
+//	and removed, NumBenchRounds times -- and print how long each
+//	took, in host milliseconds.
+//----------------------------------------------------------------------
+
+static void
+HashBenchmark() {
+    int *items = new int[NumBenchItems];
+    HashTable<int, int *> *chained =
+	new HashTable<int, int *>(BenchKey, BenchHash);
+    OpenHashTable<int, int *> *open =
+	new OpenHashTable<int, int *>(BenchKey, BenchHash);
+    int *found;
+    clock_t start, chainedTime, openTime;
+    int i, round;
+
+    for (i = 0; i < NumBenchItems; i++)
+	items[i] = i * 3;
+
+    start = clock();
+    for (round = 0; round < NumBenchRounds; round++) {
+	for (i = 0; i < NumBenchItems; i++)
+	    chained->Insert(&items[i]);
+	for (i = 0; i < 2 * NumBenchItems; i++)
+	    ASSERT(chained->Find(items[i % NumBenchItems], &found));
+	for (i = 0; i < NumBenchItems; i++)
+	    chained->Remove(items[i]);
+    }
+    chainedTime = clock() - start;
+
+    start = clock();
+    for (round = 0; round < NumBenchRounds; round++) {
+	for (i = 0; i < NumBenchItems; i++)
+	    open->Insert(&items[i]);
+	for (i = 0; i < 2 * NumBenchItems; i++)
+	    ASSERT(open->Find(items[i % NumBenchItems], &found));
+	for (i = 0; i < NumBenchItems; i++)
+	    open->Remove(items[i]);
+    }
+    openTime = clock() - start;
+
+    cout << "Hash tables, " << NumBenchItems << " items x " << NumBenchRounds
+	 << " rounds: chained " << chainedTime * 1000 / CLOCKS_PER_SEC
+	 << " ms, open addressing " << openTime * 1000 / CLOCKS_PER_SEC
+	 << " ms\n";
+
+    delete chained;
+    delete open;
+    delete [] items;
+}
+
+const int NumQueueItems = 1000;		// in the queues at once
+const int NumQueueRounds = 20;		// times they all go in and out
+
+//----------------------------------------------------------------------
+// QueueBenchmark
+//	Time a sorted list and a pairing heap doing the same work --
+//	NumQueueItems items put in, in a scrambled order, and taken out
+//	smallest first, NumQueueRounds times -- and print how long each
+//	took, in host milliseconds.
+//----------------------------------------------------------------------
+
+static void
+QueueBenchmark() {
+    int *items = new int[NumQueueItems];
+    SortedList<int> *sorted = new SortedList<int>(IntCompare);
+    PairingHeap<int> *heap = new PairingHeap<int>(IntCompare);
+    clock_t start, sortedTime, heapTime;
+    int i, round;
+
+    for (i = 0; i < NumQueueItems; i++)
+	items[i] = (i * 7919) % NumQueueItems;	// each key once
+
+    start = clock();
+    for (round = 0; round < NumQueueRounds; round++) {
+	for (i = 0; i < NumQueueItems; i++)
+	    sorted->Insert(items[i]);
+	for (i = 0; i < NumQueueItems; i++)
+	    ASSERT(sorted->RemoveFront() == i);
+    }
+    sortedTime = clock() - start;
+
+    start = clock();
+    for (round = 0; round < NumQueueRounds; round++) {
+	for (i = 0; i < NumQueueItems; i++)
+	    heap->Insert(items[i]);
+	for (i = 0; i < NumQueueItems; i++)
+	    ASSERT(heap->RemoveFront() == i);
+    }
+    heapTime = clock() - start;
+
+    cout << "Queues, " << NumQueueItems << " items x " << NumQueueRounds
+	 << " rounds: sorted list " << sortedTime * 1000 / CLOCKS_PER_SEC
+	 << " ms, pairing heap " << heapTime * 1000 / CLOCKS_PER_SEC
+	 << " ms\n";
+
+    delete sorted;
+    delete heap;
+    delete [] items;
+}
+
+// How many sectors' worth the checksums are timed on: a disk's.
+const int NumChecksumBytes = 128 * 1024;
+const int NumChecksumRounds = 20;
+
+//----------------------------------------------------------------------
+// ChecksumBenchmark
+//	Time the checksum of a disk's worth of 128-byte sectors,
+//	NumChecksumRounds times over, with the host's CRC instruction (if
+//	it has one) and with the table, and print how long each took, in
+//	host milliseconds.
+//----------------------------------------------------------------------
+
+static void
+ChecksumBenchmark() {
+    char *sectors = new char[NumChecksumBytes];
+    unsigned int sum = 0, sumInTable = 0;
+    clock_t start, hardwareTime, tableTime;
+    int i, round;
+
+    for (i = 0; i < NumChecksumBytes; i++)
+	sectors[i] = (char) (i * 7919);
+
+    start = clock();
+    for (round = 0; round < NumChecksumRounds; round++) {
+	for (i = 0; i < NumChecksumBytes; i += 128)
+	    sum += Crc32c::Compute(&sectors[i], 128);
+    }
+    hardwareTime = clock() - start;
+
+    start = clock();
+    for (round = 0; round < NumChecksumRounds; round++) {
+	for (i = 0; i < NumChecksumBytes; i += 128)
+	    sumInTable += Crc32c::ComputeInTable(&sectors[i], 128);
+    }
+    tableTime = clock() - start;
+    ASSERT(sum == sumInTable);
+
+    cout << "Checksums, " << NumChecksumBytes / 1024 << " KB x "
+	 << NumChecksumRounds << " rounds: "
+	 << (Crc32c::InHardware() ? "instruction " : "(no instruction) ")
+	 << hardwareTime * 1000 / CLOCKS_PER_SEC
+	 << " ms, table " << tableTime * 1000 / CLOCKS_PER_SEC << " ms\n";
+
+    delete [] sectors;
+}
+
 //----------------------------------------------------------------------
 // LibSelfTest
-//	Run self tests on bitmaps, lists, sorted lists, and 
-//	hash tables.
+//	Run self tests on bitmaps, extent trees, interval trees, the
+//	compressor, the checksum, lists, sorted lists, heaps, rings,
+//	intrusive lists and both kinds of hash tables, then time the
+//	hash tables, the priority queues and the checksum.
 //----------------------------------------------------------------------
 
 void
 LibSelfTest () {
     Bitmap *map = new Bitmap(200);
+    ExtentTree *extents = new ExtentTree;
+    IntervalTree *intervals = new IntervalTree;
+    LzCodec *codec = new LzCodec;
     List<int> *list = new List<int>;
     SortedList<int> *sortList = new SortedList<int>(IntCompare);
+    PairingHeap<int> *heap = new PairingHeap<int>(IntCompare);
+    RingQueue<int> *ring = new RingQueue<int>(5);
     HashTable<int, char *> *hashTable = 
 	new HashTable<int, char *>(HashKey, HashInt);
+    OpenHashTable<int, char *> *openHashTable =
+	new OpenHashTable<int, char *>(HashKey, HashInt);
+    IntrusiveList<IntrusiveTestItem> *intrusiveList =
+	new IntrusiveList<IntrusiveTestItem>(&IntrusiveTestItem::next);
 	
 		
     map->SelfTest();
+    extents->SelfTest();
+    intervals->SelfTest();
+    codec->SelfTest();
+    Crc32c::SelfTest();
     list->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
     sortList->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
+    heap->SelfTest(heapTestVector, sizeof(heapTestVector)/sizeof(int));
+    ring->SelfTest(heapTestVector, sizeof(heapTestVector)/sizeof(int));
     hashTable->SelfTest(hashTestVector, sizeof(hashTestVector)/sizeof(char *));
+    openHashTable->SelfTest(hashTestVector,
+	sizeof(hashTestVector)/sizeof(char *));
+    intrusiveList->SelfTest(intrusiveTestVector,
+	sizeof(intrusiveTestVector)/sizeof(IntrusiveTestItem));
 
     delete map;
+    delete extents;
+    delete intervals;
+    delete codec;
     delete list;
     delete sortList;
+    delete heap;
+    delete ring;
     delete hashTable;
+    delete openHashTable;
+    delete intrusiveList;
+
+    HashBenchmark();
+    QueueBenchmark();
+    ChecksumBenchmark();
 }
@@ -6,7 +6,11 @@
 // 	A "ListElement" is allocated for each item to be put on the
 //	list; it is de-allocated when the item is removed. This means
 //      we don't need to keep a "next" pointer in every object we
-//      want to put on a list.
+//      want to put on a list.  De-allocated elements are mostly kept
+//	for re-use, as allocating them is most of the cost of the list.
+//
+//	An IntrusiveList does keep a "next" pointer in every object, and
+//	allocates nothing.
 // 
 //     	NOTE: Mutual exclusion must be provided by the caller.
 //  	If you want a synchronized list, you must use the routines 
@@ -32,6 +36,31 @@ ListElement<T>::ListElement(T itm)
      next = NULL;	// always initialize to something!
 }
 
+template <class T>
+thread_local Slab ListElement<T>::slab("list elements", sizeof(ListElement<T>));
+
+//----------------------------------------------------------------------
+// ListElement<T>::operator new, ListElement<T>::operator delete
+// 	Allocate the space for a list element from the slab of its type,
+//	and release it back there.
+//----------------------------------------------------------------------
+
+template <class T>
+void *
+ListElement<T>::operator new(size_t size)
+{
+    MemCount::Add(MemListElement, sizeof(ListElement<T>));
+    return slab.Alloc(size);
+}
+
+template <class T>
+void
+ListElement<T>::operator delete(void *p, size_t size)
+{
+    MemCount::Remove(MemListElement, sizeof(ListElement<T>));
+    slab.Free(p, size);
+}
+
 
 //----------------------------------------------------------------------
 // List<T>::List
@@ -381,3 +410,153 @@ SortedList<T>::SelfTest(T *p, int numEntries)
 
      delete q;
 }
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::IntrusiveList
+//	Initialize an intrusive list, empty to start with.
+//
+//	"link" is the field of the items that links them together.
+//----------------------------------------------------------------------
+
+template <class T>
+IntrusiveList<T>::IntrusiveList(T *T::*link)
+{
+    next = link;
+    first = last = NULL;
+    numInList = 0;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::Append / Prepend
+//      Put "item" at the end, or the beginning, of the list.  It must
+//	not be on a list linked through the same field already.
+//
+//	An item's field is NULL while it is on no list (it must start out
+//	that way), and only the last item on a list has it NULL, so that
+//	can be checked without a search.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::Append(T *item)
+{
+    ASSERT(item != NULL && item->*next == NULL && item != last);
+    if (IsEmpty()) {
+	first = item;
+    } else {
+	last->*next = item;
+    }
+    last = item;
+    numInList++;
+}
+
+template <class T>
+void
+IntrusiveList<T>::Prepend(T *item)
+{
+    ASSERT(item != NULL && item->*next == NULL && item != last);
+    item->*next = first;
+    if (IsEmpty()) {
+	last = item;
+    }
+    first = item;
+    numInList++;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::RemoveFront
+//      Remove the first item from the list, and return it.  The list
+//	must not be empty.
+//----------------------------------------------------------------------
+
+template <class T>
+T *
+IntrusiveList<T>::RemoveFront()
+{
+    T *item = first;
+
+    ASSERT(!IsEmpty());
+    first = item->*next;
+    if (first == NULL) {
+	last = NULL;
+    }
+    item->*next = NULL;
+    numInList--;
+    return item;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::Remove
+//      Remove "item" from the list, wherever it is.  It must be on it.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::Remove(T *item)
+{
+    T *prev, *ptr;
+
+    ASSERT(IsInList(item));
+    if (item == first) {
+	(void) RemoveFront();
+	return;
+    }
+    for (prev = first, ptr = first->*next; ptr != item;
+		prev = ptr, ptr = ptr->*next)
+	;
+    prev->*next = item->*next;
+    if (item == last) {
+	last = prev;
+    }
+    item->*next = NULL;
+    numInList--;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::IsInList
+//      Return TRUE if "item" is on the list.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+IntrusiveList<T>::IsInList(T *item) const
+{
+    for (T *ptr = first; ptr != NULL; ptr = ptr->*next) {
+	if (ptr == item) {
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// IntrusiveList<T>::SelfTest
+//      Test whether this module is working, with the "numEntries"
+//	items at "p".
+//----------------------------------------------------------------------
+
+template <class T>
+void
+IntrusiveList<T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+
+    ASSERT(IsEmpty() && Front() == NULL);
+    for (i = 0; i < numEntries; i++) {
+	Append(&p[i]);
+	ASSERT(IsInList(&p[i]) && NumInList() == i + 1);
+    }
+    for (i = 0; i < numEntries; i++) {	// first in, first out
+	ASSERT(RemoveFront() == &p[i]);
+    }
+    ASSERT(IsEmpty());
+
+    for (i = 0; i < numEntries; i++) {
+	Prepend(&p[i]);
+    }
+    ASSERT(Front() == &p[numEntries - 1]);
+    for (i = 0; i < numEntries; i++) {	// from the middle, and the ends
+	Remove(&p[(i + numEntries / 2) % numEntries]);
+    }
+    ASSERT(IsEmpty() && Front() == NULL);
+}
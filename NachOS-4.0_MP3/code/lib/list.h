@@ -6,6 +6,15 @@
 //	pending interrupts, etc.  Allocation and deallocation of the
 //	items on the list are to be done by the caller.
 //
+//	The list elements themselves are recycled: those of removed items
+//	go back to a slab for each type (see slab.h), for the next items
+//	put on a list, so that a list that grows and shrinks calls
+//	neither new nor delete.
+//
+//	For queues on the kernel's busiest paths, there is also an
+//	"intrusive" list, which allocates nothing at all: instead of a
+//	list element, each item has a field pointing to the next item.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -15,6 +24,9 @@
 
 #include "copyright.h"
 #include "debug.h"
+#include "memcount.h"
+#include "slab.h"
+#include <stddef.h>
 
 // The following class defines a "list element" -- which is
 // used to keep track of one item on a list.  It is equivalent to a
@@ -30,6 +42,14 @@ class ListElement {
     ListElement(T itm); 	// initialize a list element
     ListElement *next;	     	// next element on list, NULL if this is last
     T item; 	   	     	// item on the list
+
+    void *operator new(size_t size);
+				// take a recycled element
+    void operator delete(void *p, size_t size);
+				// keep the element for re-use
+
+  private:
+    static thread_local Slab slab; // where the elements come from
 };
 
 // The following class defines a "list" -- a singly linked list of
@@ -136,6 +156,48 @@ class ListIterator {
     ListElement<T> *current;	// where we are in the list
 };
 
+// The following class defines an "intrusive" list: the items are
+// objects, linked through a field of their own -- passed to the
+// constructor as a pointer to member, e.g. &Thread::nextReady -- so
+// putting one on the list and taking it off allocate nothing.  An
+// object can be on as many intrusive lists at once as it has such
+// fields, but on only one list per field.  The field must be NULL
+// while the object is on no list.
+
+template <class T>
+class IntrusiveList {
+  public:
+    IntrusiveList(T *T::*link);	// initialize an empty list, linked
+				// through the "link" field
+    ~IntrusiveList() {}		// the items are the caller's
+
+    void Prepend(T *item);	// Put item at the beginning of the list
+    void Append(T *item);	// Put item at the end of the list
+
+    T *Front() { return first; }
+				// Return first item, NULL if none,
+				// without removing it
+    T *RemoveFront();		// Take item off the front of the list
+    void Remove(T *item);	// Remove specific item from list
+
+    bool IsInList(T *item) const;
+				// is the item in the list?
+    T *Next(T *item) { return item->*next; }
+				// the item after "item", NULL if it
+				// is the last
+    int NumInList() { return numInList; }
+    bool IsEmpty() { return numInList == 0; }
+
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    T *T::*next;		// the items' field linking them
+    T *first;			// head of the list, NULL if empty
+    T *last;			// last item on the list
+    int numInList;		// number of items in the list
+};
+
 #include "list.cc"		// templates are really like macros
 				// so needs to be included in every
 				// file that uses the template
@@ -0,0 +1,280 @@
+// lzcodec.cc
+//	Routines to compress and decompress blocks of bytes.  See
+//	lzcodec.h for the format.
+//
+//	The compressor is greedy: at each byte it takes the match the
+//	table offers, if there is one, and makes it as long as it goes.
+//	Every byte it writes is checked against the room it was given,
+//	so that input that does not compress costs no more than going
+//	over it once.  The decompressor checks every length and distance
+//	against the bytes it has, so a damaged block is reported rather
+//	than read or written past.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "lzcodec.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// LzCodec::LzCodec, LzCodec::~LzCodec
+// 	Allocate the table of matches, and de-allocate it.
+//----------------------------------------------------------------------
+
+LzCodec::LzCodec()
+{
+    table = new int[1 << LzHashBits];
+}
+
+LzCodec::~LzCodec()
+{
+    delete [] table;
+}
+
+//----------------------------------------------------------------------
+// Hash
+// 	Return the table entry for the MinMatch bytes at "p".
+//----------------------------------------------------------------------
+
+static unsigned
+Hash(unsigned char *p)
+{
+    unsigned word = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned) p[3] << 24);
+
+    return (word * 2654435761U) >> (32 - LzHashBits);
+}
+
+//----------------------------------------------------------------------
+// PutLength
+// 	Put out the bytes that add to a length of "n", once 15 of it has
+//	gone in the token.  Return FALSE if there is no room for them.
+//----------------------------------------------------------------------
+
+static bool
+PutLength(unsigned char *out, int *outPos, int room, int n)
+{
+    for (n -= 15; n >= 255; n -= 255) {
+	if (*outPos >= room) {
+	    return FALSE;
+	}
+	out[(*outPos)++] = 255;
+    }
+    if (*outPos >= room) {
+	return FALSE;
+    }
+    out[(*outPos)++] = n;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// PutSequence
+// 	Put out one sequence: "numLiterals" bytes from "literals", then
+//	a match of "matchLength" bytes from "offset" back.  The last
+//	sequence has "matchLength" 0, and no match.  Return FALSE if
+//	there is no room for it.
+//----------------------------------------------------------------------
+
+static bool
+PutSequence(unsigned char *out, int *outPos, int room,
+	    unsigned char *literals, int numLiterals, int offset,
+	    int matchLength)
+{
+    int extra = (matchLength > 0) ? matchLength - MinMatch : 0;
+    int token = (min(numLiterals, 15) << 4) | min(extra, 15);
+
+    if (*outPos >= room) {
+	return FALSE;
+    }
+    out[(*outPos)++] = token;
+    if (numLiterals >= 15 && !PutLength(out, outPos, room, numLiterals)) {
+	return FALSE;
+    }
+    if (numLiterals > room - *outPos) {
+	return FALSE;
+    }
+    bcopy(literals, &out[*outPos], numLiterals);
+    *outPos += numLiterals;
+    if (matchLength == 0) {
+	return TRUE;
+    }
+    if (room - *outPos < 2) {
+	return FALSE;
+    }
+    out[(*outPos)++] = offset & 0xff;
+    out[(*outPos)++] = offset >> 8;
+    return extra < 15 || PutLength(out, outPos, room, extra);
+}
+
+//----------------------------------------------------------------------
+// LzCodec::Compress
+// 	Compress the "length" bytes at "from" into "into", which has room
+//	for "room" bytes.  Return how many bytes the compressed form
+//	takes, or -1 if it would take more than "room".
+//----------------------------------------------------------------------
+
+int
+LzCodec::Compress(char *from, int length, char *into, int room)
+{
+    unsigned char *in = (unsigned char *) from;
+    unsigned char *out = (unsigned char *) into;
+    int pos = 0, anchor = 0, outPos = 0;
+
+    for (int i = 0; i < (1 << LzHashBits); i++) {
+	table[i] = -1;
+    }
+    while (pos + MinMatch <= length) {
+	unsigned h = Hash(&in[pos]);
+	int candidate = table[h];
+	int matchLength;
+
+	table[h] = pos;
+	if (candidate < 0 || pos - candidate > MaxOffset
+	    || bcmp(&in[candidate], &in[pos], MinMatch) != 0) {
+	    pos++;
+	    continue;
+	}
+	matchLength = MinMatch;
+	while (pos + matchLength < length
+	       && in[candidate + matchLength] == in[pos + matchLength]) {
+	    matchLength++;
+	}
+	if (!PutSequence(out, &outPos, room, &in[anchor], pos - anchor,
+			 pos - candidate, matchLength)) {
+	    return -1;
+	}
+	pos += matchLength;
+	anchor = pos;
+    }
+    if (!PutSequence(out, &outPos, room, &in[anchor], length - anchor, 0, 0)) {
+	return -1;
+    }
+    return outPos;
+}
+
+//----------------------------------------------------------------------
+// GetLength
+// 	Add to "*n" the length bytes that follow a 15 in a token.
+//	Return FALSE if the input ends first.
+//----------------------------------------------------------------------
+
+static bool
+GetLength(unsigned char *in, int *inPos, int length, int *n)
+{
+    int byte;
+
+    do {
+	if (*inPos >= length) {
+	    return FALSE;
+	}
+	byte = in[(*inPos)++];
+	*n += byte;
+    } while (byte == 255);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// LzCodec::Decompress
+// 	Decompress the "length" bytes at "from" into the "size" bytes at
+//	"into".  Return FALSE if they are not the compressed form of a
+//	block of that size.
+//----------------------------------------------------------------------
+
+bool
+LzCodec::Decompress(char *from, int length, char *into, int size)
+{
+    unsigned char *in = (unsigned char *) from;
+    unsigned char *out = (unsigned char *) into;
+    int inPos = 0, outPos = 0;
+
+    while (inPos < length) {
+	int token = in[inPos++];
+	int numLiterals = token >> 4;
+	int matchLength = token & 15;
+	int offset;
+
+	if (numLiterals == 15 && !GetLength(in, &inPos, length, &numLiterals)) {
+	    return FALSE;
+	}
+	if (numLiterals > length - inPos || numLiterals > size - outPos) {
+	    return FALSE;
+	}
+	bcopy(&in[inPos], &out[outPos], numLiterals);
+	inPos += numLiterals;
+	outPos += numLiterals;
+	if (outPos == size) {
+	    return TRUE;
+	}
+
+	if (length - inPos < 2) {
+	    return FALSE;
+	}
+	offset = in[inPos] | (in[inPos + 1] << 8);
+	inPos += 2;
+	if (matchLength == 15 && !GetLength(in, &inPos, length, &matchLength)) {
+	    return FALSE;
+	}
+	matchLength += MinMatch;
+	if (offset == 0 || offset > outPos || matchLength > size - outPos) {
+	    return FALSE;
+	}
+	for (int i = 0; i < matchLength; i++, outPos++) {	// may overlap
+	    out[outPos] = out[outPos - offset];
+	}
+	if (outPos == size) {
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// LzCodec::SelfTest
+// 	Test whether this module is working: text and zeroes shrink and
+//	come back, bytes that do not compress are turned away, and a
+//	cut-off block is found out.
+//----------------------------------------------------------------------
+
+void
+LzCodec::SelfTest()
+{
+    const int size = 4096;
+    char *block = new char[size];
+    char *packed = new char[size + size / 8];
+    char *unpacked = new char[size];
+    unsigned seed = 1;
+    int length;
+
+    for (int i = 0; i < size; i++) {	// lines of numbers, like the tests' files
+	block[i] = (i % 8 == 7) ? '\n' : '0' + (i / 8 + i % 8) % 10;
+    }
+    length = Compress(block, size, packed, size);
+    ASSERT(length > 0 && length < size / 4);
+    ASSERT(Decompress(packed, length, unpacked, size)
+	   && bcmp(block, unpacked, size) == 0);
+    ASSERT(!Decompress(packed, length / 2, unpacked, size));
+    ASSERT(!Decompress(packed, length, unpacked, size - 1));
+
+    bzero(block, size);
+    length = Compress(block, size, packed, size);
+    ASSERT(length > 0 && length < 32);
+    ASSERT(Decompress(packed, length, unpacked, size)
+	   && bcmp(block, unpacked, size) == 0);
+
+    for (int i = 0; i < size; i++) {
+	seed = seed * 1103515245 + 12345;
+	block[i] = seed >> 16;
+    }
+    ASSERT(Compress(block, size, packed, size) == -1);
+    length = Compress(block, size, packed, size + size / 8);
+    ASSERT(length > size);
+    ASSERT(Decompress(packed, length, unpacked, size)
+	   && bcmp(block, unpacked, size) == 0);
+
+    length = Compress(block, 0, packed, 1);
+    ASSERT(length == 1 && Decompress(packed, length, unpacked, 0));
+    delete [] block;
+    delete [] packed;
+    delete [] unpacked;
+}
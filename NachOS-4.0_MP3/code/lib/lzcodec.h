@@ -0,0 +1,66 @@
+// lzcodec.h
+//	Data structures for a fast compressor of blocks of bytes, of the
+//	LZ77 family.
+//
+//	The compressed form of a block is a list of sequences, as in the
+//	LZ4 block format.  A sequence is a run of bytes copied as they
+//	are (the "literals"), followed by a "match": a reference to bytes
+//	that were already put out, that is, how far back they start and
+//	how many to copy.  Each sequence starts with a token byte, whose
+//	high four bits are the number of literals and low four bits the
+//	length of the match less MinMatch; 15 in either means that bytes
+//	follow adding to it, each up to 255, the first one less than 255
+//	being the last.  Then come the literals, then the distance back,
+//	in two bytes, low byte first, then the extra match length bytes.
+//	The last sequence has no match.
+//
+//	The compressor finds matches by hashing every MinMatch bytes of
+//	the input into a table of where they were last seen, so it goes
+//	over the input once, and never looks back more than MaxOffset
+//	bytes.  The decompressor is simpler and faster still: it just
+//	copies bytes around.
+//
+//	The compressed form does not record how long the block was: the
+//	caller keeps that, and decompressing stops once that many bytes
+//	are out.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef LZCODEC_H
+#define LZCODEC_H
+
+#include "copyright.h"
+#include "utility.h"
+
+const int MinMatch = 4;			// shortest match worth a sequence
+const int MaxOffset = 65535;		// farthest a match reaches back
+const int LzHashBits = 12;		// the table has 2^LzHashBits entries
+
+// The following class defines the compressor and decompressor.
+
+class LzCodec {
+  public:
+    LzCodec();				// Initialize the match table
+    ~LzCodec();				// De-allocate it
+
+    int Compress(char *from, int length, char *into, int room);
+					// Compress "length" bytes, putting
+					// at most "room" bytes in "into";
+					// return how many, or -1 if they
+					// do not fit
+    static bool Decompress(char *from, int length, char *into, int size);
+					// Undo Compress of "length" bytes,
+					// into a block of "size" bytes;
+					// FALSE if they are not the
+					// compressed form of one
+
+    void SelfTest();			// Test whether this module is working
+
+  private:
+    int *table;				// hash of MinMatch bytes -> where
+					// they were last seen, -1 if not
+};
+
+#endif // LZCODEC_H
@@ -0,0 +1,86 @@
+// memcount.cc
+//	Routines to account for the memory of the kernel's data
+//	structures.  See memcount.h.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "memcount.h"
+#include "debug.h"
+
+static const char *typeName[NumMemTypes] = {
+    "open files", "file headers", "directories", "threads", "thread stacks",
+    "list elements", "pending interrupts"
+};
+
+// of the machine on this host thread (see main.cc)
+static thread_local int live[NumMemTypes]; // objects of each type now
+static thread_local int liveBytes[NumMemTypes]; // and the bytes they take
+static thread_local int peak[NumMemTypes]; // the most there have been
+static thread_local int peakBytes[NumMemTypes]; // the most bytes
+static thread_local int made[NumMemTypes]; // how many were ever made
+
+//----------------------------------------------------------------------
+// MemCount::Add, MemCount::Remove
+// 	Count an object of "type", taking "bytes" of host memory, that
+//	was just made, or that is being destroyed.
+//----------------------------------------------------------------------
+
+void
+MemCount::Add(MemType type, int bytes)
+{
+    live[type]++;
+    liveBytes[type] += bytes;
+    made[type]++;
+    if (live[type] > peak[type])
+	peak[type] = live[type];
+    if (liveBytes[type] > peakBytes[type])
+	peakBytes[type] = liveBytes[type];
+}
+
+void
+MemCount::Remove(MemType type, int bytes)
+{
+    ASSERT(live[type] > 0 && liveBytes[type] >= bytes);
+    live[type]--;
+    liveBytes[type] -= bytes;
+}
+
+//----------------------------------------------------------------------
+// MemCount::Live
+// 	Return how many objects of "type" there are now.
+//----------------------------------------------------------------------
+
+int
+MemCount::Live(MemType type)
+{
+    return live[type];
+}
+
+//----------------------------------------------------------------------
+// MemCount::Print
+// 	Print, for each type, how many objects there are and the bytes
+//	they take, with the most there ever were at once, and a total.
+//	Called at halt, so what is live then is what the kernel still
+//	holds -- or never gave back.
+//----------------------------------------------------------------------
+
+void
+MemCount::Print()
+{
+    int totalBytes = 0, totalPeak = 0;
+
+    cout << "Kernel memory: live (peak), bytes (peak), made\n";
+    for (int t = 0; t < NumMemTypes; t++) {
+	if (made[t] == 0)
+	    continue;
+	cout << "  " << typeName[t] << " " << live[t] << " (" << peak[t]
+	     << "), " << liveBytes[t] << " (" << peakBytes[t] << "), "
+	     << made[t] << "\n";
+	totalBytes += liveBytes[t];
+	totalPeak += peakBytes[t];
+    }
+    cout << "  total bytes " << totalBytes << " (" << totalPeak << ")\n";
+}
@@ -0,0 +1,58 @@
+// memcount.h
+//	Routines to account for the host memory the kernel's own data
+//	structures take, by type, so that it can be said how much each
+//	open file, thread (and its stack), directory or pending interrupt
+//	costs, and where the memory goes as the number of programs grows.
+//
+//	The constructor of each type accounted for adds one object and
+//	its size to its type, and the destructor takes them away again;
+//	the highest number live at once, and the most bytes, are kept
+//	too.  Thread stacks and list elements are pooled for re-use (see
+//	thread.h and slab.h), so for them it is the ones in use that are
+//	counted; up to MaxPooledStacks more stacks are kept in the pool,
+//	and the slabs keep the most list elements there ever were.  The
+//	figures are printed at halt with -stats.
+//
+//	Counting is just adding to a few integers.  It is always on,
+//	since list elements are made before the kernel is, and before
+//	any flag has been looked at.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef MEMCOUNT_H
+#define MEMCOUNT_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The types whose objects are counted.
+
+enum MemType {
+    MemOpenFile,
+    MemFileHeader,
+    MemDirectory,
+    MemThread,
+    MemThreadStack,
+    MemListElement,
+    MemPendingInterrupt,
+    NumMemTypes
+};
+
+// The following class groups the counting routines; the counters
+// are shared by the whole kernel.
+
+class MemCount {
+  public:
+    static void Add(MemType type, int bytes);
+					// An object of "type" taking
+					// "bytes" was made
+    static void Remove(MemType type, int bytes);
+					// and one was destroyed
+    static int Live(MemType type);	// How many there are now
+
+    static void Print();		// Print what is live and the peaks
+};
+
+#endif // MEMCOUNT_H
@@ -0,0 +1,366 @@
+// openhash.cc
+//     	Routines to manage a self-expanding, open addressing hash table
+//	of arbitrary things.  See openhash.h.
+//
+//	The table size is a power of 2, so the slot a key hashes to is
+//	found with a mask, and stepping to the next slot wraps around
+//	the same way.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+const int InitialSlots = 8;	// how big a table do we start with
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::OpenHashTable
+//	Initialize a hash table, empty to start with.
+//	Elements can now be added to the table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashTable<Key,T>::OpenHashTable(Key (*get)(T x), unsigned (*hFunc)(Key x))
+{
+    numItems = 0;
+    InitSlots(InitialSlots);
+    getKey = get;
+    hash = hFunc;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::InitSlots
+//	Allocate an empty table of "size" slots, a power of 2.
+//	Called by the constructor and by ReHash().
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::InitSlots(int size)
+{
+    ASSERT(size > 0 && (size & (size - 1)) == 0);
+    numSlots = size;
+    slots = new T[numSlots];
+    full = new bool[numSlots];
+    for (int i = 0; i < numSlots; i++) {
+	full[i] = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::~OpenHashTable
+//	Prepare a hash table for deallocation.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashTable<Key,T>::~OpenHashTable()
+{
+    ASSERT(IsEmpty());		// make sure table is empty
+    delete [] slots;
+    delete [] full;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::HomeSlot
+//      Return the slot an item with "key" goes in, if it is free.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+int
+OpenHashTable<Key,T>::HomeSlot(Key key) const
+{
+    return (*hash)(key) & (numSlots - 1);
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::FindSlot
+//      Return the slot of the item with "key", or -1 if there is none:
+//	look from its home slot on, up to the first free one.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+int
+OpenHashTable<Key,T>::FindSlot(Key key) const
+{
+    for (int i = HomeSlot(key); full[i]; i = (i + 1) & (numSlots - 1)) {
+	if (key == getKey(slots[i])) {
+	    return i;
+	}
+    }
+    return -1;			// there is always a free slot
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Place
+//      Put "item" in the first free slot from its home slot on.  The
+//	caller makes sure it is not in the table, and that there is
+//	room.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::Place(T item)
+{
+    int i;
+
+    for (i = HomeSlot(getKey(item)); full[i]; i = (i + 1) & (numSlots - 1))
+	;
+    slots[i] = item;
+    full[i] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Insert
+//      Put an item into the hashtable, first doubling the table if it
+//	would be more than 3/4 full.
+//
+//	"item" is the thing to put in the table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::Insert(T item)
+{
+    Key key = getKey(item);
+
+    ASSERT(!IsInTable(key));
+
+    if ((numItems + 1) * 4 > numSlots * 3) {
+	ReHash();
+    }
+    Place(item);
+    numItems++;
+
+    ASSERT(IsInTable(key));
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::ReHash
+//      Double the size of the table, putting every item back in it.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::ReHash()
+{
+    T *oldSlots = slots;
+    bool *oldFull = full;
+    int oldSize = numSlots;
+
+    InitSlots(numSlots * 2);
+    for (int i = 0; i < oldSize; i++) {
+	if (oldFull[i]) {
+	    Place(oldSlots[i]);
+	}
+    }
+    delete [] oldSlots;
+    delete [] oldFull;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Find
+//      Find an item from the hash table.
+//
+// Returns:
+//	Whether item is found, and if found, the item.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+bool
+OpenHashTable<Key,T>::Find(Key key, T *itemPtr) const
+{
+    int i = FindSlot(key);
+
+    if (i == -1) {
+	*itemPtr = NULL;
+	return FALSE;
+    }
+    *itemPtr = slots[i];
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Remove
+//      Remove an item from the hash table. The item must be in the table.
+//
+//	The hole it leaves is filled by the next item of the run that
+//	may move back to it -- one whose home slot is not after the hole
+//	(going round the table) -- and so on for the hole that leaves,
+//	until the end of the run.
+//
+// Returns:
+//	The removed item.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+T
+OpenHashTable<Key,T>::Remove(Key key)
+{
+    int hole = FindSlot(key);
+    int mask = numSlots - 1;
+    T item;
+
+    ASSERT(hole != -1);		// item must be in table
+    item = slots[hole];
+    full[hole] = FALSE;
+    numItems--;
+
+    for (int i = (hole + 1) & mask; full[i]; i = (i + 1) & mask) {
+	int home = HomeSlot(getKey(slots[i]));
+
+	// the item at "i" may move back to the hole unless its home
+	// slot is in (hole, i], going round the table
+	if (((i - home) & mask) >= ((i - hole) & mask)) {
+	    slots[hole] = slots[i];
+	    full[hole] = TRUE;
+	    full[i] = FALSE;
+	    hole = i;
+	}
+    }
+
+    ASSERT(!IsInTable(key));
+    return item;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Apply
+//      Apply function to every item in the hash table.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class Key,class T>
+void
+OpenHashTable<Key,T>::Apply(void (*func)(T)) const
+{
+    for (int i = 0; i < numSlots; i++) {
+	if (full[i]) {
+	    (*func)(slots[i]);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::SanityCheck
+//      Test whether this is still a legal hash table.
+//
+//	Tests: does the table have the right # of items?
+//	       is it no more than 3/4 full?
+//	       is every item reachable from its home slot, without
+//		crossing a free slot?
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::SanityCheck() const
+{
+    int numFound = 0;
+
+    for (int i = 0; i < numSlots; i++) {
+	if (full[i]) {
+	    numFound++;
+	    ASSERT(FindSlot(getKey(slots[i])) == i);
+	}
+    }
+    ASSERT(numItems == numFound);
+    ASSERT(numItems * 4 <= numSlots * 3);
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::SelfTest
+//      Test whether this module is working.  Items are removed in a
+//	different order from the one they went in, to move items back
+//	into the holes.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+    OpenHashIterator<Key, T> *iterator = new OpenHashIterator<Key,T>(this);
+
+    SanityCheck();
+    ASSERT(IsEmpty());	// check that table is empty in various ways
+    for (; !iterator->IsDone(); iterator->Next()) {
+	ASSERTNOTREACHED();
+    }
+    delete iterator;
+
+    for (i = 0; i < numEntries; i++) {
+        Insert(p[i]);
+        ASSERT(IsInTable(getKey(p[i])));
+        ASSERT(!IsEmpty());
+    }
+    SanityCheck();
+
+    iterator = new OpenHashIterator<Key,T>(this);
+    for (i = 0; !iterator->IsDone(); iterator->Next()) {
+	i++;
+    }
+    ASSERT(i == numEntries);
+    delete iterator;
+
+    // should be able to get out everything we put in
+    for (i = 0; i < numEntries; i++) {
+	int j = (i * 7) % numEntries;
+
+	if (IsInTable(getKey(p[j]))) {
+	    ASSERT(Remove(getKey(p[j])) == p[j]);
+	    SanityCheck();
+	}
+    }
+    for (i = 0; i < numEntries; i++) {
+	if (IsInTable(getKey(p[i]))) {
+	    ASSERT(Remove(getKey(p[i])) == p[i]);
+	}
+    }
+
+    ASSERT(IsEmpty());
+    SanityCheck();
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::OpenHashIterator
+//      Initialize a data structure to allow us to step through
+//	every item in an open addressing hash table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashIterator<Key,T>::OpenHashIterator(OpenHashTable<Key,T> *tbl)
+{
+    table = tbl;
+    slot = 0;
+    SkipEmpty();
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::SkipEmpty
+//      Move on from the current slot to the next full one, if it is
+//	not full itself.
+//----------------------------------------------------------------------
+
+template <class Key,class T>
+void
+OpenHashIterator<Key,T>::SkipEmpty()
+{
+    while (slot < table->numSlots && !table->full[slot]) {
+	slot++;
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::Next
+//      Update iterator to point to the next item in the table.
+//----------------------------------------------------------------------
+
+template <class Key,class T>
+void
+OpenHashIterator<Key,T>::Next()
+{
+    slot++;
+    SkipEmpty();
+}
@@ -0,0 +1,105 @@
+// openhash.h
+//      Data structures to manage an "open addressing" hash table: the
+//	same interface as HashTable (see hash.h), but with the items
+//	kept in one contiguous array instead of a list per bucket.
+//
+//	An item goes in the slot its key hashes to or, if that is taken,
+//	the next free slot after it (linear probing), so a lookup reads
+//	consecutive slots and never follows a pointer, and putting an
+//	item in the table allocates nothing (except, now and then, to
+//	double the table).  The table is kept at most 3/4 full, so runs
+//	of taken slots stay short.
+//
+//	Removing an item moves the items after it in its run back to
+//	fill the hole, where that does not put them before the slot they
+//	hash to.  So there are no "deleted" markers to slow down later
+//	lookups, and the table never needs cleaning up.
+//
+//	As for HashTable, the key must have a hash function, the items a
+//	function to get their key, and "==" must work on keys.
+//	Allocation and deallocation of the items in the table are to be
+//	done by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef OPENHASH_H
+#define OPENHASH_H
+
+#include "copyright.h"
+#include "debug.h"
+
+template <class Key,class T> class OpenHashIterator;
+
+template <class Key, class T>
+class OpenHashTable {
+  public:
+    OpenHashTable(Key (*get)(T x), unsigned (*hFunc)(Key x));
+    				// initialize a hash table
+    ~OpenHashTable();		// deallocate a hash table
+
+    void Insert(T item);	// Put item into hash table
+    T Remove(Key key);		// Remove item from hash table.
+
+    bool Find(Key key, T *itemPtr) const;
+    				// Find an item from its key
+    bool IsInTable(Key key) { T dummy; return Find(key, &dummy); }
+				// Is the item in the table?
+
+    bool IsEmpty() { return numItems == 0; }
+				// does the table have anything in it
+    int NumInTable() { return numItems; }
+
+    void Apply(void (*f)(T)) const;
+    				// apply function to all elements in table
+
+    void SanityCheck() const;	// is this still a legal hash table?
+    void SelfTest(T *p, int numItems);
+    				// is the module working?
+
+  private:
+    T *slots;			// the items, where "full" is set
+    bool *full;			// which slots have an item
+    int numSlots;		// size of the table, a power of 2
+    int numItems;		// the number of items in the table
+
+    Key (*getKey)(T x);		// get Key from value
+    unsigned (*hash)(Key x);	// the hash function
+
+    void InitSlots(int size);	// allocate an empty table
+    int HomeSlot(Key key) const;// which slot does the key hash to?
+    int FindSlot(Key key) const;// which slot has it; -1 if none
+    void Place(T item);		// put item in the first free slot of
+				// its run; no checks
+    void ReHash();		// double the size of the table
+
+    friend class OpenHashIterator<Key,T>;
+};
+
+// The following class can be used to step through an open addressing
+// hash table -- same interface as HashIterator.
+
+template <class Key,class T>
+class OpenHashIterator {
+  public:
+    OpenHashIterator(OpenHashTable<Key,T> *table);
+				// initialize an iterator
+
+    bool IsDone() { return slot == table->numSlots; }
+				// return TRUE if no more items in table
+    T Item() { ASSERT(!IsDone()); return table->slots[slot]; }
+				// return current item in table
+    void Next();		// update iterator to point to next
+
+  private:
+    OpenHashTable<Key,T> *table;// the hash table we're stepping through
+    int slot;			// the slot of the current item
+
+    void SkipEmpty();		// move on to a full slot, if any
+};
+
+#include "openhash.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // OPENHASH_H
@@ -0,0 +1,130 @@
+// ringqueue.cc
+//     	Routines to manage a single-producer, single-consumer ring of
+//	arbitrary things.  See ringqueue.h.
+//
+//     	NOTE: there must be one producer and one consumer; two of
+//	either need a lock between them.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// RingQueue<T>::RingQueue
+//	Initialize a ring of "ringSize" slots, empty to start with.
+//----------------------------------------------------------------------
+
+template <class T>
+RingQueue<T>::RingQueue(int ringSize)
+{
+    ASSERT(ringSize > 0);
+    size = ringSize;
+    slots = new T[size];
+    head = tail = 0;
+}
+
+//----------------------------------------------------------------------
+// RingQueue<T>::~RingQueue
+//	De-allocate the ring.  If it still holds any items, they are not
+//	de-allocated.
+//----------------------------------------------------------------------
+
+template <class T>
+RingQueue<T>::~RingQueue()
+{
+    delete [] slots;
+}
+
+//----------------------------------------------------------------------
+// RingQueue<T>::Put
+//	Put "item" at the end of the ring, and return TRUE; or FALSE if
+//	the ring is full.  The slot is filled in before "tail" moves, so
+//	the consumer never sees it until it is done.  The barriers keep
+//	the host from reordering either, when the consumer is on another
+//	host thread (see ringqueue.h).
+//
+//	"wasEmpty" -- set to TRUE if the ring was empty: the consumer may
+//		be waiting for it
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+RingQueue<T>::Put(T item, bool *wasEmpty)
+{
+    unsigned last = tail;
+
+    if (last - head == (unsigned) size) {
+	return FALSE;
+    }
+    __sync_synchronize();		// the consumer is done with the slot
+    slots[last % size] = item;
+    *wasEmpty = (last == head);
+    __sync_synchronize();		// and it is filled in, before...
+    tail = last + 1;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// RingQueue<T>::Get
+//	Take the first item out of the ring into "item", and return TRUE;
+//	or FALSE if the ring is empty.  The slot is read before "head"
+//	moves, so the producer never fills it in too soon; with barriers,
+//	as in Put.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+RingQueue<T>::Get(T *item)
+{
+    unsigned first = head;
+
+    if (first == tail) {
+	return FALSE;
+    }
+    __sync_synchronize();		// the producer is done with the slot
+    *item = slots[first % size];
+    __sync_synchronize();		// and we are, before...
+    head = first + 1;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// RingQueue<T>::SelfTest
+//	Test whether this module is working: fill the ring, empty it,
+//	and go round it enough times for the counts to pass the end of
+//	the slots many times over.
+//
+//	"p" -- the items to put in; at least two
+//	"numEntries" -- how many there are
+//----------------------------------------------------------------------
+
+template <class T>
+void
+RingQueue<T>::SelfTest(T *p, int numEntries)
+{
+    bool wasEmpty;
+    T item;
+    int i, round;
+
+    ASSERT(IsEmpty() && !Get(&item) && numEntries >= 2 && size >= 2);
+    for (i = 0; i < size; i++) {
+	ASSERT(Put(p[i % numEntries], &wasEmpty));
+	ASSERT(wasEmpty == (i == 0));
+    }
+    ASSERT(IsFull() && NumInQueue() == size && !Put(p[0], &wasEmpty));
+    for (i = 0; i < size; i++) {
+	ASSERT(Get(&item) && item == p[i % numEntries]);
+    }
+    ASSERT(IsEmpty() && !Get(&item));
+
+    for (round = 0; round < 10 * size; round++) {	// two in, two out
+	ASSERT(Put(p[round % numEntries], &wasEmpty));
+	ASSERT(Put(p[(round + 1) % numEntries], &wasEmpty));
+	ASSERT(!wasEmpty);
+	ASSERT(Get(&item) && item == p[round % numEntries]);
+	ASSERT(Get(&item) && item == p[(round + 1) % numEntries]);
+	ASSERT(IsEmpty());
+    }
+}
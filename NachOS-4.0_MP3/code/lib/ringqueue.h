@@ -0,0 +1,70 @@
+// ringqueue.h
+//	Data structures for a bounded queue with one producer and one
+//	consumer that never take a lock: typically an interrupt handler
+//	handing things to a kernel thread, and the thread handing them
+//	back.
+//
+//	The queue is a ring of "size" slots.  "head" and "tail" count the
+//	items ever taken out and put in; only the consumer changes
+//	"head", and only the producer changes "tail", each after it has
+//	done with the slot, so neither ever sees a slot half filled or
+//	half emptied, and neither has to turn interrupts off.  They are
+//	unsigned, so they may wrap around: tail - head is always the
+//	number of items in the ring.
+//
+//	Put says whether the ring was empty, so that the producer only
+//	wakes the consumer on the first item of a burst, and the consumer
+//	takes everything there is before it waits again.  A consumer that
+//	sleeps on a semaphore the producer V's then sees each V once,
+//	possibly after it has already taken the item; an extra look at an
+//	empty ring is all that costs.
+//
+//	The two sides may be on different host threads, as the machines
+//	run in one host process are (see Wires, in network.h), so each
+//	has a memory barrier between the slot and moving its count; on
+//	one thread, they only cost a few cycles.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include "copyright.h"
+#include "debug.h"
+
+// The following class defines a single-producer, single-consumer ring.
+
+template <class T>
+class RingQueue {
+  public:
+    RingQueue(int size);	// initialize a ring holding "size"
+				// items at most
+    ~RingQueue();		// de-allocate it; its items are not
+
+    bool Put(T item, bool *wasEmpty);
+				// put an item at the end, if there is
+				// room, and say if it was the only one;
+				// the producer only
+    bool Get(T *item);		// take the first item out, if there is
+				// one; the consumer only
+
+    bool IsEmpty() const { return tail == head; }
+    bool IsFull() const { return tail - head == (unsigned) size; }
+    int NumInQueue() const { return tail - head; }
+
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    T *slots;			// the ring
+    int size;			// how many slots it has
+    volatile unsigned head;	// items taken out, by the consumer
+    volatile unsigned tail;	// items put in, by the producer
+};
+
+#include "ringqueue.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // RINGQUEUE_H
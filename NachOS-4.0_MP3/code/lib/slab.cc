@@ -0,0 +1,110 @@
+// slab.cc
+//	Routines for caching the kernel's objects by type.  See slab.h.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "slab.h"
+#include "debug.h"
+
+thread_local Slab *Slab::slabs = NULL;
+
+//----------------------------------------------------------------------
+// Slab::Slab
+// 	Set the name and the object size of a slab, and add it to the
+//	slabs printed at halt.  Nothing else is touched: the slab may
+//	already be in use (see slab.h).
+//
+//	"size" is the size of the class, rounded up so that each object
+//	in a chunk can hold a SlabObject.
+//----------------------------------------------------------------------
+
+Slab::Slab(const char *debugName, int size)
+{
+    name = debugName;
+    objectSize = size < (int) sizeof(SlabObject) ? (int) sizeof(SlabObject)
+						 : size;
+    nextSlab = slabs;
+    slabs = this;
+}
+
+//----------------------------------------------------------------------
+// Slab::Alloc
+// 	Return the memory for an object of "size" bytes: the first on
+//	the free list, after filling it with a chunk from the heap if it
+//	is empty.  An object that is not the slab's size comes from the
+//	heap.
+//----------------------------------------------------------------------
+
+void *
+Slab::Alloc(size_t size)
+{
+    SlabObject *object;
+
+    if (objectSize == 0 || (int) size > objectSize) {
+	numHeap++;
+	return ::operator new(size);
+    }
+    if (freeList == NULL) {
+	char *chunk = (char *) ::operator new(SlabChunk * objectSize);
+
+	for (int i = SlabChunk - 1; i >= 0; i--) {
+	    object = (SlabObject *) (chunk + i * objectSize);
+	    object->next = freeList;
+	    freeList = object;
+	}
+	numChunks++;
+    }
+    object = freeList;
+    freeList = object->next;
+    numAllocs++;
+    if (++numInUse > peakInUse)
+	peakInUse = numInUse;
+    return object;
+}
+
+//----------------------------------------------------------------------
+// Slab::Free
+// 	Put the memory of an object of "size" bytes back on the free
+//	list, or back to the heap if that is where it came from.  An
+//	object from the heap before the constructor ran is the size of
+//	the slab's, and is kept too.
+//----------------------------------------------------------------------
+
+void
+Slab::Free(void *p, size_t size)
+{
+    SlabObject *object = (SlabObject *) p;
+
+    if (objectSize == 0 || (int) size > objectSize) {
+	::operator delete(p);
+	return;
+    }
+    object->next = freeList;
+    freeList = object;
+    if (numInUse > 0)		// one from the heap was never counted
+	numInUse--;
+}
+
+//----------------------------------------------------------------------
+// Slab::Print
+// 	Print, for each slab that was used, how many objects are in use
+//	and the most ever were, how many were handed out, in how many
+//	chunks, and how many came from the heap instead.
+//----------------------------------------------------------------------
+
+void
+Slab::Print()
+{
+    cout << "Slabs: in use (peak), allocations, chunks, from the heap\n";
+    for (Slab *s = slabs; s != NULL; s = s->nextSlab) {
+	if (s->numAllocs == 0 && s->numHeap == 0)
+	    continue;
+	cout << "  " << s->name << " (" << s->objectSize << " bytes) "
+	     << s->numInUse << " (" << s->peakInUse << "), "
+	     << s->numAllocs << ", " << s->numChunks << ", "
+	     << s->numHeap << "\n";
+    }
+}
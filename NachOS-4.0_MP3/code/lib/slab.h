@@ -0,0 +1,81 @@
+// slab.h
+//	Data structures for a "slab": a cache of objects of one type,
+//	for the kernel's objects that are made and destroyed all the
+//	time -- open files, file headers, directories, semaphores, list
+//	elements, Mails.
+//
+//	A class that wants one has a static Slab member, and operator
+//	new and delete that call its Alloc and Free.  The memory comes
+//	from the heap SlabChunk objects at a time, and an object destroyed
+//	goes on the slab's free list rather than back to the heap, so
+//	making one is taking the first object off the list, and the
+//	heap sees a few chunks rather than an object at a time, however
+//	long Nachos runs.  Nothing is given back before Nachos halts; the
+//	memory a slab holds is its type's peak.
+//
+//	An object of a class derived from the slab's, which is bigger,
+//	is left to the heap.
+//
+//	A slab is never copied or destroyed, and is only ever a static
+//	member: it may be used before its constructor has run, by the
+//	constructor of another static object, and so it counts on its
+//	counts and list being zero, with the rest of static memory,
+//	before then.  Until the constructor has run, and set the size of
+//	the objects, they all come from the heap.
+//
+//	The slabs are used without interrupts off, like List, since
+//	nothing in them can cause a switch to another thread.  Each is
+//	thread_local: the machines run in one host process (-machines)
+//	are each on a host thread of their own, with slabs of their own,
+//	so no slab is ever shared between host threads.  How
+//	much each is used is printed at halt with -stats.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "copyright.h"
+#include "utility.h"
+#include <stddef.h>
+
+const int SlabChunk = 32;		// objects got from the heap at once
+
+// The following class defines an object on a slab's free list; it
+// is laid over the memory of the object that was there.
+
+class SlabObject {
+  public:
+    SlabObject *next;			// the next free object
+};
+
+// The following class defines a slab.
+
+class Slab {
+  public:
+    Slab(const char *debugName, int size);
+					// A slab of objects of "size"
+					// bytes
+
+    void *Alloc(size_t size);		// Take an object off the free list
+    void Free(void *p, size_t size);	// and put one back
+
+    static void Print();		// Say how each slab was used
+
+  private:
+    const char *name;			// for -stats
+    int objectSize;			// 0 until the constructor has run
+    SlabObject *freeList;		// objects to hand out
+    int numInUse;			// handed out, and not yet back
+    int peakInUse;			// the most there ever were
+    int numAllocs;			// how many Alloc handed out
+    int numChunks;			// and how many chunks that took
+    int numHeap;			// objects left to the heap
+    Slab *nextSlab;			// the slab made before this one
+
+    static thread_local Slab *slabs;	// every slab, newest first
+};
+
+#endif // SLAB_H
@@ -32,6 +32,11 @@
 #include <sys/file.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <ucontext.h>
 #include <cerrno>
 
 #ifdef SOLARIS
@@ -39,6 +44,7 @@
 // for open()
 #include <fcntl.h>
 #endif
+#include <sys/mman.h>
 
 #ifdef LINUX	 // at this point, linux doesn't support mprotect 
 #define NO_MPROT     
@@ -119,6 +125,18 @@ CallOnUserAbort(void (*func)(int))
     (void)signal(SIGINT, func);
 }
 
+//----------------------------------------------------------------------
+// CallOnUserSignal
+// 	Arrange that "func" will be called each time the UNIX process
+//	gets SIGUSR1 (e.g., from "kill -USR1 <pid>").
+//----------------------------------------------------------------------
+
+void 
+CallOnUserSignal(void (*func)(int))
+{
+    (void)signal(SIGUSR1, func);
+}
+
 //----------------------------------------------------------------------
 // Delay
 // 	Put the UNIX process running Nachos to sleep for x seconds,
@@ -141,12 +159,23 @@ Delay(int seconds)
 void 
 UDelay(unsigned int useconds)
 {
-//#ifdef SOLARIS
-//   usleep(useconds_t useconds);
-//#else
-//   usleep(useconds);
-//#endif /* SOLARIS */
+    usleep(useconds);
+}
+
+//----------------------------------------------------------------------
+// HostNanoseconds
+// 	Return the time of day on the host, in nanoseconds.  Only the
+//	difference between two of them means anything; the resolution is
+//	whatever gettimeofday gives.
+//----------------------------------------------------------------------
 
+long long
+HostNanoseconds()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec * 1000000LL + now.tv_usec) * 1000LL;
 }
 
 //----------------------------------------------------------------------
@@ -160,27 +189,114 @@ Abort()
     abort();
 }
 
+// What each host thread started by StartHostThread has of its own:
+// where Exit goes back to, and the state of its random numbers.  NULL
+// and unused on the host's first thread.
+static thread_local ucontext_t *exitContext = NULL;
+static thread_local bool ownRandom = FALSE;
+static thread_local unsigned int randomState;
+
 //----------------------------------------------------------------------
 // Exit
-// 	Quit without dropping core.
+// 	Quit without dropping core.  On a host thread started by
+//	StartHostThread, only that thread quits: it goes back to where it
+//	started, from whatever stack it is on (a Nachos thread's, say),
+//	and finishes there.
 //----------------------------------------------------------------------
 
 void 
 Exit(int exitCode)
 {
+    if (exitContext != NULL)
+	setcontext(exitContext);
     exit(exitCode);
 }
 
+// What StartHostThread hands the thread it starts.
+struct HostThread {
+    void (*func)(void *);
+    void *arg;
+    pthread_t thread;
+};
+
+//----------------------------------------------------------------------
+// HostThreadRoot
+// 	The body of a host thread started by StartHostThread: note where
+//	Exit is to come back to, and call the routine.  Either way it
+//	ends up here the second time getcontext returns, and the thread
+//	finishes.
+//----------------------------------------------------------------------
+
+static void *
+HostThreadRoot(void *data)
+{
+    HostThread *t = (HostThread *) data;
+    ucontext_t started;
+    volatile bool running = FALSE;	// kept in memory across setcontext
+
+    ownRandom = TRUE;
+    randomState = 1;			// as rand() starts
+    getcontext(&started);
+    if (!running) {
+	running = TRUE;
+	exitContext = &started;
+	(*t->func)(t->arg);
+    }
+    exitContext = NULL;
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// StartHostThread
+// 	Run "func(arg)" on a new host thread, at the same time as this
+//	one, and return the thread, to be waited for with JoinHostThread.
+//	The thread has random numbers of its own (see RandomInit), and
+//	Exit on it only finishes it.
+//----------------------------------------------------------------------
+
+void *
+StartHostThread(void (*func)(void *), void *arg)
+{
+    HostThread *t = new HostThread;
+    int retVal;
+
+    t->func = func;
+    t->arg = arg;
+    retVal = pthread_create(&t->thread, NULL, HostThreadRoot, (void *) t);
+    ASSERT(retVal == 0);
+    return (void *) t;
+}
+
+//----------------------------------------------------------------------
+// JoinHostThread
+// 	Wait for a host thread started by StartHostThread to finish.
+//----------------------------------------------------------------------
+
+void
+JoinHostThread(void *thread)
+{
+    HostThread *t = (HostThread *) thread;
+
+    pthread_join(t->thread, NULL);
+    delete t;
+}
+
 //----------------------------------------------------------------------
 // RandomInit
 // 	Initialize the pseudo-random number generator.  We use the
 //	now obsolete "srand" and "rand" because they are more portable!
+//	A host thread started by StartHostThread has a generator of its
+//	own, so that what one machine draws does not depend on what the
+//	others do.
 //----------------------------------------------------------------------
 
 void 
 RandomInit(unsigned seed)
 {
-    srand(seed);
+    if (ownRandom)
+	randomState = seed;
+    else
+	srand(seed);
 }
 
 //----------------------------------------------------------------------
@@ -191,7 +307,7 @@ RandomInit(unsigned seed)
 unsigned int 
 RandomNumber()
 {
-    return rand();
+    return ownRandom ? rand_r(&randomState) : rand();
 }
 
 //----------------------------------------------------------------------
@@ -203,9 +319,18 @@ RandomNumber()
 //
 //	Note: Just return the useful part!
 //
+//	The guard pages cost two host pages and two system calls per
+//	array, so a build without DEBUG messages (-DNO_DEBUG) leaves them
+//	out, as NO_MPROT does; thread stacks are still checked for
+//	overflow at each switch, by their fencepost.
+//
 //	"size" -- amount of useful space needed (in bytes)
 //----------------------------------------------------------------------
 
+#if defined(NO_DEBUG) && !defined(NO_MPROT)
+#define NO_MPROT
+#endif
+
 char * 
 AllocBoundedArray(int size)
 {
@@ -296,6 +421,39 @@ PollFile(int fd)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// WaitForInput
+// 	Wait until one of several open files or sockets has characters
+//	that can be read, or until "usec" microseconds have gone by,
+//	whichever comes first.  Return TRUE if one of them is ready, and
+//	FALSE if the time ran out.  With no files, this is a sleep.
+//
+//	"fds" -- the file descriptors to wait on
+//	"numFds" -- how many there are
+//	"usec" -- the longest to wait
+//----------------------------------------------------------------------
+
+bool
+WaitForInput(int *fds, int numFds, unsigned int usec)
+{
+    fd_set rfd;
+    int maxFd = -1;
+    int retVal;
+    struct timeval waitTime;
+
+    FD_ZERO(&rfd);
+    for (int i = 0; i < numFds; i++) {
+	FD_SET(fds[i], &rfd);
+	if (fds[i] > maxFd)
+	    maxFd = fds[i];
+    }
+    waitTime.tv_sec = usec / 1000000;
+    waitTime.tv_usec = usec % 1000000;
+
+    retVal = select(maxFd + 1, &rfd, NULL, NULL, &waitTime);
+    return retVal > 0;
+}
+
 //----------------------------------------------------------------------
 // OpenForWrite
 // 	Open a file for writing.  Create it if it doesn't exist; truncate it 
@@ -330,6 +488,23 @@ OpenForReadWrite(char *name, bool crashOnError)
     return fd;
 }
 
+//----------------------------------------------------------------------
+// OpenForRead
+// 	Open a file for reading only.
+//	Return the file descriptor, or error if it doesn't exist.
+//
+//	"name" -- file name
+//----------------------------------------------------------------------
+
+int
+OpenForRead(char *name, bool crashOnError)
+{
+    int fd = open(name, O_RDONLY, 0);
+
+    ASSERT(!crashOnError || fd >= 0);
+    return fd;
+}
+
 //----------------------------------------------------------------------
 // Read
 // 	Read characters from an open file.  Abort if read fails.
@@ -379,6 +554,21 @@ Lseek(int fd, int offset, int whence)
     ASSERT(retVal >= 0);
 }
 
+//----------------------------------------------------------------------
+// Truncate
+// 	Make an open file "length" bytes long.  What is cut off is gone;
+//	if the file is later made longer again, by writing past its end,
+//	the gap reads as zeroes, and on most UNIX file systems takes no
+//	space (a "sparse" file).  Abort on error.
+//----------------------------------------------------------------------
+
+void
+Truncate(int fd, int length)
+{
+    int retVal = ftruncate(fd, length);
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // Tell
 // 	Report the current location within an open file.
@@ -420,6 +610,99 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// OpenHostDirectory, NextHostEntry, CloseHostDirectory
+// 	Open a UNIX directory, returning NULL if it cannot be; return the
+//	name of its next entry, skipping "." and "..", NULL after the
+//	last (the name is good until the next call); and close it.
+//----------------------------------------------------------------------
+
+void *
+OpenHostDirectory(char *name)
+{
+    return (void *) opendir(name);
+}
+
+char *
+NextHostEntry(void *dir)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir((DIR *) dir)) != NULL) {
+	if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+	    return entry->d_name;
+    }
+    return NULL;
+}
+
+void
+CloseHostDirectory(void *dir)
+{
+    closedir((DIR *) dir);
+}
+
+//----------------------------------------------------------------------
+// HostFileLength
+// 	Return how many bytes long the UNIX file "name" is, setting
+//	"isDirectory" to whether it is a directory; -1 if there is no
+//	such file.
+//----------------------------------------------------------------------
+
+int
+HostFileLength(char *name, bool *isDirectory)
+{
+    struct stat info;
+
+    if (stat(name, &info) < 0)
+	return -1;
+    *isDirectory = S_ISDIR(info.st_mode);
+    return (int) info.st_size;
+}
+
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "size" bytes of an open file into memory, for
+//	reading and writing, shared with the file.  Return where.
+//
+//	"fd" -- the file descriptor, open for reading and writing
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int size)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ASSERT(addr != MAP_FAILED);
+    return (char *) addr;
+}
+
+//----------------------------------------------------------------------
+// SyncMappedFile
+// 	Wait until the changes to a region mapped by MapFile have been
+//	written to the file.
+//----------------------------------------------------------------------
+
+void
+SyncMappedFile(char *addr, int size)
+{
+    int retVal = msync(addr, size, MS_SYNC);
+
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Remove a mapping made by MapFile.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int size)
+{
+    int retVal = munmap(addr, size);
+
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -533,6 +816,54 @@ ReadFromSocket(int sockID, char *buffer, int packetSize)
     ASSERT(retVal == packetSize);
 }
 
+//----------------------------------------------------------------------
+// OpenDoorbell
+// 	Make a doorbell: a pipe whose read end can be waited on with
+//	WaitForInput.  Neither end ever blocks.
+//----------------------------------------------------------------------
+
+void
+OpenDoorbell(int *readFd, int *writeFd)
+{
+    int fds[2];
+    int retVal = pipe(fds);
+
+    ASSERT(retVal == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    *readFd = fds[0];
+    *writeFd = fds[1];
+}
+
+//----------------------------------------------------------------------
+// RingDoorbell
+// 	Ring a doorbell.  If the pipe is full, it has been rung often
+//	enough already, and the byte is let go.
+//----------------------------------------------------------------------
+
+void
+RingDoorbell(int writeFd)
+{
+    char ring = 0;
+
+    (void) write(writeFd, &ring, 1);
+}
+
+//----------------------------------------------------------------------
+// ClearDoorbell
+// 	Take every ring there has been out of a doorbell, so that the
+//	next WaitForInput on it waits for a new one.
+//----------------------------------------------------------------------
+
+void
+ClearDoorbell(int readFd)
+{
+    char rings[64];
+
+    while (read(readFd, rings, sizeof(rings)) > 0)
+	continue;
+}
+
 //----------------------------------------------------------------------
 //    modified by KMS to add retry...
 // SendToSocket
@@ -25,9 +25,22 @@ extern void Exit(int exitCode);
 extern void Delay(int seconds);
 extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
 
+// Run a routine on a host thread of its own, for a machine of its own
+// (-machines), and wait for it to finish; Exit on that thread only
+// finishes it
+extern void *StartHostThread(void (*func)(void *), void *arg);
+extern void JoinHostThread(void *thread);
+
+// Host time, for profiling the simulator itself
+extern long long HostNanoseconds();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
 
+// And so that a routine is called when the host sends the signal that
+// asks for a look at the statistics (SIGUSR1)
+extern void CallOnUserSignal(void (*func)(int));
+
 // Initialize the pseudo random number generator
 extern void RandomInit(unsigned seed);
 extern unsigned int RandomNumber();
@@ -41,18 +54,38 @@ extern void DeallocBoundedArray(char *p, int size);
 // If no characters in the file, return without waiting.
 extern bool PollFile(int fd);
 
+// Wait up to "usec" microseconds for any of "numFds" files to have
+// characters to read; return TRUE as soon as one does.
+extern bool WaitForInput(int *fds, int numFds, unsigned int usec);
+
 // File operations: open/read/write/lseek/close, and check for error
 // For simulating the disk and the console devices.
 extern int OpenForWrite(char *name);
 extern int OpenForReadWrite(char *name, bool crashOnError);
+extern int OpenForRead(char *name, bool crashOnError);
 extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
 extern int Tell(int fd);
+extern void Truncate(int fd, int length);
 extern int Close(int fd);
 extern bool Unlink(char *name);
 
+// Step through the names in a UNIX directory, but for "." and "..";
+// and find out how long a UNIX file is, or that it is a directory.
+extern void *OpenHostDirectory(char *name);
+extern char *NextHostEntry(void *dir);
+extern void CloseHostDirectory(void *dir);
+extern int HostFileLength(char *name, bool *isDirectory);
+
+// Map "size" bytes of an open file into memory, shared with the file,
+// so that changes to the memory are changes to the file; make sure
+// they have reached it; remove the mapping.
+extern char *MapFile(int fd, int size);
+extern void SyncMappedFile(char *addr, int size);
+extern void UnmapFile(char *addr, int size);
+
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
 extern "C" {
@@ -63,6 +96,12 @@ void bcopy(const void *s1, void *s2, size_t n);
 void bzero(void *s, size_t n);
 }
 
+// A doorbell: a pipe that one host thread rings, without waiting, to
+// end the WaitForInput of another on its read end
+extern void OpenDoorbell(int *readFd, int *writeFd);
+extern void RingDoorbell(int writeFd);
+extern void ClearDoorbell(int readFd);
+
 // Interprocess communication operations, for simulating the network
 extern int OpenSocket();
 extern void CloseSocket(int sockID);
@@ -35,4 +35,9 @@
 typedef void (*VoidFunctionPtr)(void *arg); 
 typedef void (*VoidNoArgFunctionPtr)(); 
 
+// Simulated time, in ticks (see machine/stats.h).  It is 64 bits, so
+// that a long run with slow devices does not wrap around.
+
+typedef long long Ticks;
+
 #endif // UTILITY_H
@@ -15,6 +15,7 @@
 #include "copyright.h"
 #include "console.h"
 #include "main.h"
+#include "inputlog.h"
 #include "stdio.h"
 //----------------------------------------------------------------------
 // ConsoleInput::ConsoleInput
@@ -23,21 +24,28 @@
 //	"readFile" -- UNIX file simulating the keyboard (NULL -> use stdin)
 // 	"toCall" is the interrupt handler to call when a character arrives
 //		from the keyboard
+//
+//	When input is being replayed (see inputlog.h), the keyboard is
+//	never read.
 //----------------------------------------------------------------------
 
 ConsoleInput::ConsoleInput(char *readFile, CallBackObj *toCall)
 {
-    if (readFile == NULL)
+    replay = (kernel->inputLog != NULL && kernel->inputLog->Replaying());
+    if (readFile == NULL || replay)
 	readFileNo = 0;					// keyboard = stdin
     else
     	readFileNo = OpenForReadWrite(readFile, TRUE);	// should be read-only
 
     // set up the stuff to emulate asynchronous interrupts
     callWhenAvail = toCall;
-    incoming = EOF;
+    numIncoming = numTaken = 0;
+    atEnd = FALSE;
 
     // start polling for incoming keystrokes
-    kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
+    if (!replay)
+	kernel->interrupt->WatchInput(readFileNo);
+    kernel->interrupt->SchedulePoll(this, ConsoleTime, ConsoleReadInt);
 }
 
 //----------------------------------------------------------------------
@@ -54,39 +62,51 @@ ConsoleInput::~ConsoleInput()
 
 //----------------------------------------------------------------------
 // ConsoleInput::CallBack()
-// 	Simulator calls this when a character may be available to be
+// 	Simulator calls this when characters may be available to be
 //	read in from the simulated keyboard (eg, the user typed something).
 //
-//	First check to make sure character is available.
-//	Then invoke the "callBack" registered by whoever wants the character.
+//	First check to make sure some are available, and take in as many
+//	as the UNIX file has ready, up to ConsoleInputChunk.  Then invoke
+//	the "callBack" registered by whoever wants them.
+//
+//	When replaying, the characters are the next ones logged, if they
+//	are due; when recording, what each interrupt delivers, and the
+//	end of the file, is logged as it is delivered.
 //----------------------------------------------------------------------
 
 void
 ConsoleInput::CallBack()
 {
-  char c;
-  int readCount;
+  int readCount = -1;
 
-    ASSERT(incoming == EOF);
-    if (!PollFile(readFileNo)) { // nothing to be read
+    ASSERT(numTaken == numIncoming);
+    if (replay)
+	readCount = kernel->inputLog->Replay(InputConsole, incoming,
+					     ConsoleInputChunk);
+    else if (!kernel->interrupt->InputQuiet() && PollFile(readFileNo))
+    	readCount = ReadPartial(readFileNo, incoming, ConsoleInputChunk);
+    if (readCount < 0) {
+	// nothing to be read
         // schedule the next time to poll for a packet
-        kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
+        kernel->interrupt->SchedulePoll(this, ConsoleTime, ConsoleReadInt);
     } else { 
-    	// otherwise, try to read a character
-    	readCount = ReadPartial(readFileNo, &c, sizeof(char));
+	if (kernel->inputLog != NULL && !replay)
+	    kernel->inputLog->Record(InputConsole, incoming, readCount);
 	if (readCount == 0) {
 	   // this seems to happen at end of file, when the
 	   // console input is a regular file
 	   // don't schedule an interrupt, since there will never
 	   // be any more input
-	   // just do nothing....
+	   atEnd = TRUE;
+	   if (!replay)
+	       kernel->interrupt->UnwatchInput(readFileNo);
 	}
 	else {
-	  // save the character and notify the OS that
-	  // it is available
-	  ASSERT(readCount == sizeof(char));
-	  incoming = c;
-	  kernel->stats->numConsoleCharsRead++;
+	  // save the characters and notify the OS that
+	  // they are available
+	  numIncoming = readCount;
+	  numTaken = 0;
+	  kernel->stats->numConsoleCharsRead += readCount;
 	}
 	callWhenAvail->CallBack();
     }
@@ -101,15 +121,34 @@ ConsoleInput::CallBack()
 char
 ConsoleInput::GetChar()
 {
-   char ch = incoming;
+   char ch;
 
-   if (incoming != EOF) {	// schedule when next char will arrive
-       kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
-   }
-   incoming = EOF;
+   if (GetChars(&ch, 1) == 0)
+       return EOF;
    return ch;
 }
 
+//----------------------------------------------------------------------
+// ConsoleInput::GetChars()
+// 	Take up to "size" of the characters that have arrived, into
+//	"into", and return how many there were.  Once they have all been
+//	taken, the keyboard is polled again after ConsoleTime.
+//----------------------------------------------------------------------
+
+int
+ConsoleInput::GetChars(char *into, int size)
+{
+   int count = min(size, numIncoming - numTaken);
+
+   if (count <= 0)
+       return 0;
+   bcopy(&incoming[numTaken], into, count);
+   numTaken += count;
+   if (numTaken == numIncoming)	// schedule when the next will arrive
+       kernel->interrupt->SchedulePoll(this, ConsoleTime, ConsoleReadInt);
+   return count;
+}
+
 
 
 //----------------------------------------------------------------------
@@ -130,6 +169,7 @@ ConsoleOutput::ConsoleOutput(char *writeFile, CallBackObj *toCall)
 
     callWhenDone = toCall;
     putBusy = FALSE;
+    numPut = 0;
 }
 
 //----------------------------------------------------------------------
@@ -153,7 +193,7 @@ void
 ConsoleOutput::CallBack()
 {
     putBusy = FALSE;
-    kernel->stats->numConsoleCharsWritten++;
+    kernel->stats->numConsoleCharsWritten += numPut;
     callWhenDone->CallBack();
 }
 
@@ -166,10 +206,7 @@ ConsoleOutput::CallBack()
 void
 ConsoleOutput::PutChar(char ch)
 {
-    ASSERT(putBusy == FALSE);
-    WriteFile(writeFileNo, &ch, sizeof(char));
-    putBusy = TRUE;
-    kernel->interrupt->Schedule(this, ConsoleTime, ConsoleWriteInt);
+    PutChars(&ch, 1);
 }
 
 
@@ -182,10 +219,41 @@ ConsoleOutput::PutChar(char ch)
 void
 ConsoleOutput::PutInt(char *converted_int, int size)
 {
-    ASSERT(putBusy == FALSE);
-    WriteFile(writeFileNo, converted_int, size*sizeof(char));
+    PutChars(converted_int, size);
+}
+
+//----------------------------------------------------------------------
+// ConsoleOutput::PutChars()
+// 	Write "size" characters to the simulated display in one go,
+//	schedule one interrupt to occur in the future, and return.
+//	Like a DMA transfer to a serial line, it takes ConsoleTime to
+//	start, however many characters there are.
+//----------------------------------------------------------------------
+
+void
+ConsoleOutput::PutChars(char *buf, int size)
+{
+    ASSERT(putBusy == FALSE && size > 0);
+    WriteFile(writeFileNo, buf, size*sizeof(char));
     putBusy = TRUE;
+    numPut = size;
     kernel->interrupt->Schedule(this, ConsoleTime, ConsoleWriteInt);
 }
 
+//----------------------------------------------------------------------
+// ConsoleOutput::PutCharsNow()
+// 	Write "size" characters to the simulated display, with no
+//	interrupt: for the last of the output, as Nachos halts and there
+//	is no more time to wait for the device in.
+//----------------------------------------------------------------------
+
+void
+ConsoleOutput::PutCharsNow(char *buf, int size)
+{
+    if (size > 0) {
+	WriteFile(writeFileNo, buf, size*sizeof(char));
+	kernel->stats->numConsoleCharsWritten += size;
+    }
+}
+
 
@@ -44,6 +44,14 @@
 // serial input and serial output.  But conceptually simpler to
 // use two objects.
 
+// The keyboard takes in as many characters as the UNIX file has
+// ready, up to ConsoleInputChunk, at each interrupt -- a line, when
+// the file is a terminal -- rather than one per interrupt; it polls
+// again once they have all been taken.
+
+const int ConsoleInputChunk = 64;	// most characters one keyboard
+					// interrupt delivers
+
 class ConsoleInput : public CallBackObj {
   public:
     ConsoleInput(char *readFile, CallBackObj *toCall);
@@ -54,6 +62,11 @@ class ConsoleInput : public CallBackObj {
 				// available, return it.  Otherwise, return EOF.
     				// "callWhenAvail" is called whenever there is 
 				// a char to be gotten
+    int GetChars(char *into, int size);
+				// Take up to "size" of the characters
+				// that have arrived; return how many
+    bool AtEnd() { return atEnd; }
+				// Has the UNIX file no more to give?
 
     void CallBack();		// Invoked when a character arrives
 				// from the keyboard.
@@ -62,9 +75,12 @@ class ConsoleInput : public CallBackObj {
     int readFileNo;			// UNIX file emulating the keyboard 
     CallBackObj *callWhenAvail;		// Interrupt handler to call when 
 					// there is a char to be read
-    char incoming;    			// Contains the character to be read,
-					// if there is one available. 
-					// Otherwise contains EOF.
+    char incoming[ConsoleInputChunk];	// The characters that have arrived,
+    int numIncoming;			// how many there are,
+    int numTaken;			// and how many of them have been
+					// taken already
+    bool atEnd;				// has the file ended?
+    bool replay;			// is the input replayed from a log?
 };
 
 class ConsoleOutput : public CallBackObj {
@@ -77,6 +93,12 @@ class ConsoleOutput : public CallBackObj {
 				// and return immediately.  "callWhenDone" 
 				// will called when the I/O completes. 
     void PutInt(char *converted_int, int size);
+    void PutChars(char *buf, int size);
+				// Write "size" characters at once; one
+				// interrupt when they have all gone
+    void PutCharsNow(char *buf, int size);
+				// Write them without waiting for the
+				// device, as Nachos halts
     void CallBack();		// Invoked when next character can be put
 				// out to the display.
 
@@ -86,6 +108,7 @@ class ConsoleOutput : public CallBackObj {
 					// the next char can be put 
     bool putBusy;    			// Is a PutChar operation in progress?
 					// If so, you can't do another one!
+    int numPut;				// characters it is writing
 };
 
 #endif // CONSOLE_H
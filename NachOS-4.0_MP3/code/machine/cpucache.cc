@@ -0,0 +1,134 @@
+// cpucache.cc
+//	Routines to simulate the CPU's memory caches.  See cpucache.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "cpucache.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// CacheLevel::CacheLevel
+// 	Initialize a cache of "size" bytes, split into lines of
+//	"lineSize" bytes, "ways" of them to a set.  Every line starts out
+//	invalid.
+//----------------------------------------------------------------------
+
+CacheLevel::CacheLevel(int size, int ways, int lineSize)
+{
+    ASSERT(lineSize >= 4 && (lineSize & (lineSize - 1)) == 0);
+    ASSERT(ways >= 1 && size >= ways * lineSize);
+    ASSERT(size % (ways * lineSize) == 0);
+    numSets = size / (ways * lineSize);
+    numWays = ways;
+    lineBytes = lineSize;
+    tags = new unsigned int[numSets * numWays];
+    lastUse = new unsigned int[numSets * numWays];
+    for (int i = 0; i < numSets * numWays; i++)
+	tags[i] = lastUse[i] = 0;
+    clock = 0;
+}
+
+CacheLevel::~CacheLevel()
+{
+    delete [] tags;
+    delete [] lastUse;
+}
+
+//----------------------------------------------------------------------
+// CacheLevel::Access
+// 	Look for the line holding "physAddr" in its set.  On a hit, mark
+//	it used and return TRUE.  On a miss, it replaces the way that has
+//	gone unused longest (an invalid one first, as it was never used),
+//	and we return FALSE.
+//----------------------------------------------------------------------
+
+bool
+CacheLevel::Access(unsigned int physAddr)
+{
+    unsigned int line = physAddr / lineBytes;
+    int set = line % numSets;
+    unsigned int *setTags = &tags[set * numWays];
+    unsigned int *setUse = &lastUse[set * numWays];
+    int victim = 0;
+
+    clock++;
+    for (int i = 0; i < numWays; i++) {
+	if (setTags[i] == line + 1) {
+	    setUse[i] = clock;
+	    return TRUE;
+	}
+	if (setUse[i] < setUse[victim])
+	    victim = i;
+    }
+    setTags[victim] = line + 1;
+    setUse[victim] = clock;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// CacheLevel::Parse
+// 	Translate a cache, as given on the command line -- its size, its
+//	ways and its line size in bytes, separated by commas -- into the
+//	three numbers.  Return FALSE if they do not make a cache.
+//----------------------------------------------------------------------
+
+bool
+CacheLevel::Parse(char *spec, int *size, int *ways, int *lineSize)
+{
+    if (sscanf(spec, "%d,%d,%d", size, ways, lineSize) != 3)
+	return FALSE;
+    if (*lineSize < 4 || (*lineSize & (*lineSize - 1)) != 0 || *ways < 1)
+	return FALSE;
+    return *size >= *ways * *lineSize && *size % (*ways * *lineSize) == 0;
+}
+
+//----------------------------------------------------------------------
+// CpuCache::CpuCache / ~CpuCache
+// 	Put cache "first" in front of memory, with "second" behind it if
+//	it is not NULL; de-allocate them at the end.
+//----------------------------------------------------------------------
+
+CpuCache::CpuCache(CacheLevel *first, CacheLevel *second)
+{
+    l1 = first;
+    l2 = second;
+}
+
+CpuCache::~CpuCache()
+{
+    delete l1;
+    if (l2 != NULL)
+	delete l2;
+}
+
+//----------------------------------------------------------------------
+// CpuCache::Access
+// 	The running thread is reading or writing "physAddr".  Count it,
+//	overall and for the thread, and return how many ticks it stalls
+//	for: none for an L1 hit, CacheL2Time for an L2 hit, and MemoryTime
+//	for a miss in both.
+//----------------------------------------------------------------------
+
+int
+CpuCache::Access(int physAddr)
+{
+    ThreadStats *mine = kernel->currentThread->stats;
+
+    kernel->stats->numMemAccesses++;
+    mine->numMemAccesses++;
+    if (l1->Access(physAddr))
+	return 0;
+    kernel->stats->numL1Misses++;
+    mine->numL1Misses++;
+    if (l2 != NULL && l2->Access(physAddr))
+	return CacheL2Time;
+    if (l2 != NULL) {
+	kernel->stats->numL2Misses++;
+	mine->numL2Misses++;
+    }
+    return MemoryTime;
+}
@@ -0,0 +1,74 @@
+// cpucache.h
+//	Data structures to simulate the CPU's memory caches, so that the
+//	cost of a user program's memory layout shows up in its run time
+//	(-l1 and -l2).
+//
+//	There is a first level (L1) cache and, optionally, a second (L2)
+//	behind it.  Each is set associative, with least recently used
+//	replacement, and is given as "bytes,ways,lineBytes" on the command
+//	line.  Both hold instructions and data alike, and are indexed by
+//	physical address: every instruction fetch and every load and store
+//	the machine makes goes through them, after translation.  A hit in
+//	L1 costs nothing beyond the instruction's tick; a miss costs
+//	CacheL2Time if L2 has the line, or MemoryTime if it has to come
+//	from memory.  Stores allocate lines like loads do, and writing
+//	dirty lines back is not charged for.
+//
+//	Only the tags are simulated: the bytes are always read from and
+//	written to mainMemory, so a cache never changes what a program
+//	sees.  So the kernel needs no flushes when it copies into user
+//	memory or reads pages in; those accesses are just not counted.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CPUCACHE_H
+#define CPUCACHE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines one level of cache.
+
+class CacheLevel {
+  public:
+    CacheLevel(int size, int ways, int lineSize);
+				// A cache of "size" bytes, in lines of
+				// "lineSize", "ways" to a set; all invalid
+    ~CacheLevel();
+
+    bool Access(unsigned int physAddr);
+				// Is the line holding "physAddr" cached?
+				// If not, bring it in
+
+    static bool Parse(char *spec, int *size, int *ways, int *lineSize);
+				// Read "bytes,ways,lineBytes"
+
+  private:
+    int numSets;		// sets in the cache
+    int numWays;		// lines in each set
+    int lineBytes;		// bytes in each line
+    unsigned int *tags;		// the line each way holds, plus one;
+				// 0 if it holds none
+    unsigned int *lastUse;	// when each way was last used, for LRU
+    unsigned int clock;		// counts accesses, to stamp them
+};
+
+// The following class defines the caches in front of memory.
+
+class CpuCache {
+  public:
+    CpuCache(CacheLevel *first, CacheLevel *second);
+				// L1, and L2 or NULL
+    ~CpuCache();		// De-allocate them
+
+    int Access(int physAddr);	// Count an access by the running thread,
+				// and return the ticks it stalls for
+
+  private:
+    CacheLevel *l1;
+    CacheLevel *l2;
+};
+
+#endif // CPUCACHE_H
@@ -18,61 +18,420 @@
 #include "debug.h"
 #include "sysdep.h"
 #include "main.h"
+#include "tracer.h"
 
 // We put a magic number at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file 
 // as a disk (which would probably trash the file's contents).
+//
+// After the sectors comes the geometry the disk was made with: another
+// magic number, then SectorSize, SectorsPerTrack and NumTracks.  Files
+// made before there was a choice of geometry stop at the last sector,
+// and have the original one.
 
 const int MagicNumber = 0x456789ab;
 const int MagicSize = sizeof(int);
-const int DiskSize = (MagicSize + (NumSectors * SectorSize));
+const int ImageSize = (MagicSize + (NumSectors * SectorSize));
+					// what holds sectors; what -dm maps
+const int GeometryMagic = 0x6e67656f;
+const int GeometryWords = 4;
+const int DiskSize = (ImageSize + GeometryWords * sizeof(int));
+const int PresentBytes = divRoundUp(NumSectors, BitsInByte);
+					// what follows the geometry in the
+					// delta of an overlay
+const int OldSectorSize = 128;		// the geometry of files without one
+const int OldSectorsPerTrack = 32;
+const int OldNumTracks = 32;
+
+
+//----------------------------------------------------------------------
+// WriteGeometry
+// 	Write the geometry at the end of the sectors of a disk's UNIX
+//	file, which also makes sure reads of the last sector do not
+//	return EOF.
+//----------------------------------------------------------------------
 
+static void
+WriteGeometry(int file)
+{
+    int geometry[GeometryWords] =
+	{ GeometryMagic, SectorSize, SectorsPerTrack, NumTracks };
+
+    Lseek(file, ImageSize, 0);
+    WriteFile(file, (char *) geometry, sizeof(geometry));
+}
 
 //----------------------------------------------------------------------
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
 //	if it doesn't exist), and check the magic number to make sure it's 
-// 	ok to treat it as Nachos disk storage.
+// 	ok to treat it as Nachos disk storage.  The file is the one
+//	named with -disk, or else DISK_ followed by the machine id; for
+//	any disk of a volume but the first, with "." and its number after
+//	that (see volume.h).
+//
+//	With -dbase, the disk is an overlay on the base image it names
+//	(see disk.h), and the file is its delta.  With -restore, the base
+//	is the checkpoint, and a delta left by an earlier run is started
+//	afresh, with no sectors: the run starts from what the checkpoint
+//	has alone.
+//
+//	A disk mounted on a directory (-mount) is in the file it was
+//	given instead, and is never an overlay.
+//
+//	A RAM disk only reads the file, if there is one, to start with
+//	what it holds; it has no track buffers or write cache.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"mapImage" -- map the UNIX file into memory, and read and write
+//		sectors by copying
+//	"trackBuffers" -- how many tracks the disk can hold in RAM
+//	"writeCacheSectors" -- how many written sectors it can hold in
+//		RAM before they are on the media; 0 for none
+//	"device" -- the model of the media
+//	"member" -- which disk of its volume this is
+//	"imageName" -- the UNIX file, for a disk mounted on a directory;
+//		NULL for the kernel's own
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, bool mapImage, int trackBuffers,
+	   int writeCacheSectors, DiskDevice device, int member,
+	   char *imageName)
 {
     int magicNum;
-    int tmp = 0;
 
     DEBUG(dbgDisk, "Initializing the disk.");
+    ASSERT(SectorSize % sizeof(int) == 0 && SectorSize <= MaxSectorSize);
+    ASSERT(NumSectors <= (0x7fffffff - 64) / SectorSize);
+					// UNIX file offsets are ints
+    ASSERT(trackBuffers >= 0 && trackBuffers <= MaxTrackBuffers);
+    ASSERT(writeCacheSectors >= 0 && writeCacheSectors <= NumSectors);
     callWhenDone = toCall;
     lastSector = 0;
-    bufferInit = 0;
+    inRam = (device == DeviceRam);
+    if (device == DeviceFlash)
+	model = new FlashModel;
+    else if (device == DeviceRam)
+	model = new RamModel;
+    else
+	model = new RotatingModel(this);
+    if (inRam)
+	trackBuffers = writeCacheSectors = 0;
+
+    numBuffers = trackBuffers;
+    for (int i = 0; i < numBuffers; i++) {
+	buffers[i].track = -1;
+	buffers[i].lastUse = -1;
+    }
+    readingAhead = -1;
+    writeCacheSize = writeCacheSectors;
+    dirty = NULL;
+    if (writeCacheSize > 0)
+	dirty = new Bitmap(NumSectors);
+    numDirty = 0;
     
-    sprintf(diskname,"DISK_%d",kernel->hostName);
+    bool mounted = (imageName != NULL); // on a directory (-mount)?
+    if (!mounted)
+	imageName = kernel->diskName;
+    if (imageName != NULL) {
+	diskname = new char[strlen(imageName) + 16];
+	strcpy(diskname, imageName);
+    } else {
+	diskname = new char[32];
+	sprintf(diskname,"DISK_%d",kernel->hostName);
+    }
+    if (member > 0)
+	sprintf(diskname + strlen(diskname), ".%d", member);
+    baseFileno = -1;
+    present = NULL;
+    if (kernel->diskBase != NULL && !mounted) {
+	baseFileno = OpenForRead(kernel->diskBase, FALSE);
+	if (baseFileno < 0) {
+	    cerr << "No base disk image " << kernel->diskBase << "\n";
+	    ASSERTNOTREACHED();
+	}
+	Read(baseFileno, (char *) &magicNum, MagicSize);
+	ASSERT(magicNum == MagicNumber);
+	CheckGeometry(baseFileno, kernel->diskBase, -1);
+	present = new char[PresentBytes];
+	bzero(present, PresentBytes);
+    }
+
+    if (inRam) {
+	ASSERT(present == NULL);		// not an overlay
+	image = new char[ImageSize];
+	bzero(image, ImageSize);
+	fileno = OpenForRead(diskname, FALSE);
+	if (fileno >= 0) {
+	    Read(fileno, (char *) &magicNum, MagicSize);
+	    ASSERT(magicNum == MagicNumber);
+	    CheckGeometry(fileno, diskname, 0);
+	    Lseek(fileno, 0, 0);
+	    Read(fileno, image, ImageSize);
+	    Close(fileno);
+	}
+	fileno = -1;
+	active = FALSE;
+	return;
+    }
+
     fileno = OpenForReadWrite(diskname, FALSE);
     if (fileno >= 0) {		 	// file exists, check magic number 
 	Read(fileno, (char *) &magicNum, MagicSize);
 	ASSERT(magicNum == MagicNumber);
+	CheckGeometry(fileno, diskname, (present != NULL) ? PresentBytes : 0);
+	if (present != NULL) {
+	    Lseek(fileno, DiskSize, 0);
+	    if (kernel->restoreFile != NULL)
+		WriteFile(fileno, present, PresentBytes);
+	    else
+		Read(fileno, present, PresentBytes);
+	}
     } else {				// file doesn't exist, create it
         fileno = OpenForWrite(diskname);
 	magicNum = MagicNumber;  
 	WriteFile(fileno, (char *) &magicNum, MagicSize); // write magic number
-
-	// need to write at end of file, so that reads will not return EOF
-        Lseek(fileno, DiskSize - sizeof(int), 0);	
-	WriteFile(fileno, (char *)&tmp, sizeof(int));  
+	WriteGeometry(fileno);		// the sectors in between are a hole
+	if (present != NULL)		// the delta has no sectors yet
+	    WriteFile(fileno, present, PresentBytes);
     }
+    image = NULL;
+    if (mapImage && present == NULL)
+	image = MapFile(fileno, ImageSize);
     active = FALSE;
 }
 
 //----------------------------------------------------------------------
 // Disk::~Disk()
 // 	Clean up disk simulation, by closing the UNIX file representing the
-//	disk.
+//	disk -- once what was written to its mapping, if any, is in it.
 //----------------------------------------------------------------------
 
 Disk::~Disk()
 {
-    Close(fileno);
+    if (inRam) {
+	delete [] image;
+    } else if (image != NULL) {
+	Sync();
+	UnmapFile(image, ImageSize);
+    }
+    if (fileno >= 0)
+	Close(fileno);
+    if (baseFileno >= 0)
+	Close(baseFileno);
+    if (dirty != NULL)
+	delete dirty;
+    delete model;
+    delete [] present;
+    delete [] diskname;
+}
+
+//----------------------------------------------------------------------
+// Disk::Sync()
+// 	Make sure the sectors written so far are in the UNIX file.  Only
+//	a mapped file needs it: otherwise they are written straight to it.
+//	A RAM disk never writes them there.
+//----------------------------------------------------------------------
+
+void
+Disk::Sync()
+{
+    if (image != NULL && !inRam)
+	SyncMappedFile(image, ImageSize);
+}
+
+//----------------------------------------------------------------------
+// Disk::SaveImage()
+// 	Write at the start of the UNIX file "file" what the UNIX file of
+//	a disk that is not an overlay would hold: the magic number, every
+//	sector as it reads now, then the geometry, FileLength bytes in
+//	all.  A checkpoint starts with it, so that a disk can be made an
+//	overlay on the checkpoint (see userprog/checkpoint.h).  Whatever
+//	is in the write cache is there too: only its time is put off.
+//----------------------------------------------------------------------
+
+void
+Disk::SaveImage(int file)
+{
+    int magicNum = MagicNumber;
+    char *track = new char[SectorsPerTrack * SectorSize];
+
+    Lseek(file, 0, 0);
+    WriteFile(file, (char *) &magicNum, MagicSize);
+    for (int first = 0; first < NumSectors; first += SectorsPerTrack) {
+	ReadImage(first, SectorsPerTrack, track);
+	WriteFile(file, track, SectorsPerTrack * SectorSize);
+    }
+    WriteGeometry(file);
+    delete [] track;
+}
+
+//----------------------------------------------------------------------
+// Disk::FileLength()
+// 	Return how long the UNIX file of a disk that is not an overlay
+//	is, and so where what follows the disk in a checkpoint starts.
+//----------------------------------------------------------------------
+
+int
+Disk::FileLength()
+{
+    return DiskSize;
+}
+
+//----------------------------------------------------------------------
+// Disk::Discard()
+// 	Make every sector read as zeroes, at once (see disk.h): the UNIX
+//	file is cut back to its magic number, and the geometry written
+//	again after where the sectors go.  A mapping is made afresh, and
+//	the sectors in the write cache are dropped, since the media has
+//	nothing of them to be written.  The delta of an overlay has every
+//	sector from now on.  A RAM disk just clears its memory.
+//----------------------------------------------------------------------
+
+void
+Disk::Discard()
+{
+    ASSERT(!active);
+    DEBUG(dbgDisk, "Discarding every sector.");
+    model->Discard();
+    if (dirty != NULL) {
+	delete dirty;
+	dirty = new Bitmap(NumSectors);
+	numDirty = 0;
+    }
+    if (inRam) {
+	bzero(&image[MagicSize], NumSectors * SectorSize);
+	return;
+    }
+    if (image != NULL)
+	UnmapFile(image, ImageSize);
+    Truncate(fileno, MagicSize);
+    WriteGeometry(fileno);
+    if (present != NULL) {
+	memset(present, 0xff, PresentBytes);
+	WriteFile(fileno, present, PresentBytes);
+    }
+    if (image != NULL)
+	image = MapFile(fileno, ImageSize);
+}
+
+//----------------------------------------------------------------------
+// Disk::InDelta()
+// 	Return whether the delta of an overlay has "sector"; if not, it
+//	is read from the base image.
+//----------------------------------------------------------------------
+
+bool
+Disk::InDelta(int sector)
+{
+    return (present[sector / BitsInByte] >> (sector % BitsInByte)) & 1;
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadImage/WriteImage()
+// 	Move "numSectors" sectors, starting at "firstSector", between
+//	"data" and where they are kept: the mapping, the UNIX file, or
+//	for an overlay, the delta or the base image, a run at a time.
+//	Writing to an overlay records the sectors as being in the delta,
+//	in the delta itself, so they are there when it is next used.
+//----------------------------------------------------------------------
+
+void
+Disk::ReadImage(int firstSector, int numSectors, char *data)
+{
+    int i, run, from;
+
+    if (image != NULL) {
+	bcopy(&image[SectorSize * firstSector + MagicSize], data,
+						SectorSize * numSectors);
+	return;
+    }
+    for (i = 0; i < numSectors; i += run) {
+	from = fileno;
+	run = numSectors - i;
+	if (present != NULL) {
+	    bool inDelta = InDelta(firstSector + i);
+
+	    for (run = 1; i + run < numSectors
+			&& InDelta(firstSector + i + run) == inDelta; run++)
+		;
+	    if (!inDelta)
+		from = baseFileno;
+	}
+	Lseek(from, SectorSize * (firstSector + i) + MagicSize, 0);
+	Read(from, &data[SectorSize * i], SectorSize * run);
+    }
+}
+
+void
+Disk::WriteImage(int firstSector, int numSectors, char *data)
+{
+    int first, last;
+
+    if (image != NULL) {
+	bcopy(data, &image[SectorSize * firstSector + MagicSize],
+						SectorSize * numSectors);
+	return;
+    }
+    Lseek(fileno, SectorSize * firstSector + MagicSize, 0);
+    WriteFile(fileno, data, SectorSize * numSectors);
+    if (present != NULL) {
+	for (int i = firstSector; i < firstSector + numSectors; i++)
+	    present[i / BitsInByte] |= 1 << (i % BitsInByte);
+	first = firstSector / BitsInByte;
+	last = (firstSector + numSectors - 1) / BitsInByte;
+	Lseek(fileno, DiskSize + first, 0);
+	WriteFile(fileno, &present[first], last - first + 1);
+    }
+}
+
+//----------------------------------------------------------------------
+// Disk::CheckGeometry()
+// 	Make sure the existing UNIX file was made for a disk of the
+//	geometry we were compiled with: it is the right size, and records
+//	the same geometry -- or, for a file from before geometries were
+//	recorded, that the geometry is the original one.
+//
+//	"file", "name" -- the open UNIX file, and what it is called
+//	"extra" -- how many bytes it has after the geometry (the map of
+//		the sectors that the delta of an overlay has); -1 if it
+//		may have any number, as the base image of an overlay may
+//		(a checkpoint has the machine's state there)
+//----------------------------------------------------------------------
+
+void
+Disk::CheckGeometry(int file, char *name, int extra)
+{
+    int geometry[GeometryWords];
+    int length;
+    bool ok;
+
+    Lseek(file, 0, 2);
+    length = Tell(file);
+    if (extra == 0
+	    && length == MagicSize + OldNumTracks * OldSectorsPerTrack * OldSectorSize) {
+	ok = (SectorSize == OldSectorSize
+		&& SectorsPerTrack == OldSectorsPerTrack
+		&& NumTracks == OldNumTracks);
+    } else {
+	ok = (extra < 0) ? (length >= DiskSize)
+			 : (length == DiskSize + extra);
+	if (ok) {
+	    Lseek(file, ImageSize, 0);
+	    Read(file, (char *) geometry, sizeof(geometry));
+	    ok = (geometry[0] == GeometryMagic && geometry[1] == SectorSize
+		    && geometry[2] == SectorsPerTrack && geometry[3] == NumTracks);
+	}
+    }
+    if (!ok) {
+	cerr << name << " is not a disk";
+	if (extra > 0)
+	    cerr << " overlay";
+	cerr << " of " << NumTracks << " tracks of "
+	     << SectorsPerTrack << " sectors of " << SectorSize
+	     << " bytes; remove it to start a new one\n";
+	ASSERTNOTREACHED();
+    }
 }
 
 //----------------------------------------------------------------------
@@ -113,42 +472,158 @@ PrintSector (bool writing, int sector, char *data)
 void
 Disk::ReadRequest(int sectorNumber, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    ReadRequest(sectorNumber, 1, data);
+}
+
+void
+Disk::WriteRequest(int sectorNumber, char* data)
+{
+    WriteRequest(sectorNumber, 1, data);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadRequest/WriteRequest
+// 	Simulate a request to read/write a run of consecutive sectors.
+//	As far as the caller is concerned, this is one request: one
+//	interrupt signals that all of the sectors have been transferred.
+//
+//	"firstSector" -- the first disk sector to read/write
+//	"numSectors" -- how many sectors, starting at firstSector
+//	"data" -- the bytes to be written, the buffer to hold the incoming
+//		bytes; numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+Disk::ReadRequest(int firstSector, int numSectors, char* data)
+{
+    int ticks;
 
     ASSERT(!active);				// only one request at a time
-    ASSERT((sectorNumber < NumSectors));
-    ASSERT((sectorNumber >= 0));
+    ASSERT(numSectors > 0);
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+
+    if (InCache(firstSector, numSectors)) {
+	ticks = RotationTime;		// time to transfer from RAM
+	kernel->stats->numDiskBufferHits += numSectors;
+	DEBUG(dbgDisk, "Read served from the disk's cache");
+    } else {
+	ticks = ReadAheadTime(firstSector, numSectors);
+	if (ticks < 0)
+	    ticks = model->Transfer(firstSector, numSectors, FALSE,
+				    kernel->stats->totalTicks);
+    }
     
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
+    DEBUG(dbgDisk, "Reading " << numSectors << " sectors from sector " << firstSector);
+    TRACE(TraceDiskRead, firstSector, numSectors);
+    ReadImage(firstSector, numSectors, data);
     if (debug->IsEnabled('d'))
-	PrintSector(FALSE, sectorNumber, data);
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(FALSE, firstSector + i, &data[i * SectorSize]);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskReads++;
+    kernel->stats->numDiskReads += numSectors;
+    kernel->stats->diskRequestTicks.Add(ticks);
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
 void
-Disk::WriteRequest(int sectorNumber, char* data)
+Disk::WriteRequest(int firstSector, int numSectors, char* data)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    WriteRequest(firstSector, numSectors, data, FALSE, FALSE);
+}
+
+//----------------------------------------------------------------------
+// Disk::WriteRequest
+// 	Simulate a write of a run of consecutive sectors, as above, that
+//	may also ask for the order it reaches the media in.
+//
+//	"flushFirst" -- destage what is in the write cache before the
+//		sectors are written (the preflush of a barrier)
+//	"forceUnit" -- write the sectors to the media, not to the write
+//		cache (FUA); the interrupt comes once they are there
+//----------------------------------------------------------------------
+
+void
+Disk::WriteRequest(int firstSector, int numSectors, char* data,
+		   bool flushFirst, bool forceUnit)
+{
+    Ticks now = kernel->stats->totalTicks;
+    int ticks, fresh, i;
 
     ASSERT(!active);
-    DEBUG(dbgDisk, "Before Writing to sector " << sectorNumber);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    ASSERT(numSectors > 0);
+    ASSERT((firstSector >= 0) && (firstSector + numSectors <= NumSectors));
+
+    ticks = 0;
+    if (flushFirst && writeCacheSize > 0) {
+	DEBUG(dbgDisk, "Flushing " << numDirty << " sectors before a barrier");
+	ticks = Destage(now);
+	kernel->stats->numDiskFlushes++;
+    }
+    if (forceUnit && writeCacheSize > 0)
+	kernel->stats->numDiskForcedWrites += numSectors;
+
+    if (numSectors <= writeCacheSize && !forceUnit) {
+	fresh = 0;			// sectors not in the cache already
+	for (i = firstSector; i < firstSector + numSectors; i++) {
+	    if (!dirty->Test(i))
+		fresh++;
+	}
+	if (numDirty + fresh > writeCacheSize)
+	    ticks += Destage(now + ticks);	// make room first
+	for (i = firstSector; i < firstSector + numSectors; i++) {
+	    if (!dirty->Test(i)) {
+		dirty->Mark(i);
+		numDirty++;
+	    }
+	}
+	ticks += RotationTime;		// time to transfer to RAM
+	kernel->stats->numDiskCachedWrites += numSectors;
+    } else {
+	ticks += model->Transfer(firstSector, numSectors, TRUE, now + ticks);
+	for (i = firstSector; dirty != NULL && i < firstSector + numSectors; i++) {
+	    if (dirty->Test(i)) {	// now on the media anyway
+		dirty->Clear(i);
+		numDirty--;
+	    }
+	}
+    }
     
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    DEBUG(dbgDisk, "Writing " << numSectors << " sectors to sector " << firstSector);
+    TRACE(TraceDiskWrite, firstSector, numSectors);
+    WriteImage(firstSector, numSectors, data);
     if (debug->IsEnabled('d'))
-	PrintSector(TRUE, sectorNumber, data);
+	for (int i = 0; i < numSectors; i++)
+	    PrintSector(TRUE, firstSector + i, &data[i * SectorSize]);
     
     active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskWrites++;
+    kernel->stats->numDiskWrites += numSectors;
+    kernel->stats->diskRequestTicks.Add(ticks);
+    kernel->interrupt->Schedule(this, ticks, DiskInt);
+}
+
+//----------------------------------------------------------------------
+// Disk::FlushRequest
+// 	Simulate a request to write everything in the write cache to the
+//	media.  The interrupt comes once it is all there; until then the
+//	sectors written before the request might not survive a crash of
+//	a real disk.  A disk without a write cache has nothing to do,
+//	beyond taking the request.
+//----------------------------------------------------------------------
+
+void
+Disk::FlushRequest()
+{
+    Ticks now = kernel->stats->totalTicks;
+    int ticks;
+
+    ASSERT(!active);
+    DEBUG(dbgDisk, "Flushing " << numDirty << " sectors from the write cache");
+    ticks = Destage(now) + RotationTime;
+
+    active = TRUE;
+    kernel->stats->numDiskFlushes++;
+    kernel->stats->diskRequestTicks.Add(ticks);
     kernel->interrupt->Schedule(this, ticks, DiskInt);
 }
 
@@ -167,22 +642,23 @@ Disk::CallBack ()
 //----------------------------------------------------------------------
 // Disk::TimeToSeek()
 //	Returns how long it will take to position the disk head over the correct
-//	track on the disk.  Since when we finish seeking, we are likely
-//	to be in the middle of a sector that is rotating past the head,
-//	we also return how long until the head is at the next sector boundary.
+//	track on the disk, for a request started at tick "when".  Since
+//	when we finish seeking, we are likely to be in the middle of a
+//	sector that is rotating past the head, we also return how long
+//	until the head is at the next sector boundary.
 //	
 //   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
 //   	and rotates at one sector per RotationTime ticks
 //----------------------------------------------------------------------
 
 int
-Disk::TimeToSeek(int newSector, int *rotation) 
+Disk::TimeToSeek(int newSector, Ticks when, int *rotation) 
 {
     int newTrack = newSector / SectorsPerTrack;
     int oldTrack = lastSector / SectorsPerTrack;
     int seek = abs(newTrack - oldTrack) * SeekTime;
 				// how long will seek take?
-    int over = (kernel->stats->totalTicks + seek) % RotationTime; 
+    int over = (int) ((when + seek) % RotationTime); 
 				// will we be in the middle of a sector when
 				// we finish the seek?
 
@@ -210,7 +686,28 @@ Disk::ModuloDiff(int to, int from)
 //----------------------------------------------------------------------
 // Disk::ComputeLatency()
 // 	Return how long will it take to read/write a disk sector, from
-//	the current position of the disk head.
+//	the current position of the disk head, if the disk had to go to
+//	the media for it.
+//----------------------------------------------------------------------
+
+int
+Disk::ComputeLatency(int newSector, bool writing)
+{
+    return ComputeLatency(newSector, 1, writing);
+}
+
+int
+Disk::ComputeLatency(int firstSector, int numSectors, bool writing)
+{
+    return model->Latency(firstSector, numSectors, writing,
+			  kernel->stats->totalTicks);
+}
+
+//----------------------------------------------------------------------
+// Disk::MediaLatency()
+// 	Return how long it will take to read/write "numSectors"
+//	consecutive sectors starting at "firstSector" on the media, for a
+//	request started at tick "when".
 //
 //   	Latency = seek time + rotational latency + transfer time
 //   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
@@ -218,53 +715,448 @@ Disk::ModuloDiff(int to, int from)
 //
 //   	To find the rotational latency, we first must figure out where the 
 //   	disk head will be after the seek (if any).  We then figure out
-//   	how long it will take to rotate completely past newSector after 
-//	that point.
+//   	how long it will take to rotate to firstSector after that point.
+//	After that the sectors pass under the head one per RotationTime
+//	ticks.  Going from the end of one track to the start of the next
+//	is a one track seek, which (with the track skew of a real disk)
+//	we count as SeekTime.
+//----------------------------------------------------------------------
+
+int
+Disk::MediaLatency(int firstSector, int numSectors, Ticks when)
+{
+    int seek, rotation, transfer;
+
+    return MediaParts(firstSector, numSectors, when, &seek, &rotation,
+		      &transfer);
+}
+
+//----------------------------------------------------------------------
+// Disk::MediaParts
+// 	Return what MediaLatency does, and split it into its parts: the
+//	time spent seeking (the track changes within the run included),
+//	waiting for the first sector to come round, and passing over the
+//	sectors.
+//----------------------------------------------------------------------
+
+int
+Disk::MediaParts(int firstSector, int numSectors, Ticks when,
+		 int *seek, int *rotation, int *transfer)
+{
+    int endSector = firstSector + numSectors - 1;
+    int trackChanges = endSector / SectorsPerTrack - firstSector / SectorsPerTrack;
+    Ticks timeAfter;
+    int latency;
+
+    *seek = TimeToSeek(firstSector, when, rotation);
+    timeAfter = when + *seek + *rotation;
+    *rotation += ModuloDiff(firstSector,
+			    (int) (timeAfter / RotationTime % SectorsPerTrack))
+		 * RotationTime;
+    *seek += trackChanges * SeekTime;
+    *transfer = numSectors * RotationTime;
+    latency = *seek + *rotation + *transfer;
+
+    DEBUG(dbgDisk, "Request latency = " << latency);
+    return latency;
+}
+
+//----------------------------------------------------------------------
+// Disk::MediaTransfer
+// 	Return how long it takes to transfer a run of sectors to or from
+//	the media, for a request started at tick "when", and remember
+//	that the head is left at the end of it.
 //
-//   	The disk also has a "track buffer"; the disk continuously reads
-//   	the contents of the current disk track into the buffer.  This allows 
-//   	read requests to the current track to be satisfied more quickly.
-//   	The contents of the track buffer are discarded after every seek to 
-//   	a new track.
+//	Whatever the head passes over on the last track goes into a track
+//	buffer, from the moment it gets there until it is sent elsewhere
+//	-- so the sectors just transferred, and the ones after them.  A
+//	request on the track being read ahead leaves the buffer as it is.
 //----------------------------------------------------------------------
 
 int
-Disk::ComputeLatency(int newSector, bool writing)
+Disk::MediaTransfer(int firstSector, int numSectors, Ticks when)
 {
-    int rotation;
-    int seek = TimeToSeek(newSector, &rotation);
-    int timeAfter = kernel->stats->totalTicks + seek + rotation;
-
-#ifndef NOTRACKBUF	// turn this on if you don't want the track buffer stuff
-    // check if track buffer applies
-    if ((writing == FALSE) && (seek == 0) 
-		&& (((timeAfter - bufferInit) / RotationTime) 
-	     		> ModuloDiff(newSector, bufferInit / RotationTime))) {
-        DEBUG(dbgDisk, "Request latency = " << RotationTime);
-	return RotationTime; // time to transfer sector from the track buffer
+    int firstTrack = firstSector / SectorsPerTrack;
+    int lastTrack = (firstSector + numSectors - 1) / SectorsPerTrack;
+    int seek, rotation, latency;
+    Ticks arrival;
+    int seekPart, rotationPart, transferPart;
+    bool sameTrack = (readingAhead >= 0 && firstTrack == lastTrack
+			&& buffers[readingAhead].track == firstTrack);
+
+    seek = TimeToSeek(firstSector, when, &rotation);
+    latency = MediaParts(firstSector, numSectors, when, &seekPart,
+			 &rotationPart, &transferPart);
+    kernel->stats->diskSeekTicks.Add(seekPart);
+    kernel->stats->diskRotationTicks.Add(rotationPart);
+    kernel->stats->diskTransferTicks.Add(transferPart);
+    lastSector = firstSector + numSectors - 1;
+    DEBUG(dbgDisk, "Updating last sector = " << lastSector);
+
+    if (sameTrack) {
+	buffers[readingAhead].lastUse = when;
+    } else {
+	StopReadAhead(when);
+	if (firstTrack == lastTrack) {
+	    arrival = when + seek + rotation;
+	} else {
+	    arrival = when + latency
+		- (lastSector % SectorsPerTrack + 1) * RotationTime;
+	}
+	StartReadAhead(lastTrack, arrival);
     }
-#endif
+    return latency;
+}
 
-    rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
+//----------------------------------------------------------------------
+// TrackBuffer::Holds
+// 	Return TRUE if "sector" had passed under the head, and so been
+//	read into the buffer, by tick "now".  The sectors come in order
+//	from firstOffset, one each RotationTime, wrapping around the
+//	track.
+//----------------------------------------------------------------------
+
+bool
+TrackBuffer::Holds(int sector, Ticks now)
+{
+    Ticks end = (loadEnd < 0) ? now : loadEnd;
+    Ticks passed;
+
+    if (track != sector / SectorsPerTrack || end < loadStart)
+	return FALSE;
+    passed = (end - loadStart) / RotationTime;
+    return passed >= SectorsPerTrack
+	|| ((sector % SectorsPerTrack) - firstOffset + SectorsPerTrack)
+		% SectorsPerTrack < passed;
+}
+
+//----------------------------------------------------------------------
+// Disk::BufferHolding
+// 	Return which track buffer holds "sector" at tick "now", or -1 if
+//	none does.
+//----------------------------------------------------------------------
 
-    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + RotationTime));
-    return(seek + rotation + RotationTime);
+int
+Disk::BufferHolding(int sector, Ticks now)
+{
+    for (int i = 0; i < numBuffers; i++) {
+	if (buffers[i].Holds(sector, now))
+	    return i;
+    }
+    return -1;
 }
 
 //----------------------------------------------------------------------
-// Disk::UpdateLast
-//   	Keep track of the most recently requested sector.  So we can know
-//	what is in the track buffer.
+// Disk::InCache
+// 	Return TRUE if a read of a run of sectors can be answered without
+//	going to the media: each sector is either waiting in the write
+//	cache, or in a track buffer.  The buffers used count as used now.
+//----------------------------------------------------------------------
+
+bool
+Disk::InCache(int firstSector, int numSectors)
+{
+    Ticks now = kernel->stats->totalTicks;
+    int i, which;
+
+    for (i = firstSector; i < firstSector + numSectors; i++) {
+	if ((dirty == NULL || !dirty->Test(i)) && BufferHolding(i, now) < 0)
+	    return FALSE;
+    }
+    for (i = firstSector; i < firstSector + numSectors; i++) {
+	which = BufferHolding(i, now);
+	if (which >= 0)
+	    buffers[which].lastUse = now;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadAheadTime
+// 	If a read of a run of sectors is on the track being read ahead,
+//	it can wait for the sectors not in the buffer yet to come in,
+//	rather than start again: return how long that takes.  Return -1
+//	if the run is not on that track.
+//----------------------------------------------------------------------
+
+int
+Disk::ReadAheadTime(int firstSector, int numSectors)
+{
+    Ticks now = kernel->stats->totalTicks;
+    Ticks lastReady = now;
+    TrackBuffer *buffer;
+    Ticks ready;
+    int i;
+
+    if (readingAhead < 0)
+	return -1;
+    buffer = &buffers[readingAhead];
+    if (buffer->track != firstSector / SectorsPerTrack
+	    || buffer->track != (firstSector + numSectors - 1) / SectorsPerTrack)
+	return -1;
+    for (i = firstSector; i < firstSector + numSectors; i++) {
+	ready = buffer->loadStart
+		+ (ModuloDiff(i, buffer->firstOffset) + 1) * RotationTime;
+	if (ready > lastReady && !buffer->Holds(i, now))
+	    lastReady = ready;
+    }
+    buffer->lastUse = now;
+    DEBUG(dbgDisk, "Read waits " << (lastReady - now) << " for read-ahead");
+    return (int) max(lastReady - now, (Ticks) RotationTime);
+}
+
+//----------------------------------------------------------------------
+// Disk::StartReadAhead
+// 	The head has reached "track" at tick "when", and is reading it
+//	into a track buffer: the one already holding the track, if any,
+//	or else the least recently used.
 //----------------------------------------------------------------------
 
 void
-Disk::UpdateLast(int newSector)
+Disk::StartReadAhead(int track, Ticks when)
 {
-    int rotate;
-    int seek = TimeToSeek(newSector, &rotate);
-    
-    if (seek != 0)
-	bufferInit = kernel->stats->totalTicks + seek + rotate;
-    lastSector = newSector;
-    DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
+    int which = -1;
+    int i;
+
+    if (numBuffers == 0)
+	return;
+    for (i = 0; i < numBuffers; i++) {
+	if (buffers[i].track == track) {
+	    which = i;
+	    break;
+	}
+	if (which < 0 || buffers[i].lastUse < buffers[which].lastUse)
+	    which = i;
+    }
+    buffers[which].track = track;
+    buffers[which].loadStart = when;
+    buffers[which].firstOffset = (int) ((when / RotationTime) % SectorsPerTrack);
+    buffers[which].loadEnd = -1;
+    buffers[which].lastUse = when;
+    readingAhead = which;
+}
+
+//----------------------------------------------------------------------
+// Disk::StopReadAhead
+// 	The head is being sent elsewhere at tick "when": the track buffer
+//	being read into keeps only what the head has passed over so far.
+//----------------------------------------------------------------------
+
+void
+Disk::StopReadAhead(Ticks when)
+{
+    if (readingAhead >= 0) {
+	buffers[readingAhead].loadEnd = when;
+	readingAhead = -1;
+    }
+}
+
+//----------------------------------------------------------------------
+// Disk::Destage
+// 	Write every sector in the write cache to the media, starting at
+//	tick "when", and return how long it takes.  We go in sector
+//	order, so the head sweeps across once, and each run of
+//	consecutive sectors is written in one pass.
+//----------------------------------------------------------------------
+
+int
+Disk::Destage(Ticks when)
+{
+    Ticks time = when;
+    int first, run;
+
+    if (numDirty == 0)
+	return 0;
+    for (first = 0; numDirty > 0; first += run) {
+	for (run = 0; first + run < NumSectors && dirty->Test(first + run); run++)
+	    dirty->Clear(first + run);
+	if (run > 0) {
+	    time += model->Transfer(first, run, TRUE, time);
+	    numDirty -= run;
+	    kernel->stats->numDiskDestaged += run;
+	} else {
+	    run = 1;
+	}
+    }
+    return (int) (time - when);
+}
+
+//----------------------------------------------------------------------
+// DiskModel::ParseDevice
+// 	Translate the name of a model of the media, as given on the
+//	command line, into a DiskDevice.  Return FALSE if the name is not
+//	known.
+//----------------------------------------------------------------------
+
+bool
+DiskModel::ParseDevice(char *name, DiskDevice *device)
+{
+    if (strcmp(name, "rotating") == 0)
+	*device = DeviceRotating;
+    else if (strcmp(name, "flash") == 0)
+	*device = DeviceFlash;
+    else if (strcmp(name, "ram") == 0)
+	*device = DeviceRam;
+    else
+	return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// RotatingModel::Latency/Transfer
+// 	Time a transfer on a rotating disk, with the disk's own head and
+//	track buffers.  Reads and writes take the same time.
+//----------------------------------------------------------------------
+
+int
+RotatingModel::Latency(int firstSector, int numSectors, bool writing, Ticks when)
+{
+    return disk->MediaLatency(firstSector, numSectors, when);
+}
+
+int
+RotatingModel::Transfer(int firstSector, int numSectors, bool writing, Ticks when)
+{
+    return disk->MediaTransfer(firstSector, numSectors, when);
+}
+
+//----------------------------------------------------------------------
+// RamModel::Latency/Transfer
+// 	Time a transfer on a RAM disk: RamDiskTime, however many sectors
+//	there are.
+//----------------------------------------------------------------------
+
+int
+RamModel::Latency(int firstSector, int numSectors, bool writing, Ticks when)
+{
+    return RamDiskTime;
+}
+
+int
+RamModel::Transfer(int firstSector, int numSectors, bool writing, Ticks when)
+{
+    return RamDiskTime;
+}
+
+//----------------------------------------------------------------------
+// FlashModel::FlashModel
+// 	Initialize a flash device with every block erased.  The disk must
+//	split evenly into blocks on each channel.
+//----------------------------------------------------------------------
+
+FlashModel::FlashModel()
+{
+    int numBlocks = NumSectors / FlashBlockPages;
+
+    ASSERT(NumSectors % (FlashChannels * FlashBlockPages) == 0);
+    programmed = new int[numBlocks];
+    for (int i = 0; i < numBlocks; i++)
+	programmed[i] = 0;
+}
+
+FlashModel::~FlashModel()
+{
+    delete [] programmed;
+}
+
+//----------------------------------------------------------------------
+// FlashModel::Discard
+// 	Every sector has been discarded, so every block is erased, with
+//	no pages in use to move: as for a new device.
+//----------------------------------------------------------------------
+
+void
+FlashModel::Discard()
+{
+    for (int i = 0; i < NumSectors / FlashBlockPages; i++)
+	programmed[i] = 0;
+}
+
+//----------------------------------------------------------------------
+// FlashModel::Block
+// 	Return the erase block that holds "sector".  Sector "s" is on
+//	channel s % FlashChannels, as page s / FlashChannels of it, and
+//	each channel's pages are grouped FlashBlockPages to a block.
+//----------------------------------------------------------------------
+
+int
+FlashModel::Block(int sector)
+{
+    int blocksPerChannel = NumSectors / (FlashChannels * FlashBlockPages);
+
+    return (sector % FlashChannels) * blocksPerChannel
+		+ (sector / FlashChannels) / FlashBlockPages;
+}
+
+//----------------------------------------------------------------------
+// FlashModel::Latency/Transfer
+// 	Time a transfer on a flash disk.  It does not matter where the
+//	last one was, or when this one starts; but a write uses up erased
+//	pages, and so changes what later ones take.
+//----------------------------------------------------------------------
+
+int
+FlashModel::Latency(int firstSector, int numSectors, bool writing, Ticks when)
+{
+    return Cost(firstSector, numSectors, writing, FALSE);
+}
+
+int
+FlashModel::Transfer(int firstSector, int numSectors, bool writing, Ticks when)
+{
+    return Cost(firstSector, numSectors, writing, TRUE);
+}
+
+//----------------------------------------------------------------------
+// FlashModel::Cost
+// 	Return how long a transfer of "numSectors" from "firstSector"
+//	takes: starting it, and then the time of the busiest channel.
+//	Each channel reads or programs its pages one after another,
+//	erasing a block first when a page is to be written in it and all
+//	of its pages have been.  The pages of one channel in a run are
+//	consecutive, so it never comes back to a block it has left.
+//
+//	"commit" -- the transfer is really being done: remember the
+//		pages written, and count the blocks erased
+//----------------------------------------------------------------------
+
+int
+FlashModel::Cost(int firstSector, int numSectors, bool writing, bool commit)
+{
+    int longest = 0;
+
+    for (int c = 0; c < FlashChannels; c++) {
+	int first = firstSector
+		+ (c - firstSector % FlashChannels + FlashChannels) % FlashChannels;
+	int time = 0;
+	int block = -1;
+	int used = 0;			// pages of "block" written
+
+	for (int s = first; s < firstSector + numSectors; s += FlashChannels) {
+	    if (!writing) {
+		time += FlashReadTime;
+		continue;
+	    }
+	    if (Block(s) != block) {
+		if (commit && block >= 0)
+		    programmed[block] = used;
+		block = Block(s);
+		used = programmed[block];
+	    }
+	    if (used == FlashBlockPages) {
+		DEBUG(dbgDisk, "Erasing flash block " << block);
+		time += FlashEraseTime;
+		used = 0;
+		if (commit)
+		    kernel->stats->numDiskErases++;
+	    }
+	    time += FlashProgramTime;
+	    used++;
+	}
+	if (commit && block >= 0)
+	    programmed[block] = used;
+	longest = max(longest, time);
+    }
+    DEBUG(dbgDisk, "Flash request latency = " << FlashCommandTime + longest);
+    return FlashCommandTime + longest;
 }
@@ -20,6 +20,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "callback.h"
+#include "bitmap.h"
 
 // The following class defines a physical disk I/O device.  The disk
 // has a single surface, split up into "tracks", and each track split
@@ -34,30 +35,241 @@
 // and an interrupt is invoked later to signal that the operation completed.
 //
 // The physical disk is in fact simulated via operations on a UNIX file.
+// Or, for long simulations, the file can be mapped into memory, so that
+// reading or writing sectors is a copy rather than a pair of UNIX calls;
+// the simulated time each request takes is the same either way.
 //
-// To make life a little more realistic, the simulated time for
-// each operation reflects a "track buffer" -- RAM to store the contents
-// of the current track as the disk head passes by.  The idea is that the
-// disk always transfers to the track buffer, in case that data is requested
-// later on.  This has the benefit of eliminating the need for 
-// "skip-sector" scheduling -- a read request which comes in shortly after 
-// the head has passed the beginning of the sector can be satisfied more 
-// quickly, because its contents are in the track buffer.  Most 
-// disks these days now come with a track buffer.
-//
-// The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
-
-const int SectorSize = 128;		// number of bytes per disk sector
-const int SectorsPerTrack  = 32;	// number of sectors per disk track 
-const int NumTracks = 32;		// number of tracks per disk
+// To make life a little more realistic, the simulated disk has a cache
+// of its own, like most disks these days:
+//
+//   Track buffers -- RAM holding the contents of recently used tracks.
+//   After reading or writing, the disk goes on transferring the rest of
+//   the track into a buffer as the head passes over it ("read-ahead"),
+//   until it is sent somewhere else.  A read of sectors that are all in the
+//   buffers is answered without touching the media, in RotationTime.
+//   This also does away with the need for "skip-sector" scheduling:
+//   a read that comes in just after the head has passed its sector is
+//   satisfied from the buffer, rather than waiting a whole rotation.
+//   The least recently used buffer is the one read-ahead goes into.
+//
+//   Write cache -- RAM holding sectors written but not yet on the
+//   media.  A write that fits is acknowledged in RotationTime; the
+//   sectors are written to the media ("destaged"), in sector order,
+//   when the cache is full or a flush request asks for it.  The
+//   simulated cache never loses what it holds: the sectors reach the
+//   UNIX file right away, it is only the time they take that is put
+//   off.  A write can also ask for the cache to be flushed before it
+//   ("preflush"), and to go to the media itself, past the cache
+//   ("force unit access"); then it is on the media, after everything
+//   written before it, when its interrupt comes.
+//
+// The number of track buffers, and the size of the write cache in
+// sectors, are arguments to the constructor; by default there is one
+// buffer and no write cache.  Compiling with -DNOTRACKBUF makes the
+// default no buffers.  Statistics counts how much each one saves.
+//
+// For quick test setup, the disk can also be an "overlay" on a base
+// image (an ordinary disk file, made beforehand): the base is only
+// read, and every sector written goes to the disk's own UNIX file, the
+// "delta", which remembers which sectors it has.  A sector the delta
+// does not have is read from the base.  So a run can start from a
+// prepared disk at once, and throw its changes away by removing the
+// delta.  An overlay is never mapped into memory.
+//
+// How long the media takes for a transfer is up to the disk's model
+// (a DiskModel), which can be one of:
+//
+//   Rotating -- the default: a head that seeks across tracks, at
+//   SeekTime a track, then waits while the sectors rotate past it, at
+//   RotationTime a sector.  The track buffers are filled as it goes.
+//
+//   Flash -- like an SSD: nothing moves, so there is no seek and no
+//   rotation, and the track buffers are never filled.  Each sector is
+//   a page, read in FlashReadTime or programmed in FlashProgramTime.
+//   The pages are striped across FlashChannels channels, sector by
+//   sector, and the channels work at the same time, so a run of
+//   sectors takes about as long as its share on one channel.  A page
+//   can only be programmed once after the block of FlashBlockPages
+//   pages it is in has been erased, in FlashEraseTime.  We take it that
+//   the device writes each block's pages out of place, as its
+//   translation layer would, so a block is erased each time all of its
+//   pages have been written; moving the pages still in use is left
+//   out.  Every block starts out erased.
+//
+//   RAM -- a RAM disk, for scratch data: the sectors are kept in
+//   memory, and every transfer takes RamDiskTime, the least there is.
+//   It starts with what its UNIX file holds, if there is one, but
+//   never writes to it: what is written is gone when Nachos stops.
+//   So a RAM disk is usually formatted (-f) in the run that uses it.
+//
+// Any disk can also be "discarded" all at once, the way a file system
+// being made TRIMs a whole SSD: every sector then reads as zeroes.  The
+// UNIX file is cut short and made long again, so it is a sparse file,
+// and it takes no time however big the disk is; for an overlay, the
+// delta then has every sector, as zeroes.  It takes no simulated time
+// either, and there is no interrupt: the disk must be idle.
+//
+// The geometry of the disk can be set when compiling, for instance with
+// -DSECTOR_SIZE=1024 -DNUM_TRACKS=1024; the file system's limits (the
+// size of its file headers, of the free map, of the largest file) all
+// follow from it.  Sectors can be up to 4KB, and the disk up to 2GB.
+// The geometry is recorded in the UNIX file when it is created, and a
+// Nachos built for one geometry will not use a disk made by another.
+// Each build is so specialized to its geometry: every limit is a
+// constant, and the sector size a shift (see SectorShift).
+
+#ifndef SECTOR_SIZE
+#define SECTOR_SIZE 128
+#endif
+#ifndef SECTORS_PER_TRACK
+#define SECTORS_PER_TRACK 32
+#endif
+#ifndef NUM_TRACKS
+#define NUM_TRACKS 32
+#endif
+
+const int SectorSize = SECTOR_SIZE;	// number of bytes per disk sector
+const int SectorsPerTrack  = SECTORS_PER_TRACK;
+					// number of sectors per disk track 
+const int NumTracks = NUM_TRACKS;	// number of tracks per disk
 const int NumSectors = (SectorsPerTrack * NumTracks);
 					// total # of sectors per disk
+const int MaxSectorSize = 4096;		// the largest SectorSize allowed
+
+// SectorSize is a power of two, so the sector a byte of a file is in,
+// and where in it, take a shift and a mask, both folded into constants
+// for the geometry the kernel is built for: no division on the paths
+// that translate file offsets, at any sector size.  Offsets are never
+// negative.
+typedef char SectorSizeIsAPowerOfTwo[((SectorSize & (SectorSize - 1)) == 0
+				      && SectorSize <= MaxSectorSize) ? 1 : -1];
+const int SectorShift = (SectorSize >= 4096) ? 12 : (SectorSize >= 2048) ? 11
+		      : (SectorSize >= 1024) ? 10 : (SectorSize >= 512) ? 9
+		      : (SectorSize >= 256) ? 8 : (SectorSize >= 128) ? 7
+		      : (SectorSize >= 64) ? 6 : (SectorSize >= 32) ? 5 : 4;
+					// log2(SectorSize)
+inline int SectorOf(int offset) { return offset >> SectorShift; }
+inline int InSector(int offset) { return offset & (SectorSize - 1); }
+				// offset / SectorSize, offset % SectorSize
+const int MaxTrackBuffers = 16;		// the most track buffers a disk has
+
+#ifdef NOTRACKBUF
+const int DefaultTrackBuffers = 0;
+#else
+const int DefaultTrackBuffers = 1;
+#endif
+
+const int FlashChannels = 4;		// channels a flash disk stripes over
+const int FlashBlockPages = 32;		// pages (sectors) in an erase block
+
+enum DiskDevice { DeviceRotating, DeviceFlash, DeviceRam };
+					// the models of the media there are
+
+class Disk;
+
+// The following class defines one track buffer: which track it holds,
+// and when the head started and stopped reading it in.  The sectors in
+// it are the ones that passed under the head in between.
+
+class TrackBuffer {
+  public:
+    int track;				// -1 if the buffer is empty
+    Ticks loadStart;			// when the head started reading it
+    int firstOffset;			// the sector it started with
+    Ticks loadEnd;			// when the head left; -1 while it
+					// is still reading it
+    Ticks lastUse;			// when a request last used it
+
+    bool Holds(int sector, Ticks now);	// has "sector" been read in by "now"?
+};
+
+// The following class defines how long the media of a disk takes for a
+// transfer.  It is an abstract class, with one subclass for each kind
+// of device.
+
+class DiskModel {
+  public:
+    virtual ~DiskModel() {}
+
+    virtual int Latency(int firstSector, int numSectors, bool writing,
+			Ticks when) = 0;
+					// How long would a transfer take,
+					// if it were started at "when"?
+    virtual int Transfer(int firstSector, int numSectors, bool writing,
+			 Ticks when) = 0;
+					// The same, for a transfer that is
+					// started then: the device moves on
+					// to where it leaves it
+    virtual void Discard() {}		// Every sector has been discarded
+
+    static bool ParseDevice(char *name, DiskDevice *device);
+					// translate a -dmodel argument
+};
+
+// A rotating disk: the head, the track buffers it reads ahead into,
+// and their timing are the disk's own, and so this model leaves them
+// to it.
+
+class RotatingModel : public DiskModel {
+  public:
+    RotatingModel(Disk *d) { disk = d; }
+
+    int Latency(int firstSector, int numSectors, bool writing, Ticks when);
+    int Transfer(int firstSector, int numSectors, bool writing, Ticks when);
+
+  private:
+    Disk *disk;
+};
+
+// A RAM disk, as described at the top of the file.
+
+class RamModel : public DiskModel {
+  public:
+    int Latency(int firstSector, int numSectors, bool writing, Ticks when);
+    int Transfer(int firstSector, int numSectors, bool writing, Ticks when);
+};
+
+// A flash disk, as described at the top of the file.
+
+class FlashModel : public DiskModel {
+  public:
+    FlashModel();			// every block erased
+    ~FlashModel();
+
+    int Latency(int firstSector, int numSectors, bool writing, Ticks when);
+    int Transfer(int firstSector, int numSectors, bool writing, Ticks when);
+    void Discard();			// every block is erased again
+
+  private:
+    int *programmed;			// for each erase block, how many of
+					// its pages were written since it
+					// was erased
+
+    int Block(int sector);		// the erase block "sector" is in
+    int Cost(int firstSector, int numSectors, bool writing, bool commit);
+					// how long a transfer takes; if
+					// "commit", the pages written and
+					// blocks erased are counted
+};
 
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, bool mapImage, int trackBuffers,
+	 int writeCacheSectors, DiskDevice device, int member,
+	 char *imageName);
+    					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// If "mapImage", the UNIX file is
+					// mapped into memory.  The disk
+					// has "trackBuffers" track buffers
+					// and a write cache that holds
+					// "writeCacheSectors" (0 for none).
+					// "device" is the model of its
+					// media; "member" is which disk it
+					// is of its volume (0 if alone).
+					// "imageName" is its UNIX file,
+					// NULL for the kernel's own disk.
     ~Disk();				// Deallocate the disk.
     
     void ReadRequest(int sectorNumber, char* data);
@@ -66,27 +278,105 @@ class Disk : public CallBackObj {
     					// the disk and return immediately.
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
+    void ReadRequest(int firstSector, int numSectors, char* data);
+    					// Read/write "numSectors" consecutive
+					// sectors as a single request: the
+					// head seeks once, then the sectors
+					// stream past it.
+    void WriteRequest(int firstSector, int numSectors, char* data);
+    void WriteRequest(int firstSector, int numSectors, char* data,
+		      bool flushFirst, bool forceUnit);
+					// Same, but flush the write cache
+					// first, and/or write the sectors
+					// past it
+    void FlushRequest();		// Write what is in the write cache to
+					// the media; the interrupt says
+					// when it is all there
+    bool CachesWrites() { return writeCacheSize > 0; }
+    void Discard();			// Make every sector read as zeroes,
+					// at once; the disk must be idle
 
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
 
     int ComputeLatency(int newSector, bool writing);	
     					// Return how long a request to 
-					// newSector will take: 
-					// (seek + rotational delay + transfer)
+					// newSector will take on the media,
+					// leaving the cache out of it: for
+					// a rotating disk, (seek +
+					// rotational delay + transfer)
+    int ComputeLatency(int firstSector, int numSectors, bool writing);
+    					// Same, for a run of sectors
+
+    void Sync();			// Make sure what has been written
+					// has reached the UNIX file
+    void SaveImage(int file);		// Write, at the start of "file",
+					// what the UNIX file of a disk of
+					// its own would hold
+    static int FileLength();		// How many bytes that is
 
   private:
     int fileno;				// UNIX file number for simulated disk 
-    char diskname[32];			// name of simulated disk's file
+    char *image;			// the UNIX file mapped into memory,
+					// or NULL if it is read and written;
+					// for a RAM disk, the sectors
+    bool inRam;				// is this a RAM disk?
+    char *diskname;			// name of simulated disk's file
+    int baseFileno;			// UNIX file number of the base image
+					// of an overlay, or -1
+    char *present;			// for an overlay, one bit per sector:
+					// does the delta have it?  NULL if
+					// the disk is not an overlay
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
+    DiskModel *model;			// how long the media takes
     bool active;     			// Is a disk operation in progress?
     int lastSector;			// The previous disk request 
-    int bufferInit;			// When the track buffer started 
-					// being loaded
+					// to the media
+
+    int numBuffers;			// how many track buffers there are
+    TrackBuffer buffers[MaxTrackBuffers];
+    int readingAhead;			// the buffer the head is reading
+					// into, or -1
+    int writeCacheSize;			// sectors the write cache holds
+    Bitmap *dirty;			// which sectors it holds; NULL if
+					// there is no write cache
+    int numDirty;			// how many
 
-    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
+    void CheckGeometry(int file, char *name, int extra);
+					// is the UNIX file for this disk?
+					// "extra" bytes follow the geometry
+    bool InDelta(int sector);		// for an overlay, is "sector" in
+					// the delta rather than the base?
+    void ReadImage(int firstSector, int numSectors, char *data);
+    void WriteImage(int firstSector, int numSectors, char *data);
+					// move sectors to or from the
+					// UNIX file(s)
+    int TimeToSeek(int newSector, Ticks when, int *rotate);
+					// time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
-    void UpdateLast(int newSector);
+    int MediaLatency(int firstSector, int numSectors, Ticks when);
+					// time to transfer a run to or
+					// from the media, starting "when"
+    int MediaParts(int firstSector, int numSectors, Ticks when,
+		   int *seek, int *rotation, int *transfer);
+					// the same, and how much of it
+					// each part of the transfer takes
+    int MediaTransfer(int firstSector, int numSectors, Ticks when);
+					// the same, moving the head there
+					// and reading ahead after it
+    int BufferHolding(int sector, Ticks now);
+					// which track buffer has "sector"
+    bool InCache(int firstSector, int numSectors);
+					// can a read be answered from RAM?
+    int ReadAheadTime(int firstSector, int numSectors);
+					// or by waiting for read-ahead?
+    void StartReadAhead(int track, Ticks when);
+					// the head is over "track"
+    void StopReadAhead(Ticks when);	// and now it is leaving it
+    int Destage(Ticks when);		// write the dirty sectors to the
+					// media; how long it takes
+
+    friend class RotatingModel;		// times the media with the above
 };
 
 #endif // DISK_H
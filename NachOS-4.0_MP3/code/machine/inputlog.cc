@@ -0,0 +1,152 @@
+// inputlog.cc
+//	Routines to record the input Nachos gets from outside, and to
+//	replay it.  See inputlog.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "inputlog.h"
+#include "sysdep.h"
+#include "debug.h"
+#include "main.h"
+
+static const int LogMagic = 0x504e494e;		// "NINP"
+
+//----------------------------------------------------------------------
+// InputLog::InputLog
+// 	For recording, create the log file and write its header.  For
+//	replaying, read every record of the log into memory, and sort the
+//	records out by device; the header gives the seed and slicing the
+//	run had.
+//
+//	"fileName" -- the log
+//	"replay" -- replay the log, rather than record one
+//	"seed", "randomSlice" -- when recording, the run's random seed,
+//		and whether its time slices are random
+//----------------------------------------------------------------------
+
+InputLog::InputLog(char *fileName, bool replay, int seed, bool randomSlice)
+{
+    int header[3];
+
+    replaying = replay;
+    for (int i = 0; i < NumInputDevices; i++)
+	pending[i] = new List<InputRecord *>;
+    if (!replaying) {
+	this->seed = seed;
+	this->randomSlice = randomSlice;
+	header[0] = LogMagic;
+	header[1] = seed;
+	header[2] = randomSlice ? 1 : 0;
+	fileNo = OpenForWrite(fileName);
+	WriteFile(fileNo, (char *) header, sizeof(header));
+	return;
+    }
+
+    int fd = OpenForRead(fileName, TRUE);
+    int length, at;
+
+    Lseek(fd, 0, 2);
+    length = Tell(fd);
+    Lseek(fd, 0, 0);
+    ASSERT(length >= (int) sizeof(header));
+    Read(fd, (char *) header, sizeof(header));
+    if (header[0] != LogMagic) {
+	cerr << fileName << " is not an input log\n";
+	ASSERTNOTREACHED();
+    }
+    this->seed = header[1];
+    this->randomSlice = (header[2] != 0);
+    for (at = sizeof(header); at < length; ) {
+	InputRecord *record = new InputRecord;
+
+	Read(fd, (char *) &record->ticks, sizeof(record->ticks));
+	Read(fd, (char *) &record->device, sizeof(record->device));
+	Read(fd, (char *) &record->length, sizeof(record->length));
+	ASSERT(record->device >= 0 && record->device < NumInputDevices);
+	record->data = new char[record->length + 1];
+	if (record->length > 0)
+	    Read(fd, record->data, record->length);
+	at += sizeof(record->ticks) + sizeof(record->device)
+		+ sizeof(record->length) + record->length;
+	pending[record->device]->Append(record);
+    }
+    Close(fd);
+    fileNo = -1;
+}
+
+//----------------------------------------------------------------------
+// InputLog::~InputLog
+// 	Close the log, and throw away the records not replayed.
+//----------------------------------------------------------------------
+
+InputLog::~InputLog()
+{
+    if (fileNo >= 0)
+	Close(fileNo);
+    for (int i = 0; i < NumInputDevices; i++) {
+	while (!pending[i]->IsEmpty()) {
+	    InputRecord *record = pending[i]->RemoveFront();
+
+	    delete [] record->data;
+	    delete record;
+	}
+	delete pending[i];
+    }
+}
+
+//----------------------------------------------------------------------
+// InputLog::Record
+// 	Append a record of "length" bytes of input that "device" is
+//	delivering now.  It goes straight to the file, so the log is
+//	there even if Nachos does not halt cleanly.
+//----------------------------------------------------------------------
+
+void
+InputLog::Record(InputDevice device, char *data, int length)
+{
+    Ticks ticks = kernel->stats->totalTicks;
+    short which = device;
+    short size = length;
+
+    ASSERT(!replaying && length >= 0 && length <= 0x7fff);
+    DEBUG(dbgInt, "Logging " << length << " bytes of input " << device
+		  << " at " << ticks);
+    WriteFile(fileNo, (char *) &ticks, sizeof(ticks));
+    WriteFile(fileNo, (char *) &which, sizeof(which));
+    WriteFile(fileNo, (char *) &size, sizeof(size));
+    if (length > 0)
+	WriteFile(fileNo, data, length);
+}
+
+//----------------------------------------------------------------------
+// InputLog::Replay
+// 	If the next input logged for "device" was delivered at or before
+//	the current tick, take it from the log, copy its bytes to "data"
+//	and return how many there are.  Otherwise return -1.
+//
+//	"maxLength" -- how many bytes "data" holds
+//----------------------------------------------------------------------
+
+int
+InputLog::Replay(InputDevice device, char *data, int maxLength)
+{
+    InputRecord *record;
+    int length;
+
+    ASSERT(replaying);
+    if (pending[device]->IsEmpty()
+	    || pending[device]->Front()->ticks > kernel->stats->totalTicks)
+	return -1;
+    record = pending[device]->RemoveFront();
+    length = record->length;
+    ASSERT(length <= maxLength);
+    bcopy(record->data, data, length);
+    DEBUG(dbgInt, "Replaying " << length << " bytes of input " << device
+		  << " logged at " << record->ticks);
+    delete [] record->data;
+    delete record;
+    return length;
+}
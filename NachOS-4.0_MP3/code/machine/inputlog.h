@@ -0,0 +1,87 @@
+// inputlog.h
+//	Data structures for recording the input that comes into Nachos
+//	from outside, and replaying it, so that a run can be repeated
+//	exactly (-record and -replay).
+//
+//	Everything in a run is decided by simulated time, except for what
+//	the host supplies: the characters typed at the console (or read
+//	from the -ci file), which poll they come in at, the packets other
+//	machines send, and the seed of the random numbers (-rs), which
+//	decides the random time slices and the packets the network loses.
+//	A record log has the seed, and each character and packet that
+//	was delivered, with the tick it was delivered at.  On replay, the
+//	seed is taken from the log, and the console and the network do
+//	not look at the host at all: each delivers its next logged input
+//	at the first poll at or after its tick.  So a replay of the same
+//	build does exactly what the recorded run did, and a replay of a
+//	different one is given the same input at the same times.
+//
+//	The log file layout is host byte order:
+//
+//	   header -- the characters "NINP", then the random seed, and 1
+//		if random time slicing was on (ints)
+//	   records -- each an InputRecord header, followed by its bytes
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef INPUTLOG_H
+#define INPUTLOG_H
+
+#include "utility.h"
+#include "list.h"
+
+// The devices input comes in at, and what their records hold.
+
+enum InputDevice {
+    InputConsole,		// the character; none at end of file
+    InputNetwork,		// the packet, as it came off the wire
+    NumInputDevices
+};
+
+// The following class defines one record of the log.
+
+class InputRecord {
+  public:
+    Ticks ticks;		// when it was delivered
+    short device;		// an InputDevice
+    short length;		// how many bytes follow
+    char *data;			// them, in memory; not in the file
+};
+
+// The following class defines the log: where it is written to, or the
+// records still to be replayed from it.
+
+class InputLog {
+  public:
+    InputLog(char *fileName, bool replay, int seed, bool randomSlice);
+				// Start a log in the file, of a run with
+				// that seed and slicing, or read one to
+				// replay
+    ~InputLog();		// Close the file
+
+    bool Replaying() { return replaying; }
+    int Seed() { return seed; }	// the random seed, and whether time
+    bool RandomSlice() { return randomSlice; }
+				// slices were random, as logged
+
+    void Record(InputDevice device, char *data, int length);
+				// Log input delivered now
+    int Replay(InputDevice device, char *data, int maxLength);
+				// Put the next input logged for "device"
+				// in "data", if it is due by now, and
+				// return its length; -1 if none is due
+
+  private:
+    bool replaying;		// or recording?
+    int fileNo;			// the log, when recording
+    int seed;
+    bool randomSlice;
+    List<InputRecord *> *pending[NumInputDevices];
+				// the records still to replay, per device
+};
+
+#endif // INPUTLOG_H
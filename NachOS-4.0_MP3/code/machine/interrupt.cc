@@ -23,6 +23,14 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include "synchprofile.h"
+#include "synchconsole.h"
+#include "tracer.h"
+#include "profiler.h"
+#include "kernelprofile.h"
+#include "memcount.h"
+#include "slab.h"
+#include "checkpoint.h"
 
 // String definitions for debugging messages
 
@@ -42,16 +50,23 @@ static char *intTypeNames[] = { "timer", "disk", "console write",
 //----------------------------------------------------------------------
 
 PendingInterrupt::PendingInterrupt(CallBackObj *callOnInt, 
-					int time, IntType kind)
+					Ticks time, IntType kind)
 {
     callOnInterrupt = callOnInt;
     when = time;
     type = kind;
+    MemCount::Add(MemPendingInterrupt, sizeof(PendingInterrupt));
+}
+
+PendingInterrupt::~PendingInterrupt()
+{
+    MemCount::Remove(MemPendingInterrupt, sizeof(PendingInterrupt));
 }
 
 //----------------------------------------------------------------------
 // PendingCompare
-//	Compare to interrupts based on which should occur first.
+//	Compare to interrupts based on which should occur first.  Ties
+//	go to the one scheduled first.
 //----------------------------------------------------------------------
 
 static int
@@ -59,9 +74,22 @@ PendingCompare (PendingInterrupt *x, PendingInterrupt *y)
 {
     if (x->when < y->when) { return -1; }
     else if (x->when > y->when) { return 1; }
+    else if (x->order < y->order) { return -1; }
+    else if (x->order > y->order) { return 1; }
     else { return 0; }
 }
 
+//----------------------------------------------------------------------
+// QsortPending
+//	PendingCompare, for sorting a copy of the heap with qsort.
+//----------------------------------------------------------------------
+
+static int
+QsortPending (const void *x, const void *y)
+{
+    return PendingCompare(*(PendingInterrupt **) x, *(PendingInterrupt **) y);
+}
+
 //----------------------------------------------------------------------
 // Interrupt::Interrupt
 // 	Initialize the simulation of hardware device interrupts.
@@ -72,10 +100,17 @@ PendingCompare (PendingInterrupt *x, PendingInterrupt *y)
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new SortedList<PendingInterrupt *>(PendingCompare);
+    capacity = 16;			// grown as needed
+    pending = new PendingInterrupt *[capacity];
+    spare = new PendingInterrupt *[capacity];
+    numPending = numSpare = numOrdered = numAllocated = 0;
+    tracing = debug->IsEnabled(dbgInt);
     inHandler = FALSE;
     yieldOnReturn = FALSE;
+    UpdateDue();
     status = SystemMode;
+    numInputFds = 0;
+    inputQuiet = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -85,10 +120,14 @@ Interrupt::Interrupt()
 
 Interrupt::~Interrupt()
 {
-    while (!pending->IsEmpty()) {
-	delete pending->RemoveFront();
+    for (int i = 0; i < numPending; i++) {
+	delete pending[i];
     }
-    delete pending;
+    for (int i = 0; i < numSpare; i++) {
+	delete spare[i];
+    }
+    delete [] pending;
+    delete [] spare;
 }
 
 //----------------------------------------------------------------------
@@ -150,15 +189,93 @@ Interrupt::OneTick()
     MachineStatus oldStatus = status;
     Statistics *stats = kernel->stats;
 
-// advance simulated time
+// advance simulated time; the running thread is charged for it when
+// it is switched out (see Statistics::ChargeRunning)
     if (status == SystemMode) {
-        stats->totalTicks += SystemTick;
+        AdvanceClock(SystemTick);
 	stats->systemTicks += SystemTick;
     } else {
-	stats->totalTicks += UserTick;
+	AdvanceClock(UserTick);
 	stats->userTicks += UserTick;
     }
     DEBUG(dbgInt, "== Tick " << stats->totalTicks << " ==");
+    EndTick(oldStatus);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::BlockTick
+// 	Advance simulated time by "numInstructions" user instructions at
+//	once, and check for pending interrupts, as OneTick does after
+//	each of them.  Used when the machine charges user time per basic
+//	block (see Machine::Run); interrupts are then only taken at the
+//	end of a block.
+//----------------------------------------------------------------------
+
+void
+Interrupt::BlockTick(int numInstructions)
+{
+    Statistics *stats = kernel->stats;
+
+    ASSERT(status == UserMode);
+    AdvanceClock(numInstructions * UserTick);
+    stats->userTicks += numInstructions * UserTick;
+    DEBUG(dbgInt, "== Tick " << stats->totalTicks << " (" << numInstructions
+		  << " instructions) ==");
+    EndTick(status);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::AdvanceClock
+// 	Advance simulated time by "ticks" the CPU being simulated has
+//	run for.  With several CPUs, the scheduler keeps a clock for each
+//	of them, and works out from those how far time has got.
+//----------------------------------------------------------------------
+
+void
+Interrupt::AdvanceClock(int ticks)
+{
+    if (kernel->numCPUs == 1)
+	kernel->stats->totalTicks += ticks;
+    else
+	kernel->scheduler->Advance(ticks);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::EndTick
+// 	Fire any interrupts that are now due, and do the context switch
+//	one of their handlers asked for, if any.  "oldStatus" is the mode
+//	the machine was in when time was advanced.  The statistics get
+//	to print or write out what is due first (see Statistics::Report).
+//	With several CPUs, another may be due to be simulated first (see
+//	Scheduler::Interleave).
+//----------------------------------------------------------------------
+
+void
+Interrupt::EndTick(MachineStatus oldStatus)
+{
+    Statistics *stats = kernel->stats;
+
+    if (stats->ReportDue())
+	stats->Report();
+
+    if (kernel->numCPUs > 1 && kernel->scheduler->InterleaveDue()) {
+	bool sliceUp;
+
+	ChangeLevel(IntOn, IntOff);	// the scheduler runs with
+	status = SystemMode;		// interrupts off, in the kernel
+	sliceUp = kernel->scheduler->Interleave();
+	ChangeLevel(IntOff, IntOn);
+	if (sliceUp)			// its time slice ended while
+	    kernel->currentThread->Yield();	// another CPU ran
+	status = oldStatus;
+    }
+
+// skip it all if nothing can happen: nothing is due yet, and no
+// handler has asked for a context switch -- one comparison, with
+// nextDue kept up to date as the pending interrupts change
+    if (stats->totalTicks < nextDue) {
+	return;
+    }
 
 // check any pending interrupts are now ready to fire
     ChangeLevel(IntOn, IntOff);	// first, turn off interrupts
@@ -169,7 +286,11 @@ Interrupt::OneTick()
     if (yieldOnReturn) {	// if the timer device handler asked 
     				// for a context switch, ok to do it now
 	yieldOnReturn = FALSE;
+	UpdateDue();
  	status = SystemMode;		// yield is a kernel routine
+	if (oldStatus == UserMode && kernel->checkpoint != NULL
+		&& kernel->checkpoint->IsDue(stats->totalTicks))
+	    kernel->checkpoint->Take();	// between two instructions
 	kernel->currentThread->Yield();
 	status = oldStatus;
     }
@@ -191,6 +312,25 @@ Interrupt::YieldOnReturn()
 { 
     ASSERT(inHandler == TRUE);  
     yieldOnReturn = TRUE; 
+    nextDue = 0;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::UpdateDue
+// 	Work out "nextDue" again, after the pending interrupts or the
+//	request for a yield changed: EndTick need not look any further
+//	before then.
+//----------------------------------------------------------------------
+
+void
+Interrupt::UpdateDue()
+{
+    if (tracing || yieldOnReturn)
+	nextDue = 0;
+    else if (numPending > 0)
+	nextDue = pending[0]->when;
+    else
+	nextDue = 0x7fffffffffffffffLL;	// never
 }
 
 //----------------------------------------------------------------------
@@ -209,11 +349,19 @@ Interrupt::Idle()
 {
     DEBUG(dbgInt, "Machine idling; checking for interrupts.");
     status = IdleMode;
+    if (!SkipPolls()) {		// nothing will run before the next event;
+				// only polls, so wait for the outside
+	inputQuiet = !WaitForInput(inputFds, numInputFds, IdlePollDelay);
+    }
+    if (kernel->stats->ReportDue())	// before time jumps ahead
+	kernel->stats->Report();
     if (CheckIfDue(TRUE)) {	// check for any pending interrupts
+	inputQuiet = FALSE;
 	status = SystemMode;
 	return;			// return in case there's now
 				// a runnable thread
     }
+    inputQuiet = FALSE;
 
     // if there are no pending interrupts, and nothing is on the ready
     // queue, it is time to stop.   If the console or the network is 
@@ -235,7 +383,27 @@ Interrupt::Halt()
 {
     // cout << "Machine halting!\n\n";
     // cout << "This is halt\n";
-    // kernel->stats->Print();
+    kernel->synchConsoleOut->FlushAtHalt();
+    if (kernel->printStats) {
+	kernel->stats->Print();
+	kernel->stats->PrintThreads();
+	kernel->stats->PrintSyscalls();
+	MemCount::Print();
+	Slab::Print();
+    }
+    if (kernel->syscallTimesFile != NULL)
+	kernel->stats->WriteSyscalls(kernel->syscallTimesFile);
+    if (kernel->statsJsonFile != NULL)
+	kernel->stats->AppendJson(kernel->statsJsonFile);
+    kernel->stats->PrintShares();
+    if (kernel->synchProfiler != NULL)
+	kernel->synchProfiler->Print();
+    if (kernel->tracer != NULL)
+	kernel->tracer->Dump();
+    if (kernel->profiler != NULL)
+	kernel->profiler->FinishAll();
+    if (kernel->kernelProfiler != NULL)
+	kernel->kernelProfiler->Write();
     delete kernel;	// Never returns.
 }
 
@@ -262,6 +430,11 @@ Interrupt::ReadFile(char *buffer, int size, OpenFileId id){
     return kernel->fileSystem->ReadAFile(buffer, size, id);
 }
 
+int
+Interrupt::SeekFile(int position, OpenFileId id){
+    return kernel->fileSystem->SeekAFile(position, id);
+}
+
 int
 Interrupt::CloseFile(OpenFileId id){
     return kernel->fileSystem->CloseAFile(id);
@@ -273,7 +446,7 @@ Interrupt::CloseFile(OpenFileId id){
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it on a heap, soonest first (see Add).
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -286,13 +459,237 @@ Interrupt::CloseFile(OpenFileId id){
 void
 Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
 {
-    int when = kernel->stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(toCall, when, type);
+    Add(toCall, fromNow, type, 0);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SchedulePoll
+// 	Like Schedule, for a device that only polls: the interrupt just
+//	checks whether something has come in, or lets the scheduler time
+//	slice, and the device schedules it again "fromNow" later each
+//	time.  While the machine is idle, such an interrupt can be put
+//	off by whole periods, to just after the next event that is not a
+//	poll (see SkipPolls) -- a poll in between would have found the
+//	same thing, or, for input from outside, could as well have found
+//	it late.
+//
+//	"toCall" is the object to call when the interrupt occurs
+//	"fromNow" is how far in the future (in simulated time) the 
+//		 interrupt is to occur, and how often the device polls
+//	"type" is the hardware device that generated the interrupt
+//----------------------------------------------------------------------
+
+void
+Interrupt::SchedulePoll(CallBackObj *toCall, int fromNow, IntType type)
+{
+    Add(toCall, fromNow, type, fromNow);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Add
+// 	Schedule an interrupt, for Schedule or SchedulePoll, reusing the
+//	object of an interrupt that has already fired if there is one.
+//	"period" is 0 if it may not be put off.
+//----------------------------------------------------------------------
+
+void
+Interrupt::Add(CallBackObj *toCall, int fromNow, IntType type, int period)
+{
+    Ticks when = kernel->stats->totalTicks + fromNow;
+    PendingInterrupt *toOccur;
 
     DEBUG(dbgInt, "Scheduling interrupt handler the " << intTypeNames[type] << " at time = " << when);
     ASSERT(fromNow > 0);
 
-    pending->Insert(toOccur);
+    if (numSpare > 0) {
+	toOccur = spare[--numSpare];
+	toOccur->callOnInterrupt = toCall;
+	toOccur->when = when;
+	toOccur->type = type;
+    } else {
+	if (numAllocated == capacity) {
+	    Grow();
+	}
+	toOccur = new PendingInterrupt(toCall, when, type);
+	numAllocated++;
+    }
+    toOccur->order = numOrdered++;
+    toOccur->period = period;
+    InsertPending(toOccur);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::WatchInput
+// 	A device polls the UNIX file "fd" for input from outside; an idle
+//	machine is to wait on it (see Idle).
+//----------------------------------------------------------------------
+
+void
+Interrupt::WatchInput(int fd)
+{
+    ASSERT(numInputFds < MaxWatchedInputs);
+    inputFds[numInputFds++] = fd;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::UnwatchInput
+// 	The device no longer looks at "fd" -- it has reached the end of
+//	it, say, where select would find it ready for ever.
+//----------------------------------------------------------------------
+
+void
+Interrupt::UnwatchInput(int fd)
+{
+    for (int i = 0; i < numInputFds; i++) {
+	if (inputFds[i] == fd) {
+	    inputFds[i] = inputFds[--numInputFds];
+	    return;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SkipPolls
+// 	The machine is idle, so nothing can happen until the next
+//	interrupt that is not a poll, at time "next".  Put off every poll
+//	due before then to the first time on its period that is not:
+//	polling in between would find nothing new, as no thread runs.
+//	Time then skips straight to "next", and simulating an idle disk
+//	wait costs a handful of events however long it is.
+//
+//	If only polls are pending, they are left alone: one of them has
+//	to find whatever the machine is waiting for.  Return FALSE then.
+//----------------------------------------------------------------------
+
+bool
+Interrupt::SkipPolls()
+{
+    Ticks next = 0;
+    bool found = FALSE;
+    int i;
+
+    for (i = 0; i < numPending; i++) {
+	if (pending[i]->period == 0 && (!found || pending[i]->when < next)) {
+	    next = pending[i]->when;
+	    found = TRUE;
+	}
+    }
+    if (!found) {
+	return FALSE;
+    }
+    for (i = 0; i < numPending; i++) {
+	PendingInterrupt *poll = pending[i];
+
+	if (poll->period != 0 && poll->when < next) {
+	    Ticks periods = divRoundUp(next - poll->when, poll->period);
+
+	    DEBUG(dbgInt, "Putting off the " << intTypeNames[poll->type]
+			  << " poll by " << periods << " periods");
+	    poll->when += periods * poll->period;
+	    poll->order = numOrdered++;	// as if rescheduled last time
+	}
+    }
+    for (i = numPending / 2 - 1; i >= 0; i--) {	// back into a heap
+	SiftDown(i, pending[i]);
+    }
+    UpdateDue();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::Grow
+// 	Double the size of the heap and of the spare pool.  Each holds at
+//	most every interrupt object there is, so they only need to grow
+//	when another object is made.
+//----------------------------------------------------------------------
+
+void
+Interrupt::Grow()
+{
+    PendingInterrupt **bigger = new PendingInterrupt *[2 * capacity];
+    PendingInterrupt **biggerSpare = new PendingInterrupt *[2 * capacity];
+    int i;
+
+    for (i = 0; i < numPending; i++) {
+	bigger[i] = pending[i];
+    }
+    for (i = 0; i < numSpare; i++) {
+	biggerSpare[i] = spare[i];
+    }
+    delete [] pending;
+    delete [] spare;
+    pending = bigger;
+    spare = biggerSpare;
+    capacity *= 2;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::InsertPending
+// 	Put "toOccur" on the heap of pending interrupts: at the bottom,
+//	then up past every parent that is due after it.
+//----------------------------------------------------------------------
+
+void
+Interrupt::InsertPending(PendingInterrupt *toOccur)
+{
+    int i;
+
+    ASSERT(numPending < capacity);
+    for (i = numPending++; i > 0; i = (i - 1) / 2) {
+	PendingInterrupt *parent = pending[(i - 1) / 2];
+
+	if (PendingCompare(parent, toOccur) <= 0) {
+	    break;
+	}
+	pending[i] = parent;
+    }
+    pending[i] = toOccur;
+    UpdateDue();
+}
+
+//----------------------------------------------------------------------
+// Interrupt::RemoveSoonest
+// 	Take the soonest interrupt off the heap: the last one takes the
+//	top's place, and goes down past every child due before it.
+//----------------------------------------------------------------------
+
+PendingInterrupt *
+Interrupt::RemoveSoonest()
+{
+    PendingInterrupt *soonest = pending[0];
+    PendingInterrupt *last;
+
+    ASSERT(numPending > 0);
+    last = pending[--numPending];
+    if (numPending > 0) {
+	SiftDown(0, last);
+    }
+    UpdateDue();
+    return soonest;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SiftDown
+// 	Put "toOccur" in the heap at position "i", or, if a child of "i"
+//	is due before it, move that child up and go on down from there.
+//----------------------------------------------------------------------
+
+void
+Interrupt::SiftDown(int i, PendingInterrupt *toOccur)
+{
+    int child;
+
+    for (; (child = 2 * i + 1) < numPending; i = child) {
+	if (child + 1 < numPending
+		&& PendingCompare(pending[child + 1], pending[child]) < 0) {
+	    child++;
+	}
+	if (PendingCompare(toOccur, pending[child]) <= 0) {
+	    break;
+	}
+	pending[i] = pending[child];
+    }
+    pending[i] = toOccur;
 }
 
 //----------------------------------------------------------------------
@@ -318,10 +715,10 @@ Interrupt::CheckIfDue(bool advanceClock)
     if (debug->IsEnabled(dbgInt)) {
 	DumpState();
     }
-    if (pending->IsEmpty()) {   	// no pending interrupts
+    if (numPending == 0) {   	// no pending interrupts
 	return FALSE;	
     }		
-    next = pending->Front();
+    next = pending[0];
 
     if (next->when > stats->totalTicks) {
         if (!advanceClock) {		// not time yet
@@ -343,11 +740,11 @@ Interrupt::CheckIfDue(bool advanceClock)
 
     inHandler = TRUE;
     do {
-        next = pending->RemoveFront();    // pull interrupt off list
+        next = RemoveSoonest();    	  // pull interrupt off the heap
         next->callOnInterrupt->CallBack();// call the interrupt handler
-	delete next;
-    } while (!pending->IsEmpty() 
-    		&& (pending->Front()->when <= stats->totalTicks));
+	spare[numSpare++] = next;	  // keep it for the next Schedule
+    } while (numPending > 0
+    		&& (pending[0]->when <= stats->totalTicks));
     inHandler = FALSE;
     return TRUE;
 }
@@ -377,7 +774,18 @@ Interrupt::DumpState()
     cout << "Time: " << kernel->stats->totalTicks;
     cout << ", interrupts " << intLevelNames[level] << "\n";
     cout << "Pending interrupts:\n";
-    pending->Apply(PrintPending);
+    if (numPending > 0) {		// in the order they will fire
+	PendingInterrupt **sorted = new PendingInterrupt *[numPending];
+
+	for (int i = 0; i < numPending; i++) {
+	    sorted[i] = pending[i];
+	}
+	qsort(sorted, numPending, sizeof(PendingInterrupt *), QsortPending);
+	for (int i = 0; i < numPending; i++) {
+	    PrintPending(sorted[i]);
+	}
+	delete [] sorted;
+    }
     cout << "\nEnd of pending interrupts\n";
 }
 
@@ -14,6 +14,22 @@
 //		a user instruction is executed
 //		there is nothing in the ready queue
 //
+//	When nothing is ready to run, time jumps straight to the next
+//	interrupt.  Devices that only poll -- the timer, keyboard and
+//	network input -- schedule with SchedulePoll, and while the machine
+//	is idle their interrupts are put off until the next one that is
+//	not a poll, so that time skips ahead event by event (see
+//	Interrupt::SkipPolls).  If only polls are pending, the machine is
+//	waiting for something from outside -- another Nachos machine, or
+//	the keyboard -- and it sleeps for IdlePollDelay between polls, so
+//	that the UNIX process does not spin, keeping the other machines
+//	from running.  The devices that take input from outside tell the
+//	interrupt simulation which UNIX files they read it from (see
+//	WatchInput), and the machine waits on all of them at once in a
+//	single select: it wakes up as soon as any has something, and the
+//	polls that come due right after a wait that found nothing skip
+//	looking themselves (see InputQuiet).
+//
 //	As a result, unlike real hardware, interrupts (and thus time-slice
 //	context switches) cannot occur anywhere in the code where interrupts
 //	are enabled, but rather only at those places in the code where
@@ -39,6 +55,10 @@
 
 typedef int OpenFileId;
 
+const int IdlePollDelay = 20;	// microseconds an idle machine with only
+				// polls pending sleeps between them
+const int MaxWatchedInputs = 4;	// UNIX files input can come in on
+
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
 enum IntStatus
 {
@@ -72,19 +92,29 @@ enum IntType
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
 // left public to make it simpler to manipulate.
+//
+// Once an interrupt has fired, its object is kept for reuse by the
+// next Schedule, so that devices that interrupt all the time (the
+// timer, the console) do not allocate at each one.
 
 class PendingInterrupt
 {
 public:
-  PendingInterrupt(CallBackObj *callOnInt, int time, IntType kind);
+  PendingInterrupt(CallBackObj *callOnInt, Ticks time, IntType kind);
   // initialize an interrupt that will
   // occur in the future
+  ~PendingInterrupt();
 
   CallBackObj *callOnInterrupt; // The object (in the hardware device
                                 // emulator) to call when the interrupt occurs
 
-  int when;     // When the interrupt is supposed to fire
+  Ticks when;   // When the interrupt is supposed to fire
   IntType type; // for debugging
+  int order;    // When it was scheduled: of two interrupts due at
+                // the same time, the one scheduled first fires first
+  int period;   // For a poll, the interval it was scheduled with:
+                // while idle it may be put off by whole periods.
+                // 0 for any other interrupt
 };
 
 // The following class defines the data structures for the simulation
@@ -124,6 +154,8 @@ public:
 
 	int ReadFile(char *buffer, int size, OpenFileId id);
 
+	int SeekFile(int position, OpenFileId id);
+
 	int CloseFile(OpenFileId id);
 
   void YieldOnReturn(); // cause a context switch on return
@@ -135,6 +167,13 @@ public:
 
   void DumpState(); // Print interrupt state
 
+  void WatchInput(int fd);   // a device takes input from outside
+  void UnwatchInput(int fd); // from "fd"; it no longer does
+  bool InputQuiet() { return inputQuiet; }
+  // TRUE while the polls due after an
+  // idle wait run, if the wait found
+  // nothing to read on any watched file
+
   // NOTE: the following are internal to the hardware simulation code.
   // DO NOT call these directly.  I should make them "private",
   // but they need to be public since they are called by the
@@ -144,21 +183,48 @@ public:
   // Schedule an interrupt to occur
   // at time "when".  This is called
   // by the hardware device simulators.
+  void SchedulePoll(CallBackObj *callTo, int when, IntType type);
+  // The same, for an interrupt that
+  // only polls for something, and may
+  // be put off while the machine is
+  // idle
 
   void OneTick(); // Advance simulated time
+  void BlockTick(int numInstructions);
+  // Advance it by a basic block of
+  // user instructions at once
+  void AdvanceClock(int ticks);
+  // Advance it by "ticks", without
+  // checking for interrupts
 
 private:
   IntStatus level; // are interrupts enabled or disabled?
-  SortedList<PendingInterrupt *> *pending;
-  // the list of interrupts scheduled
-  // to occur in the future
+  PendingInterrupt **pending;
+  // the interrupts scheduled to occur
+  // in the future, as a binary heap
+  // with the soonest at the top
+  int numPending;
+  PendingInterrupt **spare; // ones that have fired, to reuse
+  int numSpare;
+  int numAllocated; // interrupt objects there are in all
+  int capacity;   // room in both arrays, >= numAllocated
+  int numOrdered; // interrupts scheduled so far
+  bool tracing;   // is interrupt debugging on?
   // int writeFileNo;            //UNIX file emulating the display
   bool inHandler; // TRUE if we are running an interrupt handler
   // bool putBusy;               // Is a PrintInt operation in progress
   // If so, you cannoot do another one
   bool yieldOnReturn; // TRUE if we are to context switch
                       // on return from the interrupt handler
+  Ticks nextDue;  // the tick by which EndTick has anything to
+                  // do: when the soonest pending interrupt is
+                  // due; 0 while a yield is asked for, or
+                  // interrupts are traced (see UpdateDue)
+  void UpdateDue(); // work out nextDue again
   MachineStatus status; // idle, kernel mode, user mode
+  int inputFds[MaxWatchedInputs]; // the files input comes in on
+  int numInputFds;
+  bool inputQuiet; // see InputQuiet
 
   // these functions are internal to the interrupt simulation code
 
@@ -166,6 +232,22 @@ private:
   // Check if any interrupts are supposed
   // to occur now, and if so, do them
 
+  void EndTick(MachineStatus oldStatus);
+  // Run whatever is due once simulated
+  // time has been advanced
+
+  void Add(CallBackObj *toCall, int fromNow, IntType type, int period);
+  // schedule, for Schedule or SchedulePoll
+  bool SkipPolls(); // put off polls, to idle up to an event;
+  // FALSE if there are only polls
+  void Grow();    // double the room in both arrays
+  void InsertPending(PendingInterrupt *toOccur);
+  PendingInterrupt *RemoveSoonest();
+  // Add to and take the top off the
+  // heap of pending interrupts
+  void SiftDown(int i, PendingInterrupt *toOccur);
+  // Put "toOccur" at "i" or below it
+
   void ChangeLevel(IntStatus old,  // SetLevel, without advancing the
                    IntStatus now); // simulated time
 };
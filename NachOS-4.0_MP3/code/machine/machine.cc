@@ -10,6 +10,7 @@
 #include "copyright.h"
 #include "machine.h"
 #include "main.h"
+#include "cpucache.h"
 
 // Textual names of the exceptions that can be generated by user program
 // execution, for debugging.
@@ -50,9 +51,13 @@ void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"perBlock" -- if TRUE, charge user time per basic block (see
+//		Machine::Run)
+//	"cache" -- the CPU caches to simulate, or NULL for none; the
+//		machine owns them
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool perBlock, CpuCache *cache)
 {
     int i;
 
@@ -61,17 +66,35 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
       	mainMemory[i] = 0;
+    decoded = new Instruction[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++) {	// what memory holds now
+	decoded[i].value = 0;
+	decoded[i].Decode();
+    }
+    blocks = new TranslatedBlock *[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++)	// translated when first run
+	blocks[i] = NULL;
 #ifdef USE_TLB
     tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
+    for (i = 0; i < TLBSize; i++) {
 	tlb[i].valid = FALSE;
+	tlb[i].numPages = 1;
+    }
     pageTable = NULL;
 #else	// use linear page table
     tlb = NULL;
     pageTable = NULL;
 #endif
+    asid = 0;
+    FlushTranslations();
 
     singleStep = debug;
+    tickPerBlock = perBlock;
+    blockLength = 0;
+    sinceSample = 0;
+    cpuCache = cache;
+    stallTicks = 0;
+    sink = 0;
     CheckEndian();
 }
 
@@ -83,8 +106,14 @@ Machine::Machine(bool debug)
 Machine::~Machine()
 {
     delete [] mainMemory;
+    delete [] decoded;
+    for (int i = 0; i < MemorySize / 4; i++)
+	delete blocks[i];
+    delete [] blocks;
     if (tlb != NULL)
         delete [] tlb;
+    if (cpuCache != NULL)
+	delete cpuCache;
 }
 
 //----------------------------------------------------------------------
@@ -103,11 +132,48 @@ Machine::RaiseException(ExceptionType which, int badVAddr)
     DEBUG(dbgMach, "Exception: " << exceptionNames[which]);
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);			// finish anything in progress
+    if (blockLength > 0) {		// the kernel sees the time of
+	kernel->interrupt->AdvanceClock(blockLength * UserTick);
+	kernel->stats->userTicks += blockLength * UserTick;
+	blockLength = 0;		// the instructions run so far
+    }
+    if (stallTicks > 0)
+	ChargeStalls();
     kernel->interrupt->setStatus(SystemMode);
     ExceptionHandler(which);		// interrupts are enabled at this point
     kernel->interrupt->setStatus(UserMode);
 }
 
+//----------------------------------------------------------------------
+// Machine::CacheAccess
+// 	A user instruction is fetching from, loading from or storing to
+//	"physAddr": run it through the CPU caches, if they are simulated,
+//	and note the stall for the thread to be charged.  The kernel's own
+//	reads and writes of user memory bypass them.
+//----------------------------------------------------------------------
+
+void
+Machine::CacheAccess(int physAddr)
+{
+    if (cpuCache != NULL && kernel->interrupt->getStatus() == UserMode)
+	stallTicks += cpuCache->Access(physAddr);
+}
+
+//----------------------------------------------------------------------
+// Machine::ChargeStalls
+// 	Advance simulated time past the cache stalls of the instructions
+//	run so far, as user time of the running thread.  Called after
+//	each instruction, and before an exception.
+//----------------------------------------------------------------------
+
+void
+Machine::ChargeStalls()
+{
+    kernel->interrupt->AdvanceClock(stallTicks);
+    kernel->stats->userTicks += stallTicks;
+    stallTicks = 0;
+}
+
 //----------------------------------------------------------------------
 // Machine::Debugger
 // 	Primitive debugger for user programs.  Note that we can't use
@@ -39,6 +39,10 @@ const int NumPhysPages = 128;
 
 const int MemorySize = (NumPhysPages * PageSize);
 const int TLBSize = 4;			// if there is a TLB, make it small
+const int NumFastTranslations = 16;	// recent translations the machine
+					// remembers, for reads and for writes
+const int MaxBlockLength = 32;		// instructions charged for at once, at
+					// most, when time is charged per block
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -75,6 +79,92 @@ enum ExceptionType { NoException,           // Everything ok!
 
 #define NumTotalRegs 	40
 
+// The following class defines an instruction, represented in both
+// 	undecoded binary form
+//      decoded to identify
+//	    operation to do
+//	    registers to act on
+//	    any immediate operand value
+
+class Instruction {
+  public:
+    void Decode();	// decode the binary representation of the instruction
+
+    unsigned int value; // binary representation of the instruction
+
+    char opCode;     // Type of instruction.  This is NOT the same as the
+    		     // opcode field from the instruction: see defs in mips.h
+    char rs, rt, rd; // Three registers from instruction.
+    int extra;       // Immediate or target or shamt field or offset.
+                     // Immediates are sign-extended.
+};
+
+// The following class defines a translation the machine remembers, so
+// that the next access to the same page need not look it up again.
+// Kept for reads and for writes separately, and good until the kernel
+// calls Machine::FlushTranslations.
+
+class FastTranslation {
+  public:
+    int virtualPage;		// -1 if nothing is remembered here
+    TranslationEntry *entry;	// the page table or TLB entry it came from
+    int physicalBase;		// where the page starts in mainMemory
+};
+
+// The following classes define a basic block of a user program,
+// translated, so that it can be run with a direct call to a routine for
+// each instruction in turn, and nothing else in between (see
+// Machine::RunBlock).  A block is a run of instructions within a page,
+// ending after the delay slot of the first jump or branch, or after
+// MaxBlockLength of them.  It is kept by the physical address it starts
+// at, and remembers the virtual address and the words it was translated
+// from, to be translated again if they change.
+
+class Machine;
+class TranslatedOp;
+
+typedef bool (*OpRoutine)(Machine *machine, TranslatedOp *op);
+				// Carry out an op; FALSE, having changed
+				// nothing, if it must be interpreted
+
+class TranslatedOp {
+  public:
+    OpRoutine routine;		// what carries it out
+    int *d;			// the register it writes; the machine's
+				// sink, if that is R0
+    int *s, *t;			// the registers it reads
+    int imm;			// its immediate, shift or branch target
+    int link;			// its address plus 8: the return address,
+				// and where a branch not taken goes
+    int loadReg;		// the register a delayed load loads
+    bool delayed;		// is it a load that must be delayed?
+    bool commit;		// finish the delayed load before it, after
+				// it is done
+};
+
+class TranslatedBlock {
+  public:
+    TranslatedBlock(int virtAddr, unsigned int *from, int numOps);
+				// The block at "virtAddr", translated from
+				// the words "from"; Machine::TranslateBlock
+				// fills in the ops
+    ~TranslatedBlock();
+
+    bool Matches(int virtAddr, char *memory);
+				// Is it still the block at "virtAddr", if
+				// "memory" holds its first word?
+
+    int virtAddr;		// where it starts in the address space
+    int numOps;			// instructions in it
+    int branch;			// the one that jumps or branches; -1 if
+				// none of them does
+    TranslatedOp *ops;
+
+  private:
+    unsigned int *words;	// what it was translated from, in the
+				// simulated machine's byte order
+};
+
 // The following class defines the simulated host workstation hardware, as 
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our 
@@ -88,12 +178,13 @@ enum ExceptionType { NoException,           // Everything ok!
 // The procedures in this class are defined in machine.cc, mipssim.cc, and
 // translate.cc.
 
-class Instruction;
 class Interrupt;
+class CpuCache;
 
 class Machine {
   public:
-    Machine(bool debug);	// Initialize the simulation of the hardware
+    Machine(bool debug, bool perBlock, CpuCache *cache);
+				// Initialize the simulation of the hardware
 				// for running user programs
     ~Machine();			// De-allocate the data structures
 
@@ -138,11 +229,20 @@ class Machine {
     TranslationEntry *pageTable;
     unsigned int pageTableSize;
 
+    int asid;				// the address space id register:
+					// which TLB entries can match
+
     bool ReadMem(int addr, int size, int* value);
     bool WriteMem(int addr, int size, int value);
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+
+    void FlushTranslations();	// Forget the translations remembered
+				// so far.  The kernel must call this
+				// when it changes the page table or
+				// ASID register, or makes an entry
+				// invalid, read-only or point elsewhere
   private:
 
 // Routines internal to the machine simulation -- DO NOT call these directly
@@ -151,6 +251,18 @@ class Machine {
 
     void OneInstruction(Instruction *instr); 	
     				// Run one instruction of a user program.
+    bool RunBlock();		// Run from the PC to the end of its basic
+				// block, translated; FALSE if the
+				// instruction there must be interpreted
+    TranslatedBlock *TranslateBlock(int virtAddr, int physAddr);
+				// Translate the block at "virtAddr"
+    static OpRoutine RoutineFor(int opCode);
+				// The routine for an instruction, in a
+				// translated block
+    void LeaveBlock(TranslatedBlock *block, int numRun);
+				// Bring the PC and the counters up to date
+				// after running part of a block
+    void EndBlock();		// Charge for the basic block just run
     
 
 
@@ -160,6 +272,16 @@ class Machine {
 				// the translation entry appropriately,
     				// and return an exception code if the 
 				// translation couldn't be completed.
+    bool FastTranslate(int virtAddr, int* physAddr, int size, bool writing);
+				// Translate an address from a remembered
+				// translation, if there is one
+    void Remember(int virtAddr, int physAddr, bool writing);
+				// Keep the translation Translate just made
+    void CacheAccess(int physAddr);
+				// Run a user access through the CPU
+				// caches, if they are simulated
+    void ChargeStalls();	// Charge the running thread for the
+				// time the caches have stalled it
 
     void RaiseException(ExceptionType which, int badVAddr);
 				// Trap to the Nachos kernel, because of a
@@ -173,9 +295,30 @@ class Machine {
 
     int registers[NumTotalRegs]; // CPU registers, for executing user programs
 
+    FastTranslation readCache[NumFastTranslations];
+    FastTranslation writeCache[NumFastTranslations];
+				// recent translations, by virtual page
+    TranslationEntry *translated; // the entry Translate last used
+
+    Instruction *decoded;	// each word of mainMemory, as last decoded;
+				// re-decoded when a fetch finds the word
+				// has changed since
+    TranslatedBlock **blocks;	// the block at each word of mainMemory,
+				// as last translated; NULL if none is
+    int sink;			// where translated instructions write
+				// what they would write in R0
+
     bool singleStep;		// drop back into the debugger after each
 				// simulated instruction
-    int runUntilTime;		// drop back into the debugger when simulated
+    bool tickPerBlock;		// advance simulated time once per basic
+				// block, not once per instruction
+    int blockLength;		// instructions run in the current block
+				// and not yet charged for
+    int sinceSample;		// instructions run since the PC was last
+				// sampled, for -prof
+    CpuCache *cpuCache;		// the simulated caches, or NULL
+    int stallTicks;		// cache stalls not yet charged for
+    Ticks runUntilTime;		// drop back into the debugger when simulated
 				// time reaches this value
 
     friend class Interrupt;		// calls DelayedLoad()    
@@ -197,10 +340,36 @@ extern void ExceptionHandler(ExceptionType which);
 //	   user registers
 //	simulated machine byte ordering:
 //	   contents of main memory
-
-unsigned int WordToHost(unsigned int word);
-unsigned short ShortToHost(unsigned short shortword);
-unsigned int WordToMachine(unsigned int word);
-unsigned short ShortToMachine(unsigned short shortword);
+//
+// They are inline, and the byte order is chosen when Nachos is
+// compiled, as every load, store and instruction fetch goes through
+// them.
+
+inline unsigned int
+WordToHost(unsigned int word)
+{
+#ifdef HOST_IS_BIG_ENDIAN
+    return ((word >> 24) & 0x000000ff) | ((word >> 8) & 0x0000ff00)
+	 | ((word << 8) & 0x00ff0000) | ((word << 24) & 0xff000000);
+#else
+    return word;
+#endif // HOST_IS_BIG_ENDIAN
+}
+
+inline unsigned short
+ShortToHost(unsigned short shortword)
+{
+#ifdef HOST_IS_BIG_ENDIAN
+    return ((shortword << 8) & 0xff00) | ((shortword >> 8) & 0x00ff);
+#else
+    return shortword;
+#endif // HOST_IS_BIG_ENDIAN
+}
+
+inline unsigned int
+WordToMachine(unsigned int word) { return WordToHost(word); }
+
+inline unsigned short
+ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
 
 #endif // MACHINE_H
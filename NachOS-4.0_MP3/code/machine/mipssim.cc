@@ -21,29 +21,10 @@
 #include "machine.h"
 #include "mipssim.h"
 #include "main.h"
+#include "profiler.h"
 
 static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 
-// The following class defines an instruction, represented in both
-// 	undecoded binary form
-//      decoded to identify
-//	    operation to do
-//	    registers to act on
-//	    any immediate operand value
-
-class Instruction {
-  public:
-    void Decode();	// decode the binary representation of the instruction
-
-    unsigned int value; // binary representation of the instruction
-
-    char opCode;     // Type of instruction.  This is NOT the same as the
-    		     // opcode field from the instruction: see defs in mips.h
-    char rs, rt, rd; // Three registers from instruction.
-    int extra;       // Immediate or target or shamt field or offset.
-                     // Immediates are sign-extended.
-};
-
 //----------------------------------------------------------------------
 // Machine::Run
 // 	Simulate the execution of a user-level program on Nachos.
@@ -51,12 +32,36 @@ class Instruction {
 //
 //	This routine is re-entrant, in that it can be called multiple
 //	times concurrently -- one for each thread executing user code.
+//
+//	Normally simulated time advances, and pending interrupts are
+//	checked, after every instruction.  With "tickPerBlock" that is
+//	done once per basic block instead: a block ends where control
+//	jumps (after the delay slot of a taken branch or jump), or after
+//	MaxBlockLength instructions.  An exception also ends the block:
+//	RaiseException charges for the instructions before it.  So
+//	interrupts are only taken between blocks, and the timer can be
+//	late by a block at most.  Single stepping always goes by
+//	instruction.
+//
+//	With "tickPerBlock", the blocks are run from translations of them
+//	(see RunBlock), unless something is to be done for every
+//	instruction -- single stepping, tracing them (-d m), the CPU
+//	caches or -prof -- when they are all interpreted.  Either way,
+//	the program runs with the same ticks.
+//
+//	Stalls in the simulated CPU caches (-l1, -l2) are charged after
+//	the instruction that had them, on top of its tick.
+//
+//	With -prof, the PC is sampled every ProfileInterval instructions,
+//	into the running program's histogram (see userprog/profiler.h).
 //----------------------------------------------------------------------
 
 void
 Machine::Run()
 {
     Instruction *instr = new Instruction;  // storage for decoded instruction
+    bool translated = tickPerBlock && !singleStep && cpuCache == NULL
+		      && kernel->profiler == NULL && !debug->IsEnabled('m');
 
     if (debug->IsEnabled('m')) {
         cout << "Starting program in thread: " << kernel->currentThread->getName();
@@ -64,14 +69,131 @@ Machine::Run()
     }
     kernel->interrupt->setStatus(UserMode);
     for (;;) {
+	if (translated && RunBlock())
+	    continue;
         OneInstruction(instr);
-		kernel->interrupt->OneTick();
+		kernel->stats->numInstructions++;
+		if (stallTicks > 0)
+			ChargeStalls();
+		if (kernel->profiler != NULL && ++sinceSample == ProfileInterval) {
+			PcProfile *profile = kernel->currentThread->space->Profile();
+
+			sinceSample = 0;
+			if (profile != NULL)
+				profile->Sample(registers[PCReg]);
+		}
+		if (!tickPerBlock || singleStep) {
+			kernel->interrupt->OneTick();
+		} else if (++blockLength == MaxBlockLength
+			   || registers[PCReg] != registers[PrevPCReg] + 4) {
+			EndBlock();
+		}
 		if (singleStep && (runUntilTime <= kernel->stats->totalTicks))
 	  		Debugger();
     }
 }
 
 
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	Run the user program from the PC to the end of its basic block,
+//	translating the block first if it has not been, or has changed
+//	since (see TranslatedBlock).  Each instruction is a direct call
+//	to the routine for it; the PC and the counters are brought up to
+//	date once at the end, and the block charged for, as Run would
+//	after interpreting each instruction.  The block is left early
+//	for MaxBlockLength, and at an instruction that only the
+//	interpreter can run.
+//
+//	Return FALSE if the instruction now at the PC is to be
+//	interpreted: one of those, or one in the delay slot of a jump
+//	from before the block, or one whose page FastTranslate does not
+//	remember.
+//----------------------------------------------------------------------
+
+bool
+Machine::RunBlock()
+{
+    int virtAddr = registers[PCReg];
+    int physAddr;
+    TranslatedBlock *block;
+    int limit, i;
+
+    if (registers[NextPCReg] != virtAddr + 4)
+	return FALSE;			// in a delay slot
+    if (!FastTranslate(virtAddr, &physAddr, 4, FALSE))
+	return FALSE;
+    block = blocks[physAddr / 4];
+    if (block == NULL || !block->Matches(virtAddr, &mainMemory[physAddr])) {
+	delete block;
+	block = TranslateBlock(virtAddr, physAddr);
+	blocks[physAddr / 4] = block;
+    }
+
+    limit = min(block->numOps, MaxBlockLength - blockLength);
+    for (i = 0; i < limit; i++) {
+	TranslatedOp *op = &block->ops[i];
+
+	if (!(*op->routine)(this, op))
+	    break;
+	if (op->commit)
+	    DelayedLoad(0, 0);
+    }
+    LeaveBlock(block, i);
+    if (i > 0 && (blockLength == MaxBlockLength
+		  || registers[PCReg] != registers[PrevPCReg] + 4)) {
+	EndBlock();
+	return TRUE;
+    }
+    return (i == limit);
+}
+
+//----------------------------------------------------------------------
+// Machine::LeaveBlock
+// 	Put the PC registers and the counters where interpreting the
+//	first "numRun" instructions of "block" would have left them.  If
+//	the last of those was the jump, it has set NextPCReg.
+//----------------------------------------------------------------------
+
+void
+Machine::LeaveBlock(TranslatedBlock *block, int numRun)
+{
+    Statistics *stats = kernel->stats;
+    bool jumped = (block->branch >= 0 && numRun == block->branch + 2);
+    bool inSlot = (block->branch >= 0 && numRun == block->branch + 1);
+
+    if (tlb != NULL)		// as FastTranslate would have counted
+	stats->numTlbHits += numRun - 1;	// the fetches after the first
+    if (numRun == 0)
+	return;
+    stats->numInstructions += numRun;
+    blockLength += numRun;
+    registers[PrevPCReg] = block->virtAddr + 4 * (numRun - 1);
+    if (jumped) {
+	registers[PCReg] = registers[NextPCReg];
+	registers[NextPCReg] = registers[PCReg] + 4;
+    } else {
+	registers[PCReg] = block->virtAddr + 4 * numRun;
+	if (!inSlot)
+	    registers[NextPCReg] = registers[PCReg] + 4;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::EndBlock
+// 	Charge for the basic block just run, and take the interrupts that
+//	are due (see Interrupt::BlockTick).
+//----------------------------------------------------------------------
+
+void
+Machine::EndBlock()
+{
+    int numInstructions = blockLength;
+
+    blockLength = 0;		// before we can be switched out
+    kernel->interrupt->BlockTick(numInstructions);
+}
+
 //----------------------------------------------------------------------
 // TypeToReg
 // 	Retrieve the register # referred to in an instruction. 
@@ -115,6 +237,15 @@ TypeToReg(RegType reg, Instruction *instr)
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
 //	and the register set.
+//
+//	The one thing kept between calls is the decoded form of each word
+//	of physical memory, so that a loop does not decode its instructions
+//	over again.  It cannot go stale: the word it was decoded from is
+//	kept with it, and compared with what is in memory at each fetch.
+//	The kernel writes into memory directly (loading pages, copying
+//	them on write), so this is cheaper than catching every write.
+//	The instruction is copied out, since another thread may re-decode
+//	its word while this one is in the kernel.
 //----------------------------------------------------------------------
 
 void
@@ -124,16 +255,32 @@ Machine::OneInstruction(Instruction *instr)
     int byte;       // described in Kane for LWL,LWR,...
 #endif
 
-    int raw;
+    unsigned int raw;
+    int physicalAddress;
+    Instruction *cached;
+    ExceptionType exception;
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
 
-    // Fetch instruction 
-    if (!ReadMem(registers[PCReg], 4, &raw))
-	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
+    // Fetch instruction, decoding it only if it is not the word last
+    // decoded at its physical address
+    if (!FastTranslate(registers[PCReg], &physicalAddress, 4, FALSE)) {
+	exception = Translate(registers[PCReg], &physicalAddress, 4, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, registers[PCReg]);
+	    return;		// exception occurred
+	}
+	Remember(registers[PCReg], physicalAddress, FALSE);
+    }
+    CacheAccess(physicalAddress);
+    raw = WordToHost(*(unsigned int *) &mainMemory[physicalAddress]);
+    cached = &decoded[physicalAddress / 4];
+    if (cached->value != raw) {
+	cached->value = raw;
+	cached->Decode();
+    }
+    *instr = *cached;
 
     if (debug->IsEnabled('m')) {
         struct OpString *str = &opStrings[instr->opCode];
@@ -826,3 +973,580 @@ Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr)
     *hiPtr = (int) hi;
     *loPtr = (int) lo;
 }
+
+//----------------------------------------------------------------------
+// TranslatedBlock::TranslatedBlock
+// 	Make room for the translation of the "numOps" instructions at
+//	"virtAddr", keeping the words "from" they are translated from.
+//----------------------------------------------------------------------
+
+TranslatedBlock::TranslatedBlock(int virtAddr, unsigned int *from,
+				 int numOps)
+{
+    this->virtAddr = virtAddr;
+    this->numOps = numOps;
+    branch = -1;
+    ops = new TranslatedOp[numOps];
+    words = new unsigned int[numOps];
+    bcopy(from, words, numOps * sizeof(unsigned int));
+}
+
+TranslatedBlock::~TranslatedBlock()
+{
+    delete [] ops;
+    delete [] words;
+}
+
+//----------------------------------------------------------------------
+// TranslatedBlock::Matches
+// 	Return TRUE if the block is still a translation of what is at
+//	"virtAddr": if it was translated for that address, and "memory",
+//	where the address is now, still holds the same words.
+//----------------------------------------------------------------------
+
+bool
+TranslatedBlock::Matches(int virtAddr, char *memory)
+{
+    return this->virtAddr == virtAddr
+	   && memcmp(words, memory, numOps * sizeof(unsigned int)) == 0;
+}
+
+//----------------------------------------------------------------------
+// IsJump
+// 	Return TRUE if "opCode" is of a jump or a branch, which has a
+//	delay slot.
+//----------------------------------------------------------------------
+
+static bool
+IsJump(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BGEZ: case OP_BGEZAL: case OP_BGTZ:
+      case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL: case OP_BNE:
+      case OP_J: case OP_JAL: case OP_JALR: case OP_JR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// IsLoad
+// 	Return TRUE if "opCode" is of a load a translated block can run.
+//----------------------------------------------------------------------
+
+static bool
+IsLoad(int opCode)
+{
+    switch (opCode) {
+      case OP_LB: case OP_LBU: case OP_LH: case OP_LHU: case OP_LW:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Written
+// 	Return the general register "instr" writes, -1 if none.  HI and
+//	LO are left to the routines that write them.
+//----------------------------------------------------------------------
+
+static int
+Written(Instruction *instr)
+{
+    switch (instr->opCode) {
+      case OP_ADD: case OP_ADDU: case OP_AND: case OP_NOR: case OP_OR:
+      case OP_SLT: case OP_SLTU: case OP_SUB: case OP_SUBU: case OP_XOR:
+      case OP_SLL: case OP_SLLV: case OP_SRA: case OP_SRAV: case OP_SRL:
+      case OP_SRLV: case OP_MFHI: case OP_MFLO: case OP_JALR:
+	return instr->rd;
+      case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_XORI:
+      case OP_SLTI: case OP_SLTIU: case OP_LUI:
+      case OP_LB: case OP_LBU: case OP_LH: case OP_LHU: case OP_LW:
+	return instr->rt;
+      case OP_JAL: case OP_BGEZAL: case OP_BLTZAL:
+	return R31;
+      default:
+	return -1;
+    }
+}
+
+//----------------------------------------------------------------------
+// Uses
+// 	Return TRUE if "instr" might read or write the register "reg":
+//	if any of its register fields names it, whether the instruction
+//	uses that field or not.
+//----------------------------------------------------------------------
+
+static bool
+Uses(Instruction *instr, int reg)
+{
+    return instr->rs == reg || instr->rt == reg || instr->rd == reg
+	   || Written(instr) == reg;
+}
+
+//----------------------------------------------------------------------
+// Interpret
+// 	The routine of an instruction only the interpreter can run.
+//----------------------------------------------------------------------
+
+static bool
+Interpret(Machine *machine, TranslatedOp *op)
+{
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateBlock
+// 	Translate the basic block at "virtAddr", whose first word is at
+//	"physAddr" in mainMemory; return the translation.  The block ends
+//	after the delay slot of its first jump or branch, at an
+//	instruction only the interpreter can run, at the end of the page,
+//	or after MaxBlockLength instructions.  A jump in a delay slot is
+//	left to the interpreter, since where it goes depends on the jump
+//	before it.
+//
+//	A load writes its register at once, unless the instruction after
+//	it might use the register, or is not in the block, or a delayed
+//	load might come before it; then the load is delayed as the
+//	interpreter delays it, and the instruction after it finishes it.
+//	The block may be entered with a load from before it in progress,
+//	so its first instruction finishes one, if there is one.
+//----------------------------------------------------------------------
+
+TranslatedBlock *
+Machine::TranslateBlock(int virtAddr, int physAddr)
+{
+    unsigned int *from = (unsigned int *) &mainMemory[physAddr];
+    Instruction instrs[MaxBlockLength];
+    TranslatedBlock *block;
+    int numOps = 0, branch = -1;
+    bool pending = TRUE;		// might a delayed load be in progress?
+					// from before the block, it might
+
+    do {
+	Instruction *instr = &instrs[numOps++];
+
+	instr->value = WordToHost(from[numOps - 1]);
+	instr->Decode();
+	if (branch >= 0)
+	    break;			// that was the delay slot
+	if (IsJump(instr->opCode))
+	    branch = numOps - 1;
+	else if (RoutineFor(instr->opCode) == Interpret)
+	    break;
+    } while (numOps < MaxBlockLength
+	     && (physAddr + 4 * numOps) % PageSize != 0);
+
+    block = new TranslatedBlock(virtAddr, from, numOps);
+    block->branch = branch;
+    for (int i = 0; i < numOps; i++) {
+	Instruction *instr = &instrs[i];
+	TranslatedOp *op = &block->ops[i];
+	int pc = virtAddr + 4 * i;
+	int written = Written(instr);
+
+	if (i != branch && IsJump(instr->opCode))
+	    op->routine = Interpret;	// in the delay slot
+	else
+	    op->routine = RoutineFor(instr->opCode);
+	op->d = (written > 0) ? &registers[written] : &sink;
+	op->s = &registers[(int) instr->rs];
+	op->t = &registers[(int) instr->rt];
+	op->link = pc + 8;
+	switch (instr->opCode) {
+	  case OP_ANDI: case OP_ORI: case OP_XORI:
+	    op->imm = instr->extra & 0xffff;
+	    break;
+	  case OP_LUI:
+	    op->imm = instr->extra << 16;
+	    break;
+	  case OP_BEQ: case OP_BGEZ: case OP_BGEZAL: case OP_BGTZ:
+	  case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL: case OP_BNE:
+	    op->imm = pc + 4 + IndexToAddr(instr->extra);
+	    break;
+	  case OP_J: case OP_JAL:
+	    op->imm = ((pc + 8) & 0xf0000000) | IndexToAddr(instr->extra);
+	    break;
+	  default:
+	    op->imm = instr->extra;
+	}
+	op->loadReg = instr->rt;
+	op->commit = FALSE;
+	op->delayed = FALSE;
+	if (IsLoad(instr->opCode)) {	// it finishes a load before it
+	    op->delayed = pending || (instr->rt != 0 && (i == numOps - 1
+					|| Uses(&instrs[i + 1], instr->rt)));
+	    pending = op->delayed;
+	} else {
+	    op->commit = pending;
+	    pending = FALSE;
+	}
+    }
+    DEBUG(dbgMach, "Translated " << numOps << " instructions at "
+		   << virtAddr);
+    return block;
+}
+
+//----------------------------------------------------------------------
+// Machine::RoutineFor
+// 	Return the routine that carries out an instruction with the op
+//	code "opCode" in a translated block (see TranslateBlock for what
+//	its operands are).  Each does what Machine::OneInstruction does
+//	for the instruction, but for advancing the PC; a jump or branch
+//	sets NextPCReg to where it goes, and a load writes its register
+//	at once unless it is delayed.  Each returns FALSE, having
+//	changed nothing, where the interpreter might raise an exception;
+//	the interpreter then runs the instruction instead, and raises it.
+//----------------------------------------------------------------------
+
+OpRoutine
+Machine::RoutineFor(int opCode)
+{
+    switch (opCode) {
+      case OP_ADD:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int sum = *op->s + *op->t;
+
+	    if (!((*op->s ^ *op->t) & SIGN_BIT) && ((*op->s ^ sum) & SIGN_BIT))
+		return FALSE;		// overflow
+	    *op->d = sum;
+	    return TRUE;
+	};
+      case OP_ADDI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int sum = *op->s + op->imm;
+
+	    if (!((*op->s ^ op->imm) & SIGN_BIT) && ((op->imm ^ sum) & SIGN_BIT))
+		return FALSE;		// overflow
+	    *op->d = sum;
+	    return TRUE;
+	};
+      case OP_ADDIU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s + op->imm;
+	    return TRUE;
+	};
+      case OP_ADDU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s + *op->t;
+	    return TRUE;
+	};
+      case OP_AND:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s & *op->t;
+	    return TRUE;
+	};
+      case OP_ANDI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s & op->imm;
+	    return TRUE;
+	};
+      case OP_BEQ:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = (*op->s == *op->t) ? op->imm : op->link;
+	    return TRUE;
+	};
+      case OP_BGEZAL:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = op->link;
+	    m->registers[NextPCReg] = !(*op->s & SIGN_BIT) ? op->imm
+							   : op->link;
+	    return TRUE;
+	};
+      case OP_BGEZ:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = !(*op->s & SIGN_BIT) ? op->imm
+							   : op->link;
+	    return TRUE;
+	};
+      case OP_BGTZ:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = (*op->s > 0) ? op->imm : op->link;
+	    return TRUE;
+	};
+      case OP_BLEZ:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = (*op->s <= 0) ? op->imm : op->link;
+	    return TRUE;
+	};
+      case OP_BLTZAL:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = op->link;
+	    m->registers[NextPCReg] = (*op->s & SIGN_BIT) ? op->imm : op->link;
+	    return TRUE;
+	};
+      case OP_BLTZ:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = (*op->s & SIGN_BIT) ? op->imm : op->link;
+	    return TRUE;
+	};
+      case OP_BNE:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = (*op->s != *op->t) ? op->imm : op->link;
+	    return TRUE;
+	};
+      case OP_DIV:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    if (*op->t == 0) {
+		m->registers[LoReg] = 0;
+		m->registers[HiReg] = 0;
+	    } else {
+		m->registers[LoReg] = *op->s / *op->t;
+		m->registers[HiReg] = *op->s % *op->t;
+	    }
+	    return TRUE;
+	};
+      case OP_DIVU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    unsigned int rs = *op->s, rt = *op->t;
+
+	    if (rt == 0) {
+		m->registers[LoReg] = 0;
+		m->registers[HiReg] = 0;
+	    } else {
+		m->registers[LoReg] = (int) (rs / rt);
+		m->registers[HiReg] = (int) (rs % rt);
+	    }
+	    return TRUE;
+	};
+      case OP_JAL:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = op->link;
+	    m->registers[NextPCReg] = op->imm;
+	    return TRUE;
+	};
+      case OP_J:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = op->imm;
+	    return TRUE;
+	};
+      case OP_JALR:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = op->link;		// first, as the interpreter does
+	    m->registers[NextPCReg] = *op->s;
+	    return TRUE;
+	};
+      case OP_JR:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[NextPCReg] = *op->s;
+	    return TRUE;
+	};
+      case OP_LB:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr, value;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 1, FALSE))
+		return FALSE;
+	    value = (signed char) m->mainMemory[physAddr];
+	    if (op->delayed)
+		m->DelayedLoad(op->loadReg, value);
+	    else
+		*op->d = value;
+	    return TRUE;
+	};
+      case OP_LBU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr, value;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 1, FALSE))
+		return FALSE;
+	    value = (unsigned char) m->mainMemory[physAddr];
+	    if (op->delayed)
+		m->DelayedLoad(op->loadReg, value);
+	    else
+		*op->d = value;
+	    return TRUE;
+	};
+      case OP_LH:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr, value;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 2, FALSE))
+		return FALSE;
+	    value = (short) ShortToHost(*(unsigned short *)
+					&m->mainMemory[physAddr]);
+	    if (op->delayed)
+		m->DelayedLoad(op->loadReg, value);
+	    else
+		*op->d = value;
+	    return TRUE;
+	};
+      case OP_LHU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr, value;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 2, FALSE))
+		return FALSE;
+	    value = ShortToHost(*(unsigned short *) &m->mainMemory[physAddr]);
+	    if (op->delayed)
+		m->DelayedLoad(op->loadReg, value);
+	    else
+		*op->d = value;
+	    return TRUE;
+	};
+      case OP_LUI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = op->imm;
+	    return TRUE;
+	};
+      case OP_LW:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr, value;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 4, FALSE))
+		return FALSE;
+	    value = WordToHost(*(unsigned int *) &m->mainMemory[physAddr]);
+	    if (op->delayed)
+		m->DelayedLoad(op->loadReg, value);
+	    else
+		*op->d = value;
+	    return TRUE;
+	};
+      case OP_MFHI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = m->registers[HiReg];
+	    return TRUE;
+	};
+      case OP_MFLO:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = m->registers[LoReg];
+	    return TRUE;
+	};
+      case OP_MTHI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[HiReg] = *op->s;
+	    return TRUE;
+	};
+      case OP_MTLO:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    m->registers[LoReg] = *op->s;
+	    return TRUE;
+	};
+      case OP_MULT:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    Mult(*op->s, *op->t, TRUE, &m->registers[HiReg],
+		 &m->registers[LoReg]);
+	    return TRUE;
+	};
+      case OP_MULTU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    Mult(*op->s, *op->t, FALSE, &m->registers[HiReg],
+		 &m->registers[LoReg]);
+	    return TRUE;
+	};
+      case OP_NOR:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = ~(*op->s | *op->t);
+	    return TRUE;
+	};
+      case OP_OR:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s | *op->t;
+	    return TRUE;
+	};
+      case OP_ORI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s | op->imm;
+	    return TRUE;
+	};
+      case OP_SB:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 1, TRUE))
+		return FALSE;
+	    m->mainMemory[physAddr] = (unsigned char) (*op->t & 0xff);
+	    return TRUE;
+	};
+      case OP_SH:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 2, TRUE))
+		return FALSE;
+	    *(unsigned short *) &m->mainMemory[physAddr]
+		= ShortToMachine((unsigned short) (*op->t & 0xffff));
+	    return TRUE;
+	};
+      case OP_SLL:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->t << op->imm;
+	    return TRUE;
+	};
+      case OP_SLLV:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->t << (*op->s & 0x1f);
+	    return TRUE;
+	};
+      case OP_SLT:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = (*op->s < *op->t) ? 1 : 0;
+	    return TRUE;
+	};
+      case OP_SLTI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = (*op->s < op->imm) ? 1 : 0;
+	    return TRUE;
+	};
+      case OP_SLTIU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = ((unsigned int) *op->s < (unsigned int) op->imm) ? 1 : 0;
+	    return TRUE;
+	};
+      case OP_SLTU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = ((unsigned int) *op->s < (unsigned int) *op->t) ? 1 : 0;
+	    return TRUE;
+	};
+      case OP_SRA:
+      case OP_SRL:			// shifting the sign in, as the
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->t >> op->imm;	// interpreter does
+	    return TRUE;
+	};
+      case OP_SRAV:
+      case OP_SRLV:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->t >> (*op->s & 0x1f);
+	    return TRUE;
+	};
+      case OP_SUB:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int diff = *op->s - *op->t;
+
+	    if (((*op->s ^ *op->t) & SIGN_BIT) && ((*op->s ^ diff) & SIGN_BIT))
+		return FALSE;		// overflow
+	    *op->d = diff;
+	    return TRUE;
+	};
+      case OP_SUBU:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s - *op->t;
+	    return TRUE;
+	};
+      case OP_SW:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    int physAddr;
+
+	    if (!m->FastTranslate(*op->s + op->imm, &physAddr, 4, TRUE))
+		return FALSE;
+	    *(unsigned int *) &m->mainMemory[physAddr]
+		= WordToMachine((unsigned int) *op->t);
+	    return TRUE;
+	};
+      case OP_XOR:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s ^ *op->t;
+	    return TRUE;
+	};
+      case OP_XORI:
+	return [](Machine *m, TranslatedOp *op) -> bool {
+	    *op->d = *op->s ^ op->imm;
+	    return TRUE;
+	};
+      default:				// system calls, the unaligned
+	return Interpret;		// loads and stores, and the rest
+    }
+}
@@ -1,6 +1,7 @@
 // network.cc 
 //	Routines to simulate a network interface, using UNIX sockets
-//	to deliver packets between multiple invocations of nachos.
+//	to deliver packets between multiple invocations of nachos, or
+//	rings between the machines of one (see Wires).
 //
 //  DO NOT CHANGE -- part of the machine emulation
 //
@@ -11,28 +12,148 @@
 #include "copyright.h"
 #include "network.h"
 #include "main.h"
+#include "inputlog.h"
+
+//-----------------------------------------------------------------------
+// Wires::Wires
+// 	Connect "n" machines, each to each other one, with empty rings.
+//-----------------------------------------------------------------------
+
+Wires::Wires(int n)
+{
+    numMachines = n;
+    rings = new RingQueue<WirePacket> *[n * n];
+    for (int i = 0; i < n * n; i++)
+	rings[i] = new RingQueue<WirePacket>(WireRingSize);
+    nextFrom = new int[n];
+    bellIn = new int[n];
+    bellOut = new int[n];
+    for (int i = 0; i < n; i++) {
+	nextFrom[i] = 0;
+	OpenDoorbell(&bellIn[i], &bellOut[i]);
+    }
+}
+
+//-----------------------------------------------------------------------
+// Wires::~Wires
+// 	Take the wires down, once every machine has halted.
+//-----------------------------------------------------------------------
+
+Wires::~Wires()
+{
+    for (int i = 0; i < numMachines * numMachines; i++)
+	delete rings[i];
+    for (int i = 0; i < numMachines; i++) {
+	Close(bellIn[i]);
+	Close(bellOut[i]);
+    }
+    delete [] rings;
+    delete [] nextFrom;
+    delete [] bellIn;
+    delete [] bellOut;
+}
+
+//-----------------------------------------------------------------------
+// Wires::Send
+// 	Put "packet", MaxWireSize bytes with a PacketHeader first, on the
+//	ring from the machine it is from to the one it is to, and ring
+//	that one's doorbell if the ring was empty.  Return FALSE, putting
+//	nothing anywhere, if there is no such machine or the ring is full.
+//	Only the machine it is from calls this.
+//-----------------------------------------------------------------------
+
+bool
+Wires::Send(char *packet)
+{
+    PacketHeader hdr = *(PacketHeader *)packet;
+    WirePacket wire;
+    bool wasEmpty;
+
+    if (hdr.to < 0 || hdr.to >= numMachines)
+	return FALSE;
+    bcopy(packet, wire.bytes, MaxWireSize);
+    if (!rings[hdr.from * numMachines + hdr.to]->Put(wire, &wasEmpty))
+	return FALSE;
+    if (wasEmpty)
+	RingDoorbell(bellOut[hdr.to]);
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------
+// Wires::Receive
+// 	Take the next packet for the machine "to" off its rings into
+//	"packet", MaxWireSize bytes, and return TRUE; FALSE if there is
+//	none.  The rings are taken in turn, starting from the one after
+//	the last one a packet came from.  Only "to" calls this.
+//
+//	The doorbell is only cleared once every ring has been found
+//	empty, and they are then looked at again: a packet put after the
+//	first look rang it, and is found by the second.  A ring missed
+//	between the two costs no more than a wait of IdlePollDelay.
+//-----------------------------------------------------------------------
+
+bool
+Wires::Receive(NetworkAddress to, char *packet)
+{
+    WirePacket wire;
+
+    if (to < 0 || to >= numMachines)
+	return FALSE;
+    for (int pass = 0; pass < 2; pass++) {
+	for (int i = 0; i < numMachines; i++) {
+	    int from = (nextFrom[to] + i) % numMachines;
+
+	    if (rings[from * numMachines + to]->Get(&wire)) {
+		nextFrom[to] = (from + 1) % numMachines;
+		bcopy(wire.bytes, packet, MaxWireSize);
+		return TRUE;
+	    }
+	}
+	if (pass == 0)
+	    ClearDoorbell(bellIn[to]);
+    }
+    return FALSE;
+}
 
 //-----------------------------------------------------------------------
 // NetworkInput::NetworkInput
 // 	Initialize the simulation for the network input
 //
 //   	"toCall" is the interrupt handler to call when packet arrives
+//
+//	When input is being replayed (see inputlog.h), the socket is
+//	never read.  On the wires (-machines), there is no socket: the
+//	machine watches its doorbell instead.
 //-----------------------------------------------------------------------
 
 NetworkInput::NetworkInput(CallBackObj *toCall)
 {
+    replay = (kernel->inputLog != NULL && kernel->inputLog->Replaying());
     // set up the stuff to emulate asynchronous interrupts
     callWhenAvail = toCall;
     packetAvail = FALSE;
     inHdr.length = 0;
+    latency = kernel->netLatency;
+    jitter = kernel->netJitter;
+    queueLimit = kernel->netQueue;
+    queue = new char[max(queueLimit, 1)][MaxWireSize];
+    due = new Ticks[max(queueLimit, 1)];
+    head = 0;
+    numQueued = 0;
     
-    sock = OpenSocket();
-    sprintf(sockName, "SOCKET_%d", kernel->hostName);
-    AssignNameToSocket(sockName, sock);		 // Bind socket to a filename 
+    sock = -1;
+    if (wires == NULL) {
+	sock = OpenSocket();
+	sprintf(sockName, "SOCKET_%d", kernel->hostName);
+	AssignNameToSocket(sockName, sock);	 // Bind socket to a filename 
 						 // in the current directory.
+    }
 
     // start polling for incoming packets
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
+    if (!replay)
+	kernel->interrupt->WatchInput((sock >= 0) ? sock
+				      : wires->Doorbell(kernel->hostName));
+    kernel->interrupt->SchedulePoll(this, NetworkTime, NetworkRecvInt);
 }
 
 //-----------------------------------------------------------------------
@@ -43,8 +164,12 @@ NetworkInput::NetworkInput(CallBackObj *toCall)
 
 NetworkInput::~NetworkInput()
 {
-    CloseSocket(sock);
-    DeAssignNameToSocket(sockName);
+    if (sock >= 0) {
+	CloseSocket(sock);
+	DeAssignNameToSocket(sockName);
+    }
+    delete [] due;
+    delete [] queue;
 }
 
 //-----------------------------------------------------------------------
@@ -55,29 +180,33 @@ NetworkInput::~NetworkInput()
 //      First check to make sure packet is available & there's space to
 //	pull it in.  Then invoke the "callBack" registered by whoever 
 //	wants the packet.
+//
+//	When replaying, the packet is the next one logged, if it is due;
+//	when recording, each packet is logged as it is read.
+//
+//	Every packet there is is read into the queue, while there is room
+//	in it -- or, with a queue limit, dropped when there is not.  The
+//	one at the head is then passed on once it is due, and the one
+//	before it has been taken.
 //-----------------------------------------------------------------------
 
 void
 NetworkInput::CallBack()
 {
+    char buffer[MaxWireSize];
+
     // schedule the next time to poll for a packet
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
+    kernel->interrupt->SchedulePoll(this, NetworkTime, NetworkRecvInt);
 
-    if (inHdr.length != 0) 	// do nothing if packet is already buffered
-	return;		
-    if (!PollSocket(sock)) 	// do nothing if no packet to be read
-	return;
+    while ((queueLimit > 0 || numQueued == 0) && ReadPacket(buffer))
+	Enqueue(buffer);
 
-    // otherwise, read packet in
-    char *buffer = new char[MaxWireSize];
-    ReadFromSocket(sock, buffer, MaxWireSize);
+    if (inHdr.length != 0 || numQueued == 0
+	|| due[head] > kernel->stats->totalTicks)
+	return;				// taken already, or not due yet
 
     // divide packet into header and data
-    inHdr = *(PacketHeader *)buffer;
-    ASSERT((inHdr.to == kernel->hostName) && (inHdr.length <= MaxPacketSize));
-    bcopy(buffer + sizeof(PacketHeader), inbox, inHdr.length);
-    delete [] buffer ;
-
+    inHdr = *(PacketHeader *)queue[head];
     DEBUG(dbgNet, "Network received packet from " << inHdr.from << ", length " << inHdr.length);
     kernel->stats->numPacketsRecvd++;
 
@@ -85,6 +214,77 @@ NetworkInput::CallBack()
     callWhenAvail->CallBack();
 }
 
+//-----------------------------------------------------------------------
+// NetworkInput::ReadPacket
+// 	Read the next packet off the wire into "buffer", if there is one
+//	(or, when replaying, if the next one logged is due), and return
+//	TRUE; FALSE if there is none.
+//-----------------------------------------------------------------------
+
+bool
+NetworkInput::ReadPacket(char *buffer)
+{
+    PacketHeader hdr;
+
+    if (replay) {
+	if (kernel->inputLog->Replay(InputNetwork, buffer, MaxWireSize) < 0)
+	    return FALSE;
+    } else if (sock < 0) {
+	// a look at the rings costs no system call, so it is taken
+	// even when the idle wait found nothing
+	if (!wires->Receive(kernel->hostName, buffer))
+	    return FALSE;
+    } else {
+	if (kernel->interrupt->InputQuiet() || !PollSocket(sock))
+	    return FALSE;	// do nothing if no packet to be read
+	// otherwise, read packet in
+	ReadFromSocket(sock, buffer, MaxWireSize);
+    }
+    hdr = *(PacketHeader *)buffer;
+    ASSERT((hdr.to == kernel->hostName) && (hdr.length <= MaxPacketSize));
+    if (kernel->inputLog != NULL && !replay)
+	kernel->inputLog->Record(InputNetwork, buffer,
+				 sizeof(PacketHeader) + hdr.length);
+    return TRUE;
+}
+
+//-----------------------------------------------------------------------
+// NetworkInput::Enqueue
+// 	Put a packet just read at the end of the queue, to be delivered
+//	once the latency, and some of the jitter, have gone by; or drop
+//	it, if the queue is full.
+//-----------------------------------------------------------------------
+
+void
+NetworkInput::Enqueue(char *buffer)
+{
+    PacketHeader hdr = *(PacketHeader *)buffer;
+    LinkStats *link = kernel->stats->LinkFrom(hdr.from);
+    int tail;
+
+    if (numQueued == max(queueLimit, 1)) {
+	DEBUG(dbgNet, "Network queue full, dropped packet from " << hdr.from);
+	if (link != NULL)
+	    link->drops++;
+	return;
+    }
+    tail = (head + numQueued) % max(queueLimit, 1);
+    bcopy(buffer, queue[tail], sizeof(PacketHeader) + hdr.length);
+    due[tail] = kernel->stats->totalTicks + latency;
+    if (jitter > 0)
+	due[tail] += RandomNumber() % (jitter + 1);
+    if (numQueued > 0 && due[tail] < due[(tail + max(queueLimit, 1) - 1)
+						% max(queueLimit, 1)])
+	due[tail] = due[(tail + max(queueLimit, 1) - 1) % max(queueLimit, 1)];
+					// in order, however it jitters
+    numQueued++;
+    if (link != NULL) {
+	link->packets++;
+	link->bytes += sizeof(PacketHeader) + hdr.length;
+	link->peakQueue = max(link->peakQueue, numQueued);
+    }
+}
+
 //-----------------------------------------------------------------------
 // NetworkInput::Receive
 // 	Read a packet, if one is buffered
@@ -97,7 +297,9 @@ NetworkInput::Receive(char* data)
 
     inHdr.length = 0;
     if (hdr.length != 0) {
-    	bcopy(inbox, data, hdr.length);
+    	bcopy(queue[head] + sizeof(PacketHeader), data, hdr.length);
+	head = (head + 1) % max(queueLimit, 1);
+	numQueued--;
     }
     return hdr;
 }
@@ -119,7 +321,30 @@ NetworkOutput::NetworkOutput(double reliability, CallBackObj *toCall)
     // set up the stuff to emulate asynchronous interrupts
     callWhenDone = toCall;
     sendBusy = FALSE;
-    sock = OpenSocket();
+    bandwidth = kernel->netBandwidth;
+    sock = (wires == NULL) ? OpenSocket() : -1;
+}
+
+//-----------------------------------------------------------------------
+// NetworkOutput::ParseLink
+// 	Translate a link, as given on the command line -- its latency in
+//	ticks, its bandwidth in bytes per tick (0 for the time of a packet
+//	not to depend on its size), and optionally its jitter in ticks,
+//	separated by commas -- into the three.  Return FALSE if they do
+//	not make a link.
+//-----------------------------------------------------------------------
+
+bool
+NetworkOutput::ParseLink(char *spec, int *latency, double *bandwidth,
+			 int *jitter)
+{
+    int n = sscanf(spec, "%d,%lf,%d", latency, bandwidth, jitter);
+
+    if (n == 2)
+	*jitter = 0;
+    else if (n != 3)
+	return FALSE;
+    return *latency >= 0 && *bandwidth >= 0 && *jitter >= 0;
 }
 
 //-----------------------------------------------------------------------
@@ -129,7 +354,8 @@ NetworkOutput::NetworkOutput(double reliability, CallBackObj *toCall)
 
 NetworkOutput::~NetworkOutput()
 {
-    CloseSocket(sock);
+    if (sock >= 0)
+	CloseSocket(sock);
 }
 
 //-----------------------------------------------------------------------
@@ -149,16 +375,21 @@ NetworkOutput::CallBack()
 // NetworkOutput::Send
 // 	Send a packet into the simulated network, to the destination in hdr.
 // 	Concatenate hdr and data, and schedule an interrupt to tell the user 
-// 	when the next packet can be sent 
+// 	when the next packet can be sent: after NetworkTime, and the time
+//	its bytes take at the link's bandwidth, if it has one.
 //
 // 	Note we always pad out a packet to MaxWireSize before putting it into
-// 	the socket, because it's simpler at the receive end.
+// 	the socket, because it's simpler at the receive end.  On the wires
+//	(-machines), a packet that finds the ring full is lost.
 //-----------------------------------------------------------------------
 
 void
 NetworkOutput::Send(PacketHeader hdr, char* data)
 {
     char toName[32];
+    int bytes = sizeof(PacketHeader) + hdr.length;
+    int sendTime = NetworkTime;
+    LinkStats *link = kernel->stats->LinkTo(hdr.to);
 
     sprintf(toName, "SOCKET_%d", (int)hdr.to);
     
@@ -166,17 +397,30 @@ NetworkOutput::Send(PacketHeader hdr, char* data)
 	(hdr.length <= MaxPacketSize) && (hdr.from == kernel->hostName));
     DEBUG(dbgNet, "Sending to addr " << hdr.to << ", length " << hdr.length);
 
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkSendInt);
+    if (bandwidth > 0)
+	sendTime += (int) (bytes / bandwidth + 0.999);
+    kernel->interrupt->Schedule(this, sendTime, NetworkSendInt);
+    if (link != NULL) {
+	link->packets++;
+	link->bytes += bytes;
+    }
 
     if (RandomNumber() % 100 >= chanceToWork * 100) { // emulate a lost packet
 	DEBUG(dbgNet, "oops, lost it!");
+	if (link != NULL)
+	    link->drops++;
 	return;
     }
 
     // concatenate hdr and data into a single buffer, and send it out
-    char *buffer = new char[MaxWireSize];
-    *(PacketHeader *)buffer = hdr;
-    bcopy(data, buffer + sizeof(PacketHeader), hdr.length);
-    SendToSocket(sock, buffer, MaxWireSize, toName);
-    delete [] buffer;
+    bzero(wire, MaxWireSize);
+    *(PacketHeader *)wire = hdr;
+    bcopy(data, wire + sizeof(PacketHeader), hdr.length);
+    if (sock >= 0)
+	SendToSocket(sock, wire, MaxWireSize, toName);
+    else if (!wires->Send(wire)) {
+	DEBUG(dbgNet, "no room on the wire, lost it!");
+	if (link != NULL)
+	    link->drops++;
+    }
 }
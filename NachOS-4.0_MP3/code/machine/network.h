@@ -18,6 +18,7 @@
 #include "copyright.h"
 #include "utility.h"
 #include "callback.h"
+#include "ringqueue.h"
 
 // Network address -- uniquely identifies a machine.  This machine's ID 
 //  is given on the command line.
@@ -43,6 +44,55 @@ class PacketHeader {
 				// data "payload" of the largest packet
 
 
+// The following class defines the wires between the machines run in
+// one host process (-machines), in place of the UNIX sockets between
+// machines run in processes of their own.  Each machine is on a host
+// thread of its own (see main.cc), and there is a ring of packets from
+// each machine to each other one, with one producer and one consumer,
+// so a packet takes no lock and no system call on its way (see
+// ringqueue.h).  A packet sent to a machine whose ring from the sender
+// was empty rings its doorbell, so that, if it is idle, it stops
+// waiting for input (see Interrupt::Idle).
+//
+// A packet to a machine that is not there, or whose ring from the
+// sender is full, is lost.
+
+const int WireRingSize = 64;		// packets on their way from one
+					// machine to another at once
+
+class WirePacket {
+  public:
+    char bytes[MaxWireSize];		// as it goes out on the wire
+};
+
+class Wires {
+  public:
+    Wires(int numMachines);		// Connect machines 0 up to
+					// "numMachines" - 1
+    ~Wires();
+
+    bool Send(char *packet);		// Put a packet on the wire to the
+					// machine its header names; FALSE
+					// if it is lost
+    bool Receive(NetworkAddress to, char *packet);
+					// Take the next packet for "to"
+					// off the wires; FALSE if none
+    int Doorbell(NetworkAddress to) { return bellIn[to]; }
+					// for "to" to wait for input on
+
+  private:
+    int numMachines;
+    RingQueue<WirePacket> **rings;	// from each machine to each, at
+					// [from * numMachines + to]
+    int *nextFrom;			// the ring each machine looks at
+					// first next time, so that none
+					// is starved
+    int *bellIn;			// each machine's doorbell
+    int *bellOut;			// and the end to ring it from
+};
+
+extern Wires *wires;			// NULL, unless -machines
+
 // The following two classes defines a physical network device.  The network
 // is capable of delivering fixed sized packets, in order but unreliably, 
 // to other machines connected to the network.
@@ -52,6 +102,23 @@ class PacketHeader {
 // a packet.  Note that you can change the seed for the random number 
 // generator, by changing the arguments to RandomInit() in Initialize().
 // The random number generator is used to choose which packets to drop.
+//
+// The links can be given a latency, a bandwidth and a jitter (-nl),
+// and the receiving end a queue of packets of bounded length (-nq):
+//
+//	a packet keeps the sender busy for NetworkTime, and then for as
+//	long as its bytes, header and all, take at the bandwidth;
+//	a packet that has arrived is delivered once the latency (plus a
+//	random part of the jitter) has gone by, in the order packets
+//	arrived; until then it waits in the queue, and one that arrives
+//	to a full queue is dropped.  With no queue, a packet is only
+//	read off the socket once the one before has been taken, as it
+//	always was.
+//
+// Each machine runs on a clock of its own, so the latency is counted
+// at the receiving end, from when it finds the packet.  The packets,
+// bytes, losses and drops of every link, and the longest its queue
+// got, are counted (see Statistics::Print).
 
 class NetworkInput : public CallBackObj{
   public:
@@ -69,21 +136,41 @@ class NetworkInput : public CallBackObj{
     void CallBack();		// A packet may have arrived.
 
   private:
-    int sock;                   // UNIX socket number for incoming packets
+    int sock;                   // UNIX socket number for incoming packets;
+				// -1 on the wires (-machines)
     char sockName[32];          // File name corresponding to UNIX socket
+    bool replay;                // are packets replayed from a log?
 
     CallBackObj *callWhenAvail; // Interrupt handler, signalling packet has 
 				// 	arrived.
     bool packetAvail;		// Packet has arrived, can be pulled off of
 				//   network
-    PacketHeader inHdr;		// Information about arrived packet
-    char inbox[MaxPacketSize];  // Data for arrived packet
+    PacketHeader inHdr;		// Information about the arrived packet
+				// at the head of the queue, once it
+				// is due; length 0 until then
+    int latency;		// ticks until an arrived packet is due
+    int jitter;			// and at most this many more
+    int queueLimit;		// packets that may wait; 0 for one
+				// without drops
+    char (*queue)[MaxWireSize];	// the arrived packets as they came off
+				// the wire, header first, in a ring
+    Ticks *due;			// when each one is to be delivered
+    int head;			// where the first one is
+    int numQueued;		// how many there are
+
+    bool ReadPacket(char *buffer); // Read a packet off the wire, if
+				// there is one
+    void Enqueue(char *buffer);	// Queue it, or drop it if full
 };
 
 class NetworkOutput : public CallBackObj {
   public:
     NetworkOutput(double reliability, CallBackObj *toCall);
 				// Allocate and initialize network output driver
+    static bool ParseLink(char *spec, int *latency, double *bandwidth,
+			  int *jitter);
+				// Map "latency,bandwidth[,jitter]" to
+				// the three
     ~NetworkOutput();		// De-allocate the network input driver data
     
     void Send(PacketHeader hdr, char* data);
@@ -100,11 +187,14 @@ class NetworkOutput : public CallBackObj {
 				// sent
 
   private:
-    int sock;                   // UNIX socket number for outgoing packets
+    int sock;                   // UNIX socket number for outgoing packets;
+				// -1 on the wires (-machines)
     double chanceToWork;	// Likelihood packet will be dropped
     CallBackObj *callWhenDone;  // Interrupt handler, signalling next packet 
 				//      can be sent.  
     bool sendBusy;		// Packet is being sent.
+    double bandwidth;		// bytes per tick; 0 for none charged
+    char wire[MaxWireSize];	// the packet going out
 };
 
 #endif // NETWORK_H
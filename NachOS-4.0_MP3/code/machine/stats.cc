@@ -10,6 +10,12 @@
 #include "copyright.h"
 #include "debug.h"
 #include "stats.h"
+#include "sysdep.h"
+#include <string.h>
+
+static const Ticks NoSnapshot = 0x7fffffffffffffffLL;
+					// nextSnapshot, if there
+					// are none to take
 
 //----------------------------------------------------------------------
 // Statistics::Statistics
@@ -20,8 +26,70 @@ Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
     numDiskReads = numDiskWrites = 0;
+    numDiskBufferHits = numDiskCachedWrites = 0;
+    numDiskDestaged = numDiskFlushes = numDiskForcedWrites = 0;
+    numDiskErases = 0;
+    numDiskMerges = numDiskSharedReads = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
+    numTimerInterrupts = numContextSwitches = numUserStateLoads = 0;
+    numCPUs = 1;
+    numSteals = numMigrations = 0;
+    bzero(cpuBusyTicks, sizeof(cpuBusyTicks));
+    numInstructions = 0;
+    startNs = HostNanoseconds();
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    bzero(sentTo, sizeof(sentTo));
+    bzero(recvdFrom, sizeof(recvdFrom));
+    numSwapIns = numSwapOuts = numCopyOnWrites = 0;
+    numSwapPooled = numSwapPoolHits = numSwapPoolWritebacks = 0;
+    numPageCacheHits = 0;
+    numZeroFills = numSharedTextPages = 0;
+    numFaultAroundPages = numFaultAroundUsed = 0;
+    numSuspensions = numResumptions = 0;
+    numTlbHits = numTlbMisses = 0;
+    numMemAccesses = numL1Misses = numL2Misses = 0;
+    numCacheHits = numCacheMisses = numReadAheads = 0;
+    numCacheGhostHits = 0;
+    numFlusherWrites = numFlusherSectors = 0;
+    numJournalCommits = numJournalSectors = numCheckpoints = 0;
+    numSectorsChecked = numChecksumErrors = 0;
+    threads = new List<ThreadStats *>;
+    running = NULL;
+    chargedUser = chargedSystem = 0;
+    dumpRequested = FALSE;
+    nextSnapshot = NoSnapshot;
+    snapshotFileNo = -1;
+    snapshotInterval = 0;
+}
+
+//----------------------------------------------------------------------
+// Statistics::~Statistics
+// 	De-allocate the statistics kept for each thread.
+//----------------------------------------------------------------------
+
+Statistics::~Statistics()
+{
+    if (snapshotFileNo >= 0)
+	Close(snapshotFileNo);
+    while (!threads->IsEmpty())
+	delete threads->RemoveFront();
+    delete threads;
+}
+
+//----------------------------------------------------------------------
+// Statistics::NewThread
+// 	Return the statistics to keep for a thread being created, with
+//	ID "threadID" and name "threadName".  They stay here after the
+//	thread is gone.
+//----------------------------------------------------------------------
+
+ThreadStats *
+Statistics::NewThread(int threadID, char *threadName)
+{
+    ThreadStats *t = new ThreadStats(threadID, threadName);
+
+    threads->Append(t);
+    return t;
 }
 
 //----------------------------------------------------------------------
@@ -35,11 +103,481 @@ Statistics::Print()
 {
     cout << "Ticks: total " << totalTicks << ", idle " << idleTicks;
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
+    cout << "Timer: interrupts " << numTimerInterrupts;
+		cout << ", context switches " << numContextSwitches;
+		cout << ", user registers swapped " << numUserStateLoads << "\n";
+    if (numCPUs > 1) {
+	cout << "CPUs: " << numCPUs << ", busy ticks";
+	for (int i = 0; i < numCPUs; i++)
+	    cout << " " << cpuBusyTicks[i];
+	cout << ", steals " << numSteals;
+	cout << ", migrations " << numMigrations << "\n";
+    }
+    if (numInstructions > 0) {
+	double hostSeconds = (HostNanoseconds() - startNs) / 1e9;
+
+	cout << "Interpreter: instructions " << numInstructions;
+	cout << ", host seconds " << hostSeconds;
+	cout << ", per host second " << (long long) (numInstructions
+				/ (hostSeconds > 0 ? hostSeconds : 1)) << "\n";
+    }
     cout << "Disk I/O: reads " << numDiskReads;
-		cout << ", writes " << numDiskWrites << "\n";
+		cout << ", writes " << numDiskWrites;
+		cout << ", erases " << numDiskErases << "\n";
+    cout << "Disk cache: track buffer hits " << numDiskBufferHits;
+		cout << ", cached writes " << numDiskCachedWrites;
+		cout << ", destaged " << numDiskDestaged;
+		cout << ", flushes " << numDiskFlushes;
+		cout << ", forced writes " << numDiskForcedWrites << "\n";
+    cout << "Disk queue: merged " << numDiskMerges;
+		cout << ", shared reads " << numDiskSharedReads << "\n";
+    if (diskRequestTicks.Count() > 0) {
+	cout << "Disk request ticks: ";
+	diskRequestTicks.Print();
+    }
+    if (diskSeekTicks.Count() > 0) {
+	cout << "Disk seek ticks: ";
+	diskSeekTicks.Print();
+	cout << "Disk rotation ticks: ";
+	diskRotationTicks.Print();
+	cout << "Disk transfer ticks: ";
+	diskTransferTicks.Print();
+    }
+    cout << "Buffer cache: hits " << numCacheHits;
+		cout << ", misses " << numCacheMisses;
+		cout << ", ghost hits " << numCacheGhostHits;
+		cout << ", read ahead " << numReadAheads << "\n";
+    cout << "Flusher: writes " << numFlusherWrites;
+		cout << ", sectors " << numFlusherSectors << "\n";
+    cout << "Journal: commits " << numJournalCommits;
+		cout << ", sectors " << numJournalSectors;
+		cout << ", checkpoints " << numCheckpoints << "\n";
+    if (numSectorsChecked > 0) {
+	cout << "Checksums: sectors checked " << numSectorsChecked;
+	cout << ", errors " << numChecksumErrors << "\n";
+    }
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
-    cout << "Paging: faults " << numPageFaults << "\n";
+    cout << "Paging: faults " << numPageFaults;
+		cout << ", swap ins " << numSwapIns;
+		cout << ", swap outs " << numSwapOuts;
+		cout << ", zero fill " << numZeroFills;
+		cout << ", copy on write " << numCopyOnWrites;
+		cout << ", shared text " << numSharedTextPages << "\n";
+    if (numPageCacheHits > 0)
+	cout << "Page cache: hits " << numPageCacheHits << "\n";
+    if (numSwapPooled > 0) {
+	cout << "Compressed swap: pages pooled " << numSwapPooled;
+	cout << ", read back " << numSwapPoolHits;
+	cout << ", written to disk " << numSwapPoolWritebacks << "\n";
+    }
+    if (numFaultAroundPages > 0) {
+	cout << "Fault-around: pages read ahead " << numFaultAroundPages;
+	cout << ", used " << numFaultAroundUsed << "\n";
+    }
+    if (numSuspensions > 0) {
+	cout << "Load control: suspensions " << numSuspensions;
+	cout << ", resumptions " << numResumptions << "\n";
+    }
+    cout << "TLB: hits " << numTlbHits;
+		cout << ", misses " << numTlbMisses << "\n";
+    if (numMemAccesses > 0) {
+	cout << "CPU cache: accesses " << numMemAccesses;
+		cout << ", L1 misses " << numL1Misses;
+		cout << ", L2 misses " << numL2Misses << "\n";
+    }
     cout << "Network I/O: packets received " << numPacketsRecvd;
 		cout << ", sent " << numPacketsSent << "\n";
+    for (int host = 0; host < MaxNetHosts; host++) {
+	LinkStats *to = &sentTo[host];
+	LinkStats *from = &recvdFrom[host];
+
+	if (to->packets > 0) {
+	    cout << "Network to host " << host << ": packets " << to->packets;
+	    cout << ", bytes " << to->bytes;
+	    cout << ", lost " << to->drops << "\n";
+	}
+	if (from->packets > 0 || from->drops > 0) {
+	    cout << "Network from host " << host << ": packets "
+		 << from->packets;
+	    cout << ", bytes " << from->bytes;
+	    cout << ", dropped " << from->drops;
+	    cout << ", peak queue " << from->peakQueue << "\n";
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::LinkTo, Statistics::LinkFrom
+// 	Return the statistics of the link to (or from) "host", or NULL
+//	if its id is out of the range they are kept for.
+//----------------------------------------------------------------------
+
+LinkStats *
+Statistics::LinkTo(int host)
+{
+    return (host >= 0 && host < MaxNetHosts) ? &sentTo[host] : NULL;
+}
+
+LinkStats *
+Statistics::LinkFrom(int host)
+{
+    return (host >= 0 && host < MaxNetHosts) ? &recvdFrom[host] : NULL;
+}
+
+//----------------------------------------------------------------------
+// Statistics::PrintThreads
+// 	Print the statistics of every thread there has been, one line
+//	each, in the order they were created.
+//----------------------------------------------------------------------
+
+void
+Statistics::PrintThreads()
+{
+    ListIterator<ThreadStats *> it(threads);
+
+    ChargeRunning();
+    for (; !it.IsDone(); it.Next())
+	it.Item()->Print();
+}
+
+//----------------------------------------------------------------------
+// Statistics::PrintShares
+// 	For each thread that asked for a share of the CPU with SetTickets,
+//	print the share it asked for and the share it got, both of those
+//	threads' total: its tickets out of theirs, and the time it ran
+//	user and kernel code out of theirs.  Print nothing if none asked.
+//----------------------------------------------------------------------
+
+void
+Statistics::PrintShares()
+{
+    ListIterator<ThreadStats *> sum(threads);
+    ListIterator<ThreadStats *> it(threads);
+    int totalTickets = 0;
+    double totalRun = 0;
+
+    ChargeRunning();
+    for (; !sum.IsDone(); sum.Next()) {
+	if (sum.Item()->tickets > 0) {
+	    totalTickets += sum.Item()->tickets;
+	    totalRun += sum.Item()->userTicks + sum.Item()->systemTicks;
+	}
+    }
+    if (totalTickets == 0)
+	return;
+    cout << "CPU shares:\n";
+    for (; !it.IsDone(); it.Next()) {
+	ThreadStats *t = it.Item();
+
+	if (t->tickets > 0) {
+	    Ticks run = t->userTicks + t->systemTicks;
+
+	    cout << "Thread " << t->id << " " << t->name;
+	    cout << ": tickets=" << t->tickets;
+	    cout << " requested=" << 100.0 * t->tickets / totalTickets << "%";
+	    cout << " achieved=" << (totalRun > 0 ? 100.0 * run / totalRun : 0) << "%\n";
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadStats::ThreadStats
+// 	Initialize the statistics of a new thread to zero.
+//----------------------------------------------------------------------
+
+ThreadStats::ThreadStats(int threadID, char *threadName)
+{
+    id = threadID;
+    name = new char[strlen(threadName) + 1];
+    strcpy(name, threadName);
+    userTicks = systemTicks = blockedTicks = 0;
+    numDiskReads = numDiskWrites = 0;
+    bytesRead = bytesWritten = numCacheHits = 0;
+    numMemAccesses = numL1Misses = numL2Misses = 0;
+    for (int i = 0; i < MaxSyscallCodes; i++)
+	numSyscalls[i] = 0;
+    tickets = 0;
+    stackBytes = 0;
+}
+
+ThreadStats::~ThreadStats()
+{
+    delete [] name;
+}
+
+//----------------------------------------------------------------------
+// ThreadStats::CountSyscall
+// 	Count a system call with code "type".  The code comes from the
+//	user program, so one we do not know is not counted.
+//----------------------------------------------------------------------
+
+void
+ThreadStats::CountSyscall(int type)
+{
+    if (type >= 0 && type < MaxSyscallCodes)
+	numSyscalls[type]++;
+}
+
+//----------------------------------------------------------------------
+// ThreadStats::Print
+// 	Print a thread's statistics on one line, as "key=value" fields
+//	after its ID and name, for scripts to pick apart.  System calls
+//	are listed as "code:count" for the codes it used.  The CPU cache
+//	fields come last, and only if its accesses were simulated.
+//----------------------------------------------------------------------
+
+void
+ThreadStats::Print()
+{
+    bool first = TRUE;
+
+    cout << "Thread " << id << " " << name;
+    cout << ": user=" << userTicks << " system=" << systemTicks;
+    cout << " blocked=" << blockedTicks << " stack=" << stackBytes;
+    cout << " diskReads=" << numDiskReads << " diskWrites=" << numDiskWrites;
+    cout << " bytesRead=" << bytesRead << " bytesWritten=" << bytesWritten;
+    cout << " syscalls=";
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	if (numSyscalls[i] > 0) {
+	    cout << (first ? "" : ",") << i << ":" << numSyscalls[i];
+	    first = FALSE;
+	}
+    }
+    if (numMemAccesses > 0) {
+	cout << " memAccesses=" << numMemAccesses << " l1Misses=" << numL1Misses;
+	cout << " l2Misses=" << numL2Misses;
+    }
+    cout << "\n";
+}
+
+//----------------------------------------------------------------------
+// Statistics::PrintSyscalls
+// 	Print, for each code of system call that returned to the program
+//	at least once, a summary of how many ticks the calls took.
+//----------------------------------------------------------------------
+
+void
+Statistics::PrintSyscalls()
+{
+    bool first = TRUE;
+
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	if (syscallTicks[i].Count() == 0)
+	    continue;
+	if (first)
+	    cout << "System call latency:\n";
+	first = FALSE;
+	cout << "Syscall " << i << ": ";
+	syscallTicks[i].Print();
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::WriteSyscalls
+// 	Write the histogram of every code of system call that was timed
+//	to "fileName", as a JSON array of objects, one for each code.
+//----------------------------------------------------------------------
+
+void
+Statistics::WriteSyscalls(char *fileName)
+{
+    int fd = OpenForWrite(fileName);
+    bool first = TRUE;
+    char line[1000];
+
+    WriteFile(fd, "[", 1);
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	int used;
+
+	if (syscallTicks[i].Count() == 0)
+	    continue;
+	used = snprintf(line, sizeof(line), "%s  {\"code\": %d, \"ticks\": ",
+			first ? "\n" : ",\n", i);
+	syscallTicks[i].Format(line + used, sizeof(line) - used - 1);
+	strcat(line, "}");
+	WriteFile(fd, line, strlen(line));
+	first = FALSE;
+    }
+    WriteFile(fd, "\n]\n", 3);
+    Close(fd);
+}
+
+//----------------------------------------------------------------------
+// Statistics::AppendJson
+// 	Append the main counters, and the host seconds since Nachos
+//	started, to "fileName" (created if there is none) as a JSON
+//	object on one line.  Each run appends its own, so that a script
+//	running several can add them up.
+//----------------------------------------------------------------------
+
+void
+Statistics::AppendJson(char *fileName)
+{
+    int fd = OpenForReadWrite(fileName, FALSE);
+    char line[1000];
+
+    if (fd < 0)
+	fd = OpenForWrite(fileName);
+    Lseek(fd, 0, SEEK_END);
+    snprintf(line, sizeof(line), "{\"totalTicks\": %lld, \"idleTicks\": %lld, "
+	     "\"systemTicks\": %lld, \"userTicks\": %lld, "
+	     "\"numInstructions\": %lld, \"numContextSwitches\": %d, "
+	     "\"numDiskReads\": %d, \"numDiskWrites\": %d, "
+	     "\"numCacheHits\": %d, \"numCacheMisses\": %d, "
+	     "\"numPageFaults\": %d, \"numSwapIns\": %d, "
+	     "\"numSwapOuts\": %d, \"numTlbMisses\": %d, "
+	     "\"numConsoleCharsRead\": %d, \"numConsoleCharsWritten\": %d, "
+	     "\"numPacketsSent\": %d, \"numPacketsRecvd\": %d, "
+	     "\"hostSeconds\": %.3f}\n",
+	     totalTicks, idleTicks, systemTicks, userTicks, numInstructions,
+	     numContextSwitches, numDiskReads, numDiskWrites, numCacheHits,
+	     numCacheMisses, numPageFaults, numSwapIns, numSwapOuts,
+	     numTlbMisses, numConsoleCharsRead, numConsoleCharsWritten,
+	     numPacketsSent, numPacketsRecvd,
+	     (HostNanoseconds() - startNs) / 1e9);
+    WriteFile(fd, line, strlen(line));
+    Close(fd);
+}
+
+//----------------------------------------------------------------------
+// Statistics::StartSnapshots
+// 	Create "fileName", and from now on append a line of the main
+//	counters to it every "interval" ticks, for plotting how they grow
+//	over the run.  The first line names the columns; each line goes
+//	straight to the file, so the ones written survive a crash.
+//----------------------------------------------------------------------
+
+void
+Statistics::StartSnapshots(char *fileName, int interval)
+{
+    static char *header = "# ticks idle system user diskReads diskWrites "
+			  "cacheHits cacheMisses pageFaults consoleRead "
+			  "consoleWritten packetsSent packetsRecvd\n";
+
+    ASSERT(interval > 0);
+    snapshotFileNo = OpenForWrite(fileName);
+    snapshotInterval = interval;
+    WriteFile(snapshotFileNo, header, strlen(header));
+    nextSnapshot = totalTicks;		// the first one is of the start
+}
+
+//----------------------------------------------------------------------
+// Statistics::Snapshot
+// 	Append the counters as they are now to the snapshot file, and
+//	work out when the next line is due.  Time may have jumped past
+//	several intervals (an idle machine skips to its next interrupt),
+//	but a line is only written for the latest.
+//----------------------------------------------------------------------
+
+void
+Statistics::Snapshot()
+{
+    char line[200];
+
+    sprintf(line, "%lld %lld %lld %lld %d %d %d %d %d %d %d %d %d\n", totalTicks,
+	    idleTicks, systemTicks, userTicks, numDiskReads, numDiskWrites,
+	    numCacheHits, numCacheMisses, numPageFaults, numConsoleCharsRead,
+	    numConsoleCharsWritten, numPacketsSent, numPacketsRecvd);
+    WriteFile(snapshotFileNo, line, strlen(line));
+    while (nextSnapshot <= totalTicks)
+	nextSnapshot += snapshotInterval;
+}
+
+//----------------------------------------------------------------------
+// Statistics::SwitchTo, Statistics::ChargeRunning
+// 	The user and system time of a thread are charged to it when it
+//	is switched out, as what the totals grew by while it ran, rather
+//	than tick by tick; ChargeRunning brings the running thread up to
+//	date, for whatever reads its times before then.
+//
+//	"next" -- the statistics of the thread that runs from now on
+//----------------------------------------------------------------------
+
+void
+Statistics::SwitchTo(ThreadStats *next)
+{
+    ChargeRunning();
+    running = next;
+}
+
+void
+Statistics::ChargeRunning()
+{
+    if (running != NULL) {
+	running->userTicks += userTicks - chargedUser;
+	running->systemTicks += systemTicks - chargedSystem;
+    }
+    chargedUser = userTicks;
+    chargedSystem = systemTicks;
+}
+
+//----------------------------------------------------------------------
+// CountersLength
+// 	Return how many bytes the counters of "s" take, from totalTicks to
+//	the end of syscallTicks: all of them, none a pointer, in the order
+//	they are declared in.
+//----------------------------------------------------------------------
+
+static int
+CountersLength(Statistics *s)
+{
+    return (char *) &s->syscallTicks[MaxSyscallCodes] - (char *) &s->totalTicks;
+}
+
+//----------------------------------------------------------------------
+// Statistics::Save/Restore
+// 	Write the counters to the UNIX file "file", at where it is, for a
+//	checkpoint; and read them back from one, so that a run restored
+//	from it goes on counting from there (see userprog/checkpoint.h).
+//	What was counted of the host, the number of CPUs, when Nachos
+//	started and the instructions the interpreter ran in that time,
+//	is this run's own, and is kept; and so are the threads'.
+//----------------------------------------------------------------------
+
+void
+Statistics::Save(int file)
+{
+    WriteFile(file, (char *) &totalTicks, CountersLength(this));
+}
+
+void
+Statistics::Restore(int file)
+{
+    int cpus = numCPUs;
+    long long instructions = numInstructions;
+    long long start = startNs;
+
+    ChargeRunning();			// for what ran before this
+    Read(file, (char *) &totalTicks, CountersLength(this));
+    numCPUs = cpus;
+    numInstructions = instructions;
+    startNs = start;
+    chargedUser = userTicks;
+    chargedSystem = systemTicks;
+}
+
+//----------------------------------------------------------------------
+// Statistics::Report
+// 	Do what has come due since the last tick: print the statistics so
+//	far if the host asked for them, and take a snapshot if one's
+//	interval is up.  The signal handler only sets "dumpRequested",
+//	so that the counters are printed here, between two ticks, and
+//	not in the middle of being changed.
+//----------------------------------------------------------------------
+
+void
+Statistics::Report()
+{
+    if (dumpRequested) {
+	dumpRequested = FALSE;
+	cout << "--- Statistics at tick " << totalTicks << " ---\n";
+	Print();
+	PrintThreads();
+	PrintSyscalls();
+	cout << "---\n";
+	cout.flush();
+    }
+    if (snapshotFileNo >= 0 && totalTicks >= nextSnapshot)
+	Snapshot();
 }
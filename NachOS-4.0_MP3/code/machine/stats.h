@@ -12,6 +12,65 @@
 #define STATS_H
 
 #include "copyright.h"
+#include "list.h"
+#include "histogram.h"
+
+const int MaxSyscallCodes = 32;	// syscall codes counted per thread
+
+// The following class defines the statistics kept about one thread --
+// what it cost in time and I/O -- so that the totals below can be
+// traced back to whoever caused them.  They outlive the thread, to be
+// printed at halt.
+
+class ThreadStats {
+  public:
+    ThreadStats(int threadID, char *threadName);
+    ~ThreadStats();
+
+    int id;			// the thread's ID
+    char *name;			// a copy of its name
+    Ticks userTicks;		// time it ran user code
+    Ticks systemTicks;		// time it ran kernel code
+    Ticks blockedTicks;		// time it waited on a semaphore (and so
+				// on a lock, condition or disk request)
+    int numDiskReads;		// sectors read from disk for it
+    int numDiskWrites;		// sectors written to disk for it
+    int bytesRead;		// bytes it read from files
+    int bytesWritten;		// bytes it wrote to files
+    int numCacheHits;		// sector reads/writes it found in the
+				// buffer cache
+    int numSyscalls[MaxSyscallCodes];
+				// system calls it made, by code
+    int numMemAccesses;		// user fetches, loads and stores, when
+				// the CPU caches are simulated
+    int numL1Misses;		// of them, those that missed L1
+    int numL2Misses;		// and L2
+    int tickets;		// its share of the CPU, if it asked for
+				// one with SetTickets; 0 if not
+    int stackBytes;		// the size of its stack; 0 for the main
+				// thread, which runs on the host's
+
+    void CountSyscall(int type);
+    void Print();		// print them on one line
+};
+
+// Most hosts on the network whose links are counted, by host id.
+const int MaxNetHosts = 16;
+
+// Most CPUs the machine can have (see Scheduler, and -smp).
+const int MaxCPUs = 8;
+
+// The following class defines the statistics of the link to or from
+// another host on the network.
+
+class LinkStats {
+  public:
+    int packets;		// packets sent to it, or that arrived
+    int bytes;			// from it, header and all
+    int drops;			// of them, those the network lost (to),
+				// or that found the queue full (from)
+    int peakQueue;		// most packets from it waiting at once
+};
 
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
@@ -21,24 +80,133 @@
 
 class Statistics {
   public:
-    int totalTicks;      	// Total time running Nachos
-    int idleTicks;       	// Time spent idle (no threads to run)
-    int systemTicks;	 	// Time spent executing system code
-    int userTicks;       	// Time spent executing user code
+    Ticks totalTicks;      	// Total time running Nachos
+    Ticks idleTicks;       	// Time spent idle (no threads to run)
+    Ticks systemTicks;	 	// Time spent executing system code
+    Ticks userTicks;       	// Time spent executing user code
 				// (this is also equal to # of
 				// user instructions executed)
+    int numTimerInterrupts;	// times the timer went off
+    int numContextSwitches;	// times another thread was switched to
+    int numUserStateLoads;	// of them, times the user registers
+				// had to be swapped (see Scheduler::
+				// LoadUserState)
+    int numCPUs;		// CPUs the machine has
+    Ticks cpuBusyTicks[MaxCPUs];	// time each of them ran a thread,
+				// if there are several
+    int numSteals;		// threads an idle CPU took from another
+    int numMigrations;		// times a thread ran on another CPU
+				// than it did last
+    long long numInstructions;	// user instructions the interpreter ran
+    long long startNs;		// host time Nachos started at
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    int numDiskBufferHits;	// sectors read from the disk's track buffers
+    int numDiskCachedWrites;	// sectors written to the disk's write cache
+    int numDiskDestaged;	// sectors written from it to the media
+    int numDiskFlushes;		// requests to flush it
+    int numDiskForcedWrites;	// sectors written past it (FUA)
+    int numDiskErases;		// blocks a flash disk erased
+    int numDiskMerges;		// requests merged into another's transfer
+    int numDiskSharedReads;	// reads served by one already in flight
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numSwapIns;		// pages read back from swap
+    int numSwapOuts;		// pages written out to swap
+    int numSwapPooled;		// of them, compressed into the pool
+    int numSwapPoolHits;	// swap ins served from the pool
+    int numSwapPoolWritebacks;	// pooled pages written to disk to
+				// make room
+    int numCopyOnWrites;	// shared pages copied on a write
+    int numZeroFills;		// page faults on pages that were
+				// never loaded, just cleared
+    int numSharedTextPages;	// page faults on code that found it
+				// in another program's frame
+    int numPageCacheHits;	// page faults on file pages that
+				// found them in the page cache
+    int numFaultAroundPages;	// pages read ahead of a page fault
+    int numFaultAroundUsed;	// and used before the next read ahead
+    int numSuspensions;		// programs suspended by load control
+    int numResumptions;		// and resumed
+    int numTlbHits;		// translations found in the TLB
+    int numTlbMisses;		// translations the kernel had to load
+    int numMemAccesses;		// user memory accesses seen by the CPU
+				// caches, if they are simulated
+    int numL1Misses;		// of them, those that missed L1
+    int numL2Misses;		// and those that missed L2 as well
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    LinkStats sentTo[MaxNetHosts];	// the links to each host
+    LinkStats recvdFrom[MaxNetHosts];	// and from it
+    int numCacheHits;		// sector reads/writes found in the buffer cache
+    int numCacheMisses;		// sector reads/writes that missed the cache
+    int numCacheGhostHits;	// sectors 2Q took back off its ghost list
+    int numReadAheads;		// sectors prefetched into the buffer cache
+    int numFlusherWrites;	// disk write requests made by the flusher
+    int numFlusherSectors;	// sectors in them
+    int numJournalCommits;	// records written to the file system journal
+    int numJournalSectors;	// sectors in them
+    int numCheckpoints;		// times the journal was written home
+    int numSectorsChecked;	// sectors read from disk whose checksum
+				// was checked (-crc)
+    int numChecksumErrors;	// of them, those that did not match
+    LogHistogram diskRequestTicks;	// how long each disk request took
+    LogHistogram diskSeekTicks;		// and, for those that went to the
+    LogHistogram diskRotationTicks;	// media of a rotating disk, how
+    LogHistogram diskTransferTicks;	// long it spent on each part
+    LogHistogram syscallTicks[MaxSyscallCodes];
+				// how long the system calls of each code
+				// took, from the trap to the return
 
     Statistics(); 		// initialize everything to zero
+    ~Statistics();		// de-allocate the per-thread statistics
 
+    LinkStats *LinkTo(int host);	// the link to "host", NULL if it
+    LinkStats *LinkFrom(int host);	// is not counted; or from it
+    ThreadStats *NewThread(int threadID, char *threadName);
+				// start counting for a new thread
     void Print();		// print collected statistics
+    void PrintThreads();	// print each thread's statistics
+    void PrintShares();		// print the CPU share each thread that
+				// asked for one got
+    void PrintSyscalls();	// print how long the system calls took
+    void WriteSyscalls(char *fileName);
+				// and write it to a file, as JSON
+    void AppendJson(char *fileName);
+				// append the main counters to a file,
+				// as a JSON object
+
+    volatile bool dumpRequested;	// the host asked for the statistics
+				// so far (see DumpStats in main.cc)
+    Ticks nextSnapshot;		// tick the next snapshot is due at
+    void StartSnapshots(char *fileName, int interval);
+				// append a line of the counters to the
+				// file every "interval" ticks
+    bool ReportDue() { return dumpRequested || totalTicks >= nextSnapshot; }
+    void Report();		// print or write what is due, checked
+				// by the interrupt handler each tick
+
+    void Save(int file);	// write the counters to a checkpoint
+    void Restore(int file);	// and read them back from one
+
+    void SwitchTo(ThreadStats *next);
+				// charge the thread running until now,
+				// and start timing "next"
+    void ChargeRunning();	// bring the running thread's user and
+				// system ticks up to date
+
+  private:
+    List<ThreadStats *> *threads;	// every thread's, in creation order
+    ThreadStats *running;	// the running thread's; NULL until
+				// there is one
+    Ticks chargedUser;		// userTicks and systemTicks when it
+    Ticks chargedSystem;	// was last charged
+    int snapshotFileNo;		// where the snapshots go, -1 if none
+    int snapshotInterval;	// ticks between them
+
+    void Snapshot();		// append a line of the counters now
 };
 
 // Constants used to reflect the relative time an operation would
@@ -53,6 +221,14 @@ const int UserTick = 	   1;	// advance for each user-level instruction
 const int SystemTick =	  10; 	// advance each time interrupts are enabled
 const int RotationTime = 500; 	// time disk takes to rotate one sector
 const int SeekTime =	 500;  	// time disk takes to seek past one track
+const int FlashCommandTime = 20; // time flash takes to start a request
+const int FlashReadTime = 25;	// to read one page (a sector)
+const int FlashProgramTime = 200; // to program (write) one erased page
+const int FlashEraseTime = 1500; // to erase one block of pages
+const int RamDiskTime =	   1;	// time a RAM disk takes for a transfer
+const int CacheL2Time =	   4;	// extra time an access missing the L1
+				// CPU cache takes, if L2 has the line
+const int MemoryTime =	  20;	// extra time one missing every cache takes
 const int ConsoleTime =	 100;	// time to read or write one character
 const int NetworkTime =	 100;  	// time to send or receive one packet
 const int TimerTicks = 	 100;  	// (average) time between timer interrupts
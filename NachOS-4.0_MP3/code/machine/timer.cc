@@ -40,9 +40,83 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
     randomize = doRandom;
     callPeriodically = toCall;
     disable = FALSE;
+    periodic = TRUE;
+    armed = FALSE;
+    generation = 0;
     SetInterrupt();
 }
 
+//----------------------------------------------------------------------
+// Timer::Timer
+//      Initialize a one-shot timer device, which generates no interrupt
+//	until it is armed.
+//
+//      "toCall" is the interrupt handler to call when the timer expires.
+//----------------------------------------------------------------------
+
+Timer::Timer(CallBackObj *toCall)
+{
+    randomize = FALSE;
+    callPeriodically = toCall;
+    disable = FALSE;
+    periodic = FALSE;
+    armed = FALSE;
+    generation = 0;
+}
+
+//----------------------------------------------------------------------
+// TimerShot
+//	The interrupt for one arming of a one-shot timer: it remembers
+//	which arming it was for, so that the timer can tell whether it has
+//	been re-armed or disarmed since.
+//----------------------------------------------------------------------
+
+class TimerShot : public CallBackObj {
+  public:
+    TimerShot(Timer *t, int shot) { timer = t; generation = shot; }
+
+  private:
+    Timer *timer;
+    int generation;
+
+    void CallBack() { timer->Expire(generation); delete this; }
+};
+
+//----------------------------------------------------------------------
+// Timer::Arm
+//      Make a one-shot timer go off "delay" ticks from now -- and not
+//	at the time it was armed for before, if it was.
+//----------------------------------------------------------------------
+
+void
+Timer::Arm(int delay)
+{
+    ASSERT(!periodic && delay > 0);
+    if (!disable) {
+	generation++;
+	armed = TRUE;
+	kernel->interrupt->Schedule(new TimerShot(this, generation), delay,
+				    TimerInt);
+    }
+}
+
+//----------------------------------------------------------------------
+// Timer::Expire
+//      An interrupt of a one-shot timer happened.  Unless the timer has
+//	been re-armed or disarmed since it was scheduled, it goes off.
+//	The handler may arm it again.
+//----------------------------------------------------------------------
+
+void
+Timer::Expire(int shot)
+{
+    if (shot != generation || disable)
+	return;
+    armed = FALSE;
+    kernel->stats->numTimerInterrupts++;
+    callPeriodically->CallBack();
+}
+
 //----------------------------------------------------------------------
 // Timer::CallBack
 //      Routine called when interrupt is generated by the hardware 
@@ -53,6 +127,7 @@ void
 Timer::CallBack() 
 {
     // invoke the Nachos interrupt handler for this device
+    kernel->stats->numTimerInterrupts++;
     callPeriodically->CallBack();
     
     SetInterrupt();	// do last, to let software interrupt handler
@@ -75,7 +150,14 @@ Timer::SetInterrupt()
        if (randomize) {
 	     delay = 1 + (RandomNumber() % (TimerTicks * 2));
         }
-       // schedule the next timer device interrupt
-       kernel->interrupt->Schedule(this, delay, TimerInt);
+       // schedule the next timer device interrupt; the alarm does
+       // nothing when the machine is idle, so it is only a poll --
+       // unless the delays are random, and putting it off would change
+       // the random numbers drawn
+       if (randomize) {
+	     kernel->interrupt->Schedule(this, delay, TimerInt);
+       } else {
+	     kernel->interrupt->SchedulePoll(this, delay, TimerInt);
+       }
     }
 }
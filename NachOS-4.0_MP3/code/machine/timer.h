@@ -11,6 +11,12 @@
 //	In order to introduce some randomness into time-slicing, if "doRandom"
 //	is set, then the interrupt comes after a random number of ticks.
 //
+//	A timer can also be made "one-shot": it only goes off when it has
+//	been armed, once, that many ticks later.  Re-arming it replaces
+//	the pending expiry, and disarming cancels it; the interrupts
+//	already scheduled for earlier armings simply find themselves out
+//	of date when they come, and are ignored.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
@@ -30,18 +36,35 @@ class Timer : public CallBackObj {
     Timer(bool doRandom, CallBackObj *toCall);
 				// Initialize the timer, and callback to "toCall"
 				// every time slice.
+    Timer(CallBackObj *toCall);	// Initialize a one-shot timer, which
+				// only calls "toCall" when armed
     virtual ~Timer() {}
     
     void Disable() { disable = TRUE; }
     				// Turn timer device off, so it doesn't
 				// generate any more interrupts.
 
+    void Arm(int delay);	// One-shot: go off "delay" ticks from
+				// now, instead of when last armed
+    void Disarm() { generation++; armed = FALSE; }
+				// One-shot: do not go off at all
+    bool IsArmed() { return armed; }
+
   private:
     bool randomize;		// set if we need to use a random timeout delay
     CallBackObj *callPeriodically; // call this every TimerTicks time units 
     bool disable;		// turn off the timer device after next
     				// interrupt.
-    
+    bool periodic;		// goes off every time slice, not only
+				// when armed
+    bool armed;			// one-shot: set if it is to go off
+    int generation;		// one-shot: bumped at each Arm and
+				// Disarm, to tell out of date
+				// interrupts from the current one
+
+    friend class TimerShot;
+    void Expire(int shot);	// one-shot: the interrupt for the "shot"th
+				// arming happened
     void CallBack();		// called internally when the hardware
 				// timer generates an interrupt
 
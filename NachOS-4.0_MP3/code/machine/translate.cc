@@ -32,42 +32,8 @@
 #include "copyright.h"
 #include "main.h"
 
-// Routines for converting Words and Short Words to and from the
-// simulated machine's format of little endian.  These end up
-// being NOPs when the host machine is also little endian (DEC and Intel).
-
-unsigned int
-WordToHost(unsigned int word) {
-#ifdef HOST_IS_BIG_ENDIAN
-	 register unsigned long result;
-	 result = (word >> 24) & 0x000000ff;
-	 result |= (word >> 8) & 0x0000ff00;
-	 result |= (word << 8) & 0x00ff0000;
-	 result |= (word << 24) & 0xff000000;
-	 return result;
-#else 
-	 return word;
-#endif /* HOST_IS_BIG_ENDIAN */
-}
-
-unsigned short
-ShortToHost(unsigned short shortword) {
-#ifdef HOST_IS_BIG_ENDIAN
-	 register unsigned short result;
-	 result = (shortword << 8) & 0xff00;
-	 result |= (shortword >> 8) & 0x00ff;
-	 return result;
-#else 
-	 return shortword;
-#endif /* HOST_IS_BIG_ENDIAN */
-}
-
-unsigned int
-WordToMachine(unsigned int word) { return WordToHost(word); }
-
-unsigned short
-ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
-
+// The routines for converting Words and Short Words to and from the
+// simulated machine's format are inline, in machine.h.
 
 //----------------------------------------------------------------------
 // Machine::ReadMem
@@ -89,13 +55,17 @@ Machine::ReadMem(int addr, int size, int *value)
     ExceptionType exception;
     int physicalAddress;
     
-    DEBUG(dbgAddr, "Reading VA " << addr << ", size " << size);
-    
-    exception = Translate(addr, &physicalAddress, size, FALSE);
-    if (exception != NoException) {
-	RaiseException(exception, addr);
-	return FALSE;
+    if (!FastTranslate(addr, &physicalAddress, size, FALSE)) {
+	DEBUG(dbgAddr, "Reading VA " << addr << ", size " << size);
+
+	exception = Translate(addr, &physicalAddress, size, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return FALSE;
+	}
+	Remember(addr, physicalAddress, FALSE);
     }
+    CacheAccess(physicalAddress);
     switch (size) {
       case 1:
 	data = mainMemory[physicalAddress];
@@ -138,13 +108,17 @@ Machine::WriteMem(int addr, int size, int value)
     ExceptionType exception;
     int physicalAddress;
      
-    DEBUG(dbgAddr, "Writing VA " << addr << ", size " << size << ", value " << value);
+    if (!FastTranslate(addr, &physicalAddress, size, TRUE)) {
+	DEBUG(dbgAddr, "Writing VA " << addr << ", size " << size << ", value " << value);
 
-    exception = Translate(addr, &physicalAddress, size, TRUE);
-    if (exception != NoException) {
-	RaiseException(exception, addr);
-	return FALSE;
+	exception = Translate(addr, &physicalAddress, size, TRUE);
+	if (exception != NoException) {
+	    RaiseException(exception, addr);
+	    return FALSE;
+	}
+	Remember(addr, physicalAddress, TRUE);
     }
+    CacheAccess(physicalAddress);
     switch (size) {
       case 1:
 	mainMemory[physicalAddress] = (unsigned char) (value & 0xff);
@@ -214,25 +188,31 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
 	    return PageFaultException;
 	}
 	entry = &pageTable[vpn];
+	pageFrame = entry->physicalPage;
     } else {
         for (entry = NULL, i = 0; i < TLBSize; i++)
-    	    if (tlb[i].valid && (tlb[i].virtualPage == ((int)vpn))) {
+	    // an entry maps "numPages" pages, from "virtualPage" on
+    	    if (tlb[i].valid && tlb[i].asid == asid
+		&& (unsigned) ((int)vpn - tlb[i].virtualPage)
+					< (unsigned) tlb[i].numPages) {
 		entry = &tlb[i];			// FOUND!
 		break;
 	    }
 	if (entry == NULL) {				// not found
+	    kernel->stats->numTlbMisses++;
     	    DEBUG(dbgAddr, "Invalid TLB entry for this virtual page!");
     	    return PageFaultException;		// really, this is a TLB fault,
 						// the page may be in memory,
 						// but not in the TLB
 	}
+	kernel->stats->numTlbHits++;
+	pageFrame = entry->physicalPage + ((int)vpn - entry->virtualPage);
     }
 
     if (entry->readOnly && writing) {	// trying to write to a read-only page
 	DEBUG(dbgAddr, "Write to read-only page at " << virtAddr);
 	return ReadOnlyException;
     }
-    pageFrame = entry->physicalPage;
 
     // if the pageFrame is too big, there is something really wrong! 
     // An invalid translation was loaded into the page table or TLB. 
@@ -243,8 +223,83 @@ Machine::Translate(int virtAddr, int* physAddr, int size, bool writing)
     entry->use = TRUE;		// set the use, dirty bits
     if (writing)
 	entry->dirty = TRUE;
+    translated = entry;
     *physAddr = pageFrame * PageSize + offset;
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
     DEBUG(dbgAddr, "phys addr = " << *physAddr);
     return NoException;
 }
+
+//----------------------------------------------------------------------
+// Machine::FastTranslate
+// 	Translate a virtual address the way the last access to its page
+//	was translated, if the machine still remembers how.  Only the
+//	alignment is checked, and the use and dirty bits set; everything
+//	else was checked when the translation was made, and stays true
+//	until the kernel calls FlushTranslations.
+//
+//	Return FALSE if nothing is remembered for the page, in which case
+//	the caller must go through Translate.
+//
+//	"virtAddr" -- the virtual address to translate
+//	"physAddr" -- the place to store the physical address
+//	"size" -- the amount of memory being read or written
+// 	"writing" -- if TRUE, look among the translations made for writes
+//----------------------------------------------------------------------
+
+bool
+Machine::FastTranslate(int virtAddr, int* physAddr, int size, bool writing)
+{
+    int vpn = (unsigned) virtAddr / PageSize;
+    FastTranslation *fast = writing ? &writeCache[vpn % NumFastTranslations]
+				    : &readCache[vpn % NumFastTranslations];
+
+    if (fast->virtualPage != vpn || (virtAddr & (size - 1)) != 0)
+	return FALSE;			// not remembered, or misaligned
+    if (tlb != NULL)
+	kernel->stats->numTlbHits++;
+    fast->entry->use = TRUE;		// set the use, dirty bits
+    if (writing)
+	fast->entry->dirty = TRUE;
+    *physAddr = fast->physicalBase + (unsigned) virtAddr % PageSize;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::Remember
+// 	Keep the translation of "virtAddr" to "physAddr" that Translate
+//	has just made, for FastTranslate.  Nothing is kept while address
+//	debugging is on, so that every access is still traced.
+//----------------------------------------------------------------------
+
+void
+Machine::Remember(int virtAddr, int physAddr, bool writing)
+{
+    int vpn = (unsigned) virtAddr / PageSize;
+    FastTranslation *fast = writing ? &writeCache[vpn % NumFastTranslations]
+				    : &readCache[vpn % NumFastTranslations];
+
+    if (debug->IsEnabled(dbgAddr))
+	return;
+    fast->virtualPage = vpn;
+    fast->entry = translated;
+    fast->physicalBase = physAddr - (unsigned) virtAddr % PageSize;
+}
+
+//----------------------------------------------------------------------
+// Machine::FlushTranslations
+// 	Forget every translation remembered for FastTranslate.  Called
+//	by the kernel whenever a translation the machine may have
+//	remembered could have changed: on a context switch, and when a
+//	page table or TLB entry is made invalid, read-only, or pointed at
+//	another frame.  Setting the use and dirty bits needs no flush.
+//----------------------------------------------------------------------
+
+void
+Machine::FlushTranslations()
+{
+    for (int i = 0; i < NumFastTranslations; i++) {
+	readCache[i].virtualPage = -1;
+	writeCache[i].virtualPage = -1;
+    }
+}
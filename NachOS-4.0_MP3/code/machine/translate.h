@@ -40,6 +40,14 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// TLB only: the address space the entry belongs
+			// to; it only matches while the machine's ASID
+			// register holds the same id.
+    int numPages;	// TLB only: how many pages the entry maps, the
+			// virtual pages from "virtualPage" on to the
+			// physical ones from "physicalPage" on.  1 for
+			// an ordinary page; more for a superpage, a
+			// power of 2 both page numbers are aligned to.
 };
 
 #endif
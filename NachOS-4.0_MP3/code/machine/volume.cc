@@ -0,0 +1,355 @@
+// volume.cc
+//	Routines to simulate a striped volume, by dealing the sectors of
+//	each request out among several simulated disks.  See volume.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "volume.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// VolumeMember::CallBack
+// 	Called by a disk of the volume when it has done its part of a
+//	request.
+//----------------------------------------------------------------------
+
+void
+VolumeMember::CallBack()
+{
+    volume->MemberDone(which);
+}
+
+//----------------------------------------------------------------------
+// Volume::Volume
+// 	Initialize a striped volume, and each of its disks.  An overlay
+//	(-dbase) can only be on a volume of one disk, as the base image
+//	has the sectors of one.
+//
+//	"toCall" -- object to call when a request completes
+//	"numDisks" -- how many disks the sectors are striped across
+//	"mapImage", "trackBuffers", "writeCacheSectors", "device",
+//		"imageName" -- how to make each disk (see Disk::Disk)
+//
+//	Only the kernel's own disk has an access map (-dmap).
+//----------------------------------------------------------------------
+
+Volume::Volume(CallBackObj *toCall, int numDisks, bool mapImage,
+	       int trackBuffers, int writeCacheSectors, DiskDevice device,
+	       char *imageName)
+{
+    ASSERT(numDisks >= 1 && numDisks <= MaxVolumeDisks);
+    ASSERT(numDisks == 1 || kernel->diskBase == NULL);
+    callWhenDone = toCall;
+    this->numDisks = numDisks;
+    for (int i = 0; i < numDisks; i++) {
+	members[i] = new VolumeMember(this, i);
+	disks[i] = new Disk(members[i], mapImage, trackBuffers,
+			    writeCacheSectors, device, i, imageName);
+    }
+    numBusy = 0;
+    flushFirst = forceUnit = FALSE;
+    sectorReads = sectorWrites = NULL;
+    if (kernel->diskMapFile != NULL && imageName == NULL) {
+	sectorReads = new int[NumSectors];
+	sectorWrites = new int[NumSectors];
+	for (int i = 0; i < NumSectors; i++)
+	    sectorReads[i] = sectorWrites[i] = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// Volume::~Volume
+// 	De-allocate the volume and its disks, writing out the access map
+//	first if there is one.
+//----------------------------------------------------------------------
+
+Volume::~Volume()
+{
+    ASSERT(numBusy == 0);
+    if (sectorReads != NULL) {
+	WriteAccessMap(kernel->diskMapFile);
+	delete [] sectorReads;
+	delete [] sectorWrites;
+    }
+    for (int i = 0; i < numDisks; i++) {
+	delete disks[i];
+	delete members[i];
+    }
+}
+
+//----------------------------------------------------------------------
+// Volume::ReadRequest/WriteRequest
+// 	Start a read/write of a run of consecutive sectors of the volume:
+//	each disk it touches gets its part at once.  One interrupt comes
+//	when all of the sectors have been transferred.
+//
+//	"first" -- the first sector of the volume to read/write
+//	"num" -- how many sectors, starting at "first"
+//	"buffer" -- the bytes to be written, the buffer to hold the
+//		incoming bytes; "num" * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+Volume::ReadRequest(int first, int num, char *buffer)
+{
+    ASSERT(numBusy == 0);
+    reading = TRUE;
+    flushFirst = forceUnit = FALSE;
+    firstSector = first;
+    numSectors = num;
+    data = buffer;
+    CountAccess(first, num, FALSE);
+    Split();
+    Start();
+}
+
+void
+Volume::WriteRequest(int first, int num, char *buffer)
+{
+    WriteRequest(first, num, buffer, FALSE, FALSE);
+}
+
+//----------------------------------------------------------------------
+// Volume::WriteRequest
+// 	Start a write as above, that may also flush the write caches
+//	before it, and/or write past them (see Disk::WriteRequest).
+//----------------------------------------------------------------------
+
+void
+Volume::WriteRequest(int first, int num, char *buffer, bool flush,
+		     bool force)
+{
+    ASSERT(numBusy == 0);
+    reading = FALSE;
+    flushFirst = flush;
+    forceUnit = force;
+    firstSector = first;
+    numSectors = num;
+    data = buffer;
+    CountAccess(first, num, TRUE);
+    Split();
+    Copy(TRUE);
+    Start();
+}
+
+//----------------------------------------------------------------------
+// Volume::FlushRequest
+// 	Start a flush of every disk's write cache; the interrupt comes
+//	once they are all on the media.
+//----------------------------------------------------------------------
+
+void
+Volume::FlushRequest()
+{
+    ASSERT(numBusy == 0);
+    numSectors = 0;
+    numBusy = numDisks;
+    for (int i = 0; i < numDisks; i++)
+	disks[i]->FlushRequest();
+}
+
+//----------------------------------------------------------------------
+// Volume::Sync
+// 	Make sure what every disk has written is in its UNIX file (see
+//	Disk::Sync).
+//----------------------------------------------------------------------
+
+void
+Volume::Sync()
+{
+    for (int i = 0; i < numDisks; i++)
+	disks[i]->Sync();
+}
+
+//----------------------------------------------------------------------
+// Volume::SaveImage
+// 	Write the image of the one disk there is to "file" (see
+//	Disk::SaveImage).  A striped volume has no single image.
+//----------------------------------------------------------------------
+
+void
+Volume::SaveImage(int file)
+{
+    ASSERT(numDisks == 1);
+    disks[0]->SaveImage(file);
+}
+
+//----------------------------------------------------------------------
+// Volume::Discard
+// 	Make every sector of the volume read as zeroes (see Disk::Discard);
+//	the volume must be idle.
+//----------------------------------------------------------------------
+
+void
+Volume::Discard()
+{
+    ASSERT(numBusy == 0);
+    for (int i = 0; i < numDisks; i++)
+	disks[i]->Discard();
+}
+
+//----------------------------------------------------------------------
+// Volume::Split
+// 	Work out which sectors of each disk the request covers.  Stripe
+//	unit "u" is unit u / numDisks of disk u % numDisks, and the units
+//	of a run that fall on one disk are consecutive there, so each disk
+//	gets a single run.  If only one disk is touched, its run is the
+//	request's, in the same order, and it uses the request's buffer;
+//	otherwise each disk gets a buffer of its own.
+//----------------------------------------------------------------------
+
+void
+Volume::Split()
+{
+    int touched = 0;
+    int s, n;
+
+    for (int i = 0; i < numDisks; i++)
+	memberNum[i] = 0;
+    for (s = firstSector; s < firstSector + numSectors; s += n) {
+	int unit = s / StripeSectors;
+	int which = unit % numDisks;
+
+	n = min(StripeSectors - s % StripeSectors, firstSector + numSectors - s);
+	if (memberNum[which] == 0) {
+	    memberFirst[which] = (unit / numDisks) * StripeSectors
+					+ s % StripeSectors;
+	    touched++;
+	}
+	memberNum[which] += n;
+    }
+    for (int i = 0; i < numDisks; i++) {
+	memberData[i] = NULL;
+	if (memberNum[i] > 0)
+	    memberData[i] = (touched == 1) ? data
+				: new char[memberNum[i] * SectorSize];
+    }
+}
+
+//----------------------------------------------------------------------
+// Volume::Copy
+// 	Move each stripe unit of the request between the request's
+//	buffer and the buffer of its disk: to the disks' buffers (for a
+//	write) if "toMembers", else from them (for a read).
+//----------------------------------------------------------------------
+
+void
+Volume::Copy(bool toMembers)
+{
+    int s, n;
+
+    for (s = firstSector; s < firstSector + numSectors; s += n) {
+	int unit = s / StripeSectors;
+	int which = unit % numDisks;
+	int sector = (unit / numDisks) * StripeSectors + s % StripeSectors;
+	char *mine = &data[(s - firstSector) * SectorSize];
+	char *theirs = &memberData[which][(sector - memberFirst[which]) * SectorSize];
+
+	n = min(StripeSectors - s % StripeSectors, firstSector + numSectors - s);
+	if (mine == theirs)
+	    continue;
+	if (toMembers)
+	    bcopy(mine, theirs, n * SectorSize);
+	else
+	    bcopy(theirs, mine, n * SectorSize);
+    }
+}
+
+//----------------------------------------------------------------------
+// Volume::Start
+// 	Send each disk touched by the request its part of it.  If the
+//	write caches are to be flushed first, the disks it does not
+//	touch are sent a flush.
+//----------------------------------------------------------------------
+
+void
+Volume::Start()
+{
+    numBusy = 0;
+    for (int i = 0; i < numDisks; i++) {
+	if (memberNum[i] > 0 || flushFirst)
+	    numBusy++;
+    }
+    DEBUG(dbgDisk, "Volume request of " << numSectors << " sectors at "
+		<< firstSector << " goes to " << numBusy << " disks");
+    for (int i = 0; i < numDisks; i++) {
+	if (memberNum[i] == 0) {
+	    if (flushFirst)
+		disks[i]->FlushRequest();
+	    continue;
+	}
+	if (reading)
+	    disks[i]->ReadRequest(memberFirst[i], memberNum[i], memberData[i]);
+	else
+	    disks[i]->WriteRequest(memberFirst[i], memberNum[i], memberData[i],
+				   flushFirst, forceUnit);
+    }
+}
+
+//----------------------------------------------------------------------
+// Volume::MemberDone
+// 	Disk "which" has done its part of the request.  If it was the
+//	last, give the bytes read to the request, free the disks'
+//	buffers, and tell our caller -- which may start the next request
+//	at once.
+//----------------------------------------------------------------------
+
+void
+Volume::MemberDone(int which)
+{
+    ASSERT(numBusy > 0);
+    if (--numBusy > 0)
+	return;
+    if (numSectors > 0) {
+	if (reading)
+	    Copy(FALSE);
+	for (int i = 0; i < numDisks; i++) {
+	    if (memberData[i] != NULL && memberData[i] != data)
+		delete [] memberData[i];
+	}
+    }
+    callWhenDone->CallBack();
+}
+
+//----------------------------------------------------------------------
+// Volume::CountAccess
+// 	Count a request to read or write ("writing") the "num" sectors
+//	from "first" in the access map, if it is kept.
+//----------------------------------------------------------------------
+
+void
+Volume::CountAccess(int first, int num, bool writing)
+{
+    int *counts = writing ? sectorWrites : sectorReads;
+
+    if (counts == NULL)
+	return;
+    for (int i = first; i < first + num; i++)
+	counts[i]++;
+}
+
+//----------------------------------------------------------------------
+// Volume::WriteAccessMap
+// 	Write the access map to "fileName": a line of the sector, its
+//	reads and its writes for each sector that was ever used, in
+//	order.
+//----------------------------------------------------------------------
+
+void
+Volume::WriteAccessMap(char *fileName)
+{
+    int fd = OpenForWrite(fileName);
+    char line[50];
+
+    for (int i = 0; i < NumSectors; i++) {
+	if (sectorReads[i] == 0 && sectorWrites[i] == 0)
+	    continue;
+	sprintf(line, "%d %d %d\n", i, sectorReads[i], sectorWrites[i]);
+	WriteFile(fd, line, strlen(line));
+    }
+    Close(fd);
+}
@@ -0,0 +1,124 @@
+// volume.h
+//	Data structures to emulate a striped volume (RAID-0): one device
+//	made of several simulated disks, with the sectors dealt out among
+//	them.
+//
+//	The volume has NumSectors sectors, like a single disk, so that
+//	the file system sees no difference.  They are split into stripe
+//	units of StripeSectors, and unit "u" goes on disk u % numDisks,
+//	after the units that went on it before.  So a run of sectors
+//	becomes one run on each disk it touches, and those are sent to
+//	the disks all at once: each has its own head, its own track
+//	buffers and write cache, and its own UNIX file, and they work
+//	side by side.  The volume's interrupt comes when the last of them
+//	is done.  As for a disk, only one request is allowed at a time.
+//	A write that asks for the write caches to be flushed first (a
+//	barrier) has every disk flush, those without a part of it too,
+//	since what came before it may be on any of them.
+//
+//	Disk 0 has the usual UNIX file, and disk "i" the same name with
+//	".i" after it.  A disk holds only NumSectors / numDisks sectors
+//	of the volume, at its start, and so the disks of a volume have to
+//	be made (formatted) together, and used with the same number of
+//	disks.  A volume of one disk is that disk, as it always was.
+//
+//	With -dmap <file>, the volume counts the reads and writes that
+//	reach each of its sectors, and writes the counts to the file when
+//	it is shut down, as "sector reads writes" lines for the sectors
+//	that were used.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef VOLUME_H
+#define VOLUME_H
+
+#include "copyright.h"
+#include "disk.h"
+
+const int MaxVolumeDisks = 8;		// the most disks a volume has
+const int StripeSectors = 8;		// sectors in a stripe unit
+
+class Volume;
+
+// The following class tells the volume which of its disks an interrupt
+// is from.
+
+class VolumeMember : public CallBackObj {
+  public:
+    VolumeMember(Volume *v, int w) { volume = v; which = w; }
+    void CallBack();			// disk "which" is done
+
+  private:
+    Volume *volume;
+    int which;
+};
+
+// The following class defines a striped volume.
+
+class Volume {
+  public:
+    Volume(CallBackObj *toCall, int numDisks, bool mapImage,
+	   int trackBuffers, int writeCacheSectors, DiskDevice device,
+	   char *imageName);
+					// Create a volume of "numDisks"
+					// disks, each made as the other
+					// arguments say (see disk.h).
+					// Invoke toCall->CallBack() when
+					// each request completes.
+    ~Volume();				// Deallocate the volume and its
+					// disks
+
+    void ReadRequest(int firstSector, int numSectors, char *data);
+    void WriteRequest(int firstSector, int numSectors, char *data);
+					// Read/write "numSectors" consecutive
+					// sectors of the volume; return
+					// right away
+    void WriteRequest(int firstSector, int numSectors, char *data,
+		      bool flushFirst, bool forceUnit);
+					// Same, flushing the write caches
+					// first and/or writing past them
+    void FlushRequest();		// Flush every disk's write cache
+    void Sync();			// Sync every disk's UNIX file
+    void SaveImage(int file);		// Write the disk's sectors to
+					// "file"; there must be only one
+    bool CachesWrites() { return disks[0]->CachesWrites(); }
+    void Discard();			// Discard every disk's sectors
+
+    void MemberDone(int which);		// Disk "which" finished its part
+
+  private:
+    CallBackObj *callWhenDone;		// Invoke when a request finishes
+    int numDisks;			// how many disks there are
+    Disk *disks[MaxVolumeDisks];
+    VolumeMember *members[MaxVolumeDisks];
+					// what each disk interrupts
+    int numBusy;			// disks still working on the request
+
+    bool reading;			// the request in progress
+    int firstSector;
+    int numSectors;
+    char *data;
+    bool flushFirst;			// flush every write cache first?
+    bool forceUnit;			// and write past them?
+    int memberFirst[MaxVolumeDisks];	// the run of each disk's sectors
+    int memberNum[MaxVolumeDisks];	// it covers; 0 if none
+    char *memberData[MaxVolumeDisks];	// the bytes of that run
+
+    int *sectorReads;			// requests that read each sector,
+    int *sectorWrites;			// and wrote it; NULL unless -dmap
+
+    void CountAccess(int first, int num, bool writing);
+					// note a request in the access map
+    void WriteAccessMap(char *fileName);
+					// and write the map out
+
+    void Split();			// find each disk's part of the
+					// request
+    void Copy(bool toMembers);		// move the bytes between "data" and
+					// "memberData"
+    void Start();			// send each disk its part
+};
+
+#endif // VOLUME_H
@@ -7,7 +7,8 @@
 //
 //	Note that once we prepend the MailHdr to the outgoing message data,
 //	the combination (MailHdr plus data) looks like "data" to the Network 
-//	device.
+//	device.  A packet may carry several such combinations (see
+//	PostOfficeOutput::SendBatch).
 //
 // 	The implementation synchronizes incoming messages with threads
 //	waiting for those messages.
@@ -21,21 +22,46 @@
 
 //----------------------------------------------------------------------
 // Mail::Mail
-//      Initialize a single mail message, by concatenating the headers to
-//	the data.
+//      Initialize a single mail message, from its headers and where
+//	its data is in the packet it came in.  The packet is not
+//	given back while the message is around.
 //
 //	"pktH" -- source, destination machine ID's
 //	"mailH" -- source, destination mailbox ID's
-//	"data" -- payload data
+//	"buffer" -- the packet
+//	"msgData" -- payload data, in "buffer"
 //----------------------------------------------------------------------
 
-Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
+Mail::Mail(PacketHeader pktH, MailHeader mailH, PacketBuffer *buffer,
+	   char *msgData)
 {
     ASSERT(mailH.length <= MaxMailSize);
 
     pktHdr = pktH;
     mailHdr = mailH;
-    bcopy(msgData, data, mailHdr.length);
+    data = msgData;
+    packet = buffer;
+    packet->refs++;
+}
+
+thread_local Slab Mail::slab("mails", sizeof(Mail));
+
+//----------------------------------------------------------------------
+// Mail::operator new, Mail::operator delete
+// 	Allocate the space for a Mail from its slab, and release it back
+//	there.
+//----------------------------------------------------------------------
+
+void *
+Mail::operator new(size_t size)
+{
+    return slab.Alloc(size);
+}
+
+void
+Mail::operator delete(void *p, size_t size)
+{
+    slab.Free(p, size);
 }
 
 //----------------------------------------------------------------------
@@ -49,7 +75,7 @@ Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
 
 MailBox::MailBox()
 { 
-    messages = new SynchList<Mail *>(); 
+    messages = new List<Mail *>(); 
 }
 
 //----------------------------------------------------------------------
@@ -57,11 +83,14 @@ MailBox::MailBox()
 //      De-allocate a single mail box within the post office.
 //
 //	Just delete the mailbox, and throw away all the queued messages 
-//	in the mailbox.
+//	in the mailbox.  Their packets are not given back: Nachos is
+//	halting.
 //----------------------------------------------------------------------
 
 MailBox::~MailBox()
 { 
+    while (!messages->IsEmpty())
+	delete messages->RemoveFront();
     delete messages; 
 }
 
@@ -83,57 +112,38 @@ PrintHeader(PacketHeader pktHdr, MailHeader mailHdr)
 
 //----------------------------------------------------------------------
 // MailBox::Put
-// 	Add a message to the mailbox.  If anyone is waiting for message
-//	arrival, wake them up!
-//
-//	We need to reconstruct the Mail message (by concatenating the headers
-//	to the data), to simplify queueing the message on the SynchList.
+// 	Add a message to the mailbox.  The post office wakes up anyone
+//	waiting for it.
 //
-//	"pktHdr" -- source, destination machine ID's
-//	"mailHdr" -- source, destination mailbox ID's
-//	"data" -- payload message data
+//	"mail" -- the message, pointing into the packet it came in
 //----------------------------------------------------------------------
 
 void 
-MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data)
+MailBox::Put(Mail *mail)
 { 
-    Mail *mail = new Mail(pktHdr, mailHdr, data); 
-
     messages->Append(mail);		// put on the end of the list of 
-					// arrived messages, and wake up 
-					// any waiters
+					// arrived messages
 }
 
 //----------------------------------------------------------------------
 // MailBox::Get
-// 	Get a message from a mailbox, parsing it into the packet header,
-//	mailbox header, and data. 
-//
-//	The calling thread waits if there are no messages in the mailbox.
+// 	Get a message from a mailbox; the caller owns it now, and gives
+//	it back to the post office once done with it.
 //
-//	"pktHdr" -- address to put: source, destination machine ID's
-//	"mailHdr" -- address to put: source, destination mailbox ID's
-//	"data" -- address to put: payload message data
+//	There must be a message in the mailbox: the post office waits
+//	for one before calling this.
 //----------------------------------------------------------------------
 
-void 
-MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data) 
+Mail *
+MailBox::Get() 
 { 
-    DEBUG(dbgNet, "Waiting for mail in mailbox");
-    Mail *mail = messages->RemoveFront();	// remove message from list;
-						// will wait if list is empty
+    Mail *mail = messages->RemoveFront();	// remove message from list
 
-    *pktHdr = mail->pktHdr;
-    *mailHdr = mail->mailHdr;
     if (debug->IsEnabled('n')) {
 	cout << "Got mail from mailbox: ";
-	PrintHeader(*pktHdr, *mailHdr);
+	PrintHeader(mail->pktHdr, mail->mailHdr);
     }
-    bcopy(mail->data, data, mail->mailHdr.length);
-					// copy the message data into
-					// the caller's buffer
-    delete mail;			// we've copied out the stuff we
-					// need, we can now discard the message
+    return mail;
 }
 
 //----------------------------------------------------------------------
@@ -145,21 +155,33 @@ MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data)
 //      We use a separate thread "the postal worker" to wait for messages 
 //	to arrive, and deliver them to the correct mailbox.  Note that
 //	delivering messages to the mailboxes can't be done directly
-//	by the interrupt handlers, because it requires a Lock.
+//	by the interrupt handlers, because it requires a Lock.  The
+//	handler gets its first spare buffers here.
 //
 //	"nBoxes" is the number of mail boxes in this Post Office
 //----------------------------------------------------------------------
 
 PostOfficeInput::PostOfficeInput(int nBoxes)
 {
+    bool wasEmpty;
+
     messageAvailable = new Semaphore("message available", 0);
+    lock = new Lock("post office");
+    mailArrived = new Condition("mail arrived");
 
     numBoxes = nBoxes;
     boxes = new MailBox[nBoxes];
+    freePackets = NULL;
+    numFreePackets = 0;
+    arrived = new RingQueue<PacketBuffer *>(PacketRingSize);
+    spares = new RingQueue<PacketBuffer *>(PacketRingSize);
+    while (!spares->IsFull())
+	(void) spares->Put(new PacketBuffer, &wasEmpty);
+    stalled = FALSE;
 
     network = new NetworkInput(this);
 
-    Thread *t = new Thread("postal worker", 1);
+    Thread *t = new Thread("postal worker", 1, SmallStackSize);
 
     t->Fork(PostOfficeInput::PostalDelivery, this);
 }
@@ -175,44 +197,106 @@ PostOfficeInput::PostOfficeInput(int nBoxes)
 
 PostOfficeInput::~PostOfficeInput()
 {
+    PacketBuffer *spare;
+
     delete network;
     delete [] boxes;
+    while (arrived->Get(&spare))
+	delete spare;
+    while (spares->Get(&spare))
+	delete spare;
+    delete arrived;
+    delete spares;
+    while (freePackets != NULL) {
+	PacketBuffer *packet = freePackets;
+
+	freePackets = packet->next;
+	delete packet;
+    }
+    delete mailArrived;
+    delete lock;
 }
 
 //----------------------------------------------------------------------
 // PostOffice::PostalDelivery
 // 	Wait for incoming messages, and put them in the right mailbox.
 //
-//      Incoming messages have had the PacketHeader stripped off,
-//	but the MailHeader is still tacked on the front of the data.
+//	Each time it is woken, the worker delivers every packet the
+//	interrupt handler has put in the ring, and gives the handler as
+//	many spare buffers as it has room for.  If the handler had run
+//	out, the packet it left on the network is taken now, as the
+//	handler would have.
 //----------------------------------------------------------------------
 
 void
 PostOfficeInput::PostalDelivery(void* data)
 {
     PostOfficeInput* _this = (PostOfficeInput*)data;
-    PacketHeader pktHdr;
-    MailHeader mailHdr;
-    char *buffer = new char[MaxPacketSize];
+    PacketBuffer *packet;
+    IntStatus oldLevel;
+    bool wasEmpty;
 
     for (;;) {
         // first, wait for a message
         _this->messageAvailable->P();	
-        pktHdr = _this->network->Receive(buffer);
+	_this->lock->Acquire();
+	while (_this->arrived->Get(&packet))
+	    _this->Deliver(packet);
+	while (!_this->spares->IsFull())
+	    (void) _this->spares->Put(_this->TakePacket(), &wasEmpty);
+	_this->mailArrived->Broadcast(_this->lock);
+	_this->lock->Release();
+
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	if (_this->stalled) {
+	    _this->stalled = FALSE;
+	    _this->CallBack();
+	}
+	(void) kernel->interrupt->SetLevel(oldLevel);
+    }
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Deliver
+// 	Put the messages of a packet that has arrived in their mailboxes.
+//	Called with the lock held.
+//
+//      Incoming messages have had the PacketHeader stripped off,
+//	but the MailHeader is still tacked on the front of the data.
+//	A packet may hold several messages, each with its own MailHeader;
+//	they are put in their mailboxes in the order they were sent.  The
+//	packet was read into a buffer of its own, which the messages point
+//	into, and which goes back to the pool once they are all read.
+//----------------------------------------------------------------------
 
-        mailHdr = *(MailHeader *)buffer;
-        if (debug->IsEnabled('n')) {
+void
+PostOfficeInput::Deliver(PacketBuffer *packet)
+{
+    PacketHeader pktHdr = packet->pktHdr;
+    MailHeader mailHdr;
+    char *buffer = packet->data;
+    unsigned offset;
+
+    for (offset = 0; offset < pktHdr.length;
+		    offset += sizeof(MailHeader) + mailHdr.length) {
+	ASSERT(offset + sizeof(MailHeader) <= pktHdr.length);
+	bcopy(buffer + offset, (char *)&mailHdr, sizeof(MailHeader));
+	if (debug->IsEnabled('n')) {
 	    cout << "Putting mail into mailbox: ";
 	    PrintHeader(pktHdr, mailHdr);
-        }
+	}
 
 	// check that arriving message is legal!
-	ASSERT(0 <= mailHdr.to && mailHdr.to < _this->numBoxes);
+	ASSERT(0 <= mailHdr.to && mailHdr.to < numBoxes);
 	ASSERT(mailHdr.length <= MaxMailSize);
+	ASSERT(offset + sizeof(MailHeader) + mailHdr.length <= pktHdr.length);
 
 	// put into mailbox
-        _this->boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader));
+	boxes[mailHdr.to].Put(new Mail(pktHdr, mailHdr, packet,
+			      buffer + offset + sizeof(MailHeader)));
     }
+    if (packet->refs == 0)
+	GivePacket(packet);	// nothing in it
 }
 
 //----------------------------------------------------------------------
@@ -234,23 +318,195 @@ void
 PostOfficeInput::Receive(int box, PacketHeader *pktHdr, 
 				MailHeader *mailHdr, char* data)
 {
-    ASSERT((box >= 0) && (box < numBoxes));
+    (void) Receive(box, pktHdr, mailHdr, data, NoTimeout);
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Receive
+// 	The same, but give up if no message has come into the box in
+//	"timeout" ticks (or never, if it is NoTimeout).  Return FALSE
+//	if none did.
+//----------------------------------------------------------------------
+
+bool
+PostOfficeInput::Receive(int box, PacketHeader *pktHdr, 
+				MailHeader *mailHdr, char* data, int timeout)
+{
+    Mail *mail = ReceiveMail(box, timeout);
 
-    boxes[box].Get(pktHdr, mailHdr, data);
+    if (mail == NULL)
+	return FALSE;
+    *pktHdr = mail->pktHdr;
+    *mailHdr = mail->mailHdr;
     ASSERT(mailHdr->length <= MaxMailSize);
+    bcopy(mail->data, data, mailHdr->length);
+					// copy the message data into
+					// the caller's buffer
+    Release(mail);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::ReceiveMail
+// 	The same, but without copying the message: return it as it is
+//	in its mailbox, with its data still in the packet it came in;
+//	NULL if none came in in time.  The caller must give it back
+//	with Release.
+//----------------------------------------------------------------------
+
+Mail *
+PostOfficeInput::ReceiveMail(int box, int timeout)
+{
+    Mail *mail = NULL;
+
+    lock->Acquire();
+    if (WaitForMail(1, &box, timeout) == box)
+	mail = boxes[box].Get();
+    lock->Release();
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Release
+// 	Give back a message ReceiveMail returned; its data is not to be
+//	looked at again.  The packet it came in is given back with the
+//	last message in it.
+//----------------------------------------------------------------------
+
+void
+PostOfficeInput::Release(Mail *mail)
+{
+    lock->Acquire();
+    ASSERT(mail->packet->refs > 0);
+    if (--mail->packet->refs == 0)
+	GivePacket(mail->packet);
+    delete mail;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::TakePacket, PostOfficeInput::GivePacket
+// 	Get a buffer for a packet about to be read in: a pooled one if
+//	there is one, a new one if not.  And give one back, once no
+//	message in it is wanted: to the pool, unless MaxPooledPackets are
+//	there already.  Called with the lock held.
+//----------------------------------------------------------------------
+
+PacketBuffer *
+PostOfficeInput::TakePacket()
+{
+    PacketBuffer *packet = freePackets;
+
+    if (packet == NULL) {
+	packet = new PacketBuffer;
+    } else {
+	freePackets = packet->next;
+	numFreePackets--;
+    }
+    packet->refs = 0;
+    packet->next = NULL;
+    return packet;
+}
+
+void
+PostOfficeInput::GivePacket(PacketBuffer *packet)
+{
+    ASSERT(packet->refs == 0);
+    if (numFreePackets >= MaxPooledPackets) {
+	delete packet;
+	return;
+    }
+    packet->next = freePackets;
+    freePackets = packet;
+    numFreePackets++;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Select
+// 	Wait until there is a message in one of the boxes "wanted", and
+//	return that box -- the first one listed, if there are several.
+//	Give up after "timeout" ticks (or never, if it is NoTimeout), and
+//	return -1 then.  The message is left in its box, for Receive to
+//	take; if another thread takes it first, Receive waits.
+//
+//	"numWanted" -- how many boxes there are in "wanted"
+//	"wanted" -- mailbox ID's in which to look for messages
+//	"timeout" -- the longest to wait, in ticks
+//----------------------------------------------------------------------
+
+int
+PostOfficeInput::Select(int numWanted, int *wanted, int timeout)
+{
+    int box;
+
+    lock->Acquire();
+    box = WaitForMail(numWanted, wanted, timeout);
+    lock->Release();
+    return box;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::WaitForMail
+// 	Select, with the lock held.  Each time mail comes in, look
+//	again at every box wanted; wait no longer than what is left of
+//	"timeout" each time.
+//----------------------------------------------------------------------
+
+int
+PostOfficeInput::WaitForMail(int numWanted, int *wanted, int timeout)
+{
+    Ticks deadline = kernel->stats->totalTicks + timeout;
+    int i, left;
+
+    for (;;) {
+	for (i = 0; i < numWanted; i++) {
+	    ASSERT((wanted[i] >= 0) && (wanted[i] < numBoxes));
+	    if (!boxes[wanted[i]].IsEmpty()) {
+		return wanted[i];
+	    }
+	}
+	DEBUG(dbgNet, "Waiting for mail in " << numWanted << " mailboxes");
+	if (timeout == NoTimeout) {
+	    mailArrived->Wait(lock);
+	} else {
+	    left = (int) (deadline - kernel->stats->totalTicks);
+	    if (left <= 0) {
+		return -1;
+	    }
+	    (void) mailArrived->TimedWait(lock, left);
+	}
+    }
 }
 
 //----------------------------------------------------------------------
 // PostOffice::CallBack
 // 	Interrupt handler, called when a packet arrives from the network.
 //
-//	Signal the PostalDelivery routine that it is time to get to work!
+//	Take it off the network into a spare buffer, and put it in the
+//	ring for the PostalDelivery routine; signal it that it is time to
+//	get to work only if the ring was empty, since otherwise it has
+//	been already.  With no spare buffer, or no room in the ring,
+//	leave the packet where it is, and signal the worker to come back
+//	for it.  Also called by the worker, with interrupts off, to do so.
 //----------------------------------------------------------------------
 
 void
 PostOfficeInput::CallBack()
 { 
-    messageAvailable->V(); 
+    PacketBuffer *packet;
+    bool wasEmpty;
+
+    if (arrived->IsFull() || !spares->Get(&packet)) {
+	if (!stalled) {
+	    stalled = TRUE;
+	    messageAvailable->V();
+	}
+	return;
+    }
+    packet->pktHdr = network->Receive(packet->data);
+    ASSERT(arrived->Put(packet, &wasEmpty));
+    if (wasEmpty)
+	messageAvailable->V(); 
 }
 
 //----------------------------------------------------------------------
@@ -299,32 +555,73 @@ PostOfficeOutput::~PostOfficeOutput()
 void
 PostOfficeOutput::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 {
-    char* buffer = new char[MaxPacketSize];	// space to hold concatenated
-						// mailHdr + data
+    SendBatch(1, &pktHdr, &mailHdr, &data);
+}
 
-    if (debug->IsEnabled('n')) {
-	cout << "Post send: ";
-	PrintHeader(pktHdr, mailHdr);
-    }
-    ASSERT(mailHdr.length <= MaxMailSize);
-    ASSERT(0 <= mailHdr.to);
-    
-    // fill in pktHdr, for the Network layer
-    pktHdr.from = kernel->hostName;
-    pktHdr.length = mailHdr.length + sizeof(MailHeader);
+//----------------------------------------------------------------------
+// PostOfficeOutput::SendBatch
+// 	Send several messages, in order, holding the send lock only once
+//	for all of them.  Each packet takes as many of the messages that
+//	follow as are for the same machine and fit in it together, each
+//	as a MailHeader + data record; the post office at the other end
+//	splits them up (see PostalDelivery).  Messages of up to
+//	MaxMailSize / 2 - sizeof(MailHeader) bytes go at least two to a
+//	packet, so a burst of small messages takes half the packets,
+//	and half the time on the network, or less.
+//
+//	A lost packet loses all of the messages in it.
+//
+//	"numMails" -- how many messages to send
+//	"pktHdrs" -- destination machine ID of each
+//	"mailHdrs" -- source, destination mailbox ID's of each
+//	"data" -- payload message data of each
+//----------------------------------------------------------------------
 
-    // concatenate MailHeader and data
-    bcopy((char *)&mailHdr, buffer, sizeof(MailHeader));
-    bcopy(data, buffer + sizeof(MailHeader), mailHdr.length);
+void
+PostOfficeOutput::SendBatch(int numMails, PacketHeader *pktHdrs,
+			    MailHeader *mailHdrs, char **data)
+{
+    char* buffer = new char[MaxPacketSize];	// space to hold concatenated
+						// mailHdr + data records
+    PacketHeader pktHdr;
+    int i, next;
+
+    for (i = 0; i < numMails; i++) {
+	if (debug->IsEnabled('n')) {
+	    cout << "Post send: ";
+	    PrintHeader(pktHdrs[i], mailHdrs[i]);
+	}
+	ASSERT(mailHdrs[i].length <= MaxMailSize);
+	ASSERT(0 <= mailHdrs[i].to);
+    }
 
     sendLock->Acquire();   		// only one message can be sent
 					// to the network at any one time
-    network->Send(pktHdr, buffer);
-    messageSent->P();			// wait for interrupt to tell us
+    for (i = 0; i < numMails; i = next) {
+	// fill in pktHdr, for the Network layer
+	pktHdr.to = pktHdrs[i].to;
+	pktHdr.from = kernel->hostName;
+	pktHdr.length = 0;
+
+	// concatenate the MailHeader and data of each message that fits
+	for (next = i; next < numMails && pktHdrs[next].to == pktHdr.to
+		&& pktHdr.length + sizeof(MailHeader) + mailHdrs[next].length
+							<= MaxPacketSize; next++) {
+	    bcopy((char *)&mailHdrs[next], buffer + pktHdr.length,
+		  sizeof(MailHeader));
+	    bcopy(data[next], buffer + pktHdr.length + sizeof(MailHeader),
+		  mailHdrs[next].length);
+	    pktHdr.length += sizeof(MailHeader) + mailHdrs[next].length;
+	}
+	DEBUG(dbgNet, "Packet to " << pktHdr.to << " holds " << next - i << " messages");
+
+	network->Send(pktHdr, buffer);
+	messageSent->P();		// wait for interrupt to tell us
 					// ok to send the next message
+    }
     sendLock->Release();
 
-    delete [] buffer;			// we've sent the message, so
+    delete [] buffer;			// we've sent the messages, so
 					// we can delete our buffer
 }
 
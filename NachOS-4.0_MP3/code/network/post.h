@@ -20,6 +20,41 @@
 //	to which you can send an acknowledgement, if your protocol requires 
 //	this.
 //
+//	A thread can wait for mail for a while only (a timeout), and for
+//	mail in any of several mailboxes at once (Select), so that one
+//	thread can serve many other machines, each talking to a mailbox
+//	of its own.  All the mailboxes share one lock, and one condition
+//	that is broadcast whenever mail comes in; every waiting thread
+//	then looks again at the boxes it is waiting on.
+//
+//	Several messages can be sent at once (see SendBatch).  Consecutive
+//	ones for the same machine that fit together in a packet are sent
+//	as one: a packet holds one or more MailHeader + data records, one
+//	after another, and the post office at the other end splits them
+//	up again.
+//
+//	An arriving packet is read straight into a packet buffer, and
+//	stays there until every message in it has been read: the Mail
+//	put in a mailbox points at its data in the packet rather than
+//	holding a copy, and ReceiveMail hands the Mail itself to the
+//	receiver, who gives it back with Release once done with the
+//	data.  Packet buffers that are given back are kept (up to
+//	MaxPooledPackets) for the next ones, and Mails go back to their
+//	slab (see slab.h), so a message costs neither a copy nor an
+//	allocation on the way in.
+//	Receive still copies the data out for callers that want it in a
+//	buffer of their own.
+//
+//	The interrupt handler takes each packet off the network itself,
+//	into a spare buffer, and hands it to the postal worker through a
+//	ring that needs no lock (see ringqueue.h); the worker hands spare
+//	buffers back through another.  The worker's semaphore is only V'ed
+//	when the ring of arrived packets was empty, and the worker puts
+//	everything in it into the mailboxes before it waits again, under
+//	one lock and one broadcast, so a burst of packets costs one
+//	wakeup, not one each.  If the handler is out of spare buffers,
+//	the packet stays on the network until the worker has some again.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -31,8 +66,10 @@
 #include "utility.h"
 #include "callback.h"
 #include "network.h"
-#include "synchlist.h"
+#include "list.h"
 #include "synch.h"
+#include "slab.h"
+#include "ringqueue.h"
 
 // Mailbox address -- uniquely identifies a mailbox on a given machine.
 // A mailbox is just a place for temporary storage for messages.
@@ -55,6 +92,22 @@ class MailHeader {
 
 #define MaxMailSize 	(MaxPacketSize - sizeof(MailHeader))
 
+const int NumMailBoxes = 11;		// mailboxes on each machine
+
+const int MaxPooledPackets = 16;	// packet buffers kept for re-use
+const int PacketRingSize = 8;		// packets the handler can take off
+					// the network before the worker
+
+// The following class defines a buffer an arrived packet is kept in
+// until every message in it has been read.
+
+class PacketBuffer {
+  public:
+    char data[MaxPacketSize];	// the packet, MailHeaders and all
+    PacketHeader pktHdr;	// its header, as it came off the network
+    int refs;			// messages in it not yet released
+    PacketBuffer *next;		// next pooled buffer, while in the pool
+};
 
 // The following class defines the format of an incoming/outgoing 
 // "Mail" message.  The message format is layered: 
@@ -64,33 +117,42 @@ class MailHeader {
 
 class Mail {
   public:
-     Mail(PacketHeader pktH, MailHeader mailH, char *msgData);
-				// Initialize a mail message by
-				// concatenating the headers to the data
+     Mail(PacketHeader pktH, MailHeader mailH, PacketBuffer *buffer,
+	  char *msgData);
+				// Initialize a mail message whose data
+				// is at "msgData" in "buffer"
 
      PacketHeader pktHdr;	// Header appended by Network
      MailHeader mailHdr;	// Header appended by PostOffice
-     char data[MaxMailSize];	// Payload -- message data
+     char *data;		// Payload -- message data, in "packet"
+     PacketBuffer *packet;	// the packet the message came in
+
+     void *operator new(size_t size);
+				// take a recycled Mail
+     void operator delete(void *p, size_t size);
+				// keep it for re-use
+
+  private:
+     static thread_local Slab slab; // where Mails come from
 };
 
 // The following class defines a single mailbox, or temporary storage
 // for messages.   Incoming messages are put by the PostOffice into the 
 // appropriate mailbox, and these messages can then be retrieved by
-// threads on this machine.
+// threads on this machine.  A mailbox does no synchronization of its
+// own: the post office's lock must be held to use it.
 
 class MailBox {
   public: 
     MailBox();			// Allocate and initialize mail box
     ~MailBox();			// De-allocate mail box
 
-    void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data);
-   				// Atomically put a message into the mailbox
-    void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data); 
-   				// Atomically get a message out of the 
-				// mailbox (and wait if there is no message 
-				// to get!)
+    void Put(Mail *mail);	// Put a message into the mailbox
+    Mail *Get();		// Get a message out of the mailbox;
+				// there must be one
+    bool IsEmpty() { return messages->IsEmpty(); }
   private:
-    SynchList<Mail *> *messages; // A mailbox is just a list of arrived messages
+    List<Mail *> *messages;	// A mailbox is just a list of arrived messages
 };
 
 // The following two classes defines a "Post Office", or a collection of 
@@ -102,6 +164,8 @@ class MailBox {
 // Incoming messages are put by the PostOffice into the 
 // appropriate mailbox, waking up any threads waiting on Receive.
 
+const int NoTimeout = -1;	// wait for mail as long as it takes
+
 class PostOfficeInput : public CallBackObj {
   public:
     PostOfficeInput(int nBoxes); // Allocate and initialize Post Office
@@ -111,6 +175,20 @@ class PostOfficeInput : public CallBackObj {
 		MailHeader *mailHdr, char *data);
     				// Retrieve a message from "box".  Wait if
 				// there is no message in the box.
+    bool Receive(int box, PacketHeader *pktHdr, 
+		MailHeader *mailHdr, char *data, int timeout);
+				// The same, but wait "timeout" ticks at
+				// most; FALSE if no message came in
+    Mail *ReceiveMail(int box, int timeout);
+				// The same, without a copy: the message
+				// itself, NULL if none came in
+    void Release(Mail *mail);	// Give back a message ReceiveMail
+				// returned, once done with its data
+    int Select(int numWanted, int *wanted, int timeout);
+				// Wait until one of the "numWanted" boxes
+				// in "wanted" has a message, for "timeout"
+				// ticks at most, and return it; -1 if none
+				// did
 
     static void PostalDelivery(void* data);
 				// Wait for incoming messages, 
@@ -125,6 +203,28 @@ class PostOfficeInput : public CallBackObj {
     MailBox *boxes;		// Table of mail boxes to hold incoming mail
     int numBoxes;		// Number of mail boxes
     Semaphore *messageAvailable;// V'ed when message has arrived from network
+				// into an empty ring, or could not
+    RingQueue<PacketBuffer *> *arrived;
+				// packets taken off the network, from the
+				// handler to the worker
+    RingQueue<PacketBuffer *> *spares;
+				// buffers for them, from the worker to the
+				// handler
+    bool stalled;		// a packet was left on the network for
+				// want of a buffer (interrupts off)
+    Lock *lock;			// protects the mail boxes, and the pools
+    Condition *mailArrived;	// broadcast when mail is put in any of them
+    PacketBuffer *freePackets;	// packet buffers to be re-used
+    int numFreePackets;		// how many there are
+
+    PacketBuffer *TakePacket();	// a buffer for the next packet to arrive
+    void Deliver(PacketBuffer *packet);
+				// put its messages in their mailboxes
+    void GivePacket(PacketBuffer *packet);
+				// a packet whose messages are all read
+
+    int WaitForMail(int numWanted, int *wanted, int timeout);
+				// Select, with the lock held
 };
 
 class PostOfficeOutput : public CallBackObj {
@@ -139,6 +239,10 @@ class PostOfficeOutput : public CallBackObj {
     				// Send a message to a mailbox on a remote 
 				// machine.  The fromBox in the MailHeader is 
 				// the return box for ack's.
+    void SendBatch(int numMails, PacketHeader *pktHdrs,
+		   MailHeader *mailHdrs, char **data);
+				// Send "numMails" messages, in order, with
+				// as few packets as they fit in
 
     void CallBack();		// Called when outgoing packet has been 
 				// put on network; next packet can now be sent
@@ -0,0 +1,730 @@
+// remotefs.cc
+//	Routines for serving a file system to another machine, and for
+//	using it from there, with a cache of blocks and requests sent
+//	without waiting for the replies to the ones before them (see
+//	remotefs.h).
+//
+//	On the client, "lock" protects the cache and the list of
+//	requests waiting for a reply, and "sendLock" the connection: the
+//	list must be in the order the requests went out, so each one is
+//	put on it, and sent, with sendLock held.  A send can wait for
+//	room in the window, so "lock" is never held over one; a block is
+//	instead marked pending with "lock" held, and only asked for once
+//	it is released.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "remotefs.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// FileServer::FileServer
+// 	Start serving the file system of this machine to machine
+//	"client".
+//----------------------------------------------------------------------
+
+FileServer::FileServer(NetworkAddress client)
+{
+    Thread *t;
+    int i;
+
+    ASSERT(RemoteFsBox + client < 10 && RemoteFsBox + kernel->hostName < 10);
+    clientHost = client;
+    conn = new Connection(RemoteFsBox + client, client,
+			  RemoteFsBox + kernel->hostName);
+    for (i = 0; i < MaxRemoteFiles; i++) {
+	files[i] = NULL;
+    }
+    buffer = new char[RemoteBlockSize];
+    done = new Semaphore("file server done", 0);
+    numRequests = 0;
+
+    t = new Thread("file server", 1);
+    t->Fork(FileServer::Server, this);
+}
+
+//----------------------------------------------------------------------
+// FileServer::WaitUntilDone
+// 	Wait until the client has unmounted, and has heard back.
+//----------------------------------------------------------------------
+
+void
+FileServer::WaitUntilDone()
+{
+    done->P();
+}
+
+//----------------------------------------------------------------------
+// FileServer::Server
+// 	The thread that serves the client; "data" is the FileServer.
+//----------------------------------------------------------------------
+
+void
+FileServer::Server(void *data)
+{
+    ((FileServer *) data)->Serve();
+}
+
+//----------------------------------------------------------------------
+// FileServer::Serve
+// 	Take requests off the connection and answer each one in turn,
+//	until the client unmounts; then close the files it left open.
+//----------------------------------------------------------------------
+
+void
+FileServer::Serve()
+{
+    RemoteRequest request;
+    OpenFile *openFile;
+    int i, count;
+
+    for (;;) {
+	conn->ReceiveAll((char *) &request, sizeof(RemoteRequest));
+	ASSERT(request.length >= 0 && request.length <= RemoteBlockSize);
+	if (request.op != RemoteRead) {
+	    conn->ReceiveAll(buffer, request.length);
+	}
+	numRequests++;
+	openFile = NULL;
+	if (request.file >= 0 && request.file < MaxRemoteFiles) {
+	    openFile = files[request.file];
+	}
+	DEBUG(dbgNet, "File server for " << clientHost << ": request "
+	      << request.op << ", file " << request.file << ", offset "
+	      << request.offset << ", " << request.length << " bytes");
+
+	switch (request.op) {
+	  case RemoteOpen:
+	    buffer[RemoteBlockSize - 1] = '\0';
+	    for (i = 0; i < MaxRemoteFiles && files[i] != NULL; i++) {
+	    }
+	    if (i < MaxRemoteFiles
+		&& (files[i] = kernel->fileSystem->Open(buffer)) != NULL) {
+		Reply(i, NULL, files[i]->Length());
+	    } else {
+		Reply(-1, NULL, 0);
+	    }
+	    break;
+
+	  case RemoteCreate:
+	    buffer[RemoteBlockSize - 1] = '\0';
+#ifdef FILESYS_STUB
+	    Reply(kernel->fileSystem->Create(buffer) ? 0 : -1, NULL, 0);
+#else
+	    Reply(kernel->fileSystem->Create(buffer, request.offset) ? 0 : -1,
+		  NULL, 0);
+#endif
+	    break;
+
+	  case RemoteRemove:
+	    buffer[RemoteBlockSize - 1] = '\0';
+	    Reply(kernel->fileSystem->Remove(buffer) ? 0 : -1, NULL, 0);
+	    break;
+
+	  case RemoteRead:
+	    if (openFile == NULL) {
+		Reply(-1, NULL, 0);
+	    } else {
+		count = openFile->ReadAt(buffer, request.length, request.offset);
+		Reply(0, buffer, max(count, 0));
+	    }
+	    break;
+
+	  case RemoteWrite:
+	    if (openFile == NULL) {
+		Reply(-1, NULL, 0);
+	    } else {
+		Reply(openFile->WriteAt(buffer, request.length, request.offset),
+		      NULL, 0);
+	    }
+	    break;
+
+	  case RemoteClose:
+	    if (openFile == NULL) {
+		Reply(-1, NULL, 0);
+	    } else {
+		delete openFile;
+		files[request.file] = NULL;
+		Reply(0, NULL, 0);
+	    }
+	    break;
+
+	  case RemoteUnmount:
+	    for (i = 0; i < MaxRemoteFiles; i++) {
+		if (files[i] != NULL) {
+		    delete files[i];
+		    files[i] = NULL;
+		}
+	    }
+	    Reply(0, NULL, 0);
+	    cout << "File server for " << clientHost << ": " << numRequests
+		 << " requests\n";
+	    conn->Close();
+	    done->V();
+	    return;
+
+	  default:
+	    Reply(-1, NULL, 0);
+	    break;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// FileServer::Reply
+// 	Send the reply to a request, with "length" bytes of "data"
+//	after it, if "data" is not NULL.
+//----------------------------------------------------------------------
+
+void
+FileServer::Reply(int status, char *data, int length)
+{
+    RemoteReply reply;
+
+    reply.status = status;
+    reply.length = length;
+    conn->Send((char *) &reply, sizeof(RemoteReply));
+    if (data != NULL && length > 0) {
+	conn->Send(data, length);
+    }
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::RemoteFileSystem
+// 	Start using the file system of machine "server", with an empty
+//	cache.
+//----------------------------------------------------------------------
+
+RemoteFileSystem::RemoteFileSystem(NetworkAddress server)
+{
+    Thread *t;
+    int i;
+
+    ASSERT(RemoteFsBox + server < 10 && RemoteFsBox + kernel->hostName < 10);
+    serverHost = server;
+    conn = new Connection(RemoteFsBox + server, server,
+			  RemoteFsBox + kernel->hostName);
+    sendLock = new Lock("remote fs send");
+    lock = new Lock("remote fs");
+    replied = new Condition("remote fs reply");
+    outstanding = new List<RemoteCall *>;
+    for (i = 0; i < RemoteCacheBlocks; i++) {
+	cache[i].state = BlockEmpty;
+	cache[i].discard = FALSE;
+	cache[i].lastUsed = 0;
+    }
+    useCount = 0;
+    numHits = numMisses = numReadAheads = 0;
+    numWrites = numWriteErrors = 0;
+
+    t = new Thread("remote fs receiver", 1);
+    t->Fork(RemoteFileSystem::Receiver, this);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Create
+// 	Create the file "name", "initialSize" bytes long, on the server.
+//----------------------------------------------------------------------
+
+bool
+RemoteFileSystem::Create(char *name, int initialSize)
+{
+    int length;
+
+    return Ask(name, RemoteCreate, initialSize, &length) >= 0;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Open
+// 	Open the file "name" on the server.  Return NULL if it cannot
+//	be opened.
+//----------------------------------------------------------------------
+
+RemoteFile *
+RemoteFileSystem::Open(char *name)
+{
+    int file, length;
+
+    if ((file = Ask(name, RemoteOpen, 0, &length)) < 0) {
+	return NULL;
+    }
+    return new RemoteFile(this, file, length);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Remove
+// 	Remove the file "name" from the server.
+//----------------------------------------------------------------------
+
+bool
+RemoteFileSystem::Remove(char *name)
+{
+    int length;
+
+    return Ask(name, RemoteRemove, 0, &length) >= 0;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Unmount
+// 	Tell the server we are done.  Its reply comes after those to
+//	every write still on its way, so once it is in, the server has
+//	everything; then wait for the connection to go quiet.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Unmount()
+{
+    RemoteRequest request;
+    int length;
+
+    request.op = RemoteUnmount;
+    request.file = -1;
+    request.offset = 0;
+    request.length = 0;
+    Call(&request, NULL, &length);
+    conn->Close();
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Print
+// 	Print how many blocks were found in the cache, and how many had
+//	to be asked for.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Print()
+{
+    cout << "Remote file system on " << serverHost << ": " << numHits
+	 << " block hits, " << numMisses << " misses, " << numReadAheads
+	 << " read ahead, " << numWrites << " writes, " << numWriteErrors
+	 << " failed\n";
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Issue
+// 	Send a request, with "request->length" bytes of "data" after it
+//	unless it is a RemoteRead, and put "call" on the list of those
+//	waiting for a reply.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Issue(RemoteRequest *request, char *data, RemoteCall *call)
+{
+    sendLock->Acquire();
+    lock->Acquire();
+    outstanding->Append(call);
+    lock->Release();
+
+    conn->Send((char *) request, sizeof(RemoteRequest));
+    if (request->op != RemoteRead && request->length > 0) {
+	conn->Send(data, request->length);
+    }
+    sendLock->Release();
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Call
+// 	Send a request and wait for the reply.  Return its status, and
+//	its length in "length".
+//----------------------------------------------------------------------
+
+int
+RemoteFileSystem::Call(RemoteRequest *request, char *data, int *length)
+{
+    RemoteCall call;
+
+    call.block = NULL;
+    call.waiting = TRUE;
+    call.done = FALSE;
+    Issue(request, data, &call);
+
+    lock->Acquire();
+    while (!call.done) {
+	replied->Wait(lock);
+    }
+    lock->Release();
+    *length = call.length;
+    return call.status;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Ask
+// 	Send a request about the file "name" and wait for the reply.
+//----------------------------------------------------------------------
+
+int
+RemoteFileSystem::Ask(char *name, int op, int offset, int *length)
+{
+    RemoteRequest request;
+
+    ASSERT((int) strlen(name) < RemoteBlockSize);
+    request.op = op;
+    request.file = -1;
+    request.offset = offset;
+    request.length = strlen(name) + 1;
+    return Call(&request, name, length);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Find
+// 	Return the entry for block "block" of "file", if it is in the
+//	cache or on its way, or NULL.  Call with "lock" held.
+//----------------------------------------------------------------------
+
+RemoteBlock *
+RemoteFileSystem::Find(int file, int block)
+{
+    int i;
+
+    for (i = 0; i < RemoteCacheBlocks; i++) {
+	if (cache[i].state != BlockEmpty && !cache[i].discard
+	    && cache[i].file == file && cache[i].block == block) {
+	    return &cache[i];
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Fetch
+// 	Ask for block "block" of "file", unless it is cached or on its
+//	way already, in place of the least recently used block that is
+//	not (an empty one first); if every block is still on its way,
+//	wait for one to come in.
+//	"ahead" is whether it is read ahead, rather than wanted now.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Fetch(int file, int block, bool ahead)
+{
+    RemoteRequest request;
+    RemoteCall *call;
+    RemoteBlock *victim;
+    int i;
+
+    lock->Acquire();
+    for (;;) {
+	if (Find(file, block) != NULL) {
+	    lock->Release();
+	    return;
+	}
+	victim = NULL;
+	for (i = 0; i < RemoteCacheBlocks; i++) {
+	    if (cache[i].state == BlockEmpty) {
+		victim = &cache[i];
+		break;
+	    }
+	    if (cache[i].state == BlockValid
+		&& (victim == NULL || cache[i].lastUsed < victim->lastUsed)) {
+		victim = &cache[i];
+	    }
+	}
+	if (victim != NULL) {
+	    break;
+	}
+	replied->Wait(lock);
+    }
+    victim->state = BlockPending;
+    victim->discard = FALSE;
+    victim->file = file;
+    victim->block = block;
+    victim->lastUsed = useCount;	// not the first to go, if it
+					// comes in before it is read
+    if (ahead) {
+	numReadAheads++;
+    } else {
+	numMisses++;
+    }
+    lock->Release();
+
+    call = new RemoteCall;
+    call->block = victim;
+    call->waiting = FALSE;
+    request.op = RemoteRead;
+    request.file = file;
+    request.offset = block * RemoteBlockSize;
+    request.length = RemoteBlockSize;
+    Issue(&request, NULL, call);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::CopyOut
+// 	Copy "numBytes" bytes, from "from" on, out of block "block" of
+//	"file", asking for it and waiting for it as need be.  Return how
+//	many there were.
+//----------------------------------------------------------------------
+
+int
+RemoteFileSystem::CopyOut(int file, int block, char *into, int from,
+			  int numBytes)
+{
+    RemoteBlock *entry;
+    bool first = TRUE;
+
+    for (;;) {
+	lock->Acquire();
+	while ((entry = Find(file, block)) != NULL
+	       && entry->state == BlockPending) {
+	    first = FALSE;
+	    replied->Wait(lock);
+	}
+	if (entry != NULL) {
+	    break;
+	}
+	lock->Release();
+	Fetch(file, block, FALSE);	// not cached, or gone already
+	first = FALSE;
+    }
+    if (first) {
+	numHits++;
+    }
+    entry->lastUsed = ++useCount;
+    numBytes = max(0, min(numBytes, entry->length - from));
+    bcopy(entry->data + from, into, numBytes);
+    lock->Release();
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::CopyIn
+// 	Write "numBytes" bytes into block "block" of "file", from "to" on,
+//	if it is cached; if it is still on its way, it will come in
+//	without them, so drop it.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::CopyIn(int file, int block, char *from, int to,
+			 int numBytes)
+{
+    RemoteBlock *entry;
+
+    lock->Acquire();
+    if ((entry = Find(file, block)) != NULL) {
+	if (entry->state == BlockPending) {
+	    entry->discard = TRUE;
+	} else if (to > entry->length) {
+	    entry->state = BlockEmpty;	// would leave a hole
+	} else {
+	    bcopy(from, entry->data + to, numBytes);
+	    entry->length = max(entry->length, to + numBytes);
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Forget
+// 	Drop every block of "file" from the cache, as it is closed.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Forget(int file)
+{
+    int i;
+
+    lock->Acquire();
+    for (i = 0; i < RemoteCacheBlocks; i++) {
+	if (cache[i].state != BlockEmpty && cache[i].file == file) {
+	    if (cache[i].state == BlockPending) {
+		cache[i].discard = TRUE;
+	    } else {
+		cache[i].state = BlockEmpty;
+	    }
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Receiver
+// 	The thread that takes the replies in, and matches each one to
+//	the request at the front of "outstanding": it fills the block a
+//	read was for, or hands the reply to the thread waiting for it.
+//	"data" is the RemoteFileSystem.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Receiver(void *data)
+{
+    RemoteFileSystem *fs = (RemoteFileSystem *) data;
+    RemoteReply reply;
+    RemoteCall *call;
+    RemoteBlock *entry;
+    char *buffer = new char[RemoteBlockSize];
+
+    for (;;) {
+	fs->conn->ReceiveAll((char *) &reply, sizeof(RemoteReply));
+	fs->lock->Acquire();
+	ASSERT(!fs->outstanding->IsEmpty());
+	call = fs->outstanding->Front();
+	fs->lock->Release();
+	if (call->block != NULL) {	// only reads carry data
+	    ASSERT(reply.length >= 0 && reply.length <= RemoteBlockSize);
+	    fs->conn->ReceiveAll(buffer, reply.length);
+	}
+
+	fs->lock->Acquire();
+	fs->outstanding->RemoveFront();
+	if ((entry = call->block) != NULL) {
+	    if (entry->discard || reply.status < 0) {
+		entry->state = BlockEmpty;
+	    } else {
+		bcopy(buffer, entry->data, reply.length);
+		entry->length = reply.length;
+		entry->state = BlockValid;
+	    }
+	    entry->discard = FALSE;
+	    delete call;
+	} else if (call->waiting) {
+	    call->status = reply.status;
+	    call->length = reply.length;
+	    call->done = TRUE;
+	} else {
+	    if (reply.status < 0) {
+		fs->numWriteErrors++;
+	    }
+	    delete call;
+	}
+	fs->replied->Broadcast(fs->lock);
+	fs->lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::RemoteFile
+// 	Initialize a file the server has opened as "handle"; it is
+//	"length" bytes long.
+//----------------------------------------------------------------------
+
+RemoteFile::RemoteFile(RemoteFileSystem *fs, int handle, int length)
+{
+    fileSystem = fs;
+    file = handle;
+    fileLength = length;
+    seekPosition = 0;
+    nextSequential = 0;
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::~RemoteFile
+// 	Close the file.  The server answers only once it has done the
+//	writes sent before, so once the reply is in, they are all done.
+//----------------------------------------------------------------------
+
+RemoteFile::~RemoteFile()
+{
+    RemoteRequest request;
+    int length;
+
+    fileSystem->Forget(file);
+    request.op = RemoteClose;
+    request.file = file;
+    request.offset = 0;
+    request.length = 0;
+    fileSystem->Call(&request, NULL, &length);
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::ReadAt
+// 	Read "numBytes" bytes from "position" on into "into", block by
+//	block out of the cache.  If the read carries on from the last
+//	one, first ask for the blocks after it too, so they are on their
+//	way while these are copied.  Return the bytes read.
+//----------------------------------------------------------------------
+
+int
+RemoteFile::ReadAt(char *into, int numBytes, int position)
+{
+    int firstBlock, lastBlock, aheadBlock, block, start, count, done;
+
+    if (numBytes <= 0 || position >= fileLength) {
+	return 0;
+    }
+    numBytes = min(numBytes, fileLength - position);
+    firstBlock = position / RemoteBlockSize;
+    lastBlock = (position + numBytes - 1) / RemoteBlockSize;
+    aheadBlock = lastBlock;
+    if (position == nextSequential) {
+	aheadBlock = min(lastBlock + ReadAheadBlocks,
+			 (fileLength - 1) / RemoteBlockSize);
+    }
+    nextSequential = position + numBytes;
+
+    for (block = firstBlock; block <= aheadBlock; block++) {
+	fileSystem->Fetch(file, block, block > lastBlock);
+    }
+
+    done = 0;
+    for (block = firstBlock; block <= lastBlock; block++) {
+	start = (position + done) - block * RemoteBlockSize;
+	count = min(numBytes - done, RemoteBlockSize - start);
+	count = fileSystem->CopyOut(file, block, into + done, start, count);
+	done += count;
+	if (start + count < RemoteBlockSize) {
+	    break;			// the file ended early
+	}
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::WriteAt
+// 	Write "numBytes" bytes from "from" into the file at "position",
+//	one request per block, without waiting for the replies.  Return
+//	"numBytes"; a write that fails only shows in the statistics.
+//----------------------------------------------------------------------
+
+int
+RemoteFile::WriteAt(char *from, int numBytes, int position)
+{
+    RemoteRequest request;
+    RemoteCall *call;
+    int block, start, count, done;
+
+    for (done = 0; done < numBytes; done += count) {
+	block = (position + done) / RemoteBlockSize;
+	start = (position + done) - block * RemoteBlockSize;
+	count = min(numBytes - done, RemoteBlockSize - start);
+	fileSystem->CopyIn(file, block, from + done, start, count);
+
+	call = new RemoteCall;
+	call->block = NULL;
+	call->waiting = FALSE;
+	request.op = RemoteWrite;
+	request.file = file;
+	request.offset = position + done;
+	request.length = count;
+	fileSystem->numWrites++;
+	fileSystem->Issue(&request, from + done, call);
+    }
+    fileLength = max(fileLength, position + numBytes);
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::Read
+// RemoteFile::Write
+// 	Read or write from the seek position on, and move it past the
+//	bytes read or written.
+//----------------------------------------------------------------------
+
+int
+RemoteFile::Read(char *into, int numBytes)
+{
+    int result = ReadAt(into, numBytes, seekPosition);
+
+    seekPosition += result;
+    return result;
+}
+
+int
+RemoteFile::Write(char *from, int numBytes)
+{
+    int result = WriteAt(from, numBytes, seekPosition);
+
+    seekPosition += result;
+    return result;
+}
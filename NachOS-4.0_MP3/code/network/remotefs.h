@@ -0,0 +1,236 @@
+// remotefs.h
+//	Data structures for using the file system of one Nachos machine
+//	from another, over a connection.
+//
+//	A FileServer on the machine with the disk serves one client
+//	machine: it takes requests to open, create, remove, read, write
+//	and close files off a connection, carries each one out on its own
+//	file system, and sends back the reply.  Requests are served, and
+//	answered, in the order they came in.
+//
+//	A RemoteFileSystem on the client stands in for the file system
+//	of the server.  It opens RemoteFiles, which read and write like
+//	OpenFiles; FileSystem and OpenFile are not virtual, so these are
+//	classes of their own rather than stand-ins for them.  Since the
+//	replies come back in order, the client need not wait for one
+//	before sending the next request: it keeps a list of the requests
+//	it is waiting on, and a thread of its own matches each reply that
+//	comes in to the one at the front of it.
+//
+//	The client keeps the blocks it has read from the server in a
+//	small cache.  A read that carries on from where the last one on
+//	the same file stopped also asks for the ReadAheadBlocks blocks
+//	after it, without waiting for them, so that a file read from
+//	start to end keeps several requests on the network at a time,
+//	and is not held up for a round trip at each block.  Writes go
+//	straight through to the server, again without waiting: closing
+//	the file waits for its reply, which the server only sends once
+//	it has done every request before it.
+//
+//	Nothing keeps the caches of two clients in step.  A file's
+//	blocks are dropped from the cache when it is closed, so a client
+//	that opens a file after another one closed it sees what the other
+//	one wrote ("close-to-open" consistency, as in NFS).
+//
+//	A file server, and a remote file system, is never deleted: the
+//	connection under it never is.  The machine at each end halts
+//	once the client has unmounted.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef REMOTEFS_H
+#define REMOTEFS_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "list.h"
+#include "synch.h"
+#include "disk.h"
+#include "filesys.h"
+#include "transport.h"
+
+// The operations a client can ask the server for.
+
+enum RemoteOp { RemoteOpen, RemoteCreate, RemoteRemove, RemoteRead,
+		RemoteWrite, RemoteClose, RemoteUnmount };
+
+// The following class defines the header of a request.  For
+// RemoteOpen, RemoteCreate and RemoteRemove, the name of the file
+// follows it, with its '\0'; for RemoteWrite, the data to write.
+
+class RemoteRequest {
+  public:
+    int op;			// a RemoteOp
+    int file;			// which file, as the server's reply to
+				// RemoteOpen numbered it
+    int offset;			// where to read or write; for
+				// RemoteCreate, the size of the file
+    int length;			// bytes following; for RemoteRead,
+				// bytes wanted
+};
+
+// The following class defines the header of a reply.  For RemoteRead,
+// the data read follows it.
+
+class RemoteReply {
+  public:
+    int status;			// -1 if the request failed; for
+				// RemoteOpen, the number of the file; for
+				// RemoteWrite, the bytes written
+    int length;			// bytes following; for RemoteOpen, the
+				// length of the file
+};
+
+const int RemoteFsBox = 2;	// the server for client c takes requests
+				// in mailbox RemoteFsBox + c, and a client
+				// of server s the replies in RemoteFsBox + s
+const int MaxRemoteFiles = 16;	// files one client can have open
+const int RemoteBlockSize = 4 * SectorSize;
+				// bytes the client caches, and asks the
+				// server for, at a time
+const int RemoteCacheBlocks = 32; // blocks in the client's cache
+const int ReadAheadBlocks = 4;	// asked for past a sequential read
+
+// The following class defines the server end.
+
+class FileServer {
+  public:
+    FileServer(NetworkAddress client);
+				// Serve machine "client", in a thread
+				// of its own
+    void WaitUntilDone();	// Wait until the client has unmounted
+
+  private:
+    NetworkAddress clientHost;
+    Connection *conn;		// requests come in, replies go out
+    OpenFile *files[MaxRemoteFiles]; // the files the client has open;
+				// NULL if none
+    char *buffer;		// a name or the data of a request
+    Semaphore *done;		// V'ed once the client unmounts
+    int numRequests;		// requests served
+
+    void Serve();		// serve requests until unmounted
+    void Reply(int status, char *data, int length);
+				// answer the request
+    static void Server(void *data);
+};
+
+// The following class defines a block in the client's cache.
+
+enum RemoteBlockState { BlockEmpty, BlockPending, BlockValid };
+
+class RemoteBlock {
+  public:
+    RemoteBlockState state;	// has the block been asked for, or come in?
+    bool discard;		// drop it when it comes in: it was written
+				// or closed while it was on its way
+    int file;			// which block of which file
+    int block;
+    int length;			// bytes in it; less than RemoteBlockSize
+				// at the end of the file
+    int lastUsed;		// when it was last read, to find the least
+				// recently used one
+    char data[RemoteBlockSize];
+};
+
+// The following class defines a request the client is waiting on.
+
+class RemoteCall {
+  public:
+    RemoteBlock *block;		// the block a RemoteRead fills; NULL
+				// for any other request
+    bool waiting;		// is a thread waiting for the reply?
+    bool done;			// and has it come in?
+    int status;			// the reply
+    int length;
+};
+
+class RemoteFile;
+
+// The following class defines the client end.
+
+class RemoteFileSystem {
+  public:
+    RemoteFileSystem(NetworkAddress server);
+				// Use the file system of machine "server"
+
+    bool Create(char *name, int initialSize);
+				// Create a file on the server
+    RemoteFile *Open(char *name); // Open one; NULL if there is none
+    bool Remove(char *name);	// Remove one
+
+    void Unmount();		// Wait for the writes still on their way,
+				// and stop the server; the files must all
+				// be closed
+    void Print();		// Print how well the cache did
+
+  private:
+    friend class RemoteFile;
+
+    NetworkAddress serverHost;
+    Connection *conn;		// requests go out, replies come in
+    Lock *sendLock;		// keeps a request whole, and in the same
+				// place on the network as in "outstanding";
+				// never taken with "lock" held
+    Lock *lock;			// protects all of the following
+    Condition *replied;		// a reply came in
+    List<RemoteCall *> *outstanding; // requests sent, not answered yet,
+				// in the order they were sent
+    RemoteBlock cache[RemoteCacheBlocks];
+    int useCount;		// bumped each time a block is read
+
+    int numHits;		// blocks read that were in the cache
+    int numMisses;		// blocks asked for when read
+    int numReadAheads;		// blocks asked for ahead of time
+    int numWrites;		// write requests sent
+    int numWriteErrors;		// of which failed
+
+    void Issue(RemoteRequest *request, char *data, RemoteCall *call);
+				// send a request, and expect the reply
+    int Call(RemoteRequest *request, char *data, int *length);
+				// send one and wait for the reply
+    int Ask(char *name, int op, int offset, int *length);
+				// send one about a file by name
+    RemoteBlock *Find(int file, int block);
+				// the block, if it is cached or on its way
+    void Fetch(int file, int block, bool ahead);
+				// ask for a block, unless it is cached
+    int CopyOut(int file, int block, char *into, int from, int numBytes);
+				// copy out of a block, waiting for it
+    void CopyIn(int file, int block, char *from, int to, int numBytes);
+				// keep a block in step with a write
+    void Forget(int file);	// drop the blocks of a file
+    static void Receiver(void *data);
+				// match up the replies
+};
+
+// The following class defines a file open on the server.
+
+class RemoteFile {
+  public:
+    RemoteFile(RemoteFileSystem *fs, int handle, int length);
+				// Made by RemoteFileSystem::Open
+    ~RemoteFile();		// Close the file, once the server has
+				// done every write to it
+
+    int ReadAt(char *into, int numBytes, int position);
+    int WriteAt(char *from, int numBytes, int position);
+    int Read(char *into, int numBytes);
+    int Write(char *from, int numBytes);
+				// Read/write bytes from the file, as in
+				// OpenFile
+    void Seek(int position) { seekPosition = position; }
+    int Length() { return fileLength; }
+
+  private:
+    RemoteFileSystem *fileSystem;
+    int file;			// the server's number for it
+    int fileLength;		// as opened, and grown by our writes
+    int seekPosition;		// where Read and Write start
+    int nextSequential;		// where a read that carries on from the
+				// last one would start
+};
+
+#endif // REMOTEFS_H
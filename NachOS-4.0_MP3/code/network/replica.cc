@@ -0,0 +1,285 @@
+// replica.cc
+//	Routines for mirroring the writes to this machine's disk onto the
+//	disk of a backup machine, and for taking them in there (see
+//	replica.h).
+//
+//	On the primary, the lists of records are only touched with
+//	interrupts off, since SynchDisk can hand over a write from an
+//	interrupt handler; the connection is only used by the sender
+//	thread, which sends, and the ack receiver, which receives.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "replica.h"
+#include "main.h"
+#include "synchdisk.h"
+#include "bufcache.h"
+
+//----------------------------------------------------------------------
+// Replicator::Replicator
+// 	Start mirroring the writes to this machine's disk onto machine
+//	"backup", with a thread to send the records and one to take in
+//	the acks.
+//----------------------------------------------------------------------
+
+Replicator::Replicator(NetworkAddress backup)
+{
+    Thread *t;
+
+    backupHost = backup;
+    conn = new Connection(ReplicaBox, backup, ReplicaBox);
+    toSend = new List<ReplicaWrite *>;
+    inFlight = new List<ReplicaWrite *>;
+    queued = new Semaphore("replica queued", 0);
+    drained = new Semaphore("replica drained", 0);
+    nextSeq = 0;
+    numRecords = numSectors = maxInFlight = 0;
+    firstQueued = lastAcked = 0;
+
+    t = new Thread("replica sender", 1);
+    t->Fork(Replicator::Sender, this);
+    t = new Thread("replica acks", 1);
+    t->Fork(Replicator::AckReceiver, this);
+}
+
+//----------------------------------------------------------------------
+// Replicator::~Replicator
+// 	Nachos is halting, and the file system has written everything
+//	back.  Send the last record, wait until the backup has everything,
+//	and say how it went.
+//----------------------------------------------------------------------
+
+Replicator::~Replicator()
+{
+    Queue(0, 0, NULL);
+    drained->P();
+    conn->Close();
+    Print();
+    delete drained;
+    delete queued;
+    delete inFlight;
+    delete toSend;
+}
+
+//----------------------------------------------------------------------
+// Replicator::Mirror
+// 	A request to write a run of sectors has been queued for the disk:
+//	send a copy of them to the backup.  Returns at once.
+//
+//	"firstSector" -- the first disk sector written
+//	"numSectors" -- the number of sectors in the run
+//	"data" -- their contents, numSectors * SectorSize bytes long
+//----------------------------------------------------------------------
+
+void
+Replicator::Mirror(int firstSector, int numSectors, char *data)
+{
+    ASSERT(numSectors > 0);
+    Queue(firstSector, numSectors, data);
+}
+
+//----------------------------------------------------------------------
+// Replicator::Queue
+// 	Copy a run of sectors into a record, put it at the end of the
+//	records to send, and wake the sender.  A run of no sectors is the
+//	last record.
+//----------------------------------------------------------------------
+
+void
+Replicator::Queue(int firstSector, int numSectors, char *data)
+{
+    ReplicaWrite *w = new ReplicaWrite;
+    IntStatus oldLevel;
+
+    w->hdr.firstSector = firstSector;
+    w->hdr.numSectors = numSectors;
+    w->data = NULL;
+    if (numSectors > 0) {
+	w->data = new char[numSectors * SectorSize];
+	bcopy(data, w->data, numSectors * SectorSize);
+    }
+    w->queued = kernel->stats->totalTicks;
+
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    w->hdr.seq = nextSeq++;
+    if (w->hdr.seq == 0)
+	firstQueued = w->queued;
+    toSend->Append(w);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    queued->V();
+}
+
+//----------------------------------------------------------------------
+// Replicator::Sender
+// 	The thread that sends the records, in the order they were
+//	queued, without waiting for them to be acknowledged; "data" is
+//	the Replicator.  A record goes on the list of those in flight
+//	before it is sent, so its ack always finds it there.
+//----------------------------------------------------------------------
+
+void
+Replicator::Sender(void *data)
+{
+    Replicator *r = (Replicator *) data;
+    ReplicaWrite *w;
+    IntStatus oldLevel;
+
+    do {
+	r->queued->P();
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	w = r->toSend->RemoveFront();
+	r->inFlight->Append(w);
+	r->maxInFlight = max(r->maxInFlight,
+			     (int) r->inFlight->NumInList());
+	(void) kernel->interrupt->SetLevel(oldLevel);
+
+	DEBUG(dbgNet, "Replica record " << w->hdr.seq << ": "
+	      << w->hdr.numSectors << " sectors from " << w->hdr.firstSector);
+	r->conn->Send((char *) &w->hdr, sizeof(ReplicaHeader));
+	if (w->hdr.numSectors > 0)
+	    r->conn->Send(w->data, w->hdr.numSectors * SectorSize);
+    } while (w->hdr.numSectors > 0);
+}
+
+//----------------------------------------------------------------------
+// Replicator::AckReceiver
+// 	The thread that takes in the backup's acks, one per record, in
+//	order, and measures how long each record took; "data" is the
+//	Replicator.  It wakes the destructor once the last one is in.
+//----------------------------------------------------------------------
+
+void
+Replicator::AckReceiver(void *data)
+{
+    Replicator *r = (Replicator *) data;
+    ReplicaWrite *w;
+    IntStatus oldLevel;
+    int seq;
+    bool last;
+
+    do {
+	r->conn->ReceiveAll((char *) &seq, sizeof(int));
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	w = r->inFlight->RemoveFront();
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	ASSERT(w->hdr.seq == seq);
+
+	r->lastAcked = kernel->stats->totalTicks;
+	r->lagTicks.Add((int) (r->lastAcked - w->queued));
+	last = (w->hdr.numSectors == 0);
+	if (!last) {
+	    r->numRecords++;
+	    r->numSectors += w->hdr.numSectors;
+	    delete [] w->data;
+	}
+	delete w;
+    } while (!last);
+    r->drained->V();
+}
+
+//----------------------------------------------------------------------
+// Replicator::Print
+// 	Print how much was mirrored, how fast, and how far the backup
+//	lagged behind.
+//----------------------------------------------------------------------
+
+void
+Replicator::Print()
+{
+    Ticks elapsed = lastAcked - firstQueued;
+
+    cout << "Replica on " << backupHost << ": " << numRecords
+	 << " writes, " << numSectors << " sectors, at most " << maxInFlight
+	 << " in flight";
+    if (elapsed > 0)
+	cout << ", " << (numSectors * SectorSize * 1000LL) / elapsed
+	     << " bytes per 1000 ticks";
+    cout << "\n";
+    cout << "Replica lag ticks: ";
+    lagTicks.Print();
+}
+
+//----------------------------------------------------------------------
+// ReplicaServer::ReplicaServer
+// 	Start taking the writes of machine "primary" onto this machine's
+//	disk.  Whatever mounting the file system here left dirty goes to
+//	disk first, so that none of it lands over the primary's sectors.
+//----------------------------------------------------------------------
+
+ReplicaServer::ReplicaServer(NetworkAddress primary)
+{
+    Thread *t;
+
+    primaryHost = primary;
+    kernel->bufferCache->Flush();
+    conn = new Connection(ReplicaBox, primary, ReplicaBox);
+    done = new Semaphore("replica done", 0);
+    numRecords = numSectors = 0;
+
+    t = new Thread("replica server", 1);
+    t->Fork(ReplicaServer::Server, this);
+}
+
+//----------------------------------------------------------------------
+// ReplicaServer::WaitUntilDone
+// 	Wait until the primary's last record is in, and acknowledged.
+//----------------------------------------------------------------------
+
+void
+ReplicaServer::WaitUntilDone()
+{
+    done->P();
+}
+
+//----------------------------------------------------------------------
+// ReplicaServer::Server
+// 	The thread that takes in the records; "data" is the
+//	ReplicaServer.
+//----------------------------------------------------------------------
+
+void
+ReplicaServer::Server(void *data)
+{
+    ((ReplicaServer *) data)->Serve();
+}
+
+//----------------------------------------------------------------------
+// ReplicaServer::Serve
+// 	Take records off the connection, in order, acknowledge each one
+//	as soon as all of it is in, then write its sectors to disk; until
+//	the last record.
+//----------------------------------------------------------------------
+
+void
+ReplicaServer::Serve()
+{
+    ReplicaHeader hdr;
+    char *buffer;
+
+    for (;;) {
+	conn->ReceiveAll((char *) &hdr, sizeof(ReplicaHeader));
+	ASSERT(hdr.numSectors >= 0 && hdr.firstSector >= 0
+	       && hdr.firstSector + hdr.numSectors <= NumSectors);
+	buffer = NULL;
+	if (hdr.numSectors > 0) {
+	    buffer = new char[hdr.numSectors * SectorSize];
+	    conn->ReceiveAll(buffer, hdr.numSectors * SectorSize);
+	}
+	conn->Send((char *) &hdr.seq, sizeof(int));
+	if (hdr.numSectors == 0)
+	    break;
+
+	kernel->synchDisk->WriteSectors(hdr.firstSector, hdr.numSectors,
+					buffer);
+	delete [] buffer;
+	numRecords++;
+	numSectors += hdr.numSectors;
+    }
+    conn->Close();
+    cout << "Replica of " << primaryHost << ": " << numRecords
+	 << " writes, " << numSectors << " sectors\n";
+    done->V();
+}
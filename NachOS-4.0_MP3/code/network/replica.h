@@ -0,0 +1,124 @@
+// replica.h
+//	Data structures for mirroring every sector this machine writes to
+//	its disk onto the disk of another machine, a "backup", as it is
+//	written (-replica on this machine, -backup on the other).
+//
+//	The Replicator sits beneath the file system and the buffer cache:
+//	SynchDisk hands it each write request as it is queued, and it
+//	copies the sectors into a record and goes on, so the write goes to
+//	the local disk at once.  A thread of its own sends the records, in
+//	order, over a connection; the connection's window keeps many of
+//	them on their way at a time, so writes are not held up for a round
+//	trip each ("pipelining").  The backup acknowledges each record as
+//	soon as it has all of it, before it writes the sectors to its own
+//	disk, so the lag -- how long a record took to be acknowledged, from
+//	when it was queued -- counts the network and not the backup's disk.
+//
+//	When the primary halts, after the file system has written back
+//	everything it had, the replicator sends a record with no sectors,
+//	waits until every record is acknowledged, and prints what it sent
+//	and how long it took.  The backup then halts too -- without
+//	unmounting its own file system, whose superblock and free map it
+//	read at boot would be written over the primary's ones.
+//
+//	The two disks must start out the same, for the backup's to end up
+//	a copy of the primary's: formatting the primary (-f) with the
+//	backup running is enough.  Discarding the disk (Disk::Discard) is
+//	not a write, and is not mirrored.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef REPLICA_H
+#define REPLICA_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "list.h"
+#include "histogram.h"
+#include "synch.h"
+#include "transport.h"
+
+const int ReplicaBox = 10;	// the mailbox both ends of a replica
+				// connection use
+
+// The following class defines the header of a record: the sectors
+// written by one disk request, which follow it.
+
+class ReplicaHeader {
+  public:
+    int seq;			// number of this record, from 0
+    int firstSector;		// the first sector written
+    int numSectors;		// how many; 0 for the last record
+};
+
+// The following class defines a record the primary has yet to hear
+// back about.
+
+class ReplicaWrite {
+  public:
+    ReplicaHeader hdr;
+    char *data;			// the sectors, numSectors * SectorSize
+				// bytes; NULL if there are none
+    Ticks queued;		// when the write was queued
+};
+
+// The following class defines the primary's end.
+
+class Replicator {
+  public:
+    Replicator(NetworkAddress backup); // Mirror writes onto "backup"
+    ~Replicator();		// Wait for every record to be
+				// acknowledged, and print how it went
+
+    void Mirror(int firstSector, int numSectors, char *data);
+				// Sectors are being written to disk; may
+				// be called from an interrupt handler
+
+  private:
+    NetworkAddress backupHost;
+    Connection *conn;		// records go out, acks come in
+    List<ReplicaWrite *> *toSend; // queued, not sent yet
+    List<ReplicaWrite *> *inFlight; // sent, not acknowledged yet
+				// (both with interrupts off)
+    Semaphore *queued;		// V'ed for each record queued
+    Semaphore *drained;		// V'ed when the last record is acked
+    int nextSeq;		// number of the next record queued
+
+    int numRecords;		// records acknowledged
+    int numSectors;		// sectors in them
+    int maxInFlight;		// most records sent, not acknowledged
+    Ticks firstQueued;		// when the first record was queued
+    Ticks lastAcked;		// and the last one acknowledged
+    LogHistogram lagTicks;	// how long each record took, from being
+				// queued until it was acknowledged
+
+    void Queue(int firstSector, int numSectors, char *data);
+				// make a record and wake the sender
+    void Print();		// print what was sent, and the lag
+    static void Sender(void *data);
+    static void AckReceiver(void *data);
+};
+
+// The following class defines the backup's end.
+
+class ReplicaServer {
+  public:
+    ReplicaServer(NetworkAddress primary);
+				// Take writes from "primary", in a
+				// thread of its own
+    void WaitUntilDone();	// Wait until its last record is in
+
+  private:
+    NetworkAddress primaryHost;
+    Connection *conn;		// records come in, acks go out
+    Semaphore *done;		// V'ed once the last record is in
+    int numRecords;		// records written to disk
+    int numSectors;		// sectors in them
+
+    void Serve();		// take records until the last one
+    static void Server(void *data);
+};
+
+#endif // REPLICA_H
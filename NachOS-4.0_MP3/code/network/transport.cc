@@ -0,0 +1,523 @@
+// transport.cc
+//	Routines for a reliable, ordered byte stream between two
+//	machines: a sliding window of numbered segments, cumulative
+//	acks, and retransmission of only the segments that were lost
+//	(see transport.h).
+//
+//	Alarm cannot put a thread to sleep for a while yet, so the
+//	retransmission timer is an interrupt of the connection's own,
+//	scheduled like a device's; its handler only wakes up the
+//	retransmitter thread, which does the rest with the lock held.  The
+//	timer is scheduled as a poll: a machine that is only waiting for
+//	an ack then goes on polling the network, rather than skipping
+//	straight to the timeout, and finds the ack when it comes in.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "transport.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Connection::Connection
+// 	Initialize one end of a connection, and fork the threads that
+//	look after it.
+//
+//	"box" -- the mailbox segments come in to on this machine
+//	"farHost" -- the machine at the other end
+//	"farBox" -- the mailbox segments go to there
+//----------------------------------------------------------------------
+
+Connection::Connection(MailBoxAddress box, NetworkAddress farHost,
+		       MailBoxAddress farBox)
+{
+    Thread *t;
+    int i;
+
+    localBox = box;
+    remoteHost = farHost;
+    remoteBox = farBox;
+
+    lock = new Lock("connection lock");
+    windowOpen = new Condition("connection window");
+    dataAvailable = new Condition("connection data");
+    quiet = new Condition("connection quiet");
+
+    sendFirst = sendNext = 0;
+    dupAcks = 0;
+    recover = 0;
+    smoothedRtt = rttDeviation = 0;
+    timeout = InitialTimeout;
+    deadline = 0;
+
+    recvBuffer = new char[RecvBufferSize];
+    recvHead = recvCount = 0;
+    recvNext = 0;
+    for (i = 0; i < WindowSize; i++) {
+	held[i].length = -1;
+    }
+
+    lastHeard = kernel->stats->totalTicks;
+    closing = FALSE;
+    resendNow = FALSE;
+    timerArmed = FALSE;
+    wakeup = new Semaphore("connection retransmit", 0);
+
+    numSent = numResent = numAcks = 0;
+
+    t = new Thread("connection receiver", 1, SmallStackSize);
+    t->Fork(Connection::Receiver, this);
+    t = new Thread("connection retransmitter", 1, SmallStackSize);
+    t->Fork(Connection::Retransmitter, this);
+}
+
+//----------------------------------------------------------------------
+// Connection::Send
+// 	Cut "numBytes" bytes of "data" into segments and send them,
+//	waiting for room in the window whenever it is full.  Returns once
+//	the last one has been sent, not when it has been acknowledged
+//	(see Flush).
+//----------------------------------------------------------------------
+
+void
+Connection::Send(char *data, int numBytes)
+{
+    char segment[SegmentSize];
+    int seq, length;
+
+    while (numBytes > 0) {
+	length = min(numBytes, SegmentSize);
+
+	lock->Acquire();
+	while (sendNext - sendFirst == WindowSize) {
+	    windowOpen->Wait(lock);
+	}
+	seq = sendNext++;
+	window[seq % WindowSize].length = length;
+	bcopy(data, window[seq % WindowSize].data, length);
+	if (seq == sendFirst) {
+	    deadline = kernel->stats->totalTicks + timeout;
+	}
+	numSent++;
+	ArmTimer(timeout);
+	lock->Release();
+
+	bcopy(data, segment, length);	// the window slot may be reused
+					// once it is acked, even while
+					// we are still sending it
+	Transmit(seq, (int) kernel->stats->totalTicks, segment, length);
+	data += length;
+	numBytes -= length;
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::Receive
+// 	Wait until some bytes have come in, then copy out as many as
+//	there are, up to "numBytes", and return how many.
+//----------------------------------------------------------------------
+
+int
+Connection::Receive(char *data, int numBytes)
+{
+    int i, count;
+
+    lock->Acquire();
+    while (recvCount == 0) {
+	dataAvailable->Wait(lock);
+    }
+    count = min(numBytes, recvCount);
+    for (i = 0; i < count; i++) {
+	data[i] = recvBuffer[(recvHead + i) % RecvBufferSize];
+    }
+    recvHead = (recvHead + count) % RecvBufferSize;
+    recvCount -= count;
+    Deliver();				// there may be room for more now
+    lock->Release();
+    return count;
+}
+
+//----------------------------------------------------------------------
+// Connection::ReceiveAll
+// 	Receive exactly "numBytes" bytes, however many pieces they come
+//	in.
+//----------------------------------------------------------------------
+
+void
+Connection::ReceiveAll(char *data, int numBytes)
+{
+    int count;
+
+    while (numBytes > 0) {
+	count = Receive(data, numBytes);
+	data += count;
+	numBytes -= count;
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::Flush
+// 	Wait until every segment sent has been acknowledged.
+//----------------------------------------------------------------------
+
+void
+Connection::Flush()
+{
+    lock->Acquire();
+    while (sendFirst != sendNext) {
+	windowOpen->Wait(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Connection::Close
+// 	Wait until everything sent has been acknowledged, and then until
+//	nothing has come in for LingerTime.  If our last ack to the other
+//	end was lost, it resends, and the receiver thread acks again; so
+//	once the other end has gone quiet, it has everything it needs,
+//	and this machine can halt.
+//----------------------------------------------------------------------
+
+void
+Connection::Close()
+{
+    Flush();
+
+    lock->Acquire();
+    closing = TRUE;
+    ArmTimer(timeout);
+    while (closing) {
+	quiet->Wait(lock);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Connection::Print
+// 	Print how many segments this end has sent.
+//----------------------------------------------------------------------
+
+void
+Connection::Print()
+{
+    cout << "Connection to " << remoteHost << ", box " << remoteBox
+	 << ": " << numSent << " segments sent, " << numResent
+	 << " resent, " << numAcks << " acks, round trip " << smoothedRtt
+	 << " ticks, timeout " << timeout << "\n";
+}
+
+//----------------------------------------------------------------------
+// Connection::Transmit
+// 	Send one segment, acknowledging everything received so far.
+//
+//	"seq" -- the number of the segment, or -1 for a bare ack
+//	"stamp" -- when it is sent, or for a bare ack, the stamp to echo
+//	"data" -- its data
+//	"length" -- how many bytes of it there are
+//----------------------------------------------------------------------
+
+void
+Connection::Transmit(int seq, int stamp, char *data, int length)
+{
+    char buffer[MaxMailSize];
+    SegmentHeader segHdr;
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+
+    segHdr.seq = seq;
+    segHdr.ack = recvNext;
+    segHdr.stamp = stamp;
+    bcopy((char *)&segHdr, buffer, sizeof(SegmentHeader));
+    bcopy(data, buffer + sizeof(SegmentHeader), length);
+
+    pktHdr.to = remoteHost;
+    mailHdr.to = remoteBox;
+    mailHdr.from = localBox;
+    mailHdr.length = sizeof(SegmentHeader) + length;
+
+    DEBUG(dbgNet, "Segment " << seq << ", ack " << segHdr.ack << ", " << length << " bytes");
+    kernel->postOfficeOut->Send(pktHdr, mailHdr, buffer);
+}
+
+//----------------------------------------------------------------------
+// Connection::ArmTimer
+// 	Set the retransmission timer to go off "fromNow" ticks from now,
+//	unless it is already set; the retransmitter sets it again for
+//	what is left, if it goes off early.  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+Connection::ArmTimer(int fromNow)
+{
+    IntStatus oldLevel;
+
+    if (!timerArmed) {
+	timerArmed = TRUE;
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	kernel->interrupt->SchedulePoll(this, max(fromNow, 1), TimerInt);
+	(void) kernel->interrupt->SetLevel(oldLevel);
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::MeasureRtt
+// 	Take in how long a segment took to be acknowledged, and work out
+//	the retransmission timeout from it: the smoothed round trip time,
+//	plus four times its smoothed mean deviation (with gains of 1/8
+//	and 1/4, as in TCP).  The deviation is taken to be at least a
+//	quarter of the round trip, so the timeout is never less than two
+//	round trips: Nachos's clock runs at whatever speed the host lets
+//	it, and a round trip that was steady for a while can suddenly
+//	take much longer.  The lock must be held.
+//
+//	"sample" -- the round trip time, in ticks
+//----------------------------------------------------------------------
+
+void
+Connection::MeasureRtt(int sample)
+{
+    int error;
+
+    if (smoothedRtt == 0) {
+	smoothedRtt = sample;
+	rttDeviation = sample / 2;
+    } else {
+	error = sample - smoothedRtt;
+	smoothedRtt += error / 8;
+	rttDeviation += ((error < 0 ? -error : error) - rttDeviation) / 4;
+    }
+    ResetTimeout();
+}
+
+//----------------------------------------------------------------------
+// Connection::ResetTimeout
+// 	Work out the retransmission timeout from the round trip time
+//	measured.  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+Connection::ResetTimeout()
+{
+    timeout = smoothedRtt + 4 * max(rttDeviation, smoothedRtt / 4);
+    timeout = min(max(timeout, MinTimeout), MaxTimeout);
+}
+
+//----------------------------------------------------------------------
+// Connection::CallBack
+// 	Interrupt handler for the retransmission timer: wake up the
+//	retransmitter.
+//----------------------------------------------------------------------
+
+void
+Connection::CallBack()
+{
+    timerArmed = FALSE;
+    wakeup->V();
+}
+
+//----------------------------------------------------------------------
+// Connection::TakeAck
+// 	The other end has acknowledged every segment before "ack".  A
+//	bare ack also measures a round trip, by the stamp it echoes.  If
+//	the ack moves the window along, undo any doubling of the timeout.
+//	If the window is being repaired and is not all acknowledged yet,
+//	the next segment was lost too: the ones after it have come in, or
+//	the ack would have gone past them.  Otherwise count repeated acks,
+//	which say sendFirst was lost.  The lock must be held.
+//
+//	"ack" -- the next segment the other end expects
+//	"echo" -- for a bare ack, when the segment it answers was sent;
+//		-1 for a segment with data.  Only bare acks repeat an
+//		ack because something is missing
+//----------------------------------------------------------------------
+
+void
+Connection::TakeAck(int ack, int echo)
+{
+    if (echo != -1) {
+	MeasureRtt((int) ((unsigned int) lastHeard - (unsigned int) echo));
+    }
+    if (ack > sendFirst && ack <= sendNext) {
+	if (smoothedRtt > 0) {
+	    ResetTimeout();
+	}
+	sendFirst = ack;
+	dupAcks = 0;
+	deadline = lastHeard + timeout;
+	if (sendFirst < recover) {
+	    resendNow = TRUE;
+	    wakeup->V();
+	}
+	windowOpen->Broadcast(lock);
+    } else if (echo != -1 && ack == sendFirst && sendFirst != sendNext) {
+	if (++dupAcks == DupAckThreshold && sendFirst >= recover) {
+	    recover = sendNext;
+	    resendNow = TRUE;
+	    wakeup->V();
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::TakeData
+// 	Segment "seq" has come in.  Hold on to it, if it is in the window
+//	and not held already, then move whatever is next in order into
+//	the receive buffer.  The lock must be held.
+//
+//	Return TRUE if the segment should be answered with an ack: every
+//	one with data is, even one that came before (its ack may have
+//	been lost), so that one out of order repeats the last ack, and
+//	tells the other end a segment went missing.
+//
+//	"seq" -- the number of the segment, or -1 for a bare ack
+//	"data" -- its data
+//	"length" -- how many bytes of it there are
+//----------------------------------------------------------------------
+
+bool
+Connection::TakeData(int seq, char *data, int length)
+{
+    SegmentCopy *copy;
+
+    if (seq == -1) {
+	return FALSE;
+    }
+    if (seq >= recvNext && seq < recvNext + WindowSize) {
+	copy = &held[seq % WindowSize];
+	if (copy->length == -1) {
+	    copy->length = length;
+	    bcopy(data, copy->data, length);
+	}
+	Deliver();
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Connection::Deliver
+// 	Move the segments held that are next in order into the receive
+//	buffer, as long as there is room for them.  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+Connection::Deliver()
+{
+    SegmentCopy *copy = &held[recvNext % WindowSize];
+    int i;
+
+    while (copy->length != -1 && recvCount + copy->length <= RecvBufferSize) {
+	for (i = 0; i < copy->length; i++) {
+	    recvBuffer[(recvHead + recvCount + i) % RecvBufferSize] =
+							copy->data[i];
+	}
+	recvCount += copy->length;
+	copy->length = -1;
+	recvNext++;
+	dataAvailable->Broadcast(lock);
+	copy = &held[recvNext % WindowSize];
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::Receiver
+// 	Take in the segments that come in to the connection's mailbox,
+//	and answer the ones that need it.  A segment's data is taken
+//	straight from the packet it came in.
+//----------------------------------------------------------------------
+
+void
+Connection::Receiver(void *data)
+{
+    Connection *conn = (Connection *) data;
+    SegmentHeader segHdr;
+    Mail *mail;
+    int length;
+    bool answer;
+
+    for (;;) {
+	mail = kernel->postOfficeIn->ReceiveMail(conn->localBox, NoTimeout);
+	bcopy(mail->data, (char *)&segHdr, sizeof(SegmentHeader));
+	ASSERT(mail->pktHdr.from == conn->remoteHost);
+	length = mail->mailHdr.length - sizeof(SegmentHeader);
+
+	conn->lock->Acquire();
+	conn->lastHeard = kernel->stats->totalTicks;
+	conn->TakeAck(segHdr.ack, segHdr.seq == -1 ? segHdr.stamp : -1);
+	answer = conn->TakeData(segHdr.seq, mail->data + sizeof(SegmentHeader),
+				length);
+	if (answer) {
+	    conn->numAcks++;
+	}
+	conn->lock->Release();
+	kernel->postOfficeIn->Release(mail);
+
+	if (answer) {
+	    conn->Transmit(-1, segHdr.stamp, NULL, 0);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::Retransmitter
+// 	Resend the oldest segment not acknowledged yet, when it has timed
+//	out, or when the receiver thread has found it missing.  A timeout
+//	doubles the timeout, until a round trip is measured again, and
+//	starts a repair of the window, as the segments after it may have
+//	been lost too.  Also tell Close when the other end has gone quiet.
+//	The timer is kept armed while there is anything to wait for, and
+//	left alone otherwise, so that an idle connection takes no
+//	interrupts.
+//----------------------------------------------------------------------
+
+void
+Connection::Retransmitter(void *data)
+{
+    Connection *conn = (Connection *) data;
+    SegmentCopy copy;
+    int seq;
+    Ticks now;
+    bool resending;
+
+    for (;;) {
+	conn->wakeup->P();
+
+	conn->lock->Acquire();
+	now = kernel->stats->totalTicks;
+	resending = conn->resendNow;
+	conn->resendNow = FALSE;
+	if (!resending && conn->sendFirst != conn->sendNext
+				&& now >= conn->deadline) {
+	    resending = TRUE;			// timed out
+	    conn->timeout = min(2 * conn->timeout, MaxTimeout);
+	    conn->recover = conn->sendNext;
+	}
+	resending = resending && conn->sendFirst != conn->sendNext;
+	if (resending) {
+	    seq = conn->sendFirst;
+	    copy = conn->window[seq % WindowSize];
+	    conn->deadline = now + conn->timeout;
+	    conn->numResent++;
+	}
+	if (conn->sendFirst != conn->sendNext) {
+	    conn->ArmTimer((int) (conn->deadline - now));
+	}
+	if (conn->closing) {
+	    if (now - conn->lastHeard >= LingerTime) {
+		conn->closing = FALSE;
+		conn->quiet->Broadcast(conn->lock);
+	    } else {
+		conn->ArmTimer((int) (conn->lastHeard + LingerTime - now));
+	    }
+	}
+	conn->lock->Release();
+
+	if (resending) {
+	    DEBUG(dbgNet, "Resending segment " << seq);
+	    conn->Transmit(seq, (int) kernel->stats->totalTicks, copy.data,
+			   copy.length);
+	}
+    }
+}
@@ -0,0 +1,192 @@
+// transport.h
+//	Data structures for a reliable, ordered byte stream between two
+//	machines, on top of the post office.
+//
+//	The post office only delivers messages of up to MaxMailSize
+//	bytes, and the network can drop any of them.  A Connection
+//	joins a mailbox on this machine to one on another machine, and
+//	moves a stream of bytes between them: what is sent at one end is
+//	received at the other, all of it, once, and in order, however
+//	much the network loses.
+//
+//	The bytes are cut into numbered "segments", each sent as one
+//	message with a SegmentHeader in front.  Up to WindowSize segments
+//	can be on their way at a time ("sliding window"), so the sender
+//	does not wait for each one to be acknowledged before sending the
+//	next.  Every segment that arrives is answered with the number of
+//	the next segment the receiver is expecting ("cumulative ack"),
+//	carried in the header of a segment going the other way, or in
+//	one with no data.  A segment that arrives out of order means one
+//	before it was lost; the receiver holds on to it until the lost
+//	one comes in again, so only that one has to be resent.
+//
+//	The oldest segment not acknowledged is sent again if no ack has
+//	come in for a while (the "retransmission timeout"), or as soon as
+//	DupAckThreshold acks in a row repeat the same number, which the
+//	receiver only does when a segment went missing.  Until everything
+//	that was out when that happened is acknowledged, an ack that
+//	moves the window only part of the way says the next one is
+//	missing too, and has it resent at once.
+//
+//	The timeout follows the round trip time.  Each segment with data
+//	is stamped with when it was sent, and the ack answering it echoes
+//	the stamp back, so that every such ack measures a round trip, even
+//	for a segment sent more than once, or held by the receiver for a
+//	while.  The timeout is the average plus four times the mean
+//	deviation, as in TCP, and doubles each time it
+//	runs out, until an ack comes in.  Each Nachos machine keeps its
+//	own simulated time, and how long a round trip takes in it depends
+//	on how fast the other one is running, so a fixed timeout would be
+//	either far too short or far too long.
+//
+//	Each connection has two threads of its own: one takes what comes
+//	into its mailbox, the other does the retransmitting.  They run
+//	until Nachos halts, so a connection, like the post office, is
+//	never deleted.  Only one thread at a time should send on a
+//	connection, and only one receive from it.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include "post.h"
+#include "stats.h"
+
+// The following class defines the header in front of each segment.
+
+class SegmentHeader {
+  public:
+    int seq;			// number of this segment; -1 if it
+				// carries only an ack
+    int ack;			// next segment expected from the other end
+    int stamp;			// when a segment with data was sent, by
+				// the sender's clock (its low 32 bits);
+				// in a bare ack, that of the segment it
+				// answers
+};
+
+#define SegmentSize	((int) (MaxMailSize - sizeof(SegmentHeader)))
+				// most data in one segment
+
+const int WindowSize = 32;	// segments on their way at a time
+const int RecvBufferSize = 2 * WindowSize * SegmentSize;
+				// bytes received but not read yet
+const int InitialTimeout = 100 * NetworkTime;
+				// retransmission timeout before the
+				// first round trip is measured
+const int MinTimeout = 10 * NetworkTime;
+const int MaxTimeout = 1000 * NetworkTime;
+				// and the bounds on it
+const int DupAckThreshold = 2;	// repeated acks that mean a segment was
+				// lost
+const int LingerTime = 2 * MaxTimeout;
+				// how long Close waits to hear nothing
+				// more from the other end: our own
+				// timeout says nothing about its one
+
+// The following class defines a copy of a segment: kept by the sender
+// until it is acknowledged, or by the receiver until the ones before
+// it come in.
+
+class SegmentCopy {
+  public:
+    int length;			// bytes of data in it; -1 if the
+				// receiver has no segment here
+    char data[SegmentSize];
+};
+
+// The following class defines one end of a connection.
+
+class Connection : public CallBackObj {
+  public:
+    Connection(MailBoxAddress box, NetworkAddress farHost,
+	       MailBoxAddress farBox);
+				// Join mailbox "box" here to "farBox"
+				// on machine "farHost"; the other end
+				// makes the mirror image of it
+
+    void Send(char *data, int numBytes);
+				// Send "numBytes" bytes; returns once
+				// they all fit in the window
+    int Receive(char *data, int numBytes);
+				// Wait for at least one byte, and return
+				// how many, up to "numBytes"
+    void ReceiveAll(char *data, int numBytes);
+				// Wait for all "numBytes" bytes
+    void Flush();		// Wait until everything sent has
+				// been acknowledged
+    void Close();		// Flush, then wait until the other end
+				// has stopped sending, so it need not
+				// resend to a machine that halted
+
+    void CallBack();		// The retransmission timer went off
+
+    void Print();		// Print how much was sent and resent
+
+  private:
+    MailBoxAddress localBox;	// where segments come in
+    NetworkAddress remoteHost;	// and where they go
+    MailBoxAddress remoteBox;
+
+    Lock *lock;			// protects all of the following
+    Condition *windowOpen;	// an ack came in
+    Condition *dataAvailable;	// a segment came in
+    Condition *quiet;		// nothing came in for a while
+
+    SegmentCopy window[WindowSize]; // sent, not acknowledged yet;
+				// segment i is in window[i % WindowSize]
+    int sendFirst;		// first segment not acknowledged
+    int sendNext;		// next segment to send
+    int dupAcks;		// acks for sendFirst in a row
+    int recover;		// sendNext when a segment was last
+				// found missing; until it is acked, the
+				// window is being repaired
+    int smoothedRtt;		// average round trip time, in ticks;
+				// 0 until one is measured
+    int rttDeviation;		// and its mean deviation
+    int timeout;		// the retransmission timeout
+    Ticks deadline;		// when the oldest segment not acknowledged
+				// will have timed out
+
+    char *recvBuffer;		// a ring of bytes received, not read
+    int recvHead;		// where the next byte is read from
+    int recvCount;		// how many bytes there are
+    int recvNext;		// next segment expected
+    SegmentCopy held[WindowSize]; // segments after it that came in
+				// already, in the same way as window[]
+
+    Ticks lastHeard;		// when a segment last came in
+    bool closing;		// is Close waiting for quiet?
+    bool resendNow;		// must sendFirst be resent right away?
+    bool timerArmed;		// is the retransmission timer set?
+    Semaphore *wakeup;		// V'ed for the retransmitter
+
+    int numSent;		// segments sent with data
+    int numResent;		// of which sent again
+    int numAcks;		// segments sent with only an ack
+
+    void Transmit(int seq, int stamp, char *data, int length);
+				// send a segment, with the latest ack
+    void ArmTimer(int fromNow);	// set the retransmission timer, if
+				// it is not set already
+    void MeasureRtt(int sample); // take in a round trip time
+    void ResetTimeout();	// and set the timeout from it
+    void TakeAck(int ack, int echo);
+				// the other end expects "ack" next
+    bool TakeData(int seq, char *data, int length);
+				// segment "seq" came in; should it be
+				// answered?
+    void Deliver();		// move segments held into recvBuffer
+    static void Receiver(void *data);
+				// take in segments, send acks
+    static void Retransmitter(void *data);
+				// resend on a timeout or repeated acks
+};
+
+#endif // TRANSPORT_H
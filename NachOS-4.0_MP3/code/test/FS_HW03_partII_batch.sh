@@ -0,0 +1,11 @@
+# FS_HW03_partII_a.sh, with the commands run in one boot
+../build.linux/nachos -f
+../build.linux/nachos -batch - <<'END'
+-mkdir /t20000
+-mkdir /t30000
+-cp num_1000.txt /t20000/num_1000
+-cp num_12000.txt /t30000/num_12000
+-lr /
+-r /t30000/num_12000
+-lr /
+END
@@ -0,0 +1,41 @@
+/* FS_append.c
+ *	Benchmark of many small appends through the system calls, as a
+ *	log file gets them.  Prints the ticks they took.
+ */
+
+#include "syscall.h"
+
+#define NUM_APPENDS 500
+#define RECORD 16
+
+void Report(char *what, int ticks)
+{
+	int n = 0;
+
+	while (what[n] != '\0')
+		n++;
+	PrintString(what, n);
+	PrintInt(ticks);
+}
+
+int main(void)
+{
+	char record[RECORD];
+	OpenFileId fid;
+	int i, start;
+
+	for (i = 0; i < RECORD - 1; i++)
+		record[i] = 'a' + i;
+	record[RECORD - 1] = '\n';
+	if (Create("/appf", 0) != 1) MSG("Failed on creating file");
+	fid = Open("/appf");
+	if (fid <= 0) MSG("Failed on opening file");
+
+	start = GetTicks();
+	for (i = 0; i < NUM_APPENDS; i++)
+		if (Write(record, RECORD, fid) != RECORD) MSG("Failed on writing file");
+	Report("append ticks: ", GetTicks() - start);
+
+	Close(fid);
+	Exit(0);
+}
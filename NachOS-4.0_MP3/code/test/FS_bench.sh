@@ -0,0 +1,16 @@
+# FS_bench.sh
+# Run the user-level file system benchmarks (FS_seq, FS_append,
+# FS_churn, FS_mixed) on a freshly formatted disk
+../build.linux/nachos -f
+../build.linux/nachos -mkdir /c0
+../build.linux/nachos -mkdir /c1
+../build.linux/nachos -mkdir /c2
+../build.linux/nachos -mkdir /c3
+../build.linux/nachos -cp FS_seq /FS_seq
+../build.linux/nachos -e /FS_seq
+../build.linux/nachos -cp FS_append /FS_append
+../build.linux/nachos -e /FS_append
+../build.linux/nachos -cp FS_churn /FS_churn
+../build.linux/nachos -e /FS_churn
+../build.linux/nachos -cp FS_mixed /FS_mixed
+../build.linux/nachos -e /FS_mixed
@@ -0,0 +1,46 @@
+/* FS_churn.c
+ *	Benchmark of creating many small files, spread across the
+ *	directories /c0 to /c3 (which must already exist): each is
+ *	created, opened, written and closed.  Prints the ticks it took.
+ */
+
+#include "syscall.h"
+
+#define NUM_DIRS 4
+#define FILES_PER_DIR 16
+
+void Report(char *what, int ticks)
+{
+	int n = 0;
+
+	while (what[n] != '\0')
+		n++;
+	PrintString(what, n);
+	PrintInt(ticks);
+}
+
+int main(void)
+{
+	char name[8];		/* "/cD/fNN" */
+	char data[] = "churn\n";
+	OpenFileId fid;
+	int i, d, start;
+
+	name[0] = '/'; name[1] = 'c'; name[3] = '/'; name[4] = 'f';
+	name[7] = '\0';
+	start = GetTicks();
+	for (i = 0; i < FILES_PER_DIR; i++) {
+		for (d = 0; d < NUM_DIRS; d++) {
+			name[2] = '0' + d;
+			name[5] = '0' + i / 10;
+			name[6] = '0' + i % 10;
+			if (Create(name, 0) != 1) MSG("Failed on creating file");
+			fid = Open(name);
+			if (fid <= 0) MSG("Failed on opening file");
+			Write(data, 6, fid);
+			Close(fid);
+		}
+	}
+	Report("churn ticks: ", GetTicks() - start);
+	Exit(0);
+}
@@ -0,0 +1,18 @@
+# FS_dir_grow.sh
+# more files than a new directory has room for, in the root and in a
+# subdirectory; both directories have to grow.  A new directory is 10
+# sectors, about 110 records of names as short as these, so 130 files
+# overflow it; the files are 10 bytes, and each takes only its header
+# sector
+../build.linux/nachos -f
+../build.linux/nachos -mkdir /t0
+for i in $(seq 1 130)
+do
+    ../build.linux/nachos -cp num_1.txt /f$i
+    ../build.linux/nachos -cp num_1.txt /t0/f$i
+done
+../build.linux/nachos -stat /
+../build.linux/nachos -stat /t0
+../build.linux/nachos -lr /
+../build.linux/nachos -p /f130
+../build.linux/nachos -p /t0/f1
@@ -0,0 +1,55 @@
+/* FS_mixed.c
+ *	Benchmark of NUM_PROCS processes reading and writing files at the
+ *	same time: the program forks copies of itself, and each writes a
+ *	file of its own, then goes over it reading one chunk and
+ *	rewriting the next.  Each prints the ticks it took.
+ */
+
+#include "syscall.h"
+
+#define NUM_PROCS 4
+#define CHUNK 128
+#define NUM_CHUNKS 32		/* a 4K file each */
+
+char buffer[CHUNK];
+
+void Report(char *what, int ticks)
+{
+	int n = 0;
+
+	while (what[n] != '\0')
+		n++;
+	PrintString(what, n);
+	PrintInt(ticks);
+}
+
+int main(void)
+{
+	char name[] = "/mix0";
+	OpenFileId fid;
+	int me, i, start;
+
+	for (me = 1; me < NUM_PROCS; me++)
+		if (Fork() == 0)
+			break;
+	if (me == NUM_PROCS)
+		me = 0;			/* the original */
+	name[4] = '0' + me;
+	for (i = 0; i < CHUNK; i++)
+		buffer[i] = 'a' + me;
+
+	start = GetTicks();
+	if (Create(name, 0) != 1) MSG("Failed on creating file");
+	fid = Open(name);
+	if (fid <= 0) MSG("Failed on opening file");
+	for (i = 0; i < NUM_CHUNKS; i++)
+		Write(buffer, CHUNK, fid);
+	for (i = 0; i + 1 < NUM_CHUNKS; i += 2) {
+		Seek(i * CHUNK, fid);
+		Read(buffer, CHUNK, fid);
+		Write(buffer, CHUNK, fid);
+	}
+	Close(fid);
+	Report("mixed ticks: ", GetTicks() - start);
+	Exit(0);
+}
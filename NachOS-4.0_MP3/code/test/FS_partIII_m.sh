@@ -0,0 +1,11 @@
+../build.linux/nachos -f
+../build.linux/nachos -cpm FS_partIII.manifest
+../build.linux/nachos -l /
+echo "========================================="
+../build.linux/nachos -l /t0
+echo "========================================="
+../build.linux/nachos -l /t0/bb
+echo "========================================="
+../build.linux/nachos -p /t0/f1
+echo "========================================="
+../build.linux/nachos -p /t0/bb/f3
@@ -0,0 +1,56 @@
+/* FS_seq.c
+ *	Benchmark of reading a file through the system calls: write a
+ *	file, then read it back in order, then every STRIDE'th chunk
+ *	(using Seek).  Prints the ticks each part took.
+ */
+
+#include "syscall.h"
+
+#define CHUNK 128
+#define NUM_CHUNKS 128		/* a 16K file */
+#define STRIDE 4
+
+char buffer[CHUNK];
+
+void Report(char *what, int ticks)
+{
+	int n = 0;
+
+	while (what[n] != '\0')
+		n++;
+	PrintString(what, n);
+	PrintInt(ticks);
+}
+
+int main(void)
+{
+	OpenFileId fid;
+	int i, start;
+
+	for (i = 0; i < CHUNK; i++)
+		buffer[i] = 'a' + i % 26;
+	if (Create("/seqf", 0) != 1) MSG("Failed on creating file");
+	fid = Open("/seqf");
+	if (fid <= 0) MSG("Failed on opening file");
+
+	start = GetTicks();
+	for (i = 0; i < NUM_CHUNKS; i++)
+		if (Write(buffer, CHUNK, fid) != CHUNK) MSG("Failed on writing file");
+	Report("seq write ticks: ", GetTicks() - start);
+
+	start = GetTicks();
+	Seek(0, fid);
+	for (i = 0; i < NUM_CHUNKS; i++)
+		if (Read(buffer, CHUNK, fid) != CHUNK) MSG("Failed on reading file");
+	Report("seq read ticks: ", GetTicks() - start);
+
+	start = GetTicks();
+	for (i = 0; i < NUM_CHUNKS; i += STRIDE) {
+		Seek(i * CHUNK, fid);
+		if (Read(buffer, CHUNK, fid) != CHUNK) MSG("Failed on reading file");
+	}
+	Report("strided read ticks: ", GetTicks() - start);
+
+	Close(fid);
+	Exit(0);
+}
@@ -0,0 +1,40 @@
+/* intstress.c
+ *    Test program that keeps the integer units busy, and little else:
+ *    a mix of adds, shifts, logic, multiplies, divides and branches,
+ *    on values that all stay in registers.
+ *
+ *    Intention is to measure how fast the simulator interprets
+ *    instructions (see mips.py), with as few memory accesses as there
+ *    can be.
+ */
+
+#include "syscall.h"
+
+#define ROUNDS (20000)
+
+int
+main()
+{
+    int i, x, y, steps;
+    unsigned int hash;
+
+    hash = 2166136261u;
+    steps = 0;
+    for (i = 1; i <= ROUNDS; i++) {
+	hash = (hash ^ i) * 16777619u;		/* FNV-1a, a word at a time */
+	hash ^= hash >> 13;
+	x = i;
+	while (x != 1 && steps < 64 * ROUNDS) {	/* a few steps of Collatz */
+	    if (x & 1)
+		x = 3 * x + 1;
+	    else
+		x = x >> 1;
+	    steps++;
+	    if ((steps & 7) == 0)
+		break;
+	}
+	y = (int) (hash % 1009) + (i / 7) - (x << 2);
+	hash += y;
+    }
+    Exit(hash & 0x7fffffff);
+}
@@ -0,0 +1,45 @@
+/* memstress.c
+ *    Test program that keeps loads and stores busy: it walks an array
+ *    in order, then a word in every few, then in a scattered order,
+ *    adding up what it reads and writing back what it made of it.
+ *
+ *    Intention is to measure how fast the simulator translates and
+ *    makes user memory accesses (see mips.py); the array is small
+ *    enough to stay in memory, so the paging system is not what is
+ *    measured.
+ */
+
+#include "syscall.h"
+
+#define SIZE (4096)		/* words; 16KB, 128 pages */
+#define PASSES (4)
+
+int A[SIZE];
+
+int
+main()
+{
+    int i, pass, stride, next, sum;
+
+    for (i = 0; i < SIZE; i++)		/* in order */
+	A[i] = i;
+
+    sum = 0;
+    for (pass = 0; pass < PASSES; pass++) {
+	for (i = 0; i < SIZE; i++) {
+	    sum += A[i];
+	    A[i] = sum;
+	}
+	for (stride = 2; stride <= 64; stride *= 2) {	/* by strides */
+	    for (i = 0; i < SIZE; i += stride)
+		sum ^= A[i];
+	}
+	next = 0;			/* scattered: next * 5 + 1 */
+	for (i = 0; i < SIZE; i++) {	/* visits every word once, */
+	    sum += A[next];		/* out of order */
+	    A[next] = sum;
+	    next = (next * 5 + 1) & (SIZE - 1);
+	}
+    }
+    Exit(sum & 0x7fffffff);
+}
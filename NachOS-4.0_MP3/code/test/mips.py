@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# mips.py
+#	Measure how fast the simulator interprets user programs: run each
+#	of a fixed set of them, on a freshly formatted disk of its own,
+#	and report the instructions it ran, the host seconds it took, and
+#	the simulated instructions per host second, from the Interpreter
+#	line Nachos prints with -stats (see machine/stats.cc).
+#
+#	    program  instructions  seconds  MIPS
+#
+#	Usage: mips.py [-n runs] [-json file] [program...]
+#	Each program is run "runs" times (3 by default), and the fastest
+#	run is kept, so that a busy host only makes a run slower.  The
+#	programs are matmult, sort, intstress and memstress, unless others
+#	are named; they must have been made (make in this directory, with
+#	the cross compiler).  With -json, the results also go to "file",
+#	as a JSON array, for comparing runs of different versions.
+
+import json
+import os
+import re
+import subprocess
+import sys
+
+NACHOS = "../build.linux/nachos"
+PROGRAMS = ["matmult", "sort", "intstress", "memstress"]
+LINE = re.compile(r"Interpreter: instructions (\d+), host seconds ([\d.e+-]+)")
+
+
+def run(program):
+    """Run "program" once; return (instructions, host seconds), or None
+    if Nachos did not say."""
+    disk = "DISK_mips_" + program
+    base = [NACHOS, "-disk", disk]
+    try:
+        subprocess.run(base + ["-f", "-cp", program, "/" + program],
+                       stdout=subprocess.DEVNULL, check=True)
+        out = subprocess.run(base + ["-stats", "-e", "/" + program],
+                             stdout=subprocess.PIPE).stdout.decode("utf-8", "replace")
+    finally:
+        if os.path.exists(disk):
+            os.remove(disk)
+    found = LINE.search(out)
+    if found is None:
+        return None
+    return int(found.group(1)), float(found.group(2))
+
+
+def measure(programs, runs):
+    results = []
+    for program in programs:
+        best = None
+        for _ in range(runs):
+            got = run(program)
+            if got is not None and (best is None or got[1] < best[1]):
+                best = got
+        if best is None:
+            print("{:<12} did not run".format(program))
+            continue
+        instructions, seconds = best
+        mips = instructions / seconds / 1e6 if seconds > 0 else 0.0
+        results.append({"program": program, "instructions": instructions,
+                        "hostSeconds": seconds, "mips": mips})
+        print("{:<12} {:>12} {:>8.3f} s {:>8.2f} MIPS".format(
+            program, instructions, seconds, mips))
+    return results
+
+
+if __name__ == "__main__":
+    args = sys.argv[1:]
+    runs, jsonFile = 3, None
+    while args and args[0].startswith("-"):
+        if args[0] == "-n" and len(args) > 1:
+            runs = int(args[1])
+        elif args[0] == "-json" and len(args) > 1:
+            jsonFile = args[1]
+        else:
+            sys.exit("usage: mips.py [-n runs] [-json file] [program...]")
+        args = args[2:]
+    results = measure(args or PROGRAMS, runs)
+    if jsonFile is not None:
+        with open(jsonFile, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
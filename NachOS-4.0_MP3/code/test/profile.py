@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# profile.py
+#	Summarize the PC profile Nachos writes when run with -prof <file>
+#	(see userprog/profiler.h), by function, the busiest first:
+#
+#	    samples percent function
+#
+#	Usage: profile.py <file> <program.coff> [program]
+#	The functions are found in the symbol table of the .coff the
+#	program was made from (before coff2noff).  Only the profiles of
+#	programs whose name ends in "program" are summed, if it is given.
+
+import struct
+import sys
+
+FILEHDR = struct.Struct("<HHiiiHH")	# f_magic ... f_flags
+HDRR = struct.Struct("<hh23i")		# the symbolic header, at f_symptr
+FDR = struct.Struct("<10iHh4i4x2i")	# a file descriptor, 72 bytes
+SYMR = struct.Struct("<iiI")		# a local symbol
+EXTR = struct.Struct("<hhiiI")		# an external symbol
+
+ST_PROC, ST_STATICPROC = 6, 14		# symbol types of functions
+
+
+def functions(path):
+    """The functions of the .coff at "path", as sorted (address, name)."""
+    with open(path, "rb") as f:
+        data = f.read()
+    symptr = FILEHDR.unpack_from(data, 0)[3]
+    h = HDRR.unpack_from(data, symptr)
+    (isymMax, cbSymOffset, issMax, cbSsOffset, issExtMax, cbSsExtOffset,
+     ifdMax, cbFdOffset) = (h[9], h[10], h[15], h[16], h[17], h[18],
+                            h[19], h[20])
+    iextMax, cbExtOffset = h[23], h[24]
+
+    def name(offset):
+        return data[offset:data.index(b"\0", offset)].decode()
+
+    found = {}
+    for i in range(iextMax):
+        _, _, iss, value, bits = EXTR.unpack_from(data, cbExtOffset + 16 * i)
+        if bits & 0x3f in (ST_PROC, ST_STATICPROC):
+            found[value] = name(cbSsExtOffset + iss)
+    for i in range(ifdMax):
+        fd = FDR.unpack_from(data, cbFdOffset + FDR.size * i)
+        issBase, isymBase, csym = fd[2], fd[4], fd[5]
+        for j in range(isymBase, isymBase + csym):
+            iss, value, bits = SYMR.unpack_from(data, cbSymOffset + 12 * j)
+            if bits & 0x3f in (ST_PROC, ST_STATICPROC):
+                found.setdefault(value, name(cbSsOffset + issBase + iss))
+    return sorted(found.items())
+
+
+def samples(path, program):
+    """The PC samples in the profile at "path", summed over the runs
+    of "program" (all, if None), and how many there were in all."""
+    counts, total, keep = {}, 0, False
+    with open(path) as f:
+        for line in f:
+            words = line.split()
+            if words[0] == "program":
+                keep = program is None or words[1].endswith(program)
+                if keep:
+                    total += int(words[3])
+            elif words[0] != "end" and keep:
+                pc = int(words[0], 16)
+                counts[pc] = counts.get(pc, 0) + int(words[1])
+    return counts, total
+
+
+def summarize(profile, coff, program):
+    funcs = functions(coff)
+    counts, total = samples(profile, program)
+    byFunc = {}
+    for pc, n in counts.items():
+        where = "?"
+        for start, fname in funcs:	# the last one starting at or before
+            if start > pc:
+                break
+            where = fname
+        byFunc[where] = byFunc.get(where, 0) + n
+    print("# {} samples".format(total))
+    for where, n in sorted(byFunc.items(), key=lambda x: -x[1]):
+        print("{:>8} {:>6.1f}% {}".format(n, 100.0 * n / max(total, 1), where))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        sys.exit("usage: profile.py <file> <program.coff> [program]")
+    summarize(sys.argv[1], sys.argv[2],
+              sys.argv[3] if len(sys.argv) > 3 else None)
@@ -4,7 +4,6 @@ int
 main()
 {
     SpaceId newProc;
-    OpenFileId input = ConsoleInput;
     OpenFileId output = ConsoleOutput;
     char prompt[2], ch, buffer[60];
     int i;
@@ -16,15 +15,12 @@ main()
     {
 	Write(prompt, 2, output);
 
-	i = 0;
-	
-	do {
-	
-	    Read(&buffer[i], 1, input); 
-
-	} while( buffer[i++] != '\n' );
-
-	buffer[--i] = '\0';
+	i = ReadConsole(buffer, sizeof(buffer) - 1);
+	if (i <= 0)
+	    Halt();
+	if (buffer[i - 1] == '\n')
+	    i--;
+	buffer[i] = '\0';
 
 	if( i > 0 ) {
 		newProc = Exec(buffer);
@@ -1,9 +1,27 @@
+import json
+
+
+# read the counters every nachos of a case appended with -sj, one JSON
+# object per line, and add them up
+def read_Stats(path):
+    total = {}
+    with open(path, 'r') as f:
+        for line in f:
+            if line.strip():
+                for name, value in json.loads(line).items():
+                    total[name] = total.get(name, 0) + value
+    return total
+
+
 class Summary:
     def __init__(self):
         self.right = 0          # right score
         self.total = 0          # total score
         self.pass_test = 0      # amount of test cases
         self.fail_list = []
+        self.times = []         # (seconds, case) for each case run
+        self.regressions = []   # (case, what) for each budget exceeded
+        self.measured = {}      # case -> counters, for a new baseline
         self.W = '\033[0m'      # white (normal)
         self.R = '\033[31m'     # red
         self.G = '\033[32m'     # green
@@ -17,6 +35,39 @@ class Summary:
         self.right += score
         self.pass_test += 1
 
+    # hold a case's counters to the most it may use: a budget of its
+    # own, {"numDiskReads": 1200, "hostSeconds": 5, ...}, and what it
+    # used in the baseline, give or take "tolerance" (0.1 for 10%);
+    # host seconds are too noisy to hold to a baseline, only to a
+    # budget; return whether it kept to them all
+    def check_Perf(self, case, stats, budget, baseline, tolerance):
+        self.measured[case] = stats
+        limits = []
+        for name, most in (budget or {}).items():
+            limits.append((name, most, "budget"))
+        for name, used in (baseline or {}).items():
+            if name != "hostSeconds":
+                limits.append((name, used * (1 + tolerance), "baseline " + str(used)))
+        ok = True
+        for name, most, why in limits:
+            if name not in stats:
+                self.regressions.append((case, "{} not measured".format(name)))
+                ok = False
+            elif stats[name] > most:
+                self.regressions.append((case, "{} {} > {:g} ({})".format(
+                    name, stats[name], most, why)))
+                ok = False
+        return ok
+
+    def print_Regressions(self):
+        for case, what in self.regressions:
+            print("{}[  SLOWER  ]{}".format(self.R, self.W), case + ":", what)
+
+    def write_Baseline(self, path):
+        with open(path, 'w') as f:
+            json.dump(self.measured, f, indent=4, sort_keys=True)
+            f.write("\n")
+
     def print_Fail(self):
         for case in self.fail_list:
             print("{}[  FAILED  ]{}".format(self.R, self.W), case)
@@ -34,4 +85,24 @@ class Summary:
 
             self.print_Fail()
 
+        if len(self.regressions) > 0:
+            print("{}[  SLOWER  ]{}".format(self.R, self.W), len(self.regressions), "budget", end='')
+            if len(self.regressions) > 1:
+                print("s", end='')
+            print(" exceeded, listed below:")
+
+            self.print_Regressions()
+
         print("Points: ", self.right, "/", self.total)
+
+    def addTime(self, case, seconds):
+        self.times.append((seconds, case))
+
+    def print_Timing(self, wall):
+        total = 0.0
+        for seconds, case in self.times:
+            total += seconds
+        print("Time: {:.2f} s for {} cases, {:.2f} s wall".format(total, len(self.times), wall))
+        self.times.sort(reverse=True)
+        for seconds, case in self.times[:3]:
+            print("    {:8.2f} s  {}".format(seconds, case))
@@ -1,6 +1,9 @@
+import os
 import sys
 import json
+import time
 import subprocess
+import concurrent.futures
 import summary
 
 W = '\033[0m'  # white (normal)
@@ -15,11 +18,38 @@ def print_dash():
     print()
 
 
+NACHOS = "../build.linux/nachos"
+
+
 # get output from command
 def get_Output(command):
     return subprocess.run(command, shell=True, stdout=subprocess.PIPE).stdout.decode('utf-8')
 
 
+# run a case with a disk of its own, so that cases can run side by side:
+# every nachos in its command (or in the script it runs) gets -disk,
+# and -sj, so that what they all used can be added up
+def run_Isolated(case):
+    disk = "DISK_" + case['case_name']
+    statsFile = "STATS_" + case['case_name']
+    command = case['command']
+    if command.startswith("./") and command.endswith(".sh") and os.path.exists(command):
+        command = open(command, 'r').read()
+    command = command.replace(NACHOS, NACHOS + " -disk " + disk + " -sj " + statsFile)
+    if os.path.exists(statsFile):
+        os.remove(statsFile)
+    start = time.monotonic()
+    output = subprocess.run(["bash", "-c", command], stdout=subprocess.PIPE).stdout.decode('utf-8')
+    elapsed = time.monotonic() - start
+    if os.path.exists(disk):
+        os.remove(disk)
+    stats = {}
+    if os.path.exists(statsFile):
+        stats = summary.read_Stats(statsFile)
+        os.remove(statsFile)
+    return output, elapsed, stats
+
+
 def compare(stu_output, answer):
     alphanumeric = ""
     for character in stu_output:
@@ -71,22 +101,33 @@ def print_diff(stu_output, answer):
     print_dash()
 
 
-def test_case(file_name):
+# a case may also have a "budget", the most of each counter -sj writes
+# (and "hostSeconds") it may use; and with a baseline file, from -record,
+# it may not use more than the baseline did, give or take "tolerance"
+def test_case(file_name, jobs, baseline_name, record_name, tolerance):
     sum = summary.Summary()
+    start = time.monotonic()
     with open(file_name, "r") as f:
         json_object = json.load(f)
-        for case in json_object:
+    baseline = {}
+    if baseline_name is not None:
+        with open(baseline_name, "r") as f:
+            baseline = json.load(f)
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as pool:
+        results = pool.map(run_Isolated, json_object)
+        # the results come back in order, each as soon as it is done
+        for case, (students_output, elapsed, stats) in zip(json_object, results):
             print("{}[ RUN      ]{}".format(G, W), case['case_name'])
-
-            command = case['command']
-            print(command)
-            students_output = get_Output(command)
+            print(case['command'])
             if case['isfile']:
                 answer = open(case['answer'], 'r').read()
             else:
                 answer = case['answer']
 
             correct = compare(students_output, answer)
+            if not sum.check_Perf(case['case_name'], stats, case.get('budget'),
+                                  baseline.get(case['case_name']), tolerance):
+                correct = False
 
             if correct:
                 print("{}[       OK ] {}".format(G, W), end='')
@@ -94,18 +135,47 @@ def test_case(file_name):
             else:
                 print("{}[  FAILED  ] {}".format(R, W), end='')
                 sum.addScore_Fail(case['score'], case['case_name'])
-            print(case['case_name'])
-            # print(output)
+            print(case['case_name'], "({:.2f} s)".format(elapsed))
+            sum.addTime(case['case_name'], elapsed)
 
     sum.print_Summary()
-
-
+    sum.print_Timing(time.monotonic() - start)
+    if record_name is not None:
+        sum.write_Baseline(record_name)
+    return len(sum.fail_list) == 0
+
+
+# usage: python3 test_case.py test_case.json [-j jobs] [-baseline file]
+#            [-tolerance percent] [-record file]
+# runs up to "jobs" cases at once, by default one per CPU; holds each
+# case to what it used in the baseline file, plus "percent" (10 by
+# default); and writes what each one used to the record file, to be
+# the next baseline.  Exits with 1 if any case failed, or used too much.
 def main():
     if len(sys.argv) <= 1:
         print("no test case file")
         return 0
-    test_case(sys.argv[1])
+    jobs = os.cpu_count() or 1
+    baseline_name = None
+    record_name = None
+    tolerance = 0.1
+    args = sys.argv[2:]
+    while len(args) >= 2:
+        if args[0] == "-j":
+            jobs = max(1, int(args[1]))
+        elif args[0] == "-baseline":
+            baseline_name = args[1]
+        elif args[0] == "-record":
+            record_name = args[1]
+        elif args[0] == "-tolerance":
+            tolerance = float(args[1]) / 100
+        else:
+            break
+        args = args[2:]
+    if not test_case(sys.argv[1], jobs, baseline_name, record_name, tolerance):
+        return 1
+    return 0
 
 
 if __name__ == "__main__":
-    main()
+    sys.exit(main())
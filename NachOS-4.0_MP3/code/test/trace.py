@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+# trace.py
+#	Decode the event trace Nachos writes at halt when run with
+#	-tr <file> (see threads/tracer.h), one event per line:
+#
+#	    ticks thread event detail...
+#
+#	Usage: trace.py <file> [event...]
+#	Only the events named are printed, if any are given.
+
+import struct
+import sys
+
+# the TraceEvent enum, in order, and what its two words of detail are
+EVENTS = [
+    ("DiskRead", "sector", "count"),
+    ("DiskWrite", "sector", "count"),
+    ("Syscall", "code", "r4"),
+    ("Switch", "to", "finishing"),
+    ("SemaphoreP", "sem", "waited"),
+    ("SemaphoreV", "sem", "woke"),
+    ("LockAcquire", "lock", "waited"),
+    ("LockRelease", "lock", "held"),
+    ("ConditionWait", "cond", "waited"),
+    ("ConditionSignal", "cond", "woke"),
+]
+
+# the first word of these identifies an object; print it in hex
+OBJECTS = ("sem", "lock", "cond")
+
+HEADER = struct.Struct("=4sii")
+RECORD = struct.Struct("=qhhiii")
+
+
+def decode(path, wanted):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, count, lost = HEADER.unpack_from(data, 0)
+    if magic != b"NTRC":
+        sys.exit("{}: not a Nachos trace".format(path))
+    if lost > 0:
+        print("# {} older events were overwritten".format(lost))
+    for i in range(count):
+        ticks, event, thread, a0, a1, _ = RECORD.unpack_from(
+            data, HEADER.size + i * RECORD.size)
+        if event < len(EVENTS):
+            name, n0, n1 = EVENTS[event]
+        else:
+            name, n0, n1 = "Event{}".format(event), "arg0", "arg1"
+        if wanted and name not in wanted:
+            continue
+        v0 = "{:#x}".format(a0 & 0xffffffff) if n0 in OBJECTS else a0
+        print("{:>10} {:>3} {:<15} {}={} {}={}".format(
+            ticks, thread, name, n0, v0, n1, a1))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: trace.py <file> [event...]")
+    decode(sys.argv[1], set(sys.argv[2:]))
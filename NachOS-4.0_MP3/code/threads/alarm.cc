@@ -1,6 +1,7 @@
 // alarm.cc
 //	Routines to use a hardware timer device to provide a
-//	software alarm clock.  For now, we just provide time-slicing.
+//	software alarm clock: time-slicing, timed wakeups of semaphores,
+//	and sleeping threads.
 //
 //	Not completely implemented.
 //
@@ -11,6 +12,7 @@
 #include "copyright.h"
 #include "alarm.h"
 #include "main.h"
+#include "synch.h"
 
 //----------------------------------------------------------------------
 // Alarm::Alarm
@@ -18,11 +20,238 @@
 //
 //      "doRandom" -- if true, arrange for the hardware interrupts to 
 //		occur at random, instead of fixed, intervals.
+//	"tickless" -- if true, the timer only goes off when the running
+//		thread's quantum is up and another thread is ready;
+//		"doRandom" is then ignored.
 //----------------------------------------------------------------------
 
-Alarm::Alarm(bool doRandom)
+Alarm::Alarm(bool doRandom, bool tickless)
 {
-    timer = new Timer(doRandom, this);
+    oneShot = tickless;
+    if (oneShot) {
+	timer = new Timer(this);
+    } else {
+	timer = new Timer(doRandom, this);
+    }
+    wheel = new TimerWheel;
+}
+
+//----------------------------------------------------------------------
+// Alarm::WaitUntil
+//	Put the current thread to sleep for "x" ticks: it is woken up by
+//	the timer wheel at the first turn at or after now + x.  A thread
+//	that asks to sleep no time at all only yields.
+//----------------------------------------------------------------------
+
+void
+Alarm::WaitUntil(int x)
+{
+    Sleeper sleeper;
+    IntStatus oldLevel;
+
+    if (x <= 0) {
+	kernel->currentThread->Yield();
+	return;
+    }
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    sleeper.thread = kernel->currentThread;
+    sleeper.when = kernel->stats->totalTicks + x;
+    DEBUG(dbgThread, "Sleeping until " << sleeper.when << ": " << sleeper.thread->getName());
+    wheel->Add(&sleeper);
+    kernel->currentThread->Sleep(FALSE);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::TimerWheel
+//	Initialize a timer wheel with no sleepers; it does not turn until
+//	it has one.
+//----------------------------------------------------------------------
+
+TimerWheel::TimerWheel()
+{
+    for (int i = 0; i < WheelSlots; i++) {
+	slots[i] = new List<Sleeper *>;
+    }
+    nextTick = 0;
+    numSleepers = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+    for (int i = 0; i < WheelSlots; i++) {
+	delete slots[i];
+    }
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Add
+//	Put "sleeper" in the slot of the first tick at or after its time
+//	to wake up, starting the wheel if it had nobody else.  Called
+//	with interrupts disabled; "sleeper" must stay around until its
+//	thread is woken.
+//----------------------------------------------------------------------
+
+void
+TimerWheel::Add(Sleeper *sleeper)
+{
+    Ticks tick = divRoundUp(sleeper->when, WheelTick);
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (numSleepers == 0) {
+	nextTick = divRoundUp(kernel->stats->totalTicks + 1, WheelTick);
+	Turn();
+    }
+    tick = max(tick, nextTick);
+    slots[tick % WheelSlots]->Append(sleeper);
+    numSleepers++;
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::Turn
+//	Schedule the wheel's interrupt for "nextTick", or right away if
+//	that has gone by already -- the last one came late.
+//----------------------------------------------------------------------
+
+void
+TimerWheel::Turn()
+{
+    Ticks delay = nextTick * WheelTick - kernel->stats->totalTicks;
+
+    kernel->interrupt->Schedule(this, (int) max(delay, (Ticks) 1), TimerInt);
+}
+
+//----------------------------------------------------------------------
+// TimerWheel::CallBack
+//	Interrupt handler for a turn of the wheel: wake up the sleepers
+//	of the slot for "nextTick" whose time has come, and leave the
+//	others, who sleep for more turns.  Then go on to the next tick,
+//	if anyone sleeps still.  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+TimerWheel::CallBack()
+{
+    List<Sleeper *> *slot = slots[nextTick % WheelSlots];
+    Ticks now = kernel->stats->totalTicks;
+
+    for (int n = slot->NumInList(); n > 0; n--) {
+	Sleeper *sleeper = slot->RemoveFront();
+
+	if (sleeper->when <= now) {
+	    kernel->scheduler->ReadyToRun(sleeper->thread);
+	    numSleepers--;
+	} else {
+	    slot->Append(sleeper);
+	}
+    }
+    nextTick++;
+    if (numSleepers > 0) {
+	Turn();
+    }
+}
+
+//----------------------------------------------------------------------
+// Wakeup::Wakeup
+//	Initialize a timed wakeup for the semaphore "s".
+//----------------------------------------------------------------------
+
+Wakeup::Wakeup(Semaphore *s)
+{
+    semaphore = s;
+    cancelled = FALSE;
+    fired = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Wakeup::CallBack
+//	Interrupt handler for a timed wakeup: V its semaphore, unless it
+//	has been cancelled, in which case it is only waiting to be
+//	deleted.  Called with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Wakeup::CallBack()
+{
+    if (cancelled) {
+	delete this;
+	return;
+    }
+    fired = TRUE;
+    semaphore->V();
+}
+
+//----------------------------------------------------------------------
+// Alarm::SetWakeup
+//	Arrange for "s" to be V'ed "delay" ticks from now, or not long
+//	after (see alarm.h).  The wakeup can be cancelled until then,
+//	and must be afterwards (see CancelWakeup).
+//----------------------------------------------------------------------
+
+Wakeup *
+Alarm::SetWakeup(Semaphore *s, int delay)
+{
+    Wakeup *w = new Wakeup(s);
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    kernel->interrupt->SchedulePoll(w, max(delay, 1), TimerInt);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return w;
+}
+
+//----------------------------------------------------------------------
+// Alarm::CancelWakeup
+//	The thread that set the wakeup "w" no longer needs it; its
+//	semaphore may now be deleted.  If it has gone off already it is
+//	deleted now, or else when it does.
+//----------------------------------------------------------------------
+
+void
+Alarm::CancelWakeup(Wakeup *w)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (w->fired) {
+	delete w;
+    } else {
+	w->cancelled = TRUE;
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Alarm::ThreadReady
+//	A thread has been put on the ready list.  If the timer is
+//	tickless and not armed -- nothing was ready before -- the running
+//	thread's quantum starts now.
+//----------------------------------------------------------------------
+
+void
+Alarm::ThreadReady()
+{
+    if (oneShot && !timer->IsArmed()) {
+	timer->Arm(kernel->currentThread->quantum);
+    }
+}
+
+//----------------------------------------------------------------------
+// Alarm::Rearm
+//	"running" is being given the CPU, or keeps it after a time slice.
+//	If the timer is tickless, arm it for "running"'s whole quantum if
+//	there is another thread to switch to, and disarm it if not.
+//----------------------------------------------------------------------
+
+void
+Alarm::Rearm(Thread *running)
+{
+    if (!oneShot) {
+	return;
+    }
+    if (kernel->scheduler->HasReady()) {
+	timer->Arm(running->quantum);
+    } else {
+	timer->Disarm();
+    }
 }
 
 //----------------------------------------------------------------------
@@ -40,7 +269,8 @@ Alarm::Alarm(bool doRandom)
 //	was interrupted.
 //
 //	For now, just provide time-slicing.  Only need to time slice 
-//      if we're currently running something (in other words, not idle).
+//      if we're currently running something (in other words, not idle),
+//	and then only when the scheduler says so.
 //----------------------------------------------------------------------
 
 void 
@@ -49,7 +279,9 @@ Alarm::CallBack()
     Interrupt *interrupt = kernel->interrupt;
     MachineStatus status = interrupt->getStatus();
     
-    if (status != IdleMode) {
+    if (status != IdleMode && kernel->scheduler->Tick()) {
 	interrupt->YieldOnReturn();
     }
+    Rearm(kernel->currentThread);	// if we do switch, Scheduler::Run
+					// re-arms it for the next thread
 }
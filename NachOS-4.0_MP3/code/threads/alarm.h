@@ -8,6 +8,33 @@
 //	From this, we provide the ability for a thread to be
 //	woken up after a delay; we also provide time-slicing.
 //
+//	A thread can also ask for a semaphore to be V'ed once a given
+//	number of ticks have gone by (SetWakeup), to wait for something
+//	with a timeout: it waits on the semaphore, and whatever it waits
+//	for V's it too.  The wakeup is scheduled as a poll, so a machine
+//	that is idle until then goes on polling its devices, and notices
+//	input from outside -- which it may well be waiting for -- as it
+//	comes in.
+//
+//	A thread can also sleep for a given number of ticks (WaitUntil).
+//	Sleepers are kept in a hashed timer wheel: a ring of WheelSlots
+//	lists, one for each WheelTick of time, a sleeper going in the
+//	list of the tick it is to wake at, modulo the size of the ring.
+//	Going to sleep takes constant time, however many threads sleep,
+//	and so does each turn of the wheel, which only looks at the
+//	sleepers of one slot -- those due now, and those due a whole
+//	number of turns later, who stay where they are.  The wheel only
+//	turns while someone sleeps, and as an event, not a poll, so a
+//	machine with nothing else to do skips straight to it, and counts
+//	the time as idle.
+//
+//	Time-slicing is done either with a periodic timer, which goes off
+//	every TimerTicks whether there is anything to switch to or not,
+//	or "tickless": with a one-shot timer that is only armed while some
+//	thread is ready to run, to go off when the running thread has used
+//	up its own quantum (Thread::quantum).  A machine with one thread
+//	to run, or none, then takes no timer interrupts at all.
+//
 //	NOTE: this abstraction is not completely implemented.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
@@ -21,19 +48,87 @@
 #include "utility.h"
 #include "callback.h"
 #include "timer.h"
+#include "stats.h"
+#include "list.h"
+
+class Thread;
+class Semaphore;
+
+const int WheelSlots = 64;	// lists in the timer wheel
+const int WheelTick = TimerTicks; // time each of them stands for
+
+// The following class defines a timed wakeup, made by Alarm::SetWakeup.
+
+class Wakeup : public CallBackObj {
+  public:
+    Wakeup(Semaphore *s);	// V "s" when it goes off
+
+  private:
+    friend class Alarm;
+
+    Semaphore *semaphore;
+    bool cancelled;		// no longer wanted; delete it when it
+				// goes off
+    bool fired;			// gone off; delete it when cancelled
+
+    void CallBack();		// the time has come
+};
+
+// The following class defines a sleeping thread, in the timer wheel.
+
+class Sleeper {
+  public:
+    Thread *thread;		// who sleeps
+    Ticks when;			// the time to wake it up
+};
+
+// The following class defines the timer wheel of sleeping threads.
+
+class TimerWheel : public CallBackObj {
+  public:
+    TimerWheel();		// Initialize a wheel with no sleepers
+    ~TimerWheel();
+
+    void Add(Sleeper *sleeper);	// Wake "sleeper->thread" at
+				// "sleeper->when"; interrupts are off
+
+  private:
+    List<Sleeper *> *slots[WheelSlots];	// the sleepers, by the tick
+					// they wake at
+    Ticks nextTick;		// the next tick the wheel turns at,
+				// in WheelTicks
+    int numSleepers;		// in all the slots; the wheel only
+				// turns when there are some
+
+    void Turn();		// Schedule the next turn
+    void CallBack();		// Wake whoever is due at "nextTick"
+};
 
 // The following class defines a software alarm clock. 
 class Alarm : public CallBackObj {
   public:
-    Alarm(bool doRandomYield);	// Initialize the timer, and callback 
+    Alarm(bool doRandomYield, bool tickless);
+				// Initialize the timer, and callback 
 				// to "toCall" every time slice.
-    ~Alarm() { delete timer; }
+    ~Alarm() { delete wheel; delete timer; }
     
-    void WaitUntil(int x);	// suspend execution until time > now + x
-                                // this method is not yet implemented
+    void WaitUntil(int x);	// suspend execution until time >= now + x
+
+    Wakeup *SetWakeup(Semaphore *s, int delay);
+				// V "s" "delay" ticks from now
+    void CancelWakeup(Wakeup *w); // It is not needed any more; must be
+				// called once for each wakeup, whether
+				// it has gone off or not
+
+    void ThreadReady();		// Tickless: a thread has become ready
+    void Rearm(Thread *running);
+				// Tickless: "running" is getting the
+				// CPU, with a fresh quantum
 
   private:
     Timer *timer;		// the hardware timer device
+    TimerWheel *wheel;		// the threads in WaitUntil
+    bool oneShot;		// only armed while a thread is ready
 
     void CallBack();		// called when the hardware
 				// timer generates an interrupt
@@ -15,8 +15,26 @@
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "bufcache.h"
+#include "inodetable.h"
+#include "swapspace.h"
+#include "loadcontrol.h"
+#include "reaper.h"
+#include "imagetable.h"
+#include "proctable.h"
+#include "futextable.h"
 #include "post.h"
+#include "transport.h"
+#include "replica.h"
 #include "synchconsole.h"
+#include "workerpool.h"
+#include "aioqueue.h"
+#include "tracer.h"
+#include "inputlog.h"
+#include "profiler.h"
+#include "cpucache.h"
+#include "kernelprofile.h"
+#include "checkpoint.h"
 
 //----------------------------------------------------------------------
 // Kernel::Kernel
@@ -27,28 +45,136 @@
 Kernel::Kernel(int argc, char **argv)
 {
     user_program = FALSE; //not user program 
+    execFiles = new List<char *>;
     randomSlice = FALSE; 
+    ticklessTimer = FALSE;     // default is a timer interrupt every TimerTicks
+    timeSlice = TimerTicks;
+    numCPUs = 1;               // default is a uniprocessor
     debugUserProg = FALSE;
+    tickPerBlock = FALSE;      // default is a tick per instruction
+    printStats = FALSE;        // default is to halt quietly
+    syscallTimesFile = NULL;
+    statsJsonFile = NULL;
+    snapshotFile = NULL;
+    snapshotInterval = 0;
+    profileSynch = FALSE;      // default is no contention profile
+    handoffSynch = FALSE;      // default is that woken threads compete
+    traceFile = NULL;          // default is no event trace
+    inputLogFile = NULL;       // default is no input log
+    replayInput = FALSE;
+    profileFile = NULL;        // default is no PC profile
+    kernelProfileFile = NULL;  // default is no kernel profile
+    randomSeed = 1;            // as if srand were never called
+    schedPolicy = SchedFIFO;   // default is plain round robin
     consoleIn = NULL;          // default is stdin
     consoleOut = NULL;         // default is stdout
+    cacheWriteThrough = FALSE; // default is a write-back buffer cache
+    cacheShards = 1;           // default is one lock for all of it
+    cacheTwoQueue = FALSE;     // default is to replace by LRU
+    cacheMetadataFirst = FALSE; // default is metadata like any sector
+    freeExtents = FALSE;       // default is to search the free map
+    sectorChecksums = FALSE;   // default is no checksums, unless the
+                               // disk has them
+    readOnlyMount = FALSE;     // default is to mount it read-write
+    logStructured = FALSE;     // default is to write sectors in place
+    headersNearDirectory = FALSE; // default is wherever there is room
+    treePrefetch = FALSE;      // default is to read each one as reached
+    diskPolicy = DiskFIFO;     // default is first come, first served
+    mapDisk = FALSE;           // default is UNIX reads and writes
+    diskName = NULL;           // default is DISK_<hostName>
+    diskBase = NULL;           // default is a disk of its own
+    restoreFile = NULL;        // default is to boot afresh
+    checkpointFile = NULL;     // default is no checkpoint
+    checkpointTicks = 0;
+    diskTrackBuffers = DefaultTrackBuffers;
+    diskWriteCache = 0;        // default is no write cache
+    diskDevice = DeviceRotating;
+    diskCount = 1;
+    diskMapFile = NULL;        // default is no access map
+    numMounts = 0;             // default is the root file system alone
+    pagePolicy = PageClock;    // default is second chance
+    tlbPolicy = TlbFIFO;       // default is round robin
+    superpagePages = 1;        // default is no superpages
+    invertedRefill = FALSE;    // default is to refill from page tables
+    workingSetInterval = 0;    // default is no load control
+    reapFlag = FALSE;          // default is to tear down at exit
+    faultAroundPages = 0;      // default is to page in a page at a time
+    swapPoolPages = 0;         // default is to swap straight to disk
+    cacheSize[0] = cacheSize[1] = 0; // default is no CPU caches
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
 #endif
     reliability = 1;            // network reliability, default is 1.0
     hostName = 0;               // machine id, also UNIX socket name
+    replicaHost = -1;           // default is no backup
+    netLatency = netJitter = 0; // packets arrive when they are sent,
+    netBandwidth = 0;           // in NetworkTime,
+    netQueue = 0;               // one at a time
                                 // 0 is the default machine id
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-rs") == 0) {
  	    	ASSERT(i + 1 < argc);
-	    	RandomInit(atoi(argv[i + 1]));// initialize pseudo-random
+	    	randomSeed = atoi(argv[i + 1]);
+	    	RandomInit(randomSeed);// initialize pseudo-random
 			// number generator
 	    	randomSlice = TRUE;
 	    	i++;
         } else if (strcmp(argv[i], "-s") == 0) {
             debugUserProg = TRUE;
+		} else if (strcmp(argv[i], "-bb") == 0) {
+	    	tickPerBlock = TRUE;
+		} else if (strcmp(argv[i], "-tl") == 0) {
+	    	ticklessTimer = TRUE;
+		} else if (strcmp(argv[i], "-tq") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	timeSlice = atoi(argv[i + 1]);
+	    	ASSERT(timeSlice > 0);
+	    	i++;
+		} else if (strcmp(argv[i], "-stats") == 0) {
+	    	printStats = TRUE;
+		} else if (strcmp(argv[i], "-lp") == 0) {
+	    	profileSynch = TRUE;
+		} else if (strcmp(argv[i], "-ho") == 0) {
+	    	handoffSynch = TRUE;
+		} else if (strcmp(argv[i], "-tr") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	traceFile = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-record") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	inputLogFile = argv[i + 1];
+	    	replayInput = FALSE;
+	    	i++;
+		} else if (strcmp(argv[i], "-replay") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	inputLogFile = argv[i + 1];
+	    	replayInput = TRUE;
+	    	i++;
+		} else if (strcmp(argv[i], "-prof") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	profileFile = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-sl") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	syscallTimesFile = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-sj") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	statsJsonFile = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-snap") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	snapshotInterval = atoi(argv[i + 1]);
+	    	snapshotFile = argv[i + 2];
+	    	ASSERT(snapshotInterval > 0);
+	    	i += 2;
+		} else if (strcmp(argv[i], "-kp") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	kernelProfileFile = argv[i + 1];
+	    	i++;
 		} else if (strcmp(argv[i], "-e") == 0) {
-        	execfile[++execfileNum]= argv[++i];
-			cout << execfile[execfileNum] << "\n";
+        	execFiles->Append(argv[++i]);
+			cout << argv[i] << "\n";
             user_program = TRUE;
 		} else if (strcmp(argv[i], "-ci") == 0) {
 	    	ASSERT(i + 1 < argc);
@@ -58,6 +184,161 @@ Kernel::Kernel(int argc, char **argv)
 	    	ASSERT(i + 1 < argc);
 	    	consoleOut = argv[i + 1];
 	    	i++;
+		} else if (strcmp(argv[i], "-wt") == 0) {
+	    	cacheWriteThrough = TRUE;
+		} else if (strcmp(argv[i], "-cs") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	cacheShards = atoi(argv[i + 1]);
+	    	if (cacheShards < 1 || cacheShards > MaxCacheShards
+		    || NumCacheEntries % cacheShards != 0) {
+				cout << "Buffer cache shards must be 1, 2, 4, 8 or 16\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-c2q") == 0) {
+	    	cacheTwoQueue = TRUE;
+		} else if (strcmp(argv[i], "-cmeta") == 0) {
+	    	cacheMetadataFirst = TRUE;
+		} else if (strcmp(argv[i], "-fx") == 0) {
+	    	freeExtents = TRUE;
+		} else if (strcmp(argv[i], "-crc") == 0) {
+	    	sectorChecksums = TRUE;
+		} else if (strcmp(argv[i], "-ro") == 0) {
+	    	readOnlyMount = TRUE;
+		} else if (strcmp(argv[i], "-lfs") == 0) {
+	    	logStructured = TRUE;
+		} else if (strcmp(argv[i], "-eh") == 0) {
+	    	headersNearDirectory = TRUE;
+		} else if (strcmp(argv[i], "-tp") == 0) {
+	    	treePrefetch = TRUE;
+		} else if (strcmp(argv[i], "-ds") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	if (!DiskQueue::ParsePolicy(argv[i + 1], &diskPolicy)) {
+				cout << "Unknown disk policy " << argv[i + 1] << "\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-dm") == 0) {
+	    	mapDisk = TRUE;
+		} else if (strcmp(argv[i], "-disk") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskName = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-dbase") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskBase = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-ckpt") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	checkpointTicks = atoll(argv[i + 1]);
+	    	checkpointFile = argv[i + 2];
+	    	ASSERT(checkpointTicks >= 0);
+	    	i += 2;
+		} else if (strcmp(argv[i], "-restore") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	restoreFile = argv[i + 1];
+	    	user_program = TRUE;
+	    	i++;
+		} else if (strcmp(argv[i], "-mount") == 0) {
+	    	ASSERT(i + 2 < argc);
+	    	if (numMounts == MaxMounts - 1) {
+				cout << "At most " << MaxMounts - 1 << " file systems can be mounted\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	mountDisks[numMounts] = argv[i + 1];
+	    	mountPaths[numMounts] = argv[i + 2];
+	    	numMounts++;
+	    	i += 2;
+		} else if (strcmp(argv[i], "-dtb") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskTrackBuffers = atoi(argv[i + 1]);
+	    	ASSERT(diskTrackBuffers >= 0 && diskTrackBuffers <= MaxTrackBuffers);
+	    	i++;
+		} else if (strcmp(argv[i], "-dwc") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskWriteCache = atoi(argv[i + 1]);
+	    	ASSERT(diskWriteCache >= 0 && diskWriteCache <= NumSectors);
+	    	i++;
+		} else if (strcmp(argv[i], "-dn") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskCount = atoi(argv[i + 1]);
+	    	ASSERT(diskCount >= 1 && diskCount <= MaxVolumeDisks);
+	    	i++;
+		} else if (strcmp(argv[i], "-dmodel") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	if (!DiskModel::ParseDevice(argv[i + 1], &diskDevice)) {
+				cout << "Unknown disk model " << argv[i + 1] << "\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-dmap") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	diskMapFile = argv[i + 1];
+	    	i++;
+		} else if (strcmp(argv[i], "-sched") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	if (!Scheduler::ParsePolicy(argv[i + 1], &schedPolicy)) {
+				cout << "Unknown scheduling policy " << argv[i + 1] << "\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-smp") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	numCPUs = atoi(argv[i + 1]);
+	    	ASSERT(numCPUs >= 1 && numCPUs <= MaxCPUs);
+	    	i++;
+		} else if (strcmp(argv[i], "-vm") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	if (!FrameTable::ParsePolicy(argv[i + 1], &pagePolicy)) {
+				cout << "Unknown page replacement policy " << argv[i + 1] << "\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-tlb") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	if (!TlbManager::ParsePolicy(argv[i + 1], &tlbPolicy)) {
+				cout << "Unknown TLB replacement policy " << argv[i + 1] << "\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-sp") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	superpagePages = atoi(argv[i + 1]);
+	    	if (superpagePages < 1 || superpagePages > MaxSuperpage
+		    || (superpagePages & (superpagePages - 1)) != 0) {
+				cout << "Superpages must be 1, 2, 4, 8 or 16 pages\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
+		} else if (strcmp(argv[i], "-ws") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	workingSetInterval = atoi(argv[i + 1]);
+	    	ASSERT(workingSetInterval > 0);
+	    	i++;
+		} else if (strcmp(argv[i], "-fa") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	faultAroundPages = atoi(argv[i + 1]);
+	    	ASSERT(faultAroundPages >= 0 && faultAroundPages <= MaxFaultAround);
+	    	i++;
+		} else if (strcmp(argv[i], "-zs") == 0) {
+	    	ASSERT(i + 1 < argc);
+	    	swapPoolPages = atoi(argv[i + 1]);
+	    	ASSERT(swapPoolPages >= 0);
+	    	i++;
+		} else if (strcmp(argv[i], "-ipt") == 0) {
+	    	invertedRefill = TRUE;
+		} else if (strcmp(argv[i], "-reap") == 0) {
+	    	reapFlag = TRUE;
+		} else if (strcmp(argv[i], "-l1") == 0 || strcmp(argv[i], "-l2") == 0) {
+	    	int level = argv[i][2] - '1';
+
+	    	ASSERT(i + 1 < argc);
+	    	if (!CacheLevel::Parse(argv[i + 1], &cacheSize[level],
+				   &cacheWays[level], &cacheLine[level])) {
+				cout << "Bad CPU cache " << argv[i + 1] << "\n";
+				ASSERTNOTREACHED();
+	    	}
+	    	i++;
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
@@ -66,6 +347,23 @@ Kernel::Kernel(int argc, char **argv)
             ASSERT(i + 1 < argc);   // next argument is float
             reliability = atof(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "-nl") == 0) {
+            ASSERT(i + 1 < argc);
+            if (!NetworkOutput::ParseLink(argv[i + 1], &netLatency,
+                                          &netBandwidth, &netJitter)) {
+                cout << "Bad network link " << argv[i + 1] << "\n";
+                ASSERTNOTREACHED();
+            }
+            i++;
+        } else if (strcmp(argv[i], "-nq") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            netQueue = atoi(argv[i + 1]);
+            ASSERT(netQueue > 0);
+            i++;
+        } else if (strcmp(argv[i], "-replica") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            replicaHost = atoi(argv[i + 1]);
+            i++;
         } else if (strcmp(argv[i], "-m") == 0) {
             ASSERT(i + 1 < argc);   // next argument is int
             hostName = atoi(argv[i + 1]);
@@ -73,13 +371,49 @@ Kernel::Kernel(int argc, char **argv)
         } else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-rs randomSeed]\n";
 	   		cout << "Partial usage: nachos [-s]\n";
+            cout << "Partial usage: nachos [-bb]\n";
+            cout << "Partial usage: nachos [-tl] [-tq ticks]\n";
+            cout << "Partial usage: nachos [-stats] [-sl latencyFile] [-sj statsFile] [-lp] [-tr traceFile]\n";
+            cout << "Partial usage: nachos [-snap ticks snapshotFile]\n";
+            cout << "Partial usage: nachos [-prof profileFile] [-kp profileFile]\n";
+            cout << "Partial usage: nachos [-record logFile] [-replay logFile]\n";
+            cout << "Partial usage: nachos [-ho]\n";
+            cout << "Partial usage: nachos [-sched fifo|mlfq|stride] [-smp cpus]\n";
             cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
+            cout << "Partial usage: nachos [-wt] [-cs shards] [-c2q] [-cmeta] [-fx] [-crc] [-ro] [-lfs] [-eh] [-tp]\n";
+            cout << "Partial usage: nachos [-ds fifo|sstf|scan|clook] [-dm]\n";
+            cout << "Partial usage: nachos [-disk unixFile] [-dbase unixFile]\n";
+            cout << "Partial usage: nachos [-ckpt ticks checkpointFile] [-restore checkpointFile]\n";
+            cout << "Partial usage: nachos [-mount unixFile directory]\n";
+            cout << "Partial usage: nachos [-dtb buffers] [-dwc sectors]\n";
+            cout << "Partial usage: nachos [-dmodel rotating|flash|ram] [-dn disks]\n";
+            cout << "Partial usage: nachos [-dmap mapFile]\n";
+            cout << "Partial usage: nachos [-vm clock|aging] [-ws ticks] [-fa pages]\n";
+            cout << "Partial usage: nachos [-reap]\n";
+            cout << "Partial usage: nachos [-zs pages]\n";
+            cout << "Partial usage: nachos [-tlb random|fifo|lru] [-sp pages] [-ipt]\n";
+            cout << "Partial usage: nachos [-l1 bytes,ways,line] [-l2 bytes,ways,line]\n";
 #ifndef FILESYS_STUB
 	    	cout << "Partial usage: nachos [-nf]\n";
 #endif
             cout << "Partial usage: nachos [-n #] [-m #]\n";
+            cout << "Partial usage: nachos [-nl latency,bandwidth[,jitter]] [-nq packets]\n";
+            cout << "Partial usage: nachos [-replica backupId]\n";
 		}
     }
+    if (restoreFile != NULL)
+	diskBase = restoreFile;		// the checkpoint starts with the disk
+    if (checkpointFile != NULL) {
+	// only the root's disk is saved, and only one CPU's registers
+	if (diskCount > 1 || numMounts > 0 || numCPUs > 1) {
+	    cout << "-ckpt needs one CPU, and one disk, with nothing mounted\n";
+	    ASSERTNOTREACHED();
+	}
+	if (diskBase != NULL && strcmp(diskBase, checkpointFile) == 0) {
+	    cout << "-ckpt cannot write over the disk's base image\n";
+	    ASSERTNOTREACHED();
+	}
+    }
 }
 
 //----------------------------------------------------------------------
@@ -97,24 +431,107 @@ Kernel::Initialize()
     // object to save its state. 
 
 	
-    currentThread = new Thread("main", threadNum++);		
+    stats = new Statistics();		// collect statistics
+    stats->numCPUs = numCPUs;
+    if (snapshotFile != NULL)
+	stats->StartSnapshots(snapshotFile, snapshotInterval);
+    synchProfiler = NULL;		// before anything makes a lock
+    if (profileSynch)
+	synchProfiler = new SynchProfiler();
+    tracer = NULL;
+    if (traceFile != NULL)
+	tracer = new Tracer(traceFile);
+    profiler = NULL;			// before any address space
+    if (profileFile != NULL)
+	profiler = new Profiler(profileFile);
+    inputLog = NULL;			// before the devices and the timer
+    if (inputLogFile != NULL) {
+	inputLog = new InputLog(inputLogFile, replayInput, randomSeed,
+				randomSlice);
+	if (replayInput) {
+	    RandomInit(inputLog->Seed());
+	    randomSlice = inputLog->RandomSlice();
+	}
+    }
+    currentThread = new Thread("main", 0);		
     currentThread->setStatus(RUNNING);
+    stats->SwitchTo(currentThread->stats);
+    kernelProfiler = NULL;		// once there is a thread to profile
+    if (kernelProfileFile != NULL)
+	kernelProfiler = new KernelProfiler(kernelProfileFile);
 
-    stats = new Statistics();		// collect statistics
     interrupt = new Interrupt;		// start up interrupt handling
-    scheduler = new Scheduler();	// initialize the ready queue
-    alarm = new Alarm(randomSlice);	// start up time slicing
-    machine = new Machine(debugUserProg);
+    scheduler = new Scheduler(schedPolicy, numCPUs);
+					// initialize the ready queues
+    alarm = new Alarm(randomSlice, ticklessTimer);	// start up time slicing
+    workerPool = new WorkerPool("kernel worker", NumWorkers);
+    aioWorkers = new WorkerPool("aio worker", NumAioWorkers);
+    CpuCache *cpuCache = NULL;
+    if (cacheSize[0] > 0) {
+	cpuCache = new CpuCache(new CacheLevel(cacheSize[0], cacheWays[0],
+					       cacheLine[0]),
+		(cacheSize[1] > 0) ? new CacheLevel(cacheSize[1], cacheWays[1],
+						    cacheLine[1]) : NULL);
+    } else
+	ASSERT(cacheSize[1] == 0);	// an L2 needs an L1 in front
+    machine = new Machine(debugUserProg, tickPerBlock, cpuCache);
     synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
     synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+    postOfficeIn = new PostOfficeInput(NumMailBoxes);
+    postOfficeOut = new PostOfficeOutput(reliability);
+    checkpoint = NULL;
+    if (checkpointFile != NULL)
+	checkpoint = new Checkpoint(checkpointFile, checkpointTicks);
+    replicator = NULL;			// before the disk is written to
+    if (replicaHost >= 0)
+	replicator = new Replicator(replicaHost);
+    synchDisk = new SynchDisk(diskPolicy, mapDisk, diskTrackBuffers,
+			      diskWriteCache, diskDevice, diskCount, NULL);
+    bufferCache = new BufferCache(synchDisk, NumCacheEntries, cacheWriteThrough,
+				  cacheShards, cacheTwoQueue ? Cache2Q : CacheLRU,
+				  cacheMetadataFirst);
+    bufferCache->StartFlusher();
+    inodeTable = new InodeTable();
 #ifdef FILESYS_STUB
     fileSystem = new FileSystem(formatFlag);
 #else
+    mounts = new MountTable(synchDisk, bufferCache, inodeTable);
+    fileSystem = NULL;			// none yet, while it is being made
     fileSystem = new FileSystem(formatFlag);
+    if (freeExtents)
+	fileSystem->IndexFreeExtents();
+    for (int i = 0; i < numMounts; i++) {
+	// each with a disk, a buffer cache and an inode table of its own
+	SynchDisk *disk = new SynchDisk(diskPolicy, mapDisk, diskTrackBuffers,
+					diskWriteCache, diskDevice, 1,
+					mountDisks[i]);
+	BufferCache *cache = new BufferCache(disk, NumCacheEntries,
+				cacheWriteThrough, cacheShards,
+				cacheTwoQueue ? Cache2Q : CacheLRU,
+				cacheMetadataFirst);
+
+	if (!mounts->Mount(mountPaths[i], disk, cache, new InodeTable(),
+			   formatFlag))
+	    cerr << "Cannot mount " << mountDisks[i] << " on "
+		 << mountPaths[i] << "\n";
+    }
 #endif // FILESYS_STUB
-    postOfficeIn = new PostOfficeInput(10);
-    postOfficeOut = new PostOfficeOutput(reliability);
+    frameTable = new FrameTable(NumPhysPages, pagePolicy, superpagePages);
+    swapSpace = new SwapSpace(swapPoolPages);
+    loadControl = NULL;
+    if (workingSetInterval > 0)
+	loadControl = new LoadControl(workingSetInterval);
+    imageTable = new ImageTable();
+    reaper = NULL;
+    if (reapFlag)
+	reaper = new Reaper();
+    processTable = new ProcessTable();
+    futexTable = new FutexTable();
+#ifdef USE_TLB
+    tlbManager = new TlbManager(tlbPolicy, superpagePages, invertedRefill);
+#else
+    tlbManager = NULL;
+#endif
 
     interrupt->Enable();
 }
@@ -126,17 +543,60 @@ Kernel::Initialize()
 
 Kernel::~Kernel()
 {
+    // the file system and buffer cache go first: flushing dirty
+    // sectors needs the disk, and the interrupts that drive it;
+    // before them, the swap area removes its file
+    if (reaper != NULL)			// it closes the programs' files,
+	delete reaper;			// and gives back their frames
+    if (tlbManager != NULL)
+	delete tlbManager;
+    if (loadControl != NULL)
+	delete loadControl;
+    delete swapSpace;
+    delete frameTable;
+#ifndef FILESYS_STUB
+    mounts->Unmount();			// before the one they are mounted on
+#endif
+    delete fileSystem;
+    delete inodeTable;
+    delete bufferCache;
+    synchDisk->CloseLog();		// after the last sector written
+    delete imageTable;			// programs may run while the
+					// above wait for the disk
+    if (replicator != NULL) {		// once nothing more is written
+	delete replicator;
+	replicator = NULL;
+    }
+    delete processTable;
+    delete futexTable;
+    delete execFiles;
+    if (checkpoint != NULL)
+	delete checkpoint;
     delete stats;
     delete interrupt;
     delete scheduler;
     delete alarm;
+    delete workerPool;
+    delete aioWorkers;
     delete machine;
     delete synchConsoleIn;
     delete synchConsoleOut;
     delete synchDisk;
-    delete fileSystem;
+#ifndef FILESYS_STUB
+    delete mounts;			// and the disks they were on
+#endif
     delete postOfficeIn;
     delete postOfficeOut;
+    if (synchProfiler != NULL)
+	delete synchProfiler;
+    if (tracer != NULL)
+	delete tracer;
+    if (inputLog != NULL)
+	delete inputLog;
+    if (profiler != NULL)
+	delete profiler;
+    if (kernelProfiler != NULL)
+	delete kernelProfiler;
     
     Exit(0);
 }
@@ -184,7 +644,10 @@ Kernel::ConsoleTest() {
 
     do {
         ch = synchConsoleIn->GetChar();
-        if(ch != EOF) synchConsoleOut->PutChar(ch);   // echo it!
+        if (ch != EOF) {
+            synchConsoleOut->PutChar(ch);   // echo it!
+            synchConsoleOut->Flush();       // without waiting for a newline
+        }
     } while (ch != EOF);
 
     cout << "\n";
@@ -200,6 +663,8 @@ Kernel::ConsoleTest() {
 //      3. send an acknowledgment for the other machine's message
 //      4. wait for an acknowledgement from the other machine to our 
 //          original message
+//      5. wait a while for anything more in either mailbox, and see
+//          that nothing comes
 //
 //  This test works best if each Nachos machine has its own window
 //----------------------------------------------------------------------
@@ -245,14 +710,74 @@ Kernel::NetworkTest() {
         cout << "Got: " << buffer << " : from " << inPktHdr.from << ", box " 
                                                 << inMailHdr.from << "\n";
         cout.flush();
+
+        // Nothing more is coming to either mailbox
+        int boxes[2] = { 0, 1 };
+        Ticks start = stats->totalTicks;
+
+        if (postOfficeIn->Select(2, boxes, 1000 * NetworkTime) < 0) {
+            cout << "No more mail after " << stats->totalTicks - start
+                 << " ticks\n";
+        }
     }
 
     // Then we're done!
 }
 
+//----------------------------------------------------------------------
+// Kernel::StreamTest
+//      Test whether a connection is working, and how fast.  Machine #0
+//	sends "numBytes" bytes to machine #1, which checks that every one
+//	arrives, in order; both print how long it took, against the time
+//	the data alone would take on the network, and how many segments
+//	had to be resent.  Run it with -n, to lose some of the packets,
+//	to see the retransmission at work.
+//----------------------------------------------------------------------
+
+void
+Kernel::StreamTest(int numBytes) {
+
+    if (hostName == 0 || hostName == 1) {
+        int farHost = (hostName == 0 ? 1 : 0);
+        Connection *conn = new Connection(0, farHost, 0);
+        char buffer[1000];
+        Ticks start = stats->totalTicks;
+        int done, count, i;
+        bool ok = TRUE;
+
+        for (done = 0; done < numBytes; done += count) {
+            if (hostName == 0) {
+                count = min(numBytes - done, (int) sizeof(buffer));
+                for (i = 0; i < count; i++) {
+                    buffer[i] = (char) ((done + i) % 251);
+                }
+                conn->Send(buffer, count);
+            } else {
+                count = conn->Receive(buffer, sizeof(buffer));
+                for (i = 0; i < count; i++) {
+                    if (buffer[i] != (char) ((done + i) % 251)) {
+                        ok = FALSE;
+                    }
+                }
+            }
+        }
+        conn->Flush();
+        cout << (hostName == 0 ? "Sent " : "Received ") << numBytes
+             << " bytes in " << stats->totalTicks - start << " ticks ("
+             << divRoundUp(numBytes, SegmentSize) * NetworkTime
+             << " at line rate)" << (ok ? "" : ", CORRUPTED") << "\n";
+        conn->Print();
+        cout.flush();
+        conn->Close();
+    }
+}
+
 void ForkExecute(Thread *t)
 {
 	if ( !t->space->Load(t->getName()) ) {
+		delete t->space;
+		t->space = NULL;
+		kernel->processTable->Exit(t->getID(), -1);
     	return;             // executable not found
     }
 	
@@ -260,49 +785,157 @@ void ForkExecute(Thread *t)
 
 }
 
+//----------------------------------------------------------------------
+// ForkReturn
+// 	Start a program made by Kernel::Fork: it picks up where its
+//	parent made the syscall, with the registers saved for it.
+//----------------------------------------------------------------------
+
+void ForkReturn(Thread *t)
+{
+    kernel->scheduler->LoadUserState(t);
+    t->space->RestoreState();
+    kernel->machine->Run();
+    ASSERTNOTREACHED();
+}
+
+//----------------------------------------------------------------------
+// Kernel::ExecAll
+// 	Start the programs named with -e, one after the other, and let
+//	them run.
+//----------------------------------------------------------------------
+
 void Kernel::ExecAll()
 {
-	for (int i=1;i<=execfileNum;i++) {
-		int a = Exec(execfile[i]);
-	}
+	if (restoreFile != NULL)
+		Checkpoint::Restore(restoreFile);
+	while (!execFiles->IsEmpty())
+		Exec(execFiles->RemoveFront());
 	currentThread->Finish();
-    //Kernel::Exec();	
 }
 
+//----------------------------------------------------------------------
+// Kernel::Exec
+// 	Start the user program in the file "name", in a new thread.  The
+//	program started is a child of the one running now, if any.
+//
+//	Return the new program's id.
+//----------------------------------------------------------------------
 
 int Kernel::Exec(char* name)
 {
-	t[threadNum] = new Thread(name, threadNum);
-	t[threadNum]->space = new AddrSpace();
-	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
-	threadNum++;
-
-	return threadNum-1;
-/*
-    cout << "Total threads number is " << execfileNum << endl;
-    for (int n=1;n<=execfileNum;n++) {
-		t[n] = new Thread(execfile[n]);
-		t[n]->space = new AddrSpace();
-		t[n]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[n]);
-		cout << "Thread " << execfile[n] << " is executing." << endl;
+	int parent = (currentThread->space != NULL) ? currentThread->getID() : 0;
+	int pid = processTable->Add(parent);
+	Thread *t = new Thread(name, pid);
+
+	t->space = new AddrSpace();
+	t->Fork((VoidFunctionPtr) &ForkExecute, (void *)t);
+	return pid;
+}
+
+//----------------------------------------------------------------------
+// Kernel::Fork
+// 	Make a copy of the user program running in the current thread
+//	(see AddrSpace::Fork), in a new thread.  The user registers are
+//	copied as they are now: the caller has already moved the PC past
+//	the syscall and put the child's return value in r2.
+//
+//	Only the program's first thread may do this: the others' stacks
+//	are not part of the copy.
+//
+//	Return the new program's id, or -1 if it could not be made.
+//----------------------------------------------------------------------
+
+int Kernel::Fork()
+{
+	AddrSpace *space;
+	Thread *t;
+	int pid;
+
+	if (currentThread->userStack != -1)
+		return -1;		// its stack would not be copied
+	space = currentThread->space->Fork();
+	if (space == NULL)
+		return -1;
+	pid = processTable->Add(currentThread->getID());
+	t = new Thread(currentThread->getName(), pid);
+	t->space = space;
+	t->SaveUserState();		// our registers, as the child's
+	t->Fork((VoidFunctionPtr) &ForkReturn, (void *)t);
+	return pid;
+}
+
+//----------------------------------------------------------------------
+// Kernel::ThreadFork
+// 	Start another thread of the user program running in the current
+//	one, in the same address space, with a stack region of its own.
+//	It starts at user address "func" with every other register
+//	clear, and returns from it to "returnTo".  It is the child of
+//	the current thread, which alone may join it.
+//
+//	Return its ThreadId, or -1 if the program has no stack left for
+//	it.
+//----------------------------------------------------------------------
+
+int Kernel::ThreadFork(int func, int returnTo)
+{
+	AddrSpace *space = currentThread->space;
+	int slot = space->AllocateStack();
+	Thread *t;
+
+	if (slot == -1)
+		return -1;
+	t = new Thread(currentThread->getName(), currentThread->getID());
+	t->space = space;
+	t->userThreadId = space->Threads()->Add(currentThread->userThreadId);
+	t->userStack = slot;
+	space->AddThread();
+	for (int i = 0; i < NumTotalRegs; i++)
+		t->SetUserRegister(i, 0);
+	t->SetUserRegister(PCReg, func);
+	t->SetUserRegister(NextPCReg, func + 4);
+	t->SetUserRegister(StackReg, space->StackTop(slot) - 16);
+	t->SetUserRegister(RetAddrReg, returnTo);
+	t->Fork((VoidFunctionPtr) &ForkReturn, (void *)t);
+	return t->userThreadId;
+}
+
+//----------------------------------------------------------------------
+// Kernel::LeaveProgram
+// 	The current thread is done running its user program: its stack
+//	region is given back, and if it was the program's last thread,
+//	so is the address space, and the program exits with the status
+//	it gave Exit.  Then the thread finishes.  The caller has already
+//	told the program's thread table.
+//----------------------------------------------------------------------
+
+void Kernel::LeaveProgram()
+{
+	Thread *t = currentThread;
+	AddrSpace *space = t->space;
+
+	if (t->userStack != -1)
+		space->FreeStack(t->userStack);
+	if (space->RemoveThread())
+	{
+		// give back its frames and swap, and write back anything
+		// it still has mapped, before a parent waiting in Join
+		// hears of it -- with -reap, only the write back, and the
+		// reaper does the rest; the thread's stack goes once it
+		// has finished
+		int status = space->ExitStatus();
+
+		if (reaper != NULL)
+		{
+			space->Retire();
+			reaper->Queue(space);
+		}
+		else
+			delete space;
+		processTable->Exit(t->getID(), status);
 	}
-	cout << "debug Kernel::Run finished.\n";	
-*/
-//  Thread *t1 = new Thread(execfile[1]);
-//  Thread *t1 = new Thread("../test/test1");
-//  Thread *t2 = new Thread("../test/test2");
-
-//    AddrSpace *halt = new AddrSpace();
-//  t1->space = new AddrSpace();
-//  t2->space = new AddrSpace();
-
-//    halt->Execute("../test/halt");
-//  t1->Fork((VoidFunctionPtr) &ForkExecute, (void *)t1);
-//  t2->Fork((VoidFunctionPtr) &ForkExecute, (void *)t2);
-
-//	currentThread->Finish();
-//    Kernel::Run();
-//  cout << "after ThreadedKernel:Run();" << endl;  // unreachable
+	t->space = NULL;
+	t->Finish();
 }
 
 int Kernel::CreateFile(char *filename,int size)
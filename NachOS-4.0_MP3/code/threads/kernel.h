@@ -18,12 +18,34 @@
 #include "alarm.h"
 #include "filesys.h"
 #include "machine.h"
+#include "disk.h"
+#include "diskqueue.h"
+#include "frametable.h"
+#include "tlbmanager.h"
+#include "mounttable.h"
 
 class PostOfficeInput;
 class PostOfficeOutput;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
+class BufferCache;
+class InodeTable;
+class MountTable;
+class SwapSpace;
+class LoadControl;
+class ImageTable;
+class ProcessTable;
+class FutexTable;
+class SynchProfiler;
+class WorkerPool;
+class Tracer;
+class InputLog;
+class Profiler;
+class KernelProfiler;
+class Replicator;
+class Checkpoint;
+class Reaper;
 
 typedef int OpenFileId;
 
@@ -37,12 +59,17 @@ class Kernel {
 				// from constructor because 
 				// refers to "kernel" as a global
 	void ExecAll();
-	int Exec(char* name);
+	int Exec(char* name);		// start a user program; its id
+	int Fork();			// copy the current user program
+	int ThreadFork(int func, int returnTo);
+					// another thread of it; its ThreadId
+	void LeaveProgram();		// the current thread is done with
+					// its program
     void ThreadSelfTest();	// self test of threads and synchronization
 	
     void ConsoleTest();         // interactive console self test
     void NetworkTest();         // interactive 2-machine network test
-	Thread* getThread(int threadID){return t[threadID];}    
+    void StreamTest(int numBytes); // 2-machine test of a connection
 	
 	int CreateFile(char* filename, int size); // fileSystem call
 
@@ -54,28 +81,132 @@ class Kernel {
     Interrupt *interrupt;	// interrupt status
     Statistics *stats;		// performance metrics
     Alarm *alarm;		// the software alarm clock    
+    WorkerPool *workerPool;	// kernel threads to run short jobs on
+    WorkerPool *aioWorkers;	// and to do the programs' asynchronous
+				// reads and writes (see aioqueue.h)
     Machine *machine;           // the simulated CPU
     SynchConsoleInput *synchConsoleIn;
     SynchConsoleOutput *synchConsoleOut;
-    SynchDisk *synchDisk;
-    FileSystem *fileSystem;     
+    SynchDisk *synchDisk;	// these three are those of the file
+    BufferCache *bufferCache;	// sector cache in front of synchDisk
+    InodeTable *inodeTable;	// file headers of the open files
+				// system the running thread is in
+    FileSystem *fileSystem;	// the root file system
+    MountTable *mounts;		// and those mounted on it (-mount)
+    FrameTable *frameTable;	// who has which frame of memory
+    SwapSpace *swapSpace;	// where evicted pages go
+    ImageTable *imageTable;	// the executables being run, for
+				// sharing their code
+    ProcessTable *processTable;	// the user programs, by id
+    FutexTable *futexTable;	// user threads waiting on their memory
+    TlbManager *tlbManager;	// refills the TLB, if there is one
+    LoadControl *loadControl;	// suspends programs that do not fit
+				// in memory; NULL unless -ws
+    Reaper *reaper;		// takes apart the address spaces of
+				// exited programs; NULL unless -reap
+    SynchProfiler *synchProfiler;	// contention on locks and such, if
+				// it is being profiled
+    Tracer *tracer;		// the trace of kernel events, if they
+				// are being traced
+    InputLog *inputLog;		// the input from outside, if it is
+				// being recorded or replayed
+    Profiler *profiler;		// the PC samples of user programs, if
+				// they are being profiled
+    KernelProfiler *kernelProfiler;	// where the kernel's time goes, if
+				// that is being profiled
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
+    Replicator *replicator;	// mirrors the disk's writes onto a
+				// backup, if there is one
+    Checkpoint *checkpoint;	// of the running program, to be taken;
+				// NULL unless -ckpt
 
     int hostName;               // machine identifier
+    char *diskName;             // UNIX file holding the disk; NULL for
+                                // DISK_<hostName>
+    char *diskBase;             // base image the disk is an overlay on,
+                                // or NULL
+    char *restoreFile;          // checkpoint to start from, which is
+                                // also diskBase; or NULL
+    char *diskMapFile;          // file to write the sectors' access
+                                // counts to, or NULL
+    bool sectorChecksums;       // keep a checksum of every sector
+    bool readOnlyMount;         // mount the file system read-only
+    bool logStructured;         // format the disk as a log
+    bool headersNearDirectory;  // put the headers of new files right
+                                // after their directory's entries
+    bool treePrefetch;          // read ahead the directories a walk
+                                // down the tree will go into
     bool user_program;
+    bool printStats;            // print statistics at halt
+    char *syscallTimesFile;     // file to write the system call
+                                // latencies to at halt, or NULL
+    char *statsJsonFile;        // file to append the counters to at
+                                // halt, as JSON, or NULL
+    char *snapshotFile;         // file to append the counters to
+    int snapshotInterval;       // every this many ticks, if not NULL
+    int timeSlice;              // tickless: the quantum of new threads
+    int numCPUs;                // CPUs the machine has (see scheduler.h)
+    bool handoffSynch;          // semaphores and locks go straight to
+                                // the threads waiting for them
+    int faultAroundPages;       // most pages read ahead of a fault
+    int netLatency;             // ticks a packet takes to arrive
+    int netJitter;              // and at most this many more
+    double netBandwidth;        // bytes per tick a link carries; 0 if
+                                // the time of a packet is fixed
+    int netQueue;               // packets that may wait to be received;
+                                // 0 for one, never dropped
 
   private:
 
-	Thread* t[10];
-	char*   execfile[10];
-	int execfileNum;
-	int threadNum;
+    List<char *> *execFiles;	// programs to run, from -e
     bool randomSlice;		// enable pseudo-random time slicing
+    bool ticklessTimer;		// only time slice when a thread is ready
     bool debugUserProg;         // single step user program
+    bool tickPerBlock;          // charge user time per basic block
+    bool profileSynch;          // count contention on locks and such
+    char *traceFile;            // file to write the event trace to
+    char *checkpointFile;       // file to take a checkpoint in, or NULL
+    Ticks checkpointTicks;      // at the first time slice from then
+    char *inputLogFile;         // file to record input to, or replay
+    bool replayInput;           // it from
+    char *profileFile;          // file to write the PC profiles to
+    char *kernelProfileFile;    // file to write the kernel profile to
+    int randomSeed;             // what -rs seeded random numbers with
+    SchedPolicy schedPolicy;    // which ready thread runs next
     double reliability;         // likelihood messages are dropped
+    int replicaHost;            // machine to mirror disk writes onto,
+                                // or -1
     char *consoleIn;            // file to read console input from
     char *consoleOut;           // file to send console output to
+    bool cacheWriteThrough;     // buffer cache writes go straight to disk
+    int cacheShards;            // shards the buffer cache is split into
+    bool cacheTwoQueue;         // it replaces sectors by 2Q, not LRU
+    bool cacheMetadataFirst;    // and keeps metadata ahead of file data
+    bool freeExtents;           // index the free sectors by extent
+    DiskPolicy diskPolicy;      // order to serve queued disk requests
+    bool mapDisk;               // map the disk image into memory
+    int diskTrackBuffers;       // track buffers the disk has
+    int diskWriteCache;         // sectors its write cache holds
+    DiskDevice diskDevice;      // the model of its media
+    int diskCount;              // disks the sectors are striped across
+    int numMounts;              // file systems to mount, from -mount:
+    char *mountDisks[MaxMounts]; // the UNIX files holding their disks
+    char *mountPaths[MaxMounts]; // and the directories they go on
+    PagePolicy pagePolicy;      // which page to evict when memory is full
+    TlbPolicy tlbPolicy;        // which TLB entry a refill replaces
+    int superpagePages;         // pages a TLB entry can map at once
+    bool invertedRefill;        // refill the TLB from the inverted
+                                // page table
+    int swapPoolPages;          // size of the compressed swap pool
+    int workingSetInterval;     // ticks between working set samples;
+                                // 0 for no load control
+    bool reapFlag;              // tear address spaces down in the
+                                // background
+    int cacheSize[2];           // bytes of the L1 and L2 CPU caches;
+                                // 0 if not simulated
+    int cacheWays[2];           // their associativity
+    int cacheLine[2];           // and line size
 // #ifdef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
 // #endif
@@ -0,0 +1,156 @@
+// kernelprofile.cc
+//	Routines to profile where the kernel spends its time.  See
+//	kernelprofile.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "kernelprofile.h"
+#include "main.h"
+#include "sysdep.h"
+
+static const int MaxStackLength = 1000;	// longest stack recorded, in bytes
+
+//----------------------------------------------------------------------
+// ProfileRegion::ProfileRegion
+// 	Enter the region "regionName" (a string constant), inside whatever
+//	region the running thread is already in.  Nothing is done if the
+//	kernel is not being profiled.
+//----------------------------------------------------------------------
+
+ProfileRegion::ProfileRegion(char *regionName)
+{
+    open = (kernel->kernelProfiler != NULL);
+    if (!open)
+	return;
+    name = regionName;
+    startTicks = kernel->stats->totalTicks;
+    startNs = HostNanoseconds();
+    childTicks = childNs = 0;
+    outer = kernel->currentThread->region;
+    kernel->currentThread->region = this;
+}
+
+//----------------------------------------------------------------------
+// ProfileRegion::~ProfileRegion
+// 	Leave the region: count the time it took, less that of the regions
+//	inside it, and charge all of it to the region it was inside.
+//----------------------------------------------------------------------
+
+ProfileRegion::~ProfileRegion()
+{
+    if (!open)
+	return;
+
+    long long ticks = kernel->stats->totalTicks - startTicks;
+    long long hostNs = HostNanoseconds() - startNs;
+
+    ASSERT(kernel->currentThread->region == this);
+    kernel->kernelProfiler->Count(this, ticks - childTicks, hostNs - childNs);
+    if (outer != NULL) {
+	outer->childTicks += ticks;
+	outer->childNs += hostNs;
+    }
+    kernel->currentThread->region = outer;
+}
+
+//----------------------------------------------------------------------
+// KernelProfiler::KernelProfiler / ~KernelProfiler
+// 	Start with no records; they go to "fileName" (and "fileName".ns)
+//	at halt.  De-allocate them all at the end.
+//----------------------------------------------------------------------
+
+KernelProfiler::KernelProfiler(char *fileName)
+{
+    this->fileName = fileName;
+    records = new List<RegionStats *>;
+}
+
+KernelProfiler::~KernelProfiler()
+{
+    while (!records->IsEmpty()) {
+	RegionStats *r = records->RemoveFront();
+
+	delete [] r->stack;
+	delete r;
+    }
+    delete records;
+}
+
+//----------------------------------------------------------------------
+// KernelProfiler::Count
+// 	Add "ticks" and "hostNs" of self time to the record of the stack
+//	"region" ends, making it the first time that stack is seen.
+//----------------------------------------------------------------------
+
+void
+KernelProfiler::Count(ProfileRegion *region, long long ticks, long long hostNs)
+{
+    char stack[MaxStackLength];
+    int length = 0;
+    ProfileRegion *r;
+
+    for (r = region; r != NULL; r = r->outer)	// how long the names are
+	length += strlen(r->name) + 1;
+    ASSERT(length <= MaxStackLength);
+    stack[--length] = '\0';
+    for (r = region; r != NULL; r = r->outer) {	// fill them in from the end
+	int n = strlen(r->name);
+
+	length -= n;
+	bcopy(r->name, &stack[length], n);
+	if (length > 0)
+	    stack[--length] = ';';
+    }
+
+    ListIterator<RegionStats *> it(records);
+    RegionStats *record = NULL;
+
+    for (; !it.IsDone(); it.Next()) {
+	if (strcmp(it.Item()->stack, stack) == 0) {
+	    record = it.Item();
+	    break;
+	}
+    }
+    if (record == NULL) {
+	record = new RegionStats;
+	record->stack = new char[strlen(stack) + 1];
+	strcpy(record->stack, stack);
+	record->ticks = record->hostNs = 0;
+	records->Append(record);
+    }
+    record->ticks += ticks;
+    record->hostNs += hostNs;
+}
+
+//----------------------------------------------------------------------
+// KernelProfiler::Write
+// 	Write every record, as "stack count" lines: the ticks to our file,
+//	and the host nanoseconds to another with ".ns" on its name.
+//----------------------------------------------------------------------
+
+void
+KernelProfiler::Write()
+{
+    char *nsName = new char[strlen(fileName) + 4];
+    int ticksFile, nsFile;
+    char line[MaxStackLength + 30];
+
+    sprintf(nsName, "%s.ns", fileName);
+    ticksFile = OpenForWrite(fileName);
+    nsFile = OpenForWrite(nsName);
+
+    ListIterator<RegionStats *> it(records);
+
+    for (; !it.IsDone(); it.Next()) {
+	sprintf(line, "%s %lld\n", it.Item()->stack, it.Item()->ticks);
+	WriteFile(ticksFile, line, strlen(line));
+	sprintf(line, "%s %lld\n", it.Item()->stack, it.Item()->hostNs);
+	WriteFile(nsFile, line, strlen(line));
+    }
+    Close(ticksFile);
+    Close(nsFile);
+    delete [] nsName;
+}
@@ -0,0 +1,82 @@
+// kernelprofile.h
+//	Data structures for profiling where the kernel spends its time,
+//	when Nachos is run with -kp <file>.
+//
+//	Code marks a region by declaring a ProfileRegion, named for it,
+//	at the top of the block; the region ends when the block does.
+//	Regions nest, in each thread, just as the calls do: the region of
+//	a thread's innermost open region is kept in the thread, as each
+//	thread has its own stack.  When a region ends, its self time --
+//	what it took, less what the regions inside it took -- is added to
+//	the record for its stack: the names of the regions open around
+//	it, outermost first, separated by ";".  Time is counted two ways:
+//
+//	   simulated ticks -- including time the thread spent waiting
+//		for the disk, or for the CPU (a region inside
+//		Scheduler::Run is the time until the thread ran again)
+//	   host nanoseconds -- what the simulator itself took
+//
+//	At halt, the records are written in the "collapsed stack" format
+//	that flame graph tools read, one stack and its count per line:
+//	the ticks to the file, and the nanoseconds to the file with ".ns"
+//	after its name.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef KERNELPROFILE_H
+#define KERNELPROFILE_H
+
+#include "list.h"
+
+// The following class defines the time spent in one stack of regions.
+
+class RegionStats {
+  public:
+    char *stack;			// the region names, outermost first
+    long long ticks;			// simulated self time in it
+    long long hostNs;			// host self time in it
+};
+
+// The following class defines one region, while it is open.  Make one
+// on the stack of the code to be profiled; it does nothing unless
+// Nachos is profiling the kernel.
+
+class ProfileRegion {
+  public:
+    ProfileRegion(char *regionName);	// Enter the region
+    ~ProfileRegion();			// Leave it, and count its time
+
+  private:
+    char *name;				// a string constant
+    bool open;				// being profiled?
+    Ticks startTicks;			// when it was entered
+    long long startNs;
+    long long childTicks;		// taken by the regions inside it
+    long long childNs;
+    ProfileRegion *outer;		// the one it is inside, or NULL
+
+    friend class KernelProfiler;
+};
+
+// The following class defines the collection of all the records.
+
+class KernelProfiler {
+  public:
+    KernelProfiler(char *fileName);	// Start with no records
+    ~KernelProfiler();			// De-allocate them
+
+    void Count(ProfileRegion *region, long long ticks, long long hostNs);
+					// Add a region's self time to the
+					// record of its stack
+    void Write();			// Write the files, at halt
+
+  private:
+    char *fileName;			// where the ticks go
+    List<RegionStats *> *records;	// in the order first seen
+};
+
+#endif // KERNELPROFILE_H
@@ -4,31 +4,231 @@
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
 //              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
-//              -p <nachos file> -r <nachos file> -l -D
+//              -f -cp <unix file> <nachos file> -cpm <manifest>
+//              -mkfs <unix directory>
+//              -p <nachos file> -r <nachos file> -rr <nachos file>
+//              -mv <nachos file> <nachos file> -l -D -Dfull <page>
 //              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+//              -z -K -C -N -serve <client> -rfs <server>
+//              -rcp <unix file> <remote file> -rp <remote file>
 //
 //    -d causes certain debugging messages to be printed (see debug.h)
 //    -rs causes Yield to occur at random (but repeatable) spots
 //    -z prints the copyright message
 //    -s causes user programs to be executed in single-step mode
+//    -bb advances simulated time once per basic block of user code,
+//	  not once per instruction
+//    -tl makes time slicing "tickless": the timer only goes off when
+//	  another thread is ready to run
+//    -tq sets, for -tl, how many ticks a thread runs before it is
+//	  switched out (TimerTicks by default)
+//    -stats prints the performance statistics at halt, overall and
+//	  for each thread, how long each code of system call took, and
+//	  the host memory the kernel's objects take, by type (see
+//	  lib/memcount.h)
+//    -sl writes how long each code of system call took, as JSON, to
+//	  the given file at halt (see lib/histogram.h)
+//    -sj appends the main counters, and the host seconds the run took,
+//	  to the given file at halt, as a JSON object on a line of its
+//	  own, for test_case.py to hold to a budget
+//    -snap appends a line of the main counters to the given file
+//	  every so many ticks, for plotting them over the run
+//	  (kill -USR1 prints the statistics so far at any time)
+//    -lp profiles the contention on semaphores, locks and condition
+//	  variables, and prints it at halt, the longest waits first
+//    -ho hands semaphores, locks and signalled conditions straight to
+//	  the thread that has waited longest, instead of letting it
+//	  compete for them once it runs (see synch.h)
+//    -tr records disk requests, system calls, context switches and
+//	  synchronization in memory, and writes them to the given file at
+//	  halt (see test/trace.py)
+//    -prof samples the PC of user programs, and writes where each
+//	  spent its time to the given file (see userprog/profiler.h and
+//	  test/profile.py)
+//    -kp profiles where the kernel's time goes, in simulated ticks and
+//	  host time, and writes it at halt to the given file and one with
+//	  ".ns" after its name, for flame graphs (see
+//	  threads/kernelprofile.h)
+//    -l1 simulates a CPU cache of the given size, associativity and
+//	  line size in bytes (as "8192,2,32"), and charges user programs
+//	  for its misses; -l2 puts a second level behind it (see
+//	  machine/cpucache.h)
+//    -ws samples the working set of each program every so many ticks,
+//	  and suspends programs while together they need more frames
+//	  than there are (see userprog/loadcontrol.h)
+//    -reap takes the address spaces of programs that have exited
+//	  apart in a background thread, several at a time, instead of
+//	  in the exiting thread (see userprog/reaper.h)
+//    -fa reads up to the given number of pages (at most 8) after one
+//	  that faults, when they follow it in its file, with the same
+//	  read; how many goes by how many were used the last time
+//	  (see AddrSpace::ReadCluster)
+//    -zs compresses evicted pages into a pool of the given number of
+//	  pages in kernel memory, and only writes them to the swap file
+//	  when it is full (see userprog/swapspace.h)
+//    -sp maps an aligned group of the given number of pages (2, 4, 8
+//	  or 16) with one TLB entry, when the group is in memory in
+//	  frames in order, and places pages in frames so that it is
+//	  (see userprog/tlbmanager.h); built with USE_TLB only
+//    -ipt refills the TLB from the frame table's inverted page table,
+//	  hashed by page, instead of walking the program's page table
+//	  (see userprog/frametable.h); built with USE_TLB only
+//    -record writes the input that comes from outside -- console
+//	  characters, packets, and the random seed -- to the given file,
+//	  with when it came in; -replay runs again with the input from
+//	  such a file, instead of from the console and the network
+//	  (see machine/inputlog.h)
+//    -sched sets the policy for picking the next thread to run: fifo
+//	  (the default), mlfq, a multilevel feedback queue, or stride,
+//	  proportional share by the tickets set with SetTickets
+//    -smp gives the machine the given number of CPUs (at most 8),
+//	  each with its own running thread and ready queues, taking
+//	  turns on the one simulated machine (see threads/scheduler.h)
 //    -x runs a user program
 //    -ci specify file for console input (stdin is the default)
 //    -co specify file for console output (stdout is the default)
 //    -n sets the network reliability
+//    -nl gives the network links a latency, in ticks, and a bandwidth,
+//	  in bytes per tick (0 for packets to take NetworkTime whatever
+//	  their size), and optionally a jitter, the most ticks a packet
+//	  may take on top of the latency (see machine/network.h)
+//    -nq lets the given number of packets that have arrived wait to be
+//	  received; one that arrives to a full queue is dropped
 //    -m sets this machine's host id (needed for the network)
 //    -K run a simple self test of kernel threads and synchronization
+//    -bench-threads runs the benchmark of context switching and
+//	  synchronization, writing its results to the given file as JSON
+//	  (see threads/threadbench.h)
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
+//    -NS sends the given number of bytes from machine 0 to machine 1
+//	  over a reliable connection (see Kernel::StreamTest)
+//    -serve serves this machine's file system to the given machine; it
+//	  may be given once for each client, and the machine halts once
+//	  they have all unmounted (see network/remotefs.h)
+//    -rfs uses the file system of the given machine for -rcp and -rp,
+//	  and prints how well its cache did
+//    -rcp copies a file from UNIX to the -rfs machine
+//    -rp prints a file of the -rfs machine to stdout
+//    -replica mirrors every sector this machine writes to its disk onto
+//	  the disk of the given machine, which must be running with
+//	  -backup, and prints how far behind it was (see network/replica.h)
+//    -machines runs several machines in this one process, each on a
+//	  host thread of its own, with the network between them on rings
+//	  rather than sockets (see machine/network.h).  What comes after
+//	  it is split at each "--", one part for each machine; machine i
+//	  gets "-m i", then the arguments before -machines, then its own
+//	  part: "nachos -machines -N -- -N" is the network test.
+//    -backup takes the writes of the given -replica machine onto this
+//	  machine's disk, and halts, without unmounting, once it has
+//	  halted
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
-//    -cp copies a file from UNIX to Nachos
+//    -cp copies a file from UNIX to Nachos; it may be given several
+//	  times, and the files are copied in order
+//    -cpm copies the files, and makes the directories, listed in a
+//	  UNIX file, one per line (see CopyManifest)
+//    -mkfs copies a whole UNIX directory tree into the root, the
+//	  directories first and then the files, largest first (see
+//	  PackTree); with -f and -dm, "make image" builds a disk image
+//	  this way in one boot
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
+//    -rr removes a Nachos file, or a directory and everything under it
+//    -mv gives a Nachos file or directory a new name
 //    -l lists the contents of the Nachos directory
-//    -D prints the contents of the entire file system
+//    -lr lists it, and every directory under it
+//    -D prints a summary of the file system -- how many files and
+//	  directories, the space they take, how fragmented they and the
+//	  free space are, and each directory's totals -- from its
+//	  metadata alone, and the I/O counters of each file used so far
+//	  in the run
+//    -Dfull prints one page of the contents of the entire file
+//	  system: the headers and data of DumpPageFiles files, the
+//	  first page (0) with the free map
+//    -stat prints the length of a Nachos file or directory, and how
+//	  many sectors and runs of sectors it takes, without opening it
+//    -frag prints how many runs of sectors a Nachos file is in, and
+//	  about how long seeking between them takes
+//    -defrag moves every fragmented file into a run of sectors of its
+//	  own, in a background thread, and waits for it to finish
+//    -clone copies a Nachos file to a new one that shares its sectors
+//	  until either is written to
+//    -dedup makes every sector that holds the same bytes as another
+//	  shared with it, and prints how many sectors that freed
+//    -fsck checks which sectors are in use against the free map and
+//	  the share counts, and repairs them (see filesys/fscheck.h); it
+//	  is done before the other file system flags
+//    -wt makes the buffer cache write-through (default is write-back)
+//    -cs splits the buffer cache into that many shards, each with its
+//	  own lock, so that a miss only holds up the sectors of its own
+//	  shard (see filesys/bufcache.h)
+//    -c2q makes the buffer cache replace sectors by 2Q rather than LRU,
+//	  so that a file streaming through does not push out the sectors
+//	  used over and over (see filesys/bufcache.h)
+//    -cmeta makes it keep file headers, directories and the free map
+//	  ahead of file data
+//    -crc keeps a checksum of every sector the file system writes, and
+//	  checks each one read from the disk against it (see
+//	  filesys/sectorsum.h); once a disk has them, they are kept
+//	  whether or not it is given
+//    -ro mounts the file system read-only: nothing on the disk is
+//	  changed, and directories and file headers stay in memory once
+//	  read, so lookups take no locks (see FileSystem::IsReadOnly); it
+//	  is ignored with -f
+//    -lfs, with -f, formats the disk as a log: every sector written is
+//	  appended to it, instead of being written in place, and a
+//	  cleaner makes room again (see filesys/seglog.h); a disk
+//	  formatted so is mounted so from then on
+//    -eh puts the header of each file created in a directory that has
+//	  not grown in the sectors right after the directory's entries,
+//	  and reads those with the entries when a name is looked up in
+//	  it, so that opening the file reads nothing more
+//    -tp makes -lr and -rr, as they go into each directory, start
+//	  reading the directories in it all at once; worth it when the
+//	  disk is striped (-dn)
+//    -ds sets the order queued disk requests are served in: fifo (the
+//	  default), sstf, scan or clook
+//    -dm maps the disk's UNIX file into memory, so that sectors are
+//	  read and written by copying instead of by UNIX calls
+//    -disk names the disk's UNIX file (DISK_0, or DISK_ and the -m
+//	  machine id, by default), so that runs side by side can each
+//	  have a disk of their own
+//    -dbase makes the disk a copy-on-write overlay on the given disk
+//	  image, which is only read: what is written goes to the disk's
+//	  own file (see machine/disk.h)
+//    -ckpt saves the running user program, with the disk, to the given
+//	  file at the first time slice from the given tick on; -restore
+//	  starts it again from there, with the disk an overlay on the
+//	  file, as with -dbase (see userprog/checkpoint.h)
+//    -mount mounts the file system on the disk in the given UNIX file
+//	  on the given directory, which is made if it is not there; with
+//	  -f, the disk is formatted first.  The disk is one of its own,
+//	  with a buffer cache and an inode table of its own, but made as
+//	  the flags for the root's say, except that it is never striped,
+//	  an overlay or mirrored (see filesys/mounttable.h)
+//    -dtb sets how many track buffers the disk has (1 by default)
+//    -dwc gives the disk a write cache of the given number of sectors
+//	  (by default it has none)
+//    -dmodel sets how long the disk's media takes: like a rotating disk
+//	  (the default), like flash, or no time at all, for a RAM disk
+//	  that is not kept (see machine/disk.h)
+//    -dn stripes the disk's sectors across the given number of disks,
+//	  which work side by side (see machine/volume.h); they must be
+//	  formatted together, with the same -dn
+//    -dmap counts the reads and writes of each sector of the disk, and
+//	  writes them to the given file at the end
+//    -cd makes the file names of the other flags that do not start
+//	  with "/" relative to the given directory
+//    -ext makes -cp, -cpm and -mkfs create the Nachos files in the extent format
+//    -compress makes them create the Nachos files compressed (see
+//	  filesys/clusterbuf.h)
+//    -bench runs the file system benchmark, writing its results to the
+//	  given file as JSON (see filesys/fsbench.h)
+//    -batch runs the file system commands in the given file ("-" for
+//	  the standard input), one per line, in a single boot (see
+//	  RunBatch); they are run after those of the other flags
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -44,11 +244,22 @@
 #include "main.h"
 #include "filesys.h"
 #include "openfile.h"
+#include "disk.h"
+#include "fsbench.h"
+#include "threadbench.h"
+#include "remotefs.h"
+#include "replica.h"
+#include "synchdisk.h"
 #include "sysdep.h"
+#include "list.h"
 
-// global variables
-Kernel *kernel;
-Debug *debug;
+// global variables; each machine has its own, on the host thread it
+// runs on (-machines)
+thread_local Kernel *kernel;
+thread_local Debug *debug;
+Wires *wires = NULL;		// between them all, if there are several
+
+static const int MaxMachines = 8;	// on the wires of one process
 
 //----------------------------------------------------------------------
 // Cleanup
@@ -62,60 +273,411 @@ Cleanup(int x)
     delete kernel;
 }
 
+//----------------------------------------------------------------------
+// DumpStats
+//	Ask for the statistics so far to be printed; called when the
+//	host sends SIGUSR1.  They are printed at the next tick (see
+//	Statistics::Report), not here in the middle of whatever the
+//	simulation was doing.
+//----------------------------------------------------------------------
+
+static void
+DumpStats(int x)
+{
+    if (kernel != NULL)		// a host thread without one got it
+	kernel->stats->dumpRequested = TRUE;
+}
+
 //-------------------------------------------------------------------
-// Constant used by "Copy" and "Print"
-//   It is the number of bytes read from the Unix file (for Copy)
-//   or the Nachos file (for Print) by each read operation
+// Constant used by "Print"
+//   It is the number of bytes read from the Nachos file by each
+//   read operation
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+//-------------------------------------------------------------------
+// Constant used by "-serve"
+//   It is the number of clients one machine can serve
+//-------------------------------------------------------------------
+static const int MaxClients = 8;
+
 #ifndef FILESYS_STUB
+//-------------------------------------------------------------------
+// Constants used by "Copy" and "CopyManifest"
+//   ImportSize is the number of bytes read from the Unix file, and
+//   written to the Nachos file, at a time by Copy: big enough that
+//   each write goes past the file's write buffer to the disk as a
+//   few long runs of sectors.  MaxCopies is how many -cp flags
+//   one command line may have.
+//-------------------------------------------------------------------
+static const int ImportSize = 64 * SectorSize;
+static const int MaxCopies = 64;
+
 //----------------------------------------------------------------------
 // Copy
 //      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//	If "useExtents", the Nachos file uses the extent header format;
+//	if "compressed", it is kept compressed instead.
+//
+//	The Nachos file is created with the length of the UNIX file, and
+//	all of its sectors are set aside at once (see OpenFile::Allocate),
+//	in as few runs as the free map allows, so a file that does not
+//	fit is turned away before anything is written.  Should the disk
+//	fill up anyway, what was copied is removed.  Return FALSE if it
+//	could not be copied.
 //----------------------------------------------------------------------
 
-static void
-Copy(char *from, char *to)
+static bool
+Copy(char *from, char *to, bool useExtents, bool compressed)
 {
     int fd;
     OpenFile *openFile;
-    int amountRead, fileLength;
+    int fileLength, amountRead = 0, copied;
     char *buffer;
 
     // Open UNIX file
     if ((fd = OpenForReadWrite(from, FALSE)) < 0)
     {
         printf("Copy: couldn't open input file %s\n", from);
-        return;
+        return FALSE;
     }
-
-    // Figure out length of UNIX file
-    Lseek(fd, 0, 2);
+    Lseek(fd, 0, SEEK_END);
     fileLength = Tell(fd);
-    Lseek(fd, 0, 0);
+    Lseek(fd, 0, SEEK_SET);
 
     // Create a Nachos file of the same length
-    DEBUG('f', "Copying file " << from << " of size " << fileLength << " to file " << to);
-    if (!kernel->fileSystem->Create(to, fileLength))
+    DEBUG('f', "Copying file " << from << " to file " << to << ", " << fileLength << " bytes");
+    if (!kernel->fileSystem->Create(to, fileLength, useExtents, compressed))
     { // Create Nachos file
         printf("Copy: couldn't create output file %s\n", to);
         Close(fd);
-        return;
+        return FALSE;
     }
 
     openFile = kernel->fileSystem->Open(to);
     ASSERT(openFile != NULL);
+    if (fileLength > 0 && !openFile->Allocate(0, fileLength))
+    {
+        printf("Copy: couldn't create output file %s\n", to);
+        delete openFile;
+        kernel->fileSystem->Remove(to);
+        Close(fd);
+        return FALSE;
+    }
 
-    // Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * TransferSize)) > 0)
-        openFile->Write(buffer, amountRead);
+    // Copy the data in ImportSize chunks
+    buffer = new char[ImportSize];
+    copied = 0;
+    while (copied < fileLength
+           && (amountRead = ReadPartial(fd, buffer, min(ImportSize, fileLength - copied))) > 0)
+    {
+        if (openFile->Write(buffer, amountRead) < amountRead)
+            break; // disk full
+        copied += amountRead;
+    }
     delete[] buffer;
 
-    // Close the UNIX and the Nachos files
+    // Close the UNIX and the Nachos files; a file that changed size
+    // under us is not left behind half copied
     delete openFile;
     Close(fd);
+    if (copied < fileLength)
+    {
+        kernel->fileSystem->Remove(to);
+        if (amountRead > 0)
+            printf("Copy: couldn't create output file %s\n", to);
+        else
+            printf("Copy: couldn't read input file %s\n", from);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// ReadHostFile
+//      Read the whole UNIX file "name" ("-" for the standard input)
+//	into a new array, with a '\0' after the last byte.  Return NULL if
+//	it cannot be opened.
+//----------------------------------------------------------------------
+
+static char *
+ReadHostFile(char *name)
+{
+    int fd, length, size, amountRead;
+    char *text, *bigger;
+
+    if (strcmp(name, "-") == 0)
+        fd = 0;
+    else if ((fd = OpenForReadWrite(name, FALSE)) < 0)
+        return NULL;
+    size = ImportSize;
+    text = new char[size + 1];
+    length = 0;
+    while ((amountRead = ReadPartial(fd, &text[length], size - length)) > 0)
+    {
+        length += amountRead;
+        if (length == size)
+        {
+            bigger = new char[2 * size + 1];
+            bcopy(text, bigger, length);
+            delete[] text;
+            text = bigger;
+            size *= 2;
+        }
+    }
+    text[length] = '\0';
+    if (fd != 0)
+        Close(fd);
+    return text;
+}
+
+//----------------------------------------------------------------------
+// NextLine
+//      Split the next line of "*text" into words, in place, storing at
+//	most "maxWords" of them in "words", and move "*text" on to the
+//	line after it (NULL after the last).  Anything from a '#' on is
+//	a comment.  Return how many words the line has, or maxWords + 1
+//	if it has too many.
+//----------------------------------------------------------------------
+
+static int
+NextLine(char **text, char **words, int maxWords)
+{
+    char *p = *text;
+    char *next = strchr(p, '\n');
+    int numWords = 0;
+
+    if (next != NULL)
+        *next++ = '\0';
+    *text = next;
+    while (*p != '\0' && *p != '#')
+    {
+        if (*p == ' ' || *p == '\t' || *p == '\r')
+        {
+            *p++ = '\0';
+            continue;
+        }
+        if (numWords == maxWords)
+            return maxWords + 1;
+        words[numWords++] = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r')
+            p++;
+    }
+    return numWords;
+}
+
+//----------------------------------------------------------------------
+// CopyManifest
+//      Stage many files in one run: carry out the lines of the UNIX
+//	file "manifest" in order.  A line is either
+//
+//		<unix file> <nachos file>	copy the file, as with -cp
+//		mkdir <nachos directory>	make the directory
+//
+//	Blank lines, and comments starting with '#', are skipped.  Stops
+//	at the first line that fails.
+//----------------------------------------------------------------------
+
+static void
+CopyManifest(char *manifest, bool useExtents, bool compressed)
+{
+    char *text, *line, *words[2];
+    int numWords, lineNo;
+
+    if ((text = ReadHostFile(manifest)) == NULL)
+    {
+        printf("Copy: couldn't open manifest %s\n", manifest);
+        return;
+    }
+    for (line = text, lineNo = 1; line != NULL; lineNo++)
+    {
+        numWords = NextLine(&line, words, 2);
+        if (numWords == 0)
+            continue;
+        if (numWords != 2)
+        {
+            printf("Copy: %s line %d: expected two names\n", manifest, lineNo);
+            break;
+        }
+        if (strcmp(words[0], "mkdir") == 0)
+        {
+            if (!kernel->fileSystem->MakeNewDir(words[1]))
+            {
+                printf("Copy: couldn't create directory %s\n", words[1]);
+                break;
+            }
+        }
+        else if (!Copy(words[0], words[1], useExtents, compressed))
+            break;
+    }
+    delete[] text;
+}
+
+// The following class defines one file or directory of a UNIX tree
+// being packed into the Nachos file system.
+
+class PackEntry
+{
+public:
+    char *hostName;   // where it is in UNIX
+    char *nachosName; // and where it goes in Nachos
+    int length;       // bytes, for a file
+};
+
+// "dir", a "/", then "name", in a new array
+static char *
+JoinPath(char *dir, char *name)
+{
+    char *path = new char[strlen(dir) + strlen(name) + 2];
+
+    sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+// qsort orders: names alphabetically; files largest first, and
+// alphabetically by name between files of the same length
+static int
+CompareNames(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+static int
+LargerFirst(const void *a, const void *b)
+{
+    PackEntry *x = *(PackEntry **)a;
+    PackEntry *y = *(PackEntry **)b;
+
+    if (x->length != y->length)
+        return (x->length > y->length) ? -1 : 1;
+    return strcmp(x->nachosName, y->nachosName);
+}
+
+//----------------------------------------------------------------------
+// PackTree
+//      Copy the UNIX directory "hostDir", and everything under it, into
+//	the root of the Nachos file system, in one go (-mkfs).  The tree
+//	is walked first, breadth first and each directory in order of
+//	name, so that the run is the same whatever order UNIX lists them
+//	in.  Then every directory is made, parents first: their headers
+//	and entries end up together, near the root, ahead of any data.
+//	Then the files are copied, the largest first (see Copy), so that
+//	each big file gets a run of sectors to itself while there are
+//	still long ones free, and the small ones fill in after them.
+//
+//	What cannot be copied -- a name too long, or no room -- is
+//	reported, and the rest is copied anyway.
+//----------------------------------------------------------------------
+
+static void
+PackTree(char *hostDir, bool useExtents, bool compressed)
+{
+    ::List<PackEntry *> pending; // directories still to be walked
+    ::List<PackEntry *> dirs;    // and those that have been
+    ::List<PackEntry *> found;   // the files in them
+    PackEntry *entry, **files;
+    int numFiles, numCopied = 0, numFailed = 0, numBytes = 0, numDirs = 0;
+    int i;
+
+    entry = new PackEntry;
+    entry->hostName = new char[strlen(hostDir) + 1];
+    strcpy(entry->hostName, hostDir);
+    entry->nachosName = new char[1];
+    entry->nachosName[0] = '\0'; // the root
+    entry->length = 0;
+    pending.Append(entry);
+    while (!pending.IsEmpty())
+    {
+        PackEntry *dir = pending.RemoveFront();
+        void *host = OpenHostDirectory(dir->hostName);
+        ::List<char *> names;
+        char **sorted, *name;
+        int numNames;
+
+        dirs.Append(dir);
+        if (host == NULL)
+        {
+            printf("Pack: couldn't read directory %s\n", dir->hostName);
+            numFailed++;
+            continue;
+        }
+        while ((name = NextHostEntry(host)) != NULL)
+        {
+            char *copy = new char[strlen(name) + 1];
+
+            strcpy(copy, name);
+            names.Append(copy);
+        }
+        CloseHostDirectory(host);
+        numNames = names.NumInList();
+        sorted = new char *[numNames + 1];
+        for (i = 0; i < numNames; i++)
+            sorted[i] = names.RemoveFront();
+        qsort(sorted, numNames, sizeof(char *), CompareNames);
+        for (i = 0; i < numNames; i++)
+        {
+            bool isDirectory;
+
+            entry = new PackEntry;
+            entry->hostName = JoinPath(dir->hostName, sorted[i]);
+            entry->nachosName = JoinPath(dir->nachosName, sorted[i]);
+            entry->length = HostFileLength(entry->hostName, &isDirectory);
+            delete[] sorted[i];
+            if (entry->length < 0)
+            {
+                printf("Pack: couldn't read %s\n", entry->hostName);
+                numFailed++;
+                dirs.Append(entry); // only to be deleted
+            }
+            else if (isDirectory)
+                pending.Append(entry);
+            else
+                found.Append(entry);
+        }
+        delete[] sorted;
+    }
+
+    for (ListIterator<PackEntry *> it(&dirs); !it.IsDone(); it.Next())
+    {
+        entry = it.Item();
+        if (entry->nachosName[0] == '\0' || entry->length < 0)
+            continue; // the root, or what could not be read
+        if (kernel->fileSystem->MakeNewDir(entry->nachosName))
+            numDirs++;
+        else
+        {
+            printf("Pack: couldn't create directory %s\n", entry->nachosName);
+            numFailed++;
+        }
+    }
+
+    numFiles = found.NumInList();
+    files = new PackEntry *[numFiles + 1];
+    for (i = 0; i < numFiles; i++)
+        files[i] = found.RemoveFront();
+    qsort(files, numFiles, sizeof(PackEntry *), LargerFirst);
+    for (i = 0; i < numFiles; i++)
+    {
+        if (Copy(files[i]->hostName, files[i]->nachosName, useExtents, compressed))
+        {
+            numCopied++;
+            numBytes += files[i]->length;
+        }
+        else
+            numFailed++;
+        dirs.Append(files[i]); // to be deleted
+    }
+    delete[] files;
+
+    printf("Packed %s: %d directories, %d files, %d bytes; %d failed\n",
+           hostDir, numDirs, numCopied, numBytes, numFailed);
+    while (!dirs.IsEmpty())
+    {
+        entry = dirs.RemoveFront();
+        delete[] entry->hostName;
+        delete[] entry->nachosName;
+        delete entry;
+    }
 }
 
 #endif // FILESYS_STUB
@@ -148,8 +710,243 @@ void Print(char *name)
 }
 
 //----------------------------------------------------------------------
-// main
-// 	Bootstrap the operating system kernel.
+// RemoteCopy
+//      Copy the contents of the UNIX file "from" to the file "to" on
+//	the machine "fs" uses.  The writes go out without waiting for
+//	each other; closing the file waits until they are all done.
+//----------------------------------------------------------------------
+
+static void
+RemoteCopy(RemoteFileSystem *fs, char *from, char *to)
+{
+    RemoteFile *remoteFile;
+    int fd, fileLength, amountRead;
+    char *buffer;
+
+    if ((fd = OpenForReadWrite(from, FALSE)) < 0)
+    {
+        printf("RemoteCopy: couldn't open input file %s\n", from);
+        return;
+    }
+    Lseek(fd, 0, SEEK_END);
+    fileLength = Tell(fd);
+    Lseek(fd, 0, SEEK_SET);
+
+    if (!fs->Create(to, fileLength) || (remoteFile = fs->Open(to)) == NULL)
+    {
+        printf("RemoteCopy: couldn't create output file %s\n", to);
+        Close(fd);
+        return;
+    }
+
+    buffer = new char[RemoteBlockSize];
+    while ((amountRead = ReadPartial(fd, buffer, RemoteBlockSize)) > 0)
+        remoteFile->Write(buffer, amountRead);
+    delete[] buffer;
+
+    delete remoteFile;
+    Close(fd);
+}
+
+//----------------------------------------------------------------------
+// RemotePrint
+//      Print the contents of the file "name" on the machine "fs" uses,
+//	read in small pieces, as Print does: most of them come out of
+//	the cache, read ahead while the ones before were printed.
+//----------------------------------------------------------------------
+
+static void
+RemotePrint(RemoteFileSystem *fs, char *name)
+{
+    RemoteFile *remoteFile;
+    int i, amountRead;
+    char *buffer;
+
+    if ((remoteFile = fs->Open(name)) == NULL)
+    {
+        printf("RemotePrint: unable to open file %s\n", name);
+        return;
+    }
+
+    buffer = new char[TransferSize];
+    while ((amountRead = remoteFile->Read(buffer, TransferSize)) > 0)
+        for (i = 0; i < amountRead; i++)
+            printf("%c", buffer[i]);
+    delete[] buffer;
+
+    delete remoteFile;
+}
+
+#ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// MakeDirectory
+//      Make the Nachos directory "name", and say whether it worked.
+//----------------------------------------------------------------------
+
+static void
+MakeDirectory(char *name)
+{
+    if (kernel->fileSystem->MakeNewDir(name))
+        cout << "Success on creating new folder.." << endl;
+    else
+        cout << "Failed on creating new folder.." << endl;
+}
+
+//----------------------------------------------------------------------
+// Rename
+//      Give the Nachos file or directory "from" the name "to", and say
+//	so if that did not work.
+//----------------------------------------------------------------------
+
+static void
+Rename(char *from, char *to)
+{
+    if (!kernel->fileSystem->Rename(from, to))
+        cout << "Could not rename " << from << " to " << to << "\n";
+}
+
+//----------------------------------------------------------------------
+// Clone
+//      Copy the Nachos file "from" to the new file "to", sharing its
+//	sectors, and say so if that did not work.
+//----------------------------------------------------------------------
+
+static void
+Clone(char *from, char *to)
+{
+    if (!kernel->fileSystem->Clone(from, to))
+        cout << "Could not clone " << from << " to " << to << "\n";
+}
+
+//----------------------------------------------------------------------
+// PrintStat
+//      Print what FileSystem::Stat says about the Nachos file "name",
+//	or that there is no such file.
+//----------------------------------------------------------------------
+
+static void
+PrintStat(char *name)
+{
+    StatInfo info;
+
+    if (!kernel->fileSystem->Stat(name, &info))
+    {
+        cout << "No file " << name << "\n";
+        return;
+    }
+    cout << name << ": " << (info.type == IS_DIR ? "Dir" : "File") << ", "
+         << info.length << " bytes, " << info.numSectors << " sectors in "
+         << info.numFragments << " runs\n";
+}
+
+//----------------------------------------------------------------------
+// Deduplicate
+//      Share the sectors that hold the same bytes on the Nachos disk,
+//	and say how many sectors that freed.
+//----------------------------------------------------------------------
+
+static void
+Deduplicate()
+{
+    cout << "Deduplicating freed " << kernel->fileSystem->Deduplicate()
+         << " sectors\n";
+}
+
+//----------------------------------------------------------------------
+// RunBatch
+//      Carry out the file system commands in "text", read from the UNIX
+//	file "name", one per line and in order, all in this one boot of
+//	the kernel: the disk is mounted once, and the caches
+//	stay warm from one command to the next.  Each line is written
+//	the way the flag would be on the command line:
+//
+//		-cp <unix file> <nachos file>	-cpm <manifest>
+//		-mkfs <unix directory>
+//		-mkdir <directory>		-r <file>
+//		-rr <file or directory>		-p <file>
+//		-l <directory>			-lr <directory>
+//		-D				-Dfull <page>
+//		-cd <directory>
+//		-mv <from> <to>			-ext
+//		-frag <file>			-defrag
+//		-compress			-clone <from> <to>
+//		-dedup				-fsck
+//		-stat <file>
+//
+//	-cd, -ext and -compress apply to the lines after them.  -defrag starts the
+//	defragmenter, and goes on with the next line while it runs.  Blank lines, and
+//	comments starting with '#', are skipped; a line that is not a
+//	command is reported, and skipped too.
+//
+//	"useExtents" -- whether -ext was given on the command line
+//	"compressed" -- and -compress
+//----------------------------------------------------------------------
+
+static void
+RunBatch(char *name, char *text, bool useExtents, bool compressed)
+{
+    char *line, *words[3];
+    int numWords, lineNo;
+
+    for (line = text, lineNo = 1; line != NULL; lineNo++)
+    {
+        numWords = NextLine(&line, words, 3);
+        if (numWords == 0)
+            continue;
+        if (strcmp(words[0], "-cp") == 0 && numWords == 3)
+            Copy(words[1], words[2], useExtents, compressed);
+        else if (strcmp(words[0], "-cpm") == 0 && numWords == 2)
+            CopyManifest(words[1], useExtents, compressed);
+        else if (strcmp(words[0], "-mkfs") == 0 && numWords == 2)
+            PackTree(words[1], useExtents, compressed);
+        else if (strcmp(words[0], "-mkdir") == 0 && numWords == 2)
+            MakeDirectory(words[1]);
+        else if (strcmp(words[0], "-r") == 0 && numWords == 2)
+            kernel->fileSystem->Remove(words[1]);
+        else if (strcmp(words[0], "-rr") == 0 && numWords == 2)
+            kernel->fileSystem->RemoveTree(words[1]);
+        else if (strcmp(words[0], "-mv") == 0 && numWords == 3)
+            Rename(words[1], words[2]);
+        else if (strcmp(words[0], "-p") == 0 && numWords == 2)
+            Print(words[1]);
+        else if (strcmp(words[0], "-l") == 0 && numWords == 2)
+            kernel->fileSystem->List(words[1]);
+        else if (strcmp(words[0], "-lr") == 0 && numWords == 2)
+            kernel->fileSystem->ListRecursive(words[1]);
+        else if (strcmp(words[0], "-D") == 0 && numWords == 1)
+            kernel->fileSystem->PrintSummary();
+        else if (strcmp(words[0], "-Dfull") == 0 && numWords == 2)
+            kernel->fileSystem->Print(atoi(words[1]));
+        else if (strcmp(words[0], "-cd") == 0 && numWords == 2)
+        {
+            if (!kernel->fileSystem->ChangeDirectory(words[1]))
+                cout << "No directory " << words[1] << "\n";
+        }
+        else if (strcmp(words[0], "-ext") == 0 && numWords == 1)
+            useExtents = TRUE;
+        else if (strcmp(words[0], "-compress") == 0 && numWords == 1)
+            compressed = TRUE;
+        else if (strcmp(words[0], "-frag") == 0 && numWords == 2)
+            kernel->fileSystem->PrintFragmentation(words[1]);
+        else if (strcmp(words[0], "-stat") == 0 && numWords == 2)
+            PrintStat(words[1]);
+        else if (strcmp(words[0], "-defrag") == 0 && numWords == 1)
+            kernel->fileSystem->StartDefragmenter();
+        else if (strcmp(words[0], "-clone") == 0 && numWords == 3)
+            Clone(words[1], words[2]);
+        else if (strcmp(words[0], "-dedup") == 0 && numWords == 1)
+            Deduplicate();
+        else if (strcmp(words[0], "-fsck") == 0 && numWords == 1)
+            kernel->fileSystem->Check();
+        else
+            printf("Batch: %s line %d: not a command\n", name, lineNo);
+    }
+}
+#endif // FILESYS_STUB
+
+//----------------------------------------------------------------------
+// RunMachine
+// 	Bootstrap the operating system kernel of one machine.
 //
 //	Initialize kernel data structures
 //	Call some test routines
@@ -159,9 +956,13 @@ void Print(char *name)
 //		of the command) -- ex: "nachos -d +" -> argc = 3
 //	"argv" is an array of strings, one for each command line argument
 //		ex: "nachos -d +" -> argv = {"nachos", "-d", "+"}
+//
+//	It never returns: the machine halts, which ends the process, or
+//	only the host thread it runs on, with -machines (see Exit).
 //----------------------------------------------------------------------
 
-int main(int argc, char **argv)
+static void
+RunMachine(int argc, char **argv)
 {
     int i;
     char *debugArg = "";
@@ -169,16 +970,47 @@ int main(int argc, char **argv)
     bool threadTestFlag = false;
     bool consoleTestFlag = false;
     bool networkTestFlag = false;
+    char *threadBenchFileName = NULL; // where its results go
+    int streamTestBytes = 0;
+    int clientHost[MaxClients];      // machines to serve the file system to
+    int numClients = 0;
+    int remoteServer = -1;           // machine whose file system -rcp and
+                                     // -rp use
+    int backupPrimary = -1;          // machine whose writes to mirror
+    char *remoteCopyFrom = NULL;
+    char *remoteCopyTo = NULL;
+    char *remotePrintName = NULL;
 #ifndef FILESYS_STUB
-    char *copyUnixFileName = NULL;   // UNIX file to be copied into Nachos
-    char *copyNachosFileName = NULL; // name of copied file in Nachos
+    char *copyUnixFileName[MaxCopies];   // UNIX files to be copied into Nachos
+    char *copyNachosFileName[MaxCopies]; // names of copied files in Nachos
+    int numCopies = 0;
+    char *manifestName = NULL;       // UNIX file listing more of them
+    char *packTreeName = NULL;       // UNIX directory to copy, whole
+    char *batchName = NULL;          // UNIX file of commands to run
+    char *batchText = NULL;          // and what it says
     char *printFileName = NULL;
     char *removeFileName = NULL;
+    char *removeTreeName = NULL;     // -rr
+    char *renameFrom = NULL;         // -mv
+    char *renameTo = NULL;
+    char *cloneFrom = NULL;          // -clone
+    char *cloneTo = NULL;
+    bool dedupFlag = false;
+    bool checkFlag = false;
     char *createDirName = NULL;
+    char *workingDirName = NULL;     // where relative names start
     char * listDirName = NULL;
     bool dirListFlag = false;
+    bool recursiveListFlag = false;  // -lr rather than -l
     bool dumpFlag = false;
+    int dumpPage = -1;               // -Dfull
     bool makeDirFlag = false;
+    bool extentFlag = false;
+    bool compressFlag = false;
+    char *benchFileName = NULL;      // where the benchmark results go
+    char *fragFileName = NULL;       // -frag
+    char *statFileName = NULL;       // -stat
+    bool defragFlag = false;
 #endif // FILESYS_STUB
 
     // some command line arguments are handled here.
@@ -206,6 +1038,12 @@ int main(int argc, char **argv)
         {
             threadTestFlag = TRUE;
         }
+        else if (strcmp(argv[i], "-bench-threads") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            threadBenchFileName = argv[i + 1];
+            i++;
+        }
         else if (strcmp(argv[i], "-C") == 0)
         {
             consoleTestFlag = TRUE;
@@ -214,14 +1052,80 @@ int main(int argc, char **argv)
         {
             networkTestFlag = TRUE;
         }
+        else if (strcmp(argv[i], "-NS") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            streamTestBytes = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-serve") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            ASSERT(numClients < MaxClients);
+            clientHost[numClients++] = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-rfs") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            remoteServer = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-backup") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            backupPrimary = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-rcp") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            remoteCopyFrom = argv[i + 1];
+            remoteCopyTo = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-rp") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            remotePrintName = argv[i + 1];
+            i++;
+        }
 #ifndef FILESYS_STUB
         else if (strcmp(argv[i], "-cp") == 0)
         {
             ASSERT(i + 2 < argc);
-            copyUnixFileName = argv[i + 1];
-            copyNachosFileName = argv[i + 2];
+            ASSERT(numCopies < MaxCopies);
+            copyUnixFileName[numCopies] = argv[i + 1];
+            copyNachosFileName[numCopies] = argv[i + 2];
+            numCopies++;
             i += 2;
         }
+        else if (strcmp(argv[i], "-cpm") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            manifestName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-mkfs") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            packTreeName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-batch") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            batchName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-ext") == 0)
+        {
+            extentFlag = true;
+        }
+        else if (strcmp(argv[i], "-compress") == 0)
+        {
+            compressFlag = true;
+        }
         else if (strcmp(argv[i], "-p") == 0)
         {
             ASSERT(i + 1 < argc);
@@ -234,38 +1138,131 @@ int main(int argc, char **argv)
             removeFileName = argv[i + 1];
             i++;
         }
+        else if (strcmp(argv[i], "-rr") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            removeTreeName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-mv") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            renameFrom = argv[i + 1];
+            renameTo = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-clone") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            cloneFrom = argv[i + 1];
+            cloneTo = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-dedup") == 0)
+        {
+            dedupFlag = true;
+        }
+        else if (strcmp(argv[i], "-fsck") == 0)
+        {
+            checkFlag = true;
+        }
         else if (strcmp(argv[i], "-l") == 0)
         {
             ASSERT(i + 1 < argc);
             listDirName = argv[i + 1];
             dirListFlag = true;
         }
+        else if (strcmp(argv[i], "-lr") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            listDirName = argv[i + 1];
+            dirListFlag = true;
+            recursiveListFlag = true;
+            i++;
+        }
         else if (strcmp(argv[i], "-D") == 0)
         {
             dumpFlag = true;
         }
+        else if (strcmp(argv[i], "-Dfull") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            dumpPage = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-frag") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            fragFileName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-stat") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            statFileName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-defrag") == 0)
+        {
+            defragFlag = true;
+        }
         else if (strcmp(argv[i], "-mkdir") == 0)
         {
             ASSERT(i + 1 < argc);
             createDirName = argv[i + 1];
             i++;
         }
+        else if (strcmp(argv[i], "-cd") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            workingDirName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-bench") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            benchFileName = argv[i + 1];
+            i++;
+        }
 #endif // FILESYS_STUB
         else if (strcmp(argv[i], "-u") == 0)
         {
             cout << "Partial usage: nachos [-z -d debugFlags]\n";
             cout << "Partial usage: nachos [-x programName]\n";
             cout << "Partial usage: nachos [-K] [-C] [-N]\n";
+            cout << "Partial usage: nachos [-bench-threads resultFile]\n";
+            cout << "Partial usage: nachos [-serve clientId]...\n";
+            cout << "Partial usage: nachos [-rfs serverId] [-rcp UnixFile remoteFile] [-rp remoteFile]\n";
+            cout << "Partial usage: nachos [-backup primaryId]\n";
+            cout << "Partial usage: nachos [...] -machines [...] [-- ...]...\n";
 #ifndef FILESYS_STUB
-            cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
+            cout << "Partial usage: nachos [-cp UnixFile NachosFile]... [-ext] [-compress]\n";
+            cout << "Partial usage: nachos [-cpm manifestFile] [-ext] [-compress]\n";
+            cout << "Partial usage: nachos [-mkfs UnixDirectory] [-ext] [-compress]\n";
             cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
-            cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-l] [-lr] [-D] [-Dfull page]\n";
+            cout << "Partial usage: nachos [-frag fileName] [-defrag]\n";
+            cout << "Partial usage: nachos [-stat fileName]\n";
+            cout << "Partial usage: nachos [-clone fromName toName] [-dedup]\n";
+            cout << "Partial usage: nachos [-fsck]\n";
             cout << "Partial usage: nachos [-mkdir dirname]\n";
+            cout << "Partial usage: nachos [-cd dirname]\n";
+            cout << "Partial usage: nachos [-bench resultFile]\n";
+            cout << "Partial usage: nachos [-batch commandFile]\n";
 #endif // FILESYS_STUB
         }
     }
     debug = new Debug(debugArg);
 
+#ifndef FILESYS_STUB
+    // read the commands before the console can take any of the
+    // standard input
+    if (batchName != NULL && (batchText = ReadHostFile(batchName)) == NULL)
+    {
+        printf("Batch: couldn't open command file %s\n", batchName);
+    }
+#endif // FILESYS_STUB
+
     DEBUG(dbgThread, "Entering main");
 
     kernel = new Kernel(argc, argv);
@@ -273,6 +1270,7 @@ int main(int argc, char **argv)
     kernel->Initialize();
 
     CallOnUserAbort(Cleanup); // if user hits ctl-C
+    CallOnUserSignal(DumpStats); // if the host wants a look
 
     // at this point, the kernel is ready to do something
     // run some tests, if requested
@@ -280,6 +1278,13 @@ int main(int argc, char **argv)
     {
         kernel->ThreadSelfTest(); // test threads and synchronization
     }
+    if (threadBenchFileName != NULL)
+    {
+        ThreadBench *bench = new ThreadBench(threadBenchFileName);
+
+        bench->Run();
+        delete bench;
+    }
     if (consoleTestFlag)
     {
         kernel->ConsoleTest(); // interactive test of the synchronized console
@@ -288,36 +1293,135 @@ int main(int argc, char **argv)
     {
         kernel->NetworkTest(); // two-machine test of the network
     }
+    if (streamTestBytes > 0)
+    {
+        kernel->StreamTest(streamTestBytes); // and of a connection
+    }
 
 #ifndef FILESYS_STUB
+    if (checkFlag)
+    {
+        kernel->fileSystem->Check();
+    }
+    if (workingDirName != NULL
+        && !kernel->fileSystem->ChangeDirectory(workingDirName))
+    {
+        cout << "No directory " << workingDirName << "\n";
+    }
     if (removeFileName != NULL)
     {
         kernel->fileSystem->Remove(removeFileName);
     }
-    if (copyUnixFileName != NULL && copyNachosFileName != NULL)
+    if (removeTreeName != NULL)
     {
-        Copy(copyUnixFileName, copyNachosFileName);
+        kernel->fileSystem->RemoveTree(removeTreeName);
     }
-    if(createDirName != NULL){
-        if(kernel->fileSystem->MakeNewDir(createDirName))
-            cout<<"Success on creating new folder.."<<endl;
-        else
-            cout<<"Failed on creating new folder.."<<endl;
+    if (renameFrom != NULL)
+    {
+        Rename(renameFrom, renameTo);
+    }
+    for (i = 0; i < numCopies; i++)
+    {
+        Copy(copyUnixFileName[i], copyNachosFileName[i], extentFlag, compressFlag);
+    }
+    if (manifestName != NULL)
+    {
+        CopyManifest(manifestName, extentFlag, compressFlag);
+    }
+    if (packTreeName != NULL)
+    {
+        PackTree(packTreeName, extentFlag, compressFlag);
+    }
+    if (createDirName != NULL)
+    {
+        MakeDirectory(createDirName);
+    }
+    if (cloneFrom != NULL)
+    {
+        Clone(cloneFrom, cloneTo);
+    }
+    if (dedupFlag)
+    {
+        Deduplicate();
+    }
+    if (defragFlag)
+    {
+        kernel->fileSystem->StartDefragmenter();
+        kernel->fileSystem->WaitForDefragmenter();
+    }
+    if (fragFileName != NULL)
+    {
+        kernel->fileSystem->PrintFragmentation(fragFileName);
+    }
+    if (statFileName != NULL)
+    {
+        PrintStat(statFileName);
     }
     if (dumpFlag)
     {
-        kernel->fileSystem->Print();
+        kernel->fileSystem->PrintSummary();
+    }
+    if (dumpPage >= 0)
+    {
+        kernel->fileSystem->Print(dumpPage);
     }
     if (dirListFlag)
     {
-        kernel->fileSystem->List(listDirName);
+        if (recursiveListFlag)
+            kernel->fileSystem->ListRecursive(listDirName);
+        else
+            kernel->fileSystem->List(listDirName);
     }
     if (printFileName != NULL)
     {
         Print(printFileName);
     }
+    if (batchText != NULL)
+    {
+        RunBatch(batchName, batchText, extentFlag, compressFlag);
+        delete[] batchText;
+    }
+    if (benchFileName != NULL)
+    {
+        FileSystemBench *bench = new FileSystemBench(benchFileName);
+
+        bench->Run();
+        delete bench;
+    }
 #endif // FILESYS_STUB
 
+    // serve the file system to other machines, or use that of one
+    if (numClients > 0)
+    {
+        FileServer *servers[MaxClients];
+
+        for (i = 0; i < numClients; i++)
+            servers[i] = new FileServer(clientHost[i]);
+        for (i = 0; i < numClients; i++)
+            servers[i]->WaitUntilDone();
+    }
+    if (remoteServer >= 0)
+    {
+        RemoteFileSystem *remoteFs = new RemoteFileSystem(remoteServer);
+
+        if (remoteCopyFrom != NULL)
+            RemoteCopy(remoteFs, remoteCopyFrom, remoteCopyTo);
+        if (remotePrintName != NULL)
+            RemotePrint(remoteFs, remotePrintName);
+        remoteFs->Unmount();
+        remoteFs->Print();
+    }
+    if (backupPrimary >= 0)
+    {
+        ReplicaServer *backup = new ReplicaServer(backupPrimary);
+
+        // the disk now holds the primary's file system, not the one
+        // mounted here, so halt without unmounting that one
+        backup->WaitUntilDone();
+        kernel->synchDisk->Flush();
+        Exit(0);
+    }
+
     // finally, run an initial user program if requested to do so
     // If we don't run a user program, we may get here.
     // Calling "return" would terminate the program.
@@ -332,3 +1436,82 @@ int main(int argc, char **argv)
 
     ASSERTNOTREACHED();
 }
+
+// The command line of one machine of -machines.
+
+class MachineArgs {
+  public:
+    int argc;
+    char **argv;
+};
+
+//----------------------------------------------------------------------
+// MachineRoot
+// 	Run the machine with the command line "arg", on the host thread
+//	that has just been started for it.
+//----------------------------------------------------------------------
+
+static void
+MachineRoot(void *arg)
+{
+    MachineArgs *m = (MachineArgs *)arg;
+
+    RunMachine(m->argc, m->argv);
+}
+
+//----------------------------------------------------------------------
+// main
+// 	Run one machine, on the command line; or, with -machines, each
+//	of several on a host thread of its own, and wait for them all to
+//	halt.
+//----------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    MachineArgs machines[MaxMachines];
+    void *threads[MaxMachines];
+    char ids[MaxMachines][8];
+    int numCommon, numMachines = 0;
+    int i, k;
+
+    for (numCommon = 1; numCommon < argc; numCommon++) {
+        if (strcmp(argv[numCommon], "-machines") == 0)
+            break;
+    }
+    if (numCommon == argc) {
+        RunMachine(argc, argv);
+        ASSERTNOTREACHED();
+    }
+
+    // split what comes after -machines at each "--"
+    for (i = numCommon + 1; i <= argc; numMachines++) {
+        int first = i;
+        MachineArgs *m = &machines[numMachines];
+
+        ASSERT(numMachines < MaxMachines);
+        while (i < argc && strcmp(argv[i], "--") != 0)
+            i++;
+        sprintf(ids[numMachines], "%d", numMachines);
+        m->argv = new char *[numCommon + 2 + (i - first) + 1];
+        m->argc = 0;
+        m->argv[m->argc++] = argv[0];
+        m->argv[m->argc++] = "-m";
+        m->argv[m->argc++] = ids[numMachines];
+        for (k = 1; k < numCommon; k++)
+            m->argv[m->argc++] = argv[k];
+        for (k = first; k < i; k++)
+            m->argv[m->argc++] = argv[k];
+        m->argv[m->argc] = NULL;
+        i++;                            // past the "--"
+    }
+
+    wires = new Wires(numMachines);
+    for (i = 0; i < numMachines; i++)
+        threads[i] = StartHostThread(MachineRoot, &machines[i]);
+    for (i = 0; i < numMachines; i++)
+        JoinHostThread(threads[i]);
+    delete wires;
+    for (i = 0; i < numMachines; i++)
+        delete [] machines[i].argv;
+    Exit(0);
+}
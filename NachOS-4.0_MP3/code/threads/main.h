@@ -12,8 +12,8 @@
 #include "debug.h"
 #include "kernel.h"
 
-extern Kernel *kernel;
-extern Debug *debug;
+extern thread_local Kernel *kernel;	// of the machine on this host
+extern thread_local Debug *debug;	// thread (see main.cc)
 
 #endif // MAIN_H
 
@@ -4,15 +4,15 @@
 //
 // 	These routines assume that interrupts are already disabled.
 //	If interrupts are disabled, we can assume mutual exclusion
-//	(since we are on a uniprocessor).
+//	(since we are on a uniprocessor, or on CPUs that only take turns
+//	while interrupts are on).
 //
 // 	NOTE: We can't use Locks to provide mutual exclusion here, since
 // 	if we needed to wait for a lock, and the lock was busy, we would 
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+//	The policies are described in scheduler.h.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,27 +22,61 @@
 #include "debug.h"
 #include "scheduler.h"
 #include "main.h"
+#include "tracer.h"
+#include "kernelprofile.h"
+#include "mounttable.h"
+#include <strings.h>
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads.
 //	Initially, no ready threads.
+//
+//	"order" -- the policy used to pick the next thread to run
+//	"cpus" -- how many CPUs there are; the thread running now is on
+//		the first
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(SchedPolicy order, int cpus)
 { 
-    readyList = new List<Thread *>; 
+    policy = order;
+    numCPUs = cpus;
+    for (int c = 0; c < numCPUs; c++) {
+	for (int i = 0; i < NumSchedLevels; i++) {
+	    ready[c][i] = new IntrusiveList<Thread>(&Thread::nextReady);
+	}
+	nonEmpty[c] = 0;
+	numReady[c] = 0;
+	running[c] = NULL;
+	clock[c] = 0;
+	resched[c] = FALSE;
+    }
+    cpu = 0;
+    running[0] = kernel->currentThread;
+    kernel->currentThread->cpu = 0;
+    kernel->currentThread->lastCPU = 0;
+    numIdle = numCPUs - 1;
+    behind = 0;
+    idleReady = FALSE;
     toBeDestroyed = NULL;
+    registerOwner = NULL;
+    ticks = 0;
+    virtualPass = 0;
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::~Scheduler
-// 	De-allocate the list of ready threads.
+// 	De-allocate the scheduler.  The ready threads themselves are
+//	not ours to delete.
 //----------------------------------------------------------------------
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int c = 0; c < numCPUs; c++) {
+	for (int i = 0; i < NumSchedLevels; i++) {
+	    delete ready[c][i];
+	}
+    }
 } 
 
 //----------------------------------------------------------------------
@@ -50,6 +84,20 @@ Scheduler::~Scheduler()
 // 	Mark a thread as ready, but not running.
 //	Put it on the ready list, for later scheduling onto the CPU.
 //
+//	Under MLFQ, a thread that was blocked is waking up from a wait,
+//	and goes back to the highest priority with a fresh quantum --
+//	or, for a background thread, to the lowest, so that it only runs
+//	when nothing else wants to (though ageing still keeps it from
+//	starving).  A thread that is only being switched out keeps its
+//	priority.
+//
+//	Under stride, a new thread or one waking up is brought up to
+//	the pass of the last thread to run.
+//
+//	It goes on the queues of the CPU it last ran on, or of the one
+//	with the fewest threads if it is new.  If any CPU is idle, it
+//	may have this thread now, or steal it (see NextCPU).
+//
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
 
@@ -59,14 +107,31 @@ Scheduler::ReadyToRun (Thread *thread)
     ASSERT(kernel->interrupt->getLevel() == IntOff);
     DEBUG(dbgThread, "Putting thread on ready list: " << thread->getName());
 	//cout << "Putting thread on ready list: " << thread->getName() << endl ;
+    if (policy == SchedMLFQ && thread->getStatus() == BLOCKED) {
+	thread->priority = thread->background ? NumSchedLevels - 1 : 0;
+	thread->quantumUsed = 0;
+    }
+    if (policy == SchedStride && thread->getStatus() != RUNNING) {
+	thread->pass = max(thread->pass, virtualPass);
+    }
     thread->setStatus(READY);
-    readyList->Append(thread);
+    thread->readySince = kernel->stats->totalTicks;
+    if (thread->cpu == -1) {
+	thread->cpu = FewestThreads();
+    }
+    Append(thread->cpu, policy == SchedMLFQ ? Level(thread) : 0, thread);
+    if (numIdle > 0) {
+	idleReady = TRUE;		// see InterleaveDue
+    }
+    kernel->alarm->ThreadReady();
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
-//	If there are no ready threads, return NULL.
+// 	Return the next thread to be scheduled onto the CPU being
+//	simulated: the first one at the highest priority that has any.
+//	If none is ready on it, steal one from another CPU; if there are
+//	none to steal either, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
 //----------------------------------------------------------------------
@@ -74,12 +139,273 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
+    Thread *thread;
+    int level;
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
-    if (readyList->IsEmpty()) {
-		return NULL;
+    level = HighestReady(cpu);
+    if (level == -1) {
+		return Steal();
+    } else if (policy == SchedStride) {
+	thread = LowestPass(cpu);
+	Remove(cpu, 0, thread);
+	return thread;
     } else {
-    	return readyList->RemoveFront();
+    	return RemoveFront(cpu, level);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FindNextToYieldTo
+// 	Return the thread "thread" should give the CPU to when it yields,
+//	taking it off the ready list; NULL if it should keep running.
+//	Under FIFO that is whichever thread is next.  Under MLFQ, only a
+//	thread of the same or a higher priority: a lower one would wait
+//	for "thread" to use up its quantum or block.  Under stride, only
+//	a thread with a lower pass than "thread" would have if it were
+//	charged now for the time it has run.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::FindNextToYieldTo (Thread *thread)
+{
+    Thread *next;
+    int level;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+
+    level = HighestReady(cpu);
+    if (level == -1 || (policy == SchedMLFQ && level > Level(thread))) {
+	return NULL;
+    }
+    if (policy == SchedStride) {
+	next = LowestPass(cpu);
+	if (next->pass >= thread->pass + (double) (kernel->stats->totalTicks
+				- thread->runSince) / thread->tickets) {
+	    return NULL;
+	}
+	Remove(cpu, 0, next);
+	return next;
+    }
+    return RemoveFront(cpu, level);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Inherit
+// 	Record that "thread" has inherited "level" from the threads
+//	waiting for its locks (NumSchedLevels for none).  If that moves
+//	it to another level while it is ready, it changes queues, to the
+//	end of the new one.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Inherit(Thread *thread, int level)
+{
+    int from = Level(thread);
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    thread->inherited = level;
+    if (policy == SchedMLFQ && thread->getStatus() == READY
+				&& Level(thread) != from) {
+	Remove(thread->cpu, from, thread);
+	Append(thread->cpu, Level(thread), thread);
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Append
+// 	Put "thread" at the end of CPU "c"'s ready queue "level".
+//----------------------------------------------------------------------
+
+void
+Scheduler::Append(int c, int level, Thread *thread)
+{
+    ready[c][level]->Append(thread);
+    nonEmpty[c] |= 1 << level;
+    numReady[c]++;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::RemoveFront
+// 	Take the first thread off CPU "c"'s ready queue "level", which
+//	must not be empty, and return it.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::RemoveFront(int c, int level)
+{
+    Thread *thread = ready[c][level]->RemoveFront();
+
+    if (ready[c][level]->IsEmpty()) {
+	nonEmpty[c] &= ~(1 << level);
+    }
+    numReady[c]--;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Remove
+// 	Take "thread" off CPU "c"'s ready queue "level", wherever it is
+//	in it.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Remove(int c, int level, Thread *thread)
+{
+    ready[c][level]->Remove(thread);
+    if (ready[c][level]->IsEmpty()) {
+	nonEmpty[c] &= ~(1 << level);
+    }
+    numReady[c]--;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LowestPass
+// 	Return the thread ready on CPU "c" with the lowest pass, the one
+//	that has been ready longest of those with the same pass; there
+//	must be one.  This looks at every such thread, but there are
+//	never many.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::LowestPass(int c)
+{
+    IntrusiveList<Thread> *queue = ready[c][0];
+    Thread *lowest = queue->Front();
+
+    for (Thread *t = queue->Next(lowest); t != NULL; t = queue->Next(t)) {
+	if (t->pass < lowest->pass) {
+	    lowest = t;
+	}
+    }
+    return lowest;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::HighestReady
+// 	Return the highest priority level with a thread ready on CPU
+//	"c", or -1 if none is: the lowest bit set in its bitmap.
+//----------------------------------------------------------------------
+
+int
+Scheduler::HighestReady(int c)
+{
+    return ffs(nonEmpty[c]) - 1;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::HasReady
+// 	Return TRUE if a thread is ready to run, on any CPU.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::HasReady()
+{
+    for (int c = 0; c < numCPUs; c++) {
+	if (nonEmpty[c] != 0) {
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Tick
+// 	Called by the alarm at each timer interrupt while a thread is
+//	running.  Return TRUE if the thread should be switched out.
+//
+//	Under FIFO and stride, it always should: that is plain time
+//	slicing, and it is at the switch that stride charges the thread
+//	for the time it ran.  Under
+//	MLFQ, it should if it has used up its quantum -- and it then drops
+//	a level -- or if a thread of higher priority is ready.  Every
+//	AgingInterval ticks, threads that have waited too long are moved
+//	up first.
+//
+//	With several CPUs, it is a time slice on each of them that is
+//	busy; the ones not being simulated switch threads when they next
+//	are (see Interleave).
+//----------------------------------------------------------------------
+
+bool
+Scheduler::Tick()
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (policy == SchedMLFQ && ++ticks % AgingInterval == 0) {
+	Age();
+    }
+    for (int c = 0; c < numCPUs; c++) {
+	if (c != cpu && running[c] != NULL && SliceUp(c, running[c])) {
+	    resched[c] = TRUE;
+	}
+    }
+    return SliceUp(cpu, kernel->currentThread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SliceUp
+// 	Return TRUE if "current", the thread running on CPU "c", should
+//	be switched out at this timer interrupt, as Tick describes.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::SliceUp(int c, Thread *current)
+{
+    int level;
+
+    if (policy != SchedMLFQ) {
+	return TRUE;
+    }
+    if (++current->quantumUsed >= Quantum(current->priority)) {
+	if (current->priority < NumSchedLevels - 1) {
+	    current->priority++;
+	    DEBUG(dbgThread, "Thread " << current->getName()
+			<< " used its quantum, now at level " << current->priority);
+	}
+	current->quantumUsed = 0;
+	return TRUE;
+    }
+    level = HighestReady(c);
+    return level != -1 && level < Level(current);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Age
+// 	Move every ready thread that has been waiting StarvationTicks or
+//	more up a level, with a fresh quantum, keeping the order within
+//	each level.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Age()
+{
+    Ticks now = kernel->stats->totalTicks;
+
+    for (int c = 0; c < numCPUs; c++) {
+	for (int i = 1; i < NumSchedLevels; i++) {
+	    IntrusiveList<Thread> *queue = ready[c][i];
+
+	    // go once round the queue: each thread is either moved up,
+	    // or put back at the end
+	    for (int n = queue->NumInList(); n > 0; n--) {
+		Thread *thread = queue->RemoveFront();
+
+		if (now - thread->readySince >= StarvationTicks) {
+		    DEBUG(dbgThread, "Thread " << thread->getName()
+			    << " waited too long, now at level " << i - 1);
+		    thread->priority = i - 1;
+		    thread->quantumUsed = 0;
+		    ready[c][i - 1]->Append(thread);
+		    nonEmpty[c] |= 1 << (i - 1);
+		} else {
+		    queue->Append(thread);
+		}
+	    }
+	    if (queue->IsEmpty()) {
+		nonEmpty[c] &= ~(1 << i);
+	    }
+	}
     }
 }
 
@@ -103,27 +429,103 @@ Scheduler::FindNextToRun ()
 void
 Scheduler::Run (Thread *nextThread, bool finishing)
 {
-    Thread *oldThread = kernel->currentThread;
+    ProfileRegion region("Scheduler::Run");
     
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
+    Leave(kernel->currentThread);
+    Enter(nextThread);
+    Switch(nextThread, finishing);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Leave
+// 	"oldThread" is giving up its CPU: charge it for the time it ran.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Leave(Thread *oldThread)
+{
+    Ticks now = kernel->stats->totalTicks;
+
+    if (policy == SchedStride) {	// charge its pass for the time it ran
+	oldThread->pass += (double) (now - oldThread->runSince)
+						/ oldThread->tickets;
+    }
+    oldThread->runTicks += now - oldThread->runSince;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Enter
+// 	Give the CPU being simulated to "nextThread", which has been
+//	taken off its ready queues: its wait is over, and its quantum
+//	starts now.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Enter(Thread *nextThread)
+{
+    Ticks now = kernel->stats->totalTicks;
+
+    if (policy == SchedStride) {
+	virtualPass = nextThread->pass;
+    }
+    nextThread->waitTicks += now - nextThread->readySince;
+    nextThread->runSince = now;
+    kernel->alarm->Rearm(nextThread);	// its quantum starts now
+    kernel->stats->numContextSwitches++;
+    nextThread->setStatus(RUNNING);      // nextThread is now running
+    if (nextThread->lastCPU != -1 && nextThread->lastCPU != cpu) {
+	kernel->stats->numMigrations++;
+    }
+    nextThread->cpu = nextThread->lastCPU = cpu;
+    if (running[cpu] == NULL) {
+	numIdle--;
+    }
+    running[cpu] = nextThread;
+    resched[cpu] = FALSE;
+    clock[cpu] = max(clock[cpu], now);	// it may have been idle
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Switch
+// 	Put "nextThread" on the machine in place of the thread running
+//	now.  Save the state of the old thread, and load the state of
+//	the new thread, by calling the machine dependent context switch
+//	routine, SWITCH.  "finishing" is as for Run.
+// Side effect:
+//	The global variable kernel->currentThread becomes nextThread,
+//	and the kernel's disk, buffer cache and inode table become
+//	those of the file system it is in (see mounttable.h).
+//----------------------------------------------------------------------
+
+void
+Scheduler::Switch(Thread *nextThread, bool finishing)
+{
+    Thread *oldThread = kernel->currentThread;
+
     if (finishing) {	// mark that we need to delete current thread
          ASSERT(toBeDestroyed == NULL);
 	 toBeDestroyed = oldThread;
     }
     
-    if (oldThread->space != NULL) {	// if this thread is a user program,
-        oldThread->SaveUserState(); 	// save the user's CPU registers
-	oldThread->space->SaveState();
-    }
+    if (oldThread->space != NULL)	// if this thread is a user program;
+	oldThread->space->SaveState();	// its CPU registers stay in the
+					// machine until someone else's
+					// are wanted (see LoadUserState)
     
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
 
+    kernel->stats->SwitchTo(nextThread->stats);
     kernel->currentThread = nextThread;  // switch to the next thread
-    nextThread->setStatus(RUNNING);      // nextThread is now running
+#ifndef FILESYS_STUB
+    if (nextThread->mount != oldThread->mount)	// the devices of the
+	kernel->mounts->Use(nextThread->mount);	// file system it is in
+#endif
     
     DEBUG(dbgThread, "Switching from: " << oldThread->getName() << " to: " << nextThread->getName());
+    TRACE(TraceSwitch, nextThread->getID(), finishing ? 1 : 0);
     
     // This is a machine-dependent assembly language routine defined 
     // in switch.s.  You may have to think
@@ -144,11 +546,281 @@ Scheduler::Run (Thread *nextThread, bool finishing)
 					// and needs to be cleaned up
     
     if (oldThread->space != NULL) {	    // if there is an address space
-        oldThread->RestoreUserState();     // to restore, do it.
+        LoadUserState(oldThread);	    // to restore, do it.
 	oldThread->space->RestoreState();
     }
 }
 
+//----------------------------------------------------------------------
+// Scheduler::Advance
+// 	The CPU being simulated has run for "ticks" more: move its clock
+//	on, and simulated time to the clock of the busy CPU furthest
+//	behind.  Only called if there are several CPUs; otherwise the
+//	interrupt simulation moves time on itself.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Advance(int ticks)
+{
+    Statistics *stats = kernel->stats;
+
+    clock[cpu] += ticks;
+    stats->cpuBusyTicks[cpu] += ticks;
+    behind = clock[cpu];
+    for (int c = 0; c < numCPUs; c++) {
+	if (running[c] != NULL && clock[c] < behind) {
+	    behind = clock[c];
+	}
+    }
+    stats->totalTicks = max(stats->totalTicks, behind);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Interleave
+// 	Called when InterleaveDue says to, with interrupts off, by the
+//	interrupt simulation as time moves on: hand the machine on to
+//	the CPU that should be simulated now, if there is one, and come
+//	back when this CPU's turn comes again.  Return TRUE if the time
+//	slice of its thread ended while it waited, and the thread should
+//	yield.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::Interleave()
+{
+    int next = NextCPU();
+    bool sliceUp;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (next != -1 && (running[next] == NULL
+			|| clock[cpu] >= clock[next] + CPUSkew)) {
+	GoTo(next, FALSE);
+    }
+    sliceUp = resched[cpu];
+    resched[cpu] = FALSE;
+    return sliceUp;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SwitchCPU
+// 	The running thread has blocked, or is finishing (see Run), and
+//	nothing else is ready on its CPU, which goes idle.  Simulate
+//	another CPU that has something to run, and return TRUE once the
+//	thread has been given a CPU again.  If no other CPU has, return
+//	FALSE at once: the machine as a whole is idle.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::SwitchCPU(bool finishing)
+{
+    int next = NextCPU();
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    running[cpu] = NULL;
+    numIdle++;
+    if (next == -1) {
+	return FALSE;
+    }
+    Leave(kernel->currentThread);
+    GoTo(next, finishing);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::GoTo
+// 	Simulate CPU "c" from now on: switch to the thread it is running,
+//	or, if it was idle, give it the first thread ready on it, or one
+//	it steals.
+//----------------------------------------------------------------------
+
+void
+Scheduler::GoTo(int c, bool finishing)
+{
+    Thread *nextThread;
+
+    DEBUG(dbgThread, "CPU " << cpu << " hands the machine to CPU " << c);
+    cpu = c;
+    nextThread = running[c];
+    if (nextThread == NULL) {
+	nextThread = FindNextToRun();
+	Enter(nextThread);
+    }
+    Switch(nextThread, finishing);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::NextCPU
+// 	Return the CPU to simulate instead of this one: an idle CPU with
+//	a thread ready on it, or that can steal one, if there is one, or
+//	else the busy CPU furthest behind.  Return -1 if no other CPU is
+//	busy, or could be.
+//----------------------------------------------------------------------
+
+int
+Scheduler::NextCPU()
+{
+    int next = -1;
+
+    if (idleReady) {
+	for (int c = 0; c < numCPUs; c++) {
+	    if (c != cpu && running[c] == NULL
+			&& (nonEmpty[c] != 0 || Victim(c) != -1)) {
+		return c;
+	    }
+	}
+	idleReady = FALSE;
+    }
+    for (int c = 0; c < numCPUs; c++) {
+	if (c != cpu && running[c] != NULL
+			&& (next == -1 || clock[c] < clock[next])) {
+	    next = c;
+	}
+    }
+    return next;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::FewestThreads
+// 	Return the CPU with the fewest threads running or ready on it,
+//	for a new thread to go to; of those, the first after this one.
+//----------------------------------------------------------------------
+
+int
+Scheduler::FewestThreads()
+{
+    int best = cpu;
+
+    for (int i = 1; i < numCPUs; i++) {
+	int c = (cpu + i) % numCPUs;
+
+	if (numReady[c] + (running[c] != NULL)
+			< numReady[best] + (running[best] != NULL)) {
+	    best = c;
+	}
+    }
+    return best;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Victim
+// 	Return the CPU that CPU "c" should steal a thread from: the busy
+//	one with the most threads waiting on it, the first after "c" of
+//	those with as many.  Return -1 if no busy CPU has any.  An idle
+//	CPU is not stolen from: it gets to run its own.
+//----------------------------------------------------------------------
+
+int
+Scheduler::Victim(int c)
+{
+    int victim = -1;
+
+    for (int i = 1; i < numCPUs; i++) {
+	int v = (c + i) % numCPUs;
+
+	if (running[v] != NULL && numReady[v] > 0
+			&& (victim == -1 || numReady[v] > numReady[victim])) {
+	    victim = v;
+	}
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Steal
+// 	The CPU being simulated has no thread ready: take one off the
+//	queues of its victim, and return it; NULL if there is none.  It
+//	is one at the victim's highest level, from the end of the queue,
+//	away from the front where the victim takes its own: the last one
+//	that did not last run on the victim, if any, and else the last.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::Steal()
+{
+    int victim = Victim(cpu);
+    IntrusiveList<Thread> *queue;
+    Thread *last = NULL, *cold = NULL;
+    int level;
+
+    if (victim == -1) {
+	return NULL;
+    }
+    level = HighestReady(victim);
+    queue = ready[victim][level];
+    for (Thread *t = queue->Front(); t != NULL; t = queue->Next(t)) {
+	last = t;
+	if (t->lastCPU != victim) {
+	    cold = t;
+	}
+    }
+    if (cold != NULL) {
+	last = cold;
+    }
+    Remove(victim, level, last);
+    last->cpu = cpu;
+    kernel->stats->numSteals++;
+    DEBUG(dbgThread, "CPU " << cpu << " steals " << last->getName()
+		<< " from CPU " << victim);
+    return last;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::LoadUserState
+// 	Get the user registers of "thread", which is about to go back to
+//	running its program, into the machine.  They are only saved when
+//	they have to make way for another thread's, not at every context
+//	switch: a switch to a kernel thread and back, or a wait for the
+//	disk with no other program running, leaves them where they are,
+//	and then there is nothing to do.  Interrupts are turned off, so
+//	that no other thread gets the machine half way through.
+//----------------------------------------------------------------------
+
+void
+Scheduler::LoadUserState(Thread *thread)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (registerOwner != thread) {
+	if (registerOwner != NULL)
+	    registerOwner->SaveUserState();
+	thread->RestoreUserState();
+	registerOwner = thread;
+	kernel->stats->numUserStateLoads++;
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ClaimUserState
+// 	"thread" is about to set its user registers in the machine from
+//	scratch, to start a program: save whoever's are there first, and
+//	make them its own.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ClaimUserState(Thread *thread)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (registerOwner != NULL && registerOwner != thread)
+	registerOwner->SaveUserState();
+    registerOwner = thread;
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ForgetUserState
+// 	"thread" is being destroyed: if the machine holds its user
+//	registers, they are nobody's now, and need not be saved.
+//----------------------------------------------------------------------
+
+void
+Scheduler::ForgetUserState(Thread *thread)
+{
+    if (registerOwner == thread)
+	registerOwner = NULL;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::CheckToBeDestroyed
 // 	If the old thread gave up the processor because it was finishing,
@@ -175,5 +847,42 @@ void
 Scheduler::Print()
 {
     cout << "Ready list contents:\n";
-    readyList->Apply(ThreadPrint);
+    for (int c = 0; c < numCPUs; c++) {
+	if (numCPUs > 1)
+	    cout << "CPU " << c << ":\n";
+	for (int i = 0; i < NumSchedLevels; i++) {
+	    IntrusiveList<Thread> *queue = ready[c][i];
+
+	    if (policy == SchedMLFQ)
+		cout << "Level " << i << ": ";
+	    for (Thread *t = queue->Front(); t != NULL; t = queue->Next(t)) {
+		ThreadPrint(t);
+		if (policy == SchedStride)
+		    cout << "(pass " << t->pass << ") ";
+	    }
+	    if (policy == SchedMLFQ)
+		cout << "\n";
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ParsePolicy
+// 	Look up a scheduling policy by name.  Return FALSE if "name" is
+//	not one we know.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ParsePolicy(char *name, SchedPolicy *order)
+{
+    if (strcmp(name, "fifo") == 0) {
+	*order = SchedFIFO;
+    } else if (strcmp(name, "mlfq") == 0) {
+	*order = SchedMLFQ;
+    } else if (strcmp(name, "stride") == 0) {
+	*order = SchedStride;
+    } else {
+	return FALSE;
+    }
+    return TRUE;
 }
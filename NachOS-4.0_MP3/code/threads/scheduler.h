@@ -2,6 +2,66 @@
 //	Data structures for the thread dispatcher and scheduler.
 //	Primarily, the list of threads that are ready to run.
 //
+//	Which ready thread runs next is decided by one of several
+//	policies:
+//
+//	   FIFO -- one queue, in the order threads became ready; the
+//		running thread is switched out at every timer interrupt
+//	   MLFQ -- a multilevel feedback queue: NumSchedLevels queues, the
+//		highest priority (level 0) first, FIFO within a level.  A
+//		thread gets a quantum of 1, 2, 4, ... timer interrupts at
+//		each level, and drops a level when it uses one up; it goes
+//		back to the top when it wakes up from a wait (for I/O, a
+//		lock, ...).  A thread that has been ready for StarvationTicks
+//		is moved up a level, so none starves.  A thread is only
+//		switched out early for one of higher priority.
+//	   stride -- proportional share: every thread has tickets (see
+//		the SetTickets system call), and its "pass" goes up by the
+//		ticks it runs divided by its tickets; the ready thread with
+//		the lowest pass runs next, switched out at every timer
+//		interrupt.  So threads that all want the CPU get it in
+//		proportion to their tickets.  A thread that wakes up from a
+//		wait starts no lower than the pass of the last thread given
+//		the CPU, so it cannot save up time by sleeping.
+//
+//	Under MLFQ a thread holding a lock runs at the level of the best
+//	thread waiting for it, if that is higher than its own (see
+//	synch.h): its Level is the better of its own priority and the
+//	level it has inherited.
+//
+//	The ready queues are intrusive lists, linked through the threads
+//	themselves (see Thread::nextReady), and a bitmap records which of
+//	them are not empty, so neither making a thread ready nor picking
+//	the next one allocates anything or depends on how many threads
+//	there are.
+//
+//	Each thread's time running and time waiting to run is counted
+//	(see Thread::RunTicks and Thread::WaitTicks), under any policy.
+//
+//	The machine may have several CPUs (-smp).  Each has a thread of
+//	its own running, or is idle, and ready queues of its own; they
+//	share everything else, the one simulated Machine included, and
+//	take turns on it: the CPU being simulated is the one whose thread
+//	is kernel->currentThread, and the other CPUs' registers are kept
+//	by their threads meanwhile, as for any thread switched out (see
+//	LoadUserState).  Each CPU has a clock, which moves on with the
+//	time it runs, and simulated time is the clock of the busy CPU
+//	furthest behind; a CPU hands the machine on to that one when it
+//	is CPUSkew ticks ahead of it, or to an idle one as soon as a
+//	thread is ready on it, or when its own thread blocks.  The CPUs
+//	only change over where a time slice could switch threads -- as
+//	time advances, with interrupts on -- so whatever turns interrupts
+//	off to be atomic, the scheduler and the synchronization
+//	primitives included, still is: no other CPU runs until they are
+//	back on.  A timer interrupt is a time slice on every busy CPU; one
+//	that is not being simulated switches threads when it next is.  A
+//	thread goes on the queues of the CPU it last ran on, and a new
+//	one on those of the CPU with the fewest threads.  A CPU with
+//	nothing of its own to run steals from the busy CPU with the most
+//	threads waiting: the last one on its first queue that has any,
+//	or rather the last of those that did not last run there, so
+//	threads stay with the CPU they ran on where they can.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -10,8 +70,20 @@
 #define SCHEDULER_H
 
 #include "copyright.h"
-#include "list.h"
 #include "thread.h"
+#include "list.h"
+
+enum SchedPolicy { SchedFIFO, SchedMLFQ, SchedStride };
+
+const int NumSchedLevels = 3;		// MLFQ priority levels
+const int StarvationTicks = 2000;	// MLFQ: ready this long, a thread
+					// is moved up a level
+const int AgingInterval = 10;		// MLFQ: timer interrupts between
+					// looks for starving threads
+const int DefaultTickets = 100;		// stride: tickets of a new thread
+const int MaxTickets = 10000;		// stride: most one thread may have
+const int CPUSkew = 50;			// -smp: ticks a CPU may get ahead of
+					// the one furthest behind
 
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
@@ -19,26 +91,117 @@
 
 class Scheduler {
   public:
-    Scheduler();		// Initialize list of ready threads 
+    Scheduler(SchedPolicy order, int cpus);
+				// Initialize list of ready threads 
     ~Scheduler();		// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	
     				// Thread can be dispatched.
     Thread* FindNextToRun();	// Dequeue first thread on the ready 
 				// list, if any, and return thread.
+    Thread* FindNextToYieldTo(Thread* thread);
+				// The same, but only a thread that is
+				// to run before "thread" does
+    bool Tick();		// The timer went off: return TRUE if
+				// the running thread should yield
+    bool HasReady();		// Is any thread ready to run?
+    int Level(Thread *thread)
+		{ return min(thread->priority, thread->inherited); }
+				// the queue it runs at, under MLFQ
+    void Inherit(Thread *thread, int level);
+				// "thread" has inherited "level" now
     void Run(Thread* nextThread, bool finishing);
     				// Cause nextThread to start running
     void CheckToBeDestroyed();// Check if thread that had been
     				// running needs to be deleted
+    void LoadUserState(Thread *thread);
+				// Put "thread"'s user registers in the
+				// machine, if they are not there yet
+    void ClaimUserState(Thread *thread);
+				// The same, for registers about to be
+				// set from scratch
+    void ForgetUserState(Thread *thread);
+				// "thread" is going away
     void Print();		// Print contents of ready list
+
+    void Advance(int ticks);	// The CPU being simulated ran for
+				// "ticks"; move simulated time on
+    bool InterleaveDue()
+	{ return idleReady || clock[cpu] >= behind + CPUSkew; }
+				// Should another CPU be simulated now?
+    bool Interleave();		// If so, simulate it; TRUE if the
+				// running thread's time slice ended
+				// meanwhile
+    bool SwitchCPU(bool finishing);
+				// The running thread blocked, and its
+				// CPU has nothing else to run:
+				// simulate another that has, if any
     
+    static bool ParsePolicy(char *name, SchedPolicy *order);
+				// Map "fifo", "mlfq" or "stride" to a
+				// policy
+
     // SelfTest for scheduler is implemented in class Thread
     
   private:
-    List<Thread *> *readyList;  // queue of threads that are ready to run,
-				// but not running
+    SchedPolicy policy;		// how to pick the next thread
+    int numCPUs;		// CPUs the machine has
+    int cpu;			// the one being simulated
+    IntrusiveList<Thread> *ready[MaxCPUs][NumSchedLevels];
+				// each CPU's queues of threads that are
+				// ready to run, but not running, by
+				// priority; FIFO only uses the first
+    unsigned int nonEmpty[MaxCPUs];
+				// bit i set if queue i has a thread
+    int numReady[MaxCPUs];	// threads on each CPU's queues
+    Thread *running[MaxCPUs];	// each CPU's thread, NULL if it is idle
+    Ticks clock[MaxCPUs];	// how far in time each CPU has got
+    Ticks behind;		// the clock of the busy CPU furthest
+				// behind
+    bool resched[MaxCPUs];	// the time slice of a CPU that is not
+				// being simulated is up
+    int numIdle;		// CPUs with no thread running
+    bool idleReady;		// an idle CPU may have a thread to run,
+				// of its own or to steal
     Thread *toBeDestroyed;	// finishing thread to be destroyed
     				// by the next thread that runs
+    Thread *registerOwner;	// whose user registers the machine
+				// holds, NULL if nobody's
+    int ticks;			// timer interrupts so far
+    double virtualPass;		// stride: pass of the thread last
+				// given the CPU
+
+    int Quantum(int level) { return 1 << level; }
+				// timer interrupts a thread may run for
+				// at "level" before dropping a level
+    void Append(int c, int level, Thread *thread);
+    Thread *RemoveFront(int c, int level);
+    void Remove(int c, int level, Thread *thread);
+				// queue operations on CPU "c"; no
+				// allocation
+    int HighestReady(int c);	// level of the first thread ready on
+				// "c"; -1 if there is none
+    Thread *LowestPass(int c);	// stride: the one to run next
+    bool SliceUp(int c, Thread *current);
+				// should "c"'s thread be switched out
+				// at a timer interrupt?
+    void Age();			// move starving threads up a level
+    void Leave(Thread *oldThread);
+				// "oldThread" gives up its CPU
+    void Enter(Thread *nextThread);
+				// the CPU being simulated is given to
+				// "nextThread"
+    void Switch(Thread *nextThread, bool finishing);
+				// run "nextThread" on the machine
+    void GoTo(int c, bool finishing);
+				// simulate CPU "c" from now on
+    int NextCPU();		// the CPU to simulate after this one;
+				// -1 if no other has work
+    int FewestThreads();	// the CPU a new thread goes to
+    int Victim(int c);		// the CPU "c" should steal from; -1 if
+				// none has threads waiting
+    Thread *Steal();		// take a thread from the victim of the
+				// CPU being simulated; NULL if none
 };
 
 #endif // SCHEDULER_H
@@ -35,6 +35,7 @@
 #include "copyright.h"
 #include "synch.h"
 #include "main.h"
+#include "tracer.h"
 
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
@@ -48,7 +49,12 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List<Thread *>;
+    queue = new IntrusiveList<Thread>(&Thread::nextWaiting);
+    lock = NULL;
+    handoff = kernel->handoffSynch;
+    profile = NULL;
+    if (kernel->synchProfiler != NULL)
+	profile = kernel->synchProfiler->Find("semaphore", name);
 }
 
 //----------------------------------------------------------------------
@@ -62,6 +68,26 @@ Semaphore::~Semaphore()
     delete queue;
 }
 
+thread_local Slab Semaphore::slab("semaphores", sizeof(Semaphore));
+
+//----------------------------------------------------------------------
+// Semaphore::operator new, Semaphore::operator delete
+// 	Allocate the space for a Semaphore from its slab, and release it
+//	back there.
+//----------------------------------------------------------------------
+
+void *
+Semaphore::operator new(size_t size)
+{
+    return slab.Alloc(size);
+}
+
+void
+Semaphore::operator delete(void *p, size_t size)
+{
+    slab.Free(p, size);
+}
+
 //----------------------------------------------------------------------
 // Semaphore::P
 // 	Wait until semaphore value > 0, then decrement.  Checking the
@@ -77,15 +103,32 @@ Semaphore::P()
 {
     Interrupt *interrupt = kernel->interrupt;
     Thread *currentThread = kernel->currentThread;
+    Ticks start = kernel->stats->totalTicks;
+    bool contended;
     
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
     
-    while (value == 0) { 		// semaphore not available
-	queue->Append(currentThread);	// so go to sleep
+    contended = (value == 0);
+    
+    if (handoff && value == 0) {	// V hands us the value, so once
+	queue->Append(currentThread);	// we are woken it is ours
+	if (lock != NULL)
+	    lock->Lend(currentThread);
 	currentThread->Sleep(FALSE);
-    } 
-    value--; 			// semaphore available, consume its value
+    } else {
+	while (value == 0) { 		// semaphore not available
+	    queue->Append(currentThread);	// so go to sleep
+	    if (lock != NULL)
+		lock->Lend(currentThread);
+	    currentThread->Sleep(FALSE);
+	} 
+	value--; 			// semaphore available, consume its value
+    }
+    currentThread->stats->blockedTicks += kernel->stats->totalTicks - start;
+    if (profile != NULL)
+	profile->Acquired(contended, kernel->stats->totalTicks - start);
+    TRACE(TraceSemaphoreP, TraceId(this), (int) (kernel->stats->totalTicks - start));
    
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);	
@@ -97,6 +140,9 @@ Semaphore::P()
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that interrupts
 //	are disabled when it is called.
+//
+//	With handoff, the value goes to the waiter, if there is one,
+//	instead of being incremented.
 //----------------------------------------------------------------------
 
 void
@@ -107,10 +153,14 @@ Semaphore::V()
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
     
+    TRACE(TraceSemaphoreV, TraceId(this), queue->IsEmpty() ? 0 : 1);
     if (!queue->IsEmpty()) {  // make thread ready.
 	kernel->scheduler->ReadyToRun(queue->RemoveFront());
+	if (!handoff)
+	    value++;
+    } else {
+	value++;
     }
-    value++;
     
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);
@@ -122,7 +172,7 @@ Semaphore::V()
 //	to control two threads ping-ponging back and forth.
 //----------------------------------------------------------------------
 
-static Semaphore *ping;
+static thread_local Semaphore *ping;
 static void
 SelfTestHelper (Semaphore *pong) 
 {
@@ -159,7 +209,14 @@ Lock::Lock(char* debugName)
 {
     name = debugName;
     semaphore = new Semaphore("lock", 1);  // initially, unlocked
+    semaphore->profile = NULL;
+    semaphore->lock = this;
     lockHolder = NULL;
+    nextHeld = NULL;
+    profile = NULL;
+    if (kernel->synchProfiler != NULL)
+	profile = kernel->synchProfiler->Find("lock", name);
+    acquiredAt = 0;
 }
 
 //----------------------------------------------------------------------
@@ -176,12 +233,46 @@ Lock::~Lock()
 //	Atomically wait until the lock is free, then set it to busy.
 //	Equivalent to Semaphore::P(), with the semaphore value of 0
 //	equal to busy, and semaphore value of 1 equal to free.
+//
+//	While we wait, the holder runs at our level if that is better
+//	than its own (see Lend).  Once we have the lock, we take over
+//	the loans of the threads still waiting for it.
 //----------------------------------------------------------------------
 
 void Lock::Acquire()
 {
+    Ticks start = kernel->stats->totalTicks;
+    bool contended = (lockHolder != NULL);
+
     semaphore->P();
-    lockHolder = kernel->currentThread;
+    Took(start, contended);
+}
+
+//----------------------------------------------------------------------
+// Lock::Took
+//	The current thread has just got the lock: semaphore->P returned,
+//	or the lock was handed to it as it waited on a condition (see
+//	Condition::Signal).  Make it the holder.
+//
+//	"start" -- when it began to wait
+//	"contended" -- was the lock busy then?
+//----------------------------------------------------------------------
+
+void Lock::Took(Ticks start, bool contended)
+{
+    Thread *currentThread = kernel->currentThread;
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    lockHolder = currentThread;
+    currentThread->waitingFor = NULL;
+    nextHeld = currentThread->locksHeld;
+    currentThread->locksHeld = this;
+    Inherit(currentThread);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    acquiredAt = kernel->stats->totalTicks;
+    if (profile != NULL)
+	profile->Acquired(contended, acquiredAt - start);
+    TRACE(TraceLockAcquire, TraceId(this), (int) (acquiredAt - start));
 }
 
 //----------------------------------------------------------------------
@@ -191,15 +282,88 @@ void Lock::Acquire()
 //	Equivalent to Semaphore::V(), with the semaphore value of 0
 //	equal to busy, and semaphore value of 1 equal to free.
 //
+//	The levels lent us by the threads waiting for this lock go
+//	back; we keep those lent for the other locks we hold.
+//
 //	By convention, only the thread that acquired the lock
 // 	may release it.
 //---------------------------------------------------------------------
 
 void Lock::Release()
 {
+    Thread *currentThread = kernel->currentThread;
+    IntStatus oldLevel;
+    Lock **held;
+
     ASSERT(IsHeldByCurrentThread());
+    if (profile != NULL)
+	profile->holdTicks += kernel->stats->totalTicks - acquiredAt;
+    TRACE(TraceLockRelease, TraceId(this), (int) (kernel->stats->totalTicks - acquiredAt));
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    for (held = &currentThread->locksHeld; *held != this;
+					held = &(*held)->nextHeld)
+	;				// usually the first: the last taken
+    *held = nextHeld;
+    nextHeld = NULL;
     lockHolder = NULL;
+    Inherit(currentThread);
     semaphore->V();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Lock::Lend
+//	"waiter" is going to sleep until this lock is free: lend its
+//	level to the holder, if it is better than the holder's, and so
+//	on down the chain, to the holder of the lock the holder is
+//	waiting for.  The chain ends at a thread that already runs at
+//	least as high, so even a deadlock cycle ends it.
+//
+//	Called by Semaphore::P, with interrupts disabled.
+//----------------------------------------------------------------------
+
+void
+Lock::Lend(Thread *waiter)
+{
+    Scheduler *scheduler = kernel->scheduler;
+    int level = scheduler->Level(waiter);
+    Lock *lock = this;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    waiter->waitingFor = this;
+    while (lock != NULL && lock->lockHolder != NULL
+		&& level < scheduler->Level(lock->lockHolder)) {
+	Thread *holder = lock->lockHolder;
+
+	DEBUG(dbgThread, "Thread " << holder->getName() << " holding "
+		<< lock->name << " inherits level " << level
+		<< " from " << waiter->getName());
+	scheduler->Inherit(holder, level);
+	lock = holder->waitingFor;
+    }
+}
+
+//----------------------------------------------------------------------
+// Lock::Inherit
+//	Set the level "holder" has inherited to the best of those of the
+//	threads waiting for the locks it holds -- none, if it holds no
+//	lock anyone waits for.  Called with interrupts disabled, as it
+//	takes or releases a lock.
+//----------------------------------------------------------------------
+
+void
+Lock::Inherit(Thread *holder)
+{
+    Scheduler *scheduler = kernel->scheduler;
+    int level = NumSchedLevels;
+
+    for (Lock *lock = holder->locksHeld; lock != NULL; lock = lock->nextHeld) {
+	IntrusiveList<Thread> *waiters = lock->semaphore->queue;
+
+	for (Thread *t = waiters->Front(); t != NULL; t = waiters->Next(t))
+	    level = min(level, scheduler->Level(t));
+    }
+    scheduler->Inherit(holder, level);
 }
 
 //----------------------------------------------------------------------
@@ -214,6 +378,9 @@ Condition::Condition(char* debugName)
 {
     name = debugName;
     waitQueue = new List<Semaphore *>;
+    profile = NULL;
+    if (kernel->synchProfiler != NULL)
+	profile = kernel->synchProfiler->Find("condition", name);
 }
 
 //----------------------------------------------------------------------
@@ -244,15 +411,59 @@ Condition::~Condition()
 void Condition::Wait(Lock* conditionLock) 
 {
      Semaphore *waiter;
+     Ticks start = kernel->stats->totalTicks;
     
      ASSERT(conditionLock->IsHeldByCurrentThread());
 
      waiter = new Semaphore("condition", 0);
+     waiter->profile = NULL;
+     waitQueue->Append(waiter);
+     conditionLock->Release();
+     waiter->P();
+     Reacquire(conditionLock, start);
+     delete waiter;
+     if (profile != NULL)
+	profile->Acquired(TRUE, kernel->stats->totalTicks - start);
+     TRACE(TraceConditionWait, TraceId(this), (int) (kernel->stats->totalTicks - start));
+}
+
+//----------------------------------------------------------------------
+// Condition::TimedWait
+// 	Like Wait, but also have the alarm wake us up "timeout" ticks
+//	from now, if we are not signalled before.  Whether we were is
+//	whether the signaller took our semaphore off the queue; if it is
+//	still there, take it off ourselves.  As with Wait, the caller
+//	must check again whatever it was waiting for, either way.
+//
+//	"conditionLock" -- lock protecting the use of this condition
+//	"timeout" -- the longest to wait, in ticks
+//----------------------------------------------------------------------
+
+bool Condition::TimedWait(Lock* conditionLock, int timeout)
+{
+     Semaphore *waiter;
+     Wakeup *wakeup;
+     bool signalled;
+     Ticks start = kernel->stats->totalTicks;
+
+     ASSERT(conditionLock->IsHeldByCurrentThread());
+
+     waiter = new Semaphore("condition", 0);
+     waiter->profile = NULL;
      waitQueue->Append(waiter);
+     wakeup = kernel->alarm->SetWakeup(waiter, timeout);
      conditionLock->Release();
      waiter->P();
-     conditionLock->Acquire();
+     Reacquire(conditionLock, start);
+     signalled = !waitQueue->IsInList(waiter);
+     if (!signalled)
+	waitQueue->Remove(waiter);
+     kernel->alarm->CancelWakeup(wakeup);
      delete waiter;
+     if (profile != NULL)
+	profile->Acquired(TRUE, kernel->stats->totalTicks - start);
+     TRACE(TraceConditionWait, TraceId(this), (int) (kernel->stats->totalTicks - start));
+     return signalled;
 }
 
 //----------------------------------------------------------------------
@@ -267,6 +478,11 @@ void Condition::Wait(Lock* conditionLock)
 //	(unlike what is described in Birrell's paper).  This allows
 //	us to access waitQueue without disabling interrupts.
 //
+//	With handoff, a waiter already asleep is moved to the queue
+//	of the lock instead of being woken, since the first thing it
+//	would do is wait there (see Reacquire).  One that has not gone
+//	to sleep yet is woken as usual.
+//
 //	"conditionLock" -- lock protecting the use of this condition
 //----------------------------------------------------------------------
 
@@ -276,9 +492,43 @@ void Condition::Signal(Lock* conditionLock)
     
     ASSERT(conditionLock->IsHeldByCurrentThread());
     
+    TRACE(TraceConditionSignal, TraceId(this), waitQueue->IsEmpty() ? 0 : 1);
     if (!waitQueue->IsEmpty()) {
         waiter = waitQueue->RemoveFront();
-	waiter->V();
+	if (kernel->handoffSynch) {
+	    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+	    if (!waiter->queue->IsEmpty()) {
+		Thread *thread = waiter->queue->RemoveFront();
+
+		conditionLock->semaphore->queue->Append(thread);
+		conditionLock->Lend(thread);
+	    } else {
+		waiter->V();
+	    }
+	    (void) kernel->interrupt->SetLevel(oldLevel);
+	} else {
+	    waiter->V();
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Condition::Reacquire
+// 	Get back the lock a Wait released.  If Signal moved us to its
+//	queue (in which case we are marked waiting for it), it has been
+//	handed to us already.
+//
+//	"conditionLock" -- lock protecting the use of this condition
+//	"start" -- when the Wait began
+//----------------------------------------------------------------------
+
+void Condition::Reacquire(Lock* conditionLock, Ticks start)
+{
+    if (kernel->currentThread->waitingFor == conditionLock) {
+	conditionLock->Took(start, TRUE);
+    } else {
+	conditionLock->Acquire();
     }
 }
 
@@ -295,3 +545,101 @@ void Condition::Broadcast(Lock* conditionLock)
         Signal(conditionLock);
     }
 }
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, so that it can be used for
+//	synchronization.  Initially, no one holds it.
+//
+//	"debugName" is an arbitrary name, useful for debugging.  The lock
+//	and conditions it is made of take the same name.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    name = debugName;
+    lock = new Lock(debugName);
+    readable = new Condition(debugName);
+    writable = new Condition(debugName);
+    numReaders = 0;
+    numWaitingWriters = 0;
+    writer = NULL;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	Deallocate a reader-writer lock.  Nobody may hold it.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT(numReaders == 0 && writer == NULL);
+    delete writable;
+    delete readable;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+// 	Wait until the lock is neither held nor wanted by a writer, then
+//	add the current thread to its readers.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireRead()
+{
+    lock->Acquire();
+    while (writer != NULL || numWaitingWriters > 0)
+	readable->Wait(lock);
+    numReaders++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseRead
+// 	Give up reading; the last reader out lets a writer in.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    ASSERT(numReaders > 0);
+    numReaders--;
+    if (numReaders == 0)
+	writable->Signal(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+// 	Wait until nobody holds the lock, then hold it to write.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    ASSERT(writer != kernel->currentThread);
+    numWaitingWriters++;
+    while (writer != NULL || numReaders > 0)
+	writable->Wait(lock);
+    numWaitingWriters--;
+    writer = kernel->currentThread;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+// 	Give up writing.  The next waiting writer goes first; only if
+//	there is none are the waiting readers let in, all of them.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(IsHeldForWriteByCurrentThread());
+    writer = NULL;
+    if (numWaitingWriters > 0)
+	writable->Signal(lock);
+    else
+	readable->Broadcast(lock);
+    lock->Release();
+}
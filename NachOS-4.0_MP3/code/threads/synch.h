@@ -20,7 +20,11 @@
 #include "copyright.h"
 #include "thread.h"
 #include "list.h"
+#include "slab.h"
 #include "main.h"
+#include "synchprofile.h"
+
+class Lock;
 
 // The following class defines a "semaphore" whose value is a non-negative
 // integer.  The semaphore has only two operations P() and V():
@@ -36,6 +40,12 @@
 // into a register, a context switch might have occurred,
 // and some other thread might have called P or V, so the true value might
 // now be different.
+//
+// With -ho, V hands the value straight to the thread that has waited
+// longest, instead of adding it for whichever thread gets to P first:
+// the woken thread does not have to check again when it runs, and
+// cannot lose the value to one that comes along in the meantime and
+// so go back to sleep.
 
 class Semaphore {
   public:
@@ -46,12 +56,26 @@ class Semaphore {
     void P();	 	// these are the only operations on a semaphore
     void V();	 	// they are both *atomic*
     void SelfTest();	// test routine for semaphore implementation
+
+    void *operator new(size_t size);	// from the slab of semaphores:
+    void operator delete(void *p, size_t size); // Condition::Wait
+					// makes one each time
     
   private:
+    static thread_local Slab slab; // where Semaphores come from
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List<Thread *> *queue;     
-		  	// threads waiting in P() for the value to be > 0
+    IntrusiveList<Thread> *queue;
+		  	// threads waiting in P() for the value to be > 0;
+			// linked through Thread::nextWaiting, so waiting
+			// allocates nothing
+    SynchStats *profile;	// contention counted here, if profiling
+    Lock *lock;			// the lock made of it, if any: each
+				// thread that waits lends it its priority
+    bool handoff;		// V gives the value to a waiter, if any
+
+    friend class Lock;		// their own profiles stand in for that
+    friend class Condition;	// of the semaphores they are made of
    };
 
 // The following class defines a "lock".  A lock can be BUSY or FREE.
@@ -65,6 +89,14 @@ class Semaphore {
 // In addition, by convention, only the thread that acquired the lock
 // may release it.  As with semaphores, you can't read the lock value
 // (because the value might change immediately after you read it).  
+//
+// Locks have priority inheritance: under MLFQ, a thread that waits for
+// a lock lends its level to the thread holding it, if that is lower,
+// and on to the holder of the lock that one is waiting for, and so on
+// down the chain.  So a thread that has gone down to the lowest level
+// while it holds, say, the disk's lock is not kept off the CPU by the
+// threads between it and the one waiting for it.  The loan is paid
+// back when the lock is released.
 
 class Lock {
   public:
@@ -86,6 +118,19 @@ class Lock {
     char *name;			// debugging assist
     Thread *lockHolder;		// thread currently holding lock
     Semaphore *semaphore;	// we use a semaphore to implement lock
+    SynchStats *profile;	// contention counted here, if profiling
+    Ticks acquiredAt;		// when lockHolder got it
+    Lock *nextHeld;		// next of the locks lockHolder holds
+
+    void Took(Ticks start, bool contended);
+				// the current thread has the lock now
+    void Lend(Thread *waiter);	// lend "waiter"'s level down the chain
+    static void Inherit(Thread *holder);
+				// give "holder" the best level of the
+				// threads waiting for its locks
+
+    friend class Semaphore;	// calls Lend as a thread waits
+    friend class Condition;	// moves its waiters to our semaphore
 };
 
 // The following class defines a "condition variable".  A condition
@@ -120,6 +165,11 @@ class Lock {
 // can acquire the lock, and change data structures, before the woken
 // thread gets a chance to run.  The advantage to Mesa-style semantics
 // is that it is a lot easier to implement than Hoare-style.
+//
+// With -ho, a thread that is signalled does not wake up only to wait
+// for the lock the signaller holds: it is moved straight to the
+// lock's queue, and the lock is handed to it in turn as it is released
+// ("wait morphing").  The semantics are still Mesa's.
 
 class Condition {
   public:
@@ -135,10 +185,59 @@ class Condition {
     void Signal(Lock *conditionLock);   // conditionLock must be held by
     void Broadcast(Lock *conditionLock);// the currentThread for all of 
 					// these operations
+    bool TimedWait(Lock *conditionLock, int timeout);
+					// Wait, but for no more than
+					// "timeout" ticks; FALSE if it
+					// was not signalled in time
     // SelfTest routine provided by SyncLists
 
   private:
     char* name;
     List<Semaphore *> *waitQueue;	// list of waiting threads
+    SynchStats *profile;		// waits counted here, if profiling
+
+    void Reacquire(Lock *conditionLock, Ticks start);
+					// after a Wait, get the lock back
 };
+// The following class defines a "reader-writer lock".  Any number of
+// threads may hold it to read, or just one to write, but not both at
+// once.  The operations:
+//
+//	AcquireRead -- wait until no thread holds the lock to write, or
+//		is waiting to, then hold it to read
+//
+//	AcquireWrite -- wait until no thread holds the lock at all, then
+//		hold it to write
+//
+//	ReleaseRead / ReleaseWrite -- give up holding it, waking up the
+//		threads that can now go ahead
+//
+// Writers are preferred: once one is waiting, new readers wait behind
+// it, so a stream of readers cannot keep it out forever.  As with
+// locks, only the thread that holds the lock to write may release it;
+// a thread must not acquire the lock again while it holds it.
+
+class RWLock {
+  public:
+    RWLock(char* debugName);		// initialize lock to be free
+    ~RWLock();				// deallocate lock
+    char* getName() { return name; }	// debugging assist
+
+    void AcquireRead();
+    void ReleaseRead();
+    void AcquireWrite();
+    void ReleaseWrite();
+    bool IsHeldForWriteByCurrentThread() {
+		return writer == kernel->currentThread; }
+
+  private:
+    char *name;				// debugging assist
+    Lock *lock;				// protects the fields below
+    Condition *readable;		// signalled when readers may go on
+    Condition *writable;		// signalled when a writer may
+    int numReaders;			// threads holding it to read
+    int numWaitingWriters;		// threads waiting to write
+    Thread *writer;			// thread holding it to write, if any
+};
+
 #endif // SYNCH_H
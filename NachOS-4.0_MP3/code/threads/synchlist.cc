@@ -21,10 +21,32 @@
 
 template <class T>
 SynchList<T>::SynchList()
+{
+    Init(0);
+}
+
+//----------------------------------------------------------------------
+// SynchList<T>::SynchList
+//	Same, for a bounded list: appending to it waits while it holds
+//	"maxItems" items.
+//----------------------------------------------------------------------
+
+template <class T>
+SynchList<T>::SynchList(int maxItems)
+{
+    ASSERT(maxItems > 0);
+    Init(maxItems);
+}
+
+template <class T>
+void
+SynchList<T>::Init(int maxItems)
 {
     list = new List<T>;
     lock = new Lock("list lock"); 
     listEmpty = new Condition("list empty cond");
+    listFull = new Condition("list full cond");
+    capacity = maxItems;
 }
 
 //----------------------------------------------------------------------
@@ -35,6 +57,7 @@ SynchList<T>::SynchList()
 template <class T>
 SynchList<T>::~SynchList()
 { 
+    delete listFull;
     delete listEmpty;
     delete lock;
     delete list;
@@ -42,8 +65,9 @@ SynchList<T>::~SynchList()
 
 //----------------------------------------------------------------------
 // SynchList<T>::Append
-//      Append an "item" to the end of the list.  Wake up anyone
-//	waiting for an element to be appended.
+//      Append an "item" to the end of the list, waiting for room if
+//	the list is bounded and full.  Wake up anyone waiting for an
+//	element to be appended.
 //
 //	"item" is the thing to put on the list. 
 //----------------------------------------------------------------------
@@ -53,15 +77,50 @@ void
 SynchList<T>::Append(T item)
 {
     lock->Acquire();		// enforce mutual exclusive access to the list 
+    while (IsFull())
+	listFull->Wait(lock);	// wait until there is room
     list->Append(item);
     listEmpty->Signal(lock);	// wake up a waiter, if any
     lock->Release();
 }
 
+//----------------------------------------------------------------------
+// SynchList<T>::AppendMany
+//      Append "numItems" items to the end of the list, in order, with
+//	one acquire of the lock.  Those that do not fit in a bounded
+//	list wait for room; the removers are woken up as each part of
+//	the batch goes in, so that they make it.
+//
+//	"items" -- the things to put on the list
+//	"numItems" -- how many there are
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SynchList<T>::AppendMany(T *items, int numItems)
+{
+    int done = 0;
+
+    lock->Acquire();
+    while (done < numItems) {
+	while (IsFull()) {
+	    listEmpty->Broadcast(lock);	// let the removers make room
+	    listFull->Wait(lock);
+	}
+	while (done < numItems && !IsFull())
+	    list->Append(items[done++]);
+    }
+    if (numItems == 1)
+	listEmpty->Signal(lock);
+    else if (numItems > 1)
+	listEmpty->Broadcast(lock);	// there may be one for each
+    lock->Release();
+}
+
 //----------------------------------------------------------------------
 // SynchList<T>::RemoveFront
 //      Remove an "item" from the beginning of the list.  Wait if
-//	the list is empty.
+//	the list is empty; wake up an appender waiting for room.
 // Returns:
 //	The removed item. 
 //----------------------------------------------------------------------
@@ -76,10 +135,42 @@ SynchList<T>::RemoveFront()
     while (list->IsEmpty())
 	listEmpty->Wait(lock);		// wait until list isn't empty
     item = list->RemoveFront();
+    if (capacity > 0)
+	listFull->Signal(lock);		// there is room now
     lock->Release();
     return item;
 }
 
+//----------------------------------------------------------------------
+// SynchList<T>::RemoveMany
+//      Remove as many items as there are from the beginning of the
+//	list, up to "maxItems", with one acquire of the lock.  Wait if
+//	the list is empty; it does not wait for more than one.
+//
+//	"into" -- where to put the items, room for "maxItems"
+//	"maxItems" -- how many to take at most; more than 0
+// Returns:
+//	How many were removed.
+//----------------------------------------------------------------------
+
+template <class T>
+int
+SynchList<T>::RemoveMany(T *into, int maxItems)
+{
+    int count = 0;
+
+    ASSERT(maxItems > 0);
+    lock->Acquire();
+    while (list->IsEmpty())
+	listEmpty->Wait(lock);
+    while (count < maxItems && !list->IsEmpty())
+	into[count++] = list->RemoveFront();
+    if (capacity > 0)
+	listFull->Broadcast(lock);	// room for as many appenders
+    lock->Release();
+    return count;
+}
+
 //----------------------------------------------------------------------
 // SynchList<T>::Apply
 //      Apply function to every item on a list.
@@ -100,17 +191,31 @@ SynchList<T>::Apply(void (*func)(T))
 // SynchList<T>::SelfTest, SelfTestHelper
 //	Test whether the SynchList implementation is working,
 //	by having two threads ping-pong a value between them
-//	using two synchronized lists.
+//	using two synchronized lists: once an item at a time, then
+//	in batches, through two lists that hold one item each (a list
+//	cannot hold the same item twice).
 //----------------------------------------------------------------------
 
+const int SynchListTestBatch = 5;	// items per batch in SelfTest
+
 template <class T>
 void
 SynchList<T>::SelfTestHelper (void* data) 
 {
     SynchList<T>* _this = (SynchList<T>*)data;
+    T batch[SynchListTestBatch];
+
     for (int i = 0; i < 10; i++) {
         _this->Append(_this->selfTestPing->RemoveFront());
     }
+    for (int i = 0; i < 10; i++) {
+	int count = 0;
+
+	while (count < SynchListTestBatch)
+	    count += _this->selfTestPing->RemoveMany(&batch[count],
+					SynchListTestBatch - count);
+	_this->selfTestPong->AppendMany(batch, SynchListTestBatch);
+    }
 }
 
 template <class T>
@@ -118,13 +223,30 @@ void
 SynchList<T>::SelfTest(T val)
 {
     Thread *helper = new Thread("ping", 1);
+    T batch[SynchListTestBatch], got[SynchListTestBatch];
     
     ASSERT(list->IsEmpty());
-    selfTestPing = new SynchList<T>;
+    selfTestPing = new SynchList<T>(1);
+    selfTestPong = new SynchList<T>(1);
     helper->Fork(SynchList<T>::SelfTestHelper, this);
     for (int i = 0; i < 10; i++) {
         selfTestPing->Append(val);
 	ASSERT(val == this->RemoveFront());
     }
+    for (int i = 0; i < SynchListTestBatch; i++)
+	batch[i] = val;
+    for (int i = 0; i < 10; i++) {
+	int count = 0;
+
+	selfTestPing->AppendMany(batch, SynchListTestBatch);
+	while (count < SynchListTestBatch) {
+	    int n = selfTestPong->RemoveMany(got, SynchListTestBatch - count);
+
+	    for (int j = 0; j < n; j++)
+		ASSERT(got[j] == val);
+	    count += n;
+	}
+    }
+    delete selfTestPong;
     delete selfTestPing;
 }
@@ -19,18 +19,34 @@
 //	1. Threads trying to remove an item from a list will
 //	wait until the list has an element on it.
 //	2. One thread at a time can access list data structures
+//	3. If the list is bounded, threads trying to append an item
+//	wait until there is room for it
+//
+// AppendMany and RemoveMany move a batch of items with one acquire of
+// the lock, and one wakeup of those waiting on the other side, rather
+// than one per item.  A batch to append that does not fit in a bounded
+// list goes in as room is made for it: in order, but perhaps with
+// another thread's items in between.
 
 template <class T>
 class SynchList {
   public:
     SynchList();		// initialize a synchronized list
+    SynchList(int capacity);	// same, holding at most "capacity" items
     ~SynchList();		// de-allocate a synchronized list
 
     void Append(T item);	// append item to the end of the list,
-				// and wake up any thread waiting in remove
+				// and wake up any thread waiting in remove;
+				// wait for room if the list is full
+    void AppendMany(T *items, int numItems);
+				// append "numItems" items, in order
 
     T RemoveFront();		// remove the first item from the front of
 				// the list, waiting if the list is empty
+    int RemoveMany(T *into, int maxItems);
+				// remove up to "maxItems" items, at least
+				// one, waiting if the list is empty;
+				// return how many
 
     void Apply(void (*f)(T)); // apply function to all elements in list
 
@@ -40,9 +56,17 @@ class SynchList {
     List<T> *list;		// the list of things
     Lock *lock;			// enforce mutual exclusive access to the list
     Condition *listEmpty;	// wait in Remove if the list is empty
+    Condition *listFull;	// wait in Append if the list is full
+    int capacity;		// most items the list holds; 0 if there
+				// is no bound
+
+    void Init(int maxItems);	// the constructors' common part
+    bool IsFull()
+	{ return capacity > 0 && (int) list->NumInList() >= capacity; }
     
     // these are only to assist SelfTest()
     SynchList<T> *selfTestPing;
+    SynchList<T> *selfTestPong;
     static void SelfTestHelper(void* data);
 };
 
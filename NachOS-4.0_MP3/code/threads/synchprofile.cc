@@ -0,0 +1,139 @@
+// synchprofile.cc
+//	Routines to keep and print the contention profile of the
+//	synchronization objects.  See synchprofile.h.
+//
+//	There are only a few dozen distinct names, so records are found
+//	by a scan, once per object made -- not per operation, since each
+//	object keeps a pointer to its record.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "debug.h"
+#include "synchprofile.h"
+#include "heap.h"
+#include <string.h>
+
+//----------------------------------------------------------------------
+// SynchStats::SynchStats
+// 	Initialize the record for objects of "objectKind" named
+//	"objectName", with nothing counted yet.
+//----------------------------------------------------------------------
+
+SynchStats::SynchStats(char *objectKind, char *objectName)
+{
+    kind = objectKind;
+    name = new char[strlen(objectName) + 1];
+    strcpy(name, objectName);
+    numAcquires = numContended = 0;
+    waitTicks = maxWaitTicks = holdTicks = 0;
+}
+
+//----------------------------------------------------------------------
+// SynchStats::Acquired
+// 	Count an acquisition.  If it was "contended" -- the caller had to
+//	sleep for it -- count the "waited" ticks that took too.
+//----------------------------------------------------------------------
+
+void
+SynchStats::Acquired(bool contended, Ticks waited)
+{
+    numAcquires++;
+    if (contended) {
+	numContended++;
+	waitTicks += waited;
+	if (waited > maxWaitTicks)
+	    maxWaitTicks = waited;
+    }
+}
+
+//----------------------------------------------------------------------
+// SynchStats::Print
+// 	Print the record on one line, as "key=value" fields after the
+//	kind and name.
+//----------------------------------------------------------------------
+
+void
+SynchStats::Print()
+{
+    cout << kind << " \"" << name << "\": acquires=" << numAcquires;
+    cout << " contended=" << numContended << " wait=" << waitTicks;
+    cout << " maxWait=" << maxWaitTicks;
+    if (strcmp(kind, "lock") == 0)
+	cout << " hold=" << holdTicks;
+    cout << "\n";
+}
+
+//----------------------------------------------------------------------
+// SynchProfiler::SynchProfiler / ~SynchProfiler
+// 	Start with no records; de-allocate them all at the end.
+//----------------------------------------------------------------------
+
+SynchProfiler::SynchProfiler()
+{
+    records = new List<SynchStats *>;
+}
+
+SynchProfiler::~SynchProfiler()
+{
+    while (!records->IsEmpty()) {
+	SynchStats *r = records->RemoveFront();
+
+	delete [] r->name;
+	delete r;
+    }
+    delete records;
+}
+
+//----------------------------------------------------------------------
+// SynchProfiler::Find
+// 	Return the record for objects of "kind" named "name", making a
+//	new one the first time.  "kind" must be a string constant.
+//----------------------------------------------------------------------
+
+SynchStats *
+SynchProfiler::Find(char *kind, char *name)
+{
+    ListIterator<SynchStats *> it(records);
+    SynchStats *r;
+
+    for (; !it.IsDone(); it.Next()) {
+	r = it.Item();
+	if (strcmp(r->kind, kind) == 0 && strcmp(r->name, name) == 0)
+	    return r;
+    }
+    r = new SynchStats(kind, name);
+    records->Append(r);
+    return r;
+}
+
+//----------------------------------------------------------------------
+// SynchProfiler::Print
+// 	Print every record of objects that were ever acquired, the one
+//	with the longest total wait first.
+//----------------------------------------------------------------------
+
+static int
+MoreWait(SynchStats *x, SynchStats *y)
+{
+    if (x->waitTicks != y->waitTicks)
+	return (x->waitTicks > y->waitTicks) ? -1 : 1;
+    return 0;
+}
+
+void
+SynchProfiler::Print()
+{
+    PairingHeap<SynchStats *> sorted(MoreWait);
+    ListIterator<SynchStats *> it(records);
+
+    for (; !it.IsDone(); it.Next()) {
+	if (it.Item()->numAcquires > 0)
+	    sorted.Insert(it.Item());
+    }
+    cout << "Synchronization profile:\n";
+    while (!sorted.IsEmpty())
+	sorted.RemoveFront()->Print();
+}
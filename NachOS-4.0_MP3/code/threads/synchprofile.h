@@ -0,0 +1,69 @@
+// synchprofile.h
+//	Data structures for profiling contention on the synchronization
+//	objects -- semaphores, locks and condition variables -- when
+//	Nachos is run with -lp.
+//
+//	Objects are profiled by kind and debug name: every lock named
+//	"frame table lock" adds to the same record, however many of them
+//	there have been.  For each, we count
+//
+//	   acquisitions -- P() on a semaphore, Acquire() on a lock, Wait()
+//		on a condition
+//	   contended ones -- those that had to wait (always, for a
+//		condition)
+//	   total and longest wait -- simulated ticks from asking to
+//		getting it
+//	   hold time -- locks only: ticks from Acquire() to Release()
+//
+//	At halt, the records are printed, the longest total wait first.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SYNCHPROFILE_H
+#define SYNCHPROFILE_H
+
+#include "list.h"
+
+// The following class records the contention on all of the objects of
+// one kind with one name.
+
+class SynchStats {
+  public:
+    SynchStats(char *objectKind, char *objectName);
+
+    char *kind;				// "semaphore", "lock" or "condition"
+    char *name;				// the objects' debug name
+    int numAcquires;			// times they were asked for
+    int numContended;			// times that had to wait
+    Ticks waitTicks;			// total time waited
+    Ticks maxWaitTicks;			// longest single wait
+    Ticks holdTicks;			// total time held (locks only)
+
+    void Acquired(bool contended, Ticks waited);
+					// count an acquisition, which may
+					// have waited "waited" ticks
+    void Print();			// print them on one line
+};
+
+// The following class defines the collection of all the records.
+
+class SynchProfiler {
+  public:
+    SynchProfiler();			// Start with no records
+    ~SynchProfiler();			// De-allocate them
+
+    SynchStats *Find(char *kind, char *name);
+					// The record for objects of "kind"
+					// named "name", made if need be
+    void Print();			// Print every record in use, by
+					// total wait
+
+  private:
+    List<SynchStats *> *records;	// in the order first seen
+};
+
+#endif // SYNCHPROFILE_H
@@ -21,31 +21,82 @@
 #include "switch.h"
 #include "synch.h"
 #include "sysdep.h"
+#include "memcount.h"
 
 // this is put at the top of the execution stack, for detecting stack overflows
 const int STACK_FENCEPOST = 0xdedbeef;
 
+// Stacks of threads that have been deleted, ready for new threads to
+// use: allocating one, with its guard pages, costs a few system calls.
+// Only touched with interrupts off; each machine has its own pool, on
+// the host thread it runs on.
+static thread_local int *stackPool[MaxPooledStacks];
+static thread_local int numPooledStacks = 0;
+
 //----------------------------------------------------------------------
-// Thread::Thread
+// Thread::Thread, Thread::Initialize
 // 	Initialize a thread control block, so that we can then call
 //	Thread::Fork.
 //
 //	"threadName" is an arbitrary string, useful for debugging.
+//	"stackWords" is the size of its stack, in words; StackSize if
+//	not given.
 //----------------------------------------------------------------------
 
 Thread::Thread(char* threadName, int threadID)
 {
+    Initialize(threadName, threadID, StackSize);
+}
+
+Thread::Thread(char* threadName, int threadID, int stackWords)
+{
+    Initialize(threadName, threadID, stackWords);
+}
+
+void
+Thread::Initialize(char* threadName, int threadID, int stackWords)
+{
+    ASSERT(stackWords >= 1024);
 	ID = threadID;
     name = threadName;
     stackTop = NULL;
     stack = NULL;
+    stackSize = stackWords;
     status = JUST_CREATED;
     for (int i = 0; i < MachineStateSize; i++) {
 	machineState[i] = NULL;		// not strictly necessary, since
 					// new thread ignores contents 
 					// of machine registers
     }
+    for (int i = 0; i < NumTotalRegs; i++)
+	userRegisters[i] = 0;		// loaded if it is switched back to
+					// while its program is being loaded
     space = NULL;
+    userThreadId = MainThreadId;
+    userStack = -1;
+    transactionDepth = 0;
+    priority = 0;
+    inherited = NumSchedLevels;
+    waitingFor = NULL;
+    locksHeld = NULL;
+    background = FALSE;
+    quantum = kernel->timeSlice;
+    quantumUsed = 0;
+    tickets = DefaultTickets;
+    pass = 0;
+    readySince = 0;
+    runSince = 0;
+    runTicks = 0;
+    waitTicks = 0;
+    cpu = -1;
+    lastCPU = -1;
+    nextReady = NULL;
+    nextWaiting = NULL;
+    region = NULL;
+    stats = kernel->stats->NewThread(ID, name);
+    ioClass = IoBestEffort;
+    mount = NULL;
+    MemCount::Add(MemThread, sizeof(Thread));
 }
 
 //----------------------------------------------------------------------
@@ -58,20 +109,34 @@ Thread::Thread(char* threadName, int threadID)
 //      NOTE: if this is the main thread, we can't delete the stack
 //      because we didn't allocate it -- we got it automatically
 //      as part of starting up Nachos.
+//
+//	A stack of the usual size is kept for the next thread to be
+//	forked, unless MaxPooledStacks already are.
 //----------------------------------------------------------------------
 
 Thread::~Thread()
 {
     DEBUG(dbgThread, "Deleting thread: " << name);
     ASSERT(this != kernel->currentThread);
-    if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    kernel->scheduler->ForgetUserState(this);
+    MemCount::Remove(MemThread, sizeof(Thread));
+    if (stack == NULL) {
+	return;
+    }
+    MemCount::Remove(MemThreadStack, stackSize * sizeof(int));
+    if (stackSize == StackSize && numPooledStacks < MaxPooledStacks) {
+	stackPool[numPooledStacks++] = stack;
+    } else {
+	DeallocBoundedArray((char *) stack, stackSize * sizeof(int));
+    }
 }
 
 //----------------------------------------------------------------------
 // Thread::Fork
 // 	Invoke (*func)(arg), allowing caller and callee to execute 
-//	concurrently.
+//	concurrently.  The new thread starts out in the file system the
+//	caller is in (see mounttable.h).
 //
 //	NOTE: although our definition allows only a single argument
 //	to be passed to the procedure, it is possible to pass multiple
@@ -96,9 +161,10 @@ Thread::Fork(VoidFunctionPtr func, void *arg)
     IntStatus oldLevel;
     
     DEBUG(dbgThread, "Forking thread: " << name << " f(a): " << (int) func << " " << arg);
-    StackAllocate(func, arg);
 
     oldLevel = interrupt->SetLevel(IntOff);
+    mount = kernel->currentThread->mount;
+    StackAllocate(func, arg);		// may take a pooled stack
     scheduler->ReadyToRun(this);	// ReadyToRun assumes that interrupts 
 					// are disabled!
     (void) interrupt->SetLevel(oldLevel);
@@ -124,7 +190,7 @@ Thread::CheckOverflow()
 {
     if (stack != NULL) {
 #ifdef HPUX			// Stacks grow upward on the Snakes
-	ASSERT(stack[StackSize - 1] == STACK_FENCEPOST);
+	ASSERT(stack[stackSize - 1] == STACK_FENCEPOST);
 #else
 	ASSERT(*stack == STACK_FENCEPOST);
 #endif
@@ -173,7 +239,9 @@ Thread::Finish ()
     (void) kernel->interrupt->SetLevel(IntOff);		
     ASSERT(this == kernel->currentThread);
     
-    DEBUG(dbgThread, "Finishing thread: " << name);
+    DEBUG(dbgThread, "Finishing thread: " << name << ", ran "
+	    << runTicks + kernel->stats->totalTicks - runSince
+	    << " ticks, waited " << waitTicks);
     Sleep(TRUE);				// invokes SWITCH
     // not reached
 }
@@ -185,7 +253,8 @@ Thread::Finish ()
 //	If so, put the thread on the end of the ready list, so that
 //	it will eventually be re-scheduled.
 //
-//	NOTE: returns immediately if no other thread on the ready queue.
+//	NOTE: returns immediately if no other thread on the ready queue,
+//	or (see Scheduler::FindNextToYieldTo) none that is to run first.
 //	Otherwise returns when the thread eventually works its way
 //	to the front of the ready list and gets re-scheduled.
 //
@@ -207,7 +276,7 @@ Thread::Yield ()
     
     DEBUG(dbgThread, "Yielding thread: " << name);
     
-    nextThread = kernel->scheduler->FindNextToRun();
+    nextThread = kernel->scheduler->FindNextToYieldTo(this);
     if (nextThread != NULL) {
 	kernel->scheduler->ReadyToRun(this);
 	kernel->scheduler->Run(nextThread, FALSE);
@@ -227,7 +296,9 @@ Thread::Yield ()
 //	we have no thread to run.  "Interrupt::Idle" is called
 //	to signify that we should idle the CPU until the next I/O interrupt
 //	occurs (the only thing that could cause a thread to become
-//	ready to run).
+//	ready to run).  With several CPUs, that is only so once no other
+//	CPU has anything to run either: until then, this one goes idle,
+//	and one of the others is simulated (see Scheduler::SwitchCPU).
 //
 //	NOTE: we assume interrupts are already disabled, because it
 //	is called from the synchronization routines which must
@@ -248,6 +319,9 @@ Thread::Sleep (bool finishing)
     status = BLOCKED;
 	//cout << "debug Thread::Sleep " << name << "wait for Idle\n";
     while ((nextThread = kernel->scheduler->FindNextToRun()) == NULL) {
+	if (kernel->numCPUs > 1 && kernel->scheduler->SwitchCPU(finishing)) {
+	    return;			// another CPU has run us again
+	}
 		kernel->interrupt->Idle();	// no one to run, wait for an interrupt
 	}    
     // returns when it's time for us to run
@@ -298,6 +372,9 @@ PLabelToAddr(void *plabel)
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
+//	The stack of a thread that has finished is used if there is one,
+//	and this thread's is of the usual size.
+//
 //	"func" is the procedure to be forked
 //	"arg" is the parameter to be passed to the procedure
 //----------------------------------------------------------------------
@@ -305,34 +382,41 @@ PLabelToAddr(void *plabel)
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (stackSize == StackSize && numPooledStacks > 0) {
+	stack = stackPool[--numPooledStacks];
+    } else {
+	stack = (int *) AllocBoundedArray(stackSize * sizeof(int));
+    }
+    MemCount::Add(MemThreadStack, stackSize * sizeof(int));
+    stats->stackBytes = stackSize * sizeof(int);
 
 #ifdef PARISC
     // HP stack works from low addresses to high addresses
     // everyone else works the other way: from high addresses to low addresses
     stackTop = stack + 16;	// HP requires 64-byte frame marker
-    stack[StackSize - 1] = STACK_FENCEPOST;
+    stack[stackSize - 1] = STACK_FENCEPOST;
 #endif
 
 #ifdef SPARC
-    stackTop = stack + StackSize - 96; 	// SPARC stack must contains at 
+    stackTop = stack + stackSize - 96; 	// SPARC stack must contains at 
 					// least 1 activation record 
 					// to start with.
     *stack = STACK_FENCEPOST;
 #endif 
 
 #ifdef PowerPC // RS6000
-    stackTop = stack + StackSize - 16; 	// RS6000 requires 64-byte frame marker
+    stackTop = stack + stackSize - 16; 	// RS6000 requires 64-byte frame marker
     *stack = STACK_FENCEPOST;
 #endif 
 
 #ifdef DECMIPS
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
     *stack = STACK_FENCEPOST;
 #endif
 
 #ifdef ALPHA
-    stackTop = stack + StackSize - 8;	// -8 to be on the safe side!
+    stackTop = stack + stackSize - 8;	// -8 to be on the safe side!
     *stack = STACK_FENCEPOST;
 #endif
 
@@ -341,7 +425,7 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
     // the x86 passes the return address on the stack.  In order for SWITCH() 
     // to go to ThreadRoot when we switch to this thread, the return addres 
     // used in SWITCH() must be the starting address of ThreadRoot.
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
     *(--stackTop) = (int) ThreadRoot;
     *stack = STACK_FENCEPOST;
 #endif
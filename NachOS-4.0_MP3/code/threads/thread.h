@@ -26,6 +26,17 @@
 //	One thing to try if you find yourself with seg faults is to
 //	increase the size of thread stack -- ThreadStackSize.
 //
+//	A thread may be given a stack of its own size when it is made.
+//	Kernel workers that do little more than wait and hand things on
+//	(the buffer cache flusher, the network's receivers) get
+//	SmallStackSize, half the usual: the most any of them was seen to
+//	use is some 11KB on a 64-bit host, nearly all of it taken by the
+//	interrupt handlers that run on whatever thread they interrupt.
+//	Anything that calls into the file system keeps the full StackSize.
+//	The guard pages around each stack are left out of a build without
+//	DEBUG messages (see AllocBoundedArray); the fencepost is still
+//	checked.
+//
 //  	In this interface, forking a thread takes two steps.
 //	We must first allocate a data structure for it: "t = new Thread".
 //	Only then can we do the fork: "t->fork(f, arg)".
@@ -42,25 +53,40 @@
 #include "sysdep.h"
 #include "machine.h"
 #include "addrspace.h"
+#include "stats.h"
+#include "diskqueue.h"
 
 // CPU register state to be saved on context switch.  
 // The x86 needs to save only a few registers, 
 // SPARC and MIPS needs to save 10 registers, 
 // the Snake needs 18,
 // and the RS6000 needs to save 75 (!)
-// For simplicity, I just take the maximum over all architectures.
+// The x86 keeps only the 8 it uses (see switch.h), which makes every
+// thread some 270 bytes smaller; the rest take the maximum.
 
+#ifdef x86
+#define MachineStateSize 8
+#else
 #define MachineStateSize 75 
+#endif
 
 
 // Size of the thread's private execution stack.
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 const int StackSize = (8 * 1024);	// in words
+const int SmallStackSize = (4 * 1024);	// in words, for kernel workers
+					// that never call the file system
+const int MaxPooledStacks = 8;		// stacks of finished threads kept
+					// for new ones, instead of freed;
+					// only those of StackSize
 
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, ZOMBIE };
 
+class Lock;
+class ProfileRegion;
+class MountEntry;
 
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
@@ -82,6 +108,9 @@ class Thread {
 
   public:
     Thread(char* debugName, int threadID);		// initialize a Thread 
+    Thread(char* debugName, int threadID, int stackWords);
+					// one whose stack is "stackWords"
+					// words, not StackSize
     ~Thread(); 				// deallocate a Thread
 					// NOTE -- thread being deleted
 					// must not be running when delete 
@@ -104,6 +133,7 @@ class Thread {
 	char* getName() { return (name); }
     
 	int getID() { return (ID); }
+    int StackBytes() { return stackSize * sizeof(int); }
     void Print() { cout << name; }
     void SelfTest();		// test whether thread impl is working
 
@@ -113,9 +143,12 @@ class Thread {
     int *stack; 	 	// Bottom of the stack 
 				// NULL if this is the main thread
 				// (If NULL, don't deallocate stack)
+    int stackSize;		// words in it, once it is allocated
     ThreadStatus status;	// ready, running or blocked
     char* name;
 	int   ID;
+    void Initialize(char *threadName, int threadID, int stackWords);
+				// shared by the constructors
     void StackAllocate(VoidFunctionPtr func, void *arg);
     				// Allocate a stack for thread.
 				// Used internally by Fork()
@@ -129,8 +162,57 @@ class Thread {
   public:
     void SaveUserState();		// save user-level register state
     void RestoreUserState();		// restore user-level register state
+    void SetUserRegister(int num, int value) { userRegisters[num] = value; }
+					// for a thread about to start
 
     AddrSpace *space;			// User code this thread is running.
+    int userThreadId;			// which of the program's threads
+					// it is (see ThreadJoin)
+    int userStack;			// its stack region in "space", -1
+					// for the program's own stack
+    int transactionDepth;		// how deep in file system journal
+					// transactions it is; 0 if in none
+
+// Scheduling state, kept by the scheduler (see scheduler.h).
+
+    int priority;			// MLFQ level, 0 the highest
+    int inherited;			// MLFQ: the best level lent by the
+					// threads waiting for the locks it
+					// holds; NumSchedLevels if none
+    Lock *waitingFor;			// the lock it is waiting for, if any
+    Lock *locksHeld;			// the locks it holds, linked through
+					// Lock::nextHeld
+    bool background;			// MLFQ: wakes up at the lowest
+					// level, not the highest
+    int quantum;			// tickless timer: ticks it may run
+					// before it is switched out
+    int quantumUsed;			// MLFQ: timer interrupts run at it
+    int tickets;			// stride: its share of the CPU
+    double pass;			// stride: ticks run per ticket, from
+					// where it started
+    Ticks readySince;			// when last put on the ready list
+    Ticks runSince;			// when last given the CPU
+    Ticks runTicks;			// time spent running, to runSince
+    Ticks waitTicks;			// time spent ready but not running
+    ThreadStats *stats;			// what it has cost, kept after it
+					// is gone
+    IoClass ioClass;			// of its disk requests
+    MountEntry *mount;			// the file system it is in, whose
+					// devices the kernel points at while
+					// it runs; NULL for the root (see
+					// mounttable.h)
+    int cpu;				// the CPU it runs on, or whose ready
+					// queues it is on, or it last ran
+					// on; -1 if it has never been ready
+    int lastCPU;			// the CPU it last ran on, -1 if it
+					// has not run yet
+    Thread *nextReady;			// next on the same ready queue
+    Thread *nextWaiting;		// next waiting on the same semaphore
+    ProfileRegion *region;		// the innermost kernel profiling
+					// region it is in, for -kp
+
+    Ticks RunTicks() { return runTicks; }
+    Ticks WaitTicks() { return waitTicks; }
 };
 
 // external function, dummy routine whose sole job is to call Thread::Print
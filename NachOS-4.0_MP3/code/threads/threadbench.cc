@@ -0,0 +1,337 @@
+// threadbench.cc
+//	Routines to benchmark context switching and synchronization.  See
+//	threadbench.h.
+//
+//	Each case forks the threads it needs, lets them run, and waits
+//	on a semaphore each of them V's as it returns, so that all of
+//	them have finished (and, once the main thread next runs, been
+//	destroyed) before the case is reported.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "threadbench.h"
+#include "main.h"
+#include "synch.h"
+#include "sysdep.h"
+#include <stdio.h>
+
+// The following class defines what the threads of one case share.
+
+class BenchShared {
+  public:
+    int rounds;			// operations each thread does
+    Semaphore *done;		// V'ed by each thread as it returns
+    Semaphore *ping;		// for the semaphore handoff
+    Semaphore *pong;
+    Lock *lock;			// for the lock and condition cases
+    Condition *changed;		// broadcast as "generation" moves on
+    Condition *allWaiting;	// signalled as "numWaiting" gets there
+    int generation;		// rounds of the broadcast so far
+    int numThreads;		// threads that wait for it
+    int numWaiting;		// of them, those waiting for the next one
+    int counter;		// bumped with the lock held
+};
+
+//----------------------------------------------------------------------
+// ThreadBench::ThreadBench
+//	Open the results file, and start the JSON array of cases.
+//
+//	"resultFile" -- the UNIX file to write the results to
+//----------------------------------------------------------------------
+
+ThreadBench::ThreadBench(char *resultFile)
+{
+    resultFd = OpenForWrite(resultFile);
+    first = TRUE;
+    Put("[");
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::~ThreadBench
+//	End the array, and close the results file.
+//----------------------------------------------------------------------
+
+ThreadBench::~ThreadBench()
+{
+    Put("\n]\n");
+    Close(resultFd);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::Put
+//	Add "text" to the results file.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Put(char *text)
+{
+    WriteFile(resultFd, text, strlen(text));
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::Run
+//	Run every case, in turn.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Run()
+{
+    YieldPingPong(1000);
+    SemaphoreHandoff(1000);
+    LockContention(2, 500);
+    LockContention(8, 500);
+    ConditionBroadcast(2, 200);
+    ConditionBroadcast(8, 200);
+    ForkFinish(500);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::Start
+//	Note the statistics, and the time, as a case starts.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Start()
+{
+    startTicks = kernel->stats->totalTicks;
+    startSwitches = kernel->stats->numContextSwitches;
+    startNs = HostNanoseconds();
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::Report
+//	Write out what the case that just ended cost, since Start.
+//
+//	"name" -- what the case does
+//	"threads" -- how many threads it forked
+//	"ops" -- how many operations they did, in all
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Report(char *name, int threads, int ops)
+{
+    char line[300];
+    Ticks ticks = kernel->stats->totalTicks - startTicks;
+    long long ns = HostNanoseconds() - startNs;
+
+    snprintf(line, sizeof(line), "%s  {\"case\": \"%s\", \"threads\": %d, "
+	     "\"ops\": %d, \"ticks\": %lld, \"switches\": %d, "
+	     "\"hostNs\": %lld, \"ticksPerOp\": %.2f, \"nsPerOp\": %.1f}",
+	     first ? "\n" : ",\n", name, threads, ops, ticks,
+	     kernel->stats->numContextSwitches - startSwitches, ns,
+	     (double) ticks / ops, (double) ns / ops);
+    Put(line);
+    first = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Yielder, ThreadBench::YieldPingPong
+//	Two threads that do nothing but yield, "rounds" times each, so
+//	that each yield switches to the other one.
+//----------------------------------------------------------------------
+
+static void
+Yielder(void *arg)
+{
+    BenchShared *shared = (BenchShared *) arg;
+
+    for (int i = 0; i < shared->rounds; i++)
+	kernel->currentThread->Yield();
+    shared->done->V();
+}
+
+void
+ThreadBench::YieldPingPong(int rounds)
+{
+    BenchShared shared;
+
+    shared.rounds = rounds;
+    shared.done = new Semaphore("bench done", 0);
+    Start();
+    (new Thread("bench yielder", 1))->Fork(Yielder, &shared);
+    (new Thread("bench yielder", 1))->Fork(Yielder, &shared);
+    shared.done->P();
+    shared.done->P();
+    Report("yield ping-pong", 2, 2 * rounds);
+    delete shared.done;
+}
+
+//----------------------------------------------------------------------
+// Pinger, Ponger, ThreadBench::SemaphoreHandoff
+//	Two threads that hand a token back and forth through a pair of
+//	semaphores, "rounds" times: each V wakes the other one, and each
+//	P waits for it.
+//----------------------------------------------------------------------
+
+static void
+Pinger(void *arg)
+{
+    BenchShared *shared = (BenchShared *) arg;
+
+    for (int i = 0; i < shared->rounds; i++) {
+	shared->ping->V();
+	shared->pong->P();
+    }
+    shared->done->V();
+}
+
+static void
+Ponger(void *arg)
+{
+    BenchShared *shared = (BenchShared *) arg;
+
+    for (int i = 0; i < shared->rounds; i++) {
+	shared->ping->P();
+	shared->pong->V();
+    }
+    shared->done->V();
+}
+
+void
+ThreadBench::SemaphoreHandoff(int rounds)
+{
+    BenchShared shared;
+
+    shared.rounds = rounds;
+    shared.done = new Semaphore("bench done", 0);
+    shared.ping = new Semaphore("bench ping", 0);
+    shared.pong = new Semaphore("bench pong", 0);
+    Start();
+    (new Thread("bench pinger", 1))->Fork(Pinger, &shared);
+    (new Thread("bench ponger", 1))->Fork(Ponger, &shared);
+    shared.done->P();
+    shared.done->P();
+    Report("semaphore handoff", 2, 2 * rounds);
+    delete shared.pong;
+    delete shared.ping;
+    delete shared.done;
+}
+
+//----------------------------------------------------------------------
+// Contender, ThreadBench::LockContention
+//	"numThreads" threads that each take a lock "rounds" times, and
+//	yield while they hold it, so that the others find it held.
+//----------------------------------------------------------------------
+
+static void
+Contender(void *arg)
+{
+    BenchShared *shared = (BenchShared *) arg;
+
+    for (int i = 0; i < shared->rounds; i++) {
+	shared->lock->Acquire();
+	shared->counter++;
+	kernel->currentThread->Yield();
+	shared->lock->Release();
+    }
+    shared->done->V();
+}
+
+void
+ThreadBench::LockContention(int numThreads, int rounds)
+{
+    BenchShared shared;
+
+    shared.rounds = rounds;
+    shared.done = new Semaphore("bench done", 0);
+    shared.lock = new Lock("bench lock");
+    shared.counter = 0;
+    Start();
+    for (int i = 0; i < numThreads; i++)
+	(new Thread("bench contender", 1))->Fork(Contender, &shared);
+    for (int i = 0; i < numThreads; i++)
+	shared.done->P();
+    ASSERT(shared.counter == numThreads * rounds);
+    Report("lock contention", numThreads, numThreads * rounds);
+    delete shared.lock;
+    delete shared.done;
+}
+
+//----------------------------------------------------------------------
+// Waiter, ThreadBench::ConditionBroadcast
+//	"numThreads" threads that wait on a condition, "rounds" times,
+//	for the main thread to broadcast it; it does once all of them
+//	are waiting.
+//----------------------------------------------------------------------
+
+static void
+Waiter(void *arg)
+{
+    BenchShared *shared = (BenchShared *) arg;
+
+    shared->lock->Acquire();
+    for (int i = 0; i < shared->rounds; i++) {
+	int generation = shared->generation;
+
+	if (++shared->numWaiting == shared->numThreads)
+	    shared->allWaiting->Signal(shared->lock);
+	while (shared->generation == generation)
+	    shared->changed->Wait(shared->lock);
+    }
+    shared->lock->Release();
+    shared->done->V();
+}
+
+void
+ThreadBench::ConditionBroadcast(int numThreads, int rounds)
+{
+    BenchShared shared;
+
+    shared.rounds = rounds;
+    shared.done = new Semaphore("bench done", 0);
+    shared.lock = new Lock("bench lock");
+    shared.changed = new Condition("bench changed");
+    shared.allWaiting = new Condition("bench all waiting");
+    shared.generation = 0;
+    shared.numThreads = numThreads;
+    shared.numWaiting = 0;
+    Start();
+    for (int i = 0; i < numThreads; i++)
+	(new Thread("bench waiter", 1))->Fork(Waiter, &shared);
+    shared.lock->Acquire();
+    for (int i = 0; i < rounds; i++) {
+	while (shared.numWaiting < numThreads)
+	    shared.allWaiting->Wait(shared.lock);
+	shared.numWaiting = 0;
+	shared.generation++;
+	shared.changed->Broadcast(shared.lock);
+    }
+    shared.lock->Release();
+    for (int i = 0; i < numThreads; i++)
+	shared.done->P();
+    Report("condition broadcast", numThreads, rounds);
+    delete shared.allWaiting;
+    delete shared.changed;
+    delete shared.lock;
+    delete shared.done;
+}
+
+//----------------------------------------------------------------------
+// Quitter, ThreadBench::ForkFinish
+//	"numThreads" threads forked one after another, that each return
+//	as soon as they run.
+//----------------------------------------------------------------------
+
+static void
+Quitter(void *arg)
+{
+    ((BenchShared *) arg)->done->V();
+}
+
+void
+ThreadBench::ForkFinish(int numThreads)
+{
+    BenchShared shared;
+
+    shared.done = new Semaphore("bench done", 0);
+    Start();
+    for (int i = 0; i < numThreads; i++) {
+	(new Thread("bench quitter", 1))->Fork(Quitter, &shared);
+	shared.done->P();
+    }
+    Report("fork and finish", numThreads, numThreads);
+    delete shared.done;
+}
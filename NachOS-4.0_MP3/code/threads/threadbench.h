@@ -0,0 +1,58 @@
+// threadbench.h
+//	Data structures for a micro-benchmark of context switching and
+//	synchronization, run by "nachos -bench-threads <file>" (or "make
+//	bench-threads").
+//
+//	Each case does many of one kind of operation -- two threads
+//	yielding to each other, or handing a semaphore back and forth;
+//	a group of threads taking turns with a lock, or waiting together
+//	on a condition that is broadcast; threads forked and finishing
+//	-- and reports what it cost: simulated ticks, context switches,
+//	and host time, in all and per operation.  Where -K checks that
+//	the threads and synchronization work, this is the yardstick for
+//	how fast they are: the results go to the file named, as JSON, in
+//	the same form as those of filesys/fsbench.h, so that runs of
+//	different versions can be compared by a script.
+//
+//	The cases run in the main thread, before any user program, and
+//	every thread they fork is done before the next one starts.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef THREADBENCH_H
+#define THREADBENCH_H
+
+#include "utility.h"
+
+class ThreadBench {
+  public:
+    ThreadBench(char *resultFile);
+				// Open the results file
+    ~ThreadBench();		// Finish it, and close it
+
+    void Run();			// Run every case
+
+  private:
+    int resultFd;		// the UNIX file of JSON results
+    bool first;			// no case reported yet?
+    Ticks startTicks;
+    int startSwitches;		// the statistics when the case started
+    long long startNs;		// and the host time
+
+    void Put(char *text);	// add "text" to the results
+    void Start();		// a case starts: take a snapshot
+    void Report(char *name, int threads, int ops);
+				// it is over: write what it cost
+
+    void YieldPingPong(int rounds);
+    void SemaphoreHandoff(int rounds);
+    void LockContention(int numThreads, int rounds);
+    void ConditionBroadcast(int numThreads, int rounds);
+    void ForkFinish(int numThreads);
+};
+
+#endif // THREADBENCH_H
@@ -0,0 +1,85 @@
+// tracer.cc
+//	Routines to record kernel events in a ring buffer, and to write it
+//	out at halt.  See tracer.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "tracer.h"
+#include "main.h"
+#include "sysdep.h"
+
+//----------------------------------------------------------------------
+// Tracer::Tracer
+// 	Initialize the tracer, with nothing recorded yet.
+//
+//	"traceFile" -- the UNIX file the records are written to at halt
+//----------------------------------------------------------------------
+
+Tracer::Tracer(char *traceFile)
+{
+    fileName = traceFile;
+    ring = new TraceRecord[TraceBufferRecords];
+    next = 0;
+    numRecorded = 0;
+}
+
+//----------------------------------------------------------------------
+// Tracer::~Tracer
+// 	De-allocate the ring.
+//----------------------------------------------------------------------
+
+Tracer::~Tracer()
+{
+    delete [] ring;
+}
+
+//----------------------------------------------------------------------
+// Tracer::Record
+// 	Add a record of "event", with its detail "arg0" and "arg1", as
+//	happening now in the current thread -- overwriting the oldest
+//	record if the ring is full.
+//----------------------------------------------------------------------
+
+void
+Tracer::Record(TraceEvent event, int arg0, int arg1)
+{
+    TraceRecord *r = &ring[next];
+
+    r->ticks = kernel->stats->totalTicks;
+    r->event = event;
+    r->thread = (kernel->currentThread == NULL) ? -1 :
+					kernel->currentThread->getID();
+    r->arg[0] = arg0;
+    r->arg[1] = arg1;
+    r->unused = 0;
+    next = (next + 1) % TraceBufferRecords;
+    numRecorded++;
+}
+
+//----------------------------------------------------------------------
+// Tracer::Dump
+// 	Write the header, then the records still in the ring, oldest
+//	first, to the trace file.  Called at halt.
+//----------------------------------------------------------------------
+
+void
+Tracer::Dump()
+{
+    int fd = OpenForWrite(fileName);
+    int header[2];
+    int numKept = min(numRecorded, TraceBufferRecords);
+
+    header[0] = numKept;
+    header[1] = numRecorded - numKept;
+    WriteFile(fd, "NTRC", 4);
+    WriteFile(fd, (char *) header, sizeof(header));
+    if (numKept == TraceBufferRecords) {	// full: the oldest is at "next"
+	WriteFile(fd, (char *) &ring[next],
+			(TraceBufferRecords - next) * sizeof(TraceRecord));
+    }
+    WriteFile(fd, (char *) ring, next * sizeof(TraceRecord));
+    Close(fd);
+}
@@ -0,0 +1,96 @@
+// tracer.h
+//	Data structures for tracing kernel events into memory, when Nachos
+//	is run with -tr: disk requests, system calls, context switches and
+//	operations on the synchronization objects.
+//
+//	Unlike DEBUG, which formats a line of text for each message, a
+//	probe only fills in a fixed-size binary record -- when it happened
+//	(in simulated ticks), what, in which thread, and two words of
+//	detail -- in a ring buffer, so tracing does not slow the simulation
+//	down enough to matter, even for runs of millions of disk sectors.
+//	If the ring fills up, the oldest records are overwritten.
+//
+//	At halt, the records are written to the trace file, oldest first,
+//	after a header; test/trace.py decodes them.  The file layout is
+//	host byte order:
+//
+//	   header -- the characters "NTRC", then the number of records
+//		that follow and the number that were overwritten (ints)
+//	   records -- each a TraceRecord, 24 bytes
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef TRACER_H
+#define TRACER_H
+
+#include "utility.h"
+
+const int TraceBufferRecords = 65536;	// records kept, at most
+
+// The kinds of events, and the two words of detail each records.  Keep
+// this in step with test/trace.py.
+
+enum TraceEvent {
+    TraceDiskRead,		// first sector, number of sectors
+    TraceDiskWrite,		// first sector, number of sectors
+    TraceSyscall,		// syscall code, first argument (r4)
+    TraceSwitch,		// ID of the thread switched to, 1 if the
+				// old one is finishing
+    TraceSemaphoreP,		// the semaphore, ticks it waited
+    TraceSemaphoreV,		// the semaphore, 1 if it woke a thread
+    TraceLockAcquire,		// the lock, ticks it waited
+    TraceLockRelease,		// the lock, ticks it was held
+    TraceConditionWait,		// the condition, ticks it waited
+    TraceConditionSignal	// the condition, 1 if it woke a thread
+};
+
+// The following class defines one record, as kept in memory and
+// written to the trace file.
+
+class TraceRecord {
+  public:
+    Ticks ticks;		// kernel->stats->totalTicks
+    short event;		// a TraceEvent
+    short thread;		// ID of the thread running, -1 if none
+    int arg[2];			// detail, depending on "event"
+    int unused;			// so that the size is the same on every
+				// host, however "ticks" is aligned
+};
+
+// The following class defines the tracer: the ring of records, and
+// where to write it out.
+
+class Tracer {
+  public:
+    Tracer(char *traceFile);	// Start with no records
+    ~Tracer();			// De-allocate the ring
+
+    void Record(TraceEvent event, int arg0, int arg1);
+				// Add a record of "event" now
+    void Dump();		// Write the records to the trace file
+
+  private:
+    char *fileName;		// where Dump writes to
+    TraceRecord *ring;		// TraceBufferRecords of them
+    int next;			// where the next record goes
+    int numRecorded;		// records added, ever
+};
+
+//----------------------------------------------------------------------
+// TRACE
+//      If events are being traced, record one.  "object" probes pass a
+//	pointer, of which the low 32 bits identify the object.
+//----------------------------------------------------------------------
+
+#define TRACE(event,arg0,arg1)                                               \
+    if (kernel->tracer == NULL) {} else {				\
+        kernel->tracer->Record(event, arg0, arg1);			\
+    }
+
+#define TraceId(object)	((int) (long) (object))
+
+#endif // TRACER_H
@@ -0,0 +1,109 @@
+// workerpool.cc
+//	Routines to run jobs on a pool of kernel worker threads.  See
+//	workerpool.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "workerpool.h"
+#include "main.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// WorkerPool::WorkerPool
+// 	Initialize a pool of "numThreads" worker threads, with no jobs.
+//	The threads are forked when the first job comes.
+//
+//	"debugName" -- the name of the pool, and of its threads
+//----------------------------------------------------------------------
+
+WorkerPool::WorkerPool(char *debugName, int numThreads)
+{
+    ASSERT(numThreads > 0);
+    name = debugName;
+    numWorkers = numThreads;
+    started = FALSE;
+    jobs = new List<WorkerJob *>;
+    pending = new Semaphore(debugName, 0);
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::~WorkerPool
+// 	De-allocate the pool, at halt.  Jobs that never ran are dropped;
+//	the workers, asleep, are never run again.
+//----------------------------------------------------------------------
+
+WorkerPool::~WorkerPool()
+{
+    while (!jobs->IsEmpty())
+	delete jobs->RemoveFront();
+    delete jobs;
+    delete pending;
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::Submit
+// 	Queue a job, to call func(arg) on one of the workers, and wake one
+//	of them up.  Never waits, so it may be called from an interrupt
+//	handler.
+//----------------------------------------------------------------------
+
+void
+WorkerPool::Submit(VoidFunctionPtr func, void *arg)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (!started)
+	Start();
+    jobs->Append(new WorkerJob(func, arg));
+    DEBUG(dbgThread, "Job submitted to " << name << ", "
+		     << jobs->NumInList() << " pending");
+    pending->V();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::Start
+// 	Fork the worker threads.  Called with interrupts off.
+//----------------------------------------------------------------------
+
+void
+WorkerPool::Start()
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    started = TRUE;
+    for (int i = 0; i < numWorkers; i++) {
+	Thread *t = new Thread(name, 1);
+
+	t->Fork((VoidFunctionPtr) WorkerPool::Worker, (void *) this);
+    }
+}
+
+//----------------------------------------------------------------------
+// WorkerPool::Worker
+// 	The procedure each worker thread runs: forever, wait for a job,
+//	then run it.
+//
+//	"pool" -- the WorkerPool the thread belongs to
+//----------------------------------------------------------------------
+
+void
+WorkerPool::Worker(void *pool)
+{
+    WorkerPool *p = (WorkerPool *) pool;
+
+    for (;;) {
+	WorkerJob *job;
+	IntStatus oldLevel;
+
+	p->pending->P();
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	job = p->jobs->RemoveFront();
+	(void) kernel->interrupt->SetLevel(oldLevel);
+
+	(*job->func)(job->arg);
+	delete job;
+    }
+}
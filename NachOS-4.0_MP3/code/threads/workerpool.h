@@ -0,0 +1,68 @@
+// workerpool.h
+//	Data structures for a pool of kernel worker threads, which run
+//	short jobs -- a procedure and its argument -- handed to them, so
+//	that the kernel need not create a thread for each.
+//
+//	A job can be submitted from anywhere, including an interrupt
+//	handler: submitting never waits (the queue is only touched with
+//	interrupts off, and the workers are woken by a semaphore).  The
+//	worker threads themselves are only forked when the first job is
+//	submitted, so a pool that is never used costs nothing.  They then
+//	live until Nachos halts, sleeping when there is nothing to do.
+//
+//	Jobs run in the order submitted, but with more than one worker,
+//	one may start before an earlier one has finished.  A job may
+//	block (on the disk, a lock, ...), holding up only its worker.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include "utility.h"
+#include "list.h"
+
+class Semaphore;
+
+const int NumWorkers = 2;		// threads in the kernel's pool
+
+// The following class records one job waiting to be run.
+
+class WorkerJob {
+  public:
+    WorkerJob(VoidFunctionPtr f, void *a) { func = f; arg = a; }
+
+    VoidFunctionPtr func;		// the procedure to call
+    void *arg;				// and what to call it with
+};
+
+// The following class defines a pool of worker threads.
+
+class WorkerPool {
+  public:
+    WorkerPool(char *debugName, int numThreads);
+					// Initialize a pool; no threads yet
+    ~WorkerPool();			// De-allocate what it still holds
+
+    void Submit(VoidFunctionPtr func, void *arg);
+					// Have a worker call func(arg)
+					// soon; never waits
+    int NumPending() { return jobs->NumInList(); }
+					// jobs not yet started
+
+  private:
+    char *name;				// for the workers, and debugging
+    int numWorkers;			// how many threads to fork
+    bool started;			// have they been forked?
+    List<WorkerJob *> *jobs;		// submitted, not yet started
+    Semaphore *pending;			// counts the jobs in "jobs"
+
+    void Start();			// fork the worker threads
+    static void Worker(void *pool);	// what each of them runs
+};
+
+#endif // WORKERPOOL_H
@@ -19,7 +19,19 @@
 #include "main.h"
 #include "addrspace.h"
 #include "machine.h"
-#include "noff.h"
+#include "frametable.h"
+#include "swapspace.h"
+#include "loadcontrol.h"
+#include "tlbmanager.h"
+#include "aioqueue.h"
+#include "imagetable.h"
+#include "proctable.h"
+#include "profiler.h"
+#include "sysdep.h"
+
+static thread_local int nextAsid = 1;	// ids handed out to address
+					// spaces, on this machine; 0 is
+					// never a program's
 
 //----------------------------------------------------------------------
 // SwapHeader
@@ -60,41 +72,168 @@ SwapHeader (NoffHeader *noffH)
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
-//	Set up the translation from program memory to physical 
-//	memory.  For now, this is really simple (1:1), since we are
-//	only uniprogramming, and we have a single unsegmented page table
+//	We have a single unsegmented page table; it is empty until a
+//	program is loaded, and then just big enough for the program's
+//	pages and whatever it maps (see GrowTable).  No frames are taken
+//	yet: each page gets one when it is first touched, so any number
+//	of programs can be resident at once.
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace()
 {
-    pageTable = new TranslationEntry[NumPhysPages];
-    for (int i = 0; i < NumPhysPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virt page # = phys page #
-	pageTable[i].physicalPage = i;
-	pageTable[i].valid = TRUE;
-	pageTable[i].use = FALSE;
-	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  
-    }
-    
-    // zero out the entire address space
-    bzero(kernel->machine->mainMemory, MemorySize);
+    pageTable = NULL;
+    swapSlot = NULL;
+    files = new FileDescriptorTable;
+    cwd = new WorkingDirectory;
+    aio = NULL;
+    executable = NULL;
+    programName = NULL;
+    image = NULL;
+    profile = NULL;
+    numPages = filePages = tableSize = tableEntries = 0;
+    faultAround = min(2, kernel->faultAroundPages);
+    numAhead = 0;
+    asid = nextAsid++;
+    for (int i = 0; i < MaxMappings; i++)
+	mappings[i].file = NULL;
+    for (int i = 0; i < MaxUserThreads; i++)
+	stackInUse[i] = FALSE;
+    threads = new ProcessTable();
+    int first = threads->Add(0);	// the thread being started now
+    ASSERT(first == MainThreadId);
+    numThreads = 1;
+    exitStatus = 0;
+    retired = reclaimed = FALSE;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::~AddrSpace
-// 	Dealloate an address space.
+// 	Dealloate an address space.  Mapped regions are written back
+//	first, as if the program had unmapped them; then the frames and
+//	swap slots of the rest of the pages are given back -- unless the
+//	reaper has done both already (see reaper.h).
 //----------------------------------------------------------------------
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
+   if (!retired)
+	Retire();
+   if (!reclaimed) {
+	int *slots = new int[tableSize];
+	int count = 0;
+
+	kernel->frameTable->Acquire();
+	(void) Reclaim(slots, &count);
+	kernel->swapSpace->FreeMany(slots, count);
+	kernel->frameTable->Release();
+	delete [] slots;
+   }
+
+   if (profile != NULL)
+	kernel->profiler->Finish(profile);
+   if (executable != NULL)
+	delete executable;
+   if (programName != NULL)
+	delete [] programName;
+   delete [] swapSlot;
+   delete [] pageTable;
+   delete files;			// closes anything left open
+   delete cwd;
+   delete threads;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Retire
+// 	The program has exited: do what has to be done before its parent
+//	hears of it.  Load control forgets it, its requests at the disk
+//	finish, and the regions it has mapped are written back to their
+//	files and removed, as if it had unmapped them.  The rest of its
+//	pages are left for Reclaim.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Retire()
+{
+   ASSERT(!retired);
+   if (kernel->loadControl != NULL)
+	kernel->loadControl->Forget(this);
+   if (aio != NULL) {
+	delete aio;			// waits for what is at the disk
+	aio = NULL;
+   }
+   for (int i = 0; i < MaxMappings; i++) {
+	if (mappings[i].file != NULL)
+	    Unmap(mappings[i].firstPage * PageSize);
+   }
+   retired = TRUE;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::Reclaim
+// 	Give back the frames of a retired address space, and its hold on
+//	the executable's shared code; the frame table's lock must be
+//	held.  Its swap slots are not freed here, but added to "slots",
+//	for the caller to free together with others (see SwapSpace::
+//	FreeMany).  Return how many frames it had.
+//
+//	"slots" -- room for TableSize() more slots after the first
+//		"*numSlots"
+//	"numSlots" -- how many are in "slots"; updated
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Reclaim(int *slots, int *numSlots)
+{
+   int numFrames = 0;
+
+   ASSERT(retired && !reclaimed);
+#ifdef USE_TLB
+   kernel->tlbManager->FlushSpace(this);
+#endif
+   kernel->machine->FlushTranslations();	// they point into pageTable
+   for (unsigned int vpn = 0; vpn < tableSize; vpn++) {
+	if (pageTable[vpn].valid) {
+	    kernel->frameTable->Free(pageTable[vpn].physicalPage, this);
+	    pageTable[vpn].valid = FALSE;
+	    numFrames++;
+	}
+	if (swapSlot[vpn] != -1) {
+	    slots[(*numSlots)++] = swapSlot[vpn];
+	    swapSlot[vpn] = -1;
+	}
+   }
+   for (int i = 0; i < MaxUserThreads; i++)
+	stackInUse[i] = FALSE;
+   if (image != NULL)
+	kernel->imageTable->Detach(image, this);
+   image = NULL;
+   reclaimed = TRUE;
+   return numFrames;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AsyncRequests
+// 	Return the queue of the program's asynchronous reads and writes
+//	(see aioqueue.h), making it the first time.  A forked copy starts
+//	with none of its parent's.
+//----------------------------------------------------------------------
+
+AioQueue *
+AddrSpace::AsyncRequests()
+{
+    if (aio == NULL)
+	aio = new AioQueue;
+    return aio;
+}
 
 //----------------------------------------------------------------------
 // AddrSpace::Load
-// 	Load a user program into memory from a file.
+// 	Get ready to run a user program from a file.  Only the header
+//	is read here; the executable stays open, and each page of code
+//	and data is read from it when the program first touches it
+//	(see LoadPage).  The program is entered in the image table, so
+//	that its code pages can be shared with any other program that
+//	is running the same file.
 //
 //	Assumes that the page table has been initialized, and that
 //	the object code file is in NOFF format.
@@ -105,14 +244,16 @@ AddrSpace::~AddrSpace()
 bool 
 AddrSpace::Load(char *fileName) 
 {
-    OpenFile *executable = kernel->fileSystem->Open(fileName);
-    NoffHeader noffH;
     unsigned int size;
 
+    executable = kernel->fileSystem->Open(fileName);
+
     if (executable == NULL) {
 	cerr << "Unable to open file " << fileName << "\n";
 	return FALSE;
     }
+    programName = new char[strlen(fileName) + 1];
+    strcpy(programName, fileName);
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
     if ((noffH.noffMagic != NOFFMAGIC) && 
@@ -134,43 +275,261 @@ AddrSpace::Load(char *fileName)
 #endif
     numPages = divRoundUp(size, PageSize);
     size = numPages * PageSize;
+    filePages = FilePages();
+    if (kernel->profiler != NULL)
+	profile = kernel->profiler->Start(programName,
+			noffH.code.virtualAddr + noffH.code.size);
 
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
-						// to run anything too big --
-						// at least until we have
-						// virtual memory
+    ASSERT(numPages <= NumVirtPages);		// check we're not trying
+						// to run anything too big
 
     DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
+    kernel->frameTable->Acquire();
+    GrowTable(numPages);
+#ifndef FILESYS_STUB
+    image = kernel->imageTable->Attach(this, executable->HeaderSector(),
+				       TextPages());
+#endif
+    kernel->frameTable->Release();
+    return TRUE;			// success
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Fork
+// 	Make a copy of this address space for a forked program, without
+//	copying any memory: the copy gets its own page table, pointing at
+//	the same frames and swap slots, and the pages both have in memory
+//	are made read-only in both.  Whichever one writes to such a page
+//	first takes a copy of it then (see CopyOnWrite).  A page that is
+//	not in memory simply shares its swap slot, and is paged in
+//	separately by each of them.
+//
+//	Mapped regions are not passed on -- the child's page table only
+//	covers the program -- and neither are open files.  The working
+//	directory is, and so are the ends of pipes, which is how two
+//	programs come to have one between them.
+//
+//	Return NULL if the executable cannot be opened again.
+//----------------------------------------------------------------------
+
+AddrSpace *
+AddrSpace::Fork()
+{
+    AddrSpace *child = new AddrSpace();
 
-// then, copy in the code and data segments into memory
-// Note: this code assumes that virtual address = physical address
-    if (noffH.code.size > 0) {
-        DEBUG(dbgAddr, "Initializing code segment.");
-	DEBUG(dbgAddr, noffH.code.virtualAddr << ", " << noffH.code.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.code.virtualAddr]), 
-			noffH.code.size, noffH.code.inFileAddr);
+    ASSERT(programName != NULL);	// there is a program to copy
+    child->cwd->CopyFrom(cwd);
+    child->files->CopyPipesFrom(files);
+    child->executable = kernel->fileSystem->Open(programName);
+    if (child->executable == NULL) {
+	delete child;
+	return NULL;
+    }
+    child->programName = new char[strlen(programName) + 1];
+    strcpy(child->programName, programName);
+    child->noffH = noffH;
+    child->numPages = numPages;
+    child->filePages = filePages;
+    if (kernel->profiler != NULL)
+	child->profile = kernel->profiler->Start(programName,
+			noffH.code.virtualAddr + noffH.code.size);
+
+    kernel->frameTable->Acquire();
+    child->GrowTable(numPages);
+    if (image != NULL)
+	child->image = kernel->imageTable->Attach(child, image->sector,
+						  image->textPages);
+#ifdef USE_TLB
+    kernel->tlbManager->FlushSpace(this);	// our entries may be writable
+#endif
+    for (unsigned int vpn = 0; vpn < numPages; vpn++) {
+	child->swapSlot[vpn] = swapSlot[vpn];
+	if (swapSlot[vpn] != -1)
+	    kernel->swapSpace->Share(swapSlot[vpn]);
+	if (pageTable[vpn].valid) {
+	    pageTable[vpn].readOnly = TRUE;
+	    child->pageTable[vpn] = pageTable[vpn];
+	    kernel->frameTable->Share(pageTable[vpn].physicalPage, child);
+	}
     }
-    if (noffH.initData.size > 0) {
-        DEBUG(dbgAddr, "Initializing data segment.");
-	DEBUG(dbgAddr, noffH.initData.virtualAddr << ", " << noffH.initData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.initData.virtualAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
+    kernel->machine->FlushTranslations();	// some pages went read-only
+    kernel->frameTable->Release();
+    DEBUG(dbgAddr, "Forked address space " << asid << " as " << child->asid);
+    return child;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::GrowTable
+// 	Make the page table cover "size" pages.  New pages are invalid
+//	and have never been swapped out.  If the arrays have to grow,
+//	they are copied; the frame table's lock must be held, since its
+//	policies look at this address space's entries too.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::GrowTable(unsigned int size)
+{
+    if (size > tableEntries) {
+	TranslationEntry *newTable = new TranslationEntry[size];
+	int *newSlots = new int[size];
+	unsigned int i;
+
+	for (i = 0; i < tableEntries; i++) {
+	    newTable[i] = pageTable[i];
+	    newSlots[i] = swapSlot[i];
+	}
+	for (; i < size; i++) {
+	    newTable[i].virtualPage = i;
+	    newTable[i].physicalPage = 0;
+	    newTable[i].valid = FALSE;
+	    newTable[i].use = FALSE;
+	    newTable[i].dirty = FALSE;
+	    newTable[i].readOnly = FALSE;
+	    newSlots[i] = -1;
+	}
+	delete [] pageTable;
+	delete [] swapSlot;
+	pageTable = newTable;
+	swapSlot = newSlots;
+	tableEntries = size;
     }
+    if (size > tableSize)
+	tableSize = size;
+    if (kernel->currentThread->space == this)
+	RestoreState();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPage
+// 	Fill the frame "frame" with virtual page "vpn" of the program:
+//	whatever parts of the code and data segments fall in the page are
+//	read from the executable, and the rest -- uninitialized data and
+//	stack -- is zero.
+//
+//	A page that one segment covers all of is read straight into the
+//	frame, with nothing to clear first; if the segment is page aligned
+//	in the file (see noff.h), that is a read of whole sectors.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadPage(int vpn, char *frame)
+{
+    Segment *segments[3];
+    int numSegments = 0;
+    int pageStart = vpn * PageSize;
 
+    segments[numSegments++] = &noffH.code;
+    segments[numSegments++] = &noffH.initData;
 #ifdef RDATA
-    if (noffH.readonlyData.size > 0) {
-        DEBUG(dbgAddr, "Initializing read only data segment.");
-	DEBUG(dbgAddr, noffH.readonlyData.virtualAddr << ", " << noffH.readonlyData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.readonlyData.virtualAddr]),
-			noffH.readonlyData.size, noffH.readonlyData.inFileAddr);
+    segments[numSegments++] = &noffH.readonlyData;
+#endif
+
+    for (int i = 0; i < numSegments; i++) {
+	Segment *seg = segments[i];
+
+	if (seg->size > 0 && seg->virtualAddr <= pageStart
+			  && seg->virtualAddr + seg->size >= pageStart + PageSize) {
+	    DEBUG(dbgAddr, "Loading all of page " << vpn);
+	    executable->ReadAt(frame, PageSize,
+			       seg->inFileAddr + (pageStart - seg->virtualAddr));
+	    return;
+	}
+    }
+
+    bzero(frame, PageSize);
+    for (int i = 0; i < numSegments; i++) {
+	Segment *seg = segments[i];
+	int first = max(seg->virtualAddr, pageStart);
+	int last = min(seg->virtualAddr + seg->size, pageStart + PageSize);
+
+	if (first < last) {
+	    DEBUG(dbgAddr, "Loading " << last - first << " bytes of page " << vpn);
+	    executable->ReadAt(&frame[first - pageStart], last - first,
+			       seg->inFileAddr + (first - seg->virtualAddr));
+	}
     }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FilePages
+// 	Return how many pages at the start of the program have any bytes
+//	of code or initialized data in them.  Every page past them holds
+//	only uninitialized data or stack, and starts out all zeroes.
+//----------------------------------------------------------------------
+
+unsigned int
+AddrSpace::FilePages()
+{
+    int end = 0;
+
+    if (noffH.code.size > 0)
+	end = max(end, noffH.code.virtualAddr + noffH.code.size);
+    if (noffH.initData.size > 0)
+	end = max(end, noffH.initData.virtualAddr + noffH.initData.size);
+#ifdef RDATA
+    if (noffH.readonlyData.size > 0)
+	end = max(end, noffH.readonlyData.virtualAddr + noffH.readonlyData.size);
 #endif
+    return min(numPages, (unsigned int)divRoundUp(end, PageSize));
+}
 
-    delete executable;			// close file
-    return TRUE;			// success
+//----------------------------------------------------------------------
+// AddrSpace::TextPages
+// 	Return how many pages at the start of the program hold nothing
+//	but code and read-only data (and the zeroes between them): the
+//	pages below the first that has any initialized or uninitialized
+//	data or stack in it.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::TextPages()
+{
+    int pages = (numPages * PageSize - UserStackSize) / PageSize;
+
+    if (noffH.initData.size > 0)
+	pages = min(pages, noffH.initData.virtualAddr / PageSize);
+    if (noffH.uninitData.size > 0)
+	pages = min(pages, noffH.uninitData.virtualAddr / PageSize);
+    return max(pages, 0);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::IsText
+// 	Return TRUE if virtual page "vpn" is a text page that, if it is
+//	in memory, holds just what the executable has: it was never
+//	written to, or it would have been copied and then saved to swap.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::IsText(int vpn)
+{
+    return image != NULL && vpn < image->textPages && swapSlot[vpn] == -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SharedText
+// 	Return a frame that another program running the same executable
+//	has text page "vpn" in, untouched, or -1 if none of them has.
+//	A page that is still read-only and clean has not been written to
+//	since it was read in: a write would have copied it first.
+//
+//	Called with the frame table's lock held.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::SharedText(int vpn)
+{
+    ListIterator<AddrSpace *> it(image->users);
+
+    for (; !it.IsDone(); it.Next()) {
+	AddrSpace *other = it.Item();
+	TranslationEntry *pte = &other->pageTable[vpn];
+
+	if (other != this && pte->valid && pte->readOnly && !pte->dirty
+			  && other->IsText(vpn))
+	    return pte->physicalPage;
+    }
+    return -1;
 }
 
 //----------------------------------------------------------------------
@@ -206,7 +565,8 @@ AddrSpace::Execute(char* fileName)
 // 	We write these directly into the "machine" registers, so
 //	that we can immediately jump to user code.  Note that these
 //	will be saved/restored into the currentThread->userRegisters
-//	when this thread is context switched out.
+//	when another thread's are wanted (see Scheduler::LoadUserState);
+//	whoever's are there now are saved first.
 //----------------------------------------------------------------------
 
 void
@@ -215,6 +575,7 @@ AddrSpace::InitRegisters()
     Machine *machine = kernel->machine;
     int i;
 
+    kernel->scheduler->ClaimUserState(kernel->currentThread);
     for (i = 0; i < NumTotalRegs; i++)
 	machine->WriteRegister(i, 0);
 
@@ -251,13 +612,28 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      Tell the machine where to find the page table -- or, if it
+//	has a TLB, which address space id its entries must carry.  TLB
+//	entries are tagged, so the TLB need not be flushed; the few
+//	translations the machine remembers itself are, but only if they
+//	are for another address space (or an old copy of our table, see
+//	GrowTable): coming back to the program that ran last, they are
+//	still good, since whatever changes a translation flushes them.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
+#ifdef USE_TLB
+    if (kernel->machine->asid != asid) {
+	kernel->machine->FlushTranslations();
+	kernel->machine->asid = asid;
+    }
+#else
+    if (kernel->machine->pageTable != pageTable)
+	kernel->machine->FlushTranslations();
     kernel->machine->pageTable = pageTable;
-    kernel->machine->pageTableSize = numPages;
+    kernel->machine->pageTableSize = tableSize;
+#endif
 }
 
 
@@ -277,13 +653,17 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     unsigned int      vpn    = vaddr / PageSize;
     unsigned int      offset = vaddr % PageSize;
 
-    if(vpn >= numPages) {
+    if(vpn >= tableSize) {
         return AddressErrorException;
     }
 
     pte = &pageTable[vpn];
 
-    if(isReadWrite && pte->readOnly) {
+    if(!pte->valid && !PageIn(vpn)) {
+        return PageFaultException;
+    }
+
+    if(isReadWrite && pte->readOnly && !CopyOnWrite(vpn)) {
         return ReadOnlyException;
     }
 
@@ -311,6 +691,860 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::Pin
+// 	Translate a virtual address as Translate does, and keep its page
+//	in the frame it is in until Unpin.  Translate is enough when the
+//	kernel touches user memory right away; a transfer that blocks on
+//	the disk needs this instead, or another program's page fault
+//	could give the frame away in the middle of it.
+//
+//	The page may be evicted while we wait for the frame table, in
+//	which case it is simply brought in again.
+//----------------------------------------------------------------------
+
+ExceptionType
+AddrSpace::Pin(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
+{
+    for (;;) {
+	ExceptionType result = Translate(vaddr, paddr, isReadWrite);
+
+	if (result != NoException)
+	    return result;
+	kernel->frameTable->Acquire();
+	if (pageTable[vaddr / PageSize].valid) {
+	    kernel->frameTable->Pin(*paddr / PageSize);
+	    kernel->frameTable->Release();
+	    return NoException;
+	}
+	kernel->frameTable->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unpin
+// 	The kernel is done with the page at physical address "paddr",
+//	which it pinned.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Unpin(unsigned int paddr)
+{
+    kernel->frameTable->Unpin(paddr / PageSize);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MappingOf
+// 	Return the mapped region holding virtual page "vpn", or NULL.
+//----------------------------------------------------------------------
+
+Mapping *
+AddrSpace::MappingOf(int vpn)
+{
+    for (int i = 0; i < MaxMappings; i++) {
+	Mapping *m = &mappings[i];
+	if (m->file != NULL && vpn >= m->firstPage
+			    && vpn < m->firstPage + m->numPages)
+	    return m;
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Map
+// 	Map "length" bytes of "file", from "offset" on, into the address
+//	space.  The region goes in the lowest run of virtual pages past
+//	the program that no other mapping uses.  Its pages start out
+//	invalid; PageIn reads each one from the file when it is first
+//	touched.
+//
+//	Return the virtual address of the region, or -1 if there is no
+//	mapping slot or not enough pages left.  On success the mapping
+//	owns "file", and closes it when it is unmapped.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Map(OpenFile *file, int offset, int length)
+{
+    int i, slot = -1;
+    int needed = divRoundUp(length, PageSize);
+    int first = numPages;
+
+    ASSERT(offset >= 0 && length > 0);
+    for (i = 0; i < MaxMappings; i++) {
+	if (mappings[i].file == NULL) {
+	    slot = i;
+	    break;
+	}
+    }
+    if (slot == -1)
+	return -1;
+
+    // move past every mapping in the way, until nothing overlaps
+    for (i = 0; i < MaxMappings; i++) {
+	Mapping *m = &mappings[i];
+	if (m->file != NULL && first < m->firstPage + m->numPages
+			    && m->firstPage < first + needed) {
+	    first = m->firstPage + m->numPages;
+	    i = -1;			// start over
+	}
+    }
+    if (first + needed > ThreadStacksStart)
+	return -1;
+
+    kernel->frameTable->Acquire();
+    GrowTable(first + needed);
+    mappings[slot].file = file;
+    mappings[slot].firstPage = first;
+    mappings[slot].numPages = needed;
+    mappings[slot].offset = offset;
+    mappings[slot].length = length;
+    kernel->frameTable->Release();
+    DEBUG(dbgAddr, "Mapped " << length << " bytes at file offset " << offset
+		    << " to virtual page " << first);
+    return first * PageSize;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageIn
+// 	Handle a page fault on virtual page "vpn": get it a frame, and
+//	fill the frame from wherever the page is now.
+//
+//	   a mapped page is read from its file (bytes past the end of
+//		the file or of the region read as zero);
+//	   a page that has been written out is read back from swap;
+//	   a page past the ones the executable has anything of is
+//		uninitialized data or stack -- the program's, or a
+//		thread's -- and is just cleared;
+//	   any other page has never been touched, and comes from the
+//		executable (see LoadPage) -- unless it is a text page that
+//		some other program running the executable has in memory,
+//		in which case that frame is shared.
+//
+//	A page that is all read from one place in a file is shared too
+//	if the page cache has it (see frametable.h), and otherwise goes
+//	in the page cache once it is read.
+//
+//	Text pages, and pages in the page cache, are read-only, so that
+//	writing to one copies it first (see CopyOnWrite), leaving the
+//	others' copy as it was.
+//
+//	Return FALSE if "vpn" is not part of the address space at all.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PageIn(int vpn)
+{
+    TranslationEntry *pte;
+    Mapping *m;
+    char *frame;
+    int shared;
+
+    if (vpn < 0 || (unsigned int)vpn >= tableSize)
+	return FALSE;
+    if (kernel->loadControl != NULL)
+	kernel->loadControl->WaitIfSuspended(this);
+    kernel->frameTable->Acquire();
+    m = MappingOf(vpn);
+    if ((unsigned int)vpn >= numPages && m == NULL && !InStack(vpn)) {
+	kernel->frameTable->Release();
+	return FALSE;			// between mapped regions
+    }
+    pte = &pageTable[vpn];
+    if (pte->valid) {			// brought in while we waited
+	kernel->frameTable->Release();
+	return TRUE;
+    }
+
+    shared = IsText(vpn) ? SharedText(vpn) : -1;
+    if (shared != -1) {
+	kernel->stats->numSharedTextPages++;
+    } else if ((shared = CachedFilePage(vpn, m)) != -1) {
+	kernel->stats->numPageCacheHits++;
+    }
+    if (shared != -1) {
+	pte->physicalPage = shared;
+	kernel->frameTable->Share(shared, this);
+    } else {
+	pte->physicalPage = kernel->frameTable->Allocate(this, vpn);
+    }
+    frame = &(kernel->machine->mainMemory[pte->physicalPage * PageSize]);
+    if (shared != -1) {
+	DEBUG(dbgAddr, "Sharing page " << vpn << " in frame " << shared);
+    } else if (ReadCluster(vpn, m, frame)) {
+	DEBUG(dbgAddr, "Read page " << vpn << " with the pages after it");
+    } else if (m != NULL) {
+	int start = (vpn - m->firstPage) * PageSize;
+	int wanted = min(PageSize, m->length - start);
+	int numRead = m->file->ReadAt(frame, wanted, m->offset + start);
+
+	bzero(&frame[numRead], PageSize - numRead);
+    } else if (swapSlot[vpn] != -1) {
+	kernel->swapSpace->Read(swapSlot[vpn], frame);
+	kernel->stats->numSwapIns++;
+    } else if ((unsigned int)vpn >= filePages) {
+	DEBUG(dbgAddr, "Zero-filling page " << vpn);
+	bzero(frame, PageSize);
+	kernel->stats->numZeroFills++;
+    } else {
+	LoadPage(vpn, frame);
+    }
+
+    if (shared == -1)
+	CacheFilePage(vpn, m);
+    pte->valid = TRUE;
+    pte->use = FALSE;
+    pte->dirty = FALSE;
+    pte->readOnly = IsText(vpn)		// else the frame is ours alone
+		    || kernel->frameTable->IsCachedFilePage(pte->physicalPage);
+    ShareAround(vpn);
+    kernel->stats->numPageFaults++;
+    DEBUG(dbgAddr, "Paged in page " << vpn << " to frame " << pte->physicalPage);
+    kernel->frameTable->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PlaceInFile
+// 	If every byte of virtual page "vpn" comes from one place in a
+//	file -- a mapped file, or the executable for a page that one
+//	segment covers all of -- set "file" and "offset" to where, and
+//	return TRUE.  A page that has been saved to swap, or that is
+//	partly zero, does not.
+//
+//	"m" -- the mapping holding "vpn", NULL if none does
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::PlaceInFile(int vpn, Mapping *m, OpenFile **file, int *offset)
+{
+    Segment *segments[3];
+    int numSegments = 0;
+    int pageStart = vpn * PageSize;
+
+    if (m != NULL) {
+	int start = (vpn - m->firstPage) * PageSize;
+
+	if (start + PageSize > m->length)
+	    return FALSE;
+	*file = m->file;
+	*offset = m->offset + start;
+	return TRUE;
+    }
+    if ((unsigned int)vpn >= filePages || swapSlot[vpn] != -1 || InStack(vpn))
+	return FALSE;
+    segments[numSegments++] = &noffH.code;
+    segments[numSegments++] = &noffH.initData;
+#ifdef RDATA
+    segments[numSegments++] = &noffH.readonlyData;
+#endif
+    for (int i = 0; i < numSegments; i++) {
+	Segment *seg = segments[i];
+
+	if (seg->size > 0 && seg->virtualAddr <= pageStart
+			  && seg->virtualAddr + seg->size >= pageStart + PageSize) {
+	    *file = executable;
+	    *offset = seg->inFileAddr + (pageStart - seg->virtualAddr);
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
 
+//----------------------------------------------------------------------
+// AddrSpace::CachedFilePage
+// 	Return a frame in the page cache that holds what virtual page
+//	"vpn" is to be read from, if it is a whole page of a file, or -1.
+//
+//	Called with the frame table's lock held.
+//
+//	"m" -- the mapping holding "vpn", NULL if none does
+//----------------------------------------------------------------------
 
+int
+AddrSpace::CachedFilePage(int vpn, Mapping *m)
+{
+#ifndef FILESYS_STUB
+    OpenFile *file;
+    int offset;
 
+    if (PlaceInFile(vpn, m, &file, &offset))
+	return kernel->frameTable->LookupFilePage(file->HeaderSector(),
+				offset, file->WriteCount(), vpn);
+#endif
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CacheFilePage
+// 	Virtual page "vpn" has just been read into a frame of its own;
+//	put the frame in the page cache if a whole page of a file was
+//	read, all of it there.  The caller makes the page read-only.
+//
+//	Called with the frame table's lock held.
+//
+//	"m" -- the mapping holding "vpn", NULL if none does
+//----------------------------------------------------------------------
+
+void
+AddrSpace::CacheFilePage(int vpn, Mapping *m)
+{
+#ifndef FILESYS_STUB
+    OpenFile *file;
+    int offset;
+
+    if (PlaceInFile(vpn, m, &file, &offset)
+	&& offset + PageSize <= file->Length())
+	kernel->frameTable->CacheFilePage(pageTable[vpn].physicalPage,
+		file->HeaderSector(), offset, file->WriteCount());
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReadCluster
+// 	With fault-around (-fa), fill "frame" with virtual page "vpn" and
+//	bring in the pages after it too, with a single read of the file:
+//	as many as the program's window allows, that are not in memory,
+//	come right after it in the same file, are not had by another
+//	program running the executable or in the page cache (PageIn
+//	would share those), and
+//	find a free frame -- nothing is evicted for a page that may not
+//	be wanted.  Return FALSE, with nothing read, if "vpn" is not a
+//	whole page of a file, or no page after it can be read with it;
+//	PageIn then reads it alone.
+//
+//	Called with the frame table's lock held.
+//
+//	"m" -- the mapping holding "vpn", NULL if none does
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::ReadCluster(int vpn, Mapping *m, char *frame)
+{
+    OpenFile *file, *nextFile;
+    int offset, nextOffset;
+    int frames[MaxFaultAround + 1];
+    int count = 1, numRead;
+    char *buffer;
+
+    if (faultAround == 0 || !PlaceInFile(vpn, m, &file, &offset))
+	return FALSE;
+    AdaptFaultAround();
+    while (count <= faultAround) {
+	int next = vpn + count;
+
+	if ((unsigned int)next >= tableSize || pageTable[next].valid
+	    || MappingOf(next) != m
+	    || !PlaceInFile(next, m, &nextFile, &nextOffset)
+	    || nextFile != file || nextOffset != offset + count * PageSize
+	    || (IsText(next) && SharedText(next) != -1)
+	    || CachedFilePage(next, m) != -1)
+	    break;
+	frames[count] = kernel->frameTable->AllocateFree(this, next);
+	if (frames[count] == -1)
+	    break;
+	count++;
+    }
+    if (count == 1)
+	return FALSE;
+
+    buffer = new char[count * PageSize];
+    numRead = file->ReadAt(buffer, count * PageSize, offset);
+    bzero(&buffer[numRead], count * PageSize - numRead);
+    bcopy(buffer, frame, PageSize);
+    for (int i = 1; i < count; i++) {
+	TranslationEntry *pte = &pageTable[vpn + i];
+
+	bcopy(&buffer[i * PageSize],
+	      &(kernel->machine->mainMemory[frames[i] * PageSize]), PageSize);
+	pte->physicalPage = frames[i];
+	CacheFilePage(vpn + i, m);
+	pte->valid = TRUE;
+	pte->use = FALSE;
+	pte->dirty = FALSE;
+	pte->readOnly = IsText(vpn + i)
+			|| kernel->frameTable->IsCachedFilePage(frames[i]);
+	ahead[numAhead++] = vpn + i;
+	kernel->stats->numFaultAroundPages++;
+    }
+    delete [] buffer;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ShareAround
+// 	With fault-around, map the pages after "vpn", within the
+//	program's window, that another program running the executable
+//	has in memory, or that the page cache has: they cost no read, so
+//	they are taken whether or not the window pays.
+//
+//	Called with the frame table's lock held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ShareAround(int vpn)
+{
+    for (int next = vpn + 1; next <= vpn + faultAround
+			     && (unsigned int)next < tableSize; next++) {
+	TranslationEntry *pte = &pageTable[next];
+	int shared;
+
+	if (pte->valid)
+	    continue;
+	shared = IsText(next) ? SharedText(next) : -1;
+	if (shared != -1) {
+	    kernel->stats->numSharedTextPages++;
+	} else if ((shared = CachedFilePage(next, MappingOf(next))) != -1) {
+	    kernel->stats->numPageCacheHits++;
+	} else
+	    continue;
+	kernel->frameTable->Share(shared, this);
+	pte->physicalPage = shared;
+	pte->valid = TRUE;
+	pte->use = FALSE;
+	pte->dirty = FALSE;
+	pte->readOnly = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AdaptFaultAround
+// 	Before reading ahead again, look at the pages read ahead last
+//	time: if at least half of them have been used, double the window,
+//	up to the most -fa allows, and if not, halve it (but keep reading
+//	ahead one page, so as to notice when it pays again).
+//----------------------------------------------------------------------
+
+void
+AddrSpace::AdaptFaultAround()
+{
+    int used = 0;
+
+    if (numAhead == 0)
+	return;
+#ifdef USE_TLB
+    kernel->tlbManager->SyncBits();	// the use bits the TLB has set
+#endif
+    for (int i = 0; i < numAhead; i++) {
+	TranslationEntry *pte = &pageTable[ahead[i]];
+
+	if ((unsigned int)ahead[i] < tableSize && pte->valid && pte->use)
+	    used++;
+    }
+    kernel->stats->numFaultAroundUsed += used;
+    if (2 * used >= numAhead)
+	faultAround = min(2 * faultAround, kernel->faultAroundPages);
+    else
+	faultAround = max(faultAround / 2, 1);
+    DEBUG(dbgAddr, used << " of " << numAhead << " pages read ahead were used; "
+		    << "now reading " << faultAround << " ahead");
+    numAhead = 0;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyOnWrite
+// 	Handle a write to virtual page "vpn" while it is read-only, which
+//	means it was shared with a forked program, is a text page that
+//	may be shared with others running the executable, or is in the
+//	page cache.  If the frame is still shared, copy it into a frame
+//	of our own; if the others have copied it or gone already, it is
+//	ours as it is, and leaves the page cache.
+//	Either way the page can then be written.  A page that was evicted
+//	meanwhile is brought in again first.
+//
+//	The copy carries on the page's dirty bit: it matches the page's
+//	swap slot exactly when the original did.
+//
+//	Return FALSE if "vpn" is not part of the address space.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyOnWrite(int vpn)
+{
+    TranslationEntry *pte;
+
+    if (vpn < 0 || (unsigned int)vpn >= tableSize)
+	return FALSE;
+    pte = &pageTable[vpn];
+    for (;;) {
+	kernel->frameTable->Acquire();
+	if (pte->valid)
+	    break;
+	kernel->frameTable->Release();
+	if (!PageIn(vpn))
+	    return FALSE;
+    }
+    if (pte->readOnly) {
+	int old = pte->physicalPage;
+
+#ifdef USE_TLB
+	kernel->tlbManager->Flush(this, vpn);
+#endif
+	kernel->machine->FlushTranslations();
+	if (kernel->frameTable->Sharers(old) > 1) {
+	    kernel->frameTable->Pin(old);	// not evicted to make room
+	    pte->physicalPage = kernel->frameTable->Allocate(this, vpn);
+	    kernel->frameTable->Unpin(old);
+	    bcopy(&(kernel->machine->mainMemory[old * PageSize]),
+		  &(kernel->machine->mainMemory[pte->physicalPage * PageSize]),
+		  PageSize);
+	    kernel->frameTable->Free(old, this);
+	    kernel->stats->numCopyOnWrites++;
+	    DEBUG(dbgAddr, "Copied page " << vpn << " from frame " << old
+			    << " to frame " << pte->physicalPage);
+	} else
+	    kernel->frameTable->UncacheFilePage(old);
+	pte->readOnly = FALSE;
+    }
+    kernel->frameTable->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Evict
+// 	The frame table is taking away the frame of virtual page "vpn".
+//	If the page was changed since it was brought in, save it where
+//	PageIn will look for it: a mapped page goes back to its file, any
+//	other page to its swap slot, which it gets the first time.  A
+//	clean page is simply dropped, since it can be had again from
+//	wherever it came from.
+//
+//	A frame shared after a Fork is evicted from each of its owners
+//	in turn.  "savedSlot" is -1 until one of them writes the page to
+//	swap, and then the slot it went to, which the rest take on in
+//	place of their own.  A slot that is shared is never written over:
+//	the others still need what is in it.
+//
+//	Called with the frame table's lock held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::Evict(int vpn, int *savedSlot)
+{
+    TranslationEntry *pte = &pageTable[vpn];
+    Mapping *m = MappingOf(vpn);
+    char *frame = &(kernel->machine->mainMemory[pte->physicalPage * PageSize]);
+    bool written;
+
+    ASSERT(pte->valid);
+#ifdef USE_TLB
+    kernel->tlbManager->Flush(this, vpn);	// may set the dirty bit
+#endif
+    kernel->machine->FlushTranslations();
+    pte->valid = FALSE;
+    if (!pte->dirty)
+	return;
+    if (m != NULL) {
+	WriteBackPage(m, vpn);
+	return;
+    }
+    if (*savedSlot != -1) {		// another owner saved it already
+	if (swapSlot[vpn] != -1)
+	    kernel->swapSpace->Free(swapSlot[vpn]);
+	swapSlot[vpn] = *savedSlot;
+	kernel->swapSpace->Share(*savedSlot);
+	return;
+    }
+    if (swapSlot[vpn] != -1 && kernel->swapSpace->IsShared(swapSlot[vpn])) {
+	kernel->swapSpace->Free(swapSlot[vpn]);
+	swapSlot[vpn] = -1;
+    }
+    if (swapSlot[vpn] == -1)
+	swapSlot[vpn] = kernel->swapSpace->Allocate();
+    ASSERT(swapSlot[vpn] != -1);	// out of swap space
+    written = kernel->swapSpace->Write(swapSlot[vpn], frame);
+    ASSERT(written);			// out of disk space
+    kernel->stats->numSwapOuts++;
+    *savedSlot = swapSlot[vpn];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SampleWorkingSet
+// 	Return how many pages in memory were used since the last call,
+//	and clear their use bits for the next one.  Called with the
+//	frame table's lock held, and with the TLB's bits folded in.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::SampleWorkingSet()
+{
+    int count = 0;
+
+    for (unsigned int vpn = 0; vpn < tableSize; vpn++) {
+	if (pageTable[vpn].valid && pageTable[vpn].use) {
+	    pageTable[vpn].use = FALSE;
+	    count++;
+	}
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SwapOut
+// 	Evict every page in memory, as if each frame had been chosen in
+//	turn, except those a kernel transfer has pinned.  Load control
+//	does this to a program it suspends.
+//
+//	Called with the frame table's lock held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SwapOut()
+{
+    for (unsigned int vpn = 0; vpn < tableSize; vpn++) {
+	int frame = pageTable[vpn].physicalPage;
+	int slot = -1;
+
+	if (!pageTable[vpn].valid || kernel->frameTable->IsPinned(frame))
+	    continue;
+	Evict(vpn, &slot);
+	kernel->frameTable->Free(frame, this);
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CanCheckpoint
+// 	Return TRUE if what there is of the program is all in its pages
+//	and registers, so that it can be started again from a checkpoint
+//	of them (see checkpoint.h): it has one thread, and no file is
+//	open or mapped.  Otherwise set "why" to what is in the way.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CanCheckpoint(char **why)
+{
+    if (numThreads != 1)
+	*why = "it has more than one thread";
+    else if (tableSize > numPages)
+	*why = "it has files mapped";
+    else if (!files->IsEmpty())
+	*why = "it has files open";
+    else if (aio != NULL)
+	*why = "it has made asynchronous requests";
+    else
+	return TRUE;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SavePages
+// 	Write every page of the program that is not just what the
+//	executable has to the UNIX file "file", for a checkpoint: each one
+//	in memory, from its frame, unless it is untouched text, and each
+//	one in swap, from its slot.  Each goes as its page number, then
+//	its bytes; -1 follows the last.  The pages never touched are left
+//	out, since a program loaded again gets them just as it did.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::SavePages(int file)
+{
+    char *page = new char[PageSize];
+    int end = -1;
+
+    for (int vpn = 0; (unsigned int)vpn < numPages; vpn++) {
+	TranslationEntry *pte = &pageTable[vpn];
+	bool saved = TRUE;
+
+	kernel->frameTable->Acquire();
+	if (pte->valid && !(IsText(vpn) && pte->readOnly))
+	    bcopy(&(kernel->machine->mainMemory[pte->physicalPage * PageSize]),
+		  page, PageSize);
+	else if (!pte->valid && swapSlot[vpn] != -1)
+	    kernel->swapSpace->Read(swapSlot[vpn], page);
+	else
+	    saved = FALSE;
+	kernel->frameTable->Release();
+	if (saved) {
+	    WriteFile(file, (char *) &vpn, sizeof(int));
+	    WriteFile(file, page, PageSize);
+	}
+    }
+    WriteFile(file, (char *) &end, sizeof(int));
+    delete [] page;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RestorePage
+// 	Put page "vpn" of a program restored from a checkpoint back in
+//	memory, with the bytes "data" in it.  It is dirty, since neither
+//	the executable nor swap has it.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::RestorePage(int vpn, char *data)
+{
+    TranslationEntry *pte = &pageTable[vpn];
+
+    ASSERT(vpn >= 0 && (unsigned int)vpn < numPages && !pte->valid);
+    kernel->frameTable->Acquire();
+    pte->physicalPage = kernel->frameTable->Allocate(this, vpn);
+    bcopy(data, &(kernel->machine->mainMemory[pte->physicalPage * PageSize]),
+	  PageSize);
+    pte->valid = TRUE;
+    pte->use = FALSE;
+    pte->dirty = TRUE;
+    pte->readOnly = FALSE;
+    kernel->frameTable->Release();
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WriteBackPage
+// 	Write a page of a mapped region back to the file.  Only the part
+//	that lies within the region and within the file as it is now is
+//	written, so unmapping never makes the file longer.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::WriteBackPage(Mapping *m, int vpn)
+{
+    int start = (vpn - m->firstPage) * PageSize;
+    int size = min(PageSize, m->length - start);
+    int fileLeft = m->file->Length() - (m->offset + start);
+    char *frame = &(kernel->machine->mainMemory[pageTable[vpn].physicalPage * PageSize]);
+
+    size = min(size, fileLeft);
+    if (size > 0)
+	m->file->WriteAt(frame, size, m->offset + start);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unmap
+// 	Remove the mapped region that starts at virtual address "vaddr".
+//	Pages that were written to go back to the file first.  Return
+//	FALSE if no region starts there.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Unmap(int vaddr)
+{
+    Mapping *m = NULL;
+    int i;
+
+    for (i = 0; i < MaxMappings; i++) {
+	if (mappings[i].file != NULL && mappings[i].firstPage * PageSize == vaddr)
+	    m = &mappings[i];
+    }
+    if (m == NULL)
+	return FALSE;
+
+    kernel->frameTable->Acquire();
+    for (i = m->firstPage; i < m->firstPage + m->numPages; i++) {
+	if (pageTable[i].valid) {
+#ifdef USE_TLB
+	    kernel->tlbManager->Flush(this, i);
+#endif
+	    if (pageTable[i].dirty)
+		WriteBackPage(m, i);
+	    kernel->frameTable->Free(pageTable[i].physicalPage, this);
+	    pageTable[i].valid = FALSE;
+	}
+    }
+    kernel->machine->FlushTranslations();
+    delete m->file;
+    m->file = NULL;
+    FitTable();
+    kernel->frameTable->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FitTable
+// 	Shrink the page table back over the program and whatever is
+//	still mapped or used as a stack.  Called with the frame table's
+//	lock held.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FitTable()
+{
+    tableSize = numPages;
+    for (int i = 0; i < MaxMappings; i++) {
+	if (mappings[i].file != NULL && (unsigned int)(mappings[i].firstPage
+				+ mappings[i].numPages) > tableSize)
+	    tableSize = mappings[i].firstPage + mappings[i].numPages;
+    }
+    for (int i = 0; i < MaxUserThreads; i++) {
+	if (stackInUse[i] && (unsigned int)StackTop(i) / PageSize > tableSize)
+	    tableSize = StackTop(i) / PageSize;
+    }
+    if (kernel->currentThread->space == this) {
+	kernel->machine->FlushTranslations();
+	RestoreState();
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::InStack
+// 	Return TRUE if virtual page "vpn" is in a stack region that a
+//	thread has.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::InStack(int vpn)
+{
+    return vpn >= ThreadStacksStart && vpn < NumVirtPages
+	   && stackInUse[(vpn - ThreadStacksStart) / ThreadStackPages];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocateStack
+// 	Take a free stack region for a new thread, and make the page
+//	table cover it.  Its pages start out invalid, and are zero-filled
+//	by PageIn when first touched.  Return the region's slot, or -1 if
+//	the program has MaxUserThreads stacks already, or is so big that
+//	it reaches into them.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::AllocateStack()
+{
+    int slot;
+
+    if (numPages > (unsigned int)ThreadStacksStart)
+	return -1;
+    kernel->frameTable->Acquire();
+    for (slot = 0; slot < MaxUserThreads && stackInUse[slot]; slot++)
+	;
+    if (slot < MaxUserThreads) {
+	stackInUse[slot] = TRUE;
+	GrowTable(StackTop(slot) / PageSize);
+	DEBUG(dbgAddr, "Thread stack " << slot << " at " << StackTop(slot));
+    } else {
+	slot = -1;
+    }
+    kernel->frameTable->Release();
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FreeStack
+// 	The thread that had stack region "slot" is done: give back the
+//	frames and swap slots of its pages.  Nothing is written back.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::FreeStack(int slot)
+{
+    int first = ThreadStacksStart + slot * ThreadStackPages;
+
+    ASSERT(slot >= 0 && slot < MaxUserThreads && stackInUse[slot]);
+    kernel->frameTable->Acquire();
+    for (int vpn = first; vpn < first + ThreadStackPages; vpn++) {
+	if (pageTable[vpn].valid) {
+#ifdef USE_TLB
+	    kernel->tlbManager->Flush(this, vpn);
+#endif
+	    kernel->frameTable->Free(pageTable[vpn].physicalPage, this);
+	    pageTable[vpn].valid = FALSE;
+	}
+	if (swapSlot[vpn] != -1) {
+	    kernel->swapSpace->Free(swapSlot[vpn]);
+	    swapSlot[vpn] = -1;
+	}
+    }
+    kernel->machine->FlushTranslations();
+    stackInUse[slot] = FALSE;
+    FitTable();
+    kernel->frameTable->Release();
+}
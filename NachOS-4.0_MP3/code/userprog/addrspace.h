@@ -2,10 +2,24 @@
 //	Data structures to keep track of executing user programs 
 //	(address spaces).
 //
-//	For now, we don't keep any information about address spaces.
+//	An address space is paged on demand: nothing is read in when a
+//	program is loaded, and each page is brought in from the
+//	executable, from swap or from a mapped file the first time it is
+//	touched (see frametable.h for how frames are handed out).
+//	A forked copy shares its parent's frames until one of them writes
+//	to a page (see AddrSpace::Fork), and programs running the same
+//	executable share the frames of its code (see imagetable.h).
 //	The user level CPU state is saved and restored in the thread
 //	executing the user program (see thread.h).
 //
+//	A program may run several threads (see ThreadFork in syscall.h),
+//	all sharing its address space.  The first uses the stack at the
+//	end of the program; each of the others gets a stack region of its
+//	own at the top of the virtual address space, with mapped files
+//	going in between.  A stack's pages are zero-filled when first
+//	touched, and given back when its thread is done.  The program is
+//	done once each of its threads is.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -15,8 +29,41 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "fdtable.h"
+#include "noff.h"
+
+class AioQueue;
+class ExecImage;
+class ProcessTable;
+class PcProfile;
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxMappings		4	// mapped file regions per program
+#define NumVirtPages		(4 * NumPhysPages)
+					// pages an address space can have
+#define MaxUserThreads		8	// threads a program may have at
+					// once besides its first
+#define ThreadStackPages	divRoundUp(UserStackSize, PageSize)
+#define ThreadStacksStart	(NumVirtPages - MaxUserThreads * ThreadStackPages)
+					// first page of the stack regions,
+					// past the last any mapping may use
+#define MainThreadId		1	// ThreadId of a program's first
+					// thread
+#define MaxFaultAround		8	// pages read ahead of a fault, at
+					// most (see AddrSpace::ReadCluster)
+
+// A region of a file mapped into an address space (see AddrSpace::Map).
+// Virtual page "firstPage" + i holds the file bytes starting at
+// "offset" + i * PageSize.
+
+class Mapping {
+  public:
+    OpenFile *file;			// NULL if this slot is free
+    int firstPage;			// where the region starts
+    int numPages;			// how many pages it covers
+    int offset;				// file offset of the first byte
+    int length;				// bytes mapped
+};
 
 class AddrSpace {
   public:
@@ -27,6 +74,9 @@ class AddrSpace {
                                         // a file
 					// return false if not found
 
+    AddrSpace *Fork();			// Make a copy-on-write copy of this
+					// address space; NULL on failure
+
     void Execute(char *fileName);             	// Run a program
 					// assumes the program has already
                                         // been loaded
@@ -38,15 +88,154 @@ class AddrSpace {
     // to physical address _paddr_. _mode_
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
+    ExceptionType Pin(unsigned int vaddr, unsigned int *paddr, int mode);
+					// Translate, and keep the page in
+					// memory until Unpin: for kernel
+					// transfers that may block
+    void Unpin(unsigned int paddr);
+
+    FileDescriptorTable *Descriptors() { return files; }
+					// The files this program has open
+    WorkingDirectory *WorkingDir() { return cwd; }
+					// Where its relative paths start
+    AioQueue *AsyncRequests();		// Its asynchronous reads and
+					// writes, made on first use
+
+    int Map(OpenFile *file, int offset, int length);
+					// Map part of "file" into unused
+					// virtual pages, returning the
+					// address; -1 if there is no room.
+					// The mapping owns "file".
+    bool Unmap(int vaddr);		// Write back and remove the mapping
+					// that starts at "vaddr"
+    bool PageIn(int vpn);		// Bring in a page on a page fault;
+					// FALSE if "vpn" is not part of
+					// the address space
+    bool CopyOnWrite(int vpn);		// Give "vpn" a frame of its own on
+					// a write to a shared page
+
+    TranslationEntry *PageEntry(int vpn) { return &pageTable[vpn]; }
+					// For the frame table's policies
+    int TableSize() { return tableSize; }
+					// Pages PageEntry can be asked for
+    int Asid() { return asid; }		// Tag of this space's TLB entries
+    PcProfile *Profile() { return profile; }
+					// Its PC samples, NULL unless -prof
+
+    int AllocateStack();		// A stack region for a new thread;
+					// its slot, -1 if none is free
+    void FreeStack(int slot);		// Its thread is done with it
+    int StackTop(int slot) {		// Address just past the stack
+	return (ThreadStacksStart + (slot + 1) * ThreadStackPages) * PageSize;
+    }
+    ProcessTable *Threads() { return threads; }
+					// Its threads, by ThreadId
+    void AddThread() { numThreads++; }	// Another thread runs in it
+    bool RemoveThread() { return --numThreads == 0; }
+					// One less; TRUE if that was the
+					// last one
+    void SetExitStatus(int status) { exitStatus = status; }
+    int ExitStatus() { return exitStatus; }
+					// What the program passed to Exit;
+					// 0 if it did not
+    void Retire();			// It has exited: write back what it
+					// has mapped, before it is reported
+    int Reclaim(int *slots, int *numSlots);
+					// Give back its frames, and add its
+					// swap slots to "slots"; frame
+					// table lock held
+    void Evict(int vpn, int *savedSlot);
+					// Give up the frame holding "vpn",
+					// saving the page if it changed
+    int SampleWorkingSet();		// Pages used since the last sample
+    void SwapOut();			// Evict every page it can, for
+					// load control
+
+    char *ProgramName() { return programName; }
+					// The executable it runs
+    bool CanCheckpoint(char **why);	// Is all of it in its memory, so
+					// that a checkpoint can have it?
+					// If not, "why" says why not
+    void SavePages(int file);		// Write the pages the executable
+					// cannot give back to a checkpoint
+    void RestorePage(int vpn, char *data);
+					// Put one of them back, from one
 
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    unsigned int filePages;		// Pages with any bytes from the
+					// executable; the rest, the end
+					// of the data and the stack, are
+					// zero-filled when first touched
+    unsigned int tableSize;		// Pages the page table covers: the
+					// program, then any mapped regions
+    unsigned int tableEntries;		// Entries allocated in pageTable
+					// and swapSlot, >= tableSize
+    Mapping mappings[MaxMappings];	// Mapped file regions
+    int *swapSlot;			// Where each page is in swap, -1
+					// if it has never been written out
+    OpenFile *executable;		// Where the code and data come from
+    char *programName;			// The file it is, for Fork to reopen
+    NoffHeader noffH;			// and where in it they are
+    ExecImage *image;			// Others running the executable,
+					// NULL if it cannot be shared
+    int asid;				// Address space id, unique to it
+    PcProfile *profile;			// Where its PCs are sampled, if they
+					// are
+    FileDescriptorTable *files;		// Open files, by OpenFileId
+    WorkingDirectory *cwd;		// Its working directory
+    AioQueue *aio;			// Its asynchronous requests, NULL
+					// until it makes one
+    bool stackInUse[MaxUserThreads];	// Which stack regions are taken
+    ProcessTable *threads;		// Its threads, for ThreadJoin
+    int numThreads;			// How many are running
+    int exitStatus;			// See ExitStatus
+    bool retired;			// Has Retire been done?
+    bool reclaimed;			// And Reclaim?
+    int faultAround;			// Pages to read ahead of the next
+					// fault, with -fa
+    int ahead[MaxFaultAround];		// The pages read ahead last time,
+    int numAhead;			// to see whether they were used
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
+    Mapping *MappingOf(int vpn);	// The mapping holding "vpn", if any
+    bool InStack(int vpn);		// Is "vpn" in a stack region that
+					// is taken?
+    void FitTable();			// Shrink the page table back over
+					// the pages still in use
+    void GrowTable(unsigned int size);	// Make room for "size" pages
+    void LoadPage(int vpn, char *frame);
+					// Fill a page from the executable
+    unsigned int FilePages();		// Pages the executable has any of
+    int TextPages();			// Leading pages of code and
+					// read-only data alone
+    bool IsText(int vpn);		// Does "vpn" still hold just what
+					// the executable has?
+    int SharedText(int vpn);		// Frame another program has text
+					// page "vpn" in, or -1
+    void WriteBackPage(Mapping *m, int vpn);
+					// Write a dirty mapped page to its
+					// file
+    bool PlaceInFile(int vpn, Mapping *m, OpenFile **file, int *offset);
+					// Where all of "vpn" is to be read
+					// from, if it is a whole page of a
+					// file
+    int CachedFilePage(int vpn, Mapping *m);
+					// Frame in the page cache that has
+					// "vpn", or -1
+    void CacheFilePage(int vpn, Mapping *m);
+					// Put the frame "vpn" was just read
+					// into there, if it can go
+    bool ReadCluster(int vpn, Mapping *m, char *frame);
+					// Read "vpn" and the pages after it
+					// that follow it in the file
+    void ShareAround(int vpn);		// Map shared pages after "vpn"
+    void AdaptFaultAround();		// Read ahead more, or less, as the
+					// last pages read ahead were used
 
 };
 
@@ -0,0 +1,162 @@
+// aioqueue.cc
+//	Routines to run the asynchronous reads and writes of a user
+//	program on the kernel's aio workers.  See aioqueue.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "aioqueue.h"
+#include "synch.h"
+#include "workerpool.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// AioRequest::AioRequest
+// 	Record a transfer to be done.  The request takes over "file" and
+//	"buffer", which is "size" bytes long.
+//----------------------------------------------------------------------
+
+AioRequest::AioRequest(AioQueue *q, int requestId, OpenFile *f, char *buf,
+		       int numBytes, int pos, bool write, int addr)
+{
+    queue = q;
+    id = requestId;
+    file = f;
+    buffer = buf;
+    size = numBytes;
+    position = pos;
+    writing = write;
+    userAddr = addr;
+    result = 0;
+}
+
+AioRequest::~AioRequest()
+{
+    delete file;
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// AioQueue::AioQueue
+// 	Initialize a queue with no requests.
+//----------------------------------------------------------------------
+
+AioQueue::AioQueue()
+{
+    lock = new Lock("aio queue lock");
+    finished = new Condition("aio queue finished");
+    done = new List<AioRequest *>;
+    numPending = 0;
+    nextId = 1;
+}
+
+//----------------------------------------------------------------------
+// AioQueue::~AioQueue
+// 	Wait for the workers to finish the requests they have, since they
+//	will put them here, then throw away every request not collected:
+//	the program is gone, and nobody wants the bytes read.  What was
+//	written is in the file all the same.
+//----------------------------------------------------------------------
+
+AioQueue::~AioQueue()
+{
+    lock->Acquire();
+    while (numPending > (int) done->NumInList())
+	finished->Wait(lock);
+    while (!done->IsEmpty())
+	delete done->RemoveFront();
+    lock->Release();
+    delete done;
+    delete finished;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// AioQueue::Submit
+// 	Hand a transfer to the aio workers, and return without waiting
+//	for it.  Return the id of the request, or -1 if the program has
+//	MaxAioRequests already, in which case "file" and "buffer" are
+//	thrown away.
+//
+//	"file" -- the file, opened for this request alone
+//	"buffer" -- "size" bytes: for a write, what to write
+//	"position" -- where in the file the transfer starts
+//	"writing" -- TRUE for a write, FALSE for a read
+//	"userAddr" -- the program's buffer, for a read to be copied to
+//----------------------------------------------------------------------
+
+int
+AioQueue::Submit(OpenFile *file, char *buffer, int size, int position,
+		 bool writing, int userAddr)
+{
+    AioRequest *request;
+
+    lock->Acquire();
+    if (numPending == MaxAioRequests) {
+	lock->Release();
+	delete file;
+	delete [] buffer;
+	return -1;
+    }
+    request = new AioRequest(this, nextId++, file, buffer, size, position,
+			     writing, userAddr);
+    numPending++;
+    lock->Release();
+    DEBUG(dbgFile, "Aio request " << request->id << ": " << (writing ? "write " : "read ")
+		   << size << " bytes at " << position);
+    kernel->aioWorkers->Submit(AioQueue::Transfer, (void *) request);
+    return request->id;
+}
+
+//----------------------------------------------------------------------
+// AioQueue::Complete
+// 	Take the request that finished first of those not collected yet,
+//	for the caller to copy out and delete.  If none has finished: if
+//	"wait" and some are still at the disk, wait for one of them;
+//	otherwise return NULL.
+//----------------------------------------------------------------------
+
+AioRequest *
+AioQueue::Complete(bool wait)
+{
+    AioRequest *request = NULL;
+
+    lock->Acquire();
+    while (done->IsEmpty() && wait && numPending > 0)
+	finished->Wait(lock);
+    if (!done->IsEmpty()) {
+	request = done->RemoveFront();
+	numPending--;
+    }
+    lock->Release();
+    return request;
+}
+
+//----------------------------------------------------------------------
+// AioQueue::Transfer
+// 	What an aio worker runs for a request: do the read or write, then
+//	put the request on its queue's list of those done.
+//
+//	"arg" -- the AioRequest
+//----------------------------------------------------------------------
+
+void
+AioQueue::Transfer(void *arg)
+{
+    AioRequest *request = (AioRequest *) arg;
+    AioQueue *queue = request->queue;
+
+    if (request->writing)
+	request->result = request->file->WriteAt(request->buffer,
+					request->size, request->position);
+    else
+	request->result = request->file->ReadAt(request->buffer,
+					request->size, request->position);
+    DEBUG(dbgFile, "Aio request " << request->id << " done: " << request->result << " bytes");
+    queue->lock->Acquire();
+    queue->done->Append(request);
+    queue->finished->Broadcast(queue->lock);
+    queue->lock->Release();
+}
@@ -0,0 +1,92 @@
+// aioqueue.h
+//	Data structures for the asynchronous file reads and writes of a
+//	user program (the AioRead, AioWrite and AioComplete system calls).
+//
+//	Each address space has a queue of its requests.  A request is
+//	handed to one of the kernel's aio workers (see workerpool.h) and
+//	the system call returns at once, with the request's id; the
+//	worker does the transfer, blocking on the disk in the program's
+//	place, and then puts the request on the queue's completion list.
+//	With several workers, a program can have that many requests at
+//	the disk at once, where the disk scheduler can order them.
+//
+//	The bytes go through a kernel buffer of the request's own: those
+//	to write are copied in from the program when it is submitted, and
+//	those read are copied out when the program collects it with
+//	AioComplete.  So the worker never touches user memory, and the
+//	program must leave its buffer alone until then, as with UNIX aio.
+//	Every request also has an OpenFile of its own, so closing the
+//	descriptor does not pull the file out from under it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef AIOQUEUE_H
+#define AIOQUEUE_H
+
+#include "list.h"
+#include "openfile.h"
+
+class Lock;
+class Condition;
+class AioQueue;
+
+const int NumAioWorkers = 4;		// requests at the disk at once
+const int MaxAioRequests = 8;		// submitted and not yet collected,
+					// per program
+const int MaxAioBytes = 4096;		// largest transfer of one request
+
+// The following class records one asynchronous read or write.
+
+class AioRequest {
+  public:
+    AioRequest(AioQueue *queue, int id, OpenFile *file, char *buffer,
+	       int size, int position, bool writing, int userAddr);
+    ~AioRequest();			// close the file, free the buffer
+
+    AioQueue *queue;			// where it goes when it is done
+    int id;				// what the program calls it
+    OpenFile *file;			// the file, opened for it alone
+    char *buffer;			// the bytes, in the kernel
+    int size;				// how many to transfer
+    int position;			// and where in the file
+    bool writing;			// write, or read?
+    int userAddr;			// the program's buffer
+    int result;				// bytes transferred, once done
+};
+
+// The following class defines the queue of one program's requests.
+
+class AioQueue {
+  public:
+    AioQueue();				// Initialize an empty queue
+    ~AioQueue();			// Wait for the requests still at
+					// the disk, then throw them all away
+
+    int Submit(OpenFile *file, char *buffer, int size, int position,
+	       bool writing, int userAddr);
+					// Start a transfer; return its id,
+					// or -1 if too many are pending.
+					// The request owns "file" and
+					// "buffer" either way
+    AioRequest *Complete(bool wait);	// Take the next request that is
+					// done, in the order they finished;
+					// if none is, wait for one if
+					// "wait", else return NULL
+    int NumPending() { return numPending; }
+					// submitted, not yet collected
+
+  private:
+    Lock *lock;				// protects everything below
+    Condition *finished;		// signalled as each request is done
+    List<AioRequest *> *done;		// done, not yet collected
+    int numPending;			// in flight or on "done"
+    int nextId;				// for the next request
+
+    static void Transfer(void *request); // what the worker runs
+};
+
+#endif // AIOQUEUE_H
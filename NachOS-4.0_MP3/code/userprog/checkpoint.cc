@@ -0,0 +1,204 @@
+// checkpoint.cc
+//	Routines to save a running user program to a checkpoint, and to
+//	start it again from one.  See checkpoint.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "checkpoint.h"
+#include "main.h"
+#include "addrspace.h"
+#include "proctable.h"
+#include "synchdisk.h"
+#include "sysdep.h"
+
+const int CheckpointMagic = 0x6b706368;	// after the disk image
+
+// What follows the disk image in a checkpoint, before the program's
+// name, its registers, the statistics and its pages.
+
+class CheckpointHeader {
+  public:
+    int magic;				// CheckpointMagic
+    int numRegisters;			// NumTotalRegs, and
+    int pageSize;			// PageSize, of the Nachos that took it
+    int numPages;			// how big the address space was
+    int nameLength;			// bytes of the program's name
+};
+
+// The checkpoint being restored, for ResumeProgram, once Restore has
+// read its header and the program's name.
+
+static thread_local int restoreFile = -1;
+static thread_local CheckpointHeader restoreHeader;
+
+//----------------------------------------------------------------------
+// Checkpoint::Checkpoint
+// 	Get ready to take a checkpoint of the running program, in the
+//	UNIX file "fileName", at the first time slice at or after tick
+//	"when".
+//----------------------------------------------------------------------
+
+Checkpoint::Checkpoint(char *fileName, Ticks when)
+{
+    this->fileName = fileName;
+    this->when = when;
+    done = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Checkpoint::Take
+// 	Save the program running on the CPU, which has just been stopped
+//	between two instructions at the end of its time slice, with its
+//	disk (see checkpoint.h).  The parts go in the order they are
+//	wanted back, after the room the disk image takes; the disk goes
+//	last, once what the file systems held back is on it, since
+//	saving the pages may read swap.  Nothing is saved, and why is
+//	said, if the program has more than its pages and registers.
+//
+//	Called by the interrupt handler, in the thread's own time, as
+//	the program is about to be switched out (see Interrupt::EndTick).
+//----------------------------------------------------------------------
+
+void
+Checkpoint::Take()
+{
+    Thread *t = kernel->currentThread;
+    AddrSpace *space = t->space;
+    CheckpointHeader hdr;
+    int registers[NumTotalRegs];
+    char *why = NULL;
+    int file;
+
+    done = TRUE;			// whether it can be taken or not
+    if (kernel->processTable->NumRunning() != 1)
+	why = "it is not the only program running";
+    else if (t->userStack != -1)
+	why = "it is not running on its first thread";
+    else if (kernel->synchDisk->Log() != NULL)
+	why = "the disk is a log (-lfs)";
+    else
+	(void) space->CanCheckpoint(&why);
+    if (why != NULL) {
+	cerr << "Cannot checkpoint " << space->ProgramName() << ": " << why
+	     << "\n";
+	return;
+    }
+
+    for (int i = 0; i < NumTotalRegs; i++)
+	registers[i] = kernel->machine->ReadRegister(i);
+    hdr.magic = CheckpointMagic;
+    hdr.numRegisters = NumTotalRegs;
+    hdr.pageSize = PageSize;
+    hdr.numPages = space->TableSize();
+    hdr.nameLength = strlen(space->ProgramName());
+
+    file = OpenForWrite(fileName);
+    Lseek(file, Disk::FileLength(), 0);
+    WriteFile(file, (char *) &hdr, sizeof(hdr));
+    WriteFile(file, space->ProgramName(), hdr.nameLength);
+    WriteFile(file, (char *) registers, sizeof(registers));
+    kernel->stats->Save(file);
+    space->SavePages(file);
+#ifndef FILESYS_STUB
+    kernel->mounts->Sync();		// there is only the root to sync
+#endif
+    kernel->synchDisk->SaveImage(file);
+    Close(file);
+    cerr << "Checkpoint of " << space->ProgramName() << " taken at tick "
+	 << kernel->stats->totalTicks << " in " << fileName << "\n";
+}
+
+//----------------------------------------------------------------------
+// ResumeProgram
+// 	Start again, in the thread "t", the program whose checkpoint
+//	Restore has read the header and the name of: load its executable,
+//	as Exec would, then put its registers, the statistics and its
+//	pages back, and run it from where it was.
+//----------------------------------------------------------------------
+
+static void
+ResumeProgram(Thread *t)
+{
+    AddrSpace *space = t->space;
+    int registers[NumTotalRegs];
+    char *page = new char[PageSize];
+    int vpn;
+
+    if (!space->Load(t->getName())
+	    || space->TableSize() != restoreHeader.numPages) {
+	cerr << "Cannot restore " << t->getName()
+	     << ": its executable is not the one checkpointed\n";
+	delete space;
+	t->space = NULL;
+	kernel->processTable->Exit(t->getID(), -1);
+	Close(restoreFile);
+	restoreFile = -1;
+	delete [] page;
+	return;
+    }
+    Read(restoreFile, (char *) registers, sizeof(registers));
+    kernel->stats->Restore(restoreFile);
+    for (;;) {
+	Read(restoreFile, (char *) &vpn, sizeof(int));
+	if (vpn == -1)
+	    break;
+	Read(restoreFile, page, PageSize);
+	space->RestorePage(vpn, page);
+    }
+    Close(restoreFile);
+    restoreFile = -1;
+    delete [] page;
+
+    kernel->scheduler->ClaimUserState(t);
+    for (int i = 0; i < NumTotalRegs; i++)
+	kernel->machine->WriteRegister(i, registers[i]);
+    space->RestoreState();
+    kernel->machine->Run();
+    ASSERTNOTREACHED();
+}
+
+//----------------------------------------------------------------------
+// Checkpoint::Restore
+// 	Start the program saved in the checkpoint "fileName" again, in a
+//	new thread, as a program with no parent; the disk is an overlay
+//	on the checkpoint already (see Disk::Disk).  Return its id, or
+//	-1, saying why, if the file is not a checkpoint this Nachos can
+//	restore.  Only one program may be restored in a run.
+//----------------------------------------------------------------------
+
+int
+Checkpoint::Restore(char *fileName)
+{
+    CheckpointHeader &hdr = restoreHeader;
+    char *name;
+    Thread *t;
+    int pid;
+
+    ASSERT(restoreFile == -1);
+    restoreFile = OpenForRead(fileName, FALSE);
+    if (restoreFile < 0) {
+	cerr << "No checkpoint " << fileName << "\n";
+	return -1;
+    }
+    Lseek(restoreFile, Disk::FileLength(), 0);
+    if (ReadPartial(restoreFile, (char *) &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || hdr.magic != CheckpointMagic || hdr.numRegisters != NumTotalRegs
+	    || hdr.pageSize != PageSize) {
+	cerr << fileName << " is not a checkpoint of this Nachos\n";
+	Close(restoreFile);
+	restoreFile = -1;
+	return -1;
+    }
+    name = new char[hdr.nameLength + 1];	// the thread's, for good
+    Read(restoreFile, name, hdr.nameLength);
+    name[hdr.nameLength] = '\0';
+
+    pid = kernel->processTable->Add(0);
+    t = new Thread(name, pid);
+    t->space = new AddrSpace();
+    t->Fork((VoidFunctionPtr) &ResumeProgram, (void *) t);
+    return pid;
+}
@@ -0,0 +1,60 @@
+// checkpoint.h
+//	Data structures for saving a running user program, with the disk
+//	it runs on, to a UNIX file (a "checkpoint", -ckpt), and for
+//	starting it again from there in a later run of Nachos (-restore).
+//
+//	A checkpoint is taken at the first time slice the program is
+//	switched out at, at or after a given tick, between two of its
+//	instructions.  It is one UNIX file: first an image of the disk,
+//	once everything the file system held back has been written to it
+//	(see Disk::SaveImage); then the program's name, its registers and
+//	the statistics; then each of its pages that the executable cannot
+//	give back (see AddrSpace::SavePages).  As it starts with a disk
+//	image, a run restored from it makes its disk an overlay on it
+//	(see disk.h), so that any number of runs can start from one
+//	checkpoint, at once, each writing only a delta of its own.
+//
+//	What the kernel holds in its own memory cannot be saved: its
+//	threads run as host code, on host stacks full of host pointers,
+//	and so do the pending interrupts.  So only a program that is all
+//	in its pages and its registers can be: the only one running, with
+//	one thread, and nothing open but the console.  It is restored
+//	into a kernel of its own, booted as usual, and run from its first
+//	thread, in the root directory; the time and counters go on from
+//	where they were.  The run that restores it must be of the same
+//	Nachos, with the same flags for the disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "utility.h"
+
+// The following class defines a checkpoint to be taken.
+
+class Checkpoint {
+  public:
+    Checkpoint(char *fileName, Ticks when);
+					// Take one in "fileName" at "when"
+
+    bool IsDue(Ticks now) { return !done && now >= when; }
+					// Is it time, and not done yet?
+    void Take();			// Save the running program now, if
+					// it can be; only ever once
+
+    static int Restore(char *fileName);	// Start the program saved in
+					// "fileName"; its id, or -1 if it is
+					// not a checkpoint
+
+  private:
+    char *fileName;			// the UNIX file it goes to
+    Ticks when;				// the tick it is due at
+    bool done;				// has it been tried?
+};
+
+#endif // CHECKPOINT_H
@@ -25,6 +25,27 @@
 #include "main.h"
 #include "syscall.h"
 #include "ksyscall.h"
+#include "tracer.h"
+#include "kernelprofile.h"
+
+// The following class times a system call, from the trap until the
+// handler returns to the program, into the histogram of its code.
+// Calls that never return (Halt, Exit, ...) are not counted.
+
+class SyscallTimer {
+  public:
+    SyscallTimer(int code) { type = code; start = kernel->stats->totalTicks; }
+    ~SyscallTimer() {
+	if (type >= 0 && type < MaxSyscallCodes)
+	    kernel->stats->syscallTicks[type].Add((int) (kernel->stats->totalTicks
+							 - start));
+    }
+
+  private:
+    int type;			// the code, or -1 if not a system call
+    Ticks start;		// when the trap came
+};
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 // 	Entry point into the Nachos kernel.  Called when a user program
@@ -50,13 +71,17 @@
 
 void ExceptionHandler(ExceptionType which)
 {
+	ProfileRegion region("ExceptionHandler");
 	int type = kernel->machine->ReadRegister(2);
+	SyscallTimer timer((which == SyscallException) ? type : -1);
 	int val;
 	int status, exit, threadID, programID, fileID, numChar;
 	DEBUG(dbgSys, "Received Exception " << which << " type: " << type << "\n");
 	switch (which)
 	{
 	case SyscallException:
+		kernel->currentThread->stats->CountSyscall(type);
+		TRACE(TraceSyscall, type, kernel->machine->ReadRegister(4));
 		switch (type)
 		{
 		case SC_Halt:
@@ -78,12 +103,119 @@ void ExceptionHandler(ExceptionType which)
 			return;
 			ASSERTNOTREACHED();
 			break;
+		case SC_PrintString:
+			val = kernel->machine->ReadRegister(4);
+			{
+				numChar = kernel->machine->ReadRegister(5);
+				status = SysPrintString(val, numChar);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ReadConsole:
+			val = kernel->machine->ReadRegister(4);
+			{
+				numChar = kernel->machine->ReadRegister(5);
+				status = SysReadConsole(val, numChar);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_GetTicks:
+			kernel->machine->WriteRegister(2, (int) kernel->stats->totalTicks);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Sleep:
+			val = kernel->machine->ReadRegister(4);
+			SysSleep(val);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_SetTickets:
+			val = kernel->machine->ReadRegister(4);
+			status = SysSetTickets(val);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ThreadFork:
+			val = kernel->machine->ReadRegister(4);
+			status = SysThreadFork(val, kernel->machine->ReadRegister(5));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ThreadJoin:
+			val = kernel->machine->ReadRegister(4);
+			status = SysThreadJoin(val);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ThreadYield:
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->currentThread->Yield();
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_FutexWait:
+		case SC_FutexWake:
+			val = kernel->machine->ReadRegister(4);
+			if (type == SC_FutexWait)
+				status = SysFutexWait(val, kernel->machine->ReadRegister(5));
+			else
+				status = SysFutexWake(val, kernel->machine->ReadRegister(5));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_GetTimes:
+			val = kernel->machine->ReadRegister(4);
+			status = SysGetTimes(val) ? 1 : 0;
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
 		case SC_MSG:
 			DEBUG(dbgSys, "Message received.\n");
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *msg = &(kernel->machine->mainMemory[val]);
-				cout << msg << endl;
+				char msg[MaxSubmitPath];
+
+				if (CopyInString(val, msg, MaxSubmitPath))
+					cout << msg << endl;
 			}
 			SysHalt();
 			ASSERTNOTREACHED();
@@ -92,9 +224,9 @@ void ExceptionHandler(ExceptionType which)
 			val = kernel->machine->ReadRegister(4);
 			{
 				int size = kernel->machine->ReadRegister(5);
-				char *filename = &(kernel->machine->mainMemory[val]);
-				// cout << filename << endl;
-				status = SysCreate(filename, size);
+				char filename[MaxSubmitPath];
+
+				status = CopyInString(val, filename, MaxSubmitPath) ? SysCreate(filename, size) : 0;
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -107,8 +239,9 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Open:
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				status = SysOpen(filename);
+				char filename[MaxSubmitPath];
+
+				status = CopyInString(val, filename, MaxSubmitPath) ? SysOpen(filename) : -1;
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -120,10 +253,9 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Read:
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *buffer = &(kernel->machine->mainMemory[val]);
 				numChar = kernel->machine->ReadRegister(5);
 				fileID = kernel->machine->ReadRegister(6);
-				status = SysRead(buffer, numChar, fileID);
+				status = SysRead(val, numChar, fileID);
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -135,10 +267,341 @@ void ExceptionHandler(ExceptionType which)
 		case SC_Write:
 			val = kernel->machine->ReadRegister(4);
 			{
-				char *buffer = &(kernel->machine->mainMemory[val]);
 				numChar = kernel->machine->ReadRegister(5);
 				fileID = kernel->machine->ReadRegister(6);
-				status = SysWrite(buffer, numChar, fileID);
+				status = SysWrite(val, numChar, fileID);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ReadV:
+		case SC_WriteV:
+			val = kernel->machine->ReadRegister(4);
+			{
+				int count = kernel->machine->ReadRegister(5);
+				fileID = kernel->machine->ReadRegister(6);
+				if (type == SC_ReadV)
+					status = SysReadV(val, count, fileID);
+				else
+					status = SysWriteV(val, count, fileID);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Submit:
+			val = kernel->machine->ReadRegister(4);
+			{
+				int count = kernel->machine->ReadRegister(5);
+				DEBUG(dbgSys, "Submit " << count << " requests\n");
+				status = SysSubmit(val, count);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Mmap:
+			fileID = kernel->machine->ReadRegister(4);
+			{
+				int offset = kernel->machine->ReadRegister(5);
+				int length = kernel->machine->ReadRegister(6);
+				status = SysMmap(fileID, offset, length);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Munmap:
+			val = kernel->machine->ReadRegister(4);
+			status = SysMunmap(val);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Fork:
+			// the child resumes after the syscall, seeing 0 in r2;
+			// its registers are taken from ours, so set them first
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(2, 0);
+			status = SysFork();
+			kernel->machine->WriteRegister(2, (int)status);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Join:
+			val = kernel->machine->ReadRegister(4);
+			status = SysJoin(val);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ChDir:
+			val = kernel->machine->ReadRegister(4);
+			{
+				char name[MaxSubmitPath];
+
+				status = CopyInString(val, name, MaxSubmitPath) ? SysChDir(name) : 0;
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_RemoveTree:
+			val = kernel->machine->ReadRegister(4);
+			{
+				char name[MaxSubmitPath];
+
+				status = CopyInString(val, name, MaxSubmitPath) ? SysRemoveTree(name) : 0;
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Rename:
+			{
+				char from[MaxSubmitPath], to[MaxSubmitPath];
+
+				status = CopyInString(kernel->machine->ReadRegister(4), from, MaxSubmitPath)
+					&& CopyInString(kernel->machine->ReadRegister(5), to, MaxSubmitPath)
+					? SysRename(from, to) : 0;
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_CopyFile:
+			{
+				char from[MaxSubmitPath], to[MaxSubmitPath];
+
+				status = CopyInString(kernel->machine->ReadRegister(4), from, MaxSubmitPath)
+					&& CopyInString(kernel->machine->ReadRegister(5), to, MaxSubmitPath)
+					? SysCopyFile(from, to) : 0;
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Fsync:
+			fileID = kernel->machine->ReadRegister(4);
+			status = SysFsync(fileID);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_GetFileIo:
+			fileID = kernel->machine->ReadRegister(4);
+			status = SysGetFileIo(fileID, kernel->machine->ReadRegister(5));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Ftruncate:
+			fileID = kernel->machine->ReadRegister(4);
+			status = SysFtruncate(fileID, kernel->machine->ReadRegister(5));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Fallocate:
+			fileID = kernel->machine->ReadRegister(4);
+			val = kernel->machine->ReadRegister(5);
+			status = SysFallocate(fileID, val, kernel->machine->ReadRegister(6));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Pread:
+		case SC_Pwrite:
+			val = kernel->machine->ReadRegister(4);
+			{
+				numChar = kernel->machine->ReadRegister(5);
+				int position = kernel->machine->ReadRegister(6);
+				fileID = kernel->machine->ReadRegister(7);
+				if (type == SC_Pread)
+					status = SysPread(val, numChar, position, fileID);
+				else
+					status = SysPwrite(val, numChar, position, fileID);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_AioRead:
+		case SC_AioWrite:
+			val = kernel->machine->ReadRegister(4);
+			{
+				numChar = kernel->machine->ReadRegister(5);
+				int position = kernel->machine->ReadRegister(6);
+				fileID = kernel->machine->ReadRegister(7);
+				status = SysAioSubmit(val, numChar, position, fileID, type == SC_AioWrite);
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_AioComplete:
+			val = kernel->machine->ReadRegister(4);
+			status = SysAioComplete(val, kernel->machine->ReadRegister(5) != 0);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Fadvise:
+			fileID = kernel->machine->ReadRegister(4);
+			val = kernel->machine->ReadRegister(5);
+			status = SysFadvise(fileID, val, kernel->machine->ReadRegister(6),
+								kernel->machine->ReadRegister(7));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_LockRange:
+			fileID = kernel->machine->ReadRegister(4);
+			val = kernel->machine->ReadRegister(5);
+			status = SysLockRange(fileID, val, kernel->machine->ReadRegister(6),
+								  kernel->machine->ReadRegister(7));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_CopyRange:
+			fileID = kernel->machine->ReadRegister(4);
+			val = kernel->machine->ReadRegister(5);
+			status = SysCopyRange(fileID, val, kernel->machine->ReadRegister(6));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_ReadDir:
+			fileID = kernel->machine->ReadRegister(4);
+			val = kernel->machine->ReadRegister(5);
+			status = SysReadDir(fileID, val, kernel->machine->ReadRegister(6));
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Stat:
+			val = kernel->machine->ReadRegister(4);
+			{
+				char filename[MaxSubmitPath];
+
+				status = CopyInString(val, filename, MaxSubmitPath)
+							 ? SysStat(filename, kernel->machine->ReadRegister(5))
+							 : 0;
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_CreateMany:
+			val = kernel->machine->ReadRegister(4);
+			{
+				char dirName[MaxSubmitPath];
+				int count = kernel->machine->ReadRegister(6);
+
+				status = CopyInString(val, dirName, MaxSubmitPath)
+							 ? SysCreateMany(dirName, kernel->machine->ReadRegister(5), count)
+							 : -1;
+				kernel->machine->WriteRegister(2, (int)status);
+			}
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Pipe:
+			val = kernel->machine->ReadRegister(4);
+			status = SysPipe(val);
+			kernel->machine->WriteRegister(2, (int)status);
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Sync:
+			SysSync();
+			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
+			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+			return;
+			ASSERTNOTREACHED();
+			break;
+		case SC_Seek:
+			val = kernel->machine->ReadRegister(4);
+			{
+				fileID = kernel->machine->ReadRegister(5);
+				status = SysSeek(val, fileID);
 				kernel->machine->WriteRegister(2, (int)status);
 			}
 			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
@@ -188,13 +651,40 @@ void ExceptionHandler(ExceptionType which)
 			DEBUG(dbgAddr, "Program exit\n");
 			val = kernel->machine->ReadRegister(4);
 			cout << "return value:" << val << endl;
-			kernel->currentThread->Finish();
+			kernel->currentThread->space->SetExitStatus(val);
+			SysThreadExit(val);
+			break;
+		case SC_ThreadExit:
+			val = kernel->machine->ReadRegister(4);
+			SysThreadExit(val);
 			break;
 		default:
 			cerr << "Unexpected system call " << type << "\n";
 			break;
 		}
 		break;
+	case PageFaultException:
+		// a page not brought in yet -- or, with a TLB, one that is
+		// not in the TLB; the faulting instruction is run again
+		// once it is there
+		val = kernel->machine->ReadRegister(BadVAddrReg);
+		if (kernel->currentThread->space->PageIn(val / PageSize))
+		{
+#ifdef USE_TLB
+			kernel->tlbManager->Refill(kernel->currentThread->space, val / PageSize);
+#endif
+			return;
+		}
+		cerr << "Page fault at unmapped address " << val << "\n";
+		break;
+	case ReadOnlyException:
+		// a write to a page shared with a forked program; it gets
+		// its own copy, and the write is run again
+		val = kernel->machine->ReadRegister(BadVAddrReg);
+		if (kernel->currentThread->space->CopyOnWrite(val / PageSize))
+			return;
+		cerr << "Write to read-only address " << val << "\n";
+		break;
 	default:
 		cerr << "Unexpected user mode exception " << (int)which << "\n";
 		break;
@@ -0,0 +1,527 @@
+// frametable.cc
+//	Routines to allocate the frames of physical memory to the pages
+//	of user programs, and to pick which page to evict when they are
+//	all taken.  See frametable.h for the policies.
+//
+//	With only NumPhysPages frames, the policies simply scan the
+//	whole table when they have to choose.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "frametable.h"
+#include "main.h"
+#include "addrspace.h"
+#include "tlbmanager.h"
+#include "reaper.h"
+#include "synch.h"
+#include <string.h>
+
+//----------------------------------------------------------------------
+// FrameTable::FrameTable
+// 	Initialize a table of frames, all of them free.
+//
+//	"size" -- how many frames physical memory has
+//	"order" -- the policy used to pick a page to evict
+//----------------------------------------------------------------------
+
+FrameTable::FrameTable(int size, PagePolicy order, int superpage)
+{
+    ASSERT(superpage >= 1 && size % superpage == 0);
+    numFrames = size;
+    superpageSize = superpage;
+    frames = new FrameInfo[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+	frames[i].owners = new List<AddrSpace *>;
+	frames[i].age = 0;
+	frames[i].pins = 0;
+	frames[i].nextInHash = -1;
+	frames[i].fileSector = -1;
+	frames[i].nextInFile = -1;
+    }
+    for (numBuckets = 1; numBuckets < numFrames; numBuckets *= 2)
+	;
+    bucket = new int[numBuckets];
+    fileBucket = new int[numBuckets];
+    for (int b = 0; b < numBuckets; b++) {
+	bucket[b] = -1;
+	fileBucket[b] = -1;
+    }
+    inUse = new Bitmap(numFrames);
+    policy = order;
+    hand = 0;
+    lock = new Lock("frame table lock");
+}
+
+//----------------------------------------------------------------------
+// FrameTable::~FrameTable
+// 	De-allocate the table.
+//----------------------------------------------------------------------
+
+FrameTable::~FrameTable()
+{
+    delete lock;
+    delete [] fileBucket;
+    delete [] bucket;
+    delete inUse;
+    for (int i = 0; i < numFrames; i++)
+	delete frames[i].owners;
+    delete [] frames;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Acquire / Release
+// 	Start and finish a paging operation.  The caller may block on
+//	the disk in between; no other page-in or eviction starts until it
+//	is done.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Acquire()
+{
+    lock->Acquire();
+}
+
+void
+FrameTable::Release()
+{
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Allocate
+// 	Return a frame in which to put virtual page "virtualPage" of
+//	"owner".  If no frame is free, a page is evicted to make one,
+//	from every address space that has it.  The first of them to save
+//	it to swap tells the others which slot it went to.  The frame's
+//	contents are left as they are: the caller fills it.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Allocate(AddrSpace *owner, int virtualPage)
+{
+    return Take(owner, virtualPage, TRUE);
+}
+
+//----------------------------------------------------------------------
+// FrameTable::AllocateFree
+// 	The same, but only if a frame is free: return -1 rather than
+//	evict a page.  For pages brought in before they are wanted.
+//----------------------------------------------------------------------
+
+int
+FrameTable::AllocateFree(AddrSpace *owner, int virtualPage)
+{
+    return Take(owner, virtualPage, FALSE);
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Take
+// 	Allocate and AllocateFree: "mayEvict" says whether a page may be
+//	evicted when no frame is free.  Before that, the frames of
+//	programs that have exited, but that the reaper has not got to
+//	yet, are given back.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Take(AddrSpace *owner, int virtualPage, bool mayEvict)
+{
+    int frame;
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    frame = -1;
+    if (superpageSize > 1) {
+	frame = PlaceInGroup(owner, virtualPage);
+	if (frame != -1)
+	    inUse->Mark(frame);
+    }
+    if (frame == -1)
+	frame = inUse->FindAndSet();
+    if (frame == -1 && kernel->reaper != NULL
+	&& kernel->reaper->ReclaimPending() > 0)
+	frame = inUse->FindAndSet();	// exited programs had some
+    if (frame == -1 && !mayEvict)
+	return -1;
+    if (frame == -1) {
+	List<AddrSpace *> *owners;
+	int slot = -1;
+
+	frame = ChooseVictim();
+	owners = frames[frame].owners;
+	DEBUG(dbgAddr, "Evicting page " << frames[frame].virtualPage
+			<< " from frame " << frame);
+	while (!owners->IsEmpty())
+	    owners->RemoveFront()->Evict(frames[frame].virtualPage, &slot);
+	Unhash(frame);
+	UncacheFilePage(frame);
+    }
+    frames[frame].owners->Append(owner);
+    frames[frame].virtualPage = virtualPage;
+    Hash(frame);
+    frames[frame].age = 0;
+    frames[frame].pins = 0;
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::PlaceInGroup
+// 	With superpages, pick a free frame for "virtualPage" of "owner"
+//	that keeps its group together (see frametable.h).  Return -1 if
+//	there is none; then any free frame will do, every one of them
+//	being in a group that is broken up already.
+//----------------------------------------------------------------------
+
+int
+FrameTable::PlaceInGroup(AddrSpace *owner, int virtualPage)
+{
+    int offset = virtualPage % superpageSize;
+    int first = virtualPage - offset;
+
+    // a page of the group in memory says where the group's frames are
+    for (int i = 0; i < superpageSize; i++) {
+	TranslationEntry *pte;
+	int base;
+
+	if (i == offset || first + i >= owner->TableSize())
+	    continue;
+	pte = owner->PageEntry(first + i);
+	if (!pte->valid)
+	    continue;
+	base = pte->physicalPage - i;
+	if (base >= 0 && base % superpageSize == 0
+	    && !inUse->Test(base + offset))
+	    return base + offset;
+	break;				// the group is broken already
+    }
+    for (int base = 0; base < numFrames; base += superpageSize) {
+	if (GroupIsFree(base))
+	    return base + offset;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::GroupIsFree
+// 	Return TRUE if no frame of the group starting at "first" is in
+//	use.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::GroupIsFree(int first)
+{
+    for (int i = first; i < first + superpageSize; i++) {
+	if (inUse->Test(i))
+	    return FALSE;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Share
+// 	A forked child, or another program running the same executable,
+//	now has "frame" in its page table too, at the same virtual page
+//	as the owners it has already.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Share(int frame, AddrSpace *owner)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(!frames[frame].owners->IsEmpty());
+    frames[frame].owners->Append(owner);
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Free
+// 	"owner" no longer needs the page in "frame"; give the frame back
+//	once nobody does.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Free(int frame, AddrSpace *owner)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(frames[frame].owners->IsInList(owner));
+    frames[frame].owners->Remove(owner);
+    if (frames[frame].owners->IsEmpty()) {
+	ASSERT(frames[frame].pins == 0);
+	Unhash(frame);
+	UncacheFilePage(frame);
+	inUse->Clear(frame);
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Hash, FrameTable::Unhash
+// 	Put a frame that has just been given a page on the hash chain of
+//	the page, or take one whose page has left it off.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Hash(int frame)
+{
+    int b = frames[frame].virtualPage & (numBuckets - 1);
+
+    frames[frame].nextInHash = bucket[b];
+    bucket[b] = frame;
+}
+
+void
+FrameTable::Unhash(int frame)
+{
+    int *link = &bucket[frames[frame].virtualPage & (numBuckets - 1)];
+
+    while (*link != frame) {
+	ASSERT(*link != -1);
+	link = &frames[*link].nextInHash;
+    }
+    *link = frames[frame].nextInHash;
+    frames[frame].nextInHash = -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Lookup
+// 	Return the frame that holds virtual page "virtualPage" of
+//	"owner", or -1 if the page is not in memory.  Needs no lock: it
+//	does not block, and the caller uses the answer before anything
+//	else can run.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Lookup(AddrSpace *owner, int virtualPage)
+{
+    int frame = bucket[virtualPage & (numBuckets - 1)];
+
+    for (; frame != -1; frame = frames[frame].nextInHash) {
+	if (frames[frame].virtualPage == virtualPage
+	    && frames[frame].owners->IsInList(owner))
+	    return frame;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::CacheFilePage
+// 	Put "frame", just filled with the page of a file that starts at
+//	"offset", in the page cache.  Every owner must have it read-only,
+//	so that nobody writes it while it is there.
+//
+//	"sector" -- the sector of the file's header
+//	"writes" -- the file's write count (see OpenFile::WriteCount)
+//----------------------------------------------------------------------
+
+void
+FrameTable::CacheFilePage(int frame, int sector, int offset,
+			  unsigned int writes)
+{
+    int b = FileHash(sector, offset);
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(frames[frame].fileSector == -1);
+    frames[frame].fileSector = sector;
+    frames[frame].fileOffset = offset;
+    frames[frame].fileWrites = writes;
+    frames[frame].nextInFile = fileBucket[b];
+    fileBucket[b] = frame;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::LookupFilePage
+// 	Return a frame in the page cache that holds the page of the file
+//	at "sector" from "offset" on, as the file is after "writes"
+//	writes, and that its owners have as "virtualPage"; -1 if there
+//	is none.
+//----------------------------------------------------------------------
+
+int
+FrameTable::LookupFilePage(int sector, int offset, unsigned int writes,
+			   int virtualPage)
+{
+    int frame = fileBucket[FileHash(sector, offset)];
+
+    ASSERT(lock->IsHeldByCurrentThread());
+    for (; frame != -1; frame = frames[frame].nextInFile) {
+	if (frames[frame].fileSector == sector
+	    && frames[frame].fileOffset == offset
+	    && frames[frame].fileWrites == writes
+	    && frames[frame].virtualPage == virtualPage)
+	    return frame;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::UncacheFilePage
+// 	Take "frame" out of the page cache, if it is in it: it is about
+//	to be written, or to hold another page.
+//----------------------------------------------------------------------
+
+void
+FrameTable::UncacheFilePage(int frame)
+{
+    int *link;
+
+    if (frames[frame].fileSector == -1)
+	return;
+    link = &fileBucket[FileHash(frames[frame].fileSector,
+				frames[frame].fileOffset)];
+    while (*link != frame) {
+	ASSERT(*link != -1);
+	link = &frames[*link].nextInFile;
+    }
+    *link = frames[frame].nextInFile;
+    frames[frame].nextInFile = -1;
+    frames[frame].fileSector = -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::FileHash
+// 	Return the page cache chain of the page of the file at "sector"
+//	from "offset" on.
+//----------------------------------------------------------------------
+
+int
+FrameTable::FileHash(int sector, int offset)
+{
+    return (sector * 31 + offset / PageSize) & (numBuckets - 1);
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Pin / Unpin
+// 	Keep the page in "frame" from being evicted while the kernel
+//	blocks on a transfer to or from it, and allow it again once the
+//	transfer is done.  Pins nest.
+//
+//	Unpinning needs no lock: it can only make a frame a candidate
+//	again, and nobody waits for that.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Pin(int frame)
+{
+    ASSERT(lock->IsHeldByCurrentThread());
+    ASSERT(!frames[frame].owners->IsEmpty());
+    frames[frame].pins++;
+}
+
+void
+FrameTable::Unpin(int frame)
+{
+    ASSERT(frames[frame].pins > 0);
+    frames[frame].pins--;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::ChooseVictim
+// 	Pick, according to the policy, the frame whose page is to be
+//	evicted.  Every frame is in use; pinned ones are passed over.
+//----------------------------------------------------------------------
+
+int
+FrameTable::ChooseVictim()
+{
+#ifdef USE_TLB
+    kernel->tlbManager->SyncBits();	// the bits the TLB has set
+#endif
+    switch (policy) {
+      case PageAging:
+	return Aging();
+      case PageClock:
+      default:
+	return Clock();
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameTable::EntryOf
+// 	Return the page table entry whose use and dirty bits stand for
+//	"frame": that of its first owner.  The page of a shared frame is
+//	read-only, so none of its owners can dirty it; only their use
+//	bits may differ, and the first owner's is taken as good enough.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+FrameTable::EntryOf(int frame)
+{
+    return frames[frame].owners->Front()->PageEntry(frames[frame].virtualPage);
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Clock
+// 	Enhanced second chance.  The first sweep looks for a frame that
+//	is neither used nor dirty, touching nothing; the second for one
+//	that is not used, clearing the use bits it passes.  If both fail,
+//	every use bit is now clear, so the next two sweeps must succeed.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Clock()
+{
+    for (int round = 0; round < 4; round++) {
+	for (int n = 0; n < numFrames; n++) {
+	    int frame = hand;
+	    TranslationEntry *pte = EntryOf(frame);
+
+	    hand = (hand + 1) % numFrames;
+	    if (frames[frame].pins > 0)
+		continue;
+	    if (!pte->use && (!pte->dirty || round % 2 == 1))
+		return frame;
+	    if (round % 2 == 1)
+		pte->use = FALSE;
+	}
+    }
+    ASSERTNOTREACHED();
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Aging
+// 	Age every frame by its use bit, then return the one used least
+//	recently: the lowest age, preferring a clean page among equals.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Aging()
+{
+    int best = -1;
+    bool bestDirty = TRUE;
+
+    for (int frame = 0; frame < numFrames; frame++) {
+	TranslationEntry *pte = EntryOf(frame);
+
+	frames[frame].age = (frames[frame].age >> 1) | (pte->use ? 0x80 : 0);
+	pte->use = FALSE;
+	if (frames[frame].pins > 0)
+	    continue;
+	if (best == -1 || frames[frame].age < frames[best].age
+		|| (frames[frame].age == frames[best].age
+		    && bestDirty && !pte->dirty)) {
+	    best = frame;
+	    bestDirty = pte->dirty;
+	}
+    }
+    ASSERT(best != -1);			// every frame pinned
+    return best;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::ParsePolicy
+// 	Look up a page replacement policy by name.  Return FALSE if
+//	"name" is not one we know.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::ParsePolicy(char *name, PagePolicy *order)
+{
+    if (strcmp(name, "clock") == 0) {
+	*order = PageClock;
+    } else if (strcmp(name, "aging") == 0) {
+	*order = PageAging;
+    } else {
+	return FALSE;
+    }
+    return TRUE;
+}
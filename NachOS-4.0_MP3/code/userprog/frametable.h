@@ -0,0 +1,187 @@
+// frametable.h
+//	Data structures for handing out the frames of physical memory to
+//	the pages of user programs, and for taking them back when memory
+//	runs out.
+//
+//	Pages are only brought into memory when a program touches them
+//	(see AddrSpace::PageIn).  Each frame in use remembers which
+//	address space and virtual page it holds, so that when every frame
+//	is taken, one can be chosen and its page evicted -- written to swap
+//	or back to its file if it was changed, and simply dropped if not.
+//	The choice is made by one of several policies, all of which go by
+//	the use and dirty bits the simulated hardware keeps in each page
+//	table entry:
+//
+//	   CLOCK -- the "enhanced" second chance algorithm: a hand sweeps
+//		the frames, looking first for a page that was neither used
+//		nor changed since the hand last passed it, then for one
+//		that was not used, clearing use bits on the way
+//	   AGING -- an approximation of least recently used: each frame
+//		has an 8 bit age, shifted right at every eviction with the
+//		use bit shifted in at the top; the frame with the lowest
+//		age goes, a clean one if there is a tie
+//
+//	After a Fork, a frame can be shared, copy-on-write, by the parent
+//	and the child, and a frame of code by all the programs running
+//	the same executable (always at the same virtual page).  Evicting
+//	a shared frame evicts the page from all of them.
+//
+//	All paging is done holding the frame table's lock, so a page is
+//	never evicted while it is being read in or written out.
+//
+//	With superpages (-sp), a free frame is chosen so that an aligned
+//	group of virtual pages ends up in an aligned group of frames, in
+//	order, which the TLB can map with one entry: next to a page of
+//	the group already in memory if there is one, at the same place in
+//	a group of frames that is all free if not.
+//
+//	The table is also an inverted page table: the frames in use are
+//	hashed by the virtual page they hold, so that Lookup finds the
+//	frame an address space has a page in without its page table
+//	(the TLB refill handler does, with -ipt).  The key is the page
+//	alone, not the address space too, since a shared frame has
+//	several owners; a chain is checked for the owner, and the
+//	buckets, one per frame, keep the chains short.  Its size goes
+//	with physical memory, however many programs there are.
+//
+//	The frames are the page cache too.  A frame a page was read into
+//	whole from a file -- a mapped file, or the executable -- and that
+//	has not been written since, is hashed by where in the file it
+//	came from: the sector of the file's header, and the offset.  A
+//	program faulting on a page of the same bytes then shares the
+//	frame, read-only, rather than read them again, whether it maps
+//	the file or runs it; a write copies the page first (see
+//	AddrSpace::CopyOnWrite), and the frame leaves the cache once its
+//	last sharer writes it.  Each entry records how many times the
+//	file had been written when it was read in (see
+//	OpenFile::WriteCount), and is not used once that count moves on.
+//	Since the owners of a frame all have its page at the same virtual
+//	page, only a program with it there finds it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FRAMETABLE_H
+#define FRAMETABLE_H
+
+#include "bitmap.h"
+#include "list.h"
+
+class AddrSpace;
+class Lock;
+class TranslationEntry;
+
+enum PagePolicy { PageClock, PageAging };
+
+// The following class records what one frame of physical memory holds.
+
+class FrameInfo {
+  public:
+    List<AddrSpace *> *owners;		// who has the frame in their page
+					// table; empty if it is free
+    int virtualPage;			// the page they have it as
+    int pins;				// kernel transfers going on to or
+					// from the frame; never evicted
+					// while this is not 0
+    unsigned char age;			// AGING: recent history of the
+					// page's use bit, newest on top
+    int nextInHash;			// next frame of the same hash
+					// chain, -1 at the end
+    int fileSector;			// header of the file whose page the
+					// frame holds, for the page cache;
+					// -1 if it is not in it
+    int fileOffset;			// where in the file the page starts
+    unsigned int fileWrites;		// the file's write count then
+    int nextInFile;			// next frame of the same page cache
+					// chain, -1 at the end
+};
+
+// The following class defines the table of all physical frames.
+
+class FrameTable {
+  public:
+    FrameTable(int numFrames, PagePolicy order, int superpage);
+					// Initialize a table of free frames
+    ~FrameTable();			// De-allocate the table
+
+    void Acquire();			// Start paging: take the lock that
+    void Release();			// keeps page-ins, evictions and
+					// unmaps from overlapping
+
+    int Allocate(AddrSpace *owner, int virtualPage);
+					// Return a frame for "virtualPage"
+					// of "owner", evicting a page if
+					// none is free; lock must be held
+    int AllocateFree(AddrSpace *owner, int virtualPage);
+					// The same, but -1 if none is free
+    void Share(int frame, AddrSpace *owner);
+					// Add an owner to a frame;
+					// lock must be held
+    int Sharers(int frame) { return frames[frame].owners->NumInList(); }
+    void Free(int frame, AddrSpace *owner);
+					// Drop an owner's use of a frame,
+					// freeing it at none; lock must be
+					// held
+    void Pin(int frame);		// Keep a frame's page where it is;
+					// lock must be held
+    void Unpin(int frame);		// Let it be evicted again
+    bool IsPinned(int frame) { return frames[frame].pins > 0; }
+
+    int Lookup(AddrSpace *owner, int virtualPage);
+					// The frame "owner" has the page
+					// in, -1 if none; lock not needed
+
+    void CacheFilePage(int frame, int sector, int offset,
+		       unsigned int writes);
+					// The frame holds the page of the
+					// file at "sector" from "offset"
+					// on, as it was after "writes"
+					// writes; lock must be held
+    int LookupFilePage(int sector, int offset, unsigned int writes,
+		       int virtualPage);
+					// A frame that does, for
+					// "virtualPage"; -1 if none
+    void UncacheFilePage(int frame);	// It is about to be written
+    bool IsCachedFilePage(int frame) { return frames[frame].fileSector != -1; }
+
+    static bool ParsePolicy(char *name, PagePolicy *order);
+					// Map "clock" or "aging" to a policy
+
+  private:
+    int numFrames;			// frames of physical memory
+    FrameInfo *frames;			// what is in each of them
+    Bitmap *inUse;			// which ones are taken
+    PagePolicy policy;			// how to pick a victim
+    int hand;				// CLOCK: the next frame to look at
+    Lock *lock;				// one pager at a time
+    int numBuckets;			// size of the hash; a power of 2
+    int *bucket;			// first frame of each chain, -1 if
+					// none
+
+    void Hash(int frame);		// put a frame in use on its chain
+    void Unhash(int frame);		// and take it off
+    int *fileBucket;			// first frame of each page cache
+					// chain, -1 if none
+    int FileHash(int sector, int offset); // the page cache chain of a
+					// file page
+    int superpageSize;			// pages in a group placed together;
+					// 1 if groups are not kept
+
+    int PlaceInGroup(AddrSpace *owner, int virtualPage);
+					// a free frame that keeps its group
+					// together; -1 if there is none
+    bool GroupIsFree(int first);	// all of a group of frames free?
+    int Take(AddrSpace *owner, int virtualPage, bool mayEvict);
+					// Allocate, evicting only if allowed
+    int ChooseVictim();			// the frame to evict, by policy
+    TranslationEntry *EntryOf(int frame);
+					// the page table entry a policy
+					// looks at for "frame"
+    int Clock();
+    int Aging();
+};
+
+#endif // FRAMETABLE_H
@@ -0,0 +1,114 @@
+// futextable.cc
+//	Routines to put user threads to sleep on a word of their memory,
+//	and wake them up.  See futextable.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "futextable.h"
+#include "synch.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// FutexTable::FutexTable
+// 	Initialize a table with no waiters.
+//----------------------------------------------------------------------
+
+FutexTable::FutexTable()
+{
+    lock = new Lock("futex table lock");
+    for (int i = 0; i < FutexBuckets; i++)
+	buckets[i] = new List<FutexWaiter *>;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::~FutexTable
+// 	De-allocate the table.  Whoever still waits is never woken.
+//----------------------------------------------------------------------
+
+FutexTable::~FutexTable()
+{
+    for (int i = 0; i < FutexBuckets; i++)
+	delete buckets[i];
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Bucket
+// 	Return the list of the waiters on "vaddr" in "space", among
+//	others.
+//----------------------------------------------------------------------
+
+List<FutexWaiter *> *
+FutexTable::Bucket(AddrSpace *space, unsigned int vaddr)
+{
+    return buckets[(vaddr / 4 + space->Asid() * 7) % FutexBuckets];
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wait
+// 	If the word of user memory at "vaddr" in "space" -- the running
+//	thread's -- holds "value", wait until a FutexWake on it wakes us
+//	up, and return 0.  Return -1 at once if it holds something else,
+//	or "vaddr" is not a word the program can read.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wait(AddrSpace *space, unsigned int vaddr, int value)
+{
+    Semaphore wakeup("futex wakeup", 0);
+    FutexWaiter waiter;
+    unsigned int paddr;
+    int word;
+
+    if (vaddr % 4 != 0)
+	return -1;
+    lock->Acquire();
+    if (space->Translate(vaddr, &paddr, 0) != NoException) {
+	lock->Release();
+	return -1;
+    }
+    word = WordToHost(*(unsigned int *) &(kernel->machine->mainMemory[paddr]));
+    if (word != value) {
+	lock->Release();
+	return -1;
+    }
+    waiter.space = space;
+    waiter.vaddr = vaddr;
+    waiter.wakeup = &wakeup;
+    Bucket(space, vaddr)->Append(&waiter);
+    lock->Release();
+    DEBUG(dbgThread, "Futex wait at " << vaddr << ": " << kernel->currentThread->getName());
+    wakeup.P();
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wake
+// 	Wake up to "count" of the threads waiting on "vaddr" in "space",
+//	those that have waited longest first.  Return how many were.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wake(AddrSpace *space, unsigned int vaddr, int count)
+{
+    List<FutexWaiter *> *bucket = Bucket(space, vaddr);
+    int woken = 0;
+
+    lock->Acquire();
+    for (int n = bucket->NumInList(); n > 0; n--) {
+	FutexWaiter *waiter = bucket->RemoveFront();
+
+	if (woken < count && waiter->space == space && waiter->vaddr == vaddr) {
+	    waiter->wakeup->V();
+	    woken++;
+	} else {
+	    bucket->Append(waiter);
+	}
+    }
+    lock->Release();
+    DEBUG(dbgThread, "Futex wake at " << vaddr << ": " << woken << " woken");
+    return woken;
+}
@@ -0,0 +1,72 @@
+// futextable.h
+//	Data structures for the threads of user programs that wait on a
+//	word of their memory (the FutexWait and FutexWake system calls).
+//
+//	A user-level lock or semaphore keeps its state in a word of user
+//	memory, and changes it there with no system call as long as no
+//	one has to wait.  A thread that has to wait calls FutexWait with
+//	the value it saw: the kernel checks the word still has it, and
+//	puts the thread to sleep; one that changes the word with others
+//	possibly waiting calls FutexWake.  The check and the going to
+//	sleep are done under the table's lock, and so is the waking, so
+//	a wakeup cannot fall between them.
+//
+//	A waiting thread sleeps on a semaphore of its own.  Waiters are
+//	kept in a fixed number of hashed lists, by the address space and
+//	virtual address of the word.  Programs never share memory here --
+//	a forked program has a copy of its parent's, and mapped files are
+//	private -- so only threads of one program can meet on a futex;
+//	and the virtual address, unlike the frame, stays the same while
+//	the page is paged out and in again.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FUTEXTABLE_H
+#define FUTEXTABLE_H
+
+#include "list.h"
+
+class Lock;
+class Semaphore;
+class AddrSpace;
+
+const int FutexBuckets = 32;		// lists of waiters
+
+// The following class records a thread waiting on a futex.
+
+class FutexWaiter {
+  public:
+    AddrSpace *space;			// whose memory the word is in
+    unsigned int vaddr;			// and where
+    Semaphore *wakeup;			// what the thread waits on
+};
+
+// The following class defines the table of waiting threads.
+
+class FutexTable {
+  public:
+    FutexTable();			// Initialize a table with no waiters
+    ~FutexTable();			// De-allocate the table
+
+    int Wait(AddrSpace *space, unsigned int vaddr, int value);
+					// Sleep until woken, if the word at
+					// "vaddr" is "value"; 0 if we slept,
+					// -1 if not
+    int Wake(AddrSpace *space, unsigned int vaddr, int count);
+					// Wake up to "count" of the threads
+					// waiting on "vaddr"; how many were
+
+  private:
+    Lock *lock;				// protects everything below
+    List<FutexWaiter *> *buckets[FutexBuckets];
+					// the waiters, oldest first, hashed
+					// by where they wait
+
+    List<FutexWaiter *> *Bucket(AddrSpace *space, unsigned int vaddr);
+};
+
+#endif // FUTEXTABLE_H
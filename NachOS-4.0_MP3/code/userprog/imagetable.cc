@@ -0,0 +1,93 @@
+// imagetable.cc
+//	Routines to keep track of the executables being run.  See
+//	imagetable.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "imagetable.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// ImageTable::ImageTable
+// 	Initialize a table with no executables in it.
+//----------------------------------------------------------------------
+
+ImageTable::ImageTable()
+{
+    images = new List<ExecImage *>;
+}
+
+//----------------------------------------------------------------------
+// ImageTable::~ImageTable
+// 	De-allocate the table, and the entries of the programs that were
+//	still running when Nachos halted.
+//----------------------------------------------------------------------
+
+ImageTable::~ImageTable()
+{
+    while (!images->IsEmpty()) {
+	ExecImage *image = images->RemoveFront();
+
+	delete image->users;
+	delete image;
+    }
+    delete images;
+}
+
+//----------------------------------------------------------------------
+// ImageTable::Attach
+// 	Record that "space" is running the executable whose file header
+//	is at "sector", and return its entry, made if nobody else is
+//	running it.
+//
+//	"textPages" -- how many leading pages of the program are code
+//		and read-only data alone; the same for every program
+//		that runs the executable
+//----------------------------------------------------------------------
+
+ExecImage *
+ImageTable::Attach(AddrSpace *space, int sector, int textPages)
+{
+    ListIterator<ExecImage *> it(images);
+    ExecImage *image = NULL;
+
+    for (; !it.IsDone(); it.Next()) {
+	if (it.Item()->sector == sector) {
+	    image = it.Item();
+	    break;
+	}
+    }
+    if (image == NULL) {
+	image = new ExecImage;
+	image->sector = sector;
+	image->textPages = textPages;
+	image->users = new List<AddrSpace *>;
+	images->Append(image);
+    }
+    ASSERT(image->textPages == textPages);
+    image->users->Append(space);
+    DEBUG(dbgAddr, "Executable at sector " << sector << " now run by "
+		    << image->users->NumInList());
+    return image;
+}
+
+//----------------------------------------------------------------------
+// ImageTable::Detach
+// 	"space" is done with the executable "image"; forget the
+//	executable once nobody runs it.
+//----------------------------------------------------------------------
+
+void
+ImageTable::Detach(ExecImage *image, AddrSpace *space)
+{
+    ASSERT(image->users->IsInList(space));
+    image->users->Remove(space);
+    if (image->users->IsEmpty()) {
+	images->Remove(image);
+	delete image->users;
+	delete image;
+    }
+}
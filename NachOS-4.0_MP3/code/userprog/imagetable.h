@@ -0,0 +1,64 @@
+// imagetable.h
+//	Data structures to keep track of the executables that user
+//	programs are running, so that programs running the same one can
+//	share the frames of its code.
+//
+//	An executable is known by the sector of its file header.  Each
+//	one that some program is running has an entry here, listing those
+//	programs.  The leading pages of the program that hold nothing but
+//	code and read-only data -- its text pages -- are never written,
+//	so when one of them faults in, the frame another of them already
+//	has it in, fresh from the executable, can be shared instead of the
+//	page being read again (see AddrSpace::PageIn).  The text pages are
+//	read-only, copy-on-write, in every page table; a program that does
+//	write to one gets a copy of its own, which is shared no more.  The
+//	rest of the address space -- data, uninitialized data and stack --
+//	is private as always.
+//
+//	So a second program running the same executable reads only the
+//	pages of its code that the first has not got in memory.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef IMAGETABLE_H
+#define IMAGETABLE_H
+
+#include "list.h"
+
+class AddrSpace;
+
+// The following class records one executable that is being run.
+
+class ExecImage {
+  public:
+    int sector;				// its file header
+    int textPages;			// how many leading pages are code
+					// and read-only data alone
+    List<AddrSpace *> *users;		// the programs running it
+};
+
+// The following class defines the table of running executables.  It
+// does no synchronization itself; it is only used with the frame
+// table's lock held.
+
+class ImageTable {
+  public:
+    ImageTable();			// Initialize an empty table
+    ~ImageTable();			// De-allocate the table
+
+    ExecImage *Attach(AddrSpace *space, int sector, int textPages);
+					// "space" is running the executable
+					// whose header is at "sector"
+    void Detach(ExecImage *image, AddrSpace *space);
+					// It is not any more; the entry goes
+					// with the last one
+
+  private:
+    List<ExecImage *> *images;		// every executable being run
+};
+
+#endif // IMAGETABLE_H
@@ -1,82 +1,739 @@
-/**************************************************************
- *
- * userprog/ksyscall.h
- *
- * Kernel interface for systemcalls
- *
- * by Marcus Voelp  (c) Universitaet Karlsruhe
- *
- **************************************************************/
-
-#ifndef __USERPROG_KSYSCALL_H__
-#define __USERPROG_KSYSCALL_H__
-
-#include "kernel.h"
-
-#include "synchconsole.h"
-
-void SysHalt()
-{
-	kernel->interrupt->Halt();
-}
-
-int SysAdd(int op1, int op2)
-{
-	return op1 + op2;
-}
-
-int SysCreate(char *filename,int size)
-{
-	// return value
-	// 1: success
-	// 0: failed
-	return kernel->interrupt->CreateFile(filename,size);
-}
-
-void SysPrintInt(int val)
-{
-	int tmp = val;
-	int digit[10] = {0}; // assume the length of val is not bigger than 10!
-	int index = 0, str_index = 0;
-	char converted_int[10] = {0};
-
-	while (tmp)
-	{
-		digit[index] = tmp % 10;
-		index++;
-		tmp /= 10;
-		if (index > 10)
-			DEBUG(dbgTraCode, "length of val is bigger than 10\n");
-	}
-
-	while (index)
-	{
-		index--;
-		converted_int[str_index++] = ('0' + digit[index]);
-	}
-	converted_int[str_index++] = ('\n');
-	kernel->synchConsoleOut->PutInt(converted_int, str_index + 1);
-}
-// #ifdef FILESYS_STUB
-OpenFileId SysOpen(char *name)
-{
-	return kernel->interrupt->OpenFile(name);
-}
-
-int SysWrite(char *buffer, int size, OpenFileId id)
-{
-	return kernel->interrupt->WriteFile(buffer, size, id);
-}
-
-int SysRead(char *buffer, int size, OpenFileId id)
-{
-	return kernel->interrupt->ReadFile(buffer, size, id);
-}
-
-int SysClose(OpenFileId id)
-{
-	return kernel->interrupt->CloseFile(id);
-}
-// #endif // FILESYS_STUB
-
-#endif /* ! __USERPROG_KSYSCALL_H__ */
+/**************************************************************
+ *
+ * userprog/ksyscall.h
+ *
+ * Kernel interface for systemcalls
+ *
+ * by Marcus Voelp  (c) Universitaet Karlsruhe
+ *
+ **************************************************************/
+
+#ifndef __USERPROG_KSYSCALL_H__
+#define __USERPROG_KSYSCALL_H__
+
+#include "kernel.h"
+
+#include "synchconsole.h"
+#include "bufcache.h"
+#include "inodetable.h"
+#include "aioqueue.h"
+#include "proctable.h"
+#include "futextable.h"
+
+const int MaxSubmitPath = 256;	// longest file name a batched Create
+				// or Open may pass
+
+// IoVec and SyscallEntry (see syscall.h) as laid out in user memory,
+// in 32-bit words; the kernel's own pointers may be bigger
+const int UserIoVecWords = 2;
+const int UserEntryWords = 5;
+const int UserTimesWords = 5;
+const int UserFileIoWords = 6;
+const int UserCreateEntryWords = 3;
+const int UserFileInfoWords = 4;
+const int MaxCreateBatch = 32;	// most files one CreateMany makes
+const int UserDirEntWords = 1 + (FileNameMaxLen + 1) / 4;
+const int MaxReadDirBatch = 8;	// most entries one ReadDir returns;
+				// they are copied out from the stack
+
+void SysHalt()
+{
+	kernel->interrupt->Halt();
+}
+
+void SysSleep(int ticks)
+{
+	kernel->alarm->WaitUntil(ticks);
+}
+
+// Give the running thread "tickets" for the stride scheduler; return 0,
+// or -1 if that is out of range.
+int SysSetTickets(int tickets)
+{
+	if (tickets < 1 || tickets > MaxTickets)
+		return -1;
+	kernel->currentThread->tickets = tickets;
+	kernel->currentThread->stats->tickets = tickets;
+	return 0;
+}
+
+// Start another thread of the running program at "func", to return
+// to "returnTo" (see start.S), and return its ThreadId, -1 if it
+// could not be started.
+int SysThreadFork(int func, int returnTo)
+{
+	return kernel->ThreadFork(func, returnTo);
+}
+
+// Wait for the thread "id" of the running program, started by the
+// running thread, to exit; return its exit code, or -1 if it is no
+// such thread.
+int SysThreadJoin(int id)
+{
+	return kernel->currentThread->space->Threads()->Join(id, kernel->currentThread->userThreadId);
+}
+
+// The running thread is done, with exit code "code"; the last thread
+// of a program to be done ends the program.
+void SysThreadExit(int code)
+{
+	Thread *t = kernel->currentThread;
+
+	t->space->Threads()->Exit(t->userThreadId, code);
+	kernel->LeaveProgram();
+}
+
+int SysFutexWait(int addr, int value)
+{
+	return kernel->futexTable->Wait(kernel->currentThread->space, addr, value);
+}
+
+int SysFutexWake(int addr, int count)
+{
+	return kernel->futexTable->Wake(kernel->currentThread->space, addr, count);
+}
+
+int SysAdd(int op1, int op2)
+{
+	return op1 + op2;
+}
+
+int SysCreate(char *filename,int size)
+{
+	// return value
+	// 1: success
+	// 0: failed
+	return kernel->interrupt->CreateFile(filename,size);
+}
+
+void SysPrintInt(int val)
+{
+	int tmp = val;
+	int digit[10] = {0}; // assume the length of val is not bigger than 10!
+	int index = 0, str_index = 0;
+	char converted_int[10] = {0};
+
+	while (tmp)
+	{
+		digit[index] = tmp % 10;
+		index++;
+		tmp /= 10;
+		if (index > 10)
+			DEBUG(dbgTraCode, "length of val is bigger than 10\n");
+	}
+
+	while (index)
+	{
+		index--;
+		converted_int[str_index++] = ('0' + digit[index]);
+	}
+	converted_int[str_index++] = ('\n');
+	kernel->synchConsoleOut->PutInt(converted_int, str_index + 1);
+}
+// Write a user buffer to the console: a page at a time, straight from
+// the frame that holds it (pinned, in case the console has to wait for
+// room), into the console's buffer.  Returns the characters written,
+// fewer than "size" only at an address that does not translate.
+int SysPrintString(int bufferAddr, int size)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	while (done < size)
+	{
+		unsigned int paddr;
+		int vaddr = bufferAddr + done;
+		int chunk = min(size - done, PageSize - vaddr % PageSize);
+
+		if (space->Pin(vaddr, &paddr, 0) != NoException)
+			break;
+		kernel->synchConsoleOut->PutChars(&(kernel->machine->mainMemory[paddr]), chunk);
+		space->Unpin(paddr);
+		done += chunk;
+	}
+	return done;
+}
+
+// #ifdef FILESYS_STUB
+OpenFileId SysOpen(char *name)
+{
+	return kernel->interrupt->OpenFile(name);
+}
+
+
+// The user's buffer is only contiguous in virtual memory, so it is
+// transferred a page at a time, each piece going straight to or from
+// the frame that holds that page, pinned there while the file system
+// may block.  Stops early when the file has no more to give or take,
+// or at an address that does not translate; returns the bytes
+// transferred.
+int SysTransfer(int bufferAddr, int size, OpenFileId id, bool writing)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	while (done < size)
+	{
+		unsigned int paddr;
+		int vaddr = bufferAddr + done;
+		int chunk = min(size - done, PageSize - vaddr % PageSize);
+		int numDone;
+
+		if (space->Pin(vaddr, &paddr, writing ? 0 : 1) != NoException)
+			break;
+		char *frame = &(kernel->machine->mainMemory[paddr]);
+		if (writing)
+			numDone = kernel->interrupt->WriteFile(frame, chunk, id);
+		else
+			numDone = kernel->interrupt->ReadFile(frame, chunk, id);
+		space->Unpin(paddr);
+		done += numDone;
+		if (numDone < chunk)
+			break;
+	}
+	return done;
+}
+
+int SysRead(int bufferAddr, int size, OpenFileId id)
+{
+	return SysTransfer(bufferAddr, size, id, FALSE);
+}
+
+int SysWrite(int bufferAddr, int size, OpenFileId id)
+{
+	return SysTransfer(bufferAddr, size, id, TRUE);
+}
+
+// Fetch/store one word of user memory; FALSE if "vaddr" does not
+// translate.
+bool ReadUserWord(int vaddr, int *value)
+{
+	unsigned int paddr;
+
+	if (vaddr % 4 != 0 || kernel->currentThread->space->Translate(vaddr, &paddr, 0) != NoException)
+		return FALSE;
+	*value = WordToHost(*(unsigned int *)&(kernel->machine->mainMemory[paddr]));
+	return TRUE;
+}
+
+bool WriteUserWord(int vaddr, int value)
+{
+	unsigned int paddr;
+
+	if (vaddr % 4 != 0 || kernel->currentThread->space->Translate(vaddr, &paddr, 1) != NoException)
+		return FALSE;
+	*(unsigned int *)&(kernel->machine->mainMemory[paddr]) = WordToHost(value);
+	return TRUE;
+}
+
+// Store the clock, and the calling thread's times and disk sectors,
+// in the Times (see syscall.h) at "timesAddr"; FALSE if it is not
+// mapped.
+bool SysGetTimes(int timesAddr)
+{
+	ThreadStats *mine = kernel->currentThread->stats;
+	int times[UserTimesWords];
+
+	kernel->stats->ChargeRunning();
+	times[0] = (int) kernel->stats->totalTicks;
+	times[1] = (int) mine->userTicks;
+	times[2] = (int) mine->systemTicks;
+	times[3] = mine->numDiskReads;
+	times[4] = mine->numDiskWrites;
+	for (int i = 0; i < UserTimesWords; i++)
+	{
+		if (!WriteUserWord(timesAddr + i * 4, times[i]))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+// Copy "size" bytes between user memory at "vaddr" and the kernel
+// buffer "buffer", a page at a time: each page is translated once and
+// copied whole, through the frame that holds it (pinned, in case it
+// has to be brought in first); "toUser" says which way.  Returns the
+// bytes copied, fewer than "size" only at an address that does not
+// translate.
+static int CopyUser(int vaddr, char *buffer, int size, bool toUser)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	while (done < size)
+	{
+		unsigned int paddr;
+		int chunk = min(size - done, PageSize - (vaddr + done) % PageSize);
+
+		if (space->Pin(vaddr + done, &paddr, toUser ? 1 : 0) != NoException)
+			break;
+		if (toUser)
+			bcopy(&buffer[done], &(kernel->machine->mainMemory[paddr]), chunk);
+		else
+			bcopy(&(kernel->machine->mainMemory[paddr]), &buffer[done], chunk);
+		space->Unpin(paddr);
+		done += chunk;
+	}
+	return done;
+}
+
+// Copy "size" bytes in from user memory at "vaddr", or out to it.
+int CopyIn(int vaddr, char *into, int size)
+{
+	return CopyUser(vaddr, into, size, FALSE);
+}
+
+int CopyOut(int vaddr, char *from, int size)
+{
+	return CopyUser(vaddr, from, size, TRUE);
+}
+
+// Read a line from the console into a user buffer: into a kernel
+// buffer first, since waiting for the line must not keep a frame
+// pinned, then copied out.  Returns the characters read, -1 if the
+// buffer is not mapped (the line is lost then).
+int SysReadConsole(int bufferAddr, int size)
+{
+	char line[ConsoleBufferSize];
+	int count;
+
+	if (size <= 0)
+		return 0;
+	count = kernel->synchConsoleIn->ReadLine(line, min(size, ConsoleBufferSize));
+	if (CopyOut(bufferAddr, line, count) < count)
+		return -1;
+	return count;
+}
+
+// Copy a NUL-terminated string in from user memory, at most "size"
+// bytes including the NUL; FALSE if it does not fit or is not mapped.
+// Each page the string is on is translated once, and searched for
+// the NUL in place.
+bool CopyInString(int vaddr, char *into, int size)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	while (done < size)
+	{
+		unsigned int paddr;
+		int chunk = min(size - done, PageSize - (vaddr + done) % PageSize);
+		char *end;
+
+		if (space->Pin(vaddr + done, &paddr, 0) != NoException)
+			return FALSE;
+		char *frame = &(kernel->machine->mainMemory[paddr]);
+		end = (char *)memchr(frame, '\0', chunk);
+		if (end != NULL)
+			chunk = end - frame + 1;
+		bcopy(frame, &into[done], chunk);
+		space->Unpin(paddr);
+		done += chunk;
+		if (end != NULL)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+// Read or write the buffers of an IoVec array, in order, as if by
+// one Read/Write per buffer; stops at the first one that is not
+// transferred completely.  Returns the total bytes transferred, -1
+// if the array itself cannot be read.
+int SysTransferV(int iovAddr, int count, OpenFileId id, bool writing)
+{
+	int total = 0;
+
+	for (int i = 0; i < count; i++)
+	{
+		int base, length, done;
+
+		if (!ReadUserWord(iovAddr + i * UserIoVecWords * 4, &base) ||
+			!ReadUserWord(iovAddr + (i * UserIoVecWords + 1) * 4, &length))
+			return (i == 0) ? -1 : total;
+		done = SysTransfer(base, length, id, writing);
+		total += done;
+		if (done < length)
+			break;
+	}
+	return total;
+}
+
+int SysReadV(int iovAddr, int count, OpenFileId id)
+{
+	return SysTransferV(iovAddr, count, id, FALSE);
+}
+
+int SysWriteV(int iovAddr, int count, OpenFileId id)
+{
+	return SysTransferV(iovAddr, count, id, TRUE);
+}
+
+int SysSeek(int position, OpenFileId id)
+{
+	return kernel->interrupt->SeekFile(position, id);
+}
+
+int SysClose(OpenFileId id)
+{
+	return kernel->interrupt->CloseFile(id);
+}
+
+// Run the "count" requests of a SyscallEntry array one after another,
+// storing each one's return value in its "result".  Only the file
+// calls can be batched; an entry with any other operation, or one that
+// cannot be read, ends the batch.  Returns the number of entries run.
+int SysSubmit(int entriesAddr, int count)
+{
+	char name[MaxSubmitPath];
+	int i;
+
+	for (i = 0; i < count; i++)
+	{
+		int entry = entriesAddr + i * UserEntryWords * 4;
+		int op, arg0, arg1, arg2, result;
+
+		if (!ReadUserWord(entry, &op) || !ReadUserWord(entry + 4, &arg0) ||
+			!ReadUserWord(entry + 8, &arg1) || !ReadUserWord(entry + 12, &arg2))
+			break;
+		switch (op)
+		{
+		case SC_Create:
+			result = CopyInString(arg0, name, MaxSubmitPath) ? SysCreate(name, arg1) : -1;
+			break;
+		case SC_Open:
+			result = CopyInString(arg0, name, MaxSubmitPath) ? SysOpen(name) : -1;
+			break;
+		case SC_Read:
+			result = SysRead(arg0, arg1, arg2);
+			break;
+		case SC_Write:
+			result = SysWrite(arg0, arg1, arg2);
+			break;
+		case SC_ReadV:
+			result = SysReadV(arg0, arg1, arg2);
+			break;
+		case SC_WriteV:
+			result = SysWriteV(arg0, arg1, arg2);
+			break;
+		case SC_Close:
+			result = SysClose(arg0);
+			break;
+		default:
+			return i;
+		}
+		if (!WriteUserWord(entry + 16, result))
+			break;
+	}
+	return i;
+}
+
+#ifndef FILESYS_STUB
+// Map part of an open file into the running program's memory; the
+// pages are filled in by the page fault handler.
+int SysMmap(OpenFileId id, int offset, int length)
+{
+	return kernel->fileSystem->MapAFile(id, offset, length);
+}
+
+int SysMunmap(int addr)
+{
+	return kernel->currentThread->space->Unmap(addr) ? 0 : -1;
+}
+
+int SysFork()
+{
+	return kernel->Fork();
+}
+
+// Wait for child program "id" of the caller to exit; its exit
+// status, or -1 if it is not a child still to be joined.
+int SysJoin(int id)
+{
+	return kernel->processTable->Join(id, kernel->currentThread->getID());
+}
+
+int SysChDir(char *name)
+{
+	return kernel->fileSystem->ChangeDirectory(name) ? 1 : 0;
+}
+
+int SysRemoveTree(char *name)
+{
+	return kernel->fileSystem->RemoveTree(name) ? 1 : 0;
+}
+
+int SysRename(char *from, char *to)
+{
+	return kernel->fileSystem->Rename(from, to) ? 1 : 0;
+}
+
+int SysCopyFile(char *from, char *to)
+{
+	return kernel->fileSystem->CopyFile(from, to) ? 1 : 0;
+}
+
+int SysFsync(OpenFileId id)
+{
+	return kernel->fileSystem->SyncAFile(id);
+}
+
+// Store the I/O counters of the open file "id" in the FileIo (see
+// syscall.h) at "ioAddr"; 0 if "id" is not open or "ioAddr" is not
+// mapped.
+int SysGetFileIo(OpenFileId id, int ioAddr)
+{
+	FileIoStats *stats = kernel->fileSystem->StatsOfAFile(id);
+	int io[UserFileIoWords];
+
+	if (stats == NULL)
+		return 0;
+	io[0] = stats->bytesRead;
+	io[1] = stats->bytesWritten;
+	io[2] = stats->sectorReads;
+	io[3] = stats->sectorWrites;
+	io[4] = stats->cacheHits;
+	io[5] = stats->runs;
+	for (int i = 0; i < UserFileIoWords; i++)
+	{
+		if (!WriteUserWord(ioAddr + i * 4, io[i]))
+			return 0;
+	}
+	return 1;
+}
+
+int SysFtruncate(OpenFileId id, int length)
+{
+	return kernel->fileSystem->TruncateAFile(id, length);
+}
+
+int SysFallocate(OpenFileId id, int offset, int length)
+{
+	return kernel->fileSystem->AllocateAFile(id, offset, length);
+}
+
+int SysFadvise(OpenFileId id, int offset, int length, int advice)
+{
+	return kernel->fileSystem->AdviseAFile(id, offset, length, advice);
+}
+
+int SysLockRange(OpenFileId id, int offset, int length, int mode)
+{
+	return kernel->fileSystem->LockAFileRange(id, offset, length, mode);
+}
+
+int SysCopyRange(OpenFileId from, OpenFileId to, int length)
+{
+	return kernel->fileSystem->CopyAFileRange(from, to, length);
+}
+
+// Like SysTransfer, but at file offset "position" (see ReadAFileAt):
+// each page-sized piece goes to where the one before it ended.
+int SysTransferAt(int bufferAddr, int size, int position, OpenFileId id, bool writing)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	if (position < 0)
+		return 0;
+	while (done < size)
+	{
+		unsigned int paddr;
+		int vaddr = bufferAddr + done;
+		int chunk = min(size - done, PageSize - vaddr % PageSize);
+		int numDone;
+
+		if (space->Pin(vaddr, &paddr, writing ? 0 : 1) != NoException)
+			break;
+		char *frame = &(kernel->machine->mainMemory[paddr]);
+		if (writing)
+			numDone = kernel->fileSystem->WriteAFileAt(frame, chunk, position + done, id);
+		else
+			numDone = kernel->fileSystem->ReadAFileAt(frame, chunk, position + done, id);
+		space->Unpin(paddr);
+		done += numDone;
+		if (numDone < chunk)
+			break;
+	}
+	return done;
+}
+
+// Start an asynchronous read or write (see aioqueue.h).  The request
+// gets an OpenFile and a buffer of its own; what is to be written is
+// copied into the buffer now.
+int SysAioSubmit(int bufferAddr, int size, int position, OpenFileId id, bool writing)
+{
+	OpenFile *file;
+	char *buffer;
+
+	if (size <= 0 || size > MaxAioBytes || position < 0
+		|| (file = kernel->fileSystem->ReopenAFile(id)) == NULL)
+		return -1;
+	buffer = new char[size];
+	if (writing && CopyIn(bufferAddr, buffer, size) < size)
+	{
+		delete file;
+		delete[] buffer;
+		return -1;
+	}
+	return kernel->currentThread->space->AsyncRequests()->Submit(
+		file, buffer, size, position, writing, bufferAddr);
+}
+
+// Collect a finished request, copying what a read got out to the
+// program's buffer, and its byte count to "resultAddr" (-1 if either
+// could not be stored).
+int SysAioComplete(int resultAddr, bool wait)
+{
+	AioQueue *queue = kernel->currentThread->space->AsyncRequests();
+	AioRequest *request;
+	int id, result;
+
+	if (queue->NumPending() == 0)
+		return -1;
+	request = queue->Complete(wait);
+	if (request == NULL)
+		return 0;
+	id = request->id;
+	result = request->result;
+	if (!request->writing && result > 0
+		&& CopyOut(request->userAddr, request->buffer, result) < result)
+		result = -1;
+	delete request;
+	if (!WriteUserWord(resultAddr, result))
+		return -1;
+	return id;
+}
+
+int SysPread(int bufferAddr, int size, int position, OpenFileId id)
+{
+	return SysTransferAt(bufferAddr, size, position, id, FALSE);
+}
+
+int SysPwrite(int bufferAddr, int size, int position, OpenFileId id)
+{
+	return SysTransferAt(bufferAddr, size, position, id, TRUE);
+}
+
+// Copy the next entries of an open directory out to the DirEnt array
+// at "entriesAddr" (see syscall.h), then move the directory's position
+// past them; if they cannot all be stored, it stays where it was.
+int SysReadDir(OpenFileId id, int entriesAddr, int count)
+{
+	DirectoryEntry entries[MaxReadDirBatch];
+	int n, next;
+
+	if (count <= 0)
+		return 0;
+	n = kernel->fileSystem->ReadDirectory(id, entries, min(count, MaxReadDirBatch), &next);
+	for (int i = 0; i < n; i++)
+	{
+		int entry = entriesAddr + i * UserDirEntWords * 4;
+		unsigned char name[(UserDirEntWords - 1) * 4];
+
+		bzero(name, sizeof(name));
+		strncpy((char *)name, entries[i].name, FileNameMaxLen);
+		if (!WriteUserWord(entry, entries[i].inUse))
+			return -1;
+		for (int w = 0; w < UserDirEntWords - 1; w++)
+		{
+			unsigned char *b = &name[w * 4];
+
+			if (!WriteUserWord(entry + 4 + w * 4, b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24)))
+				return -1;
+		}
+	}
+	if (n > 0)
+		kernel->fileSystem->SeekAFile(next, id);
+	return n;
+}
+
+// Store what the file system knows of the file "name" in the FileInfo
+// (see syscall.h) at "infoAddr"; 0 if there is no such file or
+// "infoAddr" is not mapped.
+int SysStat(char *name, int infoAddr)
+{
+	StatInfo info;
+	int words[UserFileInfoWords];
+
+	if (!kernel->fileSystem->Stat(name, &info))
+		return 0;
+	words[0] = info.length;
+	words[1] = info.numSectors;
+	words[2] = info.type;
+	words[3] = info.numFragments;
+	for (int i = 0; i < UserFileInfoWords; i++)
+	{
+		if (!WriteUserWord(infoAddr + i * 4, words[i]))
+			return 0;
+	}
+	return 1;
+}
+
+// Create the files of the CreateEntry array at "entriesAddr" (see
+// syscall.h) in the directory "dirName", and store in each entry
+// whether it was.  Every name is copied in before any is created, so
+// a batch that cannot be read creates nothing.  Returns how many were
+// created, -1 if none could be.
+int SysCreateMany(char *dirName, int entriesAddr, int count)
+{
+	char *names[MaxCreateBatch];
+	int sizes[MaxCreateBatch];
+	bool created[MaxCreateBatch];
+	char *buffer;
+	int n;
+
+	if (count <= 0 || count > MaxCreateBatch)
+		return -1;
+	buffer = new char[count * MaxSubmitPath];
+	for (int i = 0; i < count; i++)
+	{
+		int entry = entriesAddr + i * UserCreateEntryWords * 4;
+		int name;
+
+		names[i] = &buffer[i * MaxSubmitPath];
+		if (!ReadUserWord(entry, &name) || !ReadUserWord(entry + 4, &sizes[i]) ||
+			!CopyInString(name, names[i], MaxSubmitPath))
+		{
+			delete[] buffer;
+			return -1;
+		}
+	}
+	n = kernel->fileSystem->CreateMany(dirName, names, sizes, created, count);
+	for (int i = 0; n >= 0 && i < count; i++)
+	{
+		if (!WriteUserWord(entriesAddr + (i * UserCreateEntryWords + 2) * 4,
+						   created[i] ? 1 : 0))
+			break;
+	}
+	delete[] buffer;
+	return n;
+}
+
+// Make a pipe, and store the descriptors of its read and write ends
+// in the two words at "endsAddr"; if they cannot be stored, the pipe
+// is closed again.
+int SysPipe(int endsAddr)
+{
+	OpenFileId readId, writeId;
+
+	if (!kernel->fileSystem->OpenAPipe(&readId, &writeId))
+		return 0;
+	if (!WriteUserWord(endsAddr, readId) || !WriteUserWord(endsAddr + 4, writeId))
+	{
+		SysClose(readId);
+		SysClose(writeId);
+		return 0;
+	}
+	return 1;
+}
+
+// Everything written to any file, everything in the buffer cache and
+// every finished transaction go to disk, and into the disk's UNIX
+// file if it is mapped (-dm); on every mounted file system.
+void SysSync()
+{
+	kernel->mounts->Sync();
+}
+#endif // FILESYS_STUB
+// #endif // FILESYS_STUB
+
+#endif /* ! __USERPROG_KSYSCALL_H__ */
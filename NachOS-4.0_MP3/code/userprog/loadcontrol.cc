@@ -0,0 +1,207 @@
+// loadcontrol.cc
+//	Routines to suspend programs whose working sets do not fit in
+//	memory together, and to resume them once they do.  See
+//	loadcontrol.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "loadcontrol.h"
+#include "main.h"
+#include "addrspace.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// LoadControl::LoadControl
+// 	Start load control, with no program known yet, and fork the
+//	sampler thread.
+//
+//	"interval" -- ticks between samples of the working sets
+//----------------------------------------------------------------------
+
+LoadControl::LoadControl(int interval)
+{
+    Thread *t;
+
+    ASSERT(interval > 0);
+    sampleInterval = interval;
+    lock = new Lock("load control");
+    resumed = new Condition("program resumed");
+    admitted = new Condition("program admitted");
+    running = new List<LoadEntry *>;
+    suspended = new List<LoadEntry *>;
+    t = new Thread("load control", 1);
+    t->Fork((VoidFunctionPtr) LoadControl::Sampler, (void *) this);
+}
+
+LoadControl::~LoadControl()
+{
+    while (!running->IsEmpty())
+	delete running->RemoveFront();
+    while (!suspended->IsEmpty())
+	delete suspended->RemoveFront();
+    delete suspended;
+    delete running;
+    delete admitted;
+    delete resumed;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Find
+// 	Return what is known of "space", NULL if nothing is.  Called
+//	with the lock held.
+//----------------------------------------------------------------------
+
+LoadEntry *
+LoadControl::Find(AddrSpace *space)
+{
+    ListIterator<LoadEntry *> r(running);
+    ListIterator<LoadEntry *> s(suspended);
+
+    for (; !r.IsDone(); r.Next()) {
+	if (r.Item()->space == space)
+	    return r.Item();
+    }
+    for (; !s.IsDone(); s.Next()) {
+	if (s.Item()->space == space)
+	    return s.Item();
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// LoadControl::WaitIfSuspended
+// 	Called by a thread of "space" before its page fault is handled.
+//	A program not known yet is let run; the thread of one that is
+//	suspended waits until it is resumed.
+//----------------------------------------------------------------------
+
+void
+LoadControl::WaitIfSuspended(AddrSpace *space)
+{
+    LoadEntry *e;
+
+    lock->Acquire();
+    e = Find(space);
+    if (e == NULL) {
+	e = new LoadEntry;
+	e->space = space;
+	e->workingSet = 0;
+	e->suspended = FALSE;
+	running->Prepend(e);
+	admitted->Signal(lock);
+    }
+    while (e->suspended)
+	resumed->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Forget
+// 	"space" is being destroyed; it no longer counts.  Its threads
+//	are done, so none of them is waiting.
+//----------------------------------------------------------------------
+
+void
+LoadControl::Forget(AddrSpace *space)
+{
+    LoadEntry *e;
+
+    lock->Acquire();
+    e = Find(space);
+    if (e != NULL) {
+	if (e->suspended)
+	    suspended->Remove(e);
+	else
+	    running->Remove(e);
+	delete e;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Sample
+// 	Measure the working set of every program being let run, suspend
+//	the latest of them until the rest fit in memory (but never the
+//	last one), then resume suspended programs, earliest first, as
+//	long as each fits in what is left -- or if none is running.
+//----------------------------------------------------------------------
+
+void
+LoadControl::Sample()
+{
+    ListIterator<LoadEntry *> *it;
+    int total = 0;
+
+    lock->Acquire();
+    kernel->frameTable->Acquire();
+#ifdef USE_TLB
+    kernel->tlbManager->SyncBits();	// the use bits the TLB has set
+#endif
+    it = new ListIterator<LoadEntry *>(running);
+    for (; !it->IsDone(); it->Next()) {
+	LoadEntry *e = it->Item();
+
+	e->workingSet = e->space->SampleWorkingSet();
+	total += e->workingSet;
+    }
+    delete it;
+
+    while (total > NumPhysPages && running->NumInList() > 1) {
+	LoadEntry *e = running->RemoveFront();
+
+	DEBUG(dbgAddr, "Load control: suspending address space "
+		<< e->space->Asid() << ", working set " << e->workingSet
+		<< " of " << total << " pages");
+	e->suspended = TRUE;
+	suspended->Append(e);
+	total -= e->workingSet;
+	e->space->SwapOut();
+	kernel->stats->numSuspensions++;
+    }
+    while (!suspended->IsEmpty() && (running->IsEmpty()
+		|| total + suspended->Front()->workingSet <= NumPhysPages)) {
+	LoadEntry *e = suspended->RemoveFront();
+
+	DEBUG(dbgAddr, "Load control: resuming address space "
+		<< e->space->Asid() << ", working set " << e->workingSet);
+	e->suspended = FALSE;
+	running->Prepend(e);
+	total += e->workingSet;
+	resumed->Broadcast(lock);
+	kernel->stats->numResumptions++;
+    }
+    kernel->frameTable->Release();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// LoadControl::Sampler
+// 	The body of the sampler thread: while there are programs, sleep
+//	for the interval and take a sample.  It lives until Nachos halts.
+//
+//	"control" is the load control it works for
+//----------------------------------------------------------------------
+
+void
+LoadControl::Sampler(void *control)
+{
+    LoadControl *c = (LoadControl *) control;
+    Semaphore *tick = new Semaphore("load control tick", 0);
+
+    for (;;) {
+	Wakeup *w;
+
+	c->lock->Acquire();
+	while (c->running->IsEmpty() && c->suspended->IsEmpty())
+	    c->admitted->Wait(c->lock);
+	c->lock->Release();
+	w = kernel->alarm->SetWakeup(tick, c->sampleInterval);
+	tick->P();
+	kernel->alarm->CancelWakeup(w);
+	c->Sample();
+    }
+}
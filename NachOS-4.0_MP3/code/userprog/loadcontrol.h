@@ -0,0 +1,74 @@
+// loadcontrol.h
+//	Data structures for keeping the programs in memory from needing
+//	more frames than there are (-ws), so that running too many of them
+//	at once slows them down rather than having them all thrash.
+//
+//	Every so often, the sampler thread measures each program's
+//	working set: the pages of it in memory whose use bit was set since
+//	it last looked, which it clears, as the clock hand would.  If the
+//	working sets of the programs being let run add up to more than
+//	NumPhysPages, programs are suspended, the most recently let run
+//	first, until they fit: all of a suspended program's pages are
+//	evicted at once, and its threads wait at their next page fault
+//	until it is let run again.  Suspended programs are resumed, the
+//	one suspended longest first, as their last working set fits in
+//	what the others leave -- and one of them always is if nothing else
+//	is running, so that a program waiting for a suspended child cannot
+//	hold it out forever.
+//
+//	A program is known to load control from its first page fault; it
+//	is let run.  The sampler sleeps, with no timer set, while there
+//	are no programs, so that Nachos can still halt.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef LOADCONTROL_H
+#define LOADCONTROL_H
+
+#include "list.h"
+
+class AddrSpace;
+class Lock;
+class Condition;
+
+// The following class records what load control knows of a program.
+
+class LoadEntry {
+  public:
+    AddrSpace *space;			// the program
+    int workingSet;			// pages it used, last time it was
+					// looked at
+    bool suspended;			// are its threads kept waiting?
+};
+
+// The following class defines the load control of the programs.
+
+class LoadControl {
+  public:
+    LoadControl(int interval);		// Sample every "interval" ticks
+    ~LoadControl();
+
+    void WaitIfSuspended(AddrSpace *space);
+					// Before a page fault of "space" is
+					// handled: wait while it is
+					// suspended
+    void Forget(AddrSpace *space);	// "space" is going away
+
+  private:
+    int sampleInterval;			// ticks between samples
+    Lock *lock;				// protects everything below
+    Condition *resumed;			// broadcast as programs resume
+    Condition *admitted;		// signalled as a program is known
+    List<LoadEntry *> *running;		// let run, the latest first
+    List<LoadEntry *> *suspended;	// suspended, the earliest first
+
+    LoadEntry *Find(AddrSpace *space);	// NULL if it is not known
+    void Sample();			// measure, suspend and resume
+    static void Sampler(void *control);	// body of the sampler thread
+};
+
+#endif // LOADCONTROL_H
@@ -3,6 +3,12 @@
  *
  *     Basically, we only know about three types of segments:
  *	code (read-only), initialized data, and unitialized data
+ *
+ *     A segment may start anywhere in the file.  coff2noff starts each
+ *     one at the same offset within a page as it has in memory, so that
+ *     every page one segment covers is one aligned run of whole sectors,
+ *     which the kernel reads straight into the page's frame (see
+ *     AddrSpace::LoadPage).
  */
 
 #define NOFFMAGIC	0xbadfad 	/* magic number denoting Nachos 
@@ -0,0 +1,166 @@
+// proctable.cc
+//	Routines to keep track of the running user programs.  See
+//	proctable.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "proctable.h"
+#include "synch.h"
+
+static const int InitialProcesses = 16;	// entries to start out with
+
+//----------------------------------------------------------------------
+// ProcessTable::ProcessTable
+// 	Initialize a table with no programs in it.
+//----------------------------------------------------------------------
+
+ProcessTable::ProcessTable()
+{
+    lock = new Lock("process table lock");
+    exited = new Condition("process exited");
+    size = InitialProcesses;
+    procs = new Process[size];
+    for (int i = 0; i < size; i++)
+	procs[i].inUse = FALSE;
+    procs[0].inUse = TRUE;		// the kernel's
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::~ProcessTable
+// 	De-allocate the table.
+//----------------------------------------------------------------------
+
+ProcessTable::~ProcessTable()
+{
+    delete [] procs;
+    delete exited;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Add
+// 	Enter a new program in the table, and return its id: the lowest
+//	one that is free, the table being made twice as big if none is.
+//
+//	"parent" -- the id of the program starting it, or 0
+//----------------------------------------------------------------------
+
+int
+ProcessTable::Add(int parent)
+{
+    int pid;
+
+    lock->Acquire();
+    for (pid = 1; pid < size && procs[pid].inUse; pid++)
+	;
+    if (pid == size) {
+	Process *bigger = new Process[2 * size];
+
+	for (int i = 0; i < 2 * size; i++) {
+	    if (i < size)
+		bigger[i] = procs[i];
+	    else
+		bigger[i].inUse = FALSE;
+	}
+	delete [] procs;
+	procs = bigger;
+	size *= 2;
+	DEBUG(dbgAddr, "Process table grown to " << size);
+    }
+    procs[pid].inUse = TRUE;
+    procs[pid].parent = parent;
+    procs[pid].exited = FALSE;
+    procs[pid].exitStatus = 0;
+    lock->Release();
+    return pid;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Exit
+// 	Program "pid" is done, with exit status "status".  Its children
+//	will not be joined any more: those that are done leave the table,
+//	and the rest will when they are.  It stays, for its parent to
+//	join, unless it has none.
+//----------------------------------------------------------------------
+
+void
+ProcessTable::Exit(int pid, int status)
+{
+    lock->Acquire();
+    ASSERT(pid > 0 && pid < size && procs[pid].inUse && !procs[pid].exited);
+    for (int i = 1; i < size; i++) {
+	if (procs[i].inUse && procs[i].parent == pid) {
+	    if (procs[i].exited)
+		Free(i);
+	    else
+		procs[i].parent = 0;
+	}
+    }
+    procs[pid].exited = TRUE;
+    procs[pid].exitStatus = status;
+    if (procs[pid].parent == 0)
+	Free(pid);
+    else
+	exited->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Join
+// 	Wait for program "pid" to be done, and take it out of the table.
+//	Return its exit status, or -1 if it is not a child of "caller"
+//	that has not been joined yet.
+//----------------------------------------------------------------------
+
+int
+ProcessTable::Join(int pid, int caller)
+{
+    int status;
+
+    lock->Acquire();
+    if (pid <= 0 || pid >= size || !procs[pid].inUse
+		 || procs[pid].parent != caller) {
+	lock->Release();
+	return -1;
+    }
+    while (!procs[pid].exited)
+	exited->Wait(lock);
+    status = procs[pid].exitStatus;
+    Free(pid);
+    lock->Release();
+    return status;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::NumRunning
+// 	Return how many programs have been started and have not exited.
+//----------------------------------------------------------------------
+
+int
+ProcessTable::NumRunning()
+{
+    int count = 0;
+
+    lock->Acquire();
+    for (int pid = 1; pid < size; pid++) {
+	if (procs[pid].inUse && !procs[pid].exited)
+	    count++;
+    }
+    lock->Release();
+    return count;
+}
+
+//----------------------------------------------------------------------
+// ProcessTable::Free
+// 	Make "pid" free for a new program.  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+ProcessTable::Free(int pid)
+{
+    DEBUG(dbgAddr, "Process " << pid << " leaves the table");
+    procs[pid].inUse = FALSE;
+}
@@ -0,0 +1,62 @@
+// proctable.h
+//	Data structures to keep track of the user programs that are
+//	running, by their process id (the SpaceId of the system calls).
+//
+//	The table grows as programs are started, so there is no limit
+//	on how many may be run, and the id of a program that is gone is
+//	used again for the next one.  A program that exits before the
+//	program that started it has joined it stays in the table, with
+//	its exit status, until it is joined or its parent exits itself;
+//	a program started from the command line has no parent (its
+//	parent is 0, the kernel) and leaves the table as soon as it
+//	exits.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef PROCTABLE_H
+#define PROCTABLE_H
+
+class Lock;
+class Condition;
+
+// The following class records one user program.
+
+class Process {
+  public:
+    bool inUse;				// is this id taken?
+    int parent;				// id of the program that started
+					// it, 0 if none
+    bool exited;			// is it done?
+    int exitStatus;			// what it passed to Exit, once done
+};
+
+// The following class defines the table of user programs.  Id 0 is
+// never a program's.
+
+class ProcessTable {
+  public:
+    ProcessTable();			// Initialize an empty table
+    ~ProcessTable();			// De-allocate the table
+
+    int Add(int parent);		// Give a new program an id, the
+					// lowest free one
+    void Exit(int pid, int status);	// Program "pid" is done
+    int Join(int pid, int caller);	// Wait for child "pid" of "caller"
+					// to be done; its exit status, or
+					// -1 if it is not such a child
+    int NumRunning();			// How many programs are not done
+
+  private:
+    Lock *lock;				// protects everything below
+    Condition *exited;			// signalled as each program exits
+    Process *procs;			// indexed by process id
+    int size;				// entries in "procs"
+
+    void Free(int pid);			// Take "pid" out of the table
+};
+
+#endif // PROCTABLE_H
@@ -0,0 +1,157 @@
+// profiler.cc
+//	Routines to keep and report the sampling profile of user
+//	programs.  See profiler.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "profiler.h"
+#include "heap.h"
+#include "sysdep.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// PcProfile::PcProfile / ~PcProfile
+// 	Start with no samples of a program whose code is the first
+//	"codeSize" bytes of its address space; de-allocate them at the
+//	end.
+//----------------------------------------------------------------------
+
+PcProfile::PcProfile(char *programName, int codeSize)
+{
+    name = new char[strlen(programName) + 1];
+    strcpy(name, programName);
+    numWords = divRoundUp(codeSize, 4);
+    counts = new int[numWords];
+    for (int i = 0; i < numWords; i++)
+	counts[i] = 0;
+    numSamples = numOutside = 0;
+    reported = FALSE;
+}
+
+PcProfile::~PcProfile()
+{
+    delete [] name;
+    delete [] counts;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Profiler / ~Profiler
+// 	Create the report file; close it at the end.
+//----------------------------------------------------------------------
+
+Profiler::Profiler(char *fileName)
+{
+    fileNo = OpenForWrite(fileName);
+    live = new List<PcProfile *>;
+}
+
+Profiler::~Profiler()
+{
+    Close(fileNo);
+    delete live;			// the address spaces own the rest
+}
+
+//----------------------------------------------------------------------
+// Profiler::Start
+// 	Return an empty histogram for a new address space, running
+//	"programName" with "codeSize" bytes of code.
+//----------------------------------------------------------------------
+
+PcProfile *
+Profiler::Start(char *programName, int codeSize)
+{
+    PcProfile *profile = new PcProfile(programName, codeSize);
+
+    live->Append(profile);
+    return profile;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Finish
+// 	The address space of "profile" is going away: write it out, if
+//	that was not done at halt, and de-allocate it.
+//----------------------------------------------------------------------
+
+void
+Profiler::Finish(PcProfile *profile)
+{
+    live->Remove(profile);
+    if (!profile->reported)
+	Report(profile);
+    delete profile;
+}
+
+//----------------------------------------------------------------------
+// Profiler::FinishAll
+// 	Nachos is halting: write out the histogram of every address
+//	space there still is.  They are de-allocated with the spaces, if
+//	ever.
+//----------------------------------------------------------------------
+
+void
+Profiler::FinishAll()
+{
+    ListIterator<PcProfile *> it(live);
+
+    for (; !it.IsDone(); it.Next()) {
+	if (!it.Item()->reported) {
+	    Report(it.Item());
+	    it.Item()->reported = TRUE;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Profiler::Report
+// 	Append "profile" to the file, as described in profiler.h: the
+//	words of code that were ever sampled, the most often first.
+//	There can be one for each word of the program, so they are sorted
+//	with a heap rather than a sorted list.
+//----------------------------------------------------------------------
+
+class PcCount {
+  public:
+    int pc;
+    int count;
+};
+
+static int
+MoreSamples(PcCount *x, PcCount *y)
+{
+    if (x->count != y->count)
+	return y->count - x->count;
+    return x->pc - y->pc;
+}
+
+void
+Profiler::Report(PcProfile *profile)
+{
+    PairingHeap<PcCount *> sorted(MoreSamples);
+    char line[200];
+
+    DEBUG(dbgAddr, "Profile of " << profile->name << ": "
+		   << profile->numSamples << " samples");
+    for (int i = 0; i < profile->numWords; i++) {
+	if (profile->counts[i] > 0) {
+	    PcCount *entry = new PcCount;
+
+	    entry->pc = i * 4;
+	    entry->count = profile->counts[i];
+	    sorted.Insert(entry);
+	}
+    }
+    sprintf(line, "program %.150s samples %d outside %d\n", profile->name,
+	    profile->numSamples, profile->numOutside);
+    WriteFile(fileNo, line, strlen(line));
+    while (!sorted.IsEmpty()) {
+	PcCount *entry = sorted.RemoveFront();
+
+	sprintf(line, "0x%08x %d\n", entry->pc, entry->count);
+	WriteFile(fileNo, line, strlen(line));
+	delete entry;
+    }
+    WriteFile(fileNo, "end\n", 4);
+}
@@ -0,0 +1,78 @@
+// profiler.h
+//	Data structures for a sampling profile of user programs, when
+//	Nachos is run with -prof <file>.
+//
+//	Every ProfileInterval user instructions, the machine looks at the
+//	PC and counts it in the histogram of the running program: one
+//	count per word of its code.  When the program's address space goes
+//	away (or at halt, for those still running), the histogram is
+//	appended to the file as text:
+//
+//	   program <name> samples <n> outside <m>
+//	   <pc> <count>		-- in hex and decimal, the busiest first
+//	   end
+//
+//	"outside" counts PCs past the end of the code.  The PCs are the
+//	program's own addresses; test/profile.py maps them to functions
+//	with the symbols of the program's .coff.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "list.h"
+
+const int ProfileInterval = 64;		// user instructions between samples
+
+// The following class defines the histogram of one address space.
+
+class PcProfile {
+  public:
+    PcProfile(char *programName, int codeSize);
+					// Start with no samples of a program
+					// with "codeSize" bytes of code
+    ~PcProfile();			// De-allocate the histogram
+
+    void Sample(int pc) {		// Count the PC in the histogram
+	if (pc >= 0 && pc / 4 < numWords)
+	    counts[pc / 4]++;
+	else
+	    numOutside++;
+	numSamples++;
+    }
+
+    char *name;				// the program
+    int numWords;			// words of code
+    int *counts;			// samples of each of them
+    int numSamples;			// all of the samples
+    int numOutside;			// those past the code
+    bool reported;			// already written out, at halt
+};
+
+// The following class defines the file the profiles go to, and the
+// profiles of the address spaces that still exist.
+
+class Profiler {
+  public:
+    Profiler(char *fileName);		// Create the file
+    ~Profiler();			// Close it
+
+    PcProfile *Start(char *programName, int codeSize);
+					// A histogram for a new address space
+    void Finish(PcProfile *profile);	// Write it out, and de-allocate it
+    void FinishAll();			// At halt: write out every one
+					// still in use
+
+  private:
+    int fileNo;				// the report
+    List<PcProfile *> *live;		// the histograms in use
+
+    void Report(PcProfile *profile);	// Append it to the file
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,183 @@
+// reaper.cc
+//	Routines for taking apart the address spaces of exited programs
+//	in the background.  See reaper.h.
+//
+//	The lists are only touched with interrupts off, since
+//	ReclaimPending may run in any thread that needs a frame.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "reaper.h"
+#include "main.h"
+#include "addrspace.h"
+#include "swapspace.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// Reaper::Reaper
+// 	Start the reaper thread, with nothing to do yet.
+//----------------------------------------------------------------------
+
+Reaper::Reaper()
+{
+    queued = new List<AddrSpace *>;
+    reclaimed = new List<AddrSpace *>;
+    work = new Semaphore("reaper work", 0);
+    woken = FALSE;
+    numSpaces = numBatches = numFrames = numSlots = 0;
+
+    (new Thread("reaper", 1))->Fork(Reaper::ReaperThread, this);
+}
+
+//----------------------------------------------------------------------
+// Reaper::~Reaper
+// 	Nachos is halting.  Take apart the address spaces the reaper has
+//	not got to, while the frame table and the file system are still
+//	there, and say how much it did.  The reaper thread is left
+//	waiting; it is never run again.
+//----------------------------------------------------------------------
+
+Reaper::~Reaper()
+{
+    kernel->frameTable->Acquire();
+    ReclaimPending();
+    kernel->frameTable->Release();
+    DeleteReclaimed();
+    if (numSpaces > 0)
+	cout << "Reaper: " << numSpaces << " address spaces in "
+	     << numBatches << " passes, " << numFrames << " frames, "
+	     << numSlots << " swap slots\n";
+    delete work;
+    delete reclaimed;
+    delete queued;
+}
+
+//----------------------------------------------------------------------
+// Reaper::Queue
+// 	The last thread of a program is leaving, and has retired its
+//	address space: take it apart later.
+//----------------------------------------------------------------------
+
+void
+Reaper::Queue(AddrSpace *space)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    queued->Append(space);
+    Wake();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Reaper::Wake
+// 	Make sure the reaper thread will look at the lists again, without
+//	V'ing its semaphore more than once for one look.  Interrupts are
+//	off.
+//----------------------------------------------------------------------
+
+void
+Reaper::Wake()
+{
+    if (!woken) {
+	woken = TRUE;
+	work->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// Reaper::ReclaimPending
+// 	Give back the frames of every queued address space, and free
+//	all of their swap slots together, sorted; then leave them for the
+//	reaper thread to delete.  Return how many frames were given back.
+//	The frame table's lock must be held: by the reaper thread, or by
+//	a thread that found no frame free.
+//----------------------------------------------------------------------
+
+int
+Reaper::ReclaimPending()
+{
+    List<AddrSpace *> batch;
+    IntStatus oldLevel;
+    int *slots, count = 0, frames = 0, room = 0;
+
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    while (!queued->IsEmpty())
+	batch.Append(queued->RemoveFront());
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    if (batch.IsEmpty())
+	return 0;
+
+    for (ListIterator<AddrSpace *> it(&batch); !it.IsDone(); it.Next())
+	room += it.Item()->TableSize();
+    slots = new int[room];
+    for (ListIterator<AddrSpace *> it(&batch); !it.IsDone(); it.Next())
+	frames += it.Item()->Reclaim(slots, &count);
+    kernel->swapSpace->FreeMany(slots, count);
+    delete [] slots;
+
+    DEBUG(dbgAddr, "Reaped " << batch.NumInList() << " address spaces, "
+	  << frames << " frames, " << count << " swap slots");
+    numBatches++;
+    numFrames += frames;
+    numSlots += count;
+
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    while (!batch.IsEmpty())
+	reclaimed->Append(batch.RemoveFront());
+    Wake();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return frames;
+}
+
+//----------------------------------------------------------------------
+// Reaper::DeleteReclaimed
+// 	Delete the address spaces whose pages are gone: what is left of
+//	them is closing their files, and freeing their tables.
+//----------------------------------------------------------------------
+
+void
+Reaper::DeleteReclaimed()
+{
+    for (;;) {
+	IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+	AddrSpace *space = NULL;
+
+	if (!reclaimed->IsEmpty())
+	    space = reclaimed->RemoveFront();
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	if (space == NULL)
+	    break;
+	delete space;
+	numSpaces++;
+    }
+}
+
+//----------------------------------------------------------------------
+// Reaper::ReaperThread
+// 	The reaper thread; "data" is the Reaper.  Each time it is woken,
+//	it reclaims the pages of everything queued in one pass, then
+//	deletes what has been reclaimed, by it or by the frame table.
+//----------------------------------------------------------------------
+
+void
+Reaper::ReaperThread(void *data)
+{
+    Reaper *r = (Reaper *) data;
+
+    for (;;) {
+	IntStatus oldLevel;
+
+	r->work->P();
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	r->woken = FALSE;
+	(void) kernel->interrupt->SetLevel(oldLevel);
+
+	kernel->frameTable->Acquire();
+	r->ReclaimPending();
+	kernel->frameTable->Release();
+	r->DeleteReclaimed();
+    }
+}
@@ -0,0 +1,73 @@
+// reaper.h
+//	Data structures for taking apart the address spaces of programs
+//	that have exited in the background, several at a time (-reap).
+//
+//	Without it, the last thread of a program to leave gives back
+//	every frame and swap slot of the program itself, one at a time
+//	under the frame table's lock, and closes its files, before its
+//	parent can hear that it is gone.  With it, the thread only does
+//	what must be done before then -- writing back the regions it had
+//	mapped, and waiting for its requests at the disk (see AddrSpace::
+//	Retire) -- and hands the address space to the reaper thread.
+//
+//	The reaper takes every address space waiting for it at once: it
+//	takes the frame table's lock once for all of them, gives back
+//	their frames, and frees their swap slots together, in order of
+//	slot (see SwapSpace::FreeMany); then it deletes them, outside the
+//	lock.  So a burst of short programs exiting costs one pass, not
+//	one per program, and none of them waits for it.
+//
+//	Memory is never short because the reaper has not run yet: when no
+//	frame is free, the frame table reclaims the frames of the address
+//	spaces waiting for the reaper itself (see ReclaimPending) before
+//	it thinks of evicting a page.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef REAPER_H
+#define REAPER_H
+
+#include "list.h"
+
+class AddrSpace;
+class Semaphore;
+
+// The following class defines the reaper.
+
+class Reaper {
+  public:
+    Reaper();				// Start the reaper thread
+    ~Reaper();				// Take apart whatever is left, and
+					// say how it went
+
+    void Queue(AddrSpace *space);	// "space" has exited, and been
+					// retired: take it apart
+    int ReclaimPending();		// Give back the frames and swap
+					// slots of all queued address
+					// spaces now; return how many
+					// frames.  Frame table lock held
+
+  private:
+    List<AddrSpace *> *queued;		// waiting for their pages to go
+    List<AddrSpace *> *reclaimed;	// pages gone, waiting to be
+					// deleted (both with interrupts
+					// off)
+    Semaphore *work;			// V'ed when either list gets its
+    bool woken;				// first address space, if the
+					// reaper is not already awake
+
+    int numSpaces;			// address spaces taken apart
+    int numBatches;			// passes it took
+    int numFrames;			// frames given back
+    int numSlots;			// swap slots freed
+
+    void Wake();			// V "work", unless it is pending
+    void DeleteReclaimed();		// the rest of the teardown
+    static void ReaperThread(void *data);
+};
+
+#endif // REAPER_H
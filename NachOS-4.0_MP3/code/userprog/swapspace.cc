@@ -0,0 +1,295 @@
+// swapspace.cc
+//	Routines to manage the swap area.  See swapspace.h.
+//
+//	Slot "i" is the page at offset i * PageSize of the swap file.
+//	A slot whose page is in the pool has nothing good on disk: it
+//	was never written there, or has been written since.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "swapspace.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// SwapSpace::SwapSpace
+// 	Initialize a swap area with all of its slots free.  The file
+//	itself waits until it is needed.
+//
+//	"poolPages" -- how many pages' worth of bytes the pool of
+//		compressed pages holds; 0 for none
+//----------------------------------------------------------------------
+
+SwapSpace::SwapSpace(int poolPages)
+{
+    ASSERT(poolPages >= 0);
+    file = NULL;
+    slots = new Bitmap(NumSwapPages);
+    refs = new int[NumSwapPages];
+    poolSize = poolPages * PageSize;
+    poolUsed = 0;
+    packed = new char *[NumSwapPages];
+    packedLength = new int[NumSwapPages];
+    for (int i = 0; i < NumSwapPages; i++) {
+	packed[i] = NULL;
+	packedLength[i] = 0;
+    }
+    pooled = new List<int>;
+    codec = NULL;
+    scratch = NULL;
+    if (poolSize > 0) {
+	codec = new LzCodec;
+	scratch = new char[PageSize];
+    }
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::~SwapSpace
+// 	De-allocate the swap area, and remove the swap file from the
+//	disk.  The file system must still be around.
+//----------------------------------------------------------------------
+
+SwapSpace::~SwapSpace()
+{
+    if (file != NULL) {
+	delete file;
+	kernel->fileSystem->Remove(SwapFileName);
+    }
+    while (!pooled->IsEmpty())
+	Drop(pooled->Front());
+    delete pooled;
+    if (codec != NULL) {
+	delete codec;
+	delete [] scratch;
+    }
+    delete [] packedLength;
+    delete [] packed;
+    delete [] refs;
+    delete slots;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Allocate
+// 	Return a free slot, marking it in use by one page; -1 if swap
+//	is full.
+//----------------------------------------------------------------------
+
+int
+SwapSpace::Allocate()
+{
+    int slot = slots->FindAndSet();
+
+    if (slot != -1)
+	refs[slot] = 1;
+    return slot;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Share
+// 	Note that one more page (of a forked child) refers to "slot".
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Share(int slot)
+{
+    ASSERT(slots->Test(slot));
+    refs[slot]++;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Free
+// 	A page no longer refers to "slot"; give the slot back once no
+//	page does.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Free(int slot)
+{
+    ASSERT(slots->Test(slot) && refs[slot] > 0);
+    if (--refs[slot] == 0) {
+	Drop(slot);
+	slots->Clear(slot);
+    }
+}
+
+//----------------------------------------------------------------------
+// CompareSlots
+//	For sorting slots by number, with qsort.
+//----------------------------------------------------------------------
+
+static int
+CompareSlots(const void *x, const void *y)
+{
+    return *(const int *) x - *(const int *) y;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::FreeMany
+// 	Free "count" slots at once, as Free would one at a time: those
+//	of the address spaces the reaper takes apart together.  They are
+//	sorted first and freed in order, so the same slot (shared after a
+//	Fork) comes up in a run; and the pool is swept once for all of
+//	the slots that go, instead of once for each compressed page in
+//	it that Drop takes out.
+//
+//	"toFree" -- the slots, in any order; it is sorted in place
+//----------------------------------------------------------------------
+
+void
+SwapSpace::FreeMany(int *toFree, int count)
+{
+    int numDropped = 0;
+
+    qsort(toFree, count, sizeof(int), CompareSlots);
+    for (int i = 0; i < count; i++) {
+	int slot = toFree[i];
+
+	ASSERT(slots->Test(slot) && refs[slot] > 0);
+	if (--refs[slot] > 0)
+	    continue;
+	slots->Clear(slot);
+	if (packed[slot] != NULL) {
+	    poolUsed -= packedLength[slot];
+	    delete [] packed[slot];
+	    packed[slot] = NULL;
+	    packedLength[slot] = 0;
+	    numDropped++;
+	}
+    }
+    if (numDropped > 0) {
+	List<int> *kept = new List<int>;
+
+	while (!pooled->IsEmpty()) {
+	    int slot = pooled->RemoveFront();
+
+	    if (packed[slot] != NULL)
+		kept->Append(slot);
+	}
+	delete pooled;
+	pooled = kept;
+    }
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Write
+// 	Write the page at "from" to "slot": into the pool, if there is
+//	one and the page compresses well enough, making room for it if
+//	need be; otherwise to disk.  Return FALSE if it went to disk and
+//	the disk has no room for it.
+//----------------------------------------------------------------------
+
+bool
+SwapSpace::Write(int slot, char *from)
+{
+    int length;
+
+    ASSERT(slots->Test(slot) && refs[slot] == 1);
+    Drop(slot);				// what it held is stale
+    if (poolSize > 0) {
+	length = codec->Compress(from, PageSize, scratch, PageSize / 2);
+	if (length != -1 && MakeRoom(length)) {
+	    DEBUG(dbgAddr, "Pooling swap slot " << slot << ", "
+		  << length << " bytes");
+	    packed[slot] = new char[length];
+	    bcopy(scratch, packed[slot], length);
+	    packedLength[slot] = length;
+	    poolUsed += length;
+	    pooled->Append(slot);
+	    kernel->stats->numSwapPooled++;
+	    return TRUE;
+	}
+    }
+    return WriteFile(slot, from);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::WriteFile
+// 	Write the page at "from" to "slot" on disk, creating the swap
+//	file if this is the first page to go out.  A stale swap file,
+//	left by an earlier run that did not halt cleanly, is thrown away
+//	first.  Return FALSE if the disk has no room for it.
+//----------------------------------------------------------------------
+
+bool
+SwapSpace::WriteFile(int slot, char *from)
+{
+    if (file == NULL) {
+	kernel->fileSystem->Remove(SwapFileName);
+#ifdef FILESYS_STUB
+	if (!kernel->fileSystem->Create(SwapFileName))
+#else
+	if (!kernel->fileSystem->Create(SwapFileName, 0))
+#endif
+	    return FALSE;
+	file = kernel->fileSystem->Open(SwapFileName);
+	ASSERT(file != NULL);
+    }
+    DEBUG(dbgAddr, "Writing swap slot " << slot);
+    return file->WriteAt(from, PageSize, slot * PageSize) == PageSize;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Read
+// 	Read the page in "slot" into "into".
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Read(int slot, char *into)
+{
+    ASSERT(slots->Test(slot));
+    if (packed[slot] != NULL) {
+	DEBUG(dbgAddr, "Unpooling swap slot " << slot);
+	if (!LzCodec::Decompress(packed[slot], packedLength[slot], into,
+				 PageSize))
+	    ASSERTNOTREACHED();		// the pool was overwritten
+	kernel->stats->numSwapPoolHits++;
+	return;
+    }
+    ASSERT(file != NULL);
+    DEBUG(dbgAddr, "Reading swap slot " << slot);
+    file->ReadAt(into, PageSize, slot * PageSize);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::MakeRoom
+// 	Write the pages that have been in the pool longest out to their
+//	slots on disk, until "length" more bytes fit in it.  Return
+//	FALSE if the disk is full first.  The slot of a page written out
+//	may be shared after a Fork; its page is the same for all.
+//----------------------------------------------------------------------
+
+bool
+SwapSpace::MakeRoom(int length)
+{
+    while (poolUsed + length > poolSize && !pooled->IsEmpty()) {
+	int slot = pooled->Front();
+
+	if (!LzCodec::Decompress(packed[slot], packedLength[slot], scratch,
+				 PageSize))
+	    ASSERTNOTREACHED();
+	if (!WriteFile(slot, scratch))
+	    return FALSE;
+	Drop(slot);
+	kernel->stats->numSwapPoolWritebacks++;
+    }
+    return poolUsed + length <= poolSize;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Drop
+// 	Take "slot"'s compressed page, if it has one, out of the pool.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Drop(int slot)
+{
+    if (packed[slot] == NULL)
+	return;
+    pooled->Remove(slot);
+    poolUsed -= packedLength[slot];
+    delete [] packed[slot];
+    packed[slot] = NULL;
+    packedLength[slot] = 0;
+}
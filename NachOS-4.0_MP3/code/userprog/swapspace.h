@@ -0,0 +1,92 @@
+// swapspace.h
+//	Data structures for the swap area: where pages of user programs
+//	go when their frame is taken away from them and they have been
+//	changed since they were read in.
+//
+//	The swap area is an ordinary file on the Nachos disk, divided into
+//	page-sized slots.  It is only created once the first page has to
+//	be written out, starts out empty and grows as slots are used, so
+//	programs that fit in memory cost no disk space at all.  It is
+//	removed again when Nachos halts.
+//
+//	A page keeps its slot while its program runs, even after it is
+//	read back in: as long as the page stays clean, the copy in swap is
+//	still good, and evicting it again costs nothing.
+//
+//	After a Fork, parent and child share the slots of the pages they
+//	share, so slots are reference counted.  A shared slot is never
+//	written: a page that changed gets a slot of its own.
+//
+//	With -zs, a page written to a slot is first compressed into a
+//	pool in kernel memory of that many pages' worth of bytes, and
+//	stays there instead of going to disk; reading it back is just
+//	decompressing it.  Only when the pool is full are the pages that
+//	have been in it longest written out to their slots on disk, to
+//	make room.  A page that will not compress to half its size goes
+//	straight to disk.  So a program that does not fit in memory by a
+//	little swaps without waiting for the disk at all.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef SWAPSPACE_H
+#define SWAPSPACE_H
+
+#include "bitmap.h"
+#include "list.h"
+#include "openfile.h"
+#include "lzcodec.h"
+
+#define SwapFileName	"swap"		// name of the swap file
+const int NumSwapPages = 512;		// slots in the swap area
+
+// The following class defines the swap area.  It does no
+// synchronization itself; it is only used with the frame table's
+// lock held.
+
+class SwapSpace {
+  public:
+    SwapSpace(int poolPages);		// Initialize an empty swap area,
+					// with a pool of "poolPages" pages
+					// of compressed ones
+    ~SwapSpace();			// Remove the swap file, if any
+
+    int Allocate();			// Return a free slot, or -1
+    void Share(int slot);		// One more page refers to a slot
+    void Free(int slot);		// One less; free it at none
+    void FreeMany(int *toFree, int count); // The same, for many slots
+					// at once; sorts "toFree"
+    bool IsShared(int slot) { return refs[slot] > 1; }
+
+    bool Write(int slot, char *from);	// Write a page to a slot; FALSE
+					// if the disk is full
+    void Read(int slot, char *into);	// Read a page back from its slot
+
+  private:
+    OpenFile *file;			// the swap file; NULL until the
+					// first page is written
+    Bitmap *slots;			// which slots are in use
+    int *refs;				// how many pages refer to each
+
+    int poolSize;			// bytes the pool may hold; 0 for
+					// no pool
+    int poolUsed;			// bytes it does hold
+    char **packed;			// the compressed page of each slot,
+					// NULL if it is not in the pool
+    int *packedLength;			// and how long it is
+    List<int> *pooled;			// the slots in the pool, the one
+					// that has been there longest first
+    LzCodec *codec;			// compresses pages into the pool
+    char *scratch;			// a page being compressed, or
+					// written out of the pool
+
+    bool WriteFile(int slot, char *from); // Write a page to disk
+    bool MakeRoom(int length);		// Write pages out of the pool until
+					// "length" more bytes fit in it
+    void Drop(int slot);		// Forget the slot's compressed page
+};
+
+#endif // SWAPSPACE_H
@@ -8,6 +8,7 @@
 
 #include "copyright.h"
 #include "synchconsole.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // SynchConsoleInput::SynchConsoleInput
@@ -22,6 +23,10 @@ SynchConsoleInput::SynchConsoleInput(char *inputFile)
     consoleInput = new ConsoleInput(inputFile, this);
     lock = new Lock("console in");
     waitFor = new Semaphore("console in", 0);
+    head = 0;
+    numQueued = 0;
+    atEnd = FALSE;
+    readerWaiting = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -39,30 +44,140 @@ SynchConsoleInput::~SynchConsoleInput()
 //----------------------------------------------------------------------
 // SynchConsoleInput::GetChar
 //      Read a character typed at the keyboard, waiting if necessary.
+//	Return EOF once the keyboard has no more, and all it gave has
+//	been read.
 //----------------------------------------------------------------------
 
 char
 SynchConsoleInput::GetChar()
 {
-    char ch;
+    IntStatus oldLevel;
+    char ch = EOF;
 
     lock->Acquire();
-    waitFor->P();	// wait for EOF or a char to be available.
-    ch = consoleInput->GetChar();
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    while (numQueued == 0 && !atEnd)
+	WaitForInput();		// wait for EOF or a char to be available.
+    if (numQueued > 0) {
+	ch = buffer[head];
+	head = (head + 1) % ConsoleBufferSize;
+	numQueued--;
+	TakeIn();
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
     lock->Release();
     return ch;
 }
 
+//----------------------------------------------------------------------
+// SynchConsoleInput::ReadLine
+//      Read the characters typed at the keyboard up to the end of the
+//	next line, the newline included, into "into": at most "size" of
+//	them, and fewer if the ring fills up without a newline (a line
+//	longer than ConsoleBufferSize comes in pieces).  Wait until they
+//	are there.  Return how many were read: 0 once the keyboard has
+//	no more, and all it gave has been read.
+//----------------------------------------------------------------------
+
+int
+SynchConsoleInput::ReadLine(char *into, int size)
+{
+    IntStatus oldLevel;
+    int count = 0;
+
+    if (size <= 0)
+	return 0;
+    lock->Acquire();
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    while (!HasLine(size) && !atEnd)
+	WaitForInput();
+    while (count < size && numQueued > 0) {
+	char ch = buffer[head];
+
+	into[count++] = ch;
+	head = (head + 1) % ConsoleBufferSize;
+	numQueued--;
+	if (ch == '\n')
+	    break;
+    }
+    TakeIn();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    lock->Release();
+    return count;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleInput::HasLine
+//      Return TRUE if a ReadLine of "size" characters would not have to
+//	wait: the ring holds a newline, "size" characters, or is full.
+//----------------------------------------------------------------------
+
+bool
+SynchConsoleInput::HasLine(int size)
+{
+    if (numQueued >= size || numQueued == ConsoleBufferSize)
+	return TRUE;
+    for (int i = 0; i < numQueued; i++) {
+	if (buffer[(head + i) % ConsoleBufferSize] == '\n')
+	    return TRUE;
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleInput::WaitForInput
+//      Wait until the keyboard has delivered something more, or ended.
+//	Called with interrupts off, so it cannot come in between the
+//	reader finding the ring short and going to sleep.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleInput::WaitForInput()
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    readerWaiting = TRUE;
+    waitFor->P();
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleInput::TakeIn
+//      Move what the keyboard has delivered into the ring, up to the
+//	room there is: in two pieces, if the free part of the ring wraps
+//	around.  Note whether the keyboard has ended.  Called with
+//	interrupts off.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleInput::TakeIn()
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    while (numQueued < ConsoleBufferSize) {
+	int tail = (head + numQueued) % ConsoleBufferSize;
+	int room = min(ConsoleBufferSize - numQueued, ConsoleBufferSize - tail);
+	int count = consoleInput->GetChars(&buffer[tail], room);
+
+	if (count == 0)
+	    break;
+	numQueued += count;
+    }
+    if (consoleInput->AtEnd())
+	atEnd = TRUE;
+}
+
 //----------------------------------------------------------------------
 // SynchConsoleInput::CallBack
-//      Interrupt handler called when keystroke is hit; wake up
-//	anyone waiting.
+//      Interrupt handler called when keystrokes arrive, or the keyboard
+//	ends; take them in, and wake up the reader waiting, if any.
 //----------------------------------------------------------------------
 
 void
 SynchConsoleInput::CallBack()
 {
-    waitFor->V();
+    TakeIn();
+    if (readerWaiting) {
+	readerWaiting = FALSE;
+	waitFor->V();
+    }
 }
 
 //----------------------------------------------------------------------
@@ -78,6 +193,10 @@ SynchConsoleOutput::SynchConsoleOutput(char *outputFile)
     consoleOutput = new ConsoleOutput(outputFile, this);
     lock = new Lock("console out");
     waitFor = new Semaphore("console out", 0);
+    head = 0;
+    numQueued = 0;
+    numWriting = 0;
+    writerWaiting = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -100,10 +219,7 @@ SynchConsoleOutput::~SynchConsoleOutput()
 void
 SynchConsoleOutput::PutChar(char ch)
 {
-    lock->Acquire();
-    consoleOutput->PutChar(ch);
-    waitFor->P();
-    lock->Release();
+    PutChars(&ch, 1);
 }
 
 
@@ -115,21 +231,121 @@ SynchConsoleOutput::PutChar(char ch)
 void
 SynchConsoleOutput::PutInt(char *converted_int, int size)
 {
+    PutChars(converted_int, size);
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::PutChars
+//      Queue "size" characters for the console display, waiting only if
+//	the buffer fills up.  If they include a newline, start writing
+//	them out.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::PutChars(char *buf, int size)
+{
+    IntStatus oldLevel;
+    bool newline = FALSE;
+
     lock->Acquire();
-    consoleOutput->PutInt(converted_int, size);
-    waitFor->P();
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    for (int i = 0; i < size; i++) {
+	Queue(buf[i]);
+	if (buf[i] == '\n')
+	    newline = TRUE;
+    }
+    if (newline)
+	StartWrite();
+    (void) kernel->interrupt->SetLevel(oldLevel);
     lock->Release();
 }
 
+//----------------------------------------------------------------------
+// SynchConsoleOutput::Flush
+//      Start writing out whatever is queued, without waiting for it.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::Flush()
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    StartWrite();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::FlushAtHalt
+//      Write out everything queued that the display has not been given
+//	yet, straight away: Nachos is halting, and will not wait for the
+//	display any more.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::FlushAtHalt()
+{
+    int start = (head + numWriting) % ConsoleBufferSize;
+    int left = numQueued - numWriting;
+    int chunk = min(left, ConsoleBufferSize - start);
+
+    consoleOutput->PutCharsNow(&buffer[start], chunk);
+    consoleOutput->PutCharsNow(buffer, left - chunk);
+    numQueued = numWriting;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::Queue
+//      Add "ch" at the end of the ring, first waiting for the display to
+//	make room if it is full.  Called with interrupts off, so the
+//	display's interrupt cannot come in between.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::Queue(char ch)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    while (numQueued == ConsoleBufferSize) {
+	StartWrite();
+	writerWaiting = TRUE;
+	waitFor->P();
+    }
+    buffer[(head + numQueued) % ConsoleBufferSize] = ch;
+    numQueued++;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::StartWrite
+//      If the display is idle and there is something that it has not
+//	been given yet, give it all of that up to the end of the ring.
+//	Called with interrupts off.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::StartWrite()
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (numWriting > 0 || numQueued == 0)
+	return;
+    numWriting = min(numQueued, ConsoleBufferSize - head);
+    consoleOutput->PutChars(&buffer[head], numWriting);
+}
 
 //----------------------------------------------------------------------
 // SynchConsoleOutput::CallBack
-//      Interrupt handler called when it's safe to send the next 
-//	character can be sent to the display.
+//      Interrupt handler called when the display has written out a
+//	chunk.  Drop it from the ring, wake a writer waiting for room,
+//	and keep going with whatever has been queued since.
 //----------------------------------------------------------------------
 
 void
 SynchConsoleOutput::CallBack()
 {
-    waitFor->V();
+    head = (head + numWriting) % ConsoleBufferSize;
+    numQueued -= numWriting;
+    numWriting = 0;
+    if (writerWaiting) {
+	writerWaiting = FALSE;
+	waitFor->V();
+    }
+    StartWrite();
 }
@@ -2,6 +2,22 @@
 //	Data structures for synchronized access to the keyboard
 //	and console display devices.
 //
+//	Output is buffered: characters are queued in a ring buffer of
+//	ConsoleBufferSize, and only written out to the display at a
+//	newline, when the buffer fills up, on Flush, or as Nachos halts.
+//	The display then takes them a chunk at a time -- as many as are
+//	queued, up to the end of the buffer -- with one interrupt per
+//	chunk, and goes on until the buffer is empty.  A writer only waits
+//	if the buffer is full.
+//
+//	Input is buffered the same way: whatever the keyboard delivers is
+//	taken into a ring of ConsoleBufferSize by the interrupt handler,
+//	however many characters that is (see ConsoleInput).  A reader
+//	takes a character at a time with GetChar, or a whole line at
+//	once with ReadLine, and only waits if what it wants is not there
+//	yet.  When the ring is full, the keyboard is left holding what it
+//	has, and not polled, until a reader makes room.
+//
 //	NOTE: this abstraction is not completely implemented.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
@@ -17,6 +33,8 @@
 #include "console.h"
 #include "synch.h"
 
+const int ConsoleBufferSize = 256;	// characters of output queued, at most
+
 // The following two classes define synchronized input and output to
 // a console device
 
@@ -26,12 +44,27 @@ class SynchConsoleInput : public CallBackObj {
     ~SynchConsoleInput();		// Deallocate console device
 
     char GetChar();		// Read a character, waiting if necessary
+    int ReadLine(char *into, int size);
+				// Read up to the end of a line, at most
+				// "size" characters, waiting if necessary
     
   private:
     ConsoleInput *consoleInput;	// the hardware keyboard
     Lock *lock;			// only one reader at a time
     Semaphore *waitFor;		// wait for callBack
+    char buffer[ConsoleBufferSize];
+				// the ring of characters typed, not
+				// read yet
+    int head;			// where the oldest one is
+    int numQueued;		// how many there are
+    bool atEnd;			// has the keyboard no more to give?
+    bool readerWaiting;		// is a reader waiting for more?
 
+    void TakeIn();		// move what the keyboard has into the
+				// ring, as far as it has room;
+				// interrupts must be off
+    bool HasLine(int size);	// is there a line, or "size" characters?
+    void WaitForInput();	// wait for the keyboard; interrupts off
     void CallBack();		// called when a keystroke is available
 };
 
@@ -42,11 +75,29 @@ class SynchConsoleOutput : public CallBackObj {
 
     void PutChar(char ch);	// Write a character, waiting if necessary
     void PutInt(char *converted_int, int size);	// Write a converted integer string, waiting if necessary
+    void PutChars(char *buf, int size);
+				// Write "size" characters, waiting if
+				// necessary
+    void Flush();		// Start writing out what is queued
+    void FlushAtHalt();		// Write it all out right away
+
   private:
     ConsoleOutput *consoleOutput;// the hardware display
     Lock *lock;			// only one writer at a time
-    Semaphore *waitFor;		// wait for callBack
+    Semaphore *waitFor;		// wait for callBack, when full
+    char buffer[ConsoleBufferSize];
+				// the ring of characters queued
+    int head;			// where the oldest one is
+    int numQueued;		// how many, including those being
+				// written out
+    int numWriting;		// how many of them the display is
+				// writing now, from "head" on
+    bool writerWaiting;		// is a writer waiting for room?
 
+    void Queue(char ch);	// add a character, waiting for room;
+				// interrupts must be off
+    void StartWrite();		// give the display its next chunk,
+				// unless it is busy; interrupts off
     void CallBack();		// called when more data can be written
 };
 
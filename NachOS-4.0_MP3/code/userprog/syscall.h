@@ -35,7 +35,42 @@
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
 #define SC_PrintInt     16
+#define SC_ReadV        17
+#define SC_WriteV       18
+#define SC_Submit       19
+#define SC_Mmap         20
+#define SC_Munmap       21
+#define SC_Fork         22
+#define SC_ChDir        23
+#define SC_PrintString  24
+#define SC_GetTicks     25
+#define SC_GetTimes     26
+#define SC_Fsync        27
+#define SC_Sync         28
+#define SC_ReadDir      29
+#define SC_Ftruncate    30
+#define SC_Fallocate    31
+#define SC_RemoveTree   32
+#define SC_Rename       33
+#define SC_CopyFile     34
+#define SC_CopyRange    35
+#define SC_Pread        36
+#define SC_Pwrite       37
+#define SC_Fadvise      38
+#define SC_AioRead      39
+#define SC_AioWrite     40
+#define SC_AioComplete  41
 #define SC_Add		    42
+#define SC_Pipe         43
+#define SC_Sleep        44
+#define SC_FutexWait    45
+#define SC_FutexWake    46
+#define SC_SetTickets   47
+#define SC_GetFileIo    48
+#define SC_CreateMany   49
+#define SC_Stat         50
+#define SC_ReadConsole  51
+#define SC_LockRange    52
 #define SC_MSG		    100
 
 #ifndef IN_ASM
@@ -58,6 +93,79 @@ void Halt();
  */
 void PrintInt(int val);
 
+/*
+ * Output the "size" characters of "buffer" to the console, with one
+ * system call.  Return the number written, fewer only if part of
+ * "buffer" is not mapped.
+ */
+int PrintString(char *buffer, int size);
+
+/*
+ * Read a line typed at the console into "buffer", the newline
+ * included, with one system call: at most "size" characters, fewer
+ * than that without a newline only for a line longer than the
+ * kernel's buffer.  Wait until the line has been typed.  Return the
+ * number read, 0 at the end of the input, or -1 if "buffer" is not
+ * mapped.  The buffer is not NUL-terminated.
+ */
+int ReadConsole(char *buffer, int size);
+
+/*
+ * Return the simulated time, in ticks since Nachos started: take the
+ * difference of two calls to time something.  The kernel's clock is
+ * 64 bits, and this is only its low 32, so it wraps in a long run; a
+ * difference is still right if it is less than 2^31 ticks.
+ */
+int GetTicks();
+
+/* Wait for at least "ticks" ticks of simulated time, as GetTicks counts
+ * them, without running; the machine counts the time as idle if no
+ * one else has anything to do.  Sleep(0) only lets others run.
+ */
+void Sleep(int ticks);
+
+/* Wait on the word at "addr", a lock or semaphore kept in user memory,
+ * if it still holds "value": the check and the going to sleep are one
+ * step, so a FutexWake after the program saw "value" is not missed.
+ * Return 0 once woken by FutexWake, -1 at once if the word holds
+ * another value (look again) or "addr" is not a word of the program.
+ * Only threads of one program share memory, so only they can meet on
+ * a word.
+ */
+int FutexWait(int *addr, int value);
+
+/* Wake up to "count" of the threads waiting on the word at "addr",
+ * those that have waited longest first.  Return how many were woken.
+ */
+int FutexWake(int *addr, int count);
+
+/* Give the calling thread "tickets" tickets, 1 to 10000 (it starts with
+ * 100).  Under the stride scheduler (-sched stride), threads that all
+ * want the CPU get it in proportion to their tickets; the shares they
+ * asked for and got are printed at halt.  Return 0, or -1 if "tickets"
+ * is out of range.
+ */
+int SetTickets(int tickets);
+
+/* Where the time has gone, for GetTimes.  "totalTicks" is the
+ * simulated clock, as from GetTicks; the rest are the calling
+ * program's own: the ticks it has spent running user code and in the
+ * kernel, and the disk sectors read and written for it.  The times
+ * are the low 32 bits of the kernel's, as for GetTicks.
+ */
+typedef struct {
+    int totalTicks;
+    int userTicks;
+    int systemTicks;
+    int diskReads;
+    int diskWrites;
+} Times;
+
+/* Fill in "times", with one system call.  Return 1 on success, 0 if
+ * "times" could not be written.
+ */
+int GetTimes(Times *times);
+
 /*
  * Add the two operants and return the result
  */ 
@@ -89,9 +197,22 @@ SpaceId Exec(char* exec_name);
  * address space identifier
  */
 SpaceId ExecV(int argc, char* argv[]);
+
+/* Make a copy of the calling program, which runs from the same point
+ * on.  The copy starts out sharing the caller's memory, and each page
+ * is only copied when one of them first writes to it.  Mapped files
+ * and open files are not passed on to the copy; the ends of pipes are,
+ * with the same OpenFileIds.  Return 0 in the
+ * copy, and the copy's SpaceId in the caller; -1 if it could not be
+ * made.
+ */
+SpaceId Fork();
  
 /* Only return once the user program "id" has finished.  
- * Return the exit status.
+ * Return the exit status.  "id" must be a program that the caller
+ * started, and has not joined already; if not, return -1.  The id of
+ * a program that has been joined, or whose parent has exited, may be
+ * given to a new program.
  */
 int Join(SpaceId id); 	
  
@@ -125,6 +246,31 @@ int Create(char *name, int size);
 /* Remove a Nachos file, with name "name" */
 int Remove(char *name);
 
+/* Remove the Nachos file or directory "name", and everything under it.
+ * Return 1 on success, 0 if there is no such file or directory.
+ */
+int RemoveTree(char *name);
+
+/* Give the Nachos file or directory "from" the name "to", which may be
+ * in another directory; "to" must not exist yet.  Only the directory
+ * entry moves, so files open on it stay open.  Return 1 on success,
+ * 0 on failure.
+ */
+int Rename(char *from, char *to);
+
+/* Make the new Nachos file "to" a copy of the file "from", without the
+ * bytes passing through the program.  The copy shares the sectors of
+ * "from" until either is written, if it can.  Return 1 on success, 0
+ * if "from" is not a file, "to" exists, or the disk is full.
+ */
+int CopyFile(char *from, char *to);
+
+/* Make the Nachos directory "name" the working directory, which names
+ * not starting with "/" are relative to.  A forked program starts in
+ * its parent's.  Return 1 on success, 0 if there is no such directory.
+ */
+int ChDir(char *name);
+
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
  * be used to read and write to the file.
  */
@@ -146,23 +292,272 @@ int Read(char *buffer, int size, OpenFileId id);
 
 /* Set the seek position of the open file "id"
  * to the byte "position".
+ * Return 1 on success, 0 if "id" is not open or "position" is negative.
  */
 int Seek(int position, OpenFileId id);
 
+/* Read or write "size" bytes of the open file "id", like Read and
+ * Write, but at file offset "position": the seek position is neither
+ * used nor moved, so threads sharing "id" can each go their own way.
+ * Return the number of bytes transferred, 0 if "id" is not open or
+ * "position" is negative.
+ */
+int Pread(char *buffer, int size, int position, OpenFileId id);
+int Pwrite(char *buffer, int size, int position, OpenFileId id);
+
+/* Start reading or writing "size" bytes of the open file "id" at file
+ * offset "position", like Pread and Pwrite, and return at once with
+ * the id of the request (a positive number), without waiting for the
+ * disk.  The program may go on computing, or start more requests; it
+ * must not touch "buffer" until it has collected the request with
+ * AioComplete.  Return -1 if "id" is not open, "size" is not between 1
+ * and 4096, or the program already has 8 requests not collected.
+ */
+int AioRead(char *buffer, int size, int position, OpenFileId id);
+int AioWrite(char *buffer, int size, int position, OpenFileId id);
+
+/* Collect a request started by AioRead or AioWrite that is done, the
+ * one that finished first: for a read, its bytes are now in its buffer.
+ * Store how many bytes it transferred in "*result", and return its
+ * id.  If none is done yet, wait for one if "wait" is not 0, else
+ * return 0 (to poll).  Return -1 if the program has none outstanding.
+ */
+int AioComplete(int *result, int wait);
+
+/* Make a pipe, and store the OpenFileIds of its two ends in "ends":
+ * what is written to ends[1] with Write can be read from ends[0] with
+ * Read, by this program or by the copies Fork makes of it.  A Read
+ * waits until there is something to read, and returns 0 once the pipe
+ * is empty and every descriptor for ends[1] is closed; a Write waits
+ * until all of its bytes are in the pipe, or every descriptor for
+ * ends[0] is closed.
+ * Return 1 on success, 0 if there are not two descriptors free or
+ * "ends" cannot be written.
+ */
+int Pipe(OpenFileId *ends);
+
 /* Close the file, we're done reading and writing to it.
  * Return 1 on success, negative error code on failure
  */
 int Close(OpenFileId id);
 
+/* Make sure everything written to the open file "id" is on disk, not
+ * just in the kernel's caches.
+ * Return 1 on success, 0 if "id" is not open.
+ */
+int Fsync(OpenFileId id);
+
+/* What has been read from and written to a file, by every program and
+ * every open of it since it was created: the bytes, the disk sectors
+ * read and written for them, the sector reads and writes found in the
+ * kernel's buffer cache, and the runs of consecutive disk sectors
+ * those went to.
+ */
+typedef struct {
+    int bytesRead;
+    int bytesWritten;
+    int sectorReads;
+    int sectorWrites;
+    int cacheHits;
+    int runs;
+} FileIo;
+
+/* Fill in "io" for the open file "id".  Return 1 on success, 0 if
+ * "id" is not open or "io" could not be written.
+ */
+int GetFileIo(OpenFileId id, FileIo *io);
+
+/* The same for every file, and for every change to the file system.
+ */
+void Sync();
+
+/* Make the open file "id" "length" bytes long.  What was past the new
+ * end is thrown away; if the file grows, the new bytes read as zeroes.
+ * Return 1 on success, 0 if "id" is not open, "length" is negative, or
+ * the disk is full.
+ */
+int Ftruncate(OpenFileId id, int length);
+
+/* Set aside disk space for the "length" bytes of the open file "id"
+ * from "offset" on, making the file longer if they go past its end,
+ * so that writing them later cannot run out of space.  Nothing is
+ * written: the bytes read the same as before, and new ones as zeroes.
+ * Return 1 on success, 0 if "id" is not open, the range is bad, or
+ * the disk is full.
+ */
+int Fallocate(OpenFileId id, int offset, int length);
+
+/* Say how the open file "id" will be used, so that the kernel can read
+ * ahead, and keep in its cache, what the program will want:
+ *   FadviseNormal, FadviseSequential, FadviseRandom -- the file will
+ *	be read in no particular way, scanned from start to end (what
+ *	has been read is dropped first from the cache), or at random
+ *	(nothing is read ahead); "offset" and "length" are not used.
+ *   FadviseWillNeed -- the "length" bytes from "offset" on will be
+ *	read soon: start reading them in.
+ *   FadviseDontNeed -- they will not be read again soon: drop them
+ *	first from the cache.
+ * Return 1 on success, 0 if "id" is not open or the advice not valid.
+ */
+#define FadviseNormal	  0
+#define FadviseSequential 1
+#define FadviseRandom	  2
+#define FadviseWillNeed	  3
+#define FadviseDontNeed	  4
+
+int Fadvise(OpenFileId id, int offset, int length, int advice);
+
+/* Lock the "length" bytes of the open file "id" from "offset" on, so
+ * that programs working on different parts of one file keep out of
+ * each other's way and not out of the whole file:
+ *   LockShared -- for reading: any number of openings of the file can
+ *	hold shared locks on a range at once.
+ *   LockExclusive -- for writing: no other opening can hold any lock
+ *	on any part of the range.
+ *   LockTryShared, LockTryExclusive -- the same, but return 0 at once
+ *	rather than wait for a lock in the way to go.
+ *   LockUnlock -- let go of every lock this opening holds on any part
+ *	of the range.
+ * The range may go past the end of the file; a "length" of 0 goes to
+ * the end, however long the file grows.  The locks belong to the
+ * opening of the file "id" stands for, shared by the threads of the
+ * program, and go when it is closed; another Open of the same file is
+ * another opening.  They are advisory: Read and Write do not look at
+ * them.
+ * Return 1 on success, 0 if "id" is not open, the range or the mode is
+ * not valid, or a LockTry... found the range locked.
+ */
+#define LockUnlock	  0
+#define LockShared	  1
+#define LockExclusive	  2
+#define LockTryShared	  3
+#define LockTryExclusive  4
+
+int LockRange(OpenFileId id, int offset, int length, int mode);
+
+/* Copy "length" bytes from the open file "from" to the open file "to",
+ * starting where each is positioned (see Seek), and move both past
+ * them.  The bytes stay in the kernel.  Return how many were copied:
+ * fewer if "from" ends first or the disk fills, 0 if either file is
+ * not open.
+ */
+int CopyRange(OpenFileId from, OpenFileId to, int length);
+
+/* A file to make, for CreateMany: its name, within the directory, and
+ * its initial size (as for Create).  The kernel stores 1 in "result"
+ * if the file was created, 0 if not.
+ */
+typedef struct {
+    char *name;
+    int size;
+    int result;
+} CreateEntry;
+
+/* Create the "count" files of "entries", 1 to 32 of them, in the
+ * directory "dirName", with one system call.  The same as a Create of
+ * each in turn, but the directory is looked up once, and written back
+ * once for them all: much cheaper for many files.  A name must not
+ * have a "/" in it.  Return how many were created, or -1, creating
+ * none, if the directory does not exist or "entries" cannot be read.
+ */
+int CreateMany(char *dirName, CreateEntry *entries, int count);
+
+/* What Stat says about a file: its length in bytes, the disk sectors
+ * its data takes (a hole takes none), whether it is a file (1) or a
+ * directory (2), and how many runs of consecutive sectors its data is
+ * in -- 1 if it can be read without a seek.
+ */
+typedef struct {
+    int length;
+    int numSectors;
+    int type;
+    int numFragments;
+} FileInfo;
+
+/* Fill in "info" for the file or directory "name", without opening
+ * it.  Return 1 on success, 0 if there is no such file or "info"
+ * could not be written.
+ */
+int Stat(char *name, FileInfo *info);
+
+/* One entry of a directory, for ReadDir.  "type" is 1 for a file, 2
+ * for a directory.
+ */
+typedef struct {
+    int type;
+    char name[256];
+} DirEnt;
+
+/* Read the next entries of the directory "id" (opened with Open) into
+ * "entries", at most "count" of them, and move past them; Seek to 0
+ * starts over.  Fewer may be returned than there are left.
+ * Return how many were read, 0 at the end of the directory, or -1 if
+ * "id" is not open or "entries" cannot be written.
+ */
+int ReadDir(OpenFileId id, DirEnt *entries, int count);
+
+/* One buffer of a vectored Read or Write. */
+typedef struct {
+    char *buffer;
+    int size;
+} IoVec;
+
+/* Read into / write from the "count" buffers of "iov", in order, as if
+ * by one Read/Write call per buffer, but with a single system call.
+ * Stops after the first buffer that cannot be filled / written in full.
+ * Return the total number of bytes transferred, or -1 if "iov" itself
+ * could not be read.
+ */
+int ReadV(IoVec *iov, int count, OpenFileId id);
+int WriteV(IoVec *iov, int count, OpenFileId id);
+
+/* A system call request, for Submit.  "op" is one of SC_Create,
+ * SC_Open, SC_Read, SC_Write, SC_ReadV, SC_WriteV or SC_Close;
+ * "arg" holds its arguments in the order of the C call above.  The
+ * kernel stores the call's return value in "result".
+ */
+typedef struct {
+    int op;
+    int arg[3];
+    int result;
+} SyscallEntry;
+
+/* Run the "count" requests of "entries" in order, with one trap
+ * for the whole batch.  The batch ends early at an entry whose "op"
+ * cannot be batched.  Return the number of entries that were run.
+ */
+int Submit(SyscallEntry *entries, int count);
+
+/* Map "length" bytes of the open file "id", starting at "offset", into
+ * the address space.  Pages are read from the file when first touched;
+ * the ones written to are written back by Munmap (or when the program
+ * exits), without making the file longer.  Return the address of the
+ * mapped region, or -1 on failure.
+ */
+int Mmap(OpenFileId id, int offset, int length);
+
+/* Remove the mapping that starts at "addr".  Return 0 on success, -1
+ * if nothing is mapped there.
+ */
+int Munmap(int addr);
+
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 
  *
- * Could define other operations, such as LockAcquire, LockRelease, etc.
+ * The threads of a program share its memory, its open files and its
+ * working directory; each has a stack of its own.  A program may have
+ * 8 threads at once besides its first.  The program is done once
+ * every one of its threads is, by Exit or ThreadExit; its exit status
+ * is the value last given to Exit, 0 if none was.  Only the first
+ * thread may Fork.  FutexWait and FutexWake let the threads wait for
+ * each other.
  */
 
 /* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
+ * as the current thread.  Returning from "func" is the same as calling
+ * ThreadExit with what it returns.  Only the thread that forked it may
+ * join it.
  * Return a positive ThreadId on success, negative error code on failure
  */
 ThreadId ThreadFork(void (*func)());
@@ -174,12 +569,14 @@ void ThreadYield();
 
 /*
  * Blocks current thread until lokal thread ThreadID exits with ThreadExit.
- * Function returns the ExitCode of ThreadExit() of the exiting thread.
+ * Function returns the ExitCode of ThreadExit() of the exiting thread,
+ * or -1 if "id" is not a thread the caller forked and has not joined.
  */
 int ThreadJoin(ThreadId id);
 
 /*
- * Deletes current thread and returns ExitCode to every waiting lokal thread.
+ * Deletes current thread and returns ExitCode to the thread that
+ * forked it, if that one joins it.
  */
 void ThreadExit(int ExitCode);	
 
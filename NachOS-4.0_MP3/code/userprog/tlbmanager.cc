@@ -0,0 +1,288 @@
+// tlbmanager.cc
+//	Routines to refill and flush the entries of the simulated TLB.
+//	See tlbmanager.h for the policies.
+//
+//	The TLB itself is the machine's "tlb" array; the manager only
+//	adds, for each entry, the address space whose page table the
+//	translation came from (to write the use and dirty bits back to)
+//	and the state its policy needs.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "tlbmanager.h"
+#include "main.h"
+#include "addrspace.h"
+#include <string.h>
+
+//----------------------------------------------------------------------
+// TlbManager::TlbManager
+// 	Initialize the manager of an empty TLB.
+//
+//	"order" -- the policy used to pick an entry to replace
+//	"superpage" -- pages a superpage entry maps; 1 for none
+//	"inverted" -- refill from the inverted page table
+//----------------------------------------------------------------------
+
+TlbManager::TlbManager(TlbPolicy order, int superpage, bool inverted)
+{
+    ASSERT(kernel->machine->tlb != NULL);
+    ASSERT(superpage >= 1 && superpage <= MaxSuperpage
+	   && (superpage & (superpage - 1)) == 0);
+    policy = order;
+    superpageSize = superpage;
+    useInverted = inverted;
+    owners = new AddrSpace *[TLBSize];
+    ages = new unsigned char[TLBSize];
+    for (int i = 0; i < TLBSize; i++) {
+	kernel->machine->tlb[i].valid = FALSE;
+	owners[i] = NULL;
+	ages[i] = 0;
+    }
+    next = 0;
+}
+
+//----------------------------------------------------------------------
+// TlbManager::~TlbManager
+// 	De-allocate the manager.
+//----------------------------------------------------------------------
+
+TlbManager::~TlbManager()
+{
+    delete [] ages;
+    delete [] owners;
+}
+
+//----------------------------------------------------------------------
+// TlbManager::Refill
+// 	Handle a TLB miss on virtual page "vpn" of "space", which the
+//	caller has made sure is in memory: copy its page table entry into
+//	the TLB, tagged with the space's ASID.
+//
+//	If the page has left its frame again since (the caller may have
+//	been switched out on the way here), nothing is loaded and the
+//	program simply faults once more.
+//
+//	If the page's whole group can be mapped as a superpage, it is,
+//	replacing any entries for other pages of the group.
+//----------------------------------------------------------------------
+
+void
+TlbManager::Refill(AddrSpace *space, int vpn)
+{
+    TranslationEntry *pte = space->PageEntry(vpn);
+    TranslationEntry *tlb = kernel->machine->tlb;
+    int entry, first, frame, numPages = 1;
+
+    if (useInverted)
+	frame = kernel->frameTable->Lookup(space, vpn);
+    else
+	frame = pte->valid ? pte->physicalPage : -1;
+    if (frame == -1)
+	return;
+    first = SuperpageOf(space, vpn);
+    if (first >= 0) {
+	for (int page = first; page < first + superpageSize; page++)
+	    Flush(space, page);
+	frame -= vpn - first;		// the group's frames are in order
+	vpn = first;
+	pte = space->PageEntry(first);
+	numPages = superpageSize;
+    }
+    entry = ChooseEntry();
+    Invalidate(entry);
+
+    tlb[entry].virtualPage = vpn;
+    tlb[entry].physicalPage = frame;
+    tlb[entry].valid = TRUE;
+    tlb[entry].readOnly = pte->readOnly;
+    tlb[entry].asid = space->Asid();
+    tlb[entry].numPages = numPages;
+    tlb[entry].use = FALSE;
+    tlb[entry].dirty = FALSE;
+    owners[entry] = space;
+    ages[entry] = 0;
+    DEBUG(dbgAddr, "TLB entry " << entry << " now maps " << numPages
+		    << " pages from " << tlb[entry].virtualPage
+		    << " of address space " << space->Asid());
+}
+
+//----------------------------------------------------------------------
+// TlbManager::SuperpageOf
+// 	Return the first page of the superpage that virtual page "vpn"
+//	of "space" can be mapped by, or -1 if it has to be mapped alone:
+//	there are no superpages, or some page of its group is not in
+//	memory, is not in the next frame, or is protected otherwise.
+//----------------------------------------------------------------------
+
+int
+TlbManager::SuperpageOf(AddrSpace *space, int vpn)
+{
+    int first = vpn & ~(superpageSize - 1);
+    TranslationEntry *base;
+
+    if (superpageSize == 1 || first + superpageSize > space->TableSize())
+	return -1;
+    base = space->PageEntry(first);
+    if (!base->valid || base->physicalPage % superpageSize != 0)
+	return -1;
+    for (int i = 1; i < superpageSize; i++) {
+	TranslationEntry *pte = space->PageEntry(first + i);
+
+	if (!pte->valid || pte->physicalPage != base->physicalPage + i
+	    || pte->readOnly != base->readOnly)
+	    return -1;
+    }
+    return first;
+}
+
+//----------------------------------------------------------------------
+// TlbManager::Flush
+// 	Drop the TLB entry for virtual page "vpn" of "space", if it has
+//	one, folding its use and dirty bits into the page table first.
+//	Must be called before the page leaves its frame.  A superpage
+//	entry that maps it goes, and the rest of its pages with it.
+//----------------------------------------------------------------------
+
+void
+TlbManager::Flush(AddrSpace *space, int vpn)
+{
+    TranslationEntry *tlb = kernel->machine->tlb;
+
+    for (int i = 0; i < TLBSize; i++) {
+	if (owners[i] == space && vpn >= tlb[i].virtualPage
+	    && vpn < tlb[i].virtualPage + tlb[i].numPages)
+	    Invalidate(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// TlbManager::FlushSpace
+// 	Drop every TLB entry of "space", which is being destroyed.  Its
+//	ASID is never used again, but the entries would otherwise keep
+//	pointing at its page table.
+//----------------------------------------------------------------------
+
+void
+TlbManager::FlushSpace(AddrSpace *space)
+{
+    for (int i = 0; i < TLBSize; i++) {
+	if (owners[i] == space)
+	    Invalidate(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// TlbManager::SyncBits
+// 	Fold the use and dirty bits of every TLB entry into the page
+//	tables, so that the frame table's policies see them.
+//----------------------------------------------------------------------
+
+void
+TlbManager::SyncBits()
+{
+    for (int i = 0; i < TLBSize; i++) {
+	if (owners[i] != NULL)
+	    WriteBack(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// TlbManager::WriteBack
+// 	Fold the use and dirty bits of TLB entry "entry" into the page
+//	table entries it was loaded from, every page of a superpage.
+//	The use bit stays set in the TLB, for the LRU policy; the dirty
+//	bit has been recorded and is cleared.
+//----------------------------------------------------------------------
+
+void
+TlbManager::WriteBack(int entry)
+{
+    TranslationEntry *e = &(kernel->machine->tlb[entry]);
+
+    for (int i = 0; i < e->numPages; i++) {
+	TranslationEntry *pte = owners[entry]->PageEntry(e->virtualPage + i);
+
+	ASSERT(pte->valid && pte->physicalPage == e->physicalPage + i);
+	if (e->use)
+	    pte->use = TRUE;
+	if (e->dirty)
+	    pte->dirty = TRUE;
+    }
+    e->dirty = FALSE;
+}
+
+//----------------------------------------------------------------------
+// TlbManager::Invalidate
+// 	Empty TLB entry "entry", writing its bits back first.
+//----------------------------------------------------------------------
+
+void
+TlbManager::Invalidate(int entry)
+{
+    if (owners[entry] != NULL)
+	WriteBack(entry);
+    kernel->machine->tlb[entry].valid = FALSE;
+    kernel->machine->FlushTranslations();
+    owners[entry] = NULL;
+}
+
+//----------------------------------------------------------------------
+// TlbManager::ChooseEntry
+// 	Pick, according to the policy, the TLB entry to load a new
+//	translation into.  An empty entry is always taken first.
+//----------------------------------------------------------------------
+
+int
+TlbManager::ChooseEntry()
+{
+    TranslationEntry *tlb = kernel->machine->tlb;
+    int i, best;
+
+    for (i = 0; i < TLBSize; i++) {
+	if (owners[i] == NULL)
+	    return i;
+    }
+    switch (policy) {
+      case TlbRandom:
+	return RandomNumber() % TLBSize;
+      case TlbLRU:
+	best = 0;
+	for (i = 0; i < TLBSize; i++) {
+	    WriteBack(i);
+	    ages[i] = (ages[i] >> 1) | (tlb[i].use ? 0x80 : 0);
+	    tlb[i].use = FALSE;
+	    if (ages[i] < ages[best])
+		best = i;
+	}
+	return best;
+      case TlbFIFO:
+      default:
+	best = next;
+	next = (next + 1) % TLBSize;
+	return best;
+    }
+}
+
+//----------------------------------------------------------------------
+// TlbManager::ParsePolicy
+// 	Look up a TLB replacement policy by name.  Return FALSE if "name"
+//	is not one we know.
+//----------------------------------------------------------------------
+
+bool
+TlbManager::ParsePolicy(char *name, TlbPolicy *order)
+{
+    if (strcmp(name, "random") == 0) {
+	*order = TlbRandom;
+    } else if (strcmp(name, "fifo") == 0) {
+	*order = TlbFIFO;
+    } else if (strcmp(name, "lru") == 0) {
+	*order = TlbLRU;
+    } else {
+	return FALSE;
+    }
+    return TRUE;
+}
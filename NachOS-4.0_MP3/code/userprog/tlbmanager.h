@@ -0,0 +1,101 @@
+// tlbmanager.h
+//	Data structures for managing the simulated machine's TLB, when
+//	Nachos is built with USE_TLB.
+//
+//	In that mode the hardware never looks at a page table: a virtual
+//	address that is not in the TLB raises a PageFaultException, and
+//	the kernel refills a TLB entry from the address space's page table
+//	(paging the page in first, if it has to).  Which entry gets
+//	replaced is chosen by one of several policies:
+//
+//	   RANDOM -- any entry, as the MIPS "random" register would pick
+//	   FIFO -- the entries in turn, the oldest refill going first
+//	   LRU -- an approximation of least recently used: at each refill
+//		every entry's use bit is shifted into an 8 bit age, and
+//		the entry with the lowest age goes
+//
+//	An empty entry is always used first.
+//
+//	Every TLB entry is tagged with the address space id (ASID) of the
+//	program it belongs to, and only matches while the machine's ASID
+//	register holds that id.  So a context switch just loads the
+//	register, and the entries of a program that was switched out are
+//	still there when it comes back, unless they were replaced.
+//
+//	The hardware sets the use and dirty bits in the TLB entry, not in
+//	the page table.  They are folded back into the page table entry
+//	when the TLB entry is replaced or flushed, and before the frame
+//	table chooses a page to evict, since its policies go by them.  A
+//	page's entry is always flushed before the page leaves its frame.
+//
+//	With -sp, an aligned group of pages that are all in memory, in
+//	frames that are aligned and in order, and all writable or all
+//	read-only, is loaded as one superpage entry, so that the four
+//	entries reach further.  The frame table places a group's pages
+//	that way when it can (see FrameTable::Allocate).  The use and
+//	dirty bits of a superpage entry are folded into every page of
+//	it: one written page makes them all dirty.
+//
+//	With -ipt, a refill finds the frame of the page in the frame
+//	table's inverted page table, hashed by page, rather than in the
+//	address space's page table; only the protection is taken from
+//	the latter.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef TLBMANAGER_H
+#define TLBMANAGER_H
+
+class AddrSpace;
+
+const int MaxSuperpage = 16;		// most pages a TLB entry maps
+
+enum TlbPolicy { TlbRandom, TlbFIFO, TlbLRU };
+
+// The following class defines the kernel's view of the TLB.
+
+class TlbManager {
+  public:
+    TlbManager(TlbPolicy order, int superpage, bool inverted);
+					// Start with an empty TLB
+    ~TlbManager();			// De-allocate the manager
+
+    void Refill(AddrSpace *space, int vpn);
+					// Load the translation of "vpn"
+					// after a TLB miss
+    void Flush(AddrSpace *space, int vpn);
+					// Drop the entry for "vpn", if any
+    void FlushSpace(AddrSpace *space);	// Drop all of the entries of an
+					// address space that is going away
+    void SyncBits();			// Fold every entry's use and
+					// dirty bits into the page tables
+
+    static bool ParsePolicy(char *name, TlbPolicy *order);
+					// Map "random", "fifo" or "lru"
+					// to a policy
+
+  private:
+    TlbPolicy policy;			// how to pick an entry to replace
+    AddrSpace **owners;			// whose translation each entry
+					// holds, NULL if it is empty
+    unsigned char *ages;		// LRU: recent history of each
+					// entry's use bit, newest on top
+    int next;				// FIFO: the entry to replace next
+    int superpageSize;			// pages of a superpage entry; 1
+					// if there are none
+    bool useInverted;			// find frames in the inverted
+					// page table?
+
+    int SuperpageOf(AddrSpace *space, int vpn);
+					// first page of the superpage that
+					// can map "vpn"; -1 if none
+    int ChooseEntry();			// the entry to replace, by policy
+    void WriteBack(int entry);		// fold entry's bits into its pte
+    void Invalidate(int entry);		// write back and empty an entry
+};
+
+#endif // TLBMANAGER_H